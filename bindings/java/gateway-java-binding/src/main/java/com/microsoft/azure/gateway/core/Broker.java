@@ -7,12 +7,17 @@ package com.microsoft.azure.gateway.core;
 import com.microsoft.azure.gateway.messaging.Message;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.List;
 
 public class Broker {
 
     private long brokerAddr;
     private LocalBroker localBroker;
 
+    /** Direct buffer reused for every batch published by {@link #publishMessages(List, long)} */
+    private ByteBuffer batch;
+
     protected Broker() {
     }
 
@@ -41,6 +46,49 @@ public class Broker {
         return this.localBroker.publishMessage(this.brokerAddr, moduleAddr, message.toByteArray());
     }
 
+    /**
+     * Publishes the {@link Message}s to the {@link Broker} as one batch, crossing into native code once.
+     *
+     * @see <a href=
+     *      "https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/message_broker_requirements.md"
+     *      target="_top">Message broker documentation</a>
+     *
+     * @param messages
+     *            The {@link Message}s to be published, in order.
+     * @param moduleAddr
+     *            The address of the pointer to the native module.
+     * @return 0 on success, non-zero otherwise.
+     * @throws IOException
+     *             If a {@link Message} cannot be serialized.
+     */
+    public synchronized int publishMessages(List<Message> messages, long moduleAddr) throws IOException {
+        if (messages == null || messages.isEmpty()) {
+            throw new IllegalArgumentException("There are no messages to publish.");
+        }
+
+        byte[][] serialized = new byte[messages.size()][];
+        int size = 0;
+        for (int i = 0; i < serialized.length; i++) {
+            serialized[i] = messages.get(i).toByteArray();
+            size += 4 + serialized[i].length;
+        }
+
+        if (this.batch == null || this.batch.capacity() < size) {
+            this.batch = ByteBuffer.allocateDirect(Math.max(size, 2 * (this.batch == null ? 0 : this.batch.capacity())));
+        }
+
+        this.batch.clear();
+        for (byte[] message : serialized) {
+            this.batch.putInt(message.length);
+            this.batch.put(message);
+        }
+        if (this.batch.remaining() >= 4) {
+            this.batch.putInt(0);
+        }
+
+        return this.localBroker.publishMessages(this.brokerAddr, moduleAddr, this.batch);
+    }
+
     public long getAddress() {
         return this.brokerAddr;
     }
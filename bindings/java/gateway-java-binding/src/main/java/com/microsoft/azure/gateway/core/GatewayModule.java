@@ -7,6 +7,8 @@ package com.microsoft.azure.gateway.core;
 import com.microsoft.azure.gateway.messaging.Message;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.List;
 
 /**
  * The Abstract {@link GatewayModule} class to be extended by the module-creator when creating any modules.
@@ -57,6 +59,17 @@ public abstract class GatewayModule implements IGatewayModule{
         this.receive(new Message(serializedMessage));
     }
 
+    /**
+     * Called by the native module host instead of {@link #receive(byte[])}. The buffer is a direct {@link ByteBuffer}
+     * over native memory that is only valid until this method returns.
+     *
+     * @param serializedMessage The serialized message
+     */
+    public void receive(ByteBuffer serializedMessage){
+        /*Codes_SRS_JAVA_GATEWAY_MODULE_17_001: [ The function shall deserialize the ByteBuffer into a Message and pass it to receive(Message). ]*/
+        this.receive(new Message(serializedMessage));
+    }
+
     /**
      * Publishes the {@link Message} to the {@link Broker}.
      *
@@ -68,6 +81,18 @@ public abstract class GatewayModule implements IGatewayModule{
         return this.broker.publishMessage(message, this._addr);
     }
 
+    /**
+     * Publishes the {@link Message}s to the {@link Broker} as one batch. Cheaper than publishing them one at a time.
+     *
+     * @param messages The {@link Message}s to be published, in order
+     * @return 0 on success, non-zero otherwise. See <a href="https://github.com/Azure/azure-iot-gateway-sdk/blob/master/core/devdoc/message_broker_requirements.md" target="_top">Message broker documentation</a>.
+     * @throws IOException If a {@link Message} cannot be serialized.
+     */
+    public int publish(List<Message> messages) throws IOException {
+        /*Codes_SRS_JAVA_GATEWAY_MODULE_17_002: [ The function shall publish the messages to the broker as one batch. ]*/
+        return this.broker.publishMessages(messages, this._addr);
+    }
+
     //Public getter methods
 
     final public Broker getBroker(){
@@ -28,6 +28,9 @@ public interface IGatewayModule {
      *
      * The destroy() and receive() methods are guaranteed to not be called simultaneously.
      *
+     * If the module also has a {@code public void receive(java.nio.ByteBuffer source)} method, that method is
+     * called instead, with a direct buffer that is only valid until it returns.
+     *
      * @param source The serialized message
      */
     void receive(byte[] source);
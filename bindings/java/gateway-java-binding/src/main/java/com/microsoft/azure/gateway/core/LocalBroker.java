@@ -6,6 +6,8 @@ package com.microsoft.azure.gateway.core;
 
 import com.microsoft.azure.gateway.messaging.Message;
 
+import java.nio.ByteBuffer;
+
 class LocalBroker {
 
     // Loads the native library
@@ -26,4 +28,16 @@ class LocalBroker {
      * @return 0 on success, non-zero otherwise.
      */
     native int publishMessage(long brokerAddr, long moduleAddr, byte[] message);
+
+    /**
+     * Native batched Broker_Publish function. Publishes every {@link Message} in the batch to the native Broker
+     * with a single native call.
+     *
+     * @param brokerAddr The address of the pointer to the native Broker.
+     * @param moduleAddr The address of the pointer to the native module.
+     * @param batch A direct buffer of frames, each the length of a serialized {@link Message} as a big-endian int
+     *              followed by the serialized {@link Message}, ended by a frame of length 0 or the end of the buffer.
+     * @return 0 on success, non-zero otherwise.
+     */
+    native int publishMessages(long brokerAddr, long moduleAddr, ByteBuffer batch);
 }
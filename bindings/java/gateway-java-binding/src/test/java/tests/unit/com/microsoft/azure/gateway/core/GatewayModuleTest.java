@@ -9,8 +9,14 @@ import com.microsoft.azure.gateway.core.Broker;
 import com.microsoft.azure.gateway.messaging.Message;
 import mockit.Deencapsulation;
 import mockit.Mocked;
+import mockit.Verifications;
 import org.junit.Test;
 
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.List;
+
 import static org.junit.Assert.assertEquals;
 
 public class GatewayModuleTest {
@@ -43,6 +49,25 @@ public class GatewayModuleTest {
         GatewayModule module = new TestModule(address, null, null);
     }
 
+    /*Tests_SRS_JAVA_GATEWAY_MODULE_17_002: [ The function shall publish the messages to the broker as one batch. ]*/
+    @Test
+    public void publishListPublishesOneBatchSuccess() throws IOException {
+        final long address = 0x12345678;
+        final List<Message> messages = Arrays.asList(
+                new Message(new byte[]{ 1 }, new HashMap<String, String>()),
+                new Message(new byte[]{ 2 }, new HashMap<String, String>()));
+
+        GatewayModule module = new TestModule(address, mockBroker, null);
+        module.publish(messages);
+
+        new Verifications(){{
+            mockBroker.publishMessages(messages, address);
+            times = 1;
+            mockBroker.publishMessage((Message)any, anyLong);
+            times = 0;
+        }};
+    }
+
     public class TestModule extends GatewayModule{
 
         /**
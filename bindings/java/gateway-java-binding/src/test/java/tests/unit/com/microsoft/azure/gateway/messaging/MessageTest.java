@@ -11,6 +11,7 @@ import org.junit.Test;
 
 import java.io.DataOutputStream;
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Map;
@@ -186,6 +187,40 @@ public class MessageTest {
         assertTrue(Arrays.equals(expectedContent, actualContent));
     }
 
+    /*Tests_SRS_JAVA_MESSAGE_17_001: [ The constructor shall create a Message object by deserializing the ByteBuffer from its position to its limit, without changing the position. ]*/
+    @Test
+    public void constructorSetsDataFromDirectByteBuffer_Valid() throws IOException {
+
+        Map<String, String> expected = new HashMap<String, String>();
+        expected.put("BleedingEdge", "rocks");
+        expected.put("Azure IoT Gateway is", "awesome");
+        byte[] expectedContent = "34".getBytes();
+
+        ByteBuffer buffer = ByteBuffer.allocateDirect(validMessage.length);
+        buffer.put(validMessage);
+        buffer.flip();
+
+        Message message = new Message(buffer);
+
+        assertEquals(expected, message.getProperties());
+        assertTrue(Arrays.equals(expectedContent, message.getContent()));
+        assertEquals(0, buffer.position());
+    }
+
+    /*Tests_SRS_JAVA_MESSAGE_17_002: [ If the ByteBuffer is malformed, the function shall throw an IllegalArgumentException. ]*/
+    @Test(expected = IllegalArgumentException.class)
+    public void constructorThrowsExceptionForUnterminatedPropertyInByteBuffer(){
+        final byte[] source =
+            {
+                (byte)0xA1, 0x60,             /*header*/
+                0x00, 0x00, 0x00, 18,   /*size of this array*/
+                0x00, 0x00, 0x00, 0x01, /*one property*/
+                '1', '2'
+            };
+
+        Message message = new Message(ByteBuffer.wrap(source));
+    }
+
     /*Tests_SRS_JAVA_MESSAGE_14_004: [ The function shall serialize the Message content and properties according to the specification in message.h ]*/
     @Test
     public void toByteArraySerializesMinimalMessageSuccess() throws IOException {
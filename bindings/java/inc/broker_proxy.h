@@ -15,6 +15,14 @@ extern "C" {
 JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessage
   (JNIEnv *, jobject, jlong, jlong, jbyteArray);
 
+/*
+ * Class:     com_microsoft_azure_gateway_core_Broker
+ * Method:    publishMessages
+ * Signature: (JJLjava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessages
+  (JNIEnv *, jobject, jlong, jlong, jobject);
+
 #ifdef __cplusplus
 }
 #endif
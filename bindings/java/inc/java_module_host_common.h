@@ -11,6 +11,7 @@
 #define MODULE_START_METHOD_NAME "start"
 #define MODULE_DESTROY_DESCRIPTOR "()V"
 #define MODULE_RECEIVE_DESCRIPTOR "([B)V"
+#define MODULE_RECEIVE_BUFFER_DESCRIPTOR "(Ljava/nio/ByteBuffer;)V"
 #define MODULE_START_DESCRIPTOR "()V"
 #define BROKER_CONSTRUCTOR_DESCRIPTOR "(J)V"
 #define MODULE_CONSTRUCTOR_DESCRIPTOR "(JLcom/microsoft/azure/gateway/core/Broker;Ljava/lang/String;)V"
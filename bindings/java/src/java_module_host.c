@@ -49,6 +49,12 @@ typedef signed char jbyte;
 #endif //UNDER_TEST
 
 #include <stdio.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "broker_proxy.h"
 #include "local_broker_proxy.h"
 #include "java_module_host_common.h"
@@ -79,8 +85,16 @@ typedef struct JAVA_MODULE_HANDLE_DATA_TAG
     jobject module;
     char* moduleName;
     JAVA_MODULE_HOST_MANAGER_HANDLE manager;
+    jmethodID receive_method;
+    bool receive_by_buffer;
 }JAVA_MODULE_HANDLE_DATA;
 
+/* Local references created by one call to JavaModuleHost_Receive: the module class, the serialized message and a pending exception */
+#define RECEIVE_LOCAL_FRAME_CAPACITY 3
+
+/* Every frame of a batch handed to publishMessages starts with the length of its message as a big-endian int */
+#define BATCH_FRAME_HEADER_SIZE 4
+
 static int JVM_Create(JavaVM** jvm, JNIEnv** env, JVM_OPTIONS* options);
 static void JVM_Destroy(JavaVM** jvm);
 static void destroy_module_internal(JAVA_MODULE_HANDLE_DATA* module, bool decref);
@@ -89,6 +103,8 @@ static void deinit_vm_options(JavaVMInitArgs* jvm_args, VECTOR_HANDLE options_st
 static jobject NewObjectInternal(JNIEnv* env, jclass clazz, jmethodID methodID, int args_count, ...);
 static void CallVoidMethodInternal(JNIEnv* env, jobject obj, jmethodID methodID, int args_count, ...);
 static jmethodID get_module_method(JAVA_MODULE_HANDLE_DATA* module, const char* method_name, const char* method_descriptor);
+static JNIEnv* attach_worker_thread(JavaVM* jvm, bool* detach);
+static int get_receive_method(JAVA_MODULE_HANDLE_DATA* module, JNIEnv* env);
 
 static MODULE_HANDLE JavaModuleHost_Create(BROKER_HANDLE broker, const void* configuration)
 {
@@ -125,6 +141,8 @@ static MODULE_HANDLE JavaModuleHost_Create(BROKER_HANDLE broker, const void* con
                 result->env = NULL;
                 result->jvm = NULL;
                 result->moduleName = (char*)config->class_name;
+                result->receive_method = NULL;
+                result->receive_by_buffer = false;
 
                 /*Codes_SRS_JAVA_MODULE_HOST_14_037: [This function shall get a singleton instance of a JavaModuleHostManager. ]*/
                 result->manager = JavaModuleHostManager_Create(config);
@@ -404,57 +422,93 @@ static void JavaModuleHost_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
                 Message_ToByteArray(message, serialized_message, size);
 
                 /*Codes_SRS_JAVA_MODULE_HOST_14_042: [This function shall attach the JVM to the current thread.]*/
-                jint jni_result = JNIFunc(moduleHandle->jvm, AttachCurrentThread, (void**)(&(moduleHandle->env)), NULL);
-
-                if (jni_result == JNI_OK)
+                bool detach;
+                JNIEnv* env = attach_worker_thread(moduleHandle->jvm, &detach);
+                if (env == NULL)
+                {
+                    /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+                    LogError("Could not attach the current thread to the JVM.");
+                }
+                /*Codes_SRS_JAVA_MODULE_HOST_17_003: [This function shall release every local reference it creates before returning.]*/
+                else if (JNIFunc(env, PushLocalFrame, RECEIVE_LOCAL_FRAME_CAPACITY) != JNI_OK)
+                {
+                    /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+                    LogError("Could not push a local reference frame.");
+                    JNIFunc(env, ExceptionClear);
+                }
+                else
                 {
-                    /*Codes_SRS_JAVA_MODULE_HOST_14_043: [This function shall create a new jbyteArray for the serialized message.]*/
-                    jbyteArray arr = JNIFunc(moduleHandle->env, NewByteArray, size);
-                    if (arr == NULL)
+                    /*Codes_SRS_JAVA_MODULE_HOST_14_045: [This function shall get the user - defined Java module class using the module parameter and get the receive() method.]*/
+                    if (moduleHandle->receive_method == NULL && get_receive_method(moduleHandle, env) != 0)
                     {
                         /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-                        LogError("New jbyteArray could not be constructed.");
+                        LogError("Failed to get the %s receive() method.", moduleHandle->moduleName);
                     }
                     else
                     {
-                        /*Codes_SRS_JAVA_MODULE_HOST_14_044: [This function shall set the contents of the jbyteArray to the serialized_message.]*/
-                        JNIFunc(moduleHandle->env, SetByteArrayRegion, arr, 0, size, (jbyte*)serialized_message);
-                        jthrowable exception = JNIFunc(moduleHandle->env, ExceptionOccurred);
-                        if (exception)
+                        jobject source;
+                        if (moduleHandle->receive_by_buffer)
                         {
-                            /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-                            LogError("Exception occurred in SetByteArrayRegion.");
-                            JNIFunc(moduleHandle->env, ExceptionDescribe);
-                            JNIFunc(moduleHandle->env, ExceptionClear);
+                            /*Codes_SRS_JAVA_MODULE_HOST_17_005: [This function shall wrap the serialized message in a direct java.nio.ByteBuffer when the module has a receive(ByteBuffer) method.]*/
+                            source = JNIFunc(env, NewDirectByteBuffer, serialized_message, size);
+                            if (source == NULL)
+                            {
+                                /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+                                LogError("New direct ByteBuffer could not be constructed.");
+                                JNIFunc(env, ExceptionClear);
+                            }
                         }
                         else
                         {
-                            /*Codes_SRS_JAVA_MODULE_HOST_14_045: [This function shall get the user - defined Java module class using the module parameter and get the receive() method.]*/
-                            jmethodID jModule_receive = get_module_method(moduleHandle, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR);
-                            if (jModule_receive == NULL)
+                            /*Codes_SRS_JAVA_MODULE_HOST_14_043: [This function shall create a new jbyteArray for the serialized message.]*/
+                            source = JNIFunc(env, NewByteArray, size);
+                            if (source == NULL)
                             {
                                 /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-                                LogError("Failed to get the %s receive() method.", moduleHandle->moduleName);
+                                LogError("New jbyteArray could not be constructed.");
                             }
                             else
                             {
-                                /*Codes_SRS_JAVA_MODULE_HOST_14_024: [This function shall call the void receive(byte[] source) method of the Java module object passing the serialized message.]*/
-                                CallVoidMethodInternal(moduleHandle->env, moduleHandle->module, jModule_receive, 1, arr);
-                                exception = JNIFunc(moduleHandle->env, ExceptionOccurred);
+                                /*Codes_SRS_JAVA_MODULE_HOST_14_044: [This function shall set the contents of the jbyteArray to the serialized_message.]*/
+                                JNIFunc(env, SetByteArrayRegion, (jbyteArray)source, 0, size, (jbyte*)serialized_message);
+                                jthrowable exception = JNIFunc(env, ExceptionOccurred);
                                 if (exception)
                                 {
                                     /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-                                    LogError("Exception occurred in receive() of %s.", moduleHandle->moduleName);
-                                    JNIFunc(moduleHandle->env, ExceptionDescribe);
-                                    JNIFunc(moduleHandle->env, ExceptionClear);
+                                    LogError("Exception occurred in SetByteArrayRegion.");
+                                    JNIFunc(env, ExceptionDescribe);
+                                    JNIFunc(env, ExceptionClear);
+                                    source = NULL;
                                 }
                             }
                         }
-                        JNIFunc(moduleHandle->env, DeleteLocalRef, arr);
+
+                        if (source != NULL)
+                        {
+                            /*Codes_SRS_JAVA_MODULE_HOST_14_024: [This function shall call the void receive(byte[] source) method of the Java module object passing the serialized message.]*/
+                            CallVoidMethodInternal(env, moduleHandle->module, moduleHandle->receive_method, 1, source);
+                            jthrowable exception = JNIFunc(env, ExceptionOccurred);
+                            if (exception)
+                            {
+                                /*Codes_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+                                LogError("Exception occurred in receive() of %s.", moduleHandle->moduleName);
+                                JNIFunc(env, ExceptionDescribe);
+                                JNIFunc(env, ExceptionClear);
+                            }
+                        }
                     }
-                    /*Codes_SRS_JAVA_MODULE_HOST_14_046: [This function shall detach the JVM from the current thread.]*/
+
+                    /*Codes_SRS_JAVA_MODULE_HOST_17_003: [This function shall release every local reference it creates before returning.]*/
+                    (void)JNIFunc(env, PopLocalFrame, NULL);
+                }
+
+                if (detach)
+                {
+                    /*Codes_SRS_JAVA_MODULE_HOST_14_046: [This function shall detach the JVM from the current thread if it could not arrange for the thread to be detached when it exits.]*/
                     JNIFunc(moduleHandle->jvm, DetachCurrentThread);
                 }
+
+                /*Codes_SRS_JAVA_MODULE_HOST_17_006: [This function shall free the serialized message after receive() returns.]*/
                 free(serialized_message);
             }
         }
@@ -599,6 +653,116 @@ JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessa
     return result;
 }
 
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_LocalBroker_publishMessages(JNIEnv* env, jobject jBroker, jlong broker_address, jlong module_address, jobject batch)
+{
+    return Java_com_microsoft_azure_gateway_core_Broker_publishMessages(env, jBroker, broker_address, module_address, batch);
+}
+
+/*reads the big-endian length of the frame at frame, returns 0 when the batch ends there*/
+static int32_t batch_frame_length(const unsigned char* frame, size_t remaining)
+{
+    int32_t length;
+    if (remaining < BATCH_FRAME_HEADER_SIZE)
+    {
+        length = 0;
+    }
+    else
+    {
+        length = (int32_t)(((uint32_t)frame[0] << 24) | ((uint32_t)frame[1] << 16) | ((uint32_t)frame[2] << 8) | (uint32_t)frame[3]);
+    }
+    return length;
+}
+
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_core_Broker_publishMessages(JNIEnv* env, jobject jBroker, jlong broker_address, jlong module_address, jobject batch)
+{
+    (void)jBroker;
+    /*Codes_SRS_JAVA_MODULE_HOST_17_011: [ This function shall return a non-zero value if the batch is malformed or any underlying function call fails. ]*/
+    BROKER_RESULT result = BROKER_ERROR;
+
+    BROKER_HANDLE broker = (BROKER_HANDLE)broker_address;
+    MODULE_HANDLE module = (MODULE_HANDLE)module_address;
+
+    /*Codes_SRS_JAVA_MODULE_HOST_17_007: [ This function shall read the batch in place from the memory of the direct ByteBuffer batch. ]*/
+    const unsigned char* frames = (const unsigned char*)JNIFunc(env, GetDirectBufferAddress, batch);
+    jlong capacity = JNIFunc(env, GetDirectBufferCapacity, batch);
+    if (frames == NULL || capacity <= 0)
+    {
+        LogError("Batch is not a direct buffer.");
+    }
+    else
+    {
+        /*Codes_SRS_JAVA_MODULE_HOST_17_008: [ The batch shall be a sequence of frames, each a 4 byte big-endian length followed by that many bytes of serialized message, ended by a frame of length 0 or by the end of the buffer. ]*/
+        size_t size = (size_t)capacity;
+        size_t offset = 0;
+        size_t count = 0;
+        bool malformed = false;
+        int32_t length;
+        while (!malformed && (length = batch_frame_length(frames + offset, size - offset)) != 0)
+        {
+            if (length < 0 || (size_t)length > size - offset - BATCH_FRAME_HEADER_SIZE)
+            {
+                LogError("Frame %zu of the batch is %d bytes long, %zu bytes are left.", count, (int)length, size - offset - BATCH_FRAME_HEADER_SIZE);
+                malformed = true;
+            }
+            else
+            {
+                offset += BATCH_FRAME_HEADER_SIZE + (size_t)length;
+                count++;
+            }
+        }
+
+        if (malformed)
+        {
+            /*Codes_SRS_JAVA_MODULE_HOST_17_011: [ This function shall return a non-zero value if the batch is malformed or any underlying function call fails. ]*/
+        }
+        else if (count == 0)
+        {
+            LogError("Batch has no messages.");
+        }
+        else
+        {
+            MESSAGE_HANDLE* messages = (MESSAGE_HANDLE*)malloc(count * sizeof(MESSAGE_HANDLE));
+            if (messages == NULL)
+            {
+                LogError("Malloc failure.");
+            }
+            else
+            {
+                size_t created = 0;
+                offset = 0;
+                while (created < count)
+                {
+                    length = batch_frame_length(frames + offset, size - offset);
+                    /*Codes_SRS_JAVA_MODULE_HOST_17_009: [ This function shall create each message with Message_CreateFromByteArray straight from its frame, without copying the batch. ]*/
+                    messages[created] = Message_CreateFromByteArray(frames + offset + BATCH_FRAME_HEADER_SIZE, length);
+                    if (messages[created] == NULL)
+                    {
+                        LogError("Message %zu could not be created from the batch.", created);
+                        break;
+                    }
+                    offset += BATCH_FRAME_HEADER_SIZE + (size_t)length;
+                    created++;
+                }
+
+                if (created == count)
+                {
+                    /*Codes_SRS_JAVA_MODULE_HOST_17_010: [ This function shall publish the messages to the BROKER_HANDLE addressed by broker_address with a single call to Broker_PublishBatch and return the value of this function call. ]*/
+                    result = Broker_PublishBatch(broker, module, messages, count);
+                }
+
+                //Cleanup
+                while (created > 0)
+                {
+                    Message_Destroy(messages[--created]);
+                }
+                free(messages);
+            }
+        }
+    }
+
+    return result;
+}
+
 //Internal functions
 static jmethodID get_module_method(JAVA_MODULE_HANDLE_DATA* module, const char* method_name, const char* method_descriptor)
 {
@@ -624,6 +788,146 @@ static jmethodID get_module_method(JAVA_MODULE_HANDLE_DATA* module, const char*
     return jModule_method;
 }
 
+/*Broker worker threads stay attached to the JVM between messages, a thread-local destructor detaches them when they exit.*/
+#ifdef _WIN32
+static INIT_ONCE g_detach_once = INIT_ONCE_STATIC_INIT;
+static DWORD g_detach_key = FLS_OUT_OF_INDEXES;
+
+static void WINAPI detach_worker_thread(PVOID jvm)
+{
+    if (jvm != NULL)
+    {
+        /*Codes_SRS_JAVA_MODULE_HOST_17_002: [A broker worker thread attached by this function shall be detached from the JVM when the thread exits.]*/
+        (void)JNIFunc((JavaVM*)jvm, DetachCurrentThread);
+    }
+}
+
+static BOOL CALLBACK create_detach_key(PINIT_ONCE once, PVOID parameter, PVOID* context)
+{
+    (void)once;
+    (void)parameter;
+    (void)context;
+    g_detach_key = FlsAlloc(detach_worker_thread);
+    return TRUE;
+}
+
+static int detach_at_thread_exit(JavaVM* jvm)
+{
+    int result;
+    (void)InitOnceExecuteOnce(&g_detach_once, create_detach_key, NULL, NULL);
+    if (g_detach_key == FLS_OUT_OF_INDEXES || !FlsSetValue(g_detach_key, jvm))
+    {
+        LogError("Could not register the thread to be detached from the JVM when it exits.");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+#else
+static pthread_once_t g_detach_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_detach_key;
+static bool g_detach_key_created = false;
+
+static void detach_worker_thread(void* jvm)
+{
+    /*Codes_SRS_JAVA_MODULE_HOST_17_002: [A broker worker thread attached by this function shall be detached from the JVM when the thread exits.]*/
+    (void)JNIFunc((JavaVM*)jvm, DetachCurrentThread);
+}
+
+static void create_detach_key(void)
+{
+    g_detach_key_created = (pthread_key_create(&g_detach_key, detach_worker_thread) == 0);
+}
+
+static int detach_at_thread_exit(JavaVM* jvm)
+{
+    int result;
+    (void)pthread_once(&g_detach_once, create_detach_key);
+    if (!g_detach_key_created || pthread_setspecific(g_detach_key, jvm) != 0)
+    {
+        LogError("Could not register the thread to be detached from the JVM when it exits.");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+#endif
+
+static JNIEnv* attach_worker_thread(JavaVM* jvm, bool* detach)
+{
+    JNIEnv* env = NULL;
+    *detach = false;
+
+    /*Codes_SRS_JAVA_MODULE_HOST_17_001: [This function shall attach the current thread to the JVM only if it is not attached yet, and leave it attached after the message is delivered.]*/
+    jint jni_result = JNIFunc(jvm, GetEnv, (void**)(&env), JNI_VERSION_1_4);
+    if (jni_result == JNI_EDETACHED)
+    {
+        jni_result = JNIFunc(jvm, AttachCurrentThreadAsDaemon, (void**)(&env), NULL);
+        if (jni_result != JNI_OK)
+        {
+            LogError("Could not attach the current thread to the JVM. (Result: %i)", jni_result);
+            env = NULL;
+        }
+        else if (detach_at_thread_exit(jvm) != 0)
+        {
+            /*Codes_SRS_JAVA_MODULE_HOST_14_046: [This function shall detach the JVM from the current thread if it could not arrange for the thread to be detached when it exits.]*/
+            *detach = true;
+        }
+    }
+    else if (jni_result != JNI_OK)
+    {
+        LogError("Could not get the JNI environment of the current thread. (Result: %i)", jni_result);
+        env = NULL;
+    }
+
+    return env;
+}
+
+static int get_receive_method(JAVA_MODULE_HANDLE_DATA* module, JNIEnv* env)
+{
+    int result;
+    jclass jModule_class = JNIFunc(env, GetObjectClass, module->module);
+    if (jModule_class == NULL)
+    {
+        LogError("Could not find class (%s) for the module Java object. receive() will not be called on this object.", module->moduleName);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_JAVA_MODULE_HOST_17_004: [This function shall look up the receive() method of the module once, preferring void receive(java.nio.ByteBuffer source) to void receive(byte[] source), and reuse it for every later message.]*/
+        jmethodID jModule_receive = JNIFunc(env, GetMethodID, jModule_class, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR);
+        jthrowable exception = JNIFunc(env, ExceptionOccurred);
+        bool by_buffer = (jModule_receive != NULL && !exception);
+        if (!by_buffer)
+        {
+            JNIFunc(env, ExceptionClear);
+            jModule_receive = JNIFunc(env, GetMethodID, jModule_class, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR);
+            exception = JNIFunc(env, ExceptionOccurred);
+        }
+
+        if (jModule_receive == NULL || exception)
+        {
+            LogError("Failed to find the %s receive() method. receive() will not be called on this object.", module->moduleName);
+            JNIFunc(env, ExceptionDescribe);
+            JNIFunc(env, ExceptionClear);
+            result = __LINE__;
+        }
+        else
+        {
+            module->receive_method = jModule_receive;
+            module->receive_by_buffer = by_buffer;
+            result = 0;
+        }
+    }
+    return result;
+}
+
 static int JVM_Create(JavaVM** jvm, JNIEnv** env, JVM_OPTIONS* options)
 {
     /*Codes_SRS_JAVA_MODULE_HOST_14_007: [This function shall initialize a JavaVMInitArgs structure using the JVM_OPTIONS structure configuration->options.]*/
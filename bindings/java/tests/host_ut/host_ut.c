@@ -133,6 +133,7 @@ void my_Message_Destroy(MESSAGE_HANDLE message)
 
 //Broker mocks
 MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message);
+MOCKABLE_FUNCTION(, BROKER_RESULT, Broker_PublishBatch, BROKER_HANDLE, broker, MODULE_HANDLE, source, const MESSAGE_HANDLE*, messages, size_t, count);
 
 //JEnv function mocks
 MOCKABLE_FUNCTION(JNICALL, jclass, FindClass, JNIEnv*, env, const char*, name);
@@ -184,11 +185,42 @@ jbyteArray my_NewByteArray(JNIEnv* env, jsize len)
 {
     (void)env;
     (void)len;
-    return (jbyteArray)malloc(1);
+    return (jbyteArray)0x42;
 }
 
 MOCKABLE_FUNCTION(JNICALL, void, SetByteArrayRegion, JNIEnv*, env, jbyteArray, arr, jsize, start, jsize, len, const jbyte*, buf);
 
+MOCKABLE_FUNCTION(JNICALL, jobject, NewDirectByteBuffer, JNIEnv*, env, void*, address, jlong, capacity);
+jobject my_NewDirectByteBuffer(JNIEnv* env, void* address, jlong capacity)
+{
+    (void)env;
+    (void)address;
+    (void)capacity;
+    return (jobject)0x42;
+}
+
+//A batch of two messages of 1 and 2 bytes, ended by a frame of length 0
+static unsigned char batch[] = { 0, 0, 0, 1, 0xA1, 0, 0, 0, 2, 0xB1, 0xB2, 0, 0, 0, 0, 0xFF };
+
+MOCKABLE_FUNCTION(JNICALL, void*, GetDirectBufferAddress, JNIEnv*, env, jobject, buf);
+void* my_GetDirectBufferAddress(JNIEnv* env, jobject buf)
+{
+    (void)env;
+    (void)buf;
+    return batch;
+}
+
+MOCKABLE_FUNCTION(JNICALL, jlong, GetDirectBufferCapacity, JNIEnv*, env, jobject, buf);
+jlong my_GetDirectBufferCapacity(JNIEnv* env, jobject buf)
+{
+    (void)env;
+    (void)buf;
+    return (jlong)sizeof(batch);
+}
+
+MOCKABLE_FUNCTION(JNICALL, jint, PushLocalFrame, JNIEnv*, env, jint, capacity);
+MOCKABLE_FUNCTION(JNICALL, jobject, PopLocalFrame, JNIEnv*, env, jobject, result);
+
 MOCKABLE_FUNCTION(JNICALL, jsize, GetArrayLength, JNIEnv*, env, jarray, arr);
 jsize my_GetArrayLength(JNIEnv* env, jarray arr)
 {
@@ -238,6 +270,17 @@ MOCKABLE_FUNCTION(JNICALL, jint, AttachCurrentThread, JavaVM*, vm, void**, penv,
 
 MOCKABLE_FUNCTION(JNICALL, jint, DetachCurrentThread, JavaVM*, vm);
 
+MOCKABLE_FUNCTION(JNICALL, jint, AttachCurrentThreadAsDaemon, JavaVM*, vm, void**, penv, void*, args);
+jint my_AttachCurrentThreadAsDaemon(JavaVM* vm, void** penv, void* args)
+{
+    (void)vm;
+    (void)args;
+
+    *penv = (void*)global_env;
+
+    return JNI_OK;
+}
+
 MOCKABLE_FUNCTION(JNICALL, jint, DestroyJavaVM, JavaVM*, vm);
 
 jint my_DestroyJavaVM(JavaVM* vm)
@@ -282,7 +325,7 @@ jint mock_JNI_CreateJavaVM(JavaVM** pvm, void** penv, void* args)
             0, 0, 0, 0,
 
             NULL, NULL, FindClass, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            NULL, ExceptionOccurred, ExceptionDescribe, ExceptionClear, NULL, NULL, NULL, NewGlobalRef, DeleteGlobalRef, DeleteLocalRef,
+            NULL, ExceptionOccurred, ExceptionDescribe, ExceptionClear, NULL, PushLocalFrame, PopLocalFrame, NewGlobalRef, DeleteGlobalRef, DeleteLocalRef,
             NULL, NULL, NULL, NULL, NULL, NewObjectV, NULL, GetObjectClass, NULL, GetMethodID,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
@@ -303,7 +346,7 @@ jint mock_JNI_CreateJavaVM(JavaVM** pvm, void** penv, void* args)
             NULL, NULL, NULL, NULL, NULL, NULL, GetByteArrayRegion, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, SetByteArrayRegion, NULL, NULL, NULL, NULL, NULL,
             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+            NULL, NULL, NULL, NULL, NULL, NewDirectByteBuffer, GetDirectBufferAddress, GetDirectBufferCapacity, NULL
         };
 
         struct JNIInvokeInterface_ vm = {
@@ -315,7 +358,7 @@ jint mock_JNI_CreateJavaVM(JavaVM** pvm, void** penv, void* args)
             AttachCurrentThread,
             DetachCurrentThread,
             GetEnv,
-            NULL
+            AttachCurrentThreadAsDaemon
         };
 
 #ifdef __cplusplus
@@ -621,6 +664,11 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(NewGlobalRef, NULL);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(AttachCurrentThread, JNI_ERR);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(DetachCurrentThread, JNI_ERR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(AttachCurrentThreadAsDaemon, JNI_ERR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(PushLocalFrame, JNI_ERR);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(NewDirectByteBuffer, NULL);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(GetDirectBufferAddress, NULL);
+    REGISTER_GLOBAL_MOCK_FAIL_RETURN(GetDirectBufferCapacity, -1);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(JNI_CreateJavaVM, JNI_ERR);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(ExceptionOccurred, (jthrowable)0x42);
 
@@ -631,6 +679,9 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(NewObjectV, my_NewObject);
     REGISTER_GLOBAL_MOCK_HOOK(NewStringUTF, my_NewStringUTF);
     REGISTER_GLOBAL_MOCK_HOOK(NewByteArray, my_NewByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(NewDirectByteBuffer, my_NewDirectByteBuffer);
+    REGISTER_GLOBAL_MOCK_HOOK(GetDirectBufferAddress, my_GetDirectBufferAddress);
+    REGISTER_GLOBAL_MOCK_HOOK(GetDirectBufferCapacity, my_GetDirectBufferCapacity);
     REGISTER_GLOBAL_MOCK_HOOK(GetArrayLength, my_GetArrayLength);
     REGISTER_GLOBAL_MOCK_HOOK(DeleteLocalRef, my_DeleteLocalRef);
     REGISTER_GLOBAL_MOCK_HOOK(NewGlobalRef, my_NewGlobalRef);
@@ -638,6 +689,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(ExceptionOccurred, my_ExceptionOccurred);
     REGISTER_GLOBAL_MOCK_HOOK(DestroyJavaVM, my_DestroyJavaVM);
     REGISTER_GLOBAL_MOCK_HOOK(GetEnv, my_GetEnv);
+    REGISTER_GLOBAL_MOCK_HOOK(AttachCurrentThreadAsDaemon, my_AttachCurrentThreadAsDaemon);
 
     //gballoc Hooks
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
@@ -683,6 +735,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void*);
 
     REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const MESSAGE_HANDLE*, void*);
 
     REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
 
@@ -696,6 +749,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(JavaVM*, void*);
     REGISTER_UMOCK_ALIAS_TYPE(JavaVM**, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jint, int32_t);
+    REGISTER_UMOCK_ALIAS_TYPE(jlong, int64_t);
     REGISTER_UMOCK_ALIAS_TYPE(jclass, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jmethodID, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jobject, void*);
@@ -2150,11 +2204,13 @@ TEST_FUNCTION(JavaModuleHost_Create_gets_previously_created_JVM_success)
 
 /*Tests_SRS_JAVA_MODULE_HOST_14_023: [This function shall serialize message.]*/
 /*Tests_SRS_JAVA_MODULE_HOST_14_042: [This function shall attach the JVM to the current thread.]*/
-/*Tests_SRS_JAVA_MODULE_HOST_14_043: [This function shall create a new jbyteArray for the serialized message.]*/
-/*Tests_SRS_JAVA_MODULE_HOST_14_044: [This function shall set the contents of the jbyteArray to the serialized_message.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_001: [This function shall attach the current thread to the JVM only if it is not attached yet, and leave it attached after the message is delivered.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_003: [This function shall release every local reference it creates before returning.]*/
 /*Tests_SRS_JAVA_MODULE_HOST_14_045: [This function shall get the user - defined Java module class using the module parameter and get the receive() method.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_004: [This function shall look up the receive() method of the module once, preferring void receive(java.nio.ByteBuffer source) to void receive(byte[] source), and reuse it for every later message.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_005: [This function shall wrap the serialized message in a direct java.nio.ByteBuffer when the module has a receive(ByteBuffer) method.]*/
 /*Tests_SRS_JAVA_MODULE_HOST_14_024: [This function shall call the void receive(byte[] source) method of the Java module object passing the serialized message.]*/
-/*Tests_SRS_JAVA_MODULE_HOST_14_046: [This function shall detach the JVM from the current thread.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_006: [This function shall free the serialized message after receive() returns.]*/
 TEST_FUNCTION(JavaModuleHost_Receive_success)
 {
     //Arrange
@@ -2177,47 +2233,205 @@ TEST_FUNCTION(JavaModuleHost_Receive_success)
         .IgnoreArgument(2)
         .IgnoreArgument(3);
 
-    STRICT_EXPECTED_CALL(AttachCurrentThread(IGNORED_PTR_ARG, IGNORED_PTR_ARG, NULL))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
         .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(NewByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
         .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(SetByteArrayRegion(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2);
+
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(global_env, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5);
+        .IgnoreArgument(3);
 
-    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(CallVoidMethodV(global_env, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
 
-    STRICT_EXPECTED_CALL(GetObjectClass(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
 
-    STRICT_EXPECTED_CALL(GetMethodID(IGNORED_PTR_ARG, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
 
-    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
-    STRICT_EXPECTED_CALL(CallVoidMethodV(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
+    //Act
+    JavaModuleHost_Receive(module, message);
 
-    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
-    STRICT_EXPECTED_CALL(DeleteLocalRef(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_001: [This function shall attach the current thread to the JVM only if it is not attached yet, and leave it attached after the message is delivered.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_attaches_detached_thread_and_leaves_it_attached)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2)
+        .SetReturn(JNI_EDETACHED);
+    STRICT_EXPECTED_CALL(AttachCurrentThreadAsDaemon(global_vm, IGNORED_PTR_ARG, NULL))
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(global_env, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(CallVoidMethodV(global_env, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    JavaModuleHost_Receive(module, message);
+
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_004: [This function shall look up the receive() method of the module once, preferring void receive(java.nio.ByteBuffer source) to void receive(byte[] source), and reuse it for every later message.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_reuses_receive_method)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    JavaModuleHost_Receive(module, message);
+    umock_c_reset_all_calls();
 
-    STRICT_EXPECTED_CALL(DetachCurrentThread(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(global_env, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(CallVoidMethodV(global_env, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
+    //Act
+    JavaModuleHost_Receive(module, message);
+
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_004: [This function shall look up the receive() method of the module once, preferring void receive(java.nio.ByteBuffer source) to void receive(byte[] source), and reuse it for every later message.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_14_043: [This function shall create a new jbyteArray for the serialized message.]*/
+/*Tests_SRS_JAVA_MODULE_HOST_14_044: [This function shall set the contents of the jbyteArray to the serialized_message.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_byte_array_module_success)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4)
+        .IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(CallVoidMethodV(global_env, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -2357,7 +2571,7 @@ TEST_FUNCTION(JavaModuleHost_Receive_Message_allocate_failure)
 
 }
 /*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-TEST_FUNCTION(JavaModuleHost_Receive_AttachCurrentThread_failure)
+TEST_FUNCTION(JavaModuleHost_Receive_GetEnv_failure)
 {
     //Arrange
     const unsigned char msg[] =
@@ -2382,8 +2596,9 @@ TEST_FUNCTION(JavaModuleHost_Receive_AttachCurrentThread_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2)
+        .SetFailReturn(JNI_ERR);
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -2404,7 +2619,7 @@ TEST_FUNCTION(JavaModuleHost_Receive_AttachCurrentThread_failure)
 }
 
 /*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-TEST_FUNCTION(JavaModuleHost_Receive_NewByteArray_failure)
+TEST_FUNCTION(JavaModuleHost_Receive_AttachCurrentThreadAsDaemon_failure)
 {
     //Arrange
     const unsigned char msg[] =
@@ -2429,13 +2644,11 @@ TEST_FUNCTION(JavaModuleHost_Receive_NewByteArray_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2)
+        .SetReturn(JNI_EDETACHED);
+    STRICT_EXPECTED_CALL(AttachCurrentThreadAsDaemon(global_vm, IGNORED_PTR_ARG, NULL))
         .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(DetachCurrentThread(global_vm));
-
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -2456,7 +2669,7 @@ TEST_FUNCTION(JavaModuleHost_Receive_NewByteArray_failure)
 }
 
 /*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-TEST_FUNCTION(JavaModuleHost_Receive_SetByteArrayRegion_failure)
+TEST_FUNCTION(JavaModuleHost_Receive_PushLocalFrame_failure)
 {
     //Arrange
     const unsigned char msg[] =
@@ -2481,28 +2694,18 @@ TEST_FUNCTION(JavaModuleHost_Receive_SetByteArrayRegion_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5);
-    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
-    STRICT_EXPECTED_CALL(ExceptionDescribe(global_env));
     STRICT_EXPECTED_CALL(ExceptionClear(global_env));
-    STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(DetachCurrentThread(global_vm));
-
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     //Act
-    umock_c_negative_tests_fail_call(6);
+    umock_c_negative_tests_fail_call(4);
     JavaModuleHost_Receive(module, message);
 
     //Assert
@@ -2541,28 +2744,20 @@ TEST_FUNCTION(JavaModuleHost_Receive_GetObjectClass_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5);
-    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
     STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(DetachCurrentThread(global_vm));
-
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     //Act
-    umock_c_negative_tests_fail_call(7);
+    umock_c_negative_tests_fail_call(5);
     JavaModuleHost_Receive(module, message);
 
     //Assert
@@ -2601,33 +2796,30 @@ TEST_FUNCTION(JavaModuleHost_Receive_GetMethodID_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5);;
-    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
     STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
     STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
     STRICT_EXPECTED_CALL(ExceptionDescribe(global_env));
     STRICT_EXPECTED_CALL(ExceptionClear(global_env));
-    STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(DetachCurrentThread(global_vm));
-
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     //Act
-    umock_c_negative_tests_fail_call(8);
+    umock_c_negative_tests_fail_call(9);
     JavaModuleHost_Receive(module, message);
 
     //Assert
@@ -2641,7 +2833,7 @@ TEST_FUNCTION(JavaModuleHost_Receive_GetMethodID_failure)
 }
 
 /*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
-TEST_FUNCTION(JavaModuleHost_Receive_CallVoidMethod_failure)
+TEST_FUNCTION(JavaModuleHost_Receive_NewDirectByteBuffer_failure)
 {
     //Arrange
     const unsigned char msg[] =
@@ -2666,20 +2858,208 @@ TEST_FUNCTION(JavaModuleHost_Receive_CallVoidMethod_failure)
     STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(AttachCurrentThread(global_vm, IGNORED_PTR_ARG, NULL))
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(2)
-        .IgnoreArgument(4)
-        .IgnoreArgument(5);;
-    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
     STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(global_env, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    umock_c_negative_tests_snapshot();
+
+    //Act
+    umock_c_negative_tests_fail_call(8);
+    JavaModuleHost_Receive(module, message);
+
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_NewByteArray_failure)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    umock_c_reset_all_calls();
+
+    int result = 0;
+    result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    umock_c_negative_tests_snapshot();
+
+    //Act
+    umock_c_negative_tests_fail_call(11);
+    JavaModuleHost_Receive(module, message);
+
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_SetByteArrayRegion_failure)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    umock_c_reset_all_calls();
+
+    int result = 0;
+    result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_DESCRIPTOR))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewByteArray(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(SetByteArrayRegion(global_env, IGNORED_PTR_ARG, 0, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(4)
+        .IgnoreArgument(5);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(ExceptionDescribe(global_env));
+    STRICT_EXPECTED_CALL(ExceptionClear(global_env));
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    umock_c_negative_tests_snapshot();
+
+    //Act
+    umock_c_negative_tests_fail_call(13);
+    JavaModuleHost_Receive(module, message);
+
+    //Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    Message_Destroy(message);
+    JavaModuleHost_Destroy(module);
+
+    umock_c_negative_tests_deinit();
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_14_047: [This function shall exit if any underlying function fails.]*/
+TEST_FUNCTION(JavaModuleHost_Receive_CallVoidMethod_failure)
+{
+    //Arrange
+    const unsigned char msg[] =
+    {
+        0xA1, 0x60,             /*header*/
+        0x00, 0x00, 0x00, 14,   /*size of this array*/
+        0x00, 0x00, 0x00, 0x00, /*zero properties*/
+        0x00, 0x00, 0x00, 0x00  /*zero message content size*/
+    };
+
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    MESSAGE_HANDLE message = Message_CreateFromByteArray(msg, sizeof(msg));
+    umock_c_reset_all_calls();
+
+    int result = 0;
+    result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_ToByteArray(message, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(GetEnv(global_vm, IGNORED_PTR_ARG, JNI_VERSION_1_4))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(PushLocalFrame(global_env, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetObjectClass(global_env, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(GetMethodID(global_env, IGNORED_PTR_ARG, MODULE_RECEIVE_METHOD_NAME, MODULE_RECEIVE_BUFFER_DESCRIPTOR))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(global_env, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(CallVoidMethodV(global_env, IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(2)
         .IgnoreArgument(3)
@@ -2687,17 +3067,14 @@ TEST_FUNCTION(JavaModuleHost_Receive_CallVoidMethod_failure)
     STRICT_EXPECTED_CALL(ExceptionOccurred(global_env));
     STRICT_EXPECTED_CALL(ExceptionDescribe(global_env));
     STRICT_EXPECTED_CALL(ExceptionClear(global_env));
-    STRICT_EXPECTED_CALL(DeleteLocalRef(global_env, IGNORED_PTR_ARG))
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(DetachCurrentThread(global_vm));
-
+    STRICT_EXPECTED_CALL(PopLocalFrame(global_env, NULL));
     STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
     umock_c_negative_tests_snapshot();
 
     //Act
-    umock_c_negative_tests_fail_call(11);
+    umock_c_negative_tests_fail_call(10);
     JavaModuleHost_Receive(module, message);
 
     //Assert
@@ -3463,6 +3840,180 @@ TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessage_failur
     JavaModuleHost_Destroy(module);
 }
 
+//=============================================================================
+//Java_com_microsoft_azure_gateway_core_Broker_publishMessages tests
+//=============================================================================
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_007: [ This function shall read the batch in place from the memory of the direct ByteBuffer batch. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_008: [ The batch shall be a sequence of frames, each a 4 byte big-endian length followed by that many bytes of serialized message, ended by a frame of length 0 or by the end of the buffer. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_009: [ This function shall create each message with Message_CreateFromByteArray straight from its frame, without copying the batch. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_010: [ This function shall publish the messages to the BROKER_HANDLE addressed by broker_address with a single call to Broker_PublishBatch and return the value of this function call. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_success)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    jobject jBatch = (jobject)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+    BROKER_HANDLE broker = (BROKER_HANDLE)broker_address;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(global_env, jBatch));
+    STRICT_EXPECTED_CALL(GetDirectBufferCapacity(global_env, jBatch));
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(2 * sizeof(MESSAGE_HANDLE)));
+
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(Broker_PublishBatch(broker, module, IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(3);
+
+    STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, jBatch);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_008: [ The batch shall be a sequence of frames, each a 4 byte big-endian length followed by that many bytes of serialized message, ended by a frame of length 0 or by the end of the buffer. ]*/
+/*Tests_SRS_JAVA_MODULE_HOST_17_011: [ This function shall return a non-zero value if the batch is malformed or any underlying function call fails. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_malformed_batch_fails)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    unsigned char truncated[] = { 0, 0, 0, 1, 0xA1, 0, 0, 0, 9, 0xB1 };
+    jobject jBatch = (jobject)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(global_env, jBatch))
+        .SetReturn(truncated);
+    STRICT_EXPECTED_CALL(GetDirectBufferCapacity(global_env, jBatch))
+        .SetReturn((jlong)sizeof(truncated));
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, jBatch);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_011: [ This function shall return a non-zero value if the batch is malformed or any underlying function call fails. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_empty_batch_fails)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    unsigned char empty[] = { 0, 0, 0, 0, 0xA1 };
+    jobject jBatch = (jobject)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(global_env, jBatch))
+        .SetReturn(empty);
+    STRICT_EXPECTED_CALL(GetDirectBufferCapacity(global_env, jBatch))
+        .SetReturn((jlong)sizeof(empty));
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, jBatch);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int32_t, JNI_OK, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
+/*Tests_SRS_JAVA_MODULE_HOST_17_011: [ This function shall return a non-zero value if the batch is malformed or any underlying function call fails. ]*/
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_core_Broker_publishMessages_failure)
+{
+    //Arrange
+    MODULE_HANDLE module = JavaModuleHost_Create((BROKER_HANDLE)0x42, &config);
+    umock_c_reset_all_calls();
+
+    jobject jBatch = (jobject)0x42;
+    jobject jBroker = (jobject)0x42;
+    jlong broker_address = (jlong)0x42;
+    BROKER_HANDLE broker = (BROKER_HANDLE)broker_address;
+
+    int init_result = 0;
+    init_result = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, init_result);
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(global_env, jBatch));
+    STRICT_EXPECTED_CALL(GetDirectBufferCapacity(global_env, jBatch));
+
+    STRICT_EXPECTED_CALL(gballoc_malloc(2 * sizeof(MESSAGE_HANDLE)))
+        .SetFailReturn(NULL);
+
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1)
+        .SetFailReturn(NULL);
+
+    STRICT_EXPECTED_CALL(Broker_PublishBatch(broker, module, IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(3)
+        .SetFailReturn(BROKER_ERROR);
+
+    STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    umock_c_negative_tests_snapshot();
+
+    //act
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); i++)
+    {
+        if (i != 6 &&
+            i != 7 &&
+            i != 8)
+        {
+            // arrange
+            umock_c_negative_tests_reset();
+            umock_c_negative_tests_fail_call(i);
+
+            jint result = Java_com_microsoft_azure_gateway_core_Broker_publishMessages(global_env, jBroker, broker_address, (jlong)module, jBatch);
+
+            //Assert
+            ASSERT_ARE_NOT_EQUAL(int32_t, JNI_OK, result);
+        }
+    }
+    umock_c_negative_tests_deinit();
+
+    //Cleanup
+    JavaModuleHost_Destroy(module);
+}
+
 /*Tests_SRS_JAVA_MODULE_HOST_26_001: [ `Module_GetApi` shall fill out the provided `MODULES_API` structure with required module's APIs functions. ] */
 TEST_FUNCTION(Module_GetApi_returns_non_NULL)
 {
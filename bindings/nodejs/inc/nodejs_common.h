@@ -4,6 +4,7 @@
 #ifndef NODEJS_COMMON_H
 #define NODEJS_COMMON_H
 
+#include <deque>
 #include <future>
 #include <string>
 #include <utility>
@@ -38,7 +39,8 @@ struct NODEJS_MODULE_HANDLE_DATA
         v8_isolate(nullptr),
         module_id(0),
         on_module_start(nullptr),
-        module_state(NodeModuleState::error)
+        module_state(NodeModuleState::error),
+        receive_scheduled(false)
     {
     }
 
@@ -54,7 +56,8 @@ struct NODEJS_MODULE_HANDLE_DATA
         v8_isolate(nullptr),
         module_id(0),
         on_module_start(module_start),
-        module_state(NodeModuleState::error)
+        module_state(NodeModuleState::error),
+        receive_scheduled(false)
     {
     }
 
@@ -67,6 +70,8 @@ struct NODEJS_MODULE_HANDLE_DATA
         on_module_start = rhs.on_module_start;
         module_id = rhs.module_id;
         module_state = rhs.module_state;
+        pending_messages = std::move(rhs.pending_messages);
+        receive_scheduled = rhs.receive_scheduled;
 
 
         if (v8_isolate != nullptr && rhs.module_object.IsEmpty() == false)
@@ -85,6 +90,7 @@ struct NODEJS_MODULE_HANDLE_DATA
         on_module_start = rhs.on_module_start;
         module_id = rhs.module_id;
         module_state = rhs.module_state;
+        receive_scheduled = false;
 
 
         if (v8_isolate != nullptr && rhs.module_object.IsEmpty() == false)
@@ -102,6 +108,7 @@ struct NODEJS_MODULE_HANDLE_DATA
         on_module_start = rhs.on_module_start;
         this->module_id = module_id;
         module_state = rhs.module_state;
+        receive_scheduled = false;
 
         if (v8_isolate != nullptr && rhs.module_object.IsEmpty() == false)
         {
@@ -109,6 +116,14 @@ struct NODEJS_MODULE_HANDLE_DATA
         }
     }
 
+    ~NODEJS_MODULE_HANDLE_DATA()
+    {
+        for (auto message : pending_messages)
+        {
+            Message_Destroy(message);
+        }
+    }
+
     void AcquireLock() const
     {
         object_lock.AcquireLock();
@@ -141,6 +156,18 @@ struct NODEJS_MODULE_HANDLE_DATA
     NodeModuleState module_state;
     nodejs_module::Lock object_lock;
 
+    /*
+     * Messages received from the broker and not yet handed to the
+     * JS module. A copy of the handle data starts without any.
+     */
+    std::deque<MESSAGE_HANDLE> pending_messages;
+
+    /*
+     * Set while a callback delivering pending_messages is queued
+     * on Node's event loop.
+     */
+    bool receive_scheduled;
+
     /*
      * WARNING: The promise follows the lifespan of the class, NOT
      *          the lifespan of the handle data. This means the
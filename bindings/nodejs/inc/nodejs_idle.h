@@ -21,6 +21,11 @@
 
 namespace nodejs_module
 {
+    /**
+     * Maximum number of callbacks run in one turn of Node's event loop.
+     */
+    const size_t NODEJS_IDLE_MAX_BATCH = 256;
+
     class NodeJSIdle
     {
     private:
@@ -68,7 +73,8 @@ namespace nodejs_module
         void AddCallback(TCallback callback);
 
         /**
-         * Idle callback function called from Node's event loop.
+         * Idle callback function called from Node's event loop. Runs up
+         * to NODEJS_IDLE_MAX_BATCH callbacks under one v8::HandleScope.
          */
         static void OnIdle(uv_async_t* handle);
 
@@ -46,6 +46,9 @@
 
 #define DESTROY_WAIT_TIME_IN_SECS   (5)
 
+// Maximum number of messages handed to a module in one callback on Node's event loop
+#define NODEJS_RECEIVE_MAX_BATCH    (size_t)(64)
+
 #define NODE_LOAD_SCRIPT(ss, main_path, module_id)    ss <<                    \
     "(function() {"                                                            \
     "  try {"                                                                  \
@@ -958,189 +961,540 @@ static void on_module_start(NODEJS_MODULE_HANDLE_DATA* handle_data)
     }
 }
 
+/*
+ * Native data kept alive by a JS object handed to a module: the message
+ * behind a content buffer or the properties behind a properties object.
+ * It is released when the JS object is garbage collected.
+ */
+struct NODEJS_MESSAGE_REF
+{
+    MESSAGE_HANDLE message;
+    CONSTMAP_HANDLE properties;
+    size_t external_size;
+
+    // set once the properties were copied onto the JS object
+    bool materialized;
+    v8::Persistent<v8::Object> object;
+};
+
+static void release_message_ref(const v8::WeakCallbackInfo<NODEJS_MESSAGE_REF>& info)
+{
+    auto ref = info.GetParameter();
+    ref->object.Reset();
+    if (ref->external_size > 0)
+    {
+        info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(ref->external_size));
+    }
+    if (ref->properties != nullptr)
+    {
+        ConstMap_Destroy(ref->properties);
+    }
+    if (ref->message != nullptr)
+    {
+        Message_Destroy(ref->message);
+    }
+    delete ref;
+}
+
+static NODEJS_MESSAGE_REF* create_message_ref(
+    v8::Isolate* isolate,
+    v8::Local<v8::Object> object,
+    MESSAGE_HANDLE message,
+    CONSTMAP_HANDLE properties,
+    size_t external_size
+)
+{
+    NODEJS_MESSAGE_REF* ref;
+    try
+    {
+        ref = new NODEJS_MESSAGE_REF();
+        ref->message = message;
+        ref->properties = properties;
+        ref->external_size = external_size;
+        ref->materialized = false;
+        ref->object.Reset(isolate, object);
+        ref->object.SetWeak(ref, release_message_ref, v8::WeakCallbackType::kParameter);
+        if (external_size > 0)
+        {
+            isolate->AdjustAmountOfExternalAllocatedMemory(static_cast<int64_t>(external_size));
+        }
+    }
+    catch (std::bad_alloc& err)
+    {
+        LogError("Could not allocate the native reference of a JS message object - %s", err.what());
+        ref = nullptr;
+    }
+
+    return ref;
+}
+
 static v8::Local<v8::Uint8Array> copy_contents_to_object(
     v8::Isolate* isolate,
     v8::Local<v8::Context> context,
+    MESSAGE_HANDLE message,
     const CONSTBUFFER* content
 )
 {
     (void)context;
-    // this object does not have ownership of the buffer
+    v8::Local<v8::Uint8Array> result;
+
+    // the buffer is not copied, the array buffer holds a reference to
+    // the message until it is garbage collected
     auto array_buffer = v8::ArrayBuffer::New(isolate, (void *)content->buffer, content->size);
+    if (array_buffer.IsEmpty() == true)
+    {
+        LogError("Could not create an array buffer over the message content");
+    }
+    else
+    {
+        /*Codes_SRS_NODEJS_17_006: [ The content of a Message handed to the module shall keep the native message alive until the content is garbage collected. ]*/
+        auto message_clone = Message_Clone(message);
+        if (create_message_ref(isolate, array_buffer, message_clone, nullptr, content->size) == nullptr)
+        {
+            Message_Destroy(message_clone);
+        }
+        else
+        {
+            // create an Uint8Array object
+            result = v8::Uint8Array::New(array_buffer, 0, content->size);
+        }
+    }
 
-    // create an Uint8Array object
-    return v8::Uint8Array::New(array_buffer, 0, content->size);
+    return result;
 }
 
-static v8::Local<v8::Object> copy_properties_to_object(
-    v8::Isolate* isolate,
-    v8::Local<v8::Context> context,
-    CONSTMAP_HANDLE message_properties
-)
+static NODEJS_MESSAGE_REF* get_properties_ref(const v8::Local<v8::Object>& holder)
+{
+    return static_cast<NODEJS_MESSAGE_REF*>(holder->GetAlignedPointerFromInternalField(0));
+}
+
+/*
+ * Copies every property onto the JS object itself the first time a module
+ * writes to or deletes from it; the interceptors stand aside from then on.
+ */
+static void materialize_properties(v8::Isolate* isolate, v8::Local<v8::Object> holder, NODEJS_MESSAGE_REF* ref)
 {
     const char * const *keys, *const *values;
     size_t count;
-    v8::Local<v8::Object> result;
 
-    if (ConstMap_GetInternals(message_properties, &keys, &values, &count) != CONSTMAP_OK)
+    ref->materialized = true;
+    if (ConstMap_GetInternals(ref->properties, &keys, &values, &count) != CONSTMAP_OK)
     {
-        LogError("Map_GetInternals failed");
+        LogError("ConstMap_GetInternals failed");
     }
     else
     {
-        v8::Local<v8::Object> props = v8::Object::New(isolate);
-        if (props.IsEmpty() == false)
+        auto context = isolate->GetCurrentContext();
+        for (size_t i = 0; i < count; i++)
         {
-            size_t i = 0;
-            for (; i < count; i++)
+            auto prop_key = v8::String::NewFromUtf8(isolate, keys[i]);
+            auto prop_value = v8::String::NewFromUtf8(isolate, values[i]);
+            if (prop_key.IsEmpty() == true || prop_value.IsEmpty() == true)
             {
-                auto prop_key = v8::String::NewFromUtf8(isolate, keys[i]);
-                if (prop_key.IsEmpty() == true)
-                {
-                    LogError("Could not instantiate v8 string for property key '%s'", keys[i]);
-                    break;
-                }
-                else
+                LogError("Could not instantiate v8 strings for property '%s'", keys[i]);
+            }
+            else if (holder->CreateDataProperty(context, prop_key, prop_value).FromMaybe(false) == false)
+            {
+                LogError("Could not create property '%s'", keys[i]);
+            }
+        }
+    }
+}
+
+static const char* find_property(v8::Isolate* isolate, v8::Local<v8::Name> name, const v8::Local<v8::Object>& holder, std::string& key)
+{
+    const char* result = nullptr;
+    auto ref = get_properties_ref(holder);
+    if (ref != nullptr && ref->materialized == false && name->IsString() == true)
+    {
+        // properties the module added itself are not intercepted
+        key = v8_to_std_string(name.As<v8::String>());
+        if (key.empty() == false && holder->HasRealNamedProperty(isolate->GetCurrentContext(), name).FromMaybe(false) == false)
+        {
+            result = ConstMap_GetValue(ref->properties, key.c_str());
+        }
+    }
+
+    return result;
+}
+
+static void get_message_property(v8::Local<v8::Name> name, const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    std::string key;
+    const char* value = find_property(info.GetIsolate(), name, info.Holder(), key);
+    if (value != nullptr)
+    {
+        /*Codes_SRS_NODEJS_17_003: [ NodeJS_Receive shall create the value of a property of Message.properties from the native message only when the module reads it. ]*/
+        auto prop_value = v8::String::NewFromUtf8(info.GetIsolate(), value);
+        if (prop_value.IsEmpty() == true)
+        {
+            LogError("Could not instantiate v8 string for property value '%s'", value);
+        }
+        else
+        {
+            info.GetReturnValue().Set(prop_value);
+        }
+    }
+}
+
+static void query_message_property(v8::Local<v8::Name> name, const v8::PropertyCallbackInfo<v8::Integer>& info)
+{
+    std::string key;
+    if (find_property(info.GetIsolate(), name, info.Holder(), key) != nullptr)
+    {
+        info.GetReturnValue().Set(static_cast<int32_t>(v8::None));
+    }
+}
+
+static void set_message_property(v8::Local<v8::Name> name, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<v8::Value>& info)
+{
+    (void)name;
+    (void)value;
+    auto ref = get_properties_ref(info.Holder());
+    if (ref != nullptr && ref->materialized == false)
+    {
+        /*Codes_SRS_NODEJS_17_005: [ Message.properties shall behave as a plain object once the module writes to it or deletes from it. ]*/
+        materialize_properties(info.GetIsolate(), info.Holder(), ref);
+    }
+    // not intercepted, the assignment proceeds as usual
+}
+
+static void delete_message_property(v8::Local<v8::Name> name, const v8::PropertyCallbackInfo<v8::Boolean>& info)
+{
+    (void)name;
+    auto ref = get_properties_ref(info.Holder());
+    if (ref != nullptr && ref->materialized == false)
+    {
+        /*Codes_SRS_NODEJS_17_005: [ Message.properties shall behave as a plain object once the module writes to it or deletes from it. ]*/
+        materialize_properties(info.GetIsolate(), info.Holder(), ref);
+    }
+    // not intercepted, the deletion proceeds as usual
+}
+
+static void enumerate_message_properties(const v8::PropertyCallbackInfo<v8::Array>& info)
+{
+    const char * const *keys, *const *values;
+    size_t count;
+    auto ref = get_properties_ref(info.Holder());
+    if (ref != nullptr && ref->materialized == false)
+    {
+        if (ConstMap_GetInternals(ref->properties, &keys, &values, &count) != CONSTMAP_OK)
+        {
+            LogError("ConstMap_GetInternals failed");
+        }
+        else
+        {
+            auto isolate = info.GetIsolate();
+            auto context = isolate->GetCurrentContext();
+            auto names = v8::Array::New(isolate, static_cast<int>(count));
+            if (names.IsEmpty() == false)
+            {
+                uint32_t index = 0;
+                for (size_t i = 0; i < count; i++)
                 {
-                    auto prop_value = v8::String::NewFromUtf8(isolate, values[i]);
-                    if (prop_value.IsEmpty() == true)
+                    auto prop_key = v8::String::NewFromUtf8(isolate, keys[i]);
+                    if (prop_key.IsEmpty() == false && names->CreateDataProperty(context, index, prop_key).FromMaybe(false) == true)
                     {
-                        LogError("Could not instantiate v8 string for property value '%s'", values[i]);
-                        break;
-                    }
-                    else
-                    {
-                        auto status = props->CreateDataProperty(context, prop_key, prop_value);
-                        if (status.FromMaybe(false) == false)
-                        {
-                            LogError("Could not create property '%s'", values[i]);
-                            break;
-                        }
+                        index++;
                     }
                 }
+                info.GetReturnValue().Set(names);
             }
+        }
+    }
+}
 
-            // if i != count then something went wrong
-            if (i == count)
-            {
-                result = props;
-            }
+static v8::Local<v8::ObjectTemplate> get_properties_template(v8::Isolate* isolate)
+{
+    // message properties are only ever created on Node's thread
+    static v8::Persistent<v8::ObjectTemplate> properties_template;
+
+    if (properties_template.IsEmpty() == true)
+    {
+        auto object_template = v8::ObjectTemplate::New(isolate);
+        if (object_template.IsEmpty() == true)
+        {
+            LogError("Could not create the object template for message properties");
+        }
+        else
+        {
+            object_template->SetInternalFieldCount(1);
+            object_template->SetHandler(v8::NamedPropertyHandlerConfiguration(
+                get_message_property,
+                set_message_property,
+                query_message_property,
+                delete_message_property,
+                enumerate_message_properties
+            ));
+            properties_template.Reset(isolate, object_template);
         }
     }
 
-    ConstMap_Destroy(message_properties);
-    return result;
+    return v8::Local<v8::ObjectTemplate>::New(isolate, properties_template);
 }
 
-static void on_run_receive_message(
+static v8::Local<v8::Object> copy_properties_to_object(
     v8::Isolate* isolate,
     v8::Local<v8::Context> context,
-    MODULE_HANDLE module,
-    MESSAGE_HANDLE message
+    CONSTMAP_HANDLE message_properties
 )
 {
-    NODEJS_MODULE_HANDLE_DATA* handle_data = reinterpret_cast<NODEJS_MODULE_HANDLE_DATA*>(module);
-    if (handle_data->module_object.IsEmpty() == true)
+    v8::Local<v8::Object> result;
+
+    auto object_template = get_properties_template(isolate);
+    if (message_properties == nullptr)
     {
-        LogError("Module does not have a JS counterpart object - %s.", handle_data->main_path.c_str());
+        LogError("Message_GetProperties failed");
+    }
+    else if (object_template.IsEmpty() == true || object_template->NewInstance(context).ToLocal(&result) == false)
+    {
+        LogError("Could not create JS object for the message properties");
+        ConstMap_Destroy(message_properties);
     }
     else
     {
-        /*Codes_SRS_NODEJS_13_022: [ NodeJS_Receive shall construct an instance of the Message interface as defined below:
-            interface StringMap {
-                [key: string]: string;
-            }
+        /*Codes_SRS_NODEJS_17_004: [ The properties of a Message handed to the module shall keep the native message properties alive until the properties object is garbage collected. ]*/
+        auto ref = create_message_ref(isolate, result, nullptr, message_properties, 0);
+        if (ref == nullptr)
+        {
+            ConstMap_Destroy(message_properties);
+            result.Clear();
+        }
+        else
+        {
+            result->SetAlignedPointerInInternalField(0, ref);
+        }
+    }
 
-            interface Message {
-                properties: StringMap;
-                content: Uint8Array;
-            }
-        */
+    return result;
+}
 
-        // convert the message properties into a JS object
-        auto js_props = copy_properties_to_object(
-            isolate,
-            context,
-            Message_GetProperties(message)
-        );
-
-        // convert the contents into a JS Uint8Array
-        v8::Local<v8::Uint8Array> js_contents;
-        auto content = Message_GetContent(message);
-        if (content != nullptr && content->buffer != nullptr && content->size > 0)
-        {
-            js_contents = copy_contents_to_object(isolate, context, content);
+static v8::Local<v8::Object> create_js_message(
+    v8::Isolate* isolate,
+    v8::Local<v8::Context> context,
+    MESSAGE_HANDLE message
+)
+{
+    /*Codes_SRS_NODEJS_13_022: [ NodeJS_Receive shall construct an instance of the Message interface as defined below:
+        interface StringMap {
+            [key: string]: string;
         }
 
-        // create a JS object with 'properties' and 'content'
-        v8::Local<v8::Object> js_message = v8::Object::New(isolate);
-        if (js_message.IsEmpty())
-        {
-            LogError("Could not create JS object for storing the message");
+        interface Message {
+            properties: StringMap;
+            content: Uint8Array;
         }
-        else
+    */
+
+    // wrap the message properties in a JS object that reads them from
+    // the native message on demand
+    auto js_props = copy_properties_to_object(
+        isolate,
+        context,
+        Message_GetProperties(message)
+    );
+
+    // expose the contents as a JS Uint8Array over the native buffer
+    v8::Local<v8::Uint8Array> js_contents;
+    auto content = Message_GetContent(message);
+    if (content != nullptr && content->buffer != nullptr && content->size > 0)
+    {
+        js_contents = copy_contents_to_object(isolate, context, message, content);
+    }
+
+    // create a JS object with 'properties' and 'content'
+    v8::Local<v8::Object> js_message = v8::Object::New(isolate);
+    if (js_message.IsEmpty())
+    {
+        LogError("Could not create JS object for storing the message");
+    }
+    else
+    {
+        if (js_props.IsEmpty() == false)
         {
-            if (js_props.IsEmpty() == false)
+            auto prop_key = v8::String::NewFromUtf8(isolate, "properties");
+            if (prop_key.IsEmpty() == true)
             {
-                auto prop_key = v8::String::NewFromUtf8(isolate, "properties");
-                if (prop_key.IsEmpty() == true)
-                {
-                    LogError("Could not instantiate v8 string for constant 'properties'");
-                }
-                else
+                LogError("Could not instantiate v8 string for constant 'properties'");
+            }
+            else
+            {
+                auto status = js_message->CreateDataProperty(context, prop_key, js_props);
+                if (status.FromMaybe(false) == false)
                 {
-                    auto status = js_message->CreateDataProperty(context, prop_key, js_props);
-                    if (status.FromMaybe(false) == false)
-                    {
-                        LogError("Could not add 'properties' property to JS message object");
-                    }
+                    LogError("Could not add 'properties' property to JS message object");
                 }
             }
+        }
 
-            if (js_contents.IsEmpty() == false)
+        if (js_contents.IsEmpty() == false)
+        {
+            auto prop_key = v8::String::NewFromUtf8(isolate, "content");
+            if (prop_key.IsEmpty() == true)
+            {
+                LogError("Could not instantiate v8 string for constant 'content'");
+            }
+            else
             {
-                auto prop_key = v8::String::NewFromUtf8(isolate, "content");
-                if (prop_key.IsEmpty() == true)
+                auto status = js_message->CreateDataProperty(context, prop_key, js_contents);
+                if (status.FromMaybe(false) == false)
                 {
-                    LogError("Could not instantiate v8 string for constant 'content'");
-                }
-                else
-                {
-                    auto status = js_message->CreateDataProperty(context, prop_key, js_contents);
-                    if (status.FromMaybe(false) == false)
-                    {
-                        LogError("Could not add 'content' property to JS message object");
-                    }
+                    LogError("Could not add 'content' property to JS message object");
                 }
             }
+        }
+    }
 
-            auto prop_key = v8::String::NewFromUtf8(isolate, "receive");
-            if (prop_key.IsEmpty() == true)
+    return js_message;
+}
+
+static bool get_module_function(
+    v8::Isolate* isolate,
+    v8::Local<v8::Context> context,
+    v8::Local<v8::Object> gateway,
+    const char* name,
+    v8::Local<v8::Function>& function
+)
+{
+    bool result = false;
+    auto prop_key = v8::String::NewFromUtf8(isolate, name);
+    if (prop_key.IsEmpty() == true)
+    {
+        LogError("Could not instantiate v8 string for constant '%s'", name);
+    }
+    else
+    {
+        v8::Local<v8::Value> method;
+        if (gateway->Get(context, prop_key).ToLocal(&method) == true && method->IsFunction() == true)
+        {
+            function = method.As<v8::Function>();
+            result = true;
+        }
+    }
+
+    return result;
+}
+
+static void deliver_messages(
+    v8::Isolate* isolate,
+    v8::Local<v8::Context> context,
+    NODEJS_MODULE_HANDLE_DATA& handle_data,
+    const std::vector<MESSAGE_HANDLE>& messages
+)
+{
+    if (handle_data.module_object.IsEmpty() == true)
+    {
+        LogError("Module does not have a JS counterpart object - %s.", handle_data.main_path.c_str());
+    }
+    else
+    {
+        auto gateway = handle_data.module_object.Get(isolate);
+        v8::Local<v8::Function> receive_fn;
+        if (get_module_function(isolate, context, gateway, "receiveBatch", receive_fn) == true)
+        {
+            v8::Local<v8::Array> js_messages = v8::Array::New(isolate, static_cast<int>(messages.size()));
+            if (js_messages.IsEmpty())
             {
-                LogError("Could not instantiate v8 string for constant 'receive'");
+                LogError("Could not create JS array for storing the messages");
             }
             else
             {
-                // invoke 'receive' method on gateway; we know this member
-                // exists on the gateway
-                auto gateway = handle_data->module_object.Get(isolate);
-                v8::Local<v8::Value> receive_method;
-                if (gateway->Get(context, prop_key).ToLocal(&receive_method) == false || receive_method->IsFunction() == false)
+                uint32_t index = 0;
+                for (auto message : messages)
                 {
-                    LogError("'receive' property on the gateway has an unexpected value");
+                    auto js_message = create_js_message(isolate, context, message);
+                    if (js_message.IsEmpty() == false)
+                    {
+                        auto status = js_messages->CreateDataProperty(context, index, js_message);
+                        if (status.FromMaybe(false) == false)
+                        {
+                            LogError("Could not add a message to the JS array of messages");
+                        }
+                        else
+                        {
+                            index++;
+                        }
+                    }
                 }
-                else
+
+                /*Codes_SRS_NODEJS_17_002: [ When the module has a receiveBatch method, NodeJS_Receive shall invoke it once with an array of the Message instances it delivers in one go, in the order they were received. ]*/
+                v8::Local<v8::Value> args[] = { js_messages };
+                receive_fn->Call(gateway, 1, args);
+            }
+        }
+        else if (get_module_function(isolate, context, gateway, "receive", receive_fn) == false)
+        {
+            // we know this member exists on the gateway
+            LogError("'receive' property on the gateway has an unexpected value");
+        }
+        else
+        {
+            for (auto message : messages)
+            {
+                auto js_message = create_js_message(isolate, context, message);
+                if (js_message.IsEmpty() == false)
                 {
                     /*Codes_SRS_NODEJS_13_023: [ NodeJS_Receive shall invoke GatewayModule.receive passing the newly constructed Message instance. ]*/
-                    auto receive_fn = receive_method.As<v8::Function>();
                     v8::Local<v8::Value> args[] = { js_message };
                     receive_fn->Call(gateway, 1, args);
                 }
             }
         }
     }
+}
 
-    Message_Destroy(message);
+static void schedule_receive(size_t module_id);
+
+static void on_run_receive_messages(
+    v8::Isolate* isolate,
+    v8::Local<v8::Context> context,
+    size_t module_id
+)
+{
+    auto modules_manager = nodejs_module::ModulesManager::Get();
+    if (modules_manager->HasModule(module_id) == false)
+    {
+        // the module was destroyed, its pending messages went with it
+        LogInfo("Module %zu was destroyed before its messages were delivered", module_id);
+    }
+    else
+    {
+        auto& handle_data = modules_manager->GetModuleFromId(module_id);
+
+        /*Codes_SRS_NODEJS_17_001: [ NodeJS_Receive shall deliver the messages pending for a module in batches of at most NODEJS_RECEIVE_MAX_BATCH messages per callback. ]*/
+        std::vector<MESSAGE_HANDLE> messages;
+        bool more;
+        {
+            nodejs_module::LockGuard<NODEJS_MODULE_HANDLE_DATA> lock_guard(handle_data);
+            size_t count = handle_data.pending_messages.size() < NODEJS_RECEIVE_MAX_BATCH ? handle_data.pending_messages.size() : NODEJS_RECEIVE_MAX_BATCH;
+            messages.assign(handle_data.pending_messages.begin(), handle_data.pending_messages.begin() + count);
+            handle_data.pending_messages.erase(handle_data.pending_messages.begin(), handle_data.pending_messages.begin() + count);
+            more = handle_data.pending_messages.empty() == false;
+            handle_data.receive_scheduled = more;
+        }
+
+        deliver_messages(isolate, context, handle_data, messages);
+
+        for (auto message : messages)
+        {
+            Message_Destroy(message);
+        }
+
+        if (more == true)
+        {
+            schedule_receive(module_id);
+        }
+    }
+}
+
+static void schedule_receive(size_t module_id)
+{
+    // run on node's event thread
+    nodejs_module::NodeJSIdle::Get()->AddCallback([module_id]() {
+        nodejs_module::NodeJSUtils::RunWithNodeContext([module_id](v8::Isolate* isolate, v8::Local<v8::Context> context) {
+            on_run_receive_messages(isolate, context, module_id);
+        });
+    });
 }
 
 void NODEJS_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
@@ -1166,12 +1520,29 @@ void NODEJS_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
             // inc ref the message handle
             message = Message_Clone(message);
 
-            // run on node's event thread
-            nodejs_module::NodeJSIdle::Get()->AddCallback([module, message]() {
-                nodejs_module::NodeJSUtils::RunWithNodeContext([module, message](v8::Isolate* isolate, v8::Local<v8::Context> context) {
-                    on_run_receive_message(isolate, context, module, message);
-                });
-            });
+            bool schedule = false;
+            {
+                nodejs_module::LockGuard<NODEJS_MODULE_HANDLE_DATA> lock_guard(*handle_data);
+                try
+                {
+                    handle_data->pending_messages.push_back(message);
+
+                    // a callback that is already queued delivers this message too
+                    schedule = handle_data->receive_scheduled == false;
+                    handle_data->receive_scheduled = true;
+                }
+                catch (std::bad_alloc& err)
+                {
+                    LogError("Could not queue the message for the module: %s", err.what());
+                    Message_Destroy(message);
+                }
+            }
+
+            if (schedule == true)
+            {
+                /*Codes_SRS_NODEJS_13_038: [ NodeJS_Receive shall schedule a callback to be invoked on Node.js's event loop. ]*/
+                schedule_receive(handle_data->module_id);
+            }
         }
     }
 }
@@ -116,16 +116,45 @@ void NodeJSIdle::ReleaseLock() const
 
 void NodeJSIdle::InvokeCallbacks()
 {
-    AcquireLock();
-    while (m_callbacks.empty() == false)
+    // take a bounded batch of callbacks in one go so that a busy
+    // producer neither holds the lock per callback nor starves the
+    // rest of Node's event loop
+    std::vector<std::function<void()>> batch;
     {
-        auto cb = m_callbacks.front();
-        m_callbacks.pop();
-        ReleaseLock();
-        cb();
-        AcquireLock();
+        LockGuard<NodeJSIdle> lock_guard{ *this };
+        size_t count = m_callbacks.size() < NODEJS_IDLE_MAX_BATCH ? m_callbacks.size() : NODEJS_IDLE_MAX_BATCH;
+        batch.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            batch.push_back(std::move(m_callbacks.front()));
+            m_callbacks.pop();
+        }
+
+        // come back for the rest on the next turn of the event loop
+        if (m_callbacks.empty() == false)
+        {
+            uv_async_send(&m_uv_async);
+        }
+    }
+
+    // one handle scope for the whole batch
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    if (isolate != nullptr)
+    {
+        v8::Isolate::Scope isolate_scope(isolate);
+        v8::HandleScope handle_scope(isolate);
+        for (auto& cb : batch)
+        {
+            cb();
+        }
+    }
+    else
+    {
+        for (auto& cb : batch)
+        {
+            cb();
+        }
     }
-    ReleaseLock();
 }
 
 void NodeJSIdle::OnIdle(uv_async_t* handle)
@@ -1453,4 +1453,181 @@ BEGIN_TEST_SUITE(nodejs_int)
         STRING_delete(config.main_path);
     }
 
+    TEST_FUNCTION(nodejs_receive_batch_is_called)
+    {
+        ///arrange
+        const char* MODULE_RECEIVE_BATCH_IS_CALLED = ""                     \
+            "'use strict';"                                                 \
+            "module.exports = {"                                            \
+            "    create: function () {"                                     \
+            "        setTimeout(() => {"                                    \
+            "            _mock_module1.publish_mock_message();"             \
+            "            _mock_module1.publish_mock_message();"             \
+            "        }, 10);"                                               \
+            "        return true;"                                          \
+            "    },"                                                        \
+            "    receive: function (message) {"                             \
+            "        _integrationTest10.notify(false);"                     \
+            "    },"                                                        \
+            "    receiveBatch: function (messages) {"                       \
+            "        let res = Array.isArray(messages)"                     \
+            "                  &&"                                          \
+            "                  messages.length > 0"                         \
+            "                  &&"                                          \
+            "                  messages.every((m) => !!(m.properties)"      \
+            "                                        &&"                    \
+            "                                        m.content.length == 6);" \
+            "        _integrationTest10.notify(res);"                       \
+            "    },"                                                        \
+            "    destroy: function () {"                                    \
+            "    }"                                                         \
+            "};";
+
+        TempFile js_file;
+        js_file.Write(MODULE_RECEIVE_BATCH_IS_CALLED);
+
+        NODEJS_MODULE_CONFIG config = {
+            STRING_construct(js_file.js_file_path.c_str()),
+            STRING_construct("{}")
+        };
+
+        // setup a function to be called from the JS test code
+        NodeJSIdle::Get()->AddCallback([]() {
+            auto notify_result_obj = NodeJSUtils::CreateObjectWithMethod(
+                "notify", notify_result
+            );
+            NodeJSUtils::AddObjectToGlobalContext("_integrationTest10", notify_result_obj);
+
+            auto publish_mock_msg_obj = NodeJSUtils::CreateObjectWithMethod(
+                "publish_mock_message", publish_mock_message
+            );
+            NodeJSUtils::AddObjectToGlobalContext("_mock_module1", publish_mock_msg_obj);
+        });
+
+        ///act
+        auto result = NODEJS_Create(g_broker, &config);
+        const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+        MODULE module = {
+            apis,
+            result
+        };
+        Broker_AddModule(g_broker, &module);
+        BROKER_LINK_DATA broker_data =
+        {
+            g_module.module_handle,
+            result
+        };
+        Broker_AddLink(g_broker, &broker_data);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+
+        // wait for 15 seconds for the publish to happen
+        wait_for_predicate(15, []() {
+            return g_notify_result.WasCalled() == true;
+        });
+        ASSERT_IS_TRUE(g_notify_result.WasCalled() == true);
+        ASSERT_IS_TRUE(g_notify_result.GetResult() == true);
+
+        ///cleanup
+        Broker_RemoveModule(g_broker, &module);
+        NODEJS_Destroy(result);
+        STRING_delete(config.configuration_json);
+        STRING_delete(config.main_path);
+    }
+
+    TEST_FUNCTION(nodejs_message_properties_behave_as_plain_object)
+    {
+        ///arrange
+        const char* MODULE_WRITES_PROPERTIES = ""                                 \
+            "'use strict';"                                                       \
+            "module.exports = {"                                                  \
+            "    create: function () {"                                           \
+            "        setTimeout(() => {"                                          \
+            "            _mock_module1.publish_mock_message();"                   \
+            "        }, 10);"                                                     \
+            "        return true;"                                                \
+            "    },"                                                              \
+            "    receive: function (message) {"                                   \
+            "        let props = message.properties;"                             \
+            "        let res = props['p1'] === 'v1'"                              \
+            "                  &&"                                                \
+            "                  ('p2' in props)"                                   \
+            "                  &&"                                                \
+            "                  props['missing'] === undefined"                    \
+            "                  &&"                                                \
+            "                  Object.keys(props).length === 3;"                  \
+            "        props['p1'] = 'changed';"                                    \
+            "        props['p3'] = 'v3';"                                         \
+            "        delete props['p2'];"                                         \
+            "        res = res"                                                   \
+            "              &&"                                                    \
+            "              props['p1'] === 'changed'"                             \
+            "              &&"                                                    \
+            "              props['p2'] === undefined"                             \
+            "              &&"                                                    \
+            "              props['p3'] === 'v3'"                                  \
+            "              &&"                                                    \
+            "              Object.keys(props).sort().join() === 'p1,p3,ts';"      \
+            "        _integrationTest11.notify(res);"                             \
+            "    },"                                                              \
+            "    destroy: function () {"                                          \
+            "    }"                                                               \
+            "};";
+
+        TempFile js_file;
+        js_file.Write(MODULE_WRITES_PROPERTIES);
+
+        NODEJS_MODULE_CONFIG config = {
+            STRING_construct(js_file.js_file_path.c_str()),
+            STRING_construct("{}")
+        };
+
+        // setup a function to be called from the JS test code
+        NodeJSIdle::Get()->AddCallback([]() {
+            auto notify_result_obj = NodeJSUtils::CreateObjectWithMethod(
+                "notify", notify_result
+            );
+            NodeJSUtils::AddObjectToGlobalContext("_integrationTest11", notify_result_obj);
+
+            auto publish_mock_msg_obj = NodeJSUtils::CreateObjectWithMethod(
+                "publish_mock_message", publish_mock_message
+            );
+            NodeJSUtils::AddObjectToGlobalContext("_mock_module1", publish_mock_msg_obj);
+        });
+
+        ///act
+        auto result = NODEJS_Create(g_broker, &config);
+        const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+
+        MODULE module = {
+            apis,
+            result
+        };
+        Broker_AddModule(g_broker, &module);
+        BROKER_LINK_DATA broker_data =
+        {
+            g_module.module_handle,
+            result
+        };
+        Broker_AddLink(g_broker, &broker_data);
+
+        ///assert
+        ASSERT_IS_NOT_NULL(result);
+
+        // wait for 15 seconds for the publish to happen
+        wait_for_predicate(15, []() {
+            return g_notify_result.WasCalled() == true;
+        });
+        ASSERT_IS_TRUE(g_notify_result.WasCalled() == true);
+        ASSERT_IS_TRUE(g_notify_result.GetResult() == true);
+
+        ///cleanup
+        Broker_RemoveModule(g_broker, &module);
+        NODEJS_Destroy(result);
+        STRING_delete(config.configuration_json);
+        STRING_delete(config.main_path);
+    }
+
     END_TEST_SUITE(nodejs_int)
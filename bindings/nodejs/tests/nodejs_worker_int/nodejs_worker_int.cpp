@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "azure_c_shared_utility/constmap.h"
+#include "message.h"
+#include "broker.h"
+#include "gateway.h"
+#include "experimental/event_system.h"
+
+#include "worker_config_resources.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+#define WORKER_CONTROL_ID "nodejs_worker_int"
+#define WORKER_MESSAGE_SOURCE "nodejs_worker_int"
+
+static LOCK_HANDLE g_tapped_lock;
+static size_t g_tapped_from_worker;
+
+class TempFile
+{
+public:
+    std::string file_path;
+    std::string json_file_path;
+
+    enum
+    {
+        COULD_NOT_CREATE_FILE
+    };
+
+public:
+    TempFile()
+    {
+        // See nodejs_int for why 'tmpnam' is acceptable here.
+        auto temp_path = std::tmpnam(nullptr);
+        if (temp_path == nullptr)
+        {
+            throw COULD_NOT_CREATE_FILE;
+        }
+
+        file_path = temp_path;
+        json_file_path = EscapeForJson(file_path);
+    }
+
+    void Write(std::string contents)
+    {
+        std::ofstream stream(file_path);
+        stream << contents;
+    }
+
+    static std::string EscapeForJson(std::string str)
+    {
+        size_t prev_pos = 0;
+        auto it = str.find("\\", prev_pos);
+        while (it != std::string::npos)
+        {
+            str = str.replace(it, 1, "\\\\");
+            prev_pos = it + 2;
+            it = str.find("\\", prev_pos);
+        }
+
+        return str;
+    }
+
+    ~TempFile()
+    {
+        std::remove(file_path.c_str());
+    }
+};
+
+template <typename TCallback>
+void wait_for_predicate(uint32_t timeout_in_secs, TCallback pred)
+{
+    time_t start_time = get_time(nullptr);
+    while(
+            pred() == false
+            &&
+            (get_time(nullptr) - start_time) < timeout_in_secs
+         )
+    {
+        ThreadAPI_Sleep(500);
+    }
+}
+
+static size_t get_tapped_from_worker()
+{
+    size_t result;
+    (void)Lock(g_tapped_lock);
+    result = g_tapped_from_worker;
+    (void)Unlock(g_tapped_lock);
+    return result;
+}
+
+static void on_message_tapped(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param)
+{
+    const GATEWAY_TAPPED_MESSAGE* tapped = (const GATEWAY_TAPPED_MESSAGE*)context;
+    if (tapped != NULL && tapped->message != NULL)
+    {
+        CONSTMAP_HANDLE properties = Message_GetProperties(tapped->message);
+        if (properties != NULL)
+        {
+            const char* source = ConstMap_GetValue(properties, "source");
+            if (source != NULL && strcmp(source, WORKER_MESSAGE_SOURCE) == 0)
+            {
+                (void)Lock(g_tapped_lock);
+                g_tapped_from_worker++;
+                (void)Unlock(g_tapped_lock);
+            }
+            ConstMap_Destroy(properties);
+        }
+    }
+}
+
+static const char* PUBLISHING_JS_MODULE = ""            \
+"'use strict';"                                         \
+"module.exports = {"                                    \
+"  broker: null,"                                       \
+"  create: function(broker, configuration) {"           \
+"    this.broker = broker;"                             \
+"    return true;"                                      \
+"  },"                                                  \
+"  start: function() {"                                 \
+"    this.timer = setInterval(() => {"                  \
+"      this.broker.publish({"                           \
+"        properties: { 'source': '" WORKER_MESSAGE_SOURCE "' },"  \
+"        content: new Uint8Array([ 1, 2, 3 ])"          \
+"      });"                                             \
+"    }, 100);"                                          \
+"  },"                                                  \
+"  receive: function(message) {"                        \
+"  },"                                                  \
+"  destroy: function() {"                               \
+"    clearInterval(this.timer);"                        \
+"  }"                                                   \
+"};";
+
+static std::string worker_gateway_json(const std::string& js_path)
+{
+    std::string worker_path = TempFile::EscapeForJson(nodejs_worker_path());
+    std::string binding_path = TempFile::EscapeForJson(nodejs_binding_path());
+
+    return
+        "{"
+        "  \"modules\": ["
+        "    {"
+        "      \"name\": \"js_publisher\","
+        "      \"loader\": {"
+        "        \"name\": \"outprocess\","
+        "        \"entrypoint\": {"
+        "          \"activation.type\": \"launch\","
+        "          \"control.id\": \"" WORKER_CONTROL_ID "\","
+        "          \"launch\": {"
+        "            \"path\": \"" + worker_path + "\","
+        "            \"args\": [ \"" WORKER_CONTROL_ID "\" ]"
+        "          },"
+        "          \"multiplex\": true"
+        "        }"
+        "      },"
+        "      \"args\": {"
+        "        \"outprocess.loaders\": ["
+        "          {"
+        "            \"type\": \"node\","
+        "            \"name\": \"node\","
+        "            \"configuration\": {"
+        "              \"binding.path\": \"" + binding_path + "\""
+        "            }"
+        "          }"
+        "        ],"
+        "        \"outprocess.loader\": {"
+        "          \"name\": \"node\","
+        "          \"entrypoint\": {"
+        "            \"main.path\": \"" + js_path + "\""
+        "          }"
+        "        },"
+        "        \"module.args\": null"
+        "      }"
+        "    }"
+        "  ],"
+        "  \"links\": []"
+        "}";
+}
+
+BEGIN_TEST_SUITE(nodejs_worker_int)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        g_tapped_lock = Lock_Init();
+        ASSERT_IS_NOT_NULL(g_tapped_lock);
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        Lock_Deinit(g_tapped_lock);
+
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        g_tapped_from_worker = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    TEST_FUNCTION(nodejs_worker_runs_a_multiplexed_js_module)
+    {
+        ///arrange
+        TempFile js_file;
+        js_file.Write(PUBLISHING_JS_MODULE);
+
+        TempFile json_file;
+        json_file.Write(worker_gateway_json(js_file.json_file_path));
+
+        BROKER_MESSAGE_TAP tap = { 1, true };
+
+        ///act
+        GATEWAY_HANDLE gateway = Gateway_CreateFromJson(json_file.file_path.c_str());
+        ASSERT_IS_NOT_NULL(gateway);
+
+        Gateway_AddEventCallback(gateway, GATEWAY_MESSAGE_TAPPED, on_message_tapped, NULL);
+        int tap_result = Gateway_SetMessageTap(gateway, &tap);
+
+        // the worker has to start Node.js and load the module before it publishes
+        wait_for_predicate(30, []() {
+            return get_tapped_from_worker() > 0;
+        });
+
+        size_t tapped_from_worker = get_tapped_from_worker();
+
+        // destroying the gateway stops the worker
+        Gateway_Destroy(gateway);
+
+        ///assert
+        ASSERT_ARE_EQUAL(int, 0, tap_result);
+        ASSERT_IS_TRUE(tapped_from_worker > 0);
+    }
+
+END_TEST_SUITE(nodejs_worker_int)
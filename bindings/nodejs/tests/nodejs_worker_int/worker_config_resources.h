@@ -0,0 +1,12 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef WORKER_CONFIG_RESOURCES_H
+#define WORKER_CONFIG_RESOURCES_H
+
+extern "C" {
+const char* nodejs_worker_path();
+const char* nodejs_binding_path();
+}
+
+#endif /*WORKER_CONFIG_RESOURCES_H*/
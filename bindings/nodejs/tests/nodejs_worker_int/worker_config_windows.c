@@ -0,0 +1,15 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+const char* nodejs_worker_path_string = "..\\..\\..\\worker\\Debug\\nodejs_worker.exe";
+const char* nodejs_binding_path_string = "..\\..\\..\\Debug\\nodejs_binding.dll";
+
+const char* nodejs_worker_path()
+{
+    return nodejs_worker_path_string;
+}
+
+const char* nodejs_binding_path()
+{
+    return nodejs_binding_path_string;
+}
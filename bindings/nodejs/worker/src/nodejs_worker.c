@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+ * A Node.js worker is a module host process for JavaScript modules. Node.js
+ * runs a single instance per process, so every JavaScript module of a gateway
+ * shares one thread and one core. The gateway launches one worker per group
+ * of JavaScript modules through the outprocess loader; each worker starts its
+ * own Node.js instance, with its own isolate, event loop and idle queue, and
+ * hosts the modules that name its control id.
+ *
+ * The worker never detaches from the gateway. Node.js installs its own
+ * SIGINT and SIGTERM handlers when the first module starts it, and they end
+ * the process straight away; the gateway destroys the worker's modules and
+ * then stops the worker with SIGTERM, so the process exit is the cleanup.
+ */
+
+#include <stdio.h>
+
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "module.h"
+#include "proxy_gateway.h"
+#include "native_module_host.h"
+
+/* how long the main thread sleeps at a time while the worker thread serves the gateway */
+#define NODEJS_WORKER_IDLE_MS 1000
+
+int main(int argc, char** argv)
+{
+    int result;
+    REMOTE_MODULE_HANDLE remote_module;
+
+    if (argc != 2)
+    {
+        printf("usage: nodejs_worker control_channel_id\n");
+        printf("where control_channel_id is the control.id of the modules hosted by this worker.\n");
+        result = 1;
+    }
+    else if ((remote_module = ProxyGateway_Attach(MODULE_STATIC_GETAPI(OOP_MODULE_HOST)(MODULE_API_VERSION_1), argv[1])) == NULL)
+    {
+        LogError("failed to attach to the gateway on %s", argv[1]);
+        result = 1;
+    }
+    else if (ProxyGateway_StartBlockingWorkerThread(remote_module) != 0)
+    {
+        LogError("failed to start the worker thread");
+        ProxyGateway_Detach(remote_module);
+        result = 1;
+    }
+    else
+    {
+        // runs until the gateway stops the worker, see above
+        for (;;)
+        {
+            ThreadAPI_Sleep(NODEJS_WORKER_IDLE_MS);
+        }
+    }
+
+    return result;
+}
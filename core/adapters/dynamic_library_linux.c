@@ -10,6 +10,12 @@ DYNAMIC_LIBRARY_HANDLE DynamicLibrary_LoadLibrary(const char* dynamicLibraryFile
     return dlopen(dynamicLibraryFileName, RTLD_LAZY);
 }
 
+/*Codes_SRS_DYNAMIC_LIBRARY_17_004: [DynamicLibrary_LoadLibraryEager shall load the named library like DynamicLibrary_LoadLibrary, resolving all of its symbols before returning.]*/
+DYNAMIC_LIBRARY_HANDLE DynamicLibrary_LoadLibraryEager(const char* dynamicLibraryFileName)
+{
+    return dlopen(dynamicLibraryFileName, RTLD_NOW);
+}
+
 /*Codes_SRS_DYNAMIC_LIBRARY_17_002: [DynamicLibrary_UnloadLibrary shall make the OS system call to unload the library referenced by libraryHandle.] */
 void DynamicLibrary_UnloadLibrary(DYNAMIC_LIBRARY_HANDLE libraryHandle)
 {
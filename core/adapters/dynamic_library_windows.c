@@ -68,6 +68,13 @@ DYNAMIC_LIBRARY_HANDLE DynamicLibrary_LoadLibrary(const char* dynamicLibraryFile
     return returnValue;
 }
 
+/*Codes_SRS_DYNAMIC_LIBRARY_17_004: [DynamicLibrary_LoadLibraryEager shall load the named library like DynamicLibrary_LoadLibrary, resolving all of its symbols before returning.]*/
+DYNAMIC_LIBRARY_HANDLE DynamicLibrary_LoadLibraryEager(const char* dynamicLibraryFileName)
+{
+    //Windows binds the imports of a library when it loads it.
+    return DynamicLibrary_LoadLibrary(dynamicLibraryFileName);
+}
+
 /*Codes_SRS_DYNAMIC_LIBRARY_17_002: [DynamicLibrary_UnloadLibrary shall make the OS system call to unload the library referenced by libraryHandle.] */
 void DynamicLibrary_UnloadLibrary(DYNAMIC_LIBRARY_HANDLE libraryHandle)
 {
@@ -0,0 +1,178 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "file_watcher.h"
+
+/* The directory is watched rather than the file, so that a file replaced by
+ * rename (the usual way to write a configuration atomically) keeps being
+ * watched. */
+#define FILE_WATCHER_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+typedef struct FILE_WATCHER_HANDLE_DATA_TAG
+{
+    char* file_path;
+    const char* file_name;
+    FILE_WATCHER_CALLBACK callback;
+    void* context;
+    int inotify_fd;
+    int stop_pipe[2];
+    THREAD_HANDLE thread;
+} FILE_WATCHER_HANDLE_DATA;
+
+static bool read_events(FILE_WATCHER_HANDLE_DATA* watcher)
+{
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t length;
+
+    while ((length = read(watcher->inotify_fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* event_pointer = buffer; event_pointer < buffer + length; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)event_pointer;
+            if (event->len > 0 && (event->mask & FILE_WATCHER_EVENTS) != 0 && strcmp(event->name, watcher->file_name) == 0)
+            {
+                changed = true;
+            }
+            event_pointer += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+static int watcher_worker(void* param)
+{
+    FILE_WATCHER_HANDLE_DATA* watcher = (FILE_WATCHER_HANDLE_DATA*)param;
+    struct pollfd fds[2];
+    fds[0].fd = watcher->stop_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = watcher->inotify_fd;
+    fds[1].events = POLLIN;
+
+    while (poll(fds, 2, -1) >= 0 && (fds[0].revents & POLLIN) == 0)
+    {
+        /* a burst of writes to the file results in a single callback */
+        if ((fds[1].revents & POLLIN) != 0 && read_events(watcher))
+        {
+            watcher->callback(watcher->file_path, watcher->context);
+        }
+    }
+    return 0;
+}
+
+FILE_WATCHER_HANDLE FileWatcher_Create(const char* file_path, FILE_WATCHER_CALLBACK callback, void* context)
+{
+    FILE_WATCHER_HANDLE_DATA* result;
+    if (file_path == NULL || callback == NULL)
+    {
+        LogError("invalid arg file_path=%p, callback=%p", file_path, callback);
+        result = NULL;
+    }
+    else if ((result = (FILE_WATCHER_HANDLE_DATA*)malloc(sizeof(FILE_WATCHER_HANDLE_DATA))) == NULL)
+    {
+        LogError("unable to allocate the file watcher");
+    }
+    else
+    {
+        size_t path_length = strlen(file_path);
+        const char* slash = strrchr(file_path, '/');
+        /* holds the path, then the directory, NUL terminated after the last slash */
+        char* directory = (char*)malloc(2 * path_length + 3);
+        result->file_path = directory;
+        if (directory == NULL)
+        {
+            LogError("unable to copy the watched path");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            char* directory_copy = directory + path_length + 1;
+            strcpy(directory, file_path);
+            if (slash == NULL)
+            {
+                strcpy(directory_copy, ".");
+                result->file_name = directory;
+            }
+            else
+            {
+                size_t directory_length = (slash == file_path) ? 1 : (size_t)(slash - file_path);
+                memcpy(directory_copy, file_path, directory_length);
+                directory_copy[directory_length] = '\0';
+                result->file_name = directory + (slash - file_path) + 1;
+            }
+            result->callback = callback;
+            result->context = context;
+
+            result->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (result->inotify_fd == -1)
+            {
+                LogError("inotify_init1 failed");
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+            else if (inotify_add_watch(result->inotify_fd, directory_copy, FILE_WATCHER_EVENTS) == -1)
+            {
+                LogError("unable to watch directory %s", directory_copy);
+                close(result->inotify_fd);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+            else if (pipe(result->stop_pipe) != 0)
+            {
+                LogError("unable to create the stop pipe");
+                close(result->inotify_fd);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+            else if (ThreadAPI_Create(&(result->thread), watcher_worker, result) != THREADAPI_OK)
+            {
+                LogError("unable to start the file watcher thread");
+                close(result->stop_pipe[0]);
+                close(result->stop_pipe[1]);
+                close(result->inotify_fd);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+void FileWatcher_Destroy(FILE_WATCHER_HANDLE watcher)
+{
+    if (watcher != NULL)
+    {
+        int thread_result;
+        char stop = 0;
+        if (write(watcher->stop_pipe[1], &stop, 1) != 1)
+        {
+            LogError("unable to signal the file watcher thread");
+        }
+        else if (ThreadAPI_Join(watcher->thread, &thread_result) != THREADAPI_OK)
+        {
+            LogError("unable to join the file watcher thread");
+        }
+        close(watcher->stop_pipe[0]);
+        close(watcher->stop_pipe[1]);
+        close(watcher->inotify_fd);
+        free(watcher->file_path);
+        free(watcher);
+    }
+}
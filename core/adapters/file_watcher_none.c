@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "file_watcher.h"
+
+FILE_WATCHER_HANDLE FileWatcher_Create(const char* file_path, FILE_WATCHER_CALLBACK callback, void* context)
+{
+    (void)callback;
+    (void)context;
+    LogError("watching %s is not supported on this platform", file_path == NULL ? "NULL" : file_path);
+    return NULL;
+}
+
+void FileWatcher_Destroy(FILE_WATCHER_HANDLE watcher)
+{
+    (void)watcher;
+}
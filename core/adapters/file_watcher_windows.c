@@ -0,0 +1,159 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/threadapi.h"
+
+#include "file_watcher.h"
+
+/* Change notifications are per directory, so the watcher compares the last
+ * write time of the file to tell its changes from those of its neighbours. */
+typedef struct FILE_WATCHER_HANDLE_DATA_TAG
+{
+    char* file_path;
+    FILE_WATCHER_CALLBACK callback;
+    void* context;
+    HANDLE change;
+    HANDLE stop;
+    FILETIME last_write;
+    THREAD_HANDLE thread;
+} FILE_WATCHER_HANDLE_DATA;
+
+static FILETIME last_write_time(const char* file_path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    FILETIME result = { 0, 0 };
+    if (GetFileAttributesExA(file_path, GetFileExInfoStandard, &attributes))
+    {
+        result = attributes.ftLastWriteTime;
+    }
+    return result;
+}
+
+static int watcher_worker(void* param)
+{
+    FILE_WATCHER_HANDLE_DATA* watcher = (FILE_WATCHER_HANDLE_DATA*)param;
+    HANDLE handles[2];
+    handles[0] = watcher->stop;
+    handles[1] = watcher->change;
+
+    while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+    {
+        FILETIME last_write = last_write_time(watcher->file_path);
+        if (CompareFileTime(&last_write, &(watcher->last_write)) != 0)
+        {
+            watcher->last_write = last_write;
+            watcher->callback(watcher->file_path, watcher->context);
+        }
+        if (!FindNextChangeNotification(watcher->change))
+        {
+            LogError("FindNextChangeNotification failed, no longer watching %s", watcher->file_path);
+            break;
+        }
+    }
+    return 0;
+}
+
+FILE_WATCHER_HANDLE FileWatcher_Create(const char* file_path, FILE_WATCHER_CALLBACK callback, void* context)
+{
+    FILE_WATCHER_HANDLE_DATA* result;
+    if (file_path == NULL || callback == NULL)
+    {
+        LogError("invalid arg file_path=%p, callback=%p", file_path, callback);
+        result = NULL;
+    }
+    else if ((result = (FILE_WATCHER_HANDLE_DATA*)malloc(sizeof(FILE_WATCHER_HANDLE_DATA))) == NULL)
+    {
+        LogError("unable to allocate the file watcher");
+    }
+    else
+    {
+        size_t path_length = strlen(file_path);
+        /* holds the path, then the directory */
+        char* directory = (char*)malloc(2 * path_length + 3);
+        result->file_path = directory;
+        if (directory == NULL)
+        {
+            LogError("unable to copy the watched path");
+            free(result);
+            result = NULL;
+        }
+        else
+        {
+            char* directory_copy = directory + path_length + 1;
+            const char* slash = strrchr(file_path, '\\');
+            const char* forward_slash = strrchr(file_path, '/');
+            if (forward_slash != NULL && (slash == NULL || forward_slash > slash))
+            {
+                slash = forward_slash;
+            }
+
+            strcpy(directory, file_path);
+            if (slash == NULL)
+            {
+                strcpy(directory_copy, ".");
+            }
+            else
+            {
+                size_t directory_length = (size_t)(slash - file_path) + 1;
+                memcpy(directory_copy, file_path, directory_length);
+                directory_copy[directory_length] = '\0';
+            }
+            result->callback = callback;
+            result->context = context;
+            result->last_write = last_write_time(file_path);
+
+            result->change = FindFirstChangeNotificationA(directory_copy, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+            if (result->change == INVALID_HANDLE_VALUE)
+            {
+                LogError("unable to watch directory %s", directory_copy);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+            else if ((result->stop = CreateEvent(NULL, TRUE, FALSE, NULL)) == NULL)
+            {
+                LogError("unable to create the stop event");
+                FindCloseChangeNotification(result->change);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+            else if (ThreadAPI_Create(&(result->thread), watcher_worker, result) != THREADAPI_OK)
+            {
+                LogError("unable to start the file watcher thread");
+                CloseHandle(result->stop);
+                FindCloseChangeNotification(result->change);
+                free(directory);
+                free(result);
+                result = NULL;
+            }
+        }
+    }
+    return result;
+}
+
+void FileWatcher_Destroy(FILE_WATCHER_HANDLE watcher)
+{
+    if (watcher != NULL)
+    {
+        int thread_result;
+        if (!SetEvent(watcher->stop))
+        {
+            LogError("unable to signal the file watcher thread");
+        }
+        else if (ThreadAPI_Join(watcher->thread, &thread_result) != THREADAPI_OK)
+        {
+            LogError("unable to join the file watcher thread");
+        }
+        CloseHandle(watcher->stop);
+        FindCloseChangeNotification(watcher->change);
+        free(watcher->file_path);
+        free(watcher);
+    }
+}
@@ -41,6 +41,132 @@ typedef struct BROKER_LINK_DATA_TAG {
     MODULE_HANDLE module_sink_handle;
 } BROKER_LINK_DATA;
 
+/** @brief    Place of a module in a group of replicas that share the
+*            messages sent to the group.
+*/
+typedef struct BROKER_REPLICA_TAG {
+    /** @brief    Number of replicas in the group, 0 or 1 when the module is
+    *            not replicated.
+    */
+    size_t count;
+    /** @brief    Index of this replica in the group, less than count.
+    */
+    size_t index;
+    /** @brief    Name of the message property whose value picks the replica,
+    *            NULL when the replicas take turns.
+    */
+    const char* key;
+} BROKER_REPLICA;
+
+/** @brief    Messages that removed modules delivered or lost while draining.
+*/
+typedef struct BROKER_DRAIN_STATISTICS_TAG {
+    /** @brief    Messages delivered to a module after its removal began.
+    */
+    size_t drained_messages;
+    /** @brief    Messages still queued for a module when its drain timeout
+    *            expired.
+    */
+    size_t dropped_messages;
+} BROKER_DRAIN_STATISTICS;
+
+/** @brief    Budgets a module has to stay within to be considered healthy.
+*            Between the budget and the recovery threshold a module keeps
+*            its state, so that an event is not raised again until the module
+*            recovered.
+*/
+typedef struct BROKER_HEALTH_BUDGETS_TAG {
+    /** @brief    Longest time, in milliseconds, a call to the module's
+    *            receive function may take, 0 to not time the calls.
+    */
+    unsigned int receive_budget_ms;
+    /** @brief    A slow module recovers once a call to its receive function
+    *            takes no more than this many milliseconds.
+    */
+    unsigned int receive_recovery_ms;
+    /** @brief    Number of messages queued for the module at which its queue
+    *            is too deep, 0 to not watch the queue.
+    */
+    size_t queue_high_watermark;
+    /** @brief    A module whose queue was too deep recovers once no more than
+    *            this many messages are queued for it.
+    */
+    size_t queue_low_watermark;
+} BROKER_HEALTH_BUDGETS;
+
+#define BROKER_HEALTH_EVENT_VALUES \
+    BROKER_MODULE_SLOW, \
+    BROKER_QUEUE_HIGH_WATERMARK
+
+/** @brief    Enumeration of the budgets a module can exceed.
+*/
+DEFINE_ENUM(BROKER_HEALTH_EVENT, BROKER_HEALTH_EVENT_VALUES);
+
+/** @brief    Measurements of the module that exceeded a budget.
+*/
+typedef struct BROKER_MODULE_HEALTH_TAG {
+    /** @brief    The module that exceeded the budget.
+    */
+    MODULE_HANDLE module_handle;
+    /** @brief    Time, in milliseconds, the module's last call to its receive
+    *            function took, 0 if it was not timed.
+    */
+    unsigned int receive_time_ms;
+    /** @brief    Number of messages queued for the module, counted from
+    *            the last time the module found its queue empty.
+    */
+    size_t queue_depth;
+} BROKER_MODULE_HEALTH;
+
+/** @brief    Function called when a module exceeds one of its budgets.
+*
+*    @details    The function is called on the thread that published or
+*                received the message, once the broker is unlocked. It may
+*                publish, but shall not call #Broker_SetHealthMonitor, which
+*                waits for it to return.
+*/
+typedef void(*BROKER_HEALTH_CALLBACK)(void* context, BROKER_HEALTH_EVENT health_event, const BROKER_MODULE_HEALTH* health);
+
+/** @brief    Which of the published messages a tap sees.
+*/
+typedef struct BROKER_MESSAGE_TAP_TAG {
+    /** @brief    The tap sees 1 in this many of the messages each module
+    *            publishes, 1 to see every message.
+    */
+    size_t sample_interval;
+    /** @brief    Set to hand the message itself to the tap, otherwise the
+    *            tap only sees the message's metadata.
+    */
+    bool include_message;
+} BROKER_MESSAGE_TAP;
+
+/** @brief    A published message seen by a tap.
+*/
+typedef struct BROKER_TAPPED_MESSAGE_TAG {
+    /** @brief    The module that published the message.
+    */
+    MODULE_HANDLE source;
+    /** @brief    The sequence number of the message among the messages
+    *             of source.
+    */
+    uint32_t sequence;
+    /** @brief    Size, in bytes, of the serialized message.
+    */
+    size_t message_size;
+    /** @brief    The message, only valid during the call to the tap, NULL
+    *            unless the tap includes the message.
+    */
+    MESSAGE_HANDLE message;
+} BROKER_TAPPED_MESSAGE;
+
+/** @brief    Function called with the sampled messages.
+*
+*    @details    The function is called on the publishing thread while the
+*                broker is locked, so it shall return quickly and shall not
+*                call into the broker. It shall clone the message to keep it.
+*/
+typedef void(*BROKER_TAP_CALLBACK)(void* context, const BROKER_TAPPED_MESSAGE* tapped);
+
 #define BROKER_RESULT_VALUES \
     BROKER_OK, \
     BROKER_ERROR, \
@@ -96,6 +222,24 @@ GATEWAY_EXPORT void Broker_DecRef(BROKER_HANDLE broker);
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message);
 
+/** @brief        Publishes a batch of messages to the message broker.
+*
+*    @details    Publishes the messages in order, as ::Broker_Publish would,
+*                while taking the broker's lock once for the whole batch.
+*                Publishing stops at the first message that cannot be
+*                published.
+*
+*    @param        broker    The #BROKER_HANDLE onto which the messages will be
+*                        published.
+*    @param        source    The #MODULE_HANDLE from which the messages will be
+*                        published.
+*    @param        messages    Array of the #MESSAGE_HANDLEs to be published.
+*    @param        count    Number of messages in @p messages.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_PublishBatch(BROKER_HANDLE broker, MODULE_HANDLE source, const MESSAGE_HANDLE* messages, size_t count);
+
 /** @brief        Adds a module to the message broker.
 *
 *    @details    For details about threading with regard to the message broker
@@ -111,6 +255,26 @@ GATEWAY_EXPORT BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module);
 
+/** @brief        Adds a module to the message broker as one replica of a
+*                group.
+*
+*    @details    Every replica of a group is linked like a separate module,
+*                but only one replica of the group takes each message. When
+*                the replica has a key, the hash of the message's key property
+*                picks the replica, so that messages with the same key always
+*                reach the same replica. Otherwise the replicas take turns
+*                on the messages of each source.
+*
+*    @param        broker          The #BROKER_HANDLE onto which the module will be 
+*                                added.
+*    @param        module          The #MODULE for the module that will be added 
+*                                to this message broker.
+*    @param        replica         The place of the module in its group.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_AddReplicaModule(BROKER_HANDLE broker, const MODULE* module, const BROKER_REPLICA* replica);
+
 /** @brief        Removes a module from the message broker.
 *   
 *    @param        broker    The #BROKER_HANDLE from which the module will be removed.
@@ -120,6 +284,63 @@ GATEWAY_EXPORT BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE
 */
 GATEWAY_EXPORT BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module);
 
+/** @brief        Sets how long ::Broker_RemoveModule lets a module work through
+*                the messages already queued for it.
+*
+*    @details    With a drain timeout of 0, the default, queued messages are
+*                discarded as soon as the module is removed. Otherwise the
+*                module keeps receiving them until its queue is empty or the
+*                timeout expires, and whatever is left is counted as dropped.
+*
+*    @param        broker              The #BROKER_HANDLE to configure.
+*    @param        drain_timeout_ms    The longest time, in milliseconds, to
+*                                    drain each removed module.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetDrainTimeout(BROKER_HANDLE broker, unsigned int drain_timeout_ms);
+
+/** @brief        Gets the number of messages drained and dropped by the
+*                modules removed from the message broker so far.
+*
+*    @param        broker        The #BROKER_HANDLE to query.
+*    @param        statistics    Receives the message counts.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_GetDrainStatistics(BROKER_HANDLE broker, BROKER_DRAIN_STATISTICS* statistics);
+
+/** @brief        Starts or stops measuring how long modules take to receive
+*                messages and how many messages are queued for them.
+*
+*    @details    Messages are counted from the time the monitor is set. A
+*                module that exceeds a budget raises its event once, and does
+*                not raise it again until it recovered. The function waits for
+*                the calls to the previous callback in progress to return.
+*
+*    @param        broker      The #BROKER_HANDLE to monitor.
+*    @param        budgets     The budgets of every module, NULL to stop
+*                            monitoring.
+*    @param        callback    Function called when a module exceeds a budget.
+*    @param        context     User defined parameter given to @c callback.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetHealthMonitor(BROKER_HANDLE broker, const BROKER_HEALTH_BUDGETS* budgets, BROKER_HEALTH_CALLBACK callback, void* context);
+
+/** @brief        Starts or stops handing a sample of the published messages to
+*                a tap, which sees them without being linked to any module.
+*
+*    @param        broker      The #BROKER_HANDLE to tap.
+*    @param        tap         Which messages the tap sees, NULL to remove the
+*                            tap.
+*    @param        callback    Function called with each sampled message.
+*    @param        context     User defined parameter given to @c callback.
+*
+*    @return        A #BROKER_RESULT describing the result of the function.
+*/
+GATEWAY_EXPORT BROKER_RESULT Broker_SetMessageTap(BROKER_HANDLE broker, const BROKER_MESSAGE_TAP* tap, BROKER_TAP_CALLBACK callback, void* context);
+
 /** @brief        Adds a route to the message broker.
 *
 *    @details    For details about threading with regard to the message broker
@@ -137,6 +358,10 @@ GATEWAY_EXPORT BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_L
 
 /** @brief        Removes a route from the message broker.
 *
+*    @details    The messages of the link still queued for the sink are
+*                discarded, even while the sink drains. Remove a module
+*                before its links to let it drain them.
+*
 *    @param        broker    The #BROKER_HANDLE from which the link will be removed.
 *    @param        link    The #BROKER_LINK_DATA of the link to be removed.
 *
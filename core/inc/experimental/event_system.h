@@ -52,6 +52,30 @@ typedef enum GATEWAY_EVENT_TAG
     /** @brief  Called when the gateway is destroyed. */
     GATEWAY_DESTROYED,
 
+    /** @brief  Called when a module takes longer than its budget to receive
+     *          a message, see #Gateway_SetHealthBudgets.
+     *
+     *  A #GATEWAY_MODULE_HEALTH will be provided as the context to the
+     *  callback, and be later cleaned-up automatically.
+     */
+    GATEWAY_MODULE_SLOW,
+
+    /** @brief  Called when the messages queued for a module reach the high
+     *          watermark, see #Gateway_SetHealthBudgets.
+     *
+     *  A #GATEWAY_MODULE_HEALTH will be provided as the context to the
+     *  callback, and be later cleaned-up automatically.
+     */
+    GATEWAY_QUEUE_HIGH_WATERMARK,
+
+    /** @brief  Called with a sample of the messages published on the
+     *          gateway, see #Gateway_SetMessageTap.
+     *
+     *  A #GATEWAY_TAPPED_MESSAGE will be provided as the context to the
+     *  callback, and be later cleaned-up automatically.
+     */
+    GATEWAY_MESSAGE_TAPPED,
+
     /* @brief   Not an actual event, used to keep track of count of different
      *          events
      */
@@ -66,6 +90,41 @@ typedef enum GATEWAY_EVENT_TAG
  */
 typedef void* GATEWAY_EVENT_CTX;
 
+/** @brief      Context of the #GATEWAY_MODULE_SLOW and
+ *              #GATEWAY_QUEUE_HIGH_WATERMARK events
+ */
+typedef struct GATEWAY_MODULE_HEALTH_TAG
+{
+    /** @brief  The module that exceeded its budget */
+    MODULE_HANDLE module;
+
+    /** @brief  Time, in milliseconds, the module took to receive its last
+     *          message, 0 if it was not timed
+     */
+    unsigned int receive_time_ms;
+
+    /** @brief  Number of messages queued for the module */
+    size_t queue_depth;
+} GATEWAY_MODULE_HEALTH;
+
+/** @brief      Context of the #GATEWAY_MESSAGE_TAPPED event */
+typedef struct GATEWAY_TAPPED_MESSAGE_TAG
+{
+    /** @brief  The module that published the message */
+    MODULE_HANDLE source;
+
+    /** @brief  The broker's sequence number of the message */
+    uint32_t sequence;
+
+    /** @brief  Size, in bytes, of the serialized message */
+    size_t message_size;
+
+    /** @brief  The message, NULL when the tap only reports metadata. Clone
+     *          it to keep it after the callback returns.
+     */
+    MESSAGE_HANDLE message;
+} GATEWAY_TAPPED_MESSAGE;
+
 /** @brief      Function pointer that can be registered and will be called for
  *              gateway events 
  *
@@ -76,6 +135,8 @@ typedef void(*GATEWAY_CALLBACK)(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type
 EVENTSYSTEM_HANDLE EventSystem_Init(void);
 void EventSystem_AddEventCallback(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT event_type, GATEWAY_CALLBACK callback, void* user_param);
 void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type);
+void EventSystem_ReportModuleHealth(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_MODULE_HEALTH* health);
+void EventSystem_ReportMessageTap(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, const GATEWAY_TAPPED_MESSAGE* tapped);
 void EventSystem_Destroy(EVENTSYSTEM_HANDLE event_system);
 
 /** @brief      Registers a function to be called on a callback thread when_all
@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct FILE_WATCHER_HANDLE_DATA_TAG* FILE_WATCHER_HANDLE;
+
+/** @brief  Called on the watcher's thread after the file was written or
+ *          renamed into place.
+ */
+typedef void(*FILE_WATCHER_CALLBACK)(const char* file_path, void* context);
+
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT FILE_WATCHER_HANDLE, FileWatcher_Create, const char*, file_path, FILE_WATCHER_CALLBACK, callback, void*, context);
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, FileWatcher_Destroy, FILE_WATCHER_HANDLE, watcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FILE_WATCHER_H
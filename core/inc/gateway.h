@@ -156,9 +156,17 @@ typedef struct GATEWAY_PROPERTIES_DATA_TAG
  *                          "source": "sensor",
  *                          "sink": "logger"
  *                      }
- *                  ]
+ *                  ],
+ *                  "startup":
+ *                  {
+ *                      "threads": 4
+ *                  }
  *              }
  *
+ *              "startup" is optional. With more than one thread, modules
+ *              are created concurrently and started in the order of the
+ *              links, each module after the modules it sends messages to.
+ *
  * @return      A non-NULL #GATEWAY_HANDLE that can be used to manage the
  *              gateway or @c NULL on failure.
  */
@@ -169,6 +177,13 @@ GATEWAY_EXPORT GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path);
 /** @brief      Updates a gateway using a JSON configuration  string as input
  *              which describes each module. 
  *
+ *              Modules whose name and configuration match a running module
+ *              and links that already exist are left as they are. A module
+ *              whose configuration changed is replaced by a new instance,
+ *              which is linked before the old one is removed. Modules and
+ *              links that are not in @p json_content are kept. If anything
+ *              fails, the gateway is left unchanged.
+ *
  *  @param      gw          Pointer to a #GATEWAY_HANDLE from which to remove
  *                          the module.
  *  @param      json_content A JSON string with a list of Loaders, Modules and/or Links.
@@ -177,6 +192,78 @@ GATEWAY_EXPORT GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path);
  */
 GATEWAY_EXPORT GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const char* json_content);
 
+/** @brief      Makes the gateway match a JSON configuration string.
+ *
+ *              Works like ::Gateway_UpdateFromJson, then removes the links
+ *              and modules that are not in @p json_content. The string
+ *              shall have both "modules" and "links".
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE to update.
+ *  @param      json_content A JSON string with Loaders, Modules and Links.
+ *
+ *  @return     A GATEWAY_UPDATE_FROM_JSON_RESULT with the operation result.
+ */
+GATEWAY_EXPORT GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_ReplaceFromJson(GATEWAY_HANDLE gw, const char* json_content);
+
+/** @brief      Watches a JSON configuration file and applies it with
+ *              ::Gateway_ReplaceFromJson each time it is written.
+ *
+ *              The file is applied on the watcher's own thread. From the
+ *              first call on, the gateway holds a lock while it is started,
+ *              updated or destroyed and while modules or links are added or
+ *              removed, so those calls may come from other threads while the
+ *              file is applied. A file that cannot be parsed or applied
+ *              leaves the gateway unchanged. Watching a file stops watching
+ *              the previous one.
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE to keep updated.
+ *  @param      file_path   Path to the JSON configuration file.
+ *
+ *  @return     Zero on success, a non-zero value otherwise.
+ */
+GATEWAY_EXPORT int Gateway_WatchJsonFile(GATEWAY_HANDLE gw, const char* file_path);
+
+/** @brief      Stops watching the file given to ::Gateway_WatchJsonFile.
+ *              Shall not be called while the file is being applied.
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE.
+ */
+GATEWAY_EXPORT void Gateway_UnwatchJsonFile(GATEWAY_HANDLE gw);
+
+/** @brief      Validates a JSON configuration file and writes it as a binary
+ *              snapshot that ::Gateway_CreateFromSnapshot loads without
+ *              parsing the whole document.
+ *
+ *              The file shall have both "modules" and "links". Every loader
+ *              and entrypoint is checked, so a snapshot only holds
+ *              configurations that would load. The module loader list is
+ *              initialized and destroyed, so this shall not be called in a
+ *              process that runs a gateway.
+ *
+ *  @param      file_path       Path to the JSON configuration file.
+ *  @param      snapshot_path   Path of the snapshot to write.
+ *
+ *  @return     Zero on success, a non-zero value otherwise.
+ */
+GATEWAY_EXPORT int Gateway_CompileJsonSnapshot(const char* file_path, const char* snapshot_path);
+
+/** @brief      Creates and starts a gateway from a snapshot written by
+ *              ::Gateway_CompileJsonSnapshot.
+ *
+ *              The snapshot is read in one piece and checked before use.
+ *              Only the loaders and the module entrypoints are parsed; the
+ *              module "args" are passed on as the validated JSON strings
+ *              they were compiled to. The gateway can then be updated with
+ *              ::Gateway_UpdateFromJson like one created from JSON.
+ *
+ *  @param      snapshot_path   Path to the snapshot.
+ *
+ *  @return     A non-NULL #GATEWAY_HANDLE that can be used to manage the
+ *              gateway or @c NULL on failure, including when the snapshot
+ *              is corrupt or was written by another version.
+ */
+GATEWAY_EXPORT GATEWAY_HANDLE Gateway_CreateFromSnapshot(const char* snapshot_path);
+
 /** @brief      Creates a new gateway using the provided #GATEWAY_PROPERTIES.
  *
  *  @param      properties      #GATEWAY_PROPERTIES structure containing
@@ -195,6 +282,20 @@ GATEWAY_EXPORT GATEWAY_HANDLE Gateway_Create(const GATEWAY_PROPERTIES* propertie
  */
 GATEWAY_EXPORT GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw);
 
+/** @brief      Sets the number of threads ::Gateway_Start uses to start the
+ *              modules. A gateway created from JSON or a snapshot starts
+ *              with the "startup.threads" of its configuration, any other
+ *              gateway with none.
+ *
+ *  @param      gw              Pointer to a #GATEWAY_HANDLE to configure.
+ *  @param      startup_threads The number of threads. Zero or one starts the
+ *                              modules one at a time, in the order they were
+ *                              added.
+ *
+ *  @return     0 on success and a non-zero value when an error occurs.
+ */
+GATEWAY_EXPORT int Gateway_SetStartupThreads(GATEWAY_HANDLE gw, unsigned int startup_threads);
+
 /** @brief      Destroys the gateway and disposes of all associated data.
  *
  *  @param      gw      #GATEWAY_HANDLE to be destroyed.
@@ -241,6 +342,53 @@ GATEWAY_EXPORT void Gateway_RemoveModule(GATEWAY_HANDLE gw, MODULE_HANDLE module
  */
 GATEWAY_EXPORT int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name);
 
+/** @brief      Sets how long a module removed from the gateway, including by
+ *              ::Gateway_Destroy or a JSON update, may keep receiving the
+ *              messages queued for it before it is torn down.
+ *
+ *  @param      gw                  Pointer to a #GATEWAY_HANDLE to configure.
+ *  @param      drain_timeout_ms    The longest time, in milliseconds, to drain
+ *                                  each removed module. 0, the default, drops
+ *                                  the queued messages.
+ *
+ *  @return     0 on success and a non-zero value when an error occurs.
+ */
+GATEWAY_EXPORT int Gateway_SetDrainTimeout(GATEWAY_HANDLE gw, unsigned int drain_timeout_ms);
+
+/** @brief      Gets the number of messages that the modules removed so far
+ *              delivered while draining, and the number they dropped.
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE to query.
+ *  @param      statistics  Receives the message counts.
+ *
+ *  @return     0 on success and a non-zero value when an error occurs.
+ */
+GATEWAY_EXPORT int Gateway_GetDrainStatistics(GATEWAY_HANDLE gw, BROKER_DRAIN_STATISTICS* statistics);
+
+/** @brief      Starts or stops reporting the #GATEWAY_MODULE_SLOW and
+ *              #GATEWAY_QUEUE_HIGH_WATERMARK events of modules that exceed
+ *              the given budgets.
+ *
+ *  @param      gw          Pointer to a #GATEWAY_HANDLE to monitor.
+ *  @param      budgets     The budgets every module has to stay within, NULL
+ *                          to stop monitoring.
+ *
+ *  @return     0 on success and a non-zero value when an error occurs.
+ */
+GATEWAY_EXPORT int Gateway_SetHealthBudgets(GATEWAY_HANDLE gw, const BROKER_HEALTH_BUDGETS* budgets);
+
+/** @brief      Starts or stops reporting a sample of the published messages as
+ *              #GATEWAY_MESSAGE_TAPPED events, so that they can be observed
+ *              without adding links.
+ *
+ *  @param      gw      Pointer to a #GATEWAY_HANDLE to tap.
+ *  @param      tap     Which messages to report, and whether to report the
+ *                      messages or only their metadata. NULL to stop.
+ *
+ *  @return     0 on success and a non-zero value when an error occurs.
+ */
+GATEWAY_EXPORT int Gateway_SetMessageTap(GATEWAY_HANDLE gw, const BROKER_MESSAGE_TAP* tap);
+
 /** @brief      Adds a link to a gateway message broker.
  *
  *  @param      gw          Pointer to a #GATEWAY_HANDLE from which link is
@@ -30,6 +30,7 @@ typedef struct MODULE_API_TAG MODULE_API;
 #include "azure_c_shared_utility/macro_utils.h"
 #include "broker.h"
 #include "message.h"
+#include "parson.h"
 
 
 #ifdef __cplusplus
@@ -63,6 +64,23 @@ extern "C"
      */
     typedef void*(*pfModule_ParseConfigurationFromJson)(const char* configuration);
 
+    /** @brief      Translates module configuration from an already parsed
+     *              JSON value to a module specific data structure.
+     *
+     *  @details    This function is optional. When a module implements it, a
+     *              gateway created from JSON passes the module's "args"
+     *              without serializing them to a string first. The value
+     *              belongs to the caller and is only valid during the call.
+     *
+     *  @param      configuration   The JSON value which describes any needed
+     *                              configuration to create this module.
+     *
+     *  @return     A void pointer containing a parsed representation of the
+     *              module's configuration, freed with the module's
+     *              #pfModule_FreeConfiguration.
+     */
+    typedef void*(*pfModule_ParseConfigurationFromJsonValue)(const JSON_Value* configuration);
+
     /** @brief      Frees the configuration object returned by the
      *              ParseConfigurationFromJson function.
      *
@@ -121,11 +139,12 @@ extern "C"
     /** @brief  Module API version. */
     typedef enum MODULE_API_VERSION_TAG
     {
-        MODULE_API_VERSION_1
+        MODULE_API_VERSION_1,
+        MODULE_API_VERSION_2
     } MODULE_API_VERSION;
 
     /** @brief  Current gateway module API version */
-    static const MODULE_API_VERSION Module_ApiGatewayVersion = MODULE_API_VERSION_1;
+    static const MODULE_API_VERSION Module_ApiGatewayVersion = MODULE_API_VERSION_2;
 
     /** @brief  Structure returned by ::Module_GetApi containing the API
      *          version. By convention, the module returns a compound structure 
@@ -171,6 +190,23 @@ extern "C"
         pfModule_Start Module_Start;
     } MODULE_API_1;
 
+    /** @brief  The module interface, version 2. Extends version 1, so a
+     *          gateway reads the version 1 functions the same way. A module
+     *          shall only return it to a gateway whose version is
+     *          #MODULE_API_VERSION_2 or greater.
+     */
+    typedef struct MODULE_API_2_TAG
+    {
+        /** @brief  The version 1 interface, with its base version set to
+         *          #MODULE_API_VERSION_2. Always the first element. */
+        MODULE_API_1 api_1;
+
+        /** @brief  Function pointer to the
+         *          #Module_ParseConfigurationFromJsonValue function
+         *          (optional). */
+        pfModule_ParseConfigurationFromJsonValue Module_ParseConfigurationFromJsonValue;
+    } MODULE_API_2;
+
     /** @brief  This is the only function exported by a module. Using the
      *          exported function, the caller learns the functions for the 
      *          particular module.
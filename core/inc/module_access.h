@@ -21,6 +21,13 @@ extern "C"
 /** @brief  Macro to get the Module_ParseConfigurationFromJson function from a MODULES_API pointer */
 #define MODULE_PARSE_CONFIGURATION_FROM_JSON(module_api_ptr) (((const MODULE_API_1*)(module_api_ptr))->Module_ParseConfigurationFromJson)
 
+/** @brief  Macro to get the Module_ParseConfigurationFromJsonValue function
+ *          from a MODULES_API pointer, NULL for modules older than version 2 */
+#define MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(module_api_ptr) \
+    ((((const MODULE_API*)(module_api_ptr))->version >= MODULE_API_VERSION_2) ? \
+        ((const MODULE_API_2*)(module_api_ptr))->Module_ParseConfigurationFromJsonValue : \
+        (pfModule_ParseConfigurationFromJsonValue)NULL)
+
 /** @brief  Macro to get the Module_FreeConfiguration function from a MODULES_API pointer */
 #define MODULE_FREE_CONFIGURATION(module_api_ptr) (((const MODULE_API_1*)(module_api_ptr))->Module_FreeConfiguration)
 
@@ -105,7 +105,8 @@ typedef struct MODULE_LOADER_API_TAG
     DOTNET,     \
     DOTNETCORE, \
     NODEJS,     \
-    OUTPROCESS     
+    OUTPROCESS, \
+    NATIVE_STATIC
 
 /**
  * @brief Enumeration listing all supported module loaders
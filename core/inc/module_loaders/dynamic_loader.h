@@ -12,6 +12,8 @@
 #ifndef DYNAMIC_LOADER_H
 #define DYNAMIC_LOADER_H
 
+#include <stdbool.h>
+
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 
@@ -33,9 +35,32 @@ typedef struct DYNAMIC_LOADER_ENTRYPOINT_TAG
     STRING_HANDLE moduleLibraryFileName;
 } DYNAMIC_LOADER_ENTRYPOINT;
 
+/** @brief Configuration of the dynamically linked module loader */
+typedef struct DYNAMIC_LOADER_CONFIGURATION_TAG
+{
+    /** @brief Common loader configuration, unused by this loader */
+    MODULE_LOADER_BASE_CONFIGURATION base;
+
+    /** @brief Resolve every symbol of a module library when it is loaded
+     *         rather than on first use */
+    bool eager_binding;
+} DYNAMIC_LOADER_CONFIGURATION;
+
 /** @brief      The API for the dynamically linked module loader. */
 MOCKABLE_FUNCTION(, GATEWAY_EXPORT const MODULE_LOADER*, DynamicLoader_Get);
 
+/** @brief      Creates the resources shared by every library the loader
+ *              loads. Called by ModuleLoader_Initialize.
+ *
+ *  @return     Zero on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, DynamicLoader_Initialize);
+
+/** @brief      Frees what DynamicLoader_Initialize created, once it has been
+ *              called as many times as DynamicLoader_Initialize succeeded.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, DynamicLoader_Deinitialize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       static_loader.h
+ *  @brief      Library for loading gateway modules that are linked into the
+ *              gateway executable.
+ *
+ *  @details    The executable lists the modules it was linked with in a table
+ *              of #STATIC_LOADER_MODULE entries and hands it to
+ *              StaticLoader_SetModules before creating the gateway. Modules
+ *              are then found by name, without loading any library.
+ */
+
+#ifndef STATIC_LOADER_H
+#define STATIC_LOADER_H
+
+#include <stddef.h>
+
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "module.h"
+#include "module_loader.h"
+#include "gateway_export.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define STATIC_LOADER_NAME "static"
+
+/** @brief A module linked into the gateway executable */
+typedef struct STATIC_LOADER_MODULE_TAG
+{
+    /** @brief Name the module is referred to by in the entrypoint */
+    const char* name;
+
+    /** @brief The module's MODULE_STATIC_GETAPI function */
+    pfModule_GetApi get_api;
+} STATIC_LOADER_MODULE;
+
+/** @brief Table entry for a module exporting MODULE_STATIC_GETAPI(MODULE_NAME),
+ *         e.g. STATIC_LOADER_MODULE_ENTRY(LOGGER_MODULE) */
+#define STATIC_LOADER_MODULE_ENTRY(MODULE_NAME) { #MODULE_NAME, MODULE_STATIC_GETAPI(MODULE_NAME) }
+
+/** @brief Structure to load a statically linked module */
+typedef struct STATIC_LOADER_ENTRYPOINT_TAG
+{
+    /** @brief Name of the module in the table of linked modules */
+    STRING_HANDLE moduleName;
+} STATIC_LOADER_ENTRYPOINT;
+
+/** @brief      The API for the statically linked module loader. */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT const MODULE_LOADER*, StaticLoader_Get);
+
+/** @brief      Sets the table of modules the static loader loads from.
+ *
+ *  @details    The table is not copied and must outlive every gateway using
+ *              the loader. It must be set before the modules are loaded.
+ *
+ *  @param      modules     The linked modules.
+ *  @param      count       Number of entries in @p modules.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, StaticLoader_SetModules, const STATIC_LOADER_MODULE*, modules, size_t, count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STATIC_LOADER_H
@@ -3,6 +3,8 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/vector.h"
@@ -13,6 +15,8 @@
 #include "azure_c_shared_utility/refcount.h"
 #include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/constmap.h"
+#include "azure_c_shared_utility/tickcounter.h"
 
 #include "nanomsg/nn.h"
 #include "nanomsg/pubsub.h"
@@ -27,6 +31,21 @@
 #define INPROC_URL_HEAD "inproc://"
 #define INPROC_URL_HEAD_SIZE 9
 #define URL_SIZE (INPROC_URL_HEAD_SIZE + BROKER_GUID_SIZE +1)
+/* published messages start with the source module and a sequence number */
+#define BROKER_HEADER_SIZE (sizeof(MODULE_HANDLE) + sizeof(uint32_t))
+/* how often a removed module is checked while it drains its queue */
+#define BROKER_DRAIN_POLL_MS 10
+/* how often the health monitor is checked while its callback is running */
+#define BROKER_HEALTH_POLL_MS 1
+/* slots of the source index kept in the broker handle before it moves to the heap */
+#define BROKER_SOURCE_INLINE_SLOTS 8
+
+/*a module of the broker in the source index, a NULL handle marks a free slot*/
+typedef struct BROKER_SOURCE_SLOT_TAG
+{
+    MODULE_HANDLE                   handle;
+    struct BROKER_MODULEINFO_TAG*   module_info;
+}BROKER_SOURCE_SLOT;
 
 /*The structure backing the message broker handle*/
 typedef struct BROKER_HANDLE_DATA_TAG
@@ -35,6 +54,41 @@ typedef struct BROKER_HANDLE_DATA_TAG
     LOCK_HANDLE             modules_lock;
     int                     publish_socket;
     STRING_HANDLE           url;
+    /** Number of the next message published by a source that is not a
+     *  module of this broker, guarded by modules_lock */
+    uint32_t                sequence;
+    /** Time a removed module may spend on its queued messages, 0 to drop
+     *  them, guarded by modules_lock */
+    unsigned int            drain_timeout_ms;
+    /** Messages drained and dropped by removed modules, guarded by
+     *  modules_lock */
+    BROKER_DRAIN_STATISTICS drain_statistics;
+    /** Function told about modules exceeding health_budgets, NULL when the
+     *  modules are not monitored, guarded by modules_lock */
+    BROKER_HEALTH_CALLBACK  health_callback;
+    void*                   health_context;
+    BROKER_HEALTH_BUDGETS   health_budgets;
+    /** Times the calls to Module_Receive, created with the first monitor */
+    TICK_COUNTER_HANDLE     health_ticks;
+    /** Calls to health_callback running outside modules_lock, guarded by
+     *  modules_lock */
+    size_t                  health_reports;
+    /** Function handed the sampled messages, NULL when there is no tap,
+     *  guarded by modules_lock */
+    BROKER_TAP_CALLBACK     tap_callback;
+    void*                   tap_context;
+    BROKER_MESSAGE_TAP      tap;
+    /** Messages published by sources that are not modules of this broker
+     *  since the last sampled one, guarded by modules_lock */
+    size_t                  tap_count;
+    /** The modules keyed by handle, so that publishing finds its source
+     *  without a scan of modules. An open addressing table with linear
+     *  probing, in inline_source_slots until it is half full, then on the
+     *  heap, guarded by modules_lock */
+    BROKER_SOURCE_SLOT*     source_slots;
+    size_t                  source_capacity;
+    size_t                  source_count;
+    BROKER_SOURCE_SLOT      inline_source_slots[BROKER_SOURCE_INLINE_SLOTS];
 }BROKER_HANDLE_DATA;
 
 DEFINE_REFCOUNT_TYPE(BROKER_HANDLE_DATA);
@@ -53,9 +107,54 @@ typedef struct BROKER_MODULEINFO_TAG
     LOCK_HANDLE     socket_lock;
     /** Guid sent to module worker thread to close task */
     STRING_HANDLE   quit_message_guid;
+    /** Number of replicas sharing this module's messages, 0 when the module
+     *  is not replicated
+     */
+    size_t          replica_count;
+    /** Position of this module among its replicas */
+    size_t          replica_index;
+    /** Message property whose value picks the replica, NULL to take turns */
+    char*           replica_key;
+    /** Set once the quit signal was dequeued, guarded by socket_lock */
+    bool            quit_received;
+    /** Set while the module drains its queue, guarded by socket_lock */
+    bool            draining;
+    /** Messages delivered while draining, only written by the worker */
+    size_t          drained_messages;
+    /** The broker this module is attached to */
+    BROKER_HANDLE_DATA* broker;
+    /** Vector of the MODULE_HANDLEs this module is linked to, NULL until
+     *  the first link, guarded by modules_lock */
+    VECTOR_HANDLE   sources;
+    /** Messages published to this module and not yet received since the
+     *  health monitor was set or the module last found its queue empty,
+     *  guarded by modules_lock */
+    size_t          queue_depth;
+    /** Set once the module exceeded the receive budget and until it
+     *  recovers, guarded by modules_lock */
+    bool            slow;
+    /** Set once the queue reached the high watermark and until it drops
+     *  to the low watermark, guarded by modules_lock */
+    bool            queue_high;
+    /** Messages this module published since the last one the tap sampled,
+     *  guarded by modules_lock */
+    size_t          tap_count;
+    /** Number of the next message this module publishes, guarded by
+     *  modules_lock */
+    uint32_t        sequence;
 
 }BROKER_MODULEINFO;
 
+/*health events found while modules_lock was held, reported once it is released*/
+typedef struct BROKER_HEALTH_REPORT_TAG
+{
+    BROKER_HEALTH_CALLBACK  callback;
+    void*                   context;
+    /** BROKER_MODULE_HEALTH of each module whose queue reached the high
+     *  watermark, NULL until the first */
+    VECTOR_HANDLE           queue_high;
+}BROKER_HEALTH_REPORT;
+
 static STRING_HANDLE construct_url()
 {
     STRING_HANDLE result;
@@ -103,6 +202,23 @@ BROKER_HANDLE Broker_Create(void)
     }
     else
     {
+        result->sequence = 0;
+        result->drain_timeout_ms = 0;
+        result->drain_statistics.drained_messages = 0;
+        result->drain_statistics.dropped_messages = 0;
+        result->health_callback = NULL;
+        result->health_context = NULL;
+        memset(&result->health_budgets, 0, sizeof(BROKER_HEALTH_BUDGETS));
+        result->health_ticks = NULL;
+        result->health_reports = 0;
+        result->tap_callback = NULL;
+        result->tap_context = NULL;
+        memset(&result->tap, 0, sizeof(BROKER_MESSAGE_TAP));
+        result->tap_count = 0;
+        result->source_slots = result->inline_source_slots;
+        result->source_capacity = BROKER_SOURCE_INLINE_SLOTS;
+        result->source_count = 0;
+        memset(result->inline_source_slots, 0, sizeof(result->inline_source_slots));
         /*Codes_SRS_BROKER_13_007: [Broker_Create shall initialize BROKER_HANDLE_DATA::modules with a valid VECTOR_HANDLE.]*/
         result->modules = singlylinkedlist_create();
         if (result->modules == NULL)
@@ -188,11 +304,230 @@ void Broker_IncRef(BROKER_HANDLE broker)
     }
 }
 
+static uint32_t hash_replica_key(const char* key)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c = key; *c != '\0'; c++)
+    {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+* Every replica of a group receives the messages of its links, and all but one
+* of them drop each message. Replicas that take turns decide on the sequence
+* number alone, before the message is deserialized. Each source numbers its
+* own messages, so the turns of a source's messages do not depend on what
+* other sources publish.
+*/
+static bool replica_takes_sequence(const BROKER_MODULEINFO* module_info, uint32_t sequence)
+{
+    return module_info->replica_count <= 1 ||
+        module_info->replica_key != NULL ||
+        (sequence % module_info->replica_count) == module_info->replica_index;
+}
+
+static bool replica_takes_message(const BROKER_MODULEINFO* module_info, MESSAGE_HANDLE message, uint32_t sequence)
+{
+    bool result;
+    if (module_info->replica_count <= 1 || module_info->replica_key == NULL)
+    {
+        result = true;
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_17_046: [ A replica with a key shall take the messages whose key property hashes to its index, and take turns on messages without the property. ]*/
+        CONSTMAP_HANDLE properties = Message_GetProperties(message);
+        const char* key = (properties == NULL) ? NULL : ConstMap_GetValue(properties, module_info->replica_key);
+        uint32_t selector = (key == NULL) ? sequence : hash_replica_key(key);
+        result = (selector % module_info->replica_count) == module_info->replica_index;
+        if (properties != NULL)
+        {
+            ConstMap_Destroy(properties);
+        }
+    }
+    return result;
+}
+
 /**
 * This function runs for each module. It receives a pointer to a MODULE_INFO
 * object that describes the module. Its job is to call the Receive function on
 * the associated module whenever it receives a message.
 */
+static bool is_quit_message(const BROKER_MODULEINFO* module_info, const unsigned char* buf, int nbytes)
+{
+    return nbytes == BROKER_GUID_SIZE &&
+        (strncmp(STRING_c_str(module_info->quit_message_guid), (const char *)buf, BROKER_GUID_SIZE-1)==0);
+}
+
+static bool find_source_predicate(const void* element, const void* value)
+{
+    return *(const MODULE_HANDLE*)element == *(const MODULE_HANDLE*)value;
+}
+
+static void fill_module_health(const BROKER_MODULEINFO* module_info, tickcounter_ms_t receive_time_ms, BROKER_MODULE_HEALTH* health)
+{
+    health->module_handle = module_info->module->module_handle;
+    health->receive_time_ms = (unsigned int)receive_time_ms;
+    health->queue_depth = module_info->queue_depth;
+}
+
+/*counts the message in the queue of every module linked to source and adds the modules whose queue reaches the high watermark to report. modules_lock must be held*/
+static void monitor_published_message(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source, BROKER_HEALTH_REPORT* report)
+{
+    const BROKER_HEALTH_BUDGETS* budgets = &(broker_data->health_budgets);
+    LIST_ITEM_HANDLE module_item = singlylinkedlist_get_head_item(broker_data->modules);
+    while (module_item != NULL)
+    {
+        BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_item);
+        if (module_info->sources != NULL && VECTOR_find_if(module_info->sources, find_source_predicate, &source) != NULL)
+        {
+            module_info->queue_depth++;
+            /*Codes_SRS_BROKER_17_062: [ Broker_Publish shall call the health callback with BROKER_QUEUE_HIGH_WATERMARK when the queue of a module linked to source reaches the high watermark, unless it already did and the queue has not dropped to the low watermark since. ]*/
+            if (budgets->queue_high_watermark > 0 && !module_info->queue_high && module_info->queue_depth >= budgets->queue_high_watermark)
+            {
+                BROKER_MODULE_HEALTH health;
+                fill_module_health(module_info, 0, &health);
+                if (report->queue_high == NULL &&
+                    (report->queue_high = VECTOR_create(sizeof(BROKER_MODULE_HEALTH))) == NULL)
+                {
+                    LogError("unable to create the health report, module [%p] is reported on its next message", module_info);
+                }
+                else if (VECTOR_push_back(report->queue_high, &health, 1) != 0)
+                {
+                    LogError("unable to add module [%p] to the health report, it is reported on its next message", module_info);
+                }
+                else
+                {
+                    module_info->queue_high = true;
+                }
+            }
+        }
+        module_item = singlylinkedlist_get_next_item(module_item);
+    }
+}
+
+/*takes the callback that reports the events of report once modules_lock is released, returns whether there are any. modules_lock must be held*/
+static bool hold_health_report(BROKER_HANDLE_DATA* broker_data, BROKER_HEALTH_REPORT* report)
+{
+    bool result;
+    if (report->queue_high == NULL || VECTOR_size(report->queue_high) == 0)
+    {
+        result = false;
+    }
+    else
+    {
+        report->callback = broker_data->health_callback;
+        report->context = broker_data->health_context;
+        broker_data->health_reports++;
+        result = true;
+    }
+    return result;
+}
+
+/*lets Broker_SetHealthMonitor change the monitor once a held report was made. modules_lock must not be held*/
+static void release_health_report(BROKER_HANDLE_DATA* broker_data)
+{
+    if (Lock(broker_data->modules_lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, the health monitor of broker [%p] can no longer be changed", broker_data);
+    }
+    else
+    {
+        broker_data->health_reports--;
+        (void)Unlock(broker_data->modules_lock);
+    }
+}
+
+/*reports the events of report, if any. modules_lock must not be held*/
+static void report_published_health(BROKER_HANDLE_DATA* broker_data, BROKER_HEALTH_REPORT* report, bool held)
+{
+    if (held)
+    {
+        size_t i;
+        size_t count = VECTOR_size(report->queue_high);
+        for (i = 0; i < count; i++)
+        {
+            report->callback(report->context, BROKER_QUEUE_HIGH_WATERMARK, (BROKER_MODULE_HEALTH*)VECTOR_element(report->queue_high, i));
+        }
+        release_health_report(broker_data);
+    }
+    if (report->queue_high != NULL)
+    {
+        VECTOR_destroy(report->queue_high);
+    }
+}
+
+/*takes the message the worker dequeued off the module's queue and checks how long the module took to receive it*/
+static void monitor_received_message(BROKER_MODULEINFO* module_info, bool delivered, tickcounter_ms_t receive_time_ms, bool queue_empty)
+{
+    BROKER_HANDLE_DATA* broker_data = module_info->broker;
+    BROKER_HEALTH_CALLBACK callback = NULL;
+    void* context = NULL;
+    BROKER_MODULE_HEALTH health;
+    if (Lock(broker_data->modules_lock) != LOCK_OK)
+    {
+        LogError("unable to Lock, module [%p] is not monitored for this message", module_info);
+    }
+    else
+    {
+        if (broker_data->health_callback != NULL)
+        {
+            const BROKER_HEALTH_BUDGETS* budgets = &(broker_data->health_budgets);
+            /*Codes_SRS_BROKER_17_078: [ While the broker is monitored, the function shall count the module's queue from zero again whenever it finds no message left on the receive_socket. ]*/
+            if (queue_empty)
+            {
+                module_info->queue_depth = 0;
+            }
+            else if (module_info->queue_depth > 0)
+            {
+                module_info->queue_depth--;
+            }
+            if (module_info->queue_high && module_info->queue_depth <= budgets->queue_low_watermark)
+            {
+                module_info->queue_high = false;
+            }
+
+            if (delivered && budgets->receive_budget_ms > 0)
+            {
+                /*Codes_SRS_BROKER_17_058: [ The function shall call the health callback with BROKER_MODULE_SLOW when the module's receive function takes longer than the receive budget, unless it already did and no call has taken at most the recovery time since. ]*/
+                if (!module_info->slow && receive_time_ms > budgets->receive_budget_ms)
+                {
+                    fill_module_health(module_info, receive_time_ms, &health);
+                    module_info->slow = true;
+                    callback = broker_data->health_callback;
+                    context = broker_data->health_context;
+                    broker_data->health_reports++;
+                }
+                else if (module_info->slow && receive_time_ms <= budgets->receive_recovery_ms)
+                {
+                    module_info->slow = false;
+                }
+            }
+        }
+        (void)Unlock(broker_data->modules_lock);
+
+        if (callback != NULL)
+        {
+            /*Codes_SRS_BROKER_17_079: [ The function shall call the health callback after it unlocks modules_lock. ]*/
+            callback(context, BROKER_MODULE_SLOW, &health);
+            release_health_report(broker_data);
+        }
+    }
+}
+
+/*tells whether no message is left on the module's receive_socket. socket_lock must be held*/
+static bool is_queue_empty(const BROKER_MODULEINFO* module_info)
+{
+    struct nn_pollfd poll_fd;
+    poll_fd.fd = module_info->receive_socket;
+    poll_fd.events = NN_POLLIN;
+    poll_fd.revents = 0;
+    return nn_poll(&poll_fd, 1, 0) == 0;
+}
+
 static int module_worker(void * user_data)
 {
     /*Codes_SRS_BROKER_13_026: [This function shall assign `user_data` to a local variable called `module_info` of type `BROKER_MODULEINFO*`.]*/
@@ -212,9 +547,20 @@ static int module_worker(void * user_data)
         int nn_fd = module_info->receive_socket;
         int nbytes;
         unsigned char *buf = NULL;
+        bool quit_received, draining, queue_empty;
 
         /*Codes_SRS_BROKER_17_005: [ For every iteration of the loop, the function shall wait on the receive_socket for messages. ]*/
         nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, 0);
+        quit_received = is_quit_message(module_info, buf, nbytes);
+        if (quit_received)
+        {
+            module_info->quit_received = true;
+        }
+        draining = module_info->draining;
+        /* the publish socket drops the messages a full queue cannot take, so
+           the monitor counts the queue from zero whenever it is found empty */
+        queue_empty = !quit_received && nbytes >= 0 &&
+            module_info->broker->health_callback != NULL && is_queue_empty(module_info);
         /*Codes_SRS_BROKER_13_091: [ The function shall unlock module_info->socket_lock. ]*/
         if (Unlock(module_info->socket_lock) != LOCK_OK)
         {
@@ -235,8 +581,7 @@ static int module_worker(void * user_data)
         }
         else
         {
-            if (nbytes == BROKER_GUID_SIZE &&
-                (strncmp(STRING_c_str(module_info->quit_message_guid), (const char *)buf, BROKER_GUID_SIZE-1)==0))
+            if (quit_received)
             {
                 /*Codes_SRS_BROKER_13_068: [ This function shall run a loop that keeps running until module_info->quit_message_guid is sent to the thread. ]*/
                 /* received special quit message for this module */
@@ -244,18 +589,53 @@ static int module_worker(void * user_data)
             }
             else
             {
-                /*Codes_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]*/
-                const unsigned char*buf_bytes = (const unsigned char*)buf;
-                buf_bytes += sizeof(MODULE_HANDLE);
-                /*Codes_SRS_BROKER_17_017: [ The function shall deserialize the message received. ]*/
-                MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, nbytes - sizeof(MODULE_HANDLE));
-                /*Codes_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]*/
-                if (msg != NULL)
+                /* probably-past state, checked again under modules_lock */
+                bool monitored = module_info->broker->health_callback != NULL;
+                bool delivered = false;
+                tickcounter_ms_t receive_time_ms = 0;
+                uint32_t sequence = 0;
+                if (module_info->replica_count > 1 && nbytes >= (int)BROKER_HEADER_SIZE)
                 {
-                    /*Codes_SRS_BROKER_13_092: [The function shall deliver the message to the module's callback function via module_info->module_apis. ]*/
-                    MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
-                    /*Codes_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]*/
-                    Message_Destroy(msg);
+                    memcpy(&sequence, buf + sizeof(MODULE_HANDLE), sizeof(uint32_t));
+                }
+
+                /*Codes_SRS_BROKER_17_045: [ A replica without a key shall only take the messages whose sequence number, modulo the replica count, is its index. ]*/
+                if (replica_takes_sequence(module_info, sequence))
+                {
+                    /*Codes_SRS_BROKER_17_024: [ The function shall strip off the topic and the sequence number from the message. ]*/
+                    const unsigned char*buf_bytes = (const unsigned char*)buf;
+                    buf_bytes += BROKER_HEADER_SIZE;
+                    /*Codes_SRS_BROKER_17_017: [ The function shall deserialize the message received. ]*/
+                    MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, nbytes - BROKER_HEADER_SIZE);
+                    /*Codes_SRS_BROKER_17_018: [ If the deserialization is not successful, the message loop shall continue. ]*/
+                    if (msg != NULL)
+                    {
+                        if (replica_takes_message(module_info, msg, sequence))
+                        {
+                            tickcounter_ms_t receive_began, receive_ended;
+                            /*Codes_SRS_BROKER_17_057: [ While the broker is monitored, the function shall time the call to the module's receive function. ]*/
+                            bool timed = monitored && tickcounter_get_current_ms(module_info->broker->health_ticks, &receive_began) == 0;
+                            /*Codes_SRS_BROKER_13_092: [The function shall deliver the message to the module's callback function via module_info->module_apis. ]*/
+                            MODULE_RECEIVE(module_info->module->module_apis)(module_info->module->module_handle, msg);
+                            if (timed && tickcounter_get_current_ms(module_info->broker->health_ticks, &receive_ended) == 0)
+                            {
+                                receive_time_ms = receive_ended - receive_began;
+                            }
+                            delivered = true;
+                            if (draining)
+                            {
+                                /*Codes_SRS_BROKER_17_051: [ The function shall count the messages delivered while the module drains. ]*/
+                                module_info->drained_messages++;
+                            }
+                        }
+                        /*Codes_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]*/
+                        Message_Destroy(msg);
+                    }
+                }
+
+                if (monitored)
+                {
+                    monitor_received_message(module_info, delivered, receive_time_ms, queue_empty);
                 }
             }
             /*Codes_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]*/
@@ -266,10 +646,24 @@ static int module_worker(void * user_data)
     return 0;
 }
 
-static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* module)
+static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* module, const BROKER_REPLICA* replica)
 {
     BROKER_RESULT result;
 
+    module_info->replica_count = (replica == NULL) ? 0 : replica->count;
+    module_info->replica_index = (replica == NULL) ? 0 : replica->index;
+    module_info->replica_key = NULL;
+    module_info->quit_received = false;
+    module_info->draining = false;
+    module_info->drained_messages = 0;
+    module_info->broker = NULL;
+    module_info->sources = NULL;
+    module_info->queue_depth = 0;
+    module_info->slow = false;
+    module_info->queue_high = false;
+    module_info->tap_count = 0;
+    module_info->sequence = 0;
+
     /*Codes_SRS_BROKER_13_107: The function shall assign the `module` handle to `BROKER_MODULEINFO::module`.*/
     module_info->module = (MODULE*)malloc(sizeof(MODULE));
     if (module_info->module == NULL)
@@ -277,8 +671,21 @@ static BROKER_RESULT init_module(BROKER_MODULEINFO* module_info, const MODULE* m
         LogError("Allocate module failed");
         result = BROKER_ERROR;
     }
+    /*Codes_SRS_BROKER_17_044: [ Broker_AddReplicaModule shall copy the replica's key. ]*/
+    else if (replica != NULL && replica->key != NULL &&
+        (module_info->replica_key = (char*)malloc(strlen(replica->key) + 1)) == NULL)
+    {
+        LogError("Allocate replica key failed");
+        free(module_info->module);
+        module_info->module = NULL;
+        result = BROKER_ERROR;
+    }
     else
     {
+        if (module_info->replica_key != NULL)
+        {
+            (void)strcpy(module_info->replica_key, replica->key);
+        }
         module_info->module->module_apis = module->module_apis;
         module_info->module->module_handle = module->module_handle;
 
@@ -328,6 +735,11 @@ static void deinit_module(BROKER_MODULEINFO* module_info)
     Lock_Deinit(module_info->socket_lock);
     STRING_delete(module_info->quit_message_guid);
     free(module_info->module);
+    free(module_info->replica_key);
+    if (module_info->sources != NULL)
+    {
+        VECTOR_destroy(module_info->sources);
+    }
 }
 
 static BROKER_RESULT start_module(BROKER_MODULEINFO* module_info, STRING_HANDLE url)
@@ -392,9 +804,66 @@ static BROKER_RESULT start_module(BROKER_MODULEINFO* module_info, STRING_HANDLE
     return result;
 }
 
+/*waits for the worker to dequeue the quit signal, which nanomsg delivers after every message queued before it*/
+static void drain_module(BROKER_MODULEINFO* module_info, unsigned int drain_timeout_ms)
+{
+    unsigned int waited_ms = 0;
+    bool quit_received = false;
+
+    while (!quit_received && waited_ms < drain_timeout_ms)
+    {
+        if (Lock(module_info->socket_lock) != LOCK_OK)
+        {
+            LogError("unable to Lock, abandoning drain of module [%p]", module_info);
+            break;
+        }
+        else
+        {
+            module_info->draining = true;
+            quit_received = module_info->quit_received;
+            (void)Unlock(module_info->socket_lock);
+            if (!quit_received)
+            {
+                ThreadAPI_Sleep(BROKER_DRAIN_POLL_MS);
+                waited_ms += BROKER_DRAIN_POLL_MS;
+            }
+        }
+    }
+}
+
+/*discards the messages queued ahead of the quit signal, returns how many there were. socket_lock must be held*/
+static size_t drop_module_messages(BROKER_MODULEINFO* module_info)
+{
+    size_t dropped = 0;
+
+    while (!module_info->quit_received)
+    {
+        unsigned char *buf = NULL;
+        int nbytes = nn_recv(module_info->receive_socket, (void *)&buf, NN_MSG, NN_DONTWAIT);
+        if (nbytes < 0)
+        {
+            break;
+        }
+        else
+        {
+            if (is_quit_message(module_info, buf, nbytes))
+            {
+                module_info->quit_received = true;
+            }
+            else
+            {
+                dropped++;
+            }
+            nn_freemsg(buf);
+        }
+    }
+    return dropped;
+}
+
 /*stop module means: stop the thread that feeds messages to Module_Receive function + deletion of all queued messages */
+/*when drain_timeout_ms is not 0 the thread first gets that long to deliver the queued messages*/
 /*returns 0 if success, otherwise __LINE__*/
-static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
+static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info, unsigned int drain_timeout_ms, BROKER_DRAIN_STATISTICS* drain_statistics)
 {
     int  quit_result, close_result, thread_result, result;
 
@@ -409,6 +878,12 @@ static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
     }
     else
     {
+        if (drain_timeout_ms > 0)
+        {
+            /*Codes_SRS_BROKER_17_050: [ If the drain timeout is not 0, Broker_RemoveModule shall let the worker thread deliver the messages queued ahead of the quit signal until they are all delivered or the drain timeout expires. ]*/
+            drain_module(module_info, drain_timeout_ms);
+        }
+
         /*Codes_SRS_BROKER_02_001: [ Broker_RemoveModule shall lock BROKER_MODULEINFO::socket_lock. ]*/
         if (Lock(module_info->socket_lock) != LOCK_OK)
         {
@@ -419,6 +894,12 @@ static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
         }
         else
         {
+            if (drain_timeout_ms > 0)
+            {
+                /*Codes_SRS_BROKER_17_052: [ If the drain timeout expires, Broker_RemoveModule shall count the messages still queued ahead of the quit signal as dropped. ]*/
+                drain_statistics->dropped_messages += drop_module_messages(module_info);
+            }
+
             /*Codes_SRS_BROKER_17_015: [ This function shall close the BROKER_MODULEINFO::receive_socket. ]*/
             close_result = nn_close(module_info->receive_socket);
             if (close_result < 0)
@@ -444,12 +925,130 @@ static int stop_module(int publish_socket, BROKER_MODULEINFO* module_info)
     }
     else
     {
+        /*Codes_SRS_BROKER_17_051: [ The function shall count the messages delivered while the module drains. ]*/
+        drain_statistics->drained_messages += module_info->drained_messages;
         result = 0;
     }
     return result;
 }
 
-BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
+static size_t hash_source(MODULE_HANDLE handle)
+{
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = (const unsigned char*)&handle;
+    for (size_t i = 0; i < sizeof(handle); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return (size_t)hash;
+}
+
+static void place_source(BROKER_SOURCE_SLOT* slots, size_t capacity, MODULE_HANDLE handle, BROKER_MODULEINFO* module_info)
+{
+    size_t slot = hash_source(handle) & (capacity - 1);
+    while (slots[slot].handle != NULL)
+    {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    slots[slot].handle = handle;
+    slots[slot].module_info = module_info;
+}
+
+/*adds module_info to the source index, moving the index to a table twice the size once it is half full. modules_lock must be held*/
+static int add_source(BROKER_HANDLE_DATA* broker_data, BROKER_MODULEINFO* module_info)
+{
+    int result;
+    if ((broker_data->source_count + 1) * 2 > broker_data->source_capacity)
+    {
+        size_t capacity = broker_data->source_capacity * 2;
+        BROKER_SOURCE_SLOT* slots = (BROKER_SOURCE_SLOT*)malloc(capacity * sizeof(BROKER_SOURCE_SLOT));
+        if (slots == NULL)
+        {
+            LogError("unable to grow the source index to %zu slots", capacity);
+            result = __LINE__;
+        }
+        else
+        {
+            memset(slots, 0, capacity * sizeof(BROKER_SOURCE_SLOT));
+            for (size_t i = 0; i < broker_data->source_capacity; i++)
+            {
+                if (broker_data->source_slots[i].handle != NULL)
+                {
+                    place_source(slots, capacity, broker_data->source_slots[i].handle, broker_data->source_slots[i].module_info);
+                }
+            }
+            if (broker_data->source_slots != broker_data->inline_source_slots)
+            {
+                free(broker_data->source_slots);
+            }
+            broker_data->source_slots = slots;
+            broker_data->source_capacity = capacity;
+            result = 0;
+        }
+    }
+    else
+    {
+        result = 0;
+    }
+
+    if (result == 0)
+    {
+        place_source(broker_data->source_slots, broker_data->source_capacity, module_info->module->module_handle, module_info);
+        broker_data->source_count++;
+    }
+    return result;
+}
+
+/*removes module_info from the source index, shifting back the slots probed past it. modules_lock must be held*/
+static void remove_source(BROKER_HANDLE_DATA* broker_data, const BROKER_MODULEINFO* module_info)
+{
+    BROKER_SOURCE_SLOT* slots = broker_data->source_slots;
+    size_t mask = broker_data->source_capacity - 1;
+    size_t slot = hash_source(module_info->module->module_handle) & mask;
+    while (slots[slot].handle != NULL && slots[slot].module_info != module_info)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    if (slots[slot].handle != NULL)
+    {
+        size_t next = (slot + 1) & mask;
+        while (slots[next].handle != NULL)
+        {
+            size_t home = hash_source(slots[next].handle) & mask;
+            /* the slot at next moves into the hole unless its home lies cyclically in (slot, next] */
+            if (((next - home) & mask) >= ((next - slot) & mask))
+            {
+                slots[slot] = slots[next];
+                slot = next;
+            }
+            next = (next + 1) & mask;
+        }
+        slots[slot].handle = NULL;
+        slots[slot].module_info = NULL;
+        broker_data->source_count--;
+    }
+}
+
+/*finds the module of the broker whose handle is source, NULL when source is not a module of the broker. modules_lock must be held*/
+static BROKER_MODULEINFO* find_source(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source)
+{
+    BROKER_MODULEINFO* result = NULL;
+    size_t mask = broker_data->source_capacity - 1;
+    size_t slot = hash_source(source) & mask;
+    while (result == NULL && broker_data->source_slots[slot].handle != NULL)
+    {
+        if (broker_data->source_slots[slot].handle == source)
+        {
+            result = broker_data->source_slots[slot].module_info;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return result;
+}
+
+static BROKER_RESULT add_module(BROKER_HANDLE broker, const MODULE* module, const BROKER_REPLICA* replica)
 {
     BROKER_RESULT result;
 
@@ -475,11 +1074,12 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
         }
         else
         {
-            if (init_module(module_info, module) != BROKER_OK)
+            if (init_module(module_info, module, replica) != BROKER_OK)
             {
                 /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
                 LogError("start_module failed");
                 free(module_info->module);
+                free(module_info->replica_key);
                 free(module_info);
                 result = BROKER_ERROR;
             }
@@ -487,6 +1087,7 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
             {
                 /*Codes_SRS_BROKER_13_039: [This function shall acquire the lock on BROKER_HANDLE_DATA::modules_lock.]*/
                 BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+                module_info->broker = broker_data;
                 if (Lock(broker_data->modules_lock) != LOCK_OK)
                 {
                     /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
@@ -507,11 +1108,21 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
                         free(module_info);
                         result = BROKER_ERROR;
                     }
+                    /*Codes_SRS_BROKER_17_082: [ Broker_AddModule shall add the new instance of BROKER_MODULEINFO to the source index, keyed by the module's handle. ]*/
+                    else if (add_source(broker_data, module_info) != 0)
+                    {
+                        /*Codes_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                        deinit_module(module_info);
+                        singlylinkedlist_remove(broker_data->modules, moduleListItem);
+                        free(module_info);
+                        result = BROKER_ERROR;
+                    }
                     else
                     {
                         if (start_module(module_info, broker_data->url) != BROKER_OK)
                         {
                             LogError("start_module failed");
+                            remove_source(broker_data, module_info);
                             deinit_module(module_info);
                             singlylinkedlist_remove(broker_data->modules, moduleListItem);
                             free(module_info);
@@ -535,6 +1146,28 @@ BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
     return result;
 }
 
+BROKER_RESULT Broker_AddModule(BROKER_HANDLE broker, const MODULE* module)
+{
+    return add_module(broker, module, NULL);
+}
+
+BROKER_RESULT Broker_AddReplicaModule(BROKER_HANDLE broker, const MODULE* module, const BROKER_REPLICA* replica)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_043: [ If replica is NULL, or its index is not less than its count, Broker_AddReplicaModule shall return BROKER_INVALIDARG. ]*/
+    if (replica == NULL || replica->index >= replica->count)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid replica.");
+    }
+    else
+    {
+        /*Codes_SRS_BROKER_17_047: [ Otherwise Broker_AddReplicaModule shall add the module as Broker_AddModule does. ]*/
+        result = add_module(broker, module, replica);
+    }
+    return result;
+}
+
 static bool find_module_predicate(LIST_ITEM_HANDLE list_item, const void* value)
 {
     BROKER_MODULEINFO* element = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(list_item);
@@ -565,6 +1198,8 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
         {
             /*Codes_SRS_BROKER_13_049: [Broker_RemoveModule shall perform a linear search for module in BROKER_HANDLE_DATA::modules.]*/
             LIST_ITEM_HANDLE module_info_item = singlylinkedlist_find(broker_data->modules, find_module_predicate, module);
+            BROKER_MODULEINFO* module_info = NULL;
+            unsigned int drain_timeout_ms = broker_data->drain_timeout_ms;
 
             if (module_info_item == NULL)
             {
@@ -574,8 +1209,25 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
             }
             else
             {
-                BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
-                if (stop_module(broker_data->publish_socket, module_info) == 0)
+                module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_info_item);
+
+                /*Codes_SRS_BROKER_13_052: [The function shall remove the module from BROKER_HANDLE_DATA::modules.]*/
+                singlylinkedlist_remove(broker_data->modules, module_info_item);
+                /*Codes_SRS_BROKER_17_083: [ Broker_RemoveModule shall remove the module from the source index. ]*/
+                remove_source(broker_data, module_info);
+
+                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+                result = BROKER_OK;
+            }
+
+            /*Codes_SRS_BROKER_13_054: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+            Unlock(broker_data->modules_lock);
+
+            if (module_info != NULL)
+            {
+                /*Codes_SRS_BROKER_17_056: [ Broker_RemoveModule shall stop the module after releasing BROKER_HANDLE_DATA::modules_lock, so that the module can still publish while it drains. ]*/
+                BROKER_DRAIN_STATISTICS drain_statistics = { 0, 0 };
+                if (stop_module(broker_data->publish_socket, module_info, drain_timeout_ms, &drain_statistics) == 0)
                 {
                     deinit_module(module_info);
                 }
@@ -583,20 +1235,218 @@ BROKER_RESULT Broker_RemoveModule(BROKER_HANDLE broker, const MODULE* module)
                 {
                     LogError("unable to stop module");
                 }
-
-                /*Codes_SRS_BROKER_13_052: [The function shall remove the module from BROKER_HANDLE_DATA::modules.]*/
-                singlylinkedlist_remove(broker_data->modules, module_info_item);
                 free(module_info);
 
-                /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                result = BROKER_OK;
+                if (drain_statistics.drained_messages > 0 || drain_statistics.dropped_messages > 0)
+                {
+                    if (Lock(broker_data->modules_lock) != LOCK_OK)
+                    {
+                        LogError("Lock on broker_data->modules_lock failed, drain statistics are lost");
+                    }
+                    else
+                    {
+                        broker_data->drain_statistics.drained_messages += drain_statistics.drained_messages;
+                        broker_data->drain_statistics.dropped_messages += drain_statistics.dropped_messages;
+                        Unlock(broker_data->modules_lock);
+                    }
+                }
             }
+        }
+    }
 
-            /*Codes_SRS_BROKER_13_054: [This function shall release the lock on BROKER_HANDLE_DATA::modules_lock.]*/
+    return result;
+}
+
+BROKER_RESULT Broker_SetDrainTimeout(BROKER_HANDLE broker, unsigned int drain_timeout_ms)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_049: [ If broker is NULL, Broker_SetDrainTimeout shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_053: [ Broker_SetDrainTimeout shall store drain_timeout_ms as the drain timeout of the modules removed afterwards. ]*/
+            broker_data->drain_timeout_ms = drain_timeout_ms;
             Unlock(broker_data->modules_lock);
+            result = BROKER_OK;
         }
     }
+    return result;
+}
 
+BROKER_RESULT Broker_GetDrainStatistics(BROKER_HANDLE broker, BROKER_DRAIN_STATISTICS* statistics)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_054: [ If broker or statistics is NULL, Broker_GetDrainStatistics shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL || statistics == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter (NULL).");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_055: [ Broker_GetDrainStatistics shall copy the counts of drained and dropped messages into statistics. ]*/
+            *statistics = broker_data->drain_statistics;
+            Unlock(broker_data->modules_lock);
+            result = BROKER_OK;
+        }
+    }
+    return result;
+}
+
+/*locks modules_lock once no call to the health callback is in progress, returns 0 on success*/
+static int lock_without_health_reports(BROKER_HANDLE_DATA* broker_data)
+{
+    int result;
+    if (Lock(broker_data->modules_lock) != LOCK_OK)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+        while (result == 0 && broker_data->health_reports > 0)
+        {
+            (void)Unlock(broker_data->modules_lock);
+            ThreadAPI_Sleep(BROKER_HEALTH_POLL_MS);
+            if (Lock(broker_data->modules_lock) != LOCK_OK)
+            {
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_SetHealthMonitor(BROKER_HANDLE broker, const BROKER_HEALTH_BUDGETS* budgets, BROKER_HEALTH_CALLBACK callback, void* context)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_059: [ If broker is NULL, or budgets is not NULL and callback is NULL, or the recovery time exceeds the receive budget, or the low watermark is not below a non-zero high watermark, Broker_SetHealthMonitor shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL ||
+        (budgets != NULL && (callback == NULL ||
+            budgets->receive_recovery_ms > budgets->receive_budget_ms ||
+            (budgets->queue_high_watermark > 0 && budgets->queue_low_watermark >= budgets->queue_high_watermark))))
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter broker=%p, budgets=%p, callback=%p.", broker, budgets, callback);
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_17_081: [ Broker_SetHealthMonitor shall wait for the calls to the health callback in progress to return. ]*/
+        if (lock_without_health_reports(broker_data) != 0)
+        {
+            /*Codes_SRS_BROKER_17_065: [ If locking modules_lock or creating the tick counter fails, Broker_SetHealthMonitor shall return BROKER_ERROR. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            if (budgets != NULL && broker_data->health_ticks == NULL &&
+                (broker_data->health_ticks = tickcounter_create()) == NULL)
+            {
+                /*Codes_SRS_BROKER_17_065: [ If locking modules_lock or creating the tick counter fails, Broker_SetHealthMonitor shall return BROKER_ERROR. ]*/
+                LogError("unable to create the tick counter of the health monitor");
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                /*Codes_SRS_BROKER_17_060: [ Broker_SetHealthMonitor shall store budgets, callback and context, stop monitoring when budgets is NULL, and count the queued messages of every module from zero. ]*/
+                LIST_ITEM_HANDLE module_item = singlylinkedlist_get_head_item(broker_data->modules);
+                while (module_item != NULL)
+                {
+                    BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_item);
+                    module_info->queue_depth = 0;
+                    module_info->slow = false;
+                    module_info->queue_high = false;
+                    module_item = singlylinkedlist_get_next_item(module_item);
+                }
+
+                if (budgets == NULL)
+                {
+                    broker_data->health_callback = NULL;
+                    broker_data->health_context = NULL;
+                    memset(&broker_data->health_budgets, 0, sizeof(BROKER_HEALTH_BUDGETS));
+                }
+                else
+                {
+                    broker_data->health_callback = callback;
+                    broker_data->health_context = context;
+                    broker_data->health_budgets = *budgets;
+                }
+                result = BROKER_OK;
+            }
+            Unlock(broker_data->modules_lock);
+        }
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_SetMessageTap(BROKER_HANDLE broker, const BROKER_MESSAGE_TAP* tap, BROKER_TAP_CALLBACK callback, void* context)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_17_066: [ If broker is NULL, or tap is not NULL and callback is NULL or the sample interval is 0, Broker_SetMessageTap shall return BROKER_INVALIDARG. ]*/
+    if (broker == NULL || (tap != NULL && (callback == NULL || tap->sample_interval == 0)))
+    {
+        result = BROKER_INVALIDARG;
+        LogError("invalid parameter broker=%p, tap=%p, callback=%p.", broker, tap, callback);
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_067: [ If locking modules_lock fails, Broker_SetMessageTap shall return BROKER_ERROR. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_068: [ Broker_SetMessageTap shall store tap, callback and context, remove the tap when tap is NULL, and count the published messages of every module from zero. ]*/
+            LIST_ITEM_HANDLE module_item = singlylinkedlist_get_head_item(broker_data->modules);
+            while (module_item != NULL)
+            {
+                BROKER_MODULEINFO* module_info = (BROKER_MODULEINFO*)singlylinkedlist_item_get_value(module_item);
+                module_info->tap_count = 0;
+                module_item = singlylinkedlist_get_next_item(module_item);
+            }
+            broker_data->tap_count = 0;
+
+            if (tap == NULL)
+            {
+                broker_data->tap_callback = NULL;
+                broker_data->tap_context = NULL;
+                memset(&broker_data->tap, 0, sizeof(BROKER_MESSAGE_TAP));
+            }
+            else
+            {
+                broker_data->tap_callback = callback;
+                broker_data->tap_context = context;
+                broker_data->tap = *tap;
+            }
+            result = BROKER_OK;
+            Unlock(broker_data->modules_lock);
+        }
+    }
     return result;
 }
 
@@ -669,6 +1519,15 @@ BROKER_RESULT Broker_AddLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* link)
                         LogError("Unable to make link in Broker");
                         result = BROKER_ADD_LINK_ERROR;
                     }
+                    /*Codes_SRS_BROKER_17_063: [ Broker_AddLink shall remember link->module_source_handle as a source of the sink module, so that the messages queued for the sink can be counted. ]*/
+                    else if ((module_info->sources == NULL && (module_info->sources = VECTOR_create(sizeof(MODULE_HANDLE))) == NULL) ||
+                        VECTOR_push_back(module_info->sources, &(link->module_source_handle), 1) != 0)
+                    {
+                        /*Codes_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]*/
+                        LogError("Unable to remember the source of the link");
+                        (void)nn_setsockopt(module_info->receive_socket, NN_SUB, NN_SUB_UNSUBSCRIBE, &(link->module_source_handle), sizeof(MODULE_HANDLE));
+                        result = BROKER_ADD_LINK_ERROR;
+                    }
                     else
                     {
                         result = BROKER_OK;
@@ -733,6 +1592,13 @@ BROKER_RESULT Broker_RemoveLink(BROKER_HANDLE broker, const BROKER_LINK_DATA* li
                     }
                     else
                     {
+                        /*Codes_SRS_BROKER_17_064: [ Broker_RemoveLink shall forget link->module_source_handle as a source of the sink module. ]*/
+                        MODULE_HANDLE* source = (module_info->sources == NULL) ? NULL :
+                            (MODULE_HANDLE*)VECTOR_find_if(module_info->sources, find_source_predicate, &(link->module_source_handle));
+                        if (source != NULL)
+                        {
+                            VECTOR_erase(module_info->sources, source, 1);
+                        }
                         result = BROKER_OK;
                     }
                 }
@@ -763,6 +1629,14 @@ static void broker_decrement_ref(BROKER_HANDLE broker)
             STRING_delete(broker_data->url);
             singlylinkedlist_destroy(broker_data->modules);
             Lock_Deinit(broker_data->modules_lock);
+            if (broker_data->source_slots != broker_data->inline_source_slots)
+            {
+                free(broker_data->source_slots);
+            }
+            if (broker_data->health_ticks != NULL)
+            {
+                tickcounter_destroy(broker_data->health_ticks);
+            }
             free(broker_data);
         }
     }
@@ -783,84 +1657,192 @@ extern void Broker_DecRef(BROKER_HANDLE broker)
     broker_decrement_ref(broker);
 }
 
-BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message)
+/*hands the message to the tap if it is the one in sample_interval that source published. modules_lock must be held*/
+static void tap_published_message(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source, BROKER_MODULEINFO* source_info, uint32_t sequence, int32_t message_size, MESSAGE_HANDLE message)
+{
+    size_t* tap_count = (source_info == NULL) ? &(broker_data->tap_count) : &(source_info->tap_count);
+
+    (*tap_count)++;
+    if (*tap_count >= broker_data->tap.sample_interval)
+    {
+        BROKER_TAPPED_MESSAGE tapped;
+        *tap_count = 0;
+        tapped.source = source;
+        tapped.sequence = sequence;
+        tapped.message_size = (size_t)message_size;
+        /*Codes_SRS_BROKER_17_070: [ Broker_Publish shall only hand the message itself to the tap when the tap includes the message. ]*/
+        tapped.message = broker_data->tap.include_message ? message : NULL;
+        broker_data->tap_callback(broker_data->tap_context, &tapped);
+    }
+}
+
+/*publishes message from source on the publish socket and adds the health events it raises to report. source_info is the module info of source, NULL when source is not a module of the broker. modules_lock must be held*/
+static BROKER_RESULT publish_message_locked(BROKER_HANDLE_DATA* broker_data, MODULE_HANDLE source, BROKER_MODULEINFO* source_info, MESSAGE_HANDLE message, BROKER_HEALTH_REPORT* report)
 {
     BROKER_RESULT result;
-    /*Codes_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]*/
-    if (broker == NULL || source == NULL || message == NULL)
+    int32_t msg_size;
+    int32_t buf_size;
+    /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
+    MESSAGE_HANDLE msg = Message_Clone(message);
+    /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
+    msg_size = Message_ToByteArray(message, NULL, 0);
+    if (msg_size < 0)
     {
-        result = BROKER_INVALIDARG;
-        LogError("Broker handle, source, and/or message handle is NULL");
+        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+        LogError("unable to serialize a message [%p]", msg);
+        Message_Destroy(msg);
+        result = BROKER_ERROR;
     }
     else
     {
-        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
-        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]*/
-        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE) + sizeof(uint32_t). ]*/
+        buf_size = msg_size + BROKER_HEADER_SIZE;
+        void* nn_msg = nn_allocmsg(buf_size, 0);
+        if (nn_msg == NULL)
         {
             /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-            LogError("Lock on broker_data->modules_lock failed");
+            LogError("unable to serialize a message [%p]", msg);
             result = BROKER_ERROR;
         }
         else
         {
-            int32_t msg_size;
-            int32_t buf_size;
-            /*Codes_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ]*/
-            MESSAGE_HANDLE msg = Message_Clone(message);
-            /*Codes_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]*/
-            msg_size = Message_ToByteArray(message, NULL, 0);
-            if (msg_size < 0)
+            /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
+            unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
+            memcpy(nn_msg_bytes, &source, sizeof(MODULE_HANDLE));
+            nn_msg_bytes += sizeof(MODULE_HANDLE);
+            /*Codes_SRS_BROKER_17_048: [ Broker_Publish shall copy source's next sequence number after source, numbering the messages of each module of the broker separately and the messages of any other source together. ]*/
+            uint32_t* next_sequence = (source_info == NULL) ? &(broker_data->sequence) : &(source_info->sequence);
+            uint32_t sequence = *next_sequence;
+            memcpy(nn_msg_bytes, &sequence, sizeof(uint32_t));
+            (*next_sequence)++;
+            /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
+            nn_msg_bytes += sizeof(uint32_t);
+            Message_ToByteArray(message, nn_msg_bytes, msg_size);
+
+            /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
+            int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
+            if (nbytes != buf_size)
             {
                 /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                LogError("unable to serialize a message [%p]", msg);
-                Message_Destroy(msg);
+                LogError("unable to send a message [%p]", msg);
+                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+                nn_freemsg(nn_msg);
                 result = BROKER_ERROR;
             }
             else
             {
-                /*Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]*/
-                buf_size = msg_size + sizeof(MODULE_HANDLE);
-                void* nn_msg = nn_allocmsg(buf_size, 0);
-                if (nn_msg == NULL)
+                if (broker_data->health_callback != NULL)
                 {
-                    /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                    LogError("unable to serialize a message [%p]", msg);
-                    result = BROKER_ERROR;
+                    /*Codes_SRS_BROKER_17_061: [ While the broker is monitored, Broker_Publish shall count the message in the queue of every module linked to source. ]*/
+                    monitor_published_message(broker_data, source, report);
                 }
-                else
+                if (broker_data->tap_callback != NULL)
                 {
-                    /*Codes_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]*/
-                    unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
-                    memcpy(nn_msg_bytes, &source, sizeof(MODULE_HANDLE));
-                    /*Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]*/
-                    nn_msg_bytes += sizeof(MODULE_HANDLE);
-                    Message_ToByteArray(message, nn_msg_bytes, msg_size);
-
-                    /*Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]*/
-                    int nbytes = nn_send(broker_data->publish_socket, &nn_msg, NN_MSG, 0);
-                    if (nbytes != buf_size)
-                    {
-                        /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
-                        LogError("unable to send a message [%p]", msg);
-                        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                        nn_freemsg(nn_msg);
-                        result = BROKER_ERROR;
-                    }
-                    else
-                    {
-                        result = BROKER_OK;
-                    }
+                    /*Codes_SRS_BROKER_17_069: [ While the broker is tapped, Broker_Publish shall hand 1 in sample_interval of the messages each source publishes to the tap. ]*/
+                    tap_published_message(broker_data, source, source_info, sequence, msg_size, message);
                 }
-                /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
-                Message_Destroy(msg);
-                /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
+                result = BROKER_OK;
             }
+        }
+        /*Codes_SRS_BROKER_17_012: [ Broker_Publish shall free the message. ]*/
+        Message_Destroy(msg);
+        /*Codes_SRS_BROKER_17_011: [ Broker_Publish shall free the serialized message data. ]*/
+    }
+    return result;
+}
+
+BROKER_RESULT Broker_Publish(BROKER_HANDLE broker, MODULE_HANDLE source, MESSAGE_HANDLE message)
+{
+    BROKER_RESULT result;
+    /*Codes_SRS_BROKER_13_030: [If broker or message is NULL the function shall return BROKER_INVALIDARG.]*/
+    if (broker == NULL || source == NULL || message == NULL)
+    {
+        result = BROKER_INVALIDARG;
+        LogError("Broker handle, source, and/or message handle is NULL");
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_13_053: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            BROKER_HEALTH_REPORT report = { NULL, NULL, NULL };
+            bool held;
+            /*Codes_SRS_BROKER_17_084: [ Broker_Publish shall find source among the broker's modules in the source index. ]*/
+            result = publish_message_locked(broker_data, source, find_source(broker_data, source), message, &report);
+            held = hold_health_report(broker_data, &report);
             /*Codes_SRS_BROKER_17_023: [ Broker_Publish shall Unlock the modules lock. ]*/
             Unlock(broker_data->modules_lock);
+            /*Codes_SRS_BROKER_17_080: [ Broker_Publish shall call the health callback after it unlocks the modules lock. ]*/
+            report_published_health(broker_data, &report, held);
         }
 
     }
     /*Codes_SRS_BROKER_13_037: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
     return result;
-}
\ No newline at end of file
+}
+
+BROKER_RESULT Broker_PublishBatch(BROKER_HANDLE broker, MODULE_HANDLE source, const MESSAGE_HANDLE* messages, size_t count)
+{
+    BROKER_RESULT result;
+    size_t i = 0;
+
+    if (messages != NULL)
+    {
+        while (i < count && messages[i] != NULL)
+        {
+            i++;
+        }
+    }
+
+    if (broker == NULL || source == NULL || messages == NULL || count == 0 || i < count)
+    {
+        /*Codes_SRS_BROKER_17_071: [ Broker_PublishBatch shall return BROKER_INVALIDARG if broker, source or messages is NULL, count is 0, or any of the messages is NULL. ]*/
+        result = BROKER_INVALIDARG;
+        LogError("invalid batch - broker = %p, source = %p, messages = %p, count = %zu", broker, source, messages, count);
+    }
+    else
+    {
+        BROKER_HANDLE_DATA* broker_data = (BROKER_HANDLE_DATA*)broker;
+        /*Codes_SRS_BROKER_17_072: [ Broker_PublishBatch shall Lock the modules lock once for the whole batch. ]*/
+        if (Lock(broker_data->modules_lock) != LOCK_OK)
+        {
+            /*Codes_SRS_BROKER_17_076: [ Broker_PublishBatch shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]*/
+            LogError("Lock on broker_data->modules_lock failed");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            /*Codes_SRS_BROKER_17_077: [ Broker_PublishBatch shall look source up among the broker's modules once for the whole batch. ]*/
+            BROKER_MODULEINFO* source_info = find_source(broker_data, source);
+            BROKER_HEALTH_REPORT report = { NULL, NULL, NULL };
+            bool held;
+            /*Codes_SRS_BROKER_17_073: [ Broker_PublishBatch shall publish the messages in order, each the way Broker_Publish publishes a message. ]*/
+            result = BROKER_OK;
+            for (i = 0; i < count && result == BROKER_OK; i++)
+            {
+                result = publish_message_locked(broker_data, source, source_info, messages[i], &report);
+            }
+            held = hold_health_report(broker_data, &report);
+
+            if (result != BROKER_OK)
+            {
+                /*Codes_SRS_BROKER_17_074: [ Broker_PublishBatch shall stop at the first message it fails to publish. ]*/
+                LogError("unable to publish message %zu of a batch of %zu", i - 1, count);
+            }
+
+            /*Codes_SRS_BROKER_17_075: [ Broker_PublishBatch shall Unlock the modules lock. ]*/
+            Unlock(broker_data->modules_lock);
+            /*Codes_SRS_BROKER_17_080: [ Broker_Publish shall call the health callback after it unlocks the modules lock. ]*/
+            report_published_health(broker_data, &report, held);
+        }
+    }
+
+    return result;
+}
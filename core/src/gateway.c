@@ -17,6 +17,8 @@
 static bool module_info_name_find(const void* element, const void* module_name);
 static void gateway_destroymodulelist_internal(GATEWAY_MODULE_INFO* infos, size_t count);
 static bool module_data_find(const void* element, const void* value);
+static void gateway_health_callback(void* context, BROKER_HEALTH_EVENT health_event, const BROKER_MODULE_HEALTH* health);
+static void gateway_tap_callback(void* context, const BROKER_TAPPED_MESSAGE* tapped);
 
 VECTOR_HANDLE Gateway_GetModuleList(GATEWAY_HANDLE gw)
 {
@@ -28,6 +30,10 @@ VECTOR_HANDLE Gateway_GetModuleList(GATEWAY_HANDLE gw)
         LogError("NULL gateway handle given to GetModuleLIst");
         result = NULL;
     }
+    else if (gateway_lock_internal(gw) != 0)
+    {
+        result = NULL;
+    }
     else
     {
         result = VECTOR_create(sizeof(GATEWAY_MODULE_INFO));
@@ -123,6 +129,7 @@ VECTOR_HANDLE Gateway_GetModuleList(GATEWAY_HANDLE gw)
                 free(resize);
             }
         }
+        gateway_unlock_internal(gw);
     }
     return result;
 }
@@ -158,7 +165,7 @@ GATEWAY_HANDLE Gateway_Create(const GATEWAY_PROPERTIES* properties)
     }
     else
     {
-        result = gateway_create_internal(properties, false);
+        result = gateway_create_internal(properties, false, 0);
         if (result == NULL)
         {
             /* Codes_SRS_GATEWAY_27_027: [ Launch - This function shall join any spawned threads upon any failure. ] */
@@ -173,23 +180,33 @@ GATEWAY_HANDLE Gateway_Create(const GATEWAY_PROPERTIES* properties)
 GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw)
 {
     GATEWAY_START_RESULT result;
-    if (gw != NULL)
+    if (gw != NULL && gateway_lock_internal(gw) == 0)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
-        /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
-        size_t module_count = VECTOR_size(gateway_handle->modules);
-        size_t m;
-        for (m = 0; m < module_count; m++)
+        if (gateway_handle->startup_threads > 1)
         {
-            MODULE_DATA** module_data = VECTOR_element(gateway_handle->modules, m);
-            pfModule_Start pfStart = MODULE_START((*module_data)->module_loader->api->GetApi((*module_data)->module_loader, (*module_data)->module_library_handle));
-            if (pfStart != NULL)
+            /*Codes_SRS_GATEWAY_17_033: [ The modules of one step shall be started concurrently on up to startup_threads threads. ]*/
+            gateway_startmodules_parallel_internal(gateway_handle);
+        }
+        else
+        {
+            /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+            size_t module_count = VECTOR_size(gateway_handle->modules);
+            size_t m;
+            for (m = 0; m < module_count; m++)
             {
-                /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
-                (pfStart)((*module_data)->module);
+                MODULE_DATA** module_data = VECTOR_element(gateway_handle->modules, m);
+                pfModule_Start pfStart = MODULE_START((*module_data)->module_loader->api->GetApi((*module_data)->module_loader, (*module_data)->module_library_handle));
+                if (pfStart != NULL)
+                {
+                    /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+                    (pfStart)((*module_data)->module);
+                }
             }
         }
+        gateway_handle->started = true;
+        gateway_unlock_internal(gateway_handle);
         /*Codes_SRS_GATEWAY_17_012: [ This function shall report a GATEWAY_STARTED event. ]*/
         EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_STARTED);
         /*Codes_SRS_GATEWAY_17_013: [ This function shall return GATEWAY_START_SUCCESS upon completion. ]*/
@@ -203,6 +220,30 @@ GATEWAY_START_RESULT Gateway_Start(GATEWAY_HANDLE gw)
     return result;
 }
 
+int Gateway_SetStartupThreads(GATEWAY_HANDLE gw, unsigned int startup_threads)
+{
+    int result;
+    if (gw == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_055: [ If gw is NULL, Gateway_SetStartupThreads shall return a non-zero value. ]*/
+        LogError("NULL gateway given to Gateway_SetStartupThreads()");
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_17_056: [ Gateway_SetStartupThreads shall set the number of threads Gateway_Start uses while holding the gateway's lock, and return a non-zero value if it cannot take the lock. ]*/
+    else if (gateway_lock_internal(gw) != 0)
+    {
+        LogError("Unable to lock the gateway");
+        result = __LINE__;
+    }
+    else
+    {
+        gw->startup_threads = startup_threads;
+        gateway_unlock_internal(gw);
+        result = 0;
+    }
+    return result;
+}
+
 void Gateway_Destroy(GATEWAY_HANDLE gw)
 {
     gateway_destroy_internal(gw);
@@ -216,7 +257,15 @@ MODULE_HANDLE Gateway_AddModule(GATEWAY_HANDLE gw, const GATEWAY_MODULES_ENTRY*
     /*Codes_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's loader_configuration or loader_api is NULL the function shall return NULL. ]*/
     if (gw != NULL && entry != NULL)
     {
-        module = gateway_addmodule_internal(gw, entry, false);
+        if (gateway_lock_internal(gw) != 0)
+        {
+            module = NULL;
+        }
+        else
+        {
+            module = gateway_addmodule_internal(gw, entry, false);
+            gateway_unlock_internal(gw);
+        }
 
         if (module == NULL)
         {
@@ -239,7 +288,7 @@ MODULE_HANDLE Gateway_AddModule(GATEWAY_HANDLE gw, const GATEWAY_MODULES_ENTRY*
 
 extern void Gateway_StartModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
 {
-    if (gw != NULL)
+    if (gw != NULL && gateway_lock_internal(gw) == 0)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
         MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_data_find, module);
@@ -257,11 +306,12 @@ extern void Gateway_StartModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
             /*Codes_SRS_GATEWAY_17_007: [ If module is not found in the gateway, this function shall do nothing. ]*/
             LogError("Gateway_StartModule(): Failed to start module because the MODULE_DATA not found.");
         }
+        gateway_unlock_internal(gateway_handle);
     }
     else
     {
         /*Codes_SRS_GATEWAY_17_006: [ If gw is NULL, this function shall do nothing. ]*/
-        LogError("Gateway_StartModule(): Failed to start module because the GATEWAY_HANDLE is NULL.");
+        LogError("Gateway_StartModule(): Failed to start module because the GATEWAY_HANDLE is NULL or cannot be locked.");
     }
 }
 
@@ -269,7 +319,7 @@ extern void Gateway_StartModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
 void Gateway_RemoveModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
 {
     /*Codes_SRS_GATEWAY_14_020: [ If gw or module is NULL the function shall return. ]*/
-    if (gw != NULL)
+    if (gw != NULL && gateway_lock_internal(gw) == 0)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
@@ -279,17 +329,19 @@ void Gateway_RemoveModule(GATEWAY_HANDLE gw, MODULE_HANDLE module)
         if (module_data != NULL)
         {
             gateway_removemodule_internal(gateway_handle, module_data);
+            gateway_unlock_internal(gateway_handle);
             /*Codes_SRS_GATEWAY_26_012: [ The function shall report `GATEWAY_MODULE_LIST_CHANGED` event after successfully removing the module. ]*/
             EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_MODULE_LIST_CHANGED);
         }
         else
         {
+            gateway_unlock_internal(gateway_handle);
             LogError("Gateway_RemoveModule(): Failed to remove module because the MODULE_DATA pointer is NULL.");
         }
     }
     else
     {
-        LogError("Gateway_RemoveModule(): Failed to remove module because the GATEWA_HANDLE is NULL.");
+        LogError("Gateway_RemoveModule(): Failed to remove module because the GATEWA_HANDLE is NULL or cannot be locked.");
     }
 }
 
@@ -298,16 +350,23 @@ int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name)
     int result;
     if (gw != NULL && module_name != NULL)
     {
-        MODULE_DATA **module_data = (MODULE_DATA**)VECTOR_find_if(gw->modules, module_name_find, module_name);
-        if (module_data != NULL)
+        size_t position;
+        if (gateway_lock_internal(gw) != 0)
         {
+            result = __LINE__;
+        }
+        else if (gateway_index_findmodule(gw, module_name, &position) != NULL)
+        {
+            MODULE_DATA **module_data = (MODULE_DATA**)VECTOR_element(gw->modules, position);
             /* Codes_SRS_GATEWAY_26_016: [** The function shall return 0 if the module was found. ] */
             result = 0;
             gateway_removemodule_internal(gw, module_data);
+            gateway_unlock_internal(gw);
             EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_MODULE_LIST_CHANGED);
         }
         else
         {
+            gateway_unlock_internal(gw);
             /* Codes_SRS_GATEWAY_26_017: [** If module with `module_name` name is not found this function shall return non - zero and do nothing. ] */
             LogError("Couldn't find module with the specified name");
             result = __LINE__;
@@ -322,6 +381,96 @@ int Gateway_RemoveModuleByName(GATEWAY_HANDLE gw, const char *module_name)
     return result;
 }
 
+int Gateway_SetDrainTimeout(GATEWAY_HANDLE gw, unsigned int drain_timeout_ms)
+{
+    int result;
+    if (gw == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_037: [ If gw is NULL, Gateway_SetDrainTimeout shall return a non-zero value. ]*/
+        LogError("NULL gateway given to Gateway_SetDrainTimeout()");
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_17_038: [ Gateway_SetDrainTimeout shall set the drain timeout of the gateway's broker by calling Broker_SetDrainTimeout, and return a non-zero value if it fails. ]*/
+    else if (Broker_SetDrainTimeout(gw->broker, drain_timeout_ms) != BROKER_OK)
+    {
+        LogError("Unable to set the drain timeout of the broker");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int Gateway_GetDrainStatistics(GATEWAY_HANDLE gw, BROKER_DRAIN_STATISTICS* statistics)
+{
+    int result;
+    if (gw == NULL || statistics == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_039: [ If gw or statistics is NULL, Gateway_GetDrainStatistics shall return a non-zero value. ]*/
+        LogError("invalid arg gw=%p, statistics=%p", gw, statistics);
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_17_040: [ Gateway_GetDrainStatistics shall get the counts from the gateway's broker by calling Broker_GetDrainStatistics, and return a non-zero value if it fails. ]*/
+    else if (Broker_GetDrainStatistics(gw->broker, statistics) != BROKER_OK)
+    {
+        LogError("Unable to get the drain statistics of the broker");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+int Gateway_SetHealthBudgets(GATEWAY_HANDLE gw, const BROKER_HEALTH_BUDGETS* budgets)
+{
+    int result;
+    if (gw == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_041: [ If gw is NULL, Gateway_SetHealthBudgets shall return a non-zero value. ]*/
+        LogError("NULL gateway given to Gateway_SetHealthBudgets()");
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_17_042: [ Gateway_SetHealthBudgets shall start or, when budgets is NULL, stop monitoring the gateway's broker by calling Broker_SetHealthMonitor, and return a non-zero value if it fails. ]*/
+    else if (Broker_SetHealthMonitor(gw->broker, budgets, (budgets == NULL) ? NULL : gateway_health_callback, gw) != BROKER_OK)
+    {
+        LogError("Unable to set the health monitor of the broker");
+        result = __LINE__;
+    }
+    else
+    {
+        gw->health_monitored = (budgets != NULL);
+        result = 0;
+    }
+    return result;
+}
+
+int Gateway_SetMessageTap(GATEWAY_HANDLE gw, const BROKER_MESSAGE_TAP* tap)
+{
+    int result;
+    if (gw == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_045: [ If gw is NULL, Gateway_SetMessageTap shall return a non-zero value. ]*/
+        LogError("NULL gateway given to Gateway_SetMessageTap()");
+        result = __LINE__;
+    }
+    /*Codes_SRS_GATEWAY_17_046: [ Gateway_SetMessageTap shall set or, when tap is NULL, remove the tap of the gateway's broker by calling Broker_SetMessageTap, and return a non-zero value if it fails. ]*/
+    else if (Broker_SetMessageTap(gw->broker, tap, (tap == NULL) ? NULL : gateway_tap_callback, gw) != BROKER_OK)
+    {
+        LogError("Unable to set the message tap of the broker");
+        result = __LINE__;
+    }
+    else
+    {
+        gw->message_tapped = (tap != NULL);
+        result = 0;
+    }
+    return result;
+}
+
 GATEWAY_ADD_LINK_RESULT Gateway_AddLink(GATEWAY_HANDLE gw, const GATEWAY_LINK_ENTRY* entryLink)
 {
     GATEWAY_ADD_LINK_RESULT result;
@@ -332,9 +481,15 @@ GATEWAY_ADD_LINK_RESULT Gateway_AddLink(GATEWAY_HANDLE gw, const GATEWAY_LINK_EN
         result = GATEWAY_ADD_LINK_INVALID_ARG;
         LogError("Failed to add link because either the GATEWAY_HANDLE is NULL, entryLink, module_source string is NULL or empty or module_sink is NULL or empty. gw = %p, module_source = '%s', module_sink = '%s'.", gw, entryLink, (entryLink != NULL)? entryLink->module_source:NULL, (entryLink != NULL) ? entryLink->module_sink : NULL);
     }
+    else if (gateway_lock_internal(gw) != 0)
+    {
+        result = GATEWAY_ADD_LINK_ERROR;
+    }
     else
     {
-        if (!gateway_addlink_internal(gw, entryLink))
+        bool added = gateway_addlink_internal(gw, entryLink);
+        gateway_unlock_internal(gw);
+        if (!added)
         {
             /*Codes_SRS_GATEWAY_04_010: [ If the entryLink already exists it the function shall return GATEWAY_ADD_LINK_ERROR ] */
             /*Codes_SRS_GATEWAY_04_011: [ If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
@@ -359,21 +514,23 @@ void Gateway_RemoveLink(GATEWAY_HANDLE gw, const GATEWAY_LINK_ENTRY* entryLink)
     {
         LogError("Gateway_RemoveLink(): Failed to remove link because the GATEWAY_HANDLE is NULL or entryLink is NULL.");
     }
-    else
+    else if (gateway_lock_internal(gw) == 0)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
         /*Codes_SRS_GATEWAY_04_006: [ The function shall locate the LINK_DATA object in GATEWAY_HANDLE_DATA's links containing link and return if it cannot be found. ]*/
-        LINK_DATA* link_data = (LINK_DATA*)VECTOR_find_if(gateway_handle->links, link_data_find, entryLink);
+        size_t position = gateway_index_findlink(gateway_handle, entryLink);
 
-        if (link_data != NULL)
+        if (position != GATEWAY_INDEX_NOT_FOUND)
         {
-            gateway_removelink_internal(gateway_handle, link_data);
+            gateway_removelink_internal(gateway_handle, (LINK_DATA*)VECTOR_element(gateway_handle->links, position));
+            gateway_unlock_internal(gateway_handle);
             /*Codes_SRS_GATEWAY_26_018: [ The function shall report `GATEWAY_MODULE_LIST_CHANGED` event. ]*/
             EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_MODULE_LIST_CHANGED);
         }
         else
         {
+            gateway_unlock_internal(gateway_handle);
             LogError("Gateway_RemoveLink(): Could not find link given it's source/sink.");
         }
     }
@@ -401,3 +558,29 @@ static bool module_info_name_find(const void* element, const void* module_name)
     const char* name = (const char*)module_name;
     return (strcmp(((GATEWAY_MODULE_INFO*)element)->module_name, name) == 0);
 }
+
+static void gateway_health_callback(void* context, BROKER_HEALTH_EVENT health_event, const BROKER_MODULE_HEALTH* health)
+{
+    GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)context;
+    GATEWAY_MODULE_HEALTH module_health;
+    module_health.module = health->module_handle;
+    module_health.receive_time_ms = health->receive_time_ms;
+    module_health.queue_depth = health->queue_depth;
+
+    /*Codes_SRS_GATEWAY_17_043: [ When the broker reports BROKER_MODULE_SLOW or BROKER_QUEUE_HIGH_WATERMARK, the gateway shall report GATEWAY_MODULE_SLOW or GATEWAY_QUEUE_HIGH_WATERMARK with the module's health. ]*/
+    EventSystem_ReportModuleHealth(gateway_handle->event_system, gateway_handle,
+        (health_event == BROKER_MODULE_SLOW) ? GATEWAY_MODULE_SLOW : GATEWAY_QUEUE_HIGH_WATERMARK, &module_health);
+}
+
+static void gateway_tap_callback(void* context, const BROKER_TAPPED_MESSAGE* tapped)
+{
+    GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)context;
+    GATEWAY_TAPPED_MESSAGE gateway_tapped;
+    gateway_tapped.source = tapped->source;
+    gateway_tapped.sequence = tapped->sequence;
+    gateway_tapped.message_size = tapped->message_size;
+    gateway_tapped.message = tapped->message;
+
+    /*Codes_SRS_GATEWAY_17_047: [ When the broker taps a message, the gateway shall report GATEWAY_MESSAGE_TAPPED with the tapped message. ]*/
+    EventSystem_ReportMessageTap(gateway_handle->event_system, gateway_handle, &gateway_tapped);
+}
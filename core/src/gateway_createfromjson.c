@@ -2,6 +2,9 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/macro_utils.h"
@@ -20,11 +23,15 @@
 #define LOADER_ENTRYPOINT_KEY "entrypoint"
 #define MODULE_PATH_KEY "module.path"
 #define ARG_KEY "args"
+#define REPLICAS_KEY "replicas"
+#define REPLICA_KEY_KEY "replica_key"
 
 #define LINKS_KEY "links"
 #define SOURCE_KEY "source"
 #define SINK_KEY "sink"
 
+#define STARTUP_THREADS_KEY "startup.threads"
+
 #define PARSE_JSON_RESULT_VALUES \
     PARSE_JSON_SUCCESS, \
     PARSE_JSON_FAILURE, \
@@ -34,9 +41,10 @@
 
 DEFINE_ENUM(PARSE_JSON_RESULT, PARSE_JSON_RESULT_VALUES);
 
-GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
-static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root);
+GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json, unsigned int startup_threads);
+static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, unsigned int* out_startup_threads, JSON_Value *root);
 static void destroy_properties_internal(GATEWAY_PROPERTIES* properties);
+static void stamp_configuration_hashes(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_PROPERTIES* properties, JSON_Value* root);
 void gateway_destroy_internal(GATEWAY_HANDLE gw);
 
 GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
@@ -65,13 +73,14 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
 
                 if (properties != NULL)
                 {
+                    unsigned int startup_threads = 0;
                     properties->gateway_modules = NULL;
                     properties->gateway_links = NULL;
-                    if ((parse_json_internal(properties, root_value) == PARSE_JSON_SUCCESS) && properties->gateway_modules != NULL && properties->gateway_links != NULL)
+                    if ((parse_json_internal(properties, &startup_threads, root_value) == PARSE_JSON_SUCCESS) && properties->gateway_modules != NULL && properties->gateway_links != NULL)
                     {
                         /*Codes_SRS_GATEWAY_JSON_14_007: [The function shall use the GATEWAY_PROPERTIES instance to create and return a GATEWAY_HANDLE using the lower level API.]*/
                         /*Codes_SRS_GATEWAY_JSON_17_004: [ The function shall set the module loader to the default dynamically linked library module loader. ]*/
-                        gw = gateway_create_internal(properties, true);
+                        gw = gateway_create_internal(properties, true, startup_threads);
 
                         if (gw == NULL)
                         {
@@ -89,6 +98,11 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
                                 gateway_destroy_internal(gw);
                                 gw = NULL;
                             }
+                            else
+                            {
+                                /*Codes_SRS_GATEWAY_JSON_17_016: [ The function shall hash the JSON of each module, so that a later update can tell whether the module changed. ]*/
+                                stamp_configuration_hashes(gw, properties, root_value);
+                            }
                         }
                     }
                     /*Codes_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
@@ -131,248 +145,463 @@ GATEWAY_HANDLE Gateway_CreateFromJson(const char* file_path)
     return gw;
 }
 
-static void rollbackModules(GATEWAY_HANDLE gw, VECTOR_HANDLE modules_added_successfully)
+#define FNV_OFFSET_BASIS UINT64_C(14695981039346656037)
+#define FNV_PRIME UINT64_C(1099511628211)
+
+static uint64_t hash_bytes(uint64_t hash, uint64_t value, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        hash ^= (unsigned char)(value >> (8 * i));
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char* value)
 {
-    size_t success_modules_entries_count = VECTOR_size(modules_added_successfully);
-    if (success_modules_entries_count > 0)
+    if (value != NULL)
     {
-        for (size_t properties_index = 0; properties_index < success_modules_entries_count; ++properties_index)
+        for (const char* c = value; *c != '\0'; c++)
         {
-            GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(modules_added_successfully, properties_index);
-            if (Gateway_RemoveModuleByName(gw, entry->module_name) != 0)
+            hash ^= (unsigned char)*c;
+            hash *= FNV_PRIME;
+        }
+    }
+    /* the terminator keeps "ab","c" apart from "a","bc" */
+    return hash_bytes(hash, 0, 1);
+}
+
+/* Walks the parsed JSON, so that hashing a module does not serialize its
+ * args. Object members are hashed in document order. */
+static uint64_t hash_json_value(uint64_t hash, const JSON_Value* value)
+{
+    JSON_Value_Type type = json_value_get_type(value);
+    hash = hash_bytes(hash, (uint64_t)type, 1);
+    switch (type)
+    {
+        case JSONObject:
+        {
+            JSON_Object* object = json_value_get_object(value);
+            size_t count = json_object_get_count(object);
+            for (size_t i = 0; i < count; i++)
             {
-                LogError("Failed to remove module %s up failure.", entry->module_name);
+                hash = hash_string(hash, json_object_get_name(object, i));
+                hash = hash_json_value(hash, json_object_get_value_at(object, i));
             }
+            break;
         }
+        case JSONArray:
+        {
+            JSON_Array* array = json_value_get_array(value);
+            size_t count = json_array_get_count(array);
+            for (size_t i = 0; i < count; i++)
+            {
+                hash = hash_json_value(hash, json_array_get_value(array, i));
+            }
+            break;
+        }
+        case JSONString:
+            hash = hash_string(hash, json_value_get_string(value));
+            break;
+        case JSONNumber:
+        {
+            double number = json_value_get_number(value);
+            uint64_t bits;
+            memcpy(&bits, &number, sizeof(bits));
+            hash = hash_bytes(hash, bits, sizeof(bits));
+            break;
+        }
+        case JSONBoolean:
+            hash = hash_bytes(hash, (uint64_t)json_value_get_boolean(value), 1);
+            break;
+        default:
+            break;
     }
+    return hash;
 }
 
-GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const char* json_content)
+static uint64_t configuration_hash(const JSON_Value* module_json)
 {
-    GATEWAY_UPDATE_FROM_JSON_RESULT result;
-    /* Codes_SRS_GATEWAY_JSON_04_004: [ If gw is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ] */
-    if (gw == NULL)
+    uint64_t hash = hash_json_value(FNV_OFFSET_BASIS, module_json);
+    /* 0 marks a module that was not added from JSON */
+    return (hash == 0) ? 1 : hash;
+}
+
+/* The replicas of a module follow its first entry and share its JSON */
+static bool is_first_replica(const GATEWAY_JSON_MODULES_ENTRY* entry)
+{
+    return entry->module_replica.count <= 1 || entry->module_replica.index == 0;
+}
+
+static void stamp_configuration_hashes(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_PROPERTIES* properties, JSON_Value* root)
+{
+    JSON_Array* modules_array = json_object_get_array(json_value_get_object(root), MODULES_KEY);
+    size_t entries_count = VECTOR_size(properties->gateway_modules);
+    size_t json_index = 0;
+    uint64_t hash = 0;
+    for (size_t properties_index = 0; properties_index < entries_count; ++properties_index)
     {
-        LogError("Gw handle can't be NULL.");
-        result = GATEWAY_UPDATE_FROM_JSON_INVALID_ARG;
+        GATEWAY_JSON_MODULES_ENTRY* entry = (GATEWAY_JSON_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, properties_index);
+        MODULE_DATA* module_data = gateway_index_findmodule(gateway_handle, entry->entry.module_name, NULL);
+        if (is_first_replica(entry))
+        {
+            hash = (module_data == NULL) ? 0 : configuration_hash(json_array_get_value(modules_array, json_index));
+            ++json_index;
+        }
+        if (module_data != NULL)
+        {
+            module_data->configuration_hash = hash;
+        }
     }
-    /* Codes_SRS_GATEWAY_JSON_04_003: [ If json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ] */
-    else if (json_content == NULL)
+}
+
+static GATEWAY_UPDATE_FROM_JSON_RESULT update_from_json_value(GATEWAY_HANDLE gw, JSON_Value* root_value, bool replace)
+{
+    GATEWAY_UPDATE_FROM_JSON_RESULT result;
+    GATEWAY_PROPERTIES *properties = (GATEWAY_PROPERTIES*)malloc(sizeof(GATEWAY_PROPERTIES));
+    if (properties == NULL)
     {
-        LogError("json_content can't be NULL.");
-        result = GATEWAY_UPDATE_FROM_JSON_INVALID_ARG;
+        /* Codes_SRS_GATEWAY_JSON_04_008: [ This function shall return GATEWAY_UPDATE_FROM_JSON_ERROR upon any memory allocation failure. ] */
+        LogError("Failed to allocate GATEWAY_PROPERTIES.");
+        result = GATEWAY_UPDATE_FROM_JSON_MEMORY;
     }
     else
     {
-        /* Codes_SRS_GATEWAY_JSON_04_005: [ The function shall use parson to parse the JSON string to a parson JSON_Value structure. ] */
-        JSON_Value *root_value = json_parse_string(json_content);
-        
-        if (root_value == NULL)
+        /* an update keeps the threads the gateway was created with */
+        unsigned int startup_threads;
+        properties->gateway_modules = NULL;
+        properties->gateway_links = NULL;
+        /* Codes_SRS_GATEWAY_JSON_04_007: [ The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance. ] */
+        /* Codes_SRS_GATEWAY_JSON_04_011: [ The function shall be able to add just `modules`, just `links` or both. ] */
+        if (parse_json_internal(properties, &startup_threads, root_value) != PARSE_JSON_SUCCESS)
         {
-            /* Codes_SRS_GATEWAY_JSON_04_006: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON content could not be parsed to a JSON_Value. ] */
-            LogError("Input file [%s] could not be read.", json_content);
+            /* Codes_SRS_GATEWAY_JSON_04_010: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON_Value contains incomplete information. ] */
+            LogError("Failed to create properties structure from JSON configuration.");
+            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
+        }
+        /*Codes_SRS_GATEWAY_JSON_17_024: [ Gateway_ReplaceFromJson shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the document does not have both `modules` and `links`. ]*/
+        else if (replace && (properties->gateway_modules == NULL || properties->gateway_links == NULL))
+        {
+            LogError("Replacing the gateway configuration needs both modules and links.");
             result = GATEWAY_UPDATE_FROM_JSON_ERROR;
         }
         else
         {
-            GATEWAY_PROPERTIES *properties = (GATEWAY_PROPERTIES*)malloc(sizeof(GATEWAY_PROPERTIES));
-            if (properties == NULL)
+            size_t entries_count = (properties->gateway_modules == NULL) ? 0 : VECTOR_size(properties->gateway_modules);
+            uint64_t* configuration_hashes = NULL;
+            if (entries_count > 0 &&
+                (configuration_hashes = (uint64_t*)malloc(entries_count * sizeof(uint64_t))) == NULL)
             {
                 /* Codes_SRS_GATEWAY_JSON_04_008: [ This function shall return GATEWAY_UPDATE_FROM_JSON_ERROR upon any memory allocation failure. ] */
-                LogError("Failed to allocate GATEWAY_PROPERTIES.");
+                LogError("Failed to allocate the module configuration hashes.");
                 result = GATEWAY_UPDATE_FROM_JSON_MEMORY;
             }
             else
             {
-                properties->gateway_modules = NULL;
-                properties->gateway_links = NULL;
-                /* Codes_SRS_GATEWAY_JSON_04_007: [ The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance. ] */
-                /* Codes_SRS_GATEWAY_JSON_04_011: [ The function shall be able to add just `modules`, just `links` or both. ] */
-                if (parse_json_internal(properties, root_value) != PARSE_JSON_SUCCESS)
+                if (entries_count > 0)
+                {
+                    /*Codes_SRS_GATEWAY_JSON_17_016: [ The function shall hash the JSON of each module, so that a later update can tell whether the module changed. ]*/
+                    JSON_Array* modules_array = json_object_get_array(json_value_get_object(root_value), MODULES_KEY);
+                    size_t json_index = 0;
+                    for (size_t properties_index = 0; properties_index < entries_count; ++properties_index)
+                    {
+                        GATEWAY_JSON_MODULES_ENTRY* entry = (GATEWAY_JSON_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, properties_index);
+                        if (is_first_replica(entry))
+                        {
+                            configuration_hashes[properties_index] = configuration_hash(json_array_get_value(modules_array, json_index));
+                            ++json_index;
+                        }
+                        else
+                        {
+                            configuration_hashes[properties_index] = configuration_hashes[properties_index - 1];
+                        }
+                    }
+                }
+
+                /*Codes_SRS_GATEWAY_JSON_17_037: [ The function shall hold the gateway's lock, if it has one, while it applies the configuration, and return GATEWAY_UPDATE_FROM_JSON_ERROR if it cannot take it. ]*/
+                if (gateway_lock_internal(gw) != 0)
                 {
-                    /* Codes_SRS_GATEWAY_JSON_04_010: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON_Value contains incomplete information. ] */
-                    LogError("Failed to create properties structure from JSON configuration.");
                     result = GATEWAY_UPDATE_FROM_JSON_ERROR;
                 }
                 else
                 {
-                    
-                    VECTOR_HANDLE modules_added_successfully = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
-                    if (modules_added_successfully == NULL)
+                    bool modules_changed;
+                    /* Codes_SRS_GATEWAY_JSON_04_009: [ The function shall be able to roll back previous operation if any module or link fails to be added. ] */
+                    if (gateway_update_internal(gw, properties, configuration_hashes, replace, &modules_changed) != 0)
                     {
-                        LogError("Failed to create Vector for successfully added modules.");
+                        LogError("Failed to apply the JSON configuration, the gateway is unchanged.");
                         result = GATEWAY_UPDATE_FROM_JSON_ERROR;
                     }
                     else
                     {
-                        VECTOR_HANDLE links_added_successfully = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY));
-                        if (links_added_successfully == NULL)
-                        {
-                            LogError("Failed to create Vector for successfully added links.");
-                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                        }
-                        else
-                        {
-                            if (properties->gateway_modules != NULL)
-                            {
-                                size_t entries_count = VECTOR_size(properties->gateway_modules);
-                                if (entries_count > 0)
-                                {
-                                    //Add the first module, if successful add others
-                                    GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, 0);
-                                    MODULE_HANDLE module = gateway_addmodule_internal(gw, entry, true);
+                        result = GATEWAY_UPDATE_FROM_JSON_SUCCESS;
+                    }
+                    gateway_unlock_internal(gw);
 
-                                    if (module != NULL)
-                                    {
-                                        if (VECTOR_push_back(modules_added_successfully, entry, 1) != 0)
-                                        {
-                                            LogError("Failed to save successfully added module.");
-                                            if (Gateway_RemoveModuleByName(gw, entry->module_name) != 0)
-                                            {
-                                                LogError("Failed to remove module %s upon failure.", entry->module_name);
-                                            }
-                                            module = NULL;
-                                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                    }
+                    /*Codes_SRS_GATEWAY_JSON_17_025: [ The function shall report GATEWAY_MODULE_LIST_CHANGED if any module was added, replaced or removed. ]*/
+                    /*Codes_SRS_GATEWAY_JSON_17_039: [ The function shall report GATEWAY_MODULE_LIST_CHANGED after it releases the gateway's lock. ]*/
+                    if (modules_changed)
+                    {
+                        EventSystem_ReportEvent(gw->event_system, gw, GATEWAY_MODULE_LIST_CHANGED);
+                    }
+                }
 
-                                    //Continue adding modules until all are added or one fails
-                                    for (size_t properties_index = 1; properties_index < entries_count && module != NULL; ++properties_index)
-                                    {
-                                        entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, properties_index);
-                                        module = gateway_addmodule_internal(gw, entry, true);
+                if (configuration_hashes != NULL)
+                {
+                    free(configuration_hashes);
+                }
+            }
+        }
+        destroy_properties_internal(properties);
+        free(properties);
+    }
 
-                                        if (module != NULL)
-                                        {
-                                            if (VECTOR_push_back(modules_added_successfully, entry, 1) != 0)
-                                            {
-                                                LogError("Failed to save successfully added module.");
-                                                if (Gateway_RemoveModuleByName(gw, entry->module_name) != 0)
-                                                {
-                                                    LogError("Failed to remove module %s up failure.", entry->module_name);
-                                                }
-                                                module = NULL;
-                                                result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                            }
-                                        }
-                                        else
-                                        {
-                                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                        }
-                                    }
+    return result;
+}
 
-                                    if (module == NULL)
-                                    {
-                                        //Clean up modules.
-                                        /* Codes_SRS_GATEWAY_JSON_04_009: [ The function shall be able to roll back previous operation if any module or link fails to be added. ] */
-                                        rollbackModules(gw, modules_added_successfully);
-                                    }
-                                    else
-                                    {
-                                        //Notify Event System.
-                                        GATEWAY_HANDLE_DATA* gateway = (GATEWAY_HANDLE_DATA*)gw;
-                                        EventSystem_ReportEvent(gateway->event_system, gateway, GATEWAY_MODULE_LIST_CHANGED);
-                                        result = GATEWAY_UPDATE_FROM_JSON_SUCCESS;
-                                    }
-                                }
-                                else
-                                {
-                                    result = GATEWAY_UPDATE_FROM_JSON_SUCCESS;
-                                }
-                            }
-                            else
-                            {
-                                result = GATEWAY_UPDATE_FROM_JSON_SUCCESS;
-                            }
+static GATEWAY_UPDATE_FROM_JSON_RESULT update_from_json_content(GATEWAY_HANDLE gw, const char* json_content, bool replace)
+{
+    GATEWAY_UPDATE_FROM_JSON_RESULT result;
+    /* Codes_SRS_GATEWAY_JSON_04_004: [ If gw is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ] */
+    if (gw == NULL)
+    {
+        LogError("Gw handle can't be NULL.");
+        result = GATEWAY_UPDATE_FROM_JSON_INVALID_ARG;
+    }
+    /* Codes_SRS_GATEWAY_JSON_04_003: [ If json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ] */
+    else if (json_content == NULL)
+    {
+        LogError("json_content can't be NULL.");
+        result = GATEWAY_UPDATE_FROM_JSON_INVALID_ARG;
+    }
+    else
+    {
+        /* Codes_SRS_GATEWAY_JSON_04_005: [ The function shall use parson to parse the JSON string to a parson JSON_Value structure. ] */
+        JSON_Value *root_value = json_parse_string(json_content);
+        
+        if (root_value == NULL)
+        {
+            /* Codes_SRS_GATEWAY_JSON_04_006: [ The function shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the JSON content could not be parsed to a JSON_Value. ] */
+            LogError("Input file [%s] could not be read.", json_content);
+            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
+        }
+        else
+        {
+            result = update_from_json_value(gw, root_value, replace);
+            json_value_free(root_value);
+        }
+    }
 
+    return result;
+}
 
-                            if (result == 0 && properties->gateway_links != NULL)
-                            {
-                                size_t entries_count = VECTOR_size(properties->gateway_links);
+GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_UpdateFromJson(GATEWAY_HANDLE gw, const char* json_content)
+{
+    return update_from_json_content(gw, json_content, false);
+}
 
-                                if (entries_count > 0)
-                                {
-                                    //Add the first link, if successfull add others
-                                    GATEWAY_LINK_ENTRY* entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(properties->gateway_links, 0);
-                                    bool linkAdded = gateway_addlink_internal(gw, entry);
+GATEWAY_UPDATE_FROM_JSON_RESULT Gateway_ReplaceFromJson(GATEWAY_HANDLE gw, const char* json_content)
+{
+    /*Codes_SRS_GATEWAY_JSON_17_023: [ Gateway_ReplaceFromJson shall remove every link and then every module that is not in the document, after the new modules and links are in place. ]*/
+    return update_from_json_content(gw, json_content, true);
+}
 
-                                    if (linkAdded)
-                                    {
-                                        if (VECTOR_push_back(links_added_successfully, entry, 1) != 0)
-                                        {
-                                            LogError("Failed to save successfully added link.");
-                                            Gateway_RemoveLink(gw, entry);
-                                            linkAdded = false;
-                                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                        }
-                                    }
-                                    else
-                                    {
-                                        result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                    }
+static void json_file_changed(const char* file_path, void* context)
+{
+    /*Codes_SRS_GATEWAY_JSON_17_028: [ When the watched file changes, the gateway shall parse the file and apply it as Gateway_ReplaceFromJson does. ]*/
+    JSON_Value* root_value = json_parse_file(file_path);
+    if (root_value == NULL)
+    {
+        LogError("Unable to parse %s, the gateway keeps its configuration.", file_path);
+    }
+    else
+    {
+        if (update_from_json_value((GATEWAY_HANDLE)context, root_value, true) != GATEWAY_UPDATE_FROM_JSON_SUCCESS)
+        {
+            LogError("Unable to apply %s, the gateway keeps its configuration.", file_path);
+        }
+        json_value_free(root_value);
+    }
+}
 
+int Gateway_WatchJsonFile(GATEWAY_HANDLE gw, const char* file_path)
+{
+    int result;
+    /*Codes_SRS_GATEWAY_JSON_17_026: [ If gw or file_path is NULL, Gateway_WatchJsonFile shall return a non-zero value. ]*/
+    if (gw == NULL || file_path == NULL)
+    {
+        LogError("invalid arg gw=%p, file_path=%p", gw, file_path);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_JSON_17_027: [ Gateway_WatchJsonFile shall stop watching any previous file and create a file watcher on file_path. ]*/
+        Gateway_UnwatchJsonFile(gw);
+        /*Codes_SRS_GATEWAY_JSON_17_036: [ Gateway_WatchJsonFile shall create the gateway's lock, if it has none, before it creates the file watcher, and return a non-zero value if it cannot. ]*/
+        if (gw->update_lock == NULL && (gw->update_lock = Lock_Init()) == NULL)
+        {
+            LogError("Unable to create the gateway lock.");
+            result = __LINE__;
+        }
+        else
+        {
+            gw->json_file_watcher = FileWatcher_Create(file_path, json_file_changed, gw);
+            if (gw->json_file_watcher == NULL)
+            {
+                /*Codes_SRS_GATEWAY_JSON_17_030: [ Gateway_WatchJsonFile shall return a non-zero value if the file watcher cannot be created. ]*/
+                LogError("Unable to watch %s.", file_path);
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+    }
+    return result;
+}
 
-                                    //Continue adding links until all are added or one fails
-                                    for (size_t links_index = 1; links_index < entries_count && linkAdded; ++links_index)
-                                    {
-                                        entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(properties->gateway_links, links_index);
-                                        linkAdded = gateway_addlink_internal(gw, entry);
-                                        if (linkAdded)
-                                        {
-                                            if (VECTOR_push_back(links_added_successfully, entry, 1) != 0)
-                                            {
-                                                LogError("Failed to save successfully added link.");
-                                                Gateway_RemoveLink(gw, entry);
-                                                linkAdded = false;
-                                                result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                            }
-                                        }
-                                        else
-                                        {
-                                            result = GATEWAY_UPDATE_FROM_JSON_ERROR;
-                                        }
-                                    }
+void Gateway_UnwatchJsonFile(GATEWAY_HANDLE gw)
+{
+    /*Codes_SRS_GATEWAY_JSON_17_029: [ Gateway_UnwatchJsonFile shall destroy the file watcher, if any. ]*/
+    if (gw != NULL && gw->json_file_watcher != NULL)
+    {
+        FileWatcher_Destroy(gw->json_file_watcher);
+        gw->json_file_watcher = NULL;
+    }
+}
 
-                                    if (!linkAdded)
-                                    {
+static int write_snapshot(const char* snapshot_path, const GATEWAY_PROPERTIES* properties, unsigned int startup_threads, JSON_Value* root_value)
+{
+    int result;
+    JSON_Object* json_document = json_value_get_object(root_value);
+    JSON_Array* modules_array = json_object_get_array(json_document, MODULES_KEY);
+    size_t module_count = VECTOR_size(properties->gateway_modules);
+    GATEWAY_SNAPSHOT_MODULE* modules = (GATEWAY_SNAPSHOT_MODULE*)malloc((module_count == 0 ? 1 : module_count) * sizeof(GATEWAY_SNAPSHOT_MODULE));
+    if (modules == NULL)
+    {
+        LogError("Failed to allocate the snapshot modules.");
+        result = __LINE__;
+    }
+    else
+    {
+        JSON_Value* loaders = json_object_get_value(json_document, LOADERS_KEY);
+        char* loaders_str = (loaders == NULL) ? NULL : json_serialize_to_string(loaders);
+        bool serialized = (loaders == NULL || loaders_str != NULL);
+        size_t json_index = 0;
+        JSON_Value* module_json = NULL;
 
-                                        size_t success_link_entries_count = VECTOR_size(links_added_successfully);
+        for (size_t module_index = 0; module_index < module_count; ++module_index)
+        {
+            GATEWAY_JSON_MODULES_ENTRY* entry = (GATEWAY_JSON_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, module_index);
+            if (is_first_replica(entry))
+            {
+                module_json = json_array_get_value(modules_array, json_index);
+                ++json_index;
+            }
+            JSON_Object* loader_json = json_object_get_object(json_value_get_object(module_json), LOADER_KEY);
+            JSON_Value* entrypoint_json = json_object_get_value(loader_json, LOADER_ENTRYPOINT_KEY);
 
-                                        //Clean up links. Have to clean up links first before removing modules.
-                                        /* Codes_SRS_GATEWAY_JSON_04_009: [ The function shall be able to roll back previous operation if any module or link fails to be added. ] */
-                                        if (success_link_entries_count > 0)
-                                        {
-                                            for (size_t properties_index = 0; properties_index < success_link_entries_count; ++properties_index)
-                                            {
-                                                GATEWAY_LINK_ENTRY* entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(links_added_successfully, properties_index);
-                                                Gateway_RemoveLink(gw, entry);
-                                            }
-                                        }
+            /*Codes_SRS_GATEWAY_SNAPSHOT_17_003: [ Gateway_CompileJsonSnapshot shall store, for each module, its name, its loader name, its serialized entrypoint and args, the hash of its JSON, and its replica count, index and key. ]*/
+            modules[module_index].module_name = entry->entry.module_name;
+            modules[module_index].loader_name = json_object_get_string(loader_json, LOADER_NAME_KEY);
+            if (modules[module_index].loader_name == NULL)
+            {
+                modules[module_index].loader_name = DYNAMIC_LOADER_NAME;
+            }
+            modules[module_index].entrypoint = (entrypoint_json == NULL) ? NULL : json_serialize_to_string(entrypoint_json);
+            modules[module_index].args = (entry->module_configuration_json == NULL) ? NULL : json_serialize_to_string(entry->module_configuration_json);
+            modules[module_index].configuration_hash = configuration_hash(module_json);
+            modules[module_index].replica = entry->module_replica;
+            if ((entrypoint_json != NULL && modules[module_index].entrypoint == NULL) ||
+                (entry->module_configuration_json != NULL && modules[module_index].args == NULL))
+            {
+                serialized = false;
+            }
+        }
 
-                                        //Clean up modules.
-                                        /* Codes_SRS_GATEWAY_JSON_04_009: [ The function shall be able to roll back previous operation if any module or link fails to be added. ] */
-                                        rollbackModules(gw, modules_added_successfully);
+        if (!serialized)
+        {
+            LogError("Failed to serialize the configuration.");
+            result = __LINE__;
+        }
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_004: [ Gateway_CompileJsonSnapshot shall write the loaders, startup threads, modules and links to snapshot_path, with a checksum over the snapshot. ]*/
+        else if (gateway_snapshot_write_internal(snapshot_path, loaders_str, startup_threads, modules, module_count,
+            (const GATEWAY_LINK_ENTRY*)VECTOR_front(properties->gateway_links), VECTOR_size(properties->gateway_links)) != 0)
+        {
+            LogError("Failed to write the snapshot %s.", snapshot_path);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
 
-                                        LogError("Unable to add link from '%s' to '%s'.Rolling back Update Operation.", entry->module_source, entry->module_sink);
-                                    }
-                                }
-                            }
-                            VECTOR_destroy(links_added_successfully);
-                        }
-                        VECTOR_destroy(modules_added_successfully);
-                    }
-                }
-                destroy_properties_internal(properties);
-                free(properties);
+        for (size_t module_index = 0; module_index < module_count; ++module_index)
+        {
+            if (modules[module_index].entrypoint != NULL)
+            {
+                json_free_serialized_string((char*)modules[module_index].entrypoint);
+            }
+            if (modules[module_index].args != NULL)
+            {
+                json_free_serialized_string((char*)modules[module_index].args);
             }
-            json_value_free(root_value);
         }
+        if (loaders_str != NULL)
+        {
+            json_free_serialized_string(loaders_str);
+        }
+        free(modules);
     }
+    return result;
+}
 
+int Gateway_CompileJsonSnapshot(const char* file_path, const char* snapshot_path)
+{
+    int result;
+    /*Codes_SRS_GATEWAY_SNAPSHOT_17_001: [ If file_path or snapshot_path is NULL, Gateway_CompileJsonSnapshot shall return a non-zero value. ]*/
+    if (file_path == NULL || snapshot_path == NULL)
+    {
+        LogError("invalid arg file_path=%p, snapshot_path=%p", file_path, snapshot_path);
+        result = __LINE__;
+    }
+    else if (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS)
+    {
+        LogError("ModuleLoader_Initialize failed");
+        result = __LINE__;
+    }
+    else
+    {
+        JSON_Value *root_value = json_parse_file(file_path);
+        if (root_value == NULL)
+        {
+            LogError("Input file [%s] could not be read.", file_path);
+            result = __LINE__;
+        }
+        else
+        {
+            GATEWAY_PROPERTIES properties;
+            unsigned int startup_threads = 0;
+            properties.gateway_modules = NULL;
+            properties.gateway_links = NULL;
+            /*Codes_SRS_GATEWAY_SNAPSHOT_17_002: [ Gateway_CompileJsonSnapshot shall parse and validate file_path as Gateway_CreateFromJson does, and shall return a non-zero value if it is not a complete configuration. ]*/
+            if (parse_json_internal(&properties, &startup_threads, root_value) != PARSE_JSON_SUCCESS || properties.gateway_modules == NULL || properties.gateway_links == NULL)
+            {
+                LogError("Failed to create properties structure from JSON configuration.");
+                result = __LINE__;
+            }
+            else
+            {
+                result = write_snapshot(snapshot_path, &properties, startup_threads, root_value);
+            }
+            destroy_properties_internal(&properties);
+            json_value_free(root_value);
+        }
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_005: [ Gateway_CompileJsonSnapshot shall destroy the module loader list before returning. ]*/
+        ModuleLoader_Destroy();
+    }
     return result;
 }
 
@@ -384,9 +613,15 @@ static void destroy_properties_internal(GATEWAY_PROPERTIES* properties)
         size_t vector_size = VECTOR_size(properties->gateway_modules);
         for (size_t element_index = 0; element_index < vector_size; ++element_index)
         {
-            GATEWAY_MODULES_ENTRY* element = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, element_index);
-            element->module_loader_info.loader->api->FreeEntrypoint(element->module_loader_info.loader, element->module_loader_info.entrypoint);
-            json_free_serialized_string((char*)(element->module_configuration));
+            GATEWAY_JSON_MODULES_ENTRY* element = (GATEWAY_JSON_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, element_index);
+            if (is_first_replica(element))
+            {
+                element->entry.module_loader_info.loader->api->FreeEntrypoint(element->entry.module_loader_info.loader, element->entry.module_loader_info.entrypoint);
+            }
+            if (element->module_replica.count > 1)
+            {
+                free((char*)element->entry.module_name);
+            }
         }
 
         VECTOR_destroy(properties->gateway_modules);
@@ -446,9 +681,101 @@ static PARSE_JSON_RESULT parse_loader(JSON_Object* loader_json, GATEWAY_MODULE_L
     return result;
 }
 
-static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, JSON_Value *root)
+/* Adds an entry named "<name>#<index>" for each replica. The first replica
+ * owns the loader entrypoint, which is freed if it cannot be added. */
+static int add_replicas(VECTOR_HANDLE modules, GATEWAY_JSON_MODULES_ENTRY* entry, size_t replica_count, const char* replica_key)
+{
+    int result = 0;
+    const char* module_name = entry->entry.module_name;
+    for (size_t replica_index = 0; replica_index < replica_count; ++replica_index)
+    {
+        /* room for '#', the digits of an unsigned long and the terminator */
+        char* replica_name = (char*)malloc(strlen(module_name) + 22);
+        if (replica_name == NULL)
+        {
+            LogError("Failed to allocate the name of replica %lu of module %s.", (unsigned long)replica_index, module_name);
+            result = __LINE__;
+        }
+        else
+        {
+            (void)sprintf(replica_name, "%s#%lu", module_name, (unsigned long)replica_index);
+            entry->entry.module_name = replica_name;
+            entry->module_replica.count = replica_count;
+            entry->module_replica.index = replica_index;
+            entry->module_replica.key = replica_key;
+            if (VECTOR_push_back(modules, entry, 1) != 0)
+            {
+                LogError("Failed to push data into properties vector.");
+                free(replica_name);
+                result = __LINE__;
+            }
+        }
+
+        if (result != 0)
+        {
+            if (replica_index == 0)
+            {
+                entry->entry.module_loader_info.loader->api->FreeEntrypoint(entry->entry.module_loader_info.loader, entry->entry.module_loader_info.entrypoint);
+            }
+            break;
+        }
+    }
+    entry->entry.module_name = module_name;
+    return result;
+}
+
+/* Returns the number of replicas of module_name, 0 when it is not
+ * replicated, and the position of its first replica */
+static size_t find_replicas(VECTOR_HANDLE modules, const char* module_name, size_t* first_replica)
+{
+    size_t result = 0;
+    size_t name_length = strlen(module_name);
+    size_t entries_count = VECTOR_size(modules);
+    for (size_t entry_index = 0; entry_index < entries_count; ++entry_index)
+    {
+        const GATEWAY_JSON_MODULES_ENTRY* entry = (const GATEWAY_JSON_MODULES_ENTRY*)VECTOR_element(modules, entry_index);
+        if (entry->module_replica.count > 1 &&
+            entry->module_replica.index == 0 &&
+            strncmp(entry->entry.module_name, module_name, name_length) == 0 &&
+            strcmp(entry->entry.module_name + name_length, "#0") == 0)
+        {
+            *first_replica = entry_index;
+            result = entry->module_replica.count;
+            break;
+        }
+    }
+    return result;
+}
+
+/* Adds the link once for each replica of its source and of its sink */
+static int add_replica_links(GATEWAY_PROPERTIES* properties, const char* module_source, const char* module_sink)
+{
+    int result = 0;
+    size_t first_source = 0;
+    size_t first_sink = 0;
+    size_t source_count = (properties->gateway_modules == NULL) ? 0 : find_replicas(properties->gateway_modules, module_source, &first_source);
+    size_t sink_count = (properties->gateway_modules == NULL) ? 0 : find_replicas(properties->gateway_modules, module_sink, &first_sink);
+    for (size_t source_index = 0; source_index < (source_count == 0 ? 1 : source_count) && result == 0; ++source_index)
+    {
+        for (size_t sink_index = 0; sink_index < (sink_count == 0 ? 1 : sink_count) && result == 0; ++sink_index)
+        {
+            GATEWAY_LINK_ENTRY entry = {
+                (source_count == 0) ? module_source : ((const GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, first_source + source_index))->module_name,
+                (sink_count == 0) ? module_sink : ((const GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, first_sink + sink_index))->module_name
+            };
+            if (VECTOR_push_back(properties->gateway_links, &entry, 1) != 0)
+            {
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties, unsigned int* out_startup_threads, JSON_Value *root)
 {
     PARSE_JSON_RESULT result;
+    size_t replicated_modules = 0;
 
     JSON_Object *json_document = json_value_get_object(root);
     if (json_document != NULL)
@@ -461,12 +788,15 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
         {
             JSON_Array *modules_array = json_object_get_array(json_document, MODULES_KEY);
             JSON_Array *links_array = json_object_get_array(json_document, LINKS_KEY);
+            /*Codes_SRS_GATEWAY_JSON_17_015: [ The function shall read the optional "startup.threads" number, and create the gateway with that many startup threads. ]*/
+            double startup_threads = json_object_dotget_number(json_document, STARTUP_THREADS_KEY);
+            *out_startup_threads = (startup_threads > 0) ? (unsigned int)startup_threads : 0;
 
             if (modules_array != NULL || links_array != NULL)
             {
                 if (modules_array != NULL)
                 {
-                    out_properties->gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+                    out_properties->gateway_modules = VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY));
                     if (out_properties->gateway_modules != NULL)
                     {
                         /*Codes_SRS_GATEWAY_JSON_17_008: [ The function shall parse the "modules" JSON array for each module entry. ]*/
@@ -491,25 +821,46 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                                 const char* module_name = json_object_get_string(module, MODULE_NAME_KEY);
                                 if (module_name != NULL)
                                 {
-                                    /*Codes_SRS_GATEWAY_JSON_14_005: [The function shall set the value of const void* module_properties in the GATEWAY_PROPERTIES instance to a char* representing the serialized args value for the particular module.]*/
+                                    /*Codes_SRS_GATEWAY_JSON_14_005: [The function shall set the module_configuration_json of each GATEWAY_JSON_MODULES_ENTRY to the parsed args value for the particular module, and leave its module_configuration NULL.]*/
                                     JSON_Value *args = json_object_get_value(module, ARG_KEY);
-                                    char* args_str = json_serialize_to_string(args);
+                                    double replicas = json_object_get_number(module, REPLICAS_KEY);
 
-                                    GATEWAY_MODULES_ENTRY entry = {
-                                        module_name,
-                                        loader_info,
-                                        args_str
+                                    GATEWAY_JSON_MODULES_ENTRY entry = {
+                                        { module_name, loader_info, NULL },
+                                        args,
+                                        { 0, 0, NULL }
                                     };
 
+                                    if (replicas > UINT32_MAX)
+                                    {
+                                        loader_info.loader->api->FreeEntrypoint(loader_info.loader, loader_info.entrypoint);
+                                        result = PARSE_JSON_MISSING_OR_MISCONFIGURED_CONFIG;
+                                        LogError("Module %s has too many replicas.", module_name);
+                                        break;
+                                    }
+                                    /*Codes_SRS_GATEWAY_JSON_17_034: [ If a module's "replicas" number is greater than one, the function shall add that many GATEWAY_JSON_MODULES_ENTRYs named "<name>#<index>", sharing the module's loader entrypoint and args, with the replica count, index and optional "replica_key" in module_replica. ]*/
+                                    else if (replicas > 1)
+                                    {
+                                        if (add_replicas(out_properties->gateway_modules, &entry, (size_t)replicas, json_object_get_string(module, REPLICA_KEY_KEY)) == 0)
+                                        {
+                                            ++replicated_modules;
+                                            result = PARSE_JSON_SUCCESS;
+                                        }
+                                        else
+                                        {
+                                            result = PARSE_JSON_VECTOR_FAILURE;
+                                            LogError("Failed to add the replicas of module %s.", module_name);
+                                            break;
+                                        }
+                                    }
                                     /*Codes_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
-                                    if (VECTOR_push_back(out_properties->gateway_modules, &entry, 1) == 0)
+                                    else if (VECTOR_push_back(out_properties->gateway_modules, &entry, 1) == 0)
                                     {
                                         result = PARSE_JSON_SUCCESS;
                                     }
                                     else
                                     {
                                         loader_info.loader->api->FreeEntrypoint(loader_info.loader, loader_info.entrypoint);
-                                        json_free_serialized_string(args_str);
                                         result = PARSE_JSON_VECTOR_FAILURE;
                                         LogError("Failed to push data into properties vector.");
                                         break;
@@ -562,9 +913,20 @@ static PARSE_JSON_RESULT parse_json_internal(GATEWAY_PROPERTIES* out_properties,
                                         module_source,
                                         module_sink
                                     };
+                                    int link_result;
+
+                                    if (replicated_modules > 0)
+                                    {
+                                        /*Codes_SRS_GATEWAY_JSON_17_035: [ A link whose source or sink names a replicated module shall be added once for each of the module's replicas. ]*/
+                                        link_result = add_replica_links(out_properties, module_source, module_sink);
+                                    }
+                                    else
+                                    {
+                                        /* Codes_SRS_GATEWAY_JSON_04_002: [ The function shall add all modules source and sink to GATEWAY_PROPERTIES inside gateway_links. ] */
+                                        link_result = VECTOR_push_back(out_properties->gateway_links, &entry, 1);
+                                    }
 
-                                    /* Codes_SRS_GATEWAY_JSON_04_002: [ The function shall add all modules source and sink to GATEWAY_PROPERTIES inside gateway_links. ] */
-                                    if (VECTOR_push_back(out_properties->gateway_links, &entry, 1) == 0)
+                                    if (link_result == 0)
                                     {
                                         result = PARSE_JSON_SUCCESS;
                                     }
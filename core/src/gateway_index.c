@@ -0,0 +1,411 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/xlogging.h>
+
+#include <azure_c_shared_utility/vector.h>
+
+#include "experimental/event_system.h"
+#include "broker.h"
+
+#include "gateway_internal.h"
+
+/*
+ * Hash indexes over the gateway's modules and links vectors.
+ *
+ * Each index is an open addressing table with linear probing. A slot holds
+ * the position of a module (or link) in its vector, so lookups by name or by
+ * (source, sink) pair need no scan of the vector. Modules are keyed by name,
+ * links by the pair of MODULE_DATA pointers they connect, with a NULL source
+ * for links from "*". The modules vector shifts its elements down on erase, so
+ * removing a module also moves down the positions of the modules after it.
+ * A removed link is replaced by the last link instead, so only that one link
+ * changes position.
+ *
+ * A third table keys every link by the modules at its ends, so the links of a
+ * module are found without a scan of the whole link table. Its slots hold the
+ * (source, sink) pair of the link, and several slots may share a module.
+ *
+ * A table starts in the slots embedded in the gateway handle and moves to the
+ * heap once it is half full.
+ */
+
+#define GATEWAY_ALL "*"
+
+static uint32_t hash_bytes(uint32_t hash, const unsigned char* bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_name(const char* name)
+{
+    return hash_bytes(2166136261u, (const unsigned char*)name, strlen(name));
+}
+
+static uint32_t hash_pair(const MODULE_DATA* first, const MODULE_DATA* second)
+{
+    uint32_t hash = hash_bytes(2166136261u, (const unsigned char*)&first, sizeof(first));
+    return hash_bytes(hash, (const unsigned char*)&second, sizeof(second));
+}
+
+static uint32_t hash_module(const MODULE_DATA* module)
+{
+    return hash_bytes(2166136261u, (const unsigned char*)&module, sizeof(module));
+}
+
+static GATEWAY_INDEX_SLOT* index_slots(GATEWAY_INDEX* index, size_t* capacity)
+{
+    GATEWAY_INDEX_SLOT* result;
+    if (index->slots == NULL)
+    {
+        *capacity = GATEWAY_INDEX_INLINE_SLOTS;
+        result = index->inline_slots;
+    }
+    else
+    {
+        *capacity = index->capacity;
+        result = index->slots;
+    }
+    return result;
+}
+
+static void place_slot(GATEWAY_INDEX_SLOT* slots, size_t capacity, const GATEWAY_INDEX_SLOT* slot)
+{
+    size_t i = slot->hash & (capacity - 1);
+    while (slots[i].used)
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+    slots[i] = *slot;
+}
+
+static int index_add(GATEWAY_INDEX* index, uint32_t hash, MODULE_DATA* first, MODULE_DATA* second, size_t position)
+{
+    int result;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+
+    if ((index->count + 1) * 2 > capacity)
+    {
+        GATEWAY_INDEX_SLOT* grown = (GATEWAY_INDEX_SLOT*)malloc(2 * capacity * sizeof(GATEWAY_INDEX_SLOT));
+        if (grown == NULL)
+        {
+            LogError("unable to grow the gateway index, continuing with %zu slots", capacity);
+        }
+        else
+        {
+            memset(grown, 0, 2 * capacity * sizeof(GATEWAY_INDEX_SLOT));
+            for (size_t i = 0; i < capacity; i++)
+            {
+                if (slots[i].used)
+                {
+                    place_slot(grown, 2 * capacity, &(slots[i]));
+                }
+            }
+            if (index->slots != NULL)
+            {
+                free(index->slots);
+            }
+            index->slots = grown;
+            index->capacity = 2 * capacity;
+            slots = index_slots(index, &capacity);
+        }
+    }
+
+    /* one slot always stays empty, so that probing ends */
+    if (index->count + 1 >= capacity)
+    {
+        LogError("gateway index is full");
+        result = __LINE__;
+    }
+    else
+    {
+        GATEWAY_INDEX_SLOT slot;
+        slot.used = true;
+        slot.hash = hash;
+        slot.first = first;
+        slot.second = second;
+        slot.position = position;
+        place_slot(slots, capacity, &slot);
+        index->count++;
+        result = 0;
+    }
+    return result;
+}
+
+static void index_remove_at(GATEWAY_INDEX* index, size_t removed)
+{
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+    size_t mask = capacity - 1;
+    size_t hole = removed;
+
+    /* backward shift deletion: pull up every entry that probed past the hole */
+    slots[hole].used = false;
+    for (size_t next = (hole + 1) & mask; slots[next].used; next = (next + 1) & mask)
+    {
+        size_t home = slots[next].hash & mask;
+        bool stays = (hole <= next) ?
+            (hole < home && home <= next) :
+            (hole < home || home <= next);
+        if (!stays)
+        {
+            slots[hole] = slots[next];
+            slots[next].used = false;
+            hole = next;
+        }
+    }
+    index->count--;
+}
+
+static void index_shift_positions(GATEWAY_INDEX* index, size_t removed_position)
+{
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (slots[i].used && slots[i].position > removed_position)
+        {
+            slots[i].position--;
+        }
+    }
+}
+
+static size_t index_find_pair(GATEWAY_INDEX* index, const MODULE_DATA* first, const MODULE_DATA* second)
+{
+    size_t result = GATEWAY_INDEX_NOT_FOUND;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+    uint32_t hash = hash_pair(first, second);
+    for (size_t i = hash & (capacity - 1); slots[i].used; i = (i + 1) & (capacity - 1))
+    {
+        if (slots[i].hash == hash && slots[i].first == first && slots[i].second == second)
+        {
+            result = i;
+            break;
+        }
+    }
+    return result;
+}
+
+static size_t index_find_end(GATEWAY_INDEX* index, const MODULE_DATA* end, const MODULE_DATA* first, const MODULE_DATA* second)
+{
+    size_t result = GATEWAY_INDEX_NOT_FOUND;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+    uint32_t hash = hash_module(end);
+    for (size_t i = hash & (capacity - 1); slots[i].used; i = (i + 1) & (capacity - 1))
+    {
+        if (slots[i].hash == hash && slots[i].first == first && slots[i].second == second)
+        {
+            result = i;
+            break;
+        }
+    }
+    return result;
+}
+
+static void remove_link_entries(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* source, const MODULE_DATA* sink)
+{
+    size_t slot = index_find_pair(&(gateway_handle->link_index), source, sink);
+    if (slot != GATEWAY_INDEX_NOT_FOUND)
+    {
+        index_remove_at(&(gateway_handle->link_index), slot);
+    }
+    slot = index_find_end(&(gateway_handle->link_end_index), sink, source, sink);
+    if (slot != GATEWAY_INDEX_NOT_FOUND)
+    {
+        index_remove_at(&(gateway_handle->link_end_index), slot);
+    }
+    if (source != NULL && source != sink)
+    {
+        slot = index_find_end(&(gateway_handle->link_end_index), source, source, sink);
+        if (slot != GATEWAY_INDEX_NOT_FOUND)
+        {
+            index_remove_at(&(gateway_handle->link_end_index), slot);
+        }
+    }
+}
+
+static size_t index_find_module(GATEWAY_INDEX* index, const char* module_name)
+{
+    size_t result = GATEWAY_INDEX_NOT_FOUND;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(index, &capacity);
+    uint32_t hash = hash_name(module_name);
+    for (size_t i = hash & (capacity - 1); slots[i].used; i = (i + 1) & (capacity - 1))
+    {
+        if (slots[i].hash == hash && strcmp(slots[i].first->module_name, module_name) == 0)
+        {
+            result = i;
+            break;
+        }
+    }
+    return result;
+}
+
+int gateway_index_addmodule(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module)
+{
+    /* the module has just been pushed to the back of the modules vector */
+    return index_add(&(gateway_handle->module_index), hash_name(module->module_name), module, NULL, gateway_handle->module_index.count);
+}
+
+void gateway_index_removemodule(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module)
+{
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(&(gateway_handle->module_index), &capacity);
+    size_t slot = index_find_module(&(gateway_handle->module_index), module->module_name);
+    if (slot != GATEWAY_INDEX_NOT_FOUND && slots[slot].first == module)
+    {
+        size_t position = slots[slot].position;
+        index_remove_at(&(gateway_handle->module_index), slot);
+        index_shift_positions(&(gateway_handle->module_index), position);
+    }
+}
+
+MODULE_DATA* gateway_index_findmodule(GATEWAY_HANDLE_DATA* gateway_handle, const char* module_name, size_t* position)
+{
+    MODULE_DATA* result;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(&(gateway_handle->module_index), &capacity);
+    size_t slot = index_find_module(&(gateway_handle->module_index), module_name);
+    if (slot == GATEWAY_INDEX_NOT_FOUND)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = slots[slot].first;
+        if (position != NULL)
+        {
+            *position = slots[slot].position;
+        }
+    }
+    return result;
+}
+
+int gateway_index_addlink(GATEWAY_HANDLE_DATA* gateway_handle, const LINK_DATA* link)
+{
+    int result;
+    /* the link has just been pushed to the back of the links vector */
+    MODULE_DATA* source = link->from_any_source ? NULL : link->module_source;
+    MODULE_DATA* sink = link->module_sink;
+    if (index_add(&(gateway_handle->link_index), hash_pair(source, sink), source, sink, gateway_handle->link_index.count) != 0 ||
+        index_add(&(gateway_handle->link_end_index), hash_module(sink), source, sink, 0) != 0 ||
+        (source != NULL && source != sink &&
+            index_add(&(gateway_handle->link_end_index), hash_module(source), source, sink, 0) != 0))
+    {
+        remove_link_entries(gateway_handle, source, sink);
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
+
+LINK_DATA* gateway_index_removelink(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link)
+{
+    LINK_DATA* result = link;
+    MODULE_DATA* source = link->from_any_source ? NULL : link->module_source;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(&(gateway_handle->link_index), &capacity);
+    size_t slot = index_find_pair(&(gateway_handle->link_index), source, link->module_sink);
+    if (slot != GATEWAY_INDEX_NOT_FOUND)
+    {
+        size_t position = slots[slot].position;
+        size_t last_position = gateway_handle->link_index.count - 1;
+        remove_link_entries(gateway_handle, source, link->module_sink);
+        if (position != last_position)
+        {
+            /* the links vector is contiguous, so the last link sits
+             * last_position - position elements after this one; it takes
+             * over the position of the removed link */
+            LINK_DATA* last = link + (last_position - position);
+            size_t last_slot = index_find_pair(&(gateway_handle->link_index), last->from_any_source ? NULL : last->module_source, last->module_sink);
+            if (last_slot != GATEWAY_INDEX_NOT_FOUND)
+            {
+                slots[last_slot].position = position;
+                *link = *last;
+                result = last;
+            }
+        }
+    }
+    return result;
+}
+
+size_t gateway_index_findlink(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
+{
+    size_t result = GATEWAY_INDEX_NOT_FOUND;
+    MODULE_DATA* sink = gateway_index_findmodule(gateway_handle, link_entry->module_sink, NULL);
+    if (sink != NULL)
+    {
+        bool from_any_source = (strcmp(link_entry->module_source, GATEWAY_ALL) == 0);
+        MODULE_DATA* source = from_any_source ? NULL : gateway_index_findmodule(gateway_handle, link_entry->module_source, NULL);
+        if (from_any_source || source != NULL)
+        {
+            size_t capacity;
+            GATEWAY_INDEX_SLOT* slots = index_slots(&(gateway_handle->link_index), &capacity);
+            size_t slot = index_find_pair(&(gateway_handle->link_index), source, sink);
+            if (slot != GATEWAY_INDEX_NOT_FOUND)
+            {
+                result = slots[slot].position;
+            }
+        }
+    }
+    return result;
+}
+
+size_t gateway_index_findlinkof(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module)
+{
+    size_t result = GATEWAY_INDEX_NOT_FOUND;
+    size_t capacity;
+    GATEWAY_INDEX_SLOT* slots = index_slots(&(gateway_handle->link_end_index), &capacity);
+    uint32_t hash = hash_module(module);
+    for (size_t i = hash & (capacity - 1); slots[i].used; i = (i + 1) & (capacity - 1))
+    {
+        if (slots[i].hash == hash && (slots[i].first == module || slots[i].second == module))
+        {
+            size_t link_capacity;
+            GATEWAY_INDEX_SLOT* link_slots = index_slots(&(gateway_handle->link_index), &link_capacity);
+            size_t slot = index_find_pair(&(gateway_handle->link_index), slots[i].first, slots[i].second);
+            if (slot != GATEWAY_INDEX_NOT_FOUND)
+            {
+                result = link_slots[slot].position;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+void gateway_index_destroy(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    if (gateway_handle->module_index.slots != NULL)
+    {
+        free(gateway_handle->module_index.slots);
+        gateway_handle->module_index.slots = NULL;
+    }
+    if (gateway_handle->link_index.slots != NULL)
+    {
+        free(gateway_handle->link_index.slots);
+        gateway_handle->link_index.slots = NULL;
+    }
+    if (gateway_handle->link_end_index.slots != NULL)
+    {
+        free(gateway_handle->link_end_index.slots);
+        gateway_handle->link_end_index.slots = NULL;
+    }
+}
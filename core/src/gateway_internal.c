@@ -22,26 +22,9 @@
 
 static MODULE_DATA *no_module = NULL;
 
-bool module_name_find(const void* element, const void* module_name)
-{
-    const char* module_name_casted = (const char*)module_name;
-    return (strcmp((*(MODULE_DATA**)element)->module_name, module_name_casted) == 0);
-}
-
-static bool link_name_both_find(const void* link_void, const void* name_void)
-{
-    const char* name = (const char*)name_void;
-    const LINK_DATA *link = (LINK_DATA*)link_void;
-    return
-        strcmp(link->module_sink->module_name, name) == 0 ||
-        (!link->from_any_source && strcmp(link->module_source->module_name, name) == 0);
-}
-
 static bool check_if_link_exists(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
-    LINK_DATA* link_data = (LINK_DATA*)VECTOR_find_if(gateway_handle->links, link_data_find, link_entry);
-
-    return link_data == NULL ? false : true;
+    return gateway_index_findlink(gateway_handle, link_entry) != GATEWAY_INDEX_NOT_FOUND;
 }
 
 static int add_one_link_to_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_HANDLE source, MODULE_HANDLE sink)
@@ -87,27 +70,27 @@ static int remove_one_link_from_broker(GATEWAY_HANDLE_DATA* gateway_handle, MODU
 static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
     int result;
-    MODULE_DATA** module_source_handle = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_source);
+    MODULE_DATA* module_source = gateway_index_findmodule(gateway_handle, link_entry->module_source, NULL);
 
     //Check of Source Module exists.
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
-    if (module_source_handle == NULL)
+    if (module_source == NULL)
     {
         LogError("Failed to add the link. Source module doesn't exists on this gateway. Module Name: %s.", link_entry->module_source);
         result = __LINE__;
     }
     else
     {
-        MODULE_DATA** module_sink_handle = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink);
+        MODULE_DATA* module_sink = gateway_index_findmodule(gateway_handle, link_entry->module_sink, NULL);
         /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
-        if (module_sink_handle == NULL)
+        if (module_sink == NULL)
         {
             LogError("Failed to add the link. Sink module doesn't exists on this gateway. Module Name: %s.", link_entry->module_sink);
             result = __LINE__;
         }
         else
         {
-            if (add_one_link_to_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module) != 0)
+            if (add_one_link_to_broker(gateway_handle, module_source->module, module_sink->module) != 0)
             {
                 LogError("Unable to add link to Broker.");
                 result = __LINE__;
@@ -117,15 +100,23 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
                 LINK_DATA link_data =
                 {
                     false,
-                    *module_source_handle,
-                    *module_sink_handle
+                    module_source,
+                    module_sink
                 };
 
                 /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
                 if (VECTOR_push_back(gateway_handle->links, &link_data, 1) != 0)
                 {
                     LogError("Unable to add LINK_DATA* to the gateway links vector.");
-                    remove_one_link_from_broker(gateway_handle, (*module_source_handle)->module, (*module_sink_handle)->module);
+                    remove_one_link_from_broker(gateway_handle, module_source->module, module_sink->module);
+                    result = __LINE__;
+                }
+                /*Codes_SRS_GATEWAY_17_035: [ The gateway shall index each link by its source and sink modules, so that finding a link does not scan gw->links. ]*/
+                else if (gateway_index_addlink(gateway_handle, &link_data) != 0)
+                {
+                    LogError("Unable to index the link.");
+                    VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
+                    remove_one_link_from_broker(gateway_handle, module_source->module, module_sink->module);
                     result = __LINE__;
                 }
                 else
@@ -138,7 +129,7 @@ static int add_regular_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_L
     return result;
 }
 
-GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json)
+GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json, unsigned int startup_threads)
 {
     GATEWAY_HANDLE_DATA* gateway;
     /*Codes_SRS_GATEWAY_14_001: [This function shall create a GATEWAY_HANDLE representing the newly created gateway.]*/
@@ -148,6 +139,7 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
     {
         /* For freeing up NULL ptrs in case of create failure */
         memset(gateway, 0, sizeof(GATEWAY_HANDLE_DATA));
+        gateway->startup_threads = startup_threads;
 
         /*Codes_SRS_GATEWAY_14_003: [This function shall create a new BROKER_HANDLE for the gateway representing this gateway's message broker. ]*/
         gateway->broker = Broker_Create();
@@ -186,7 +178,17 @@ GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, boo
                     {
                         /*Codes_SRS_GATEWAY_14_009: [The function shall use each of GATEWAY_PROPERTIES's gateway_modules to create and add a module to the gateway's message broker. ]*/
                         size_t entries_count = VECTOR_size(properties->gateway_modules);
-                        if (entries_count > 0)
+                        if (entries_count > 0 && gateway->startup_threads > 1)
+                        {
+                            /*Codes_SRS_GATEWAY_17_023: [ If the gateway's startup_threads is greater than one, the function shall create the modules concurrently on up to startup_threads threads. ]*/
+                            if (gateway_addmodules_parallel_internal(gateway, properties->gateway_modules, use_json) != 0)
+                            {
+                                /*Codes_SRS_GATEWAY_14_036: [ If any MODULE_HANDLE is unable to be created from a GATEWAY_MODULES_ENTRY the GATEWAY_HANDLE will be destroyed. ]*/
+                                gateway_destroy_internal(gateway);
+                                gateway = NULL;
+                            }
+                        }
+                        else if (entries_count > 0)
                         {
                             //Add the first module, if successful add others
                             GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, 0);
@@ -279,6 +281,38 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
     {
         GATEWAY_HANDLE_DATA* gateway_handle = (GATEWAY_HANDLE_DATA*)gw;
 
+        if (gateway_handle->json_file_watcher != NULL)
+        {
+            /*Codes_SRS_GATEWAY_JSON_17_031: [ Gateway_Destroy shall stop watching the JSON configuration file. ]*/
+            FileWatcher_Destroy(gateway_handle->json_file_watcher);
+            gateway_handle->json_file_watcher = NULL;
+        }
+
+        if (gateway_handle->update_lock != NULL)
+        {
+            /*Codes_SRS_GATEWAY_17_052: [ Gateway_Destroy shall wait for a change the gateway is making on another thread to finish, and then destroy the gateway's lock. ]*/
+            if (Lock(gateway_handle->update_lock) == LOCK_OK)
+            {
+                (void)Unlock(gateway_handle->update_lock);
+            }
+            (void)Lock_Deinit(gateway_handle->update_lock);
+            gateway_handle->update_lock = NULL;
+        }
+
+        if (gateway_handle->health_monitored)
+        {
+            /*Codes_SRS_GATEWAY_17_044: [ Gateway_Destroy shall stop monitoring the modules' health before destroying the event system. ]*/
+            (void)Broker_SetHealthMonitor(gateway_handle->broker, NULL, NULL, NULL);
+            gateway_handle->health_monitored = false;
+        }
+
+        if (gateway_handle->message_tapped)
+        {
+            /*Codes_SRS_GATEWAY_17_048: [ Gateway_Destroy shall remove the message tap before destroying the event system. ]*/
+            (void)Broker_SetMessageTap(gateway_handle->broker, NULL, NULL, NULL);
+            gateway_handle->message_tapped = false;
+        }
+
         if (gateway_handle->event_system != NULL)
         {
             /* event_system might be NULL here if destroying during failed creation, event system API should cleanly handle that */
@@ -295,7 +329,8 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
             while (VECTOR_size(gateway_handle->links) > 0)
             {
                 LINK_DATA* link_data = (LINK_DATA*)VECTOR_front(gateway_handle->links);
-                gateway_removelink_internal(gateway_handle, link_data);
+                /*Codes_SRS_GATEWAY_17_054: [ The function shall leave the links in the broker, which drops them along with their sinks, so that each module still drains the messages queued for it when it is detached. ]*/
+                VECTOR_erase(gateway_handle->links, gateway_index_removelink(gateway_handle, link_data), 1);
             }
             VECTOR_destroy(gateway_handle->links);
             gateway_handle->links = NULL;
@@ -325,6 +360,7 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
             Broker_Destroy(gateway_handle->broker);
         }
 
+        gateway_index_destroy(gateway_handle);
         free(gateway_handle);
     }
     else
@@ -333,16 +369,39 @@ void gateway_destroy_internal(GATEWAY_HANDLE gw)
     }
 }
 
-bool checkIfModuleExists(GATEWAY_HANDLE_DATA* gateway_handle, const char* module_name)
+int gateway_lock_internal(GATEWAY_HANDLE_DATA* gateway_handle)
 {
-    MODULE_DATA** module_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, module_name);
+    int result;
+    /*Codes_SRS_GATEWAY_17_051: [ Once the gateway has a lock, Gateway_Start, Gateway_StartModule, Gateway_AddModule, Gateway_RemoveModule, Gateway_RemoveModuleByName, Gateway_AddLink, Gateway_RemoveLink, Gateway_GetModuleList and the JSON updates shall hold it while they use the gateway's modules and links. ]*/
+    if (gateway_handle->update_lock != NULL && Lock(gateway_handle->update_lock) != LOCK_OK)
+    {
+        LogError("unable to lock the gateway");
+        result = __LINE__;
+    }
+    else
+    {
+        result = 0;
+    }
+    return result;
+}
 
-    return module_data == NULL ? false : true;
+void gateway_unlock_internal(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    if (gateway_handle->update_lock != NULL)
+    {
+        (void)Unlock(gateway_handle->update_lock);
+    }
 }
 
-MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json)
+bool checkIfModuleExists(GATEWAY_HANDLE_DATA* gateway_handle, const char* module_name)
 {
-    MODULE_HANDLE module_result;
+    /*Codes_SRS_GATEWAY_17_034: [ The gateway shall index each module by name, so that finding a module by name does not scan gw->modules. ]*/
+    return gateway_index_findmodule(gateway_handle, module_name, NULL) != NULL;
+}
+
+bool gateway_checkentry_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry)
+{
+    bool result;
 
     /*Codes_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's loader_configuration or loader_api is NULL the function shall return NULL. ]*/
     if (
@@ -354,7 +413,7 @@ MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, co
 		module_entry->module_loader_info.loader->api == NULL
        )
     {
-        module_result = NULL;
+        result = false;
         LogError(
             "Failed to add module because a required input parameter is NULL. gw = %p, module_name = '%s', loader = %p, entrypoint = %p.",
             gateway_handle,
@@ -366,182 +425,302 @@ MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, co
     else if (strcmp(module_entry->module_name, GATEWAY_ALL) == 0)
     {
         /*Codes_SRS_GATEWAY_17_001: [ This function shall not accept "*" as a module name. ]*/
-        module_result = NULL;
+        result = false;
         LogError("Failed to add module because the module_name is invalid [%s]", module_entry->module_name);
     }
     else
     {
-        //First check if a module with a given name already exists.
-        /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
-        bool moduleExist = checkIfModuleExists(gateway_handle, module_entry->module_name);
-        if (!moduleExist)
+        result = true;
+    }
+
+    return result;
+}
+
+bool gateway_checkmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry)
+{
+    bool result;
+
+    if (!gateway_checkentry_internal(gateway_handle, module_entry))
+    {
+        result = false;
+    }
+    //First check if a module with a given name already exists.
+    /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
+    else if (checkIfModuleExists(gateway_handle, module_entry->module_name))
+    {
+        result = false;
+        LogError("Error to add module. Duplicated module name: %s", module_entry->module_name);
+    }
+    else
+    {
+        result = true;
+    }
+
+    return result;
+}
+
+static void* parse_module_configuration(const GATEWAY_JSON_MODULES_ENTRY* module_entry, const MODULE_API* module_apis)
+{
+    void* result;
+    pfModule_ParseConfigurationFromJsonValue parse_json_value = MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(module_apis);
+    if (module_entry->module_configuration_json != NULL && parse_json_value != NULL)
+    {
+        /*Codes_SRS_GATEWAY_JSON_17_032: [ If the module implements Module_ParseConfigurationFromJsonValue, the gateway shall pass it the parsed "args" without serializing them. ]*/
+        result = parse_json_value(module_entry->module_configuration_json);
+    }
+    else if (module_entry->entry.module_configuration == NULL && module_entry->module_configuration_json != NULL)
+    {
+        /*Codes_SRS_GATEWAY_JSON_17_033: [ Otherwise the gateway shall serialize the "args" only while the module's Module_ParseConfigurationFromJson is called. ]*/
+        char* serialized_configuration = json_serialize_to_string(module_entry->module_configuration_json);
+        if (serialized_configuration == NULL)
+        {
+            LogError("Failed to serialize the configuration of module %s.", module_entry->entry.module_name);
+        }
+        result = MODULE_PARSE_CONFIGURATION_FROM_JSON(module_apis)(serialized_configuration);
+        if (serialized_configuration != NULL)
         {
-            MODULE_DATA * new_module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA));
-            if (new_module_data == NULL)
+            json_free_serialized_string(serialized_configuration);
+        }
+    }
+    else
+    {
+        result = MODULE_PARSE_CONFIGURATION_FROM_JSON(module_apis)((const char *)(module_entry->entry.module_configuration));
+    }
+    return result;
+}
+
+MODULE_HANDLE gateway_loadmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE* module_library_handle, const MODULE_API** module_apis)
+{
+    MODULE_HANDLE module_result;
+
+    /*Codes_SRS_GATEWAY_14_012: [The function shall load the module located at GATEWAY_MODULES_ENTRY's module_path into a MODULE_LIBRARY_HANDLE. ]*/
+    /*Codes_SRS_GATEWAY_17_015: [ The function shall use the module's specified loader and the module's entrypoint to get each module's MODULE_LIBRARY_HANDLE. ]*/
+    *module_library_handle = module_entry->module_loader_info.loader->api->Load(
+        module_entry->module_loader_info.loader,
+        module_entry->module_loader_info.entrypoint
+    );
+
+    /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+    if (*module_library_handle == NULL)
+    {
+        free(new_module_data);
+        module_result = NULL;
+        LogError("Failed to add module because the module could not be loaded.");
+    }
+    else
+    {
+        module_result = gateway_createmodule_internal(gateway_handle, module_entry, use_json, new_module_data, *module_library_handle, module_apis);
+    }
+
+    return module_result;
+}
+
+MODULE_HANDLE gateway_createmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE module_library_handle, const MODULE_API** module_apis)
+{
+    MODULE_HANDLE module_result;
+
+    //Should always be a safe call.
+    /*Codes_SRS_GATEWAY_14_013: [The function shall get the const MODULE_API* from the MODULE_LIBRARY_HANDLE.]*/
+    *module_apis = module_entry->module_loader_info.loader->api->GetApi(module_entry->module_loader_info.loader, module_library_handle);
+
+    // parse module args if needed
+    const void* module_configuration = module_entry->module_configuration;
+    const void* transformed_module_configuration;
+    if (use_json)
+    {
+        module_configuration = parse_module_configuration((const GATEWAY_JSON_MODULES_ENTRY*)module_entry, *module_apis);
+    }
+
+    // request the loader to transform the module configuration to what the module expects
+    /*Codes_SRS_GATEWAY_17_018: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
+    /*Codes_SRS_GATEWAY_17_021: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
+    /*Codes_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
+    transformed_module_configuration = module_entry->module_loader_info.loader->api->BuildModuleConfiguration(
+        module_entry->module_loader_info.loader,
+        module_entry->module_loader_info.entrypoint,
+        module_configuration
+    );
+
+    /*Codes_SRS_GATEWAY_14_015: [The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_configuration. ]*/
+    module_result = MODULE_CREATE(*module_apis)(gateway_handle->broker, transformed_module_configuration);
+
+    // free the configurations
+    /*Codes_SRS_GATEWAY_17_020: [ The function shall clean up any constructed resources. ]*/
+    /*Codes_SRS_GATEWAY_17_022: [ The function shall clean up any constructed resources. ]*/
+    if (use_json)
+    {
+        MODULE_FREE_CONFIGURATION(*module_apis)((void*)module_configuration);
+    }
+    module_entry->module_loader_info.loader->api->FreeModuleConfiguration(module_entry->module_loader_info.loader, transformed_module_configuration);
+
+    /*Codes_SRS_GATEWAY_14_016: [If the module creation is unsuccessful, the function shall return NULL.]*/
+    if (module_result == NULL)
+    {
+        free(new_module_data);
+        module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
+        LogError("Module_Create failed.");
+    }
+
+    return module_result;
+}
+
+BROKER_RESULT gateway_brokeraddmodule_internal(BROKER_HANDLE broker, const MODULE* module, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json)
+{
+    BROKER_RESULT result;
+    /* only entries read from JSON or a snapshot can be replicas */
+    const BROKER_REPLICA* replica = use_json ? &((const GATEWAY_JSON_MODULES_ENTRY*)module_entry)->module_replica : NULL;
+    /*Codes_SRS_GATEWAY_17_036: [ If the entry was read from JSON or a snapshot and is one of a group of replicas, the function shall attach the module using Broker_AddReplicaModule instead. ]*/
+    if (replica != NULL && replica->count > 1)
+    {
+        result = Broker_AddReplicaModule(broker, module, replica);
+    }
+    else
+    {
+        result = Broker_AddModule(broker, module);
+    }
+    return result;
+}
+
+MODULE_HANDLE gateway_attachmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE module_library_handle, const MODULE_API* module_apis, MODULE_HANDLE module_handle)
+{
+    MODULE_HANDLE module_result;
+
+    /*Codes_SRS_GATEWAY_99_011: [The function shall assign `module_apis` to `MODULE::module_apis`. ]*/
+    MODULE module;
+    module.module_apis = module_apis;
+    module.module_handle = module_handle;
+
+    /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
+    /*Codes_SRS_GATEWAY_14_018: [If the function cannot attach the module to the message broker, the function shall return NULL.]*/
+    if (gateway_brokeraddmodule_internal(gateway_handle->broker, &module, module_entry, use_json) != BROKER_OK)
+    {
+        free(new_module_data);
+        module_result = NULL;
+        LogError("Failed to add module to the gateway's broker.");
+    }
+    else
+    {
+        char* name_copied = NULL;
+        /*Codes_SRS_GATEWAY_26_020: [ The function shall make a copy of the name of the module for internal use. ]*/
+        mallocAndStrcpy_s(&name_copied, module_entry->module_name);
+        if (name_copied == NULL)
+        {
+            free(new_module_data);
+            module_result = NULL;
+            if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+            {
+                LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+            }
+            LogError("Unable to malloc for module name");
+        }
+        else
+        {
+            strcpy(name_copied, module_entry->module_name);
+            /*Codes_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
+            Broker_IncRef(gateway_handle->broker);
+            /*Codes_SRS_GATEWAY_14_029: [ The function shall create a new MODULE_DATA containing the MODULE_HANDLE, MODULE_LOADER_API and MODULE_LIBRARY_HANDLE if the module was successfully linked to the message broker. ]*/
+            MODULE_DATA module_data =
+            {
+                name_copied,
+                module_library_handle,
+                module_entry->module_loader_info.loader,
+                module_handle
+            };
+            *new_module_data = module_data;
+            /*Codes_SRS_GATEWAY_14_032: [The function shall add the new MODULE_DATA to GATEWAY_HANDLE_DATA's modules if the module was successfully attached to the message broker. ]*/
+            if (VECTOR_push_back(gateway_handle->modules, &new_module_data, 1) != 0)
+            {
+                /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                Broker_DecRef(gateway_handle->broker);
+                free(new_module_data);
+                free(name_copied);
+                module_result = NULL;
+                if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                {
+                    LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                }
+                LogError("Unable to add MODULE_DATA* to the gateway module vector.");
+            }
+            /*Codes_SRS_GATEWAY_17_034: [ The gateway shall index each module by name, so that finding a module by name does not scan gw->modules. ]*/
+            else if (gateway_index_addmodule(gateway_handle, new_module_data) != 0)
             {
-                /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+                Broker_DecRef(gateway_handle->broker);
                 module_result = NULL;
-                LogError("Failed to add module because it could not allocate memory.");
+                if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                {
+                    LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                }
+                VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
+                free(new_module_data);
+                free(name_copied);
+                LogError("Unable to index MODULE_DATA*.");
             }
             else
             {
-                /*Codes_SRS_GATEWAY_14_012: [The function shall load the module located at GATEWAY_MODULES_ENTRY's module_path into a MODULE_LIBRARY_HANDLE. ]*/
-                /*Codes_SRS_GATEWAY_17_015: [ The function shall use the module's specified loader and the module's entrypoint to get each module's MODULE_LIBRARY_HANDLE. ]*/
-                MODULE_LIBRARY_HANDLE module_library_handle = module_entry->module_loader_info.loader->api->Load(
-                    module_entry->module_loader_info.loader,
-                    module_entry->module_loader_info.entrypoint
-                );
-
-                /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
-                if (module_library_handle == NULL)
+                if (add_module_to_any_source(gateway_handle, *(MODULE_DATA**)VECTOR_back(gateway_handle->modules)) != 0)
                 {
-                    free(new_module_data);
+                    /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                    Broker_DecRef(gateway_handle->broker);
                     module_result = NULL;
-                    LogError("Failed to add module because the module could not be loaded.");
+                    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+                    {
+                        LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
+                    }
+                    gateway_index_removemodule(gateway_handle, new_module_data);
+                    VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
+                    free(new_module_data);
+                    free(name_copied);
+                    LogError("Unable to add MODULE_DATA* to existing broker links.");
                 }
                 else
                 {
-                    //Should always be a safe call.
-                    /*Codes_SRS_GATEWAY_14_013: [The function shall get the const MODULE_API* from the MODULE_LIBRARY_HANDLE.]*/
-                    const MODULE_API* module_apis = module_entry->module_loader_info.loader->api->GetApi(module_entry->module_loader_info.loader, module_library_handle);
-
-                    // parse module args if needed
-                    const void* module_configuration = module_entry->module_configuration;
-                    const void* transformed_module_configuration;
-                    if (use_json)
-                    {
-                        module_configuration = MODULE_PARSE_CONFIGURATION_FROM_JSON(module_apis)(
-                            (const char *)(module_entry->module_configuration)
-                        );
-					}
-
-                    // request the loader to transform the module configuration to what the module expects
-                    /*Codes_SRS_GATEWAY_17_018: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
-                    /*Codes_SRS_GATEWAY_17_021: [ The function shall construct module configuration from module's entrypoint and module's module_configuration. ]*/
-                    /*Codes_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
-                    transformed_module_configuration = module_entry->module_loader_info.loader->api->BuildModuleConfiguration(
-                        module_entry->module_loader_info.loader,
-                        module_entry->module_loader_info.entrypoint,
-                        module_configuration
-                    );
-
-                    /*Codes_SRS_GATEWAY_14_015: [The function shall use the MODULE_API to create a MODULE_HANDLE using the GATEWAY_MODULES_ENTRY's module_configuration. ]*/
-                    MODULE_HANDLE module_handle = MODULE_CREATE(module_apis)(gateway_handle->broker, transformed_module_configuration);
-
-                    // free the configurations
-                    /*Codes_SRS_GATEWAY_17_020: [ The function shall clean up any constructed resources. ]*/
-                    /*Codes_SRS_GATEWAY_17_022: [ The function shall clean up any constructed resources. ]*/
-                    if (use_json)
-                    {
-                        MODULE_FREE_CONFIGURATION(module_apis)((void*)module_configuration);
-                    }
-                    module_entry->module_loader_info.loader->api->FreeModuleConfiguration(module_entry->module_loader_info.loader, transformed_module_configuration);
-
-                    /*Codes_SRS_GATEWAY_14_016: [If the module creation is unsuccessful, the function shall return NULL.]*/
-                    if (module_handle == NULL)
-                    {
-                        free(new_module_data);
-                        module_result = NULL;
-                        module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
-                        LogError("Module_Create failed.");
-                    }
-                    else
-                    {
-                        /*Codes_SRS_GATEWAY_99_011: [The function shall assign `module_apis` to `MODULE::module_apis`. ]*/
-                        MODULE module;
-                        module.module_apis = module_apis;
-                        module.module_handle = module_handle;
-
-                        /*Codes_SRS_GATEWAY_14_017: [The function shall attach the module to the GATEWAY_HANDLE_DATA's broker using a call to Broker_AddModule. ]*/
-                        /*Codes_SRS_GATEWAY_14_018: [If the function cannot attach the module to the message broker, the function shall return NULL.]*/
-                        if (Broker_AddModule(gateway_handle->broker, &module) != BROKER_OK)
-                        {
-                            free(new_module_data);
-                            module_result = NULL;
-                            LogError("Failed to add module to the gateway's broker.");
-                        }
-                        else
-                        {
-                            char* name_copied = NULL;
-                            /*Codes_SRS_GATEWAY_26_020: [ The function shall make a copy of the name of the module for internal use. ]*/
-                            mallocAndStrcpy_s(&name_copied, module_entry->module_name);
-                            if (name_copied == NULL)
-                            {
-                                free(new_module_data);
-                                module_result = NULL;
-                                if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                {
-                                    LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                }
-                                LogError("Unable to malloc for module name");
-                            }
-                            else
-                            {
-                                strcpy(name_copied, module_entry->module_name);
-                                /*Codes_SRS_GATEWAY_14_039: [ The function shall increment the BROKER_HANDLE reference count if the MODULE_HANDLE was successfully added to the GATEWAY_HANDLE_DATA's broker. ]*/
-                                Broker_IncRef(gateway_handle->broker);
-                                /*Codes_SRS_GATEWAY_14_029: [ The function shall create a new MODULE_DATA containing the MODULE_HANDLE, MODULE_LOADER_API and MODULE_LIBRARY_HANDLE if the module was successfully linked to the message broker. ]*/
-                                MODULE_DATA module_data =
-                                {
-                                    name_copied,
-                                    module_library_handle,
-                                    module_entry->module_loader_info.loader,
-                                    module_handle
-                                };
-                                *new_module_data = module_data;
-                                /*Codes_SRS_GATEWAY_14_032: [The function shall add the new MODULE_DATA to GATEWAY_HANDLE_DATA's modules if the module was successfully attached to the message broker. ]*/
-                                if (VECTOR_push_back(gateway_handle->modules, &new_module_data, 1) != 0)
-                                {
-                                    /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                    Broker_DecRef(gateway_handle->broker);
-                                    free(new_module_data);
-                                    free(name_copied);
-                                    module_result = NULL;
-                                    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                    {
-                                        LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                    }
-                                    LogError("Unable to add MODULE_DATA* to the gateway module vector.");
-                                }
-                                else
-                                {
-                                    if (add_module_to_any_source(gateway_handle, *(MODULE_DATA**)VECTOR_back(gateway_handle->modules)) != 0)
-                                    {
-                                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                        Broker_DecRef(gateway_handle->broker);
-                                        module_result = NULL;
-                                        if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-                                        {
-                                            LogError("Failed to remove module [%p] from the gateway message broker. This module will remain attached.", &module);
-                                        }
-                                        VECTOR_erase(gateway_handle->modules, VECTOR_back(gateway_handle->modules), 1);
-                                        free(new_module_data);
-                                        free(name_copied);
-                                        LogError("Unable to add MODULE_DATA* to existing broker links.");
-                                    }
-                                    else
-                                    {
-                                        /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
-                                        module_result = module_handle;
-                                    }
-                                }
-                            }
-                        }
-
-                        /*Codes_SRS_GATEWAY_14_030: [If any internal API call is unsuccessful after a module is created, the library will be unloaded and the module destroyed.]*/
-                        if (module_result == NULL)
-                        {
-                            MODULE_DESTROY(module_apis)(module_handle);
-                            module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
-                        }
-                    }
+                    /*Codes_SRS_GATEWAY_14_019: [The function shall return the newly created MODULE_HANDLE only if each API call returns successfully.]*/
+                    module_result = module_handle;
                 }
             }
         }
-        else
+    }
+
+    /*Codes_SRS_GATEWAY_14_030: [If any internal API call is unsuccessful after a module is created, the library will be unloaded and the module destroyed.]*/
+    if (module_result == NULL)
+    {
+        MODULE_DESTROY(module_apis)(module_handle);
+        module_entry->module_loader_info.loader->api->Unload(module_entry->module_loader_info.loader, module_library_handle);
+    }
+
+    return module_result;
+}
+
+MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json)
+{
+    MODULE_HANDLE module_result;
+
+    if (!gateway_checkmodule_internal(gateway_handle, module_entry))
+    {
+        module_result = NULL;
+    }
+    else
+    {
+        MODULE_DATA * new_module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA));
+        if (new_module_data == NULL)
         {
+            /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
             module_result = NULL;
-            LogError("Error to add module. Duplicated module name: %s", module_entry->module_name);
+            LogError("Failed to add module because it could not allocate memory.");
+        }
+        else
+        {
+            MODULE_LIBRARY_HANDLE module_library_handle;
+            const MODULE_API* module_apis;
+            MODULE_HANDLE module_handle = gateway_loadmodule_internal(gateway_handle, module_entry, use_json, new_module_data, &module_library_handle, &module_apis);
+            if (module_handle == NULL)
+            {
+                module_result = NULL;
+            }
+            else
+            {
+                module_result = gateway_attachmodule_internal(gateway_handle, module_entry, use_json, new_module_data, module_library_handle, module_apis, module_handle);
+            }
         }
     }
 
@@ -554,25 +733,38 @@ void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
     module.module_apis = NULL;
     module.module_handle = (*module_data_pptr)->module;
 
+    /*Codes_SRS_GATEWAY_14_021: [ The function shall detach module from the GATEWAY_HANDLE_DATA's broker BROKER_HANDLE. ]*/
+    /*Codes_SRS_GATEWAY_17_053: [ The function shall detach the module from the broker before removing its links, so that the module drains the messages queued for it while it is still subscribed to their sources. ]*/
+    /*Codes_SRS_GATEWAY_14_022: [ If GATEWAY_HANDLE_DATA's broker cannot detach module, the function shall log the error and continue unloading the module from the GATEWAY_HANDLE. ]*/
+    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
+    {
+        LogError("Failed to remove module [%p] from the message broker. This module will remain linked to the broker but will be removed from the gateway.", (*module_data_pptr)->module);
+    }
+
     remove_module_from_any_source(gateway_handle, *module_data_pptr);
     /* Codes_SRS_GATEWAY_26_018: [ This function shall remove any links that contain the removed module either as a source or sink. ] */
+    /*Codes_SRS_GATEWAY_17_050: [ The gateway shall index each link by the modules at its ends, so that finding the links of a module does not scan the link index. ]*/
     if (gateway_handle->links)
     {
-        LINK_DATA *link;
-        while ((link = VECTOR_find_if(gateway_handle->links, link_name_both_find, (*module_data_pptr)->module_name)) != NULL)
+        size_t link;
+        while ((link = gateway_index_findlinkof(gateway_handle, *module_data_pptr)) != GATEWAY_INDEX_NOT_FOUND)
         {
-            gateway_removelink_internal(gateway_handle, link);
+            LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, link);
+            if (link_data->module_sink == *module_data_pptr)
+            {
+                /*Codes_SRS_GATEWAY_17_054: [ The function shall leave the links in the broker, which drops them along with their sinks, so that each module still drains the messages queued for it when it is detached. ]*/
+                VECTOR_erase(gateway_handle->links, gateway_index_removelink(gateway_handle, link_data), 1);
+            }
+            else
+            {
+                gateway_removelink_internal(gateway_handle, link_data);
+            }
         }
     }
 
+    gateway_index_removemodule(gateway_handle, *module_data_pptr);
     free((*module_data_pptr)->module_name);
 
-    /*Codes_SRS_GATEWAY_14_021: [ The function shall detach module from the GATEWAY_HANDLE_DATA's broker BROKER_HANDLE. ]*/
-    /*Codes_SRS_GATEWAY_14_022: [ If GATEWAY_HANDLE_DATA's broker cannot detach module, the function shall log the error and continue unloading the module from the GATEWAY_HANDLE. ]*/
-    if (Broker_RemoveModule(gateway_handle->broker, &module) != BROKER_OK)
-    {
-        LogError("Failed to remove module [%p] from the message broker. This module will remain linked to the broker but will be removed from the gateway.", (*module_data_pptr)->module);
-    }
     /*Codes_SRS_GATEWAY_14_038: [ The function shall decrement the BROKER_HANDLE reference count. ]*/
     Broker_DecRef(gateway_handle->broker);
 
@@ -653,7 +845,8 @@ void gateway_removelink_internal(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA*
         Broker_RemoveLink(gateway_handle->broker, &broker_data);
     }
 
-    VECTOR_erase(gateway_handle->links, link_data, 1);
+    /*Codes_SRS_GATEWAY_17_049: [ The function shall move the last link of gw->links into the place of the removed link, so that no other link changes position. ]*/
+    VECTOR_erase(gateway_handle->links, gateway_index_removelink(gateway_handle, link_data), 1);
 }
 
 int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module)
@@ -666,7 +859,7 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
         LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
         if (link_data->from_any_source)
         {
-            MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
+            MODULE_DATA* module_sink = gateway_index_findmodule(gateway_handle, link_data->module_sink->module_name, NULL);
             if (module_sink == NULL)
             {
                 LogError("Link failure between [%s] and [%s]", link_data->module_sink->module_name, module->module_name);
@@ -675,7 +868,7 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
             }
             else
             {
-                if (add_one_link_to_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
+                if (add_one_link_to_broker(gateway_handle, module->module, module_sink->module) != 0)
                 {
                     result = __LINE__;
                     break;
@@ -702,14 +895,14 @@ void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
             LINK_DATA * link_data = VECTOR_element(gateway_handle->links, link);
             if (link_data->from_any_source)
             {
-                MODULE_DATA** module_sink = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_data->module_sink->module_name);
+                MODULE_DATA* module_sink = gateway_index_findmodule(gateway_handle, link_data->module_sink->module_name, NULL);
                 if (module_sink == NULL)
                 {
                     LogError("Could not find sink for link [%s]", link_data->module_sink);
                 }
-                else
+                else if (module_sink != module)
                 {
-                    if (remove_one_link_from_broker(gateway_handle, module->module, (*module_sink)->module) != 0)
+                    if (remove_one_link_from_broker(gateway_handle, module->module, module_sink->module) != 0)
                     {
                         LogError("Unable to remove link to Broker.");
                     }
@@ -722,7 +915,7 @@ void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_D
 int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry)
 {
     int result;
-    MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink);
+    MODULE_DATA* module_sink_data = gateway_index_findmodule(gateway_handle, link_entry->module_sink, NULL);
 
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
     if (module_sink_data == NULL)
@@ -737,7 +930,7 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
         {
             true,
             no_module,
-            *module_sink_data
+            module_sink_data
         };
 
         /*Codes_SRS_GATEWAY_04_012: [ This function shall add the entryLink to the gw->links ] */
@@ -756,8 +949,8 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
             {
                 MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
                 /*Codes_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]*/
-                if ((*source_module_data)->module != (*module_sink_data)->module &&
-                    add_one_link_to_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
+                if ((*source_module_data)->module != module_sink_data->module &&
+                    add_one_link_to_broker(gateway_handle, (*source_module_data)->module, module_sink_data->module) != 0)
                 {
                     result = __LINE__;
                     break;
@@ -768,6 +961,14 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
                 remove_any_source_link(gateway_handle, &link_data);
                 VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
             }
+            /*Codes_SRS_GATEWAY_17_035: [ The gateway shall index each link by its source and sink modules, so that finding a link does not scan gw->links. ]*/
+            else if (gateway_index_addlink(gateway_handle, &link_data) != 0)
+            {
+                LogError("Unable to index the link.");
+                remove_any_source_link(gateway_handle, &link_data);
+                VECTOR_erase(gateway_handle->links, VECTOR_back(gateway_handle->links), 1);
+                result = __LINE__;
+            }
         }
     }
     return result;
@@ -775,7 +976,7 @@ int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_
 
 void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_entry)
 {
-    MODULE_DATA** module_sink_data = (MODULE_DATA**)VECTOR_find_if(gateway_handle->modules, module_name_find, link_entry->module_sink->module_name);
+    MODULE_DATA* module_sink_data = gateway_index_findmodule(gateway_handle, link_entry->module_sink->module_name, NULL);
 
     /*Codes_SRS_GATEWAY_04_011: [If the module referenced by the entryLink->module_source or entryLink->module_sink doesn't exists this function shall return GATEWAY_ADD_LINK_ERROR ] */
     if (module_sink_data != NULL)
@@ -785,8 +986,8 @@ void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link
         for (m = 0; m < num_modules; m++)
         {
             MODULE_DATA **source_module_data = (MODULE_DATA **)VECTOR_element(gateway_handle->modules, m);
-            if ((*source_module_data)->module != (*module_sink_data)->module &&
-                remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, (*module_sink_data)->module) != 0)
+            if ((*source_module_data)->module != module_sink_data->module &&
+                remove_one_link_from_broker(gateway_handle, (*source_module_data)->module, module_sink_data->module) != 0)
             {
                 LogError("Unable to remove link to Broker.");
             }
@@ -798,37 +999,3 @@ void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link
     }
 
 }
-
-/* Searches both sources and sinks. */
-bool link_data_find(const void* element, const void* linkEntry)
-{
-    bool result;
-    GATEWAY_LINK_ENTRY* link_entry_casted = (GATEWAY_LINK_ENTRY*)linkEntry;
-    LINK_DATA * element_casted = (LINK_DATA*)element;
-
-    if (strcmp(GATEWAY_ALL, link_entry_casted->module_source) == 0)
-    {
-        if (element_casted->from_any_source)
-        {
-            result = (strcmp(element_casted->module_sink->module_name, link_entry_casted->module_sink) == 0);
-        }
-        else
-        {
-            result = false;
-        }
-    }
-    else
-    {
-        if (element_casted->from_any_source)
-        {
-            result = false;
-        }
-        else
-        {
-            result = ((strcmp(element_casted->module_sink->module_name, link_entry_casted->module_sink) == 0) &&
-                (strcmp(element_casted->module_source->module_name, link_entry_casted->module_source) == 0));
-        }
-    }
-
-    return result;
-}
@@ -4,7 +4,10 @@
 #ifndef GATEWAY_INTERNAL_H
 #define GATEWAY_INTERNAL_H
 
+#include <stdint.h>
+#include "azure_c_shared_utility/lock.h"
 #include "module_loader.h"
+#include "file_watcher.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -26,8 +29,63 @@ typedef struct MODULE_DATA_TAG {
      *          broker.
      */
     MODULE_HANDLE module;
+
+    /** @brief  Hash of the JSON the module was configured from, 0 when the
+     *          module was not added from JSON
+     */
+    uint64_t configuration_hash;
 } MODULE_DATA;
 
+/** @brief  A module entry read from a JSON configuration or a snapshot. The
+ *          vectors of GATEWAY_PROPERTIES built from JSON hold these; the
+ *          functions below that take use_json read an entry as one of these
+ *          when it is true, and as a plain GATEWAY_MODULES_ENTRY otherwise.
+ */
+typedef struct GATEWAY_JSON_MODULES_ENTRY_TAG
+{
+    GATEWAY_MODULES_ENTRY entry;
+
+    /** @brief  The module's parsed "args", or NULL. Modules that implement
+     *          Module_ParseConfigurationFromJsonValue receive it as is,
+     *          others receive it serialized when entry.module_configuration
+     *          is NULL.
+     */
+    const JSON_Value* module_configuration_json;
+
+    /** @brief  The place of the module in its group of replicas. A count of
+     *          0 or 1 adds the module as a single instance.
+     */
+    BROKER_REPLICA module_replica;
+} GATEWAY_JSON_MODULES_ENTRY;
+
+#define GATEWAY_INDEX_INLINE_SLOTS 16
+#define GATEWAY_INDEX_NOT_FOUND ((size_t)-1)
+
+typedef struct GATEWAY_INDEX_SLOT_TAG {
+    bool used;
+    uint32_t hash;
+
+    /** @brief  The module, or the source of the link (NULL for "*") */
+    MODULE_DATA* first;
+
+    /** @brief  The sink of the link, NULL in the module index */
+    MODULE_DATA* second;
+
+    /** @brief  Position of the module or link in its vector, unused in the
+     *          link end index */
+    size_t position;
+} GATEWAY_INDEX_SLOT;
+
+/** @brief  Hash index over the modules or the links vector. Uses inline_slots
+ *          until it outgrows them, then slots on the heap.
+ */
+typedef struct GATEWAY_INDEX_TAG {
+    GATEWAY_INDEX_SLOT* slots;
+    size_t capacity;
+    size_t count;
+    GATEWAY_INDEX_SLOT inline_slots[GATEWAY_INDEX_INLINE_SLOTS];
+} GATEWAY_INDEX;
+
 typedef struct GATEWAY_HANDLE_DATA_TAG {
 
     /** @brief  Vector of MODULE_DATA modules that the Gateway must track */
@@ -41,6 +99,39 @@ typedef struct GATEWAY_HANDLE_DATA_TAG {
 
     /** @brief  Vector of LINK_DATA links that the Gateway must track */
     VECTOR_HANDLE links;
+
+    /** @brief  Number of threads creating and starting modules, one or less
+     *          brings modules up one at a time */
+    unsigned int startup_threads;
+
+    /** @brief  Positions of the modules, indexed by module name */
+    GATEWAY_INDEX module_index;
+
+    /** @brief  Positions of the links, indexed by source and sink module */
+    GATEWAY_INDEX link_index;
+
+    /** @brief  Source and sink of the links, indexed by each of their modules */
+    GATEWAY_INDEX link_end_index;
+
+    /** @brief  Set once Gateway_Start has started the modules */
+    bool started;
+
+    /** @brief  Watcher of the JSON configuration file, NULL when no file is
+     *          watched */
+    FILE_WATCHER_HANDLE json_file_watcher;
+
+    /** @brief  Serializes the changes to the gateway once a JSON file is
+     *          watched, since the watcher applies the file on its own
+     *          thread. NULL until then */
+    LOCK_HANDLE update_lock;
+
+    /** @brief  Set while the broker reports the modules' health to the event
+     *          system */
+    bool health_monitored;
+
+    /** @brief  Set while the broker hands sampled messages to the event
+     *          system */
+    bool message_tapped;
 } GATEWAY_HANDLE_DATA;
 
 typedef struct LINK_DATA_TAG {
@@ -49,9 +140,35 @@ typedef struct LINK_DATA_TAG {
     MODULE_DATA *module_sink;
 } LINK_DATA;
 
-GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json);
+/** @brief  A module as it is written to a snapshot */
+typedef struct GATEWAY_SNAPSHOT_MODULE_TAG {
+    const char* module_name;
+    const char* loader_name;
+
+    /** @brief  Serialized "loader.entrypoint", NULL when there is none */
+    const char* entrypoint;
+
+    /** @brief  Serialized "args", NULL when there is none */
+    const char* args;
+    uint64_t configuration_hash;
+
+    /** @brief  The module's place in its group of replicas */
+    BROKER_REPLICA replica;
+} GATEWAY_SNAPSHOT_MODULE;
+
+GATEWAY_HANDLE gateway_create_internal(const GATEWAY_PROPERTIES* properties, bool use_json, unsigned int startup_threads);
 void gateway_destroy_internal(GATEWAY_HANDLE gw);
+int gateway_lock_internal(GATEWAY_HANDLE_DATA* gateway_handle);
+void gateway_unlock_internal(GATEWAY_HANDLE_DATA* gateway_handle);
 MODULE_HANDLE gateway_addmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry, bool use_json);
+bool gateway_checkmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry);
+bool gateway_checkentry_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry);
+MODULE_HANDLE gateway_loadmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE* module_library_handle, const MODULE_API** module_apis);
+MODULE_HANDLE gateway_createmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE module_library_handle, const MODULE_API** module_apis);
+BROKER_RESULT gateway_brokeraddmodule_internal(BROKER_HANDLE broker, const MODULE* module, const GATEWAY_MODULES_ENTRY* module_entry, bool use_json);
+MODULE_HANDLE gateway_attachmodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_MODULES_ENTRY* entry, bool use_json, MODULE_DATA* new_module_data, MODULE_LIBRARY_HANDLE module_library_handle, const MODULE_API* module_apis, MODULE_HANDLE module_handle);
+int gateway_addmodules_parallel_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, bool use_json);
+void gateway_startmodules_parallel_internal(GATEWAY_HANDLE_DATA* gateway_handle);
 void gateway_removemodule_internal(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA** module);
 bool gateway_addlink_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
 void gateway_removelink_internal(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_data);
@@ -59,8 +176,16 @@ int add_module_to_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* m
 void remove_module_from_any_source(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module);
 int add_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
 void remove_any_source_link(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link_entry);
-bool module_name_find(const void* element, const void* module_name);
-bool link_data_find(const void* element, const void* link_data);
+int gateway_index_addmodule(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_DATA* module);
+void gateway_index_removemodule(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module);
+MODULE_DATA* gateway_index_findmodule(GATEWAY_HANDLE_DATA* gateway_handle, const char* module_name, size_t* position);
+int gateway_index_addlink(GATEWAY_HANDLE_DATA* gateway_handle, const LINK_DATA* link);
+LINK_DATA* gateway_index_removelink(GATEWAY_HANDLE_DATA* gateway_handle, LINK_DATA* link);
+size_t gateway_index_findlink(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_LINK_ENTRY* link_entry);
+size_t gateway_index_findlinkof(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module);
+void gateway_index_destroy(GATEWAY_HANDLE_DATA* gateway_handle);
+int gateway_update_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_PROPERTIES* properties, const uint64_t* configuration_hashes, bool replace, bool* modules_changed);
+int gateway_snapshot_write_internal(const char* snapshot_path, const char* loaders, unsigned int startup_threads, const GATEWAY_SNAPSHOT_MODULE* modules, size_t module_count, const GATEWAY_LINK_ENTRY* links, size_t link_count);
 
 #ifdef __cplusplus
 }
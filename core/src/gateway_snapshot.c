@@ -0,0 +1,514 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/vector.h"
+#include "gateway.h"
+#include "parson.h"
+#include "experimental/event_system.h"
+
+#include "gateway_internal.h"
+
+/*
+ * A snapshot is a gateway JSON configuration after it was validated, laid
+ * out so that it is read with one fread and used in place:
+ *
+ *   0   "AZGWSNAP"
+ *   8   u32 version
+ *   12  u32 size of the whole snapshot
+ *   16  u64 FNV-1a checksum of the bytes from offset 24 to the end
+ *   24  u32 startup threads
+ *   28  u32 "loaders" JSON, 0 when there is none
+ *   32  u32 module count
+ *   36  u32 link count
+ *   40  modules: u32 name, u32 loader name, u32 entrypoint JSON, u32 args
+ *       JSON, u64 configuration hash, u32 replica count, u32 replica index,
+ *       u32 replica key; the JSON and key offsets are 0 when the module
+ *       has none
+ *       links: u32 source, u32 sink
+ *       strings, each NUL terminated
+ *
+ * Integers are little endian, strings are offsets from the start of the
+ * snapshot.
+ */
+#define SNAPSHOT_MAGIC "AZGWSNAP"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_CHECKSUM_OFFSET 16
+#define SNAPSHOT_CHECKED_OFFSET 24
+#define SNAPSHOT_HEADER_SIZE 40
+#define SNAPSHOT_MODULE_SIZE 36
+#define SNAPSHOT_LINK_SIZE 8
+
+/* The JSON parsed for a module entry, kept until the gateway is created */
+typedef struct SNAPSHOT_MODULE_JSON_TAG
+{
+    JSON_Value* entrypoint;
+    JSON_Value* args;
+} SNAPSHOT_MODULE_JSON;
+
+static void put_u32(unsigned char* destination, uint32_t value)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        destination[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char* destination, uint64_t value)
+{
+    for (size_t i = 0; i < 8; i++)
+    {
+        destination[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* source)
+{
+    uint32_t value = 0;
+    for (size_t i = 4; i > 0; i--)
+    {
+        value = (value << 8) | source[i - 1];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char* source)
+{
+    uint64_t value = 0;
+    for (size_t i = 8; i > 0; i--)
+    {
+        value = (value << 8) | source[i - 1];
+    }
+    return value;
+}
+
+static uint64_t snapshot_checksum(const unsigned char* snapshot, size_t size)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = SNAPSHOT_CHECKED_OFFSET; i < size; i++)
+    {
+        hash ^= snapshot[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+static size_t string_size(const char* value)
+{
+    return (value == NULL) ? 0 : strlen(value) + 1;
+}
+
+/* Copies value into the string area, returns its offset or 0 for NULL */
+static uint32_t put_string(unsigned char* snapshot, size_t* strings_end, const char* value)
+{
+    uint32_t offset;
+    if (value == NULL)
+    {
+        offset = 0;
+    }
+    else
+    {
+        size_t size = strlen(value) + 1;
+        offset = (uint32_t)*strings_end;
+        memcpy(snapshot + *strings_end, value, size);
+        *strings_end += size;
+    }
+    return offset;
+}
+
+int gateway_snapshot_write_internal(const char* snapshot_path, const char* loaders, unsigned int startup_threads, const GATEWAY_SNAPSHOT_MODULE* modules, size_t module_count, const GATEWAY_LINK_ENTRY* links, size_t link_count)
+{
+    int result;
+    size_t tables_size = SNAPSHOT_HEADER_SIZE + module_count * SNAPSHOT_MODULE_SIZE + link_count * SNAPSHOT_LINK_SIZE;
+    size_t size = tables_size + string_size(loaders);
+    for (size_t i = 0; i < module_count; i++)
+    {
+        size += string_size(modules[i].module_name) + string_size(modules[i].loader_name) +
+            string_size(modules[i].entrypoint) + string_size(modules[i].args) + string_size(modules[i].replica.key);
+    }
+    for (size_t i = 0; i < link_count; i++)
+    {
+        size += string_size(links[i].module_source) + string_size(links[i].module_sink);
+    }
+
+    unsigned char* snapshot;
+    if (size > UINT32_MAX)
+    {
+        LogError("The configuration is too large for a snapshot.");
+        result = __LINE__;
+    }
+    else if ((snapshot = (unsigned char*)malloc(size)) == NULL)
+    {
+        LogError("Failed to allocate the snapshot.");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t strings_end = tables_size;
+        unsigned char* record = snapshot + SNAPSHOT_HEADER_SIZE;
+
+        memcpy(snapshot, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+        put_u32(snapshot + 8, SNAPSHOT_VERSION);
+        put_u32(snapshot + 12, (uint32_t)size);
+        put_u32(snapshot + 24, startup_threads);
+        put_u32(snapshot + 28, put_string(snapshot, &strings_end, loaders));
+        put_u32(snapshot + 32, (uint32_t)module_count);
+        put_u32(snapshot + 36, (uint32_t)link_count);
+        for (size_t i = 0; i < module_count; i++, record += SNAPSHOT_MODULE_SIZE)
+        {
+            put_u32(record, put_string(snapshot, &strings_end, modules[i].module_name));
+            put_u32(record + 4, put_string(snapshot, &strings_end, modules[i].loader_name));
+            put_u32(record + 8, put_string(snapshot, &strings_end, modules[i].entrypoint));
+            put_u32(record + 12, put_string(snapshot, &strings_end, modules[i].args));
+            put_u64(record + 16, modules[i].configuration_hash);
+            put_u32(record + 24, (uint32_t)modules[i].replica.count);
+            put_u32(record + 28, (uint32_t)modules[i].replica.index);
+            put_u32(record + 32, put_string(snapshot, &strings_end, modules[i].replica.key));
+        }
+        for (size_t i = 0; i < link_count; i++, record += SNAPSHOT_LINK_SIZE)
+        {
+            put_u32(record, put_string(snapshot, &strings_end, links[i].module_source));
+            put_u32(record + 4, put_string(snapshot, &strings_end, links[i].module_sink));
+        }
+        put_u64(snapshot + SNAPSHOT_CHECKSUM_OFFSET, snapshot_checksum(snapshot, size));
+
+        FILE* file = fopen(snapshot_path, "wb");
+        if (file == NULL)
+        {
+            LogError("Unable to open %s for writing.", snapshot_path);
+            result = __LINE__;
+        }
+        else
+        {
+            bool written = fwrite(snapshot, 1, size, file) == size;
+            if (fclose(file) != 0 || !written)
+            {
+                LogError("Unable to write %s.", snapshot_path);
+                result = __LINE__;
+            }
+            else
+            {
+                result = 0;
+            }
+        }
+        free(snapshot);
+    }
+    return result;
+}
+
+static unsigned char* read_snapshot(const char* snapshot_path, size_t* size)
+{
+    unsigned char* snapshot = NULL;
+    FILE* file = fopen(snapshot_path, "rb");
+    if (file == NULL)
+    {
+        LogError("Unable to open %s.", snapshot_path);
+    }
+    else
+    {
+        long length;
+        if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < SNAPSHOT_HEADER_SIZE || fseek(file, 0, SEEK_SET) != 0)
+        {
+            LogError("%s is not a gateway snapshot.", snapshot_path);
+        }
+        else if ((snapshot = (unsigned char*)malloc((size_t)length)) == NULL)
+        {
+            LogError("Failed to allocate the snapshot.");
+        }
+        else if (fread(snapshot, 1, (size_t)length, file) != (size_t)length)
+        {
+            LogError("Unable to read %s.", snapshot_path);
+            free(snapshot);
+            snapshot = NULL;
+        }
+        else
+        {
+            *size = (size_t)length;
+        }
+        (void)fclose(file);
+    }
+    return snapshot;
+}
+
+static bool is_string(uint32_t offset, size_t strings_start, size_t size, bool optional)
+{
+    return (offset == 0) ? optional : (offset >= strings_start && offset < size);
+}
+
+static bool snapshot_is_valid(const unsigned char* snapshot, size_t size)
+{
+    bool result;
+    if (memcmp(snapshot, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0 ||
+        get_u32(snapshot + 8) != SNAPSHOT_VERSION ||
+        get_u32(snapshot + 12) != size ||
+        get_u64(snapshot + SNAPSHOT_CHECKSUM_OFFSET) != snapshot_checksum(snapshot, size))
+    {
+        LogError("The snapshot is corrupt or was written by another version of the gateway.");
+        result = false;
+    }
+    else
+    {
+        size_t module_count = get_u32(snapshot + 32);
+        size_t link_count = get_u32(snapshot + 36);
+        /* the counts are checked first so that the tables size cannot overflow */
+        size_t strings_start = (module_count > size / SNAPSHOT_MODULE_SIZE || link_count > (size - module_count * SNAPSHOT_MODULE_SIZE) / SNAPSHOT_LINK_SIZE) ? SIZE_MAX :
+            SNAPSHOT_HEADER_SIZE + module_count * SNAPSHOT_MODULE_SIZE + link_count * SNAPSHOT_LINK_SIZE;
+
+        /* the last byte terminates the last string, so every offset in the
+         * string area points at a terminated string */
+        result = strings_start <= size &&
+            snapshot[size - 1] == '\0' &&
+            is_string(get_u32(snapshot + 28), strings_start, size, true);
+
+        const unsigned char* record = snapshot + SNAPSHOT_HEADER_SIZE;
+        for (size_t i = 0; i < module_count && result; i++, record += SNAPSHOT_MODULE_SIZE)
+        {
+            result = is_string(get_u32(record), strings_start, size, false) &&
+                is_string(get_u32(record + 4), strings_start, size, false) &&
+                is_string(get_u32(record + 8), strings_start, size, true) &&
+                is_string(get_u32(record + 12), strings_start, size, true) &&
+                (get_u32(record + 24) <= 1 || get_u32(record + 28) < get_u32(record + 24)) &&
+                is_string(get_u32(record + 32), strings_start, size, true);
+        }
+        for (size_t i = 0; i < link_count && result; i++, record += SNAPSHOT_LINK_SIZE)
+        {
+            result = is_string(get_u32(record), strings_start, size, false) &&
+                is_string(get_u32(record + 4), strings_start, size, false);
+        }
+
+        if (!result)
+        {
+            LogError("The snapshot has a table out of bounds.");
+        }
+    }
+    return result;
+}
+
+static const char* snapshot_string(const unsigned char* snapshot, const unsigned char* field)
+{
+    uint32_t offset = get_u32(field);
+    return (offset == 0) ? NULL : (const char*)(snapshot + offset);
+}
+
+static void free_module_json(SNAPSHOT_MODULE_JSON* module_json)
+{
+    if (module_json->entrypoint != NULL)
+    {
+        json_value_free(module_json->entrypoint);
+    }
+    if (module_json->args != NULL)
+    {
+        json_value_free(module_json->args);
+    }
+}
+
+static void free_module_entries(GATEWAY_PROPERTIES* properties, SNAPSHOT_MODULE_JSON* module_json)
+{
+    size_t entries_count = VECTOR_size(properties->gateway_modules);
+    for (size_t i = 0; i < entries_count; i++)
+    {
+        GATEWAY_MODULES_ENTRY* entry = (GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, i);
+        entry->module_loader_info.loader->api->FreeEntrypoint(entry->module_loader_info.loader, entry->module_loader_info.entrypoint);
+        free_module_json(&module_json[i]);
+    }
+}
+
+/* Fills the properties with strings that point into the snapshot */
+static bool add_snapshot_entries(const unsigned char* snapshot, GATEWAY_PROPERTIES* properties, SNAPSHOT_MODULE_JSON* module_json)
+{
+    bool result = true;
+    size_t module_count = get_u32(snapshot + 32);
+    size_t link_count = get_u32(snapshot + 36);
+    const unsigned char* record = snapshot + SNAPSHOT_HEADER_SIZE;
+
+    for (size_t i = 0; i < module_count && result; i++, record += SNAPSHOT_MODULE_SIZE)
+    {
+        const char* loader_name = snapshot_string(snapshot, record + 4);
+        const char* entrypoint = snapshot_string(snapshot, record + 8);
+        const char* args = snapshot_string(snapshot, record + 12);
+        GATEWAY_JSON_MODULES_ENTRY entry;
+        entry.entry.module_name = snapshot_string(snapshot, record);
+        entry.entry.module_configuration = NULL;
+        entry.module_configuration_json = NULL;
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_014: [ Gateway_CreateFromSnapshot shall give each module entry the replica count, index and key stored in the snapshot. ]*/
+        entry.module_replica.count = get_u32(record + 24);
+        entry.module_replica.index = get_u32(record + 28);
+        entry.module_replica.key = snapshot_string(snapshot, record + 32);
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_010: [ Gateway_CreateFromSnapshot shall find each module's loader by name and parse only the module's entrypoint JSON. ]*/
+        entry.entry.module_loader_info.loader = ModuleLoader_FindByName(loader_name);
+        entry.entry.module_loader_info.entrypoint = NULL;
+        module_json[i].entrypoint = NULL;
+        module_json[i].args = NULL;
+        if (entry.entry.module_loader_info.loader == NULL)
+        {
+            LogError("The snapshot names a loader that does not exist - %s.", loader_name);
+            result = false;
+        }
+        else if (entrypoint != NULL &&
+            ((module_json[i].entrypoint = json_parse_string(entrypoint)) == NULL ||
+            (entry.entry.module_loader_info.entrypoint = entry.entry.module_loader_info.loader->api->ParseEntrypointFromJson(entry.entry.module_loader_info.loader, module_json[i].entrypoint)) == NULL))
+        {
+            LogError("An error occurred when parsing the entrypoint of module %s.", entry.entry.module_name);
+            free_module_json(&module_json[i]);
+            result = false;
+        }
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_015: [ Gateway_CreateFromSnapshot shall parse each module's stored args and hand them to the module as the parsed "args" of a JSON configuration. ]*/
+        else if (args != NULL &&
+            (entry.module_configuration_json = module_json[i].args = json_parse_string(args)) == NULL)
+        {
+            LogError("An error occurred when parsing the args of module %s.", entry.entry.module_name);
+            entry.entry.module_loader_info.loader->api->FreeEntrypoint(entry.entry.module_loader_info.loader, entry.entry.module_loader_info.entrypoint);
+            free_module_json(&module_json[i]);
+            result = false;
+        }
+        else if (VECTOR_push_back(properties->gateway_modules, &entry, 1) != 0)
+        {
+            LogError("Failed to push data into properties vector.");
+            entry.entry.module_loader_info.loader->api->FreeEntrypoint(entry.entry.module_loader_info.loader, entry.entry.module_loader_info.entrypoint);
+            free_module_json(&module_json[i]);
+            result = false;
+        }
+    }
+
+    for (size_t i = 0; i < link_count && result; i++, record += SNAPSHOT_LINK_SIZE)
+    {
+        GATEWAY_LINK_ENTRY entry;
+        entry.module_source = snapshot_string(snapshot, record);
+        entry.module_sink = snapshot_string(snapshot, record + 4);
+        if (VECTOR_push_back(properties->gateway_links, &entry, 1) != 0)
+        {
+            LogError("Failed to push data into links vector.");
+            result = false;
+        }
+    }
+    return result;
+}
+
+static GATEWAY_HANDLE create_from_snapshot(const unsigned char* snapshot)
+{
+    GATEWAY_HANDLE gw = NULL;
+    const char* loaders_json = snapshot_string(snapshot, snapshot + 28);
+    size_t module_count = get_u32(snapshot + 32);
+    JSON_Value* loaders = NULL;
+    SNAPSHOT_MODULE_JSON* module_json;
+    GATEWAY_PROPERTIES properties;
+    unsigned int startup_threads = get_u32(snapshot + 24);
+
+    /*Codes_SRS_GATEWAY_SNAPSHOT_17_009: [ Gateway_CreateFromSnapshot shall initialize the module loaders from the snapshot's "loaders" JSON, if any. ]*/
+    if (loaders_json != NULL &&
+        ((loaders = json_parse_string(loaders_json)) == NULL || ModuleLoader_InitializeFromJson(loaders) != MODULE_LOADER_SUCCESS))
+    {
+        LogError("Failed to initialize the module loaders of the snapshot.");
+    }
+    else if ((module_json = (SNAPSHOT_MODULE_JSON*)malloc((module_count == 0 ? 1 : module_count) * sizeof(SNAPSHOT_MODULE_JSON))) == NULL)
+    {
+        LogError("Failed to allocate the module JSON list.");
+    }
+    else
+    {
+        if ((properties.gateway_modules = VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY))) == NULL)
+        {
+            LogError("Failed to create properties vector.");
+        }
+        else
+        {
+            if ((properties.gateway_links = VECTOR_create(sizeof(GATEWAY_LINK_ENTRY))) == NULL)
+            {
+                LogError("Failed to create links vector.");
+            }
+            else
+            {
+                if (add_snapshot_entries(snapshot, &properties, module_json))
+                {
+                    /*Codes_SRS_GATEWAY_SNAPSHOT_17_011: [ Gateway_CreateFromSnapshot shall create the gateway from the snapshot's modules and links, and shall start it. ]*/
+                    gw = gateway_create_internal(&properties, true, startup_threads);
+                    if (gw == NULL)
+                    {
+                        LogError("Failed to create gateway using lower level library.");
+                    }
+                    else if (Gateway_Start(gw) != GATEWAY_START_SUCCESS)
+                    {
+                        LogError("failed to start gateway");
+                        gateway_destroy_internal(gw);
+                        gw = NULL;
+                    }
+                    else
+                    {
+                        /*Codes_SRS_GATEWAY_SNAPSHOT_17_012: [ Gateway_CreateFromSnapshot shall give each module the configuration hash stored in the snapshot. ]*/
+                        const unsigned char* record = snapshot + SNAPSHOT_HEADER_SIZE;
+                        for (size_t i = 0; i < module_count; i++, record += SNAPSHOT_MODULE_SIZE)
+                        {
+                            MODULE_DATA* module_data = gateway_index_findmodule(gw, snapshot_string(snapshot, record), NULL);
+                            if (module_data != NULL)
+                            {
+                                module_data->configuration_hash = get_u64(record + 16);
+                            }
+                        }
+                    }
+                }
+                /* the modules have parsed their args by now */
+                free_module_entries(&properties, module_json);
+                VECTOR_destroy(properties.gateway_links);
+            }
+            VECTOR_destroy(properties.gateway_modules);
+        }
+        free(module_json);
+    }
+
+    if (loaders != NULL)
+    {
+        json_value_free(loaders);
+    }
+    return gw;
+}
+
+GATEWAY_HANDLE Gateway_CreateFromSnapshot(const char* snapshot_path)
+{
+    GATEWAY_HANDLE gw;
+    unsigned char* snapshot;
+    size_t size;
+
+    /*Codes_SRS_GATEWAY_SNAPSHOT_17_006: [ If snapshot_path is NULL, Gateway_CreateFromSnapshot shall return NULL. ]*/
+    if (snapshot_path == NULL)
+    {
+        LogError("Snapshot path is NULL.");
+        gw = NULL;
+    }
+    /*Codes_SRS_GATEWAY_SNAPSHOT_17_007: [ Gateway_CreateFromSnapshot shall read the snapshot in a single read, and shall return NULL if it cannot be read. ]*/
+    else if ((snapshot = read_snapshot(snapshot_path, &size)) == NULL)
+    {
+        gw = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_GATEWAY_SNAPSHOT_17_008: [ Gateway_CreateFromSnapshot shall return NULL if the snapshot's magic, version, size or checksum do not match, or if any of its tables or strings is out of bounds. ]*/
+        if (!snapshot_is_valid(snapshot, size))
+        {
+            gw = NULL;
+        }
+        else if (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS)
+        {
+            LogError("ModuleLoader_Initialize failed");
+            gw = NULL;
+        }
+        else
+        {
+            gw = create_from_snapshot(snapshot);
+            if (gw == NULL)
+            {
+                /*Codes_SRS_GATEWAY_SNAPSHOT_17_013: [ Upon failure Gateway_CreateFromSnapshot shall destroy the module loader list and return NULL. ]*/
+                ModuleLoader_Destroy();
+            }
+        }
+        free(snapshot);
+    }
+
+    return gw;
+}
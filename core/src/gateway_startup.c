@@ -0,0 +1,463 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/xlogging.h>
+#include <azure_c_shared_utility/threadapi.h>
+#include <azure_c_shared_utility/lock.h>
+
+#include <azure_c_shared_utility/vector.h>
+
+#include "experimental/event_system.h"
+#include "broker.h"
+#include "module_access.h"
+
+#include "gateway_internal.h"
+
+/*
+ * Parallel gateway bring-up.
+ *
+ * Modules are grouped in lanes. Modules in different lanes are created (or
+ * started) at the same time by a small pool of threads; modules in the same
+ * lane are handled one after another, in configuration order. Native modules
+ * loaded from the same library share its globals and so share a lane, while
+ * every module of any other loader shares the lane of its loader, since
+ * language runtimes and module hosts keep process wide state that their
+ * loaders do not guard against concurrent use. The libraries are loaded one
+ * at a time before any module is created, and the native loaders hand out a
+ * single MODULE_LIBRARY_HANDLE per library, so the handle tells them apart.
+ */
+
+#define NO_TASK ((size_t)-1)
+
+typedef void(*STARTUP_TASK_FUNCTION)(void* context, size_t task);
+
+typedef struct STARTUP_LANE_KEY_TAG
+{
+    const MODULE_LOADER* loader;
+    MODULE_LIBRARY_HANDLE library;
+} STARTUP_LANE_KEY;
+
+typedef struct STARTUP_POOL_TAG
+{
+    LOCK_HANDLE lock;
+    size_t next_lane;
+    size_t lane_count;
+    const size_t* lanes;
+    const size_t* next_task;
+    STARTUP_TASK_FUNCTION run;
+    void* context;
+} STARTUP_POOL;
+
+typedef struct STARTUP_MODULE_TAG
+{
+    const GATEWAY_MODULES_ENTRY* entry;
+    MODULE_DATA* module_data;
+    MODULE_LIBRARY_HANDLE module_library_handle;
+    const MODULE_API* module_apis;
+    MODULE_HANDLE module;
+} STARTUP_MODULE;
+
+typedef struct STARTUP_CREATE_CONTEXT_TAG
+{
+    GATEWAY_HANDLE_DATA* gateway_handle;
+    STARTUP_MODULE* modules;
+    bool use_json;
+} STARTUP_CREATE_CONTEXT;
+
+static bool is_native_loader(const MODULE_LOADER* loader)
+{
+    return loader->type == NATIVE || loader->type == NATIVE_STATIC;
+}
+
+static bool same_lane(const STARTUP_LANE_KEY* key, const STARTUP_LANE_KEY* other)
+{
+    bool result;
+    if (!is_native_loader(key->loader))
+    {
+        result = (key->loader == other->loader);
+    }
+    else
+    {
+        /* every native loader of a type shares one set of loaded libraries */
+        result = is_native_loader(other->loader) &&
+            key->loader->type == other->loader->type &&
+            key->library == other->library;
+    }
+    return result;
+}
+
+static size_t build_lanes(const STARTUP_LANE_KEY* keys, size_t count, size_t* lanes, size_t* next_task, size_t* lane_tails)
+{
+    size_t lane_count = 0;
+    for (size_t task = 0; task < count; task++)
+    {
+        size_t lane = lane_count;
+        next_task[task] = NO_TASK;
+        for (size_t other = 0; other < lane_count; other++)
+        {
+            if (same_lane(&(keys[lanes[other]]), &(keys[task])))
+            {
+                lane = other;
+                break;
+            }
+        }
+
+        if (lane == lane_count)
+        {
+            lanes[lane_count] = task;
+            lane_tails[lane_count] = task;
+            lane_count++;
+        }
+        else
+        {
+            next_task[lane_tails[lane]] = task;
+            lane_tails[lane] = task;
+        }
+    }
+    return lane_count;
+}
+
+static int startup_worker(void* param)
+{
+    STARTUP_POOL* pool = (STARTUP_POOL*)param;
+    bool done = false;
+    while (!done)
+    {
+        size_t lane;
+        if (pool->lock != NULL && Lock(pool->lock) != LOCK_OK)
+        {
+            LogError("unable to lock the startup pool");
+            done = true;
+        }
+        else
+        {
+            lane = pool->next_lane;
+            if (lane < pool->lane_count)
+            {
+                pool->next_lane++;
+            }
+            if (pool->lock != NULL)
+            {
+                (void)Unlock(pool->lock);
+            }
+
+            if (lane >= pool->lane_count)
+            {
+                done = true;
+            }
+            else
+            {
+                for (size_t task = pool->lanes[lane]; task != NO_TASK; task = pool->next_task[task])
+                {
+                    pool->run(pool->context, task);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void run_lanes(unsigned int threads, const STARTUP_LANE_KEY* keys, size_t count, STARTUP_TASK_FUNCTION run, void* context)
+{
+    size_t* lanes = (size_t*)malloc(3 * (count + 1) * sizeof(size_t));
+    THREAD_HANDLE* workers = (THREAD_HANDLE*)malloc((((threads < count) ? threads : count) + 1) * sizeof(THREAD_HANDLE));
+    if (lanes == NULL || workers == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_028: [ If the threads cannot be set up, the modules shall be brought up one at a time on the calling thread. ]*/
+        LogError("unable to allocate the startup schedule, bringing modules up one at a time");
+        for (size_t task = 0; task < count; task++)
+        {
+            run(context, task);
+        }
+    }
+    else
+    {
+        STARTUP_POOL pool;
+        size_t worker_count = 0;
+        pool.next_lane = 0;
+        pool.lanes = lanes;
+        pool.next_task = lanes + count;
+        pool.lane_count = build_lanes(keys, count, lanes, lanes + count, lanes + 2 * count);
+        pool.run = run;
+        pool.context = context;
+        pool.lock = (pool.lane_count > 1) ? Lock_Init() : NULL;
+
+        if (pool.lock != NULL)
+        {
+            /*Codes_SRS_GATEWAY_17_024: [ Modules shall be handed to the threads in lanes: native modules share a lane when they are loaded from the same library, every module of any other loader shares the lane of its loader. ]*/
+            /*Codes_SRS_GATEWAY_17_025: [ The modules of a lane shall be handled one after another, in configuration order. ]*/
+            size_t wanted = (threads < pool.lane_count) ? threads : pool.lane_count;
+            while (worker_count + 1 < wanted)
+            {
+                if (ThreadAPI_Create(&(workers[worker_count]), startup_worker, &pool) != THREADAPI_OK)
+                {
+                    /*Codes_SRS_GATEWAY_17_028: [ If the threads cannot be set up, the modules shall be brought up one at a time on the calling thread. ]*/
+                    LogError("unable to create a startup thread, continuing with the threads already running");
+                    break;
+                }
+                worker_count++;
+            }
+        }
+
+        /*Codes_SRS_GATEWAY_17_026: [ The calling thread shall take part in the work and join every thread it started before returning. ]*/
+        (void)startup_worker(&pool);
+        for (size_t worker = 0; worker < worker_count; worker++)
+        {
+            int thread_result;
+            if (ThreadAPI_Join(workers[worker], &thread_result) != THREADAPI_OK)
+            {
+                LogError("unable to join startup thread");
+            }
+        }
+
+        if (pool.lock != NULL)
+        {
+            (void)Lock_Deinit(pool.lock);
+        }
+    }
+    free(workers);
+    free(lanes);
+}
+
+static void create_one_module(void* context, size_t task)
+{
+    STARTUP_CREATE_CONTEXT* create = (STARTUP_CREATE_CONTEXT*)context;
+    STARTUP_MODULE* module = &(create->modules[task]);
+    module->module = gateway_createmodule_internal(
+        create->gateway_handle,
+        module->entry,
+        create->use_json,
+        module->module_data,
+        module->module_library_handle,
+        &(module->module_apis));
+}
+
+static bool entry_name_is_repeated(VECTOR_HANDLE module_entries, size_t index)
+{
+    bool result = false;
+    const GATEWAY_MODULES_ENTRY* entry = (const GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, index);
+    for (size_t earlier = 0; earlier < index && !result; earlier++)
+    {
+        const GATEWAY_MODULES_ENTRY* other = (const GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, earlier);
+        result = (strcmp(other->module_name, entry->module_name) == 0);
+    }
+    return result;
+}
+
+int gateway_addmodules_parallel_internal(GATEWAY_HANDLE_DATA* gateway_handle, VECTOR_HANDLE module_entries, bool use_json)
+{
+    int result;
+    size_t count = VECTOR_size(module_entries);
+    STARTUP_MODULE* modules = (STARTUP_MODULE*)calloc(count, sizeof(STARTUP_MODULE));
+    STARTUP_LANE_KEY* keys = (STARTUP_LANE_KEY*)malloc(count * sizeof(STARTUP_LANE_KEY));
+    if (modules == NULL || keys == NULL)
+    {
+        LogError("unable to allocate the module startup schedule");
+        result = __LINE__;
+    }
+    else
+    {
+        size_t index;
+        size_t loaded = 0;
+        result = 0;
+
+        /*Codes_SRS_GATEWAY_17_027: [ Every entry shall be checked, its MODULE_DATA allocated and its library loaded, one at a time, before any module is created. ]*/
+        for (index = 0; index < count; index++)
+        {
+            modules[index].entry = (const GATEWAY_MODULES_ENTRY*)VECTOR_element(module_entries, index);
+            if (!gateway_checkmodule_internal(gateway_handle, modules[index].entry))
+            {
+                result = __LINE__;
+                break;
+            }
+            else if (entry_name_is_repeated(module_entries, index))
+            {
+                /*Codes_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
+                LogError("Error to add module. Duplicated module name: %s", modules[index].entry->module_name);
+                result = __LINE__;
+                break;
+            }
+        }
+
+        /* nothing is loaded until every entry has been checked */
+        for (index = 0; result == 0 && index < count; index++)
+        {
+            if ((modules[index].module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA))) == NULL)
+            {
+                LogError("Failed to add module because it could not allocate memory.");
+                result = __LINE__;
+            }
+            /*Codes_SRS_GATEWAY_14_012: [The function shall load the module located at GATEWAY_MODULES_ENTRY's module_path into a MODULE_LIBRARY_HANDLE. ]*/
+            else if ((modules[index].module_library_handle = modules[index].entry->module_loader_info.loader->api->Load(
+                modules[index].entry->module_loader_info.loader,
+                modules[index].entry->module_loader_info.entrypoint)) == NULL)
+            {
+                /*Codes_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+                LogError("Failed to add module because the module could not be loaded.");
+                free(modules[index].module_data);
+                result = __LINE__;
+            }
+            else
+            {
+                keys[index].loader = modules[index].entry->module_loader_info.loader;
+                keys[index].library = modules[index].module_library_handle;
+                loaded++;
+            }
+        }
+
+        if (result != 0)
+        {
+            while (loaded > 0)
+            {
+                loaded--;
+                modules[loaded].entry->module_loader_info.loader->api->Unload(modules[loaded].entry->module_loader_info.loader, modules[loaded].module_library_handle);
+                free(modules[loaded].module_data);
+            }
+        }
+        else
+        {
+            STARTUP_CREATE_CONTEXT context;
+            context.gateway_handle = gateway_handle;
+            context.modules = modules;
+            context.use_json = use_json;
+
+            /*Codes_SRS_GATEWAY_17_023: [ If the gateway's startup_threads is greater than one, the function shall create the modules concurrently on up to startup_threads threads. ]*/
+            run_lanes(gateway_handle->startup_threads, keys, count, create_one_module, &context);
+
+            /*Codes_SRS_GATEWAY_17_029: [ Created modules shall be attached to the broker one at a time, in configuration order. ]*/
+            for (index = 0; index < count; index++)
+            {
+                STARTUP_MODULE* module = &(modules[index]);
+                if (module->module == NULL)
+                {
+                    /* gateway_createmodule_internal has already released everything */
+                    result = __LINE__;
+                }
+                else if (result != 0)
+                {
+                    /*Codes_SRS_GATEWAY_17_030: [ If any module cannot be created or attached, every module created but not yet attached shall be destroyed and its library unloaded. ]*/
+                    MODULE_DESTROY(module->module_apis)(module->module);
+                    module->entry->module_loader_info.loader->api->Unload(module->entry->module_loader_info.loader, module->module_library_handle);
+                    free(module->module_data);
+                }
+                else if (gateway_attachmodule_internal(gateway_handle, module->entry, use_json, module->module_data, module->module_library_handle, module->module_apis, module->module) == NULL)
+                {
+                    result = __LINE__;
+                }
+            }
+        }
+    }
+
+    free(keys);
+    free(modules);
+    return result;
+}
+
+static bool module_sends_to_pending(GATEWAY_HANDLE_DATA* gateway_handle, const MODULE_DATA* module, const bool* started)
+{
+    bool result = false;
+    size_t link_count = VECTOR_size(gateway_handle->links);
+    for (size_t l = 0; l < link_count && !result; l++)
+    {
+        LINK_DATA* link = (LINK_DATA*)VECTOR_element(gateway_handle->links, l);
+        size_t sink;
+        if (link->module_sink != module && (link->from_any_source || link->module_source == module) &&
+            gateway_index_findmodule(gateway_handle, link->module_sink->module_name, &sink) != NULL)
+        {
+            result = !started[sink];
+        }
+    }
+    return result;
+}
+
+static void start_one_module(void* context, size_t task)
+{
+    MODULE_DATA* module_data = ((MODULE_DATA**)context)[task];
+    pfModule_Start pfStart = MODULE_START(module_data->module_loader->api->GetApi(module_data->module_loader, module_data->module_library_handle));
+    if (pfStart != NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_010: [ This function shall call Module_Start for every module which defines the start function. ]*/
+        (pfStart)(module_data->module);
+    }
+}
+
+void gateway_startmodules_parallel_internal(GATEWAY_HANDLE_DATA* gateway_handle)
+{
+    size_t module_count = VECTOR_size(gateway_handle->modules);
+    bool* started = (bool*)calloc(module_count + 1, sizeof(bool));
+    bool* ready = (bool*)calloc(module_count + 1, sizeof(bool));
+    MODULE_DATA** wave = (MODULE_DATA**)malloc((module_count + 1) * sizeof(MODULE_DATA*));
+    STARTUP_LANE_KEY* keys = (STARTUP_LANE_KEY*)malloc((module_count + 1) * sizeof(STARTUP_LANE_KEY));
+    if (started == NULL || ready == NULL || wave == NULL || keys == NULL)
+    {
+        /*Codes_SRS_GATEWAY_17_028: [ If the threads cannot be set up, the modules shall be brought up one at a time on the calling thread. ]*/
+        LogError("unable to allocate the start schedule, starting modules one at a time");
+        for (size_t m = 0; m < module_count; m++)
+        {
+            start_one_module(VECTOR_element(gateway_handle->modules, m), 0);
+        }
+    }
+    else
+    {
+        size_t remaining = module_count;
+        while (remaining > 0)
+        {
+            size_t wave_size = 0;
+
+            /*Codes_SRS_GATEWAY_17_031: [ A module shall be started only after every module it has a link to, so that no module receives messages before it is started. ]*/
+            for (size_t m = 0; m < module_count; m++)
+            {
+                MODULE_DATA* module_data = *(MODULE_DATA**)VECTOR_element(gateway_handle->modules, m);
+                ready[m] = !started[m] && !module_sends_to_pending(gateway_handle, module_data, started);
+            }
+
+            for (size_t m = 0; m < module_count; m++)
+            {
+                if (ready[m])
+                {
+                    wave[wave_size] = *(MODULE_DATA**)VECTOR_element(gateway_handle->modules, m);
+                    keys[wave_size].loader = wave[wave_size]->module_loader;
+                    keys[wave_size].library = wave[wave_size]->module_library_handle;
+                    wave_size++;
+                }
+            }
+
+            if (wave_size == 0)
+            {
+                /*Codes_SRS_GATEWAY_17_032: [ If every module left has a link to another module left, the links form a cycle and the modules left shall be started together. ]*/
+                for (size_t m = 0; m < module_count; m++)
+                {
+                    if (!started[m])
+                    {
+                        ready[m] = true;
+                        wave[wave_size] = *(MODULE_DATA**)VECTOR_element(gateway_handle->modules, m);
+                        keys[wave_size].loader = wave[wave_size]->module_loader;
+                        keys[wave_size].library = wave[wave_size]->module_library_handle;
+                        wave_size++;
+                    }
+                }
+            }
+
+            /*Codes_SRS_GATEWAY_17_033: [ The modules of one step shall be started concurrently on up to startup_threads threads. ]*/
+            run_lanes(gateway_handle->startup_threads, keys, wave_size, start_one_module, wave);
+
+            for (size_t m = 0; m < module_count; m++)
+            {
+                if (ready[m])
+                {
+                    started[m] = true;
+                    remaining--;
+                }
+            }
+        }
+    }
+    free(keys);
+    free(wave);
+    free(ready);
+    free(started);
+}
@@ -0,0 +1,561 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <azure_c_shared_utility/gballoc.h>
+#include <azure_c_shared_utility/xlogging.h>
+
+#include <azure_c_shared_utility/vector.h>
+
+#include "broker.h"
+#include "module_access.h"
+
+#include "gateway_internal.h"
+
+/*
+ * Applies a GATEWAY_PROPERTIES document to a running gateway as a diff.
+ *
+ * Modules whose configuration hash matches the running module of the same
+ * name, and links that already exist, are left alone. Everything the update
+ * needs is created before the running topology is touched, so a failure
+ * leaves the gateway as it was. A reconfigured module is swapped make before
+ * break: the replacement joins the broker with the links of the running
+ * module, then the running module leaves, so no message between unchanged
+ * modules is dropped. The running MODULE_DATA takes over the replacement, so
+ * the links and the indexes that point at it stay valid.
+ */
+
+typedef struct UPDATE_MODULE_TAG
+{
+    const GATEWAY_MODULES_ENTRY* entry;
+    uint64_t configuration_hash;
+
+    /** @brief  Module of the same name running before the update, or NULL */
+    MODULE_DATA* running;
+
+    /** @brief  Whether a new instance was created for this entry */
+    bool created;
+
+    /** @brief  Whether the replacement is on the broker next to 'running' */
+    bool wired;
+
+    MODULE_DATA* module_data;
+    MODULE_LIBRARY_HANDLE module_library_handle;
+    const MODULE_API* module_apis;
+    MODULE_HANDLE module;
+} UPDATE_MODULE;
+
+typedef struct GATEWAY_UPDATE_TAG
+{
+    GATEWAY_HANDLE_DATA* gateway_handle;
+    UPDATE_MODULE* modules;
+    size_t module_count;
+} GATEWAY_UPDATE;
+
+static bool entry_name_is_repeated(const GATEWAY_UPDATE* update, size_t index)
+{
+    bool result = false;
+    for (size_t i = 0; i < index; i++)
+    {
+        if (strcmp(update->modules[i].entry->module_name, update->modules[index].entry->module_name) == 0)
+        {
+            result = true;
+            break;
+        }
+    }
+    return result;
+}
+
+static MODULE_HANDLE pending_replacement(const GATEWAY_UPDATE* update, const MODULE_DATA* module)
+{
+    MODULE_HANDLE result = NULL;
+    for (size_t i = 0; i < update->module_count; i++)
+    {
+        if (update->modules[i].wired && update->modules[i].running == module)
+        {
+            result = update->modules[i].module;
+            break;
+        }
+    }
+    return result;
+}
+
+static int change_one_link(GATEWAY_HANDLE_DATA* gateway_handle, MODULE_HANDLE source, MODULE_HANDLE sink, bool add)
+{
+    int result;
+    BROKER_LINK_DATA broker_link_entry =
+    {
+        source,
+        sink
+    };
+    if (add)
+    {
+        if (Broker_AddLink(gateway_handle->broker, &broker_link_entry) != BROKER_OK)
+        {
+            LogError("Could not add link to broker [%p] -> [%p]", source, sink);
+            result = __LINE__;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    else
+    {
+        if (Broker_RemoveLink(gateway_handle->broker, &broker_link_entry) != BROKER_OK)
+        {
+            LogError("Could not remove link from broker [%p] -> [%p]", source, sink);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+/* Adds or removes the broker links between 'handle', standing in for
+ * 'module', and every handle of 'other': its current one and, while it is
+ * being swapped, its replacement. */
+static int change_pair(const GATEWAY_UPDATE* update, const MODULE_DATA* module, MODULE_HANDLE handle, const MODULE_DATA* other, bool module_is_source, bool add)
+{
+    int result;
+    if (other == module)
+    {
+        result = change_one_link(update->gateway_handle, handle, handle, add);
+    }
+    else
+    {
+        MODULE_HANDLE replacement = pending_replacement(update, other);
+        result = module_is_source ?
+            change_one_link(update->gateway_handle, handle, other->module, add) :
+            change_one_link(update->gateway_handle, other->module, handle, add);
+        if (result == 0 && replacement != NULL)
+        {
+            result = module_is_source ?
+                change_one_link(update->gateway_handle, handle, replacement, add) :
+                change_one_link(update->gateway_handle, replacement, handle, add);
+        }
+    }
+    return result;
+}
+
+/* Gives 'handle' the broker links that the gateway's links give 'module' */
+static int change_module_links(const GATEWAY_UPDATE* update, const MODULE_DATA* module, MODULE_HANDLE handle, bool add)
+{
+    int result = 0;
+    GATEWAY_HANDLE_DATA* gateway_handle = update->gateway_handle;
+    size_t link_count = VECTOR_size(gateway_handle->links);
+    for (size_t l = 0; l < link_count && result == 0; l++)
+    {
+        LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, l);
+        if (link_data->from_any_source && link_data->module_sink == module)
+        {
+            size_t module_count = VECTOR_size(gateway_handle->modules);
+            for (size_t m = 0; m < module_count && result == 0; m++)
+            {
+                MODULE_DATA* source = *(MODULE_DATA**)VECTOR_element(gateway_handle->modules, m);
+                if (source != module)
+                {
+                    result = change_pair(update, module, handle, source, false, add);
+                }
+            }
+        }
+        else if (link_data->from_any_source || link_data->module_source == module)
+        {
+            result = change_pair(update, module, handle, link_data->module_sink, true, add);
+        }
+        else if (link_data->module_sink == module)
+        {
+            result = change_pair(update, module, handle, link_data->module_source, false, add);
+        }
+    }
+    return result;
+}
+
+static void destroy_created_module(UPDATE_MODULE* update_module)
+{
+    const MODULE_LOADER* loader = update_module->entry->module_loader_info.loader;
+    MODULE_DESTROY(update_module->module_apis)(update_module->module);
+    loader->api->Unload(loader, update_module->module_library_handle);
+    if (update_module->module_data != NULL)
+    {
+        free(update_module->module_data);
+    }
+    update_module->created = false;
+}
+
+static int wire_replacement(GATEWAY_UPDATE* update, UPDATE_MODULE* update_module)
+{
+    int result;
+    MODULE module;
+    module.module_apis = update_module->module_apis;
+    module.module_handle = update_module->module;
+
+    if (gateway_brokeraddmodule_internal(update->gateway_handle->broker, &module, update_module->entry, true) != BROKER_OK)
+    {
+        LogError("Failed to add the replacement of module %s to the broker.", update_module->entry->module_name);
+        result = __LINE__;
+    }
+    else
+    {
+        Broker_IncRef(update->gateway_handle->broker);
+        if (change_module_links(update, update_module->running, update_module->module, true) != 0)
+        {
+            LogError("Failed to link the replacement of module %s.", update_module->entry->module_name);
+            (void)change_module_links(update, update_module->running, update_module->module, false);
+            if (Broker_RemoveModule(update->gateway_handle->broker, &module) != BROKER_OK)
+            {
+                LogError("Failed to remove module [%p] from the gateway message broker.", update_module->module);
+            }
+            Broker_DecRef(update->gateway_handle->broker);
+            result = __LINE__;
+        }
+        else
+        {
+            update_module->wired = true;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+static void unwire_replacement(GATEWAY_UPDATE* update, UPDATE_MODULE* update_module)
+{
+    MODULE module;
+    module.module_apis = update_module->module_apis;
+    module.module_handle = update_module->module;
+
+    update_module->wired = false;
+    (void)change_module_links(update, update_module->running, update_module->module, false);
+    if (Broker_RemoveModule(update->gateway_handle->broker, &module) != BROKER_OK)
+    {
+        LogError("Failed to remove module [%p] from the gateway message broker.", update_module->module);
+    }
+    Broker_DecRef(update->gateway_handle->broker);
+}
+
+/* Retires the running module and moves its replacement into its MODULE_DATA */
+static void swap_replacement(GATEWAY_UPDATE* update, UPDATE_MODULE* update_module)
+{
+    MODULE_DATA* running = update_module->running;
+    MODULE module;
+    module.module_apis = NULL;
+    module.module_handle = running->module;
+
+    (void)change_module_links(update, running, running->module, false);
+    if (Broker_RemoveModule(update->gateway_handle->broker, &module) != BROKER_OK)
+    {
+        LogError("Failed to remove module [%p] from the gateway message broker.", running->module);
+    }
+    Broker_DecRef(update->gateway_handle->broker);
+
+    MODULE_DESTROY(running->module_loader->api->GetApi(running->module_loader, running->module_library_handle))(running->module);
+    running->module_loader->api->Unload(running->module_loader, running->module_library_handle);
+
+    running->module = update_module->module;
+    running->module_library_handle = update_module->module_library_handle;
+    running->module_loader = update_module->entry->module_loader_info.loader;
+    running->configuration_hash = update_module->configuration_hash;
+    update_module->wired = false;
+    update_module->created = false;
+}
+
+static void start_module(UPDATE_MODULE* update_module)
+{
+    pfModule_Start pfStart = MODULE_START(update_module->module_apis);
+    if (pfStart != NULL)
+    {
+        (pfStart)(update_module->module);
+    }
+}
+
+static int create_modules(GATEWAY_UPDATE* update)
+{
+    int result = 0;
+    for (size_t i = 0; i < update->module_count && result == 0; i++)
+    {
+        UPDATE_MODULE* update_module = &(update->modules[i]);
+        if (entry_name_is_repeated(update, i))
+        {
+            LogError("Module %s appears more than once in the update.", update_module->entry->module_name);
+            result = __LINE__;
+        }
+        /*Codes_SRS_GATEWAY_JSON_17_017: [ A module whose name and configuration match a running module shall be left running untouched. ]*/
+        else if (update_module->running != NULL &&
+            update_module->configuration_hash != 0 &&
+            update_module->running->configuration_hash == update_module->configuration_hash)
+        {
+            update_module->created = false;
+        }
+        else if (update_module->running == NULL ?
+            !gateway_checkmodule_internal(update->gateway_handle, update_module->entry) :
+            !gateway_checkentry_internal(update->gateway_handle, update_module->entry))
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            /* a replacement moves into the MODULE_DATA of the running module */
+            if (update_module->running == NULL)
+            {
+                update_module->module_data = (MODULE_DATA*)malloc(sizeof(MODULE_DATA));
+            }
+
+            if (update_module->running == NULL && update_module->module_data == NULL)
+            {
+                LogError("Failed to allocate MODULE_DATA for module %s.", update_module->entry->module_name);
+                result = __LINE__;
+            }
+            else
+            {
+                /*Codes_SRS_GATEWAY_JSON_17_018: [ A module whose name matches a running module but whose configuration differs shall be replaced by a new instance. ]*/
+                update_module->module = gateway_loadmodule_internal(update->gateway_handle, update_module->entry, true,
+                    update_module->module_data, &(update_module->module_library_handle), &(update_module->module_apis));
+                if (update_module->module == NULL)
+                {
+                    update_module->module_data = NULL;
+                    LogError("Failed to create module %s.", update_module->entry->module_name);
+                    result = __LINE__;
+                }
+                else
+                {
+                    update_module->created = true;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+static int attach_modules(GATEWAY_UPDATE* update)
+{
+    int result = 0;
+    for (size_t i = 0; i < update->module_count && result == 0; i++)
+    {
+        UPDATE_MODULE* update_module = &(update->modules[i]);
+        if (update_module->created && update_module->running == NULL)
+        {
+            MODULE_DATA* module_data = update_module->module_data;
+            update_module->created = false;
+            update_module->module_data = NULL;
+            if (gateway_attachmodule_internal(update->gateway_handle, update_module->entry, true, module_data,
+                update_module->module_library_handle, update_module->module_apis, update_module->module) == NULL)
+            {
+                LogError("Failed to attach module %s.", update_module->entry->module_name);
+                result = __LINE__;
+            }
+            else
+            {
+                module_data->configuration_hash = update_module->configuration_hash;
+            }
+        }
+    }
+    return result;
+}
+
+static int add_links(GATEWAY_UPDATE* update, const GATEWAY_PROPERTIES* properties, bool* keep_links)
+{
+    int result = 0;
+    if (properties->gateway_links != NULL)
+    {
+        size_t entries_count = VECTOR_size(properties->gateway_links);
+        for (size_t i = 0; i < entries_count && result == 0; i++)
+        {
+            GATEWAY_LINK_ENTRY* entry = (GATEWAY_LINK_ENTRY*)VECTOR_element(properties->gateway_links, i);
+            size_t position = gateway_index_findlink(update->gateway_handle, entry);
+            /*Codes_SRS_GATEWAY_JSON_17_019: [ A link that already exists shall be left untouched. ]*/
+            if (position != GATEWAY_INDEX_NOT_FOUND)
+            {
+                if (keep_links != NULL)
+                {
+                    keep_links[position] = true;
+                }
+            }
+            else if (!gateway_addlink_internal(update->gateway_handle, entry))
+            {
+                LogError("Unable to add link from '%s' to '%s'.", entry->module_source, entry->module_sink);
+                result = __LINE__;
+            }
+        }
+    }
+    return result;
+}
+
+static void roll_back(GATEWAY_UPDATE* update, size_t module_count, size_t link_count)
+{
+    GATEWAY_HANDLE_DATA* gateway_handle = update->gateway_handle;
+
+    for (size_t i = update->module_count; i > 0; i--)
+    {
+        if (update->modules[i - 1].wired)
+        {
+            unwire_replacement(update, &(update->modules[i - 1]));
+        }
+    }
+
+    /* the update only appends to the links and modules vectors */
+    while (VECTOR_size(gateway_handle->links) > link_count)
+    {
+        gateway_removelink_internal(gateway_handle, (LINK_DATA*)VECTOR_back(gateway_handle->links));
+    }
+    while (VECTOR_size(gateway_handle->modules) > module_count)
+    {
+        gateway_removemodule_internal(gateway_handle, (MODULE_DATA**)VECTOR_back(gateway_handle->modules));
+    }
+
+    for (size_t i = 0; i < update->module_count; i++)
+    {
+        if (update->modules[i].created)
+        {
+            destroy_created_module(&(update->modules[i]));
+        }
+    }
+}
+
+static bool remove_stale(GATEWAY_UPDATE* update, const bool* keep_modules, size_t module_count, const bool* keep_links, size_t link_count)
+{
+    GATEWAY_HANDLE_DATA* gateway_handle = update->gateway_handle;
+    bool removed_modules = false;
+
+    /* from the back, so the positions still to visit do not move */
+    for (size_t l = link_count; l > 0; l--)
+    {
+        if (!keep_links[l - 1])
+        {
+            LINK_DATA* link_data = (LINK_DATA*)VECTOR_element(gateway_handle->links, l - 1);
+            size_t sink_position;
+            /*Codes_SRS_GATEWAY_JSON_17_038: [ The update shall leave the links into a module it removes for the module's removal, so that the module drains the messages queued for it. ]*/
+            if (gateway_index_findmodule(gateway_handle, link_data->module_sink->module_name, &sink_position) == NULL ||
+                sink_position >= module_count ||
+                keep_modules[sink_position])
+            {
+                gateway_removelink_internal(gateway_handle, link_data);
+            }
+        }
+    }
+    for (size_t m = module_count; m > 0; m--)
+    {
+        if (!keep_modules[m - 1])
+        {
+            gateway_removemodule_internal(gateway_handle, (MODULE_DATA**)VECTOR_element(gateway_handle->modules, m - 1));
+            removed_modules = true;
+        }
+    }
+    return removed_modules;
+}
+
+int gateway_update_internal(GATEWAY_HANDLE_DATA* gateway_handle, const GATEWAY_PROPERTIES* properties, const uint64_t* configuration_hashes, bool replace, bool* modules_changed)
+{
+    int result;
+    GATEWAY_UPDATE update;
+    size_t module_count = VECTOR_size(gateway_handle->modules);
+    size_t link_count = VECTOR_size(gateway_handle->links);
+    bool* keep = NULL;
+
+    *modules_changed = false;
+    update.gateway_handle = gateway_handle;
+    update.modules = NULL;
+    update.module_count = (properties->gateway_modules == NULL) ? 0 : VECTOR_size(properties->gateway_modules);
+
+    if (update.module_count > 0 &&
+        (update.modules = (UPDATE_MODULE*)malloc(update.module_count * sizeof(UPDATE_MODULE))) == NULL)
+    {
+        LogError("Failed to allocate the module update list.");
+        result = __LINE__;
+    }
+    else if (replace && module_count + link_count > 0 &&
+        (keep = (bool*)malloc((module_count + link_count) * sizeof(bool))) == NULL)
+    {
+        LogError("Failed to allocate the list of modules and links to keep.");
+        result = __LINE__;
+    }
+    else
+    {
+        bool* keep_modules = keep;
+        bool* keep_links = (keep == NULL) ? NULL : keep + module_count;
+        if (keep != NULL)
+        {
+            memset(keep, 0, (module_count + link_count) * sizeof(bool));
+        }
+
+        for (size_t i = 0; i < update.module_count; i++)
+        {
+            UPDATE_MODULE* update_module = &(update.modules[i]);
+            size_t position;
+            memset(update_module, 0, sizeof(UPDATE_MODULE));
+            update_module->entry = (const GATEWAY_MODULES_ENTRY*)VECTOR_element(properties->gateway_modules, i);
+            update_module->configuration_hash = configuration_hashes[i];
+            update_module->running = gateway_index_findmodule(gateway_handle, update_module->entry->module_name, &position);
+            if (update_module->running != NULL && keep_modules != NULL)
+            {
+                keep_modules[position] = true;
+            }
+        }
+
+        /*Codes_SRS_GATEWAY_JSON_17_020: [ The function shall create every new and replacement module before it changes the running gateway, and shall leave the gateway unchanged if any of them fails. ]*/
+        if (create_modules(&update) != 0 ||
+            attach_modules(&update) != 0 ||
+            add_links(&update, properties, keep_links) != 0)
+        {
+            roll_back(&update, module_count, link_count);
+            result = __LINE__;
+        }
+        else
+        {
+            /*Codes_SRS_GATEWAY_JSON_17_021: [ A replacement module shall be added to the broker with the links of the module it replaces before that module is removed. ]*/
+            result = 0;
+            for (size_t i = 0; i < update.module_count && result == 0; i++)
+            {
+                if (update.modules[i].created && wire_replacement(&update, &(update.modules[i])) != 0)
+                {
+                    roll_back(&update, module_count, link_count);
+                    result = __LINE__;
+                }
+            }
+
+            if (result == 0)
+            {
+                *modules_changed = VECTOR_size(gateway_handle->modules) > module_count;
+
+                /*Codes_SRS_GATEWAY_JSON_17_022: [ If the gateway has been started, the function shall start each new and replacement module once it is linked. ]*/
+                if (gateway_handle->started)
+                {
+                    for (size_t i = 0; i < update.module_count; i++)
+                    {
+                        if (update.modules[i].wired || (update.modules[i].running == NULL && update.modules[i].module != NULL))
+                        {
+                            start_module(&(update.modules[i]));
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < update.module_count; i++)
+                {
+                    if (update.modules[i].wired)
+                    {
+                        swap_replacement(&update, &(update.modules[i]));
+                        *modules_changed = true;
+                    }
+                }
+
+                /*Codes_SRS_GATEWAY_JSON_17_023: [ Gateway_ReplaceFromJson shall remove every link and then every module that is not in the document, after the new modules and links are in place. ]*/
+                if (keep != NULL && remove_stale(&update, keep_modules, module_count, keep_links, link_count))
+                {
+                    *modules_changed = true;
+                }
+            }
+        }
+    }
+
+    if (keep != NULL)
+    {
+        free(keep);
+    }
+    if (update.modules != NULL)
+    {
+        free(update.modules);
+    }
+    return result;
+}
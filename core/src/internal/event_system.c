@@ -3,61 +3,90 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/condition.h"
-#include "azure_c_shared_utility/singlylinkedlist.h"
+#include "azure_c_shared_utility/refcount.h"
 
 #include "gateway.h"
+#include "message.h"
 #include "experimental/event_system.h"
 
 #include <assert.h>
 #include <stdlib.h>
 
-struct EVENTSYSTEM_DATA {
-    VECTOR_HANDLE event_callbacks[GATEWAY_EVENTS_COUNT];
-    /* Should some callback or thread creation fail all next event reports will be no-op */
-    int is_errored;
-    /* @brief Decides whether the thread should have delayed shutdown or not */
-    int delay_when_queue_empty;
-
-    THREAD_HANDLE callback_thread;
-    // The last thread that quit already and needs cleaning up of the handle
-    THREAD_HANDLE destroyed_thread;
-    LOCK_HANDLE internal_change_lock;
-    LOCK_HANDLE thread_queue_lock;
-    COND_HANDLE thread_queue_condition;
-    SINGLYLINKEDLIST_HANDLE thread_queue;
-};
-
 typedef struct CALLBACK_CLOSURE_TAG {
     GATEWAY_CALLBACK call;
     void* user_param;
 } CALLBACK_CLOSURE;
 
-typedef struct THREAD_QUEUE_ROW_TAG {
+/** @brief The callbacks of one event. A snapshot is never changed once it is
+ *         published, adding a callback publishes a new one instead */
+typedef struct CALLBACK_SNAPSHOT_TAG {
+    /* VECTOR of CALLBACK_CLOSURE */
+    VECTOR_HANDLE callbacks;
+} CALLBACK_SNAPSHOT;
+
+DEFINE_REFCOUNT_TYPE(CALLBACK_SNAPSHOT);
+
+typedef void(*EVENT_CONTEXT_DESTROY)(GATEWAY_EVENT_CTX context);
+
+typedef struct EVENT_QUEUE_ROW_TAG {
     GATEWAY_HANDLE gateway;
     GATEWAY_EVENT event_type;
-    VECTOR_HANDLE callbacks;
+    CALLBACK_SNAPSHOT* callbacks;
     GATEWAY_EVENT_CTX context;
-} THREAD_QUEUE_ROW;
+    /* Called once every callback saw the context, NULL when there is nothing to destroy */
+    EVENT_CONTEXT_DESTROY destroy_context;
+} EVENT_QUEUE_ROW;
+
+struct EVENTSYSTEM_DATA {
+    /* The current snapshot of each event, NULL until a callback is added, guarded by internal_change_lock */
+    CALLBACK_SNAPSHOT* event_callbacks[GATEWAY_EVENTS_COUNT];
+    /* Should the dispatcher thread fail to be created all next event reports will be no-op */
+    int is_errored;
+    /* @brief Set when destroying, the dispatcher empties the queue and exits instead of waiting */
+    int is_stopping;
+
+    /* Delivers the events, created with the first event and kept until the event system is destroyed */
+    THREAD_HANDLE dispatcher_thread;
+    LOCK_HANDLE internal_change_lock;
+    LOCK_HANDLE event_queue_lock;
+    COND_HANDLE event_queue_condition;
+
+    /* Ring buffer of reported events, guarded by event_queue_lock */
+    EVENT_QUEUE_ROW* event_queue;
+    size_t event_queue_capacity;
+    size_t event_queue_head;
+    size_t event_queue_count;
+};
 
-/** @brief How long should the thread stay alive before shutting down when the processing queue is empty */
-static const int THREAD_EMPTY_QUEUE_TIMEOUT_MS = 200;
+/** @brief How many events the queue holds before it has to grow, and what it shrinks back to once drained */
+#define EVENT_QUEUE_INITIAL_CAPACITY 16
+/** @brief How many events the queue holds at most, events reported while it is full are dropped */
+#define EVENT_QUEUE_MAX_CAPACITY 1024
 
 static void destroy_event_system(EVENTSYSTEM_HANDLE handle);
-static void callbacks_call(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, VECTOR_HANDLE callbacks, GATEWAY_EVENT_CTX context);
-static int add_to_thread_queue(EVENTSYSTEM_HANDLE event_system, THREAD_QUEUE_ROW* row);
-static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system, int timeout_ms);
-static void destroy_thread_row(THREAD_QUEUE_ROW* row);
-static int callback_thread_main_func(void* event_system_param);
-static GATEWAY_EVENT_CTX handle_module_list_update(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks);
+static CALLBACK_SNAPSHOT* create_snapshot(CALLBACK_SNAPSHOT* previous, const CALLBACK_CLOSURE* closure);
+static void release_snapshot(CALLBACK_SNAPSHOT* snapshot);
+static int add_to_event_queue(EVENTSYSTEM_HANDLE event_system, const EVENT_QUEUE_ROW* row);
+static int take_from_event_queue(EVENTSYSTEM_HANDLE event_system, EVENT_QUEUE_ROW* row);
+static void destroy_event_row(EVENT_QUEUE_ROW* row);
+static void start_dispatcher(EVENTSYSTEM_HANDLE event_system);
+static int dispatcher_main_func(void* event_system_param);
+static void report_event(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const void* event_data);
+static GATEWAY_EVENT_CTX handle_module_list_update(GATEWAY_HANDLE gateway);
+static GATEWAY_EVENT_CTX handle_module_health(const GATEWAY_MODULE_HEALTH* health);
+static void destroy_module_health(GATEWAY_EVENT_CTX context);
+static GATEWAY_EVENT_CTX handle_message_tapped(const GATEWAY_TAPPED_MESSAGE* tapped);
+static void destroy_tapped_message(GATEWAY_EVENT_CTX context);
 
 /** @brief This function assumes that the context is a #VECTOR_HANDLE and destroys it */
-static void callback_destroy_modulelist(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param);
+static void destroy_modulelist(GATEWAY_EVENT_CTX context);
 
 EVENTSYSTEM_HANDLE EventSystem_Init(void)
 {
@@ -70,14 +99,14 @@ EVENTSYSTEM_HANDLE EventSystem_Init(void)
     }
     else
     {
-        /* NULL everything for easier free() in case of VECTOR malloc failure */
+        /* NULL everything for easier free() in case of a later failure */
         memset(result, 0, sizeof(struct EVENTSYSTEM_DATA));
 
         result->internal_change_lock = Lock_Init();
-        result->thread_queue_lock = Lock_Init();
-        result->thread_queue_condition = Condition_Init();
+        result->event_queue_lock = Lock_Init();
+        result->event_queue_condition = Condition_Init();
         /* Codes_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
-        if (result->internal_change_lock == NULL || result->thread_queue_lock == NULL || result->thread_queue_condition == NULL)
+        if (result->internal_change_lock == NULL || result->event_queue_lock == NULL || result->event_queue_condition == NULL)
         {
             LogError("failed to initialize event system locks or condition");
             destroy_event_system(result);
@@ -85,36 +114,17 @@ EVENTSYSTEM_HANDLE EventSystem_Init(void)
         }
         else
         {
-            for (int i = 0; i < GATEWAY_EVENTS_COUNT; i++)
+            result->event_queue = (EVENT_QUEUE_ROW*)malloc(EVENT_QUEUE_INITIAL_CAPACITY * sizeof(EVENT_QUEUE_ROW));
+            /* Codes_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
+            if (result->event_queue == NULL)
             {
-                VECTOR_HANDLE event_callbacks = VECTOR_create(sizeof(CALLBACK_CLOSURE));
-                /* Codes_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
-                if (event_callbacks == NULL)
-                {
-                    LogError("failed to initialize callback vectors");
-                    destroy_event_system(result);
-                    result = NULL;
-                    break;
-                }
-                else
-                {
-                    result->event_callbacks[i] = event_callbacks;
-                }
+                LogError("failed to create event queue during event system init");
+                destroy_event_system(result);
+                result = NULL;
             }
-
-            /* callback creation might have failed */
-            if (result != NULL)
+            else
             {
-                result->delay_when_queue_empty = 1;
-
-                result->thread_queue = singlylinkedlist_create();
-                /* Codes_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
-                if (result->thread_queue == NULL)
-                {
-                    LogError("failed to create thread queue during event system init");
-                    destroy_event_system(result);
-                    result = NULL;
-                }
+                result->event_queue_capacity = EVENT_QUEUE_INITIAL_CAPACITY;
             }
         }
     }
@@ -135,299 +145,452 @@ void EventSystem_AddEventCallback(EVENTSYSTEM_HANDLE event_system, GATEWAY_EVENT
             callback,
             user_param
         };
-        if (VECTOR_push_back(event_system->event_callbacks[event_type], &closure, 1) != 0)
+
+        Lock(event_system->internal_change_lock);
+
+        /* Codes_SRS_EVENTSYSTEM_17_001: [ This function shall publish a new snapshot of the event's callbacks, so that events already reported keep calling the callbacks they were reported with. ] */
+        CALLBACK_SNAPSHOT* previous = event_system->event_callbacks[event_type];
+        CALLBACK_SNAPSHOT* snapshot = create_snapshot(previous, &closure);
+        if (snapshot == NULL)
         {
-            /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+            /* Codes_SRS_EVENTSYSTEM_17_012: [ Should the new snapshot fail to be created, failure shall be logged and only this callback shall not be registered. ] */
             LogError("failed to register callback");
-            event_system->is_errored = 1;
         }
+        else
+        {
+            event_system->event_callbacks[event_type] = snapshot;
+            release_snapshot(previous);
+        }
+
+        Unlock(event_system->internal_change_lock);
     }
 }
 
 void EventSystem_ReportEvent(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type)
+{
+    report_event(event_system, gw, event_type, NULL);
+}
+
+void EventSystem_ReportModuleHealth(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const GATEWAY_MODULE_HEALTH* health)
+{
+    /* Codes_SRS_EVENTSYSTEM_17_006: [ This function shall do nothing when `health` is NULL or `event_type` is neither `GATEWAY_MODULE_SLOW` nor `GATEWAY_QUEUE_HIGH_WATERMARK`. ] */
+    if (health == NULL || (event_type != GATEWAY_MODULE_SLOW && event_type != GATEWAY_QUEUE_HIGH_WATERMARK))
+    {
+        LogError("null module health or event type %d is not a module health event", (int)event_type);
+    }
+    else
+    {
+        report_event(event_system, gw, event_type, health);
+    }
+}
+
+void EventSystem_ReportMessageTap(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, const GATEWAY_TAPPED_MESSAGE* tapped)
+{
+    /* Codes_SRS_EVENTSYSTEM_17_009: [ This function shall do nothing when `tapped` is NULL. ] */
+    if (tapped == NULL)
+    {
+        LogError("null tapped message when reporting message tap");
+    }
+    else
+    {
+        report_event(event_system, gw, GATEWAY_MESSAGE_TAPPED, tapped);
+    }
+}
+
+void EventSystem_Destroy(EVENTSYSTEM_HANDLE handle)
+{
+    destroy_event_system(handle);
+}
+
+/*********************
+ * Private functions *
+ *********************/
+
+static void report_event(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, const void* event_data)
 {
     /* Codes_SRS_EVENTSYSTEM_26_014: [ This function shall do nothing when `event_system` parameter is NULL. ] */
     if (event_system == NULL)
     {
         LogError("null gateway handle or gateway event handle when reporting event");
     }
-    /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+    /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
     else if (!event_system->is_errored)
     {
         /* Lock-avoiding mechanism, we get a probably-past state with previous if, then check synchronized state to be sure */
-        int real_is_errored = 0;
+        CALLBACK_SNAPSHOT* snapshot = NULL;
         Lock(event_system->internal_change_lock);
-        real_is_errored = event_system->is_errored;
-        Unlock(event_system->internal_change_lock);
-        
-        if (!real_is_errored)
+        if (!event_system->is_errored)
         {
-            /* We need to copy the callback queue because the callback might register another function */
             /* Codes_SRS_EVENTSYSTEM_26_007: [ This function shan't call any callbacks registered for any other GATEWAY_EVENT other than the one given as parameter. ] */
-            VECTOR_HANDLE callbacks = event_system->event_callbacks[event_type];
-            size_t vector_size = VECTOR_size(callbacks);
+            /* Codes_SRS_EVENTSYSTEM_17_002: [ This function shall take a reference to the current snapshot of the event's callbacks instead of copying them. ] */
+            snapshot = event_system->event_callbacks[event_type];
+            if (snapshot != NULL)
+            {
+                INC_REF(CALLBACK_SNAPSHOT, snapshot);
+            }
+        }
+        Unlock(event_system->internal_change_lock);
 
-            if (vector_size > 0)
+        if (snapshot != NULL)
+        {
+            EVENT_QUEUE_ROW row;
+            int context_failed = 0;
+            row.gateway = gw;
+            row.event_type = event_type;
+            row.callbacks = snapshot;
+            row.context = NULL;
+            row.destroy_context = NULL;
+
+            /* handlers return NULL on failure, and when reported without data */
+            switch (event_type)
             {
-                VECTOR_HANDLE call_queue = VECTOR_create(sizeof(CALLBACK_CLOSURE));
-                if (call_queue == NULL)
-                {
-                    /*Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-                    LogError("Failed to create call queue during event report");
-                    event_system->is_errored = 1;
-                }
-                else
-                {
-                    if (VECTOR_push_back(call_queue, VECTOR_front(callbacks), vector_size) != 0)
-                    {
-                        /*Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-                        LogError("Failed to copy callback queue during event report");
-                        event_system->is_errored = 1;
-                        VECTOR_destroy(call_queue);
-                    }
-                    else
-                    {
-                        GATEWAY_EVENT_CTX context = NULL;
-                        /* handlers might change event_system->is_errored */
-                        switch (event_type)
-                        {
-                        case GATEWAY_MODULE_LIST_CHANGED:
-                            context = handle_module_list_update(event_system, gw, call_queue);
-                            break;
-                        default:
-                            break;
-                        }
-
-                        if (event_system->is_errored)
-                            VECTOR_destroy(call_queue);
-                        else
-                            callbacks_call(event_system, gw, event_type, call_queue, context);
-                    }
-                }
+            case GATEWAY_MODULE_LIST_CHANGED:
+                row.context = handle_module_list_update(gw);
+                row.destroy_context = destroy_modulelist;
+                context_failed = (row.context == NULL);
+                break;
+            case GATEWAY_MODULE_SLOW:
+            case GATEWAY_QUEUE_HIGH_WATERMARK:
+                row.context = handle_module_health((const GATEWAY_MODULE_HEALTH*)event_data);
+                row.destroy_context = destroy_module_health;
+                context_failed = (event_data != NULL && row.context == NULL);
+                break;
+            case GATEWAY_MESSAGE_TAPPED:
+                row.context = handle_message_tapped((const GATEWAY_TAPPED_MESSAGE*)event_data);
+                row.destroy_context = destroy_tapped_message;
+                context_failed = (event_data != NULL && row.context == NULL);
+                break;
+            default:
+                break;
+            }
+
+            if (context_failed)
+            {
+                /* Codes_SRS_EVENTSYSTEM_17_013: [ Should the context of the event fail to be created or the event fail to be queued, failure shall be logged and only this event shall be dropped. ] */
+                LogError("Failed to create the context of event %d, dropping it", (int)event_type);
+                release_snapshot(snapshot);
+            }
+            /* Codes_SRS_EVENTSYSTEM_17_003: [ This function shall add the event to a queue that only allocates memory when it has to grow. ] */
+            else if (add_to_event_queue(event_system, &row) != 0)
+            {
+                /* Codes_SRS_EVENTSYSTEM_17_013: [ Should the context of the event fail to be created or the event fail to be queued, failure shall be logged and only this event shall be dropped. ] */
+                LogError("Failed to queue event %d, dropping it", (int)event_type);
+                destroy_event_row(&row);
+            }
+            else
+            {
+                start_dispatcher(event_system);
             }
         }
     }
 }
 
-void EventSystem_Destroy(EVENTSYSTEM_HANDLE handle)
-{
-    destroy_event_system(handle);
-}
-
-/*********************
- * Private functions *
- *********************/
-
 static void destroy_event_system(EVENTSYSTEM_HANDLE handle)
 {
     /* Codes_SRS_EVENTSYSTEM_26_004: [ This function shall do nothing when `event_system` parameter is NULL. ] */
     if (handle != NULL)
     {
-        if (handle->thread_queue_lock != NULL && handle->thread_queue_condition != NULL)
+        if (handle->event_queue_lock != NULL && handle->event_queue_condition != NULL)
         {
-            /* force the thread to not wait for new stuff on the queue and return as soon as the queue is empty */
-            Lock(handle->thread_queue_lock);
+            Lock(handle->event_queue_lock);
 
-            /* in case the thread is still running callbacks, notify it that it shouldn't wait for new data later on */
-            handle->delay_when_queue_empty = 0;
-            /* in case the thread is already waiting and we want it to stop waiting */
-            Condition_Post(handle->thread_queue_condition);
+            /* the dispatcher finishes what is queued and exits instead of waiting for more */
+            handle->is_stopping = 1;
+            /* in case the dispatcher is already waiting and we want it to stop waiting */
+            Condition_Post(handle->event_queue_condition);
 
-            Unlock(handle->thread_queue_lock);
+            Unlock(handle->event_queue_lock);
         }
 
-        THREAD_HANDLE callback_thread = NULL, destroyed_thread = NULL;
+        THREAD_HANDLE dispatcher_thread = NULL;
         if (handle->internal_change_lock != NULL)
         {
-            // The thread might be running, we want to wait for it to finish, but it might be moving the handles
-            // So we need to have a copy of those
             Lock(handle->internal_change_lock);
-
-            callback_thread = handle->callback_thread;
-            destroyed_thread = handle->destroyed_thread;
-
+            dispatcher_thread = handle->dispatcher_thread;
+            handle->dispatcher_thread = NULL;
             Unlock(handle->internal_change_lock);
         }
 
         int thread_res;
         /* Codes_SRS_EVENTSYSTEM_26_005: [ This function shall wait for all callbacks to finish before returning. ] */
-        if (callback_thread != NULL)
-            ThreadAPI_Join(callback_thread, &thread_res);
-        if (destroyed_thread != NULL)
-            ThreadAPI_Join(destroyed_thread, &thread_res);
+        if (dispatcher_thread != NULL)
+            ThreadAPI_Join(dispatcher_thread, &thread_res);
         /* Codes_SRS_EVENTSYSTEM_26_003: [ This function shall destroy and free resources of the given event system. ] */
-        Condition_Deinit(handle->thread_queue_condition);
-        Lock_Deinit(handle->thread_queue_lock);
+        Condition_Deinit(handle->event_queue_condition);
+        Lock_Deinit(handle->event_queue_lock);
         Lock_Deinit(handle->internal_change_lock);
 
-        /* Something might have been left on the list if thread errored out */
-        LIST_ITEM_HANDLE node = NULL;
-        while ((node = singlylinkedlist_get_head_item(handle->thread_queue)) != NULL)
+        /* Something might have been left on the queue if the dispatcher never started */
+        for (; handle->event_queue_count > 0; handle->event_queue_count--)
         {
-            destroy_thread_row((THREAD_QUEUE_ROW*)singlylinkedlist_item_get_value(node));
-            singlylinkedlist_remove(handle->thread_queue, node);
+            destroy_event_row(&handle->event_queue[handle->event_queue_head]);
+            handle->event_queue_head = (handle->event_queue_head + 1) % handle->event_queue_capacity;
         }
-        singlylinkedlist_destroy(handle->thread_queue);
+        free(handle->event_queue);
 
         for (int i = 0; i < GATEWAY_EVENTS_COUNT; i++)
-            VECTOR_destroy(handle->event_callbacks[i]);
+            release_snapshot(handle->event_callbacks[i]);
         free(handle);
     }
 }
 
-static void callbacks_call(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, VECTOR_HANDLE callbacks, GATEWAY_EVENT_CTX context)
+static CALLBACK_SNAPSHOT* create_snapshot(CALLBACK_SNAPSHOT* previous, const CALLBACK_CLOSURE* closure)
 {
-    THREAD_QUEUE_ROW* row = (THREAD_QUEUE_ROW*)malloc(sizeof(THREAD_QUEUE_ROW));
-    if (row == NULL)
+    CALLBACK_SNAPSHOT* result = REFCOUNT_TYPE_CREATE(CALLBACK_SNAPSHOT);
+    if (result == NULL)
     {
-        LogError("malloc failed when trying to create event system queue row");
-        VECTOR_destroy(callbacks);
+        LogError("malloc failed when creating callback snapshot");
     }
     else
     {
-        row->gateway = gw;
-        row->event_type = event_type;
-        row->callbacks = callbacks;
-        row->context = context;
-        /* Failed to add to queue, we have allocated row which won't be freed during EventSystem destroy */
-        if (add_to_thread_queue(event_system, row))
+        result->callbacks = VECTOR_create(sizeof(CALLBACK_CLOSURE));
+        size_t previous_size = (previous == NULL) ? 0 : VECTOR_size(previous->callbacks);
+        if (result->callbacks == NULL ||
+            (previous_size > 0 && VECTOR_push_back(result->callbacks, VECTOR_front(previous->callbacks), previous_size) != 0) ||
+            VECTOR_push_back(result->callbacks, closure, 1) != 0)
         {
-            destroy_thread_row(row);
-            row = NULL;
+            LogError("failed to copy callbacks into snapshot");
+            VECTOR_destroy(result->callbacks);
+            free(result);
+            result = NULL;
         }
     }
+    return result;
+}
 
-    Lock(event_system->internal_change_lock);
-
-    // There's a thread to cleanup that was destroyed but has a floating handle
-    if (event_system->destroyed_thread != NULL)
+static void release_snapshot(CALLBACK_SNAPSHOT* snapshot)
+{
+    if (snapshot != NULL && DEC_REF(CALLBACK_SNAPSHOT, snapshot) == DEC_RETURN_ZERO)
     {
-        int res;
-        ThreadAPI_Join(event_system->destroyed_thread, &res);
-        event_system->destroyed_thread = NULL;
+        VECTOR_destroy(snapshot->callbacks);
+        free(snapshot);
     }
+}
+
+static int add_to_event_queue(EVENTSYSTEM_HANDLE event_system, const EVENT_QUEUE_ROW* row)
+{
+    int errored = 0;
+
+    Lock(event_system->event_queue_lock);
 
-    /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-    if (row == NULL)
+    if (event_system->event_queue_count == EVENT_QUEUE_MAX_CAPACITY)
     {
-        event_system->is_errored = 1;
+        /* Codes_SRS_EVENTSYSTEM_17_014: [ This function shall queue at most EVENT_QUEUE_MAX_CAPACITY events. ] */
+        LogError("event queue holds %d events, the dispatcher is not keeping up", EVENT_QUEUE_MAX_CAPACITY);
+        errored = 1;
     }
-    else if (event_system->callback_thread == NULL)
+    else if (event_system->event_queue_count == event_system->event_queue_capacity)
     {
-        /* Codes_SRS_EVENTSYSTEM_26_008: [ This function shall call all registered callbacks on a seperate thread. ] */
-        THREADAPI_RESULT result = ThreadAPI_Create(&event_system->callback_thread, callback_thread_main_func, (void*)event_system);
-        /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
-        /* Stuff on the queue will be deleted when destroying EventSystem */
-        if (result != THREADAPI_OK)
-            event_system->is_errored = 1;
+        /* full, move the events in order to a queue twice the size */
+        size_t new_capacity = event_system->event_queue_capacity * 2;
+        EVENT_QUEUE_ROW* new_queue = (EVENT_QUEUE_ROW*)malloc(new_capacity * sizeof(EVENT_QUEUE_ROW));
+        if (new_queue == NULL)
+        {
+            LogError("malloc failed when growing event queue");
+            errored = 1;
+        }
+        else
+        {
+            for (size_t i = 0; i < event_system->event_queue_count; i++)
+            {
+                new_queue[i] = event_system->event_queue[(event_system->event_queue_head + i) % event_system->event_queue_capacity];
+            }
+            free(event_system->event_queue);
+            event_system->event_queue = new_queue;
+            event_system->event_queue_capacity = new_capacity;
+            event_system->event_queue_head = 0;
+        }
     }
 
-    Unlock(event_system->internal_change_lock);
-}
-
-static int add_to_thread_queue(EVENTSYSTEM_HANDLE event_system, THREAD_QUEUE_ROW* row)
-{
-    Lock(event_system->thread_queue_lock);
-
-    int errored = !singlylinkedlist_add(event_system->thread_queue, row);
-    Condition_Post(event_system->thread_queue_condition);
+    if (!errored)
+    {
+        event_system->event_queue[(event_system->event_queue_head + event_system->event_queue_count) % event_system->event_queue_capacity] = *row;
+        event_system->event_queue_count++;
+        Condition_Post(event_system->event_queue_condition);
+    }
 
-    Unlock(event_system->thread_queue_lock);
+    Unlock(event_system->event_queue_lock);
 
     return errored;
 }
 
-static THREAD_QUEUE_ROW* get_from_thread_queue(EVENTSYSTEM_HANDLE event_system, int timeout_ms)
+/* Returns non-zero with the oldest event in row, or 0 once the queue is empty and the event system is stopping */
+static int take_from_event_queue(EVENTSYSTEM_HANDLE event_system, EVENT_QUEUE_ROW* row)
 {
-    THREAD_QUEUE_ROW* row = NULL;
-    
-    Lock(event_system->thread_queue_lock);
-    
-    LIST_ITEM_HANDLE node = singlylinkedlist_get_head_item(event_system->thread_queue);
-    if (node == NULL && event_system->delay_when_queue_empty)
+    int taken = 0;
+
+    Lock(event_system->event_queue_lock);
+
+    /* Codes_SRS_EVENTSYSTEM_17_004: [ The dispatcher shall wait for further events until the event system is destroyed. ] */
+    while (event_system->event_queue_count == 0 && !event_system->is_stopping)
     {
-        Condition_Wait(event_system->thread_queue_condition, event_system->thread_queue_lock, timeout_ms);
-        node = singlylinkedlist_get_head_item(event_system->thread_queue);
+        Condition_Wait(event_system->event_queue_condition, event_system->event_queue_lock, 0);
     }
 
-    /* Condition might have timed out or we don't have delayed destroy so the node can be NULL */
-    if (node != NULL)
+    if (event_system->event_queue_count > 0)
     {
-        row = (THREAD_QUEUE_ROW*)singlylinkedlist_item_get_value(node);
-        singlylinkedlist_remove(event_system->thread_queue, node);
+        *row = event_system->event_queue[event_system->event_queue_head];
+        event_system->event_queue_head = (event_system->event_queue_head + 1) % event_system->event_queue_capacity;
+        event_system->event_queue_count--;
+        taken = 1;
+
+        if (event_system->event_queue_count == 0 && event_system->event_queue_capacity > EVENT_QUEUE_INITIAL_CAPACITY)
+        {
+            /* Codes_SRS_EVENTSYSTEM_17_015: [ The dispatcher shall shrink the queue back to its initial size once it empties it. ] */
+            EVENT_QUEUE_ROW* new_queue = (EVENT_QUEUE_ROW*)realloc(event_system->event_queue, EVENT_QUEUE_INITIAL_CAPACITY * sizeof(EVENT_QUEUE_ROW));
+            if (new_queue == NULL)
+            {
+                LogError("realloc failed when shrinking event queue, keeping it as is");
+            }
+            else
+            {
+                event_system->event_queue = new_queue;
+                event_system->event_queue_capacity = EVENT_QUEUE_INITIAL_CAPACITY;
+            }
+            event_system->event_queue_head = 0;
+        }
     }
-    
-    Unlock(event_system->thread_queue_lock);
-    
-    return row;
+
+    Unlock(event_system->event_queue_lock);
+
+    return taken;
 }
 
-static void destroy_thread_row(THREAD_QUEUE_ROW* row)
+static void destroy_event_row(EVENT_QUEUE_ROW* row)
 {
-    if (row != NULL)
-        VECTOR_destroy(row->callbacks);
-    free(row);
+    if (row->destroy_context != NULL)
+        row->destroy_context(row->context);
+    release_snapshot(row->callbacks);
 }
 
-static int callback_thread_main_func(void* event_system_param)
+static void start_dispatcher(EVENTSYSTEM_HANDLE event_system)
+{
+    Lock(event_system->internal_change_lock);
+
+    if (event_system->dispatcher_thread == NULL && !event_system->is_errored)
+    {
+        /* Codes_SRS_EVENTSYSTEM_26_008: [ This function shall call all registered callbacks on a seperate thread. ] */
+        /* Codes_SRS_EVENTSYSTEM_17_005: [ This function shall create the dispatcher thread when the first event is reported. ] */
+        THREADAPI_RESULT result = ThreadAPI_Create(&event_system->dispatcher_thread, dispatcher_main_func, (void*)event_system);
+        /* Codes_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+        /* Stuff on the queue will be deleted when destroying EventSystem */
+        if (result != THREADAPI_OK)
+        {
+            LogError("failed to create event dispatcher thread");
+            event_system->dispatcher_thread = NULL;
+            event_system->is_errored = 1;
+        }
+    }
+
+    Unlock(event_system->internal_change_lock);
+}
+
+static int dispatcher_main_func(void* event_system_param)
 {
     EVENTSYSTEM_HANDLE event_system = (EVENTSYSTEM_HANDLE)event_system_param;
-    THREAD_QUEUE_ROW* row;
-    while ((row = get_from_thread_queue(event_system, THREAD_EMPTY_QUEUE_TIMEOUT_MS)) != NULL)
+    EVENT_QUEUE_ROW row;
+    while (take_from_event_queue(event_system, &row))
     {
-        size_t vector_size = VECTOR_size(row->callbacks);
+        size_t vector_size = VECTOR_size(row.callbacks->callbacks);
         /* Codes_SRS_EVENTSYSTEM_26_006: [ This function shall call all registered callbacks for the given GATEWAY_EVENT. ] */
         /* Codes_SRS_EVENTSYSTEM_26_009: [ This function shall call all registered callbacks in First - In - First - Out order in terms registration. ] */
         for (size_t i = 0; i < vector_size; i++)
         {
-            CALLBACK_CLOSURE *closure = (CALLBACK_CLOSURE*)VECTOR_element(row->callbacks, i);
+            CALLBACK_CLOSURE *closure = (CALLBACK_CLOSURE*)VECTOR_element(row.callbacks->callbacks, i);
             /* Codes_SRS_EVENTSYSTEM_26_010: [ The given `GATEWAY_CALLBACK` function shall be called with proper `GATEWAY_HANDLE`, `GATEWAY_EVENT` and provided user parameter as function parameters coresponding to the gateway and the event that occured. ] */
-            closure->call(row->gateway, row->event_type, row->context, closure->user_param);
+            closure->call(row.gateway, row.event_type, row.context, closure->user_param);
         }
-        destroy_thread_row(row);
+        destroy_event_row(&row);
     }
 
-    Lock(event_system->internal_change_lock);
-
-    event_system->destroyed_thread = event_system->callback_thread;
-    event_system->callback_thread = NULL;
-
-    Unlock(event_system->internal_change_lock);
-
     return THREADAPI_OK;
 }
 
-static GATEWAY_EVENT_CTX handle_module_list_update(EVENTSYSTEM_HANDLE event_system, GATEWAY_HANDLE gateway, VECTOR_HANDLE callbacks)
+static GATEWAY_EVENT_CTX handle_module_list_update(GATEWAY_HANDLE gateway)
 {
     /* Codes_SRS_EVENTSYSTEM_26_016: [ This event shall provide `VECTOR_HANDLE` as returned from #Gateway_GetModuleList as the event context in callbacks ] */
     VECTOR_HANDLE modules = Gateway_GetModuleList(gateway);
     if (modules == NULL)
     {
-        event_system->is_errored = 1;
+        LogError("Failed to get the module list during handling module list updated event");
     }
-    else
+    return modules;
+}
+
+static void destroy_modulelist(GATEWAY_EVENT_CTX context)
+{
+    /* Codes_SRS_EVENTSYSTEM_26_015: [ This event shall clean up the `VECTOR_HANDLE` of #Gateway_GetModuleList after finishing all the callbacks ] */
+    if (context != NULL)
+        Gateway_DestroyModuleList((VECTOR_HANDLE)context);
+}
+
+static GATEWAY_EVENT_CTX handle_module_health(const GATEWAY_MODULE_HEALTH* health)
+{
+    GATEWAY_MODULE_HEALTH* copy = NULL;
+    /* Reported without a health by EventSystem_ReportEvent, callbacks get a NULL context */
+    if (health != NULL)
     {
-        CALLBACK_CLOSURE closure = {
-            callback_destroy_modulelist,
-            NULL
-        };
-        /* Codes_SRS_EVENTSYSTEM_26_015: [ This event shall clean up the `VECTOR_HANDLE` of #Gateway_GetModuleList after finishing all the callbacks ] */
-        if (VECTOR_push_back(callbacks, &closure, 1) != 0)
+        /* Codes_SRS_EVENTSYSTEM_17_007: [ This event shall provide a copy of the `GATEWAY_MODULE_HEALTH` given to #EventSystem_ReportModuleHealth as the event context in callbacks ] */
+        copy = (GATEWAY_MODULE_HEALTH*)malloc(sizeof(GATEWAY_MODULE_HEALTH));
+        if (copy == NULL)
         {
-            LogError("Failed to push back during handling module list updated event");
-            VECTOR_destroy(modules);
-            event_system->is_errored = 1;
-            modules = NULL;
+            LogError("Failed to copy the module health during handling module health event");
+        }
+        else
+        {
+            *copy = *health;
         }
     }
-    return modules;
+    return copy;
 }
 
+static void destroy_module_health(GATEWAY_EVENT_CTX context)
+{
+    /* Codes_SRS_EVENTSYSTEM_17_008: [ This event shall free the copy of the `GATEWAY_MODULE_HEALTH` after finishing all the callbacks ] */
+    free(context);
+}
 
-static void callback_destroy_modulelist(GATEWAY_HANDLE gateway, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param)
+static GATEWAY_EVENT_CTX handle_message_tapped(const GATEWAY_TAPPED_MESSAGE* tapped)
 {
-    (void)gateway;
-    (void)event_type;
-    (void)user_param;
-    Gateway_DestroyModuleList((VECTOR_HANDLE)context);
-}
\ No newline at end of file
+    GATEWAY_TAPPED_MESSAGE* copy = NULL;
+    /* Reported without a message by EventSystem_ReportEvent, callbacks get a NULL context */
+    if (tapped != NULL)
+    {
+        /* Codes_SRS_EVENTSYSTEM_17_010: [ This event shall provide a copy of the `GATEWAY_TAPPED_MESSAGE` given to #EventSystem_ReportMessageTap as the event context in callbacks, holding a clone of its message ] */
+        copy = (GATEWAY_TAPPED_MESSAGE*)malloc(sizeof(GATEWAY_TAPPED_MESSAGE));
+        if (copy == NULL)
+        {
+            LogError("Failed to copy the tapped message during handling message tapped event");
+        }
+        else
+        {
+            *copy = *tapped;
+            if (tapped->message != NULL)
+            {
+                /* the broker's message is only valid while it is being tapped, clone it */
+                copy->message = Message_Clone(tapped->message);
+                if (copy->message == NULL)
+                {
+                    LogError("Failed to clone the tapped message during handling message tapped event");
+                    free(copy);
+                    copy = NULL;
+                }
+            }
+        }
+    }
+    return copy;
+}
+
+static void destroy_tapped_message(GATEWAY_EVENT_CTX context)
+{
+    /* Codes_SRS_EVENTSYSTEM_17_011: [ This event shall destroy the clone of the message and free the copy of the `GATEWAY_TAPPED_MESSAGE` after finishing all the callbacks ] */
+    GATEWAY_TAPPED_MESSAGE* tapped = (GATEWAY_TAPPED_MESSAGE*)context;
+    if (tapped != NULL)
+    {
+        if (tapped->message != NULL)
+        {
+            Message_Destroy(tapped->message);
+        }
+        free(tapped);
+    }
+}
@@ -16,6 +16,7 @@
 #include "module.h"
 #include "module_loader.h"
 #include "module_loaders/dynamic_loader.h"
+#include "module_loaders/static_loader.h"
 
 #ifdef OUTPROCESS_ENABLED
 #include "module_loaders/outprocess_loader.h"
@@ -84,12 +85,26 @@ MODULE_LOADER_RESULT ModuleLoader_Initialize(void)
                 /*Codes_SRS_MODULE_LOADER_13_002: [ ModuleLoader_Initialize shall return MODULE_LOADER_ERROR if an underlying platform call fails. ]*/
                 result = MODULE_LOADER_ERROR;
             }
+            /*Codes_SRS_MODULE_LOADER_17_012: [ ModuleLoader_Initialize shall initialize the dynamic loader by calling DynamicLoader_Initialize. ]*/
+            else if (DynamicLoader_Initialize() != 0)
+            {
+                LogError("DynamicLoader_Initialize failed");
+                VECTOR_destroy(g_module_loaders.module_loaders);
+                g_module_loaders.module_loaders = NULL;
+                Unlock(g_module_loaders.lock);
+                Lock_Deinit(g_module_loaders.lock);
+                g_module_loaders.lock = NULL;
+
+                /*Codes_SRS_MODULE_LOADER_13_002: [ ModuleLoader_Initialize shall return MODULE_LOADER_ERROR if an underlying platform call fails. ]*/
+                result = MODULE_LOADER_ERROR;
+            }
             else
             {
                 // add all supported module loaders
                 const MODULE_LOADER* supported_loaders[] =
                 {
                     DynamicLoader_Get()
+                    , StaticLoader_Get()
 #ifdef NODE_BINDING_ENABLED
                     , NodeLoader_Get()
 #endif
@@ -395,6 +410,9 @@ void ModuleLoader_Destroy(void)
         /*Codes_SRS_MODULE_LOADER_13_048: [ ModuleLoader_Destroy shall destroy the loaders vector. ]*/
         VECTOR_destroy(g_module_loaders.module_loaders);
         g_module_loaders.module_loaders = NULL;
+
+        /*Codes_SRS_MODULE_LOADER_17_013: [ ModuleLoader_Destroy shall deinitialize the dynamic loader by calling DynamicLoader_Deinitialize. ]*/
+        DynamicLoader_Deinitialize();
     }
 
     if (g_module_loaders.lock != NULL)
@@ -509,6 +527,11 @@ MODULE_LOADER* ModuleLoader_GetDefaultLoaderForType(MODULE_LOADER_TYPE type)
         result = ModuleLoader_FindByName(DYNAMIC_LOADER_NAME);
         break;
 
+    case NATIVE_STATIC:
+        /*Codes_SRS_MODULE_LOADER_13_058: [ ModuleLoader_GetDefaultLoaderForType shall return a non-NULL MODULE_LOADER pointer when the loader type is a recongized type. ]*/
+        result = ModuleLoader_FindByName(STATIC_LOADER_NAME);
+        break;
+
 #ifdef NODE_BINDING_ENABLED
     case NODEJS:
         /*Codes_SRS_MODULE_LOADER_13_058: [ ModuleLoader_GetDefaultLoaderForType shall return a non-NULL MODULE_LOADER pointer when the loader type is a recongized type. ]*/
@@ -559,6 +582,9 @@ MODULE_LOADER_TYPE ModuleLoader_ParseType(const char* type)
     if (strcmp(type, "native") == 0)
         /*Codes_SRS_MODULE_LOADER_13_060: [ ModuleLoader_ParseType shall return a valid MODULE_LOADER_TYPE if type is a recognized module loader type string. ]*/
         loader_type = NATIVE;
+    else if (strcmp(type, "static") == 0)
+        /*Codes_SRS_MODULE_LOADER_13_060: [ ModuleLoader_ParseType shall return a valid MODULE_LOADER_TYPE if type is a recognized module loader type string. ]*/
+        loader_type = NATIVE_STATIC;
     else if (strcmp(type, "outprocess") == 0)
         /*Codes_SRS_MODULE_LOADER_13_060: [ ModuleLoader_ParseType shall return a valid MODULE_LOADER_TYPE if type is a recognized module loader type string. ]*/
         loader_type = OUTPROCESS;
@@ -583,8 +609,10 @@ MODULE_LOADER_TYPE ModuleLoader_ParseType(const char* type)
 
 bool ModuleLoader_IsDefaultLoader(const char* name)
 {
-    /*Codes_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]*/
+    /*Codes_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'static', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]*/
     return strcmp(name, DYNAMIC_LOADER_NAME) == 0
+           ||
+           strcmp(name, STATIC_LOADER_NAME) == 0
            ||
            strcmp(name, "outprocess") == 0
            ||
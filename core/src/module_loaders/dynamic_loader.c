@@ -3,8 +3,11 @@
 #include <stdlib.h>
 #include "azure_c_shared_utility/gballoc.h"
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/lock.h"
 #include "parson.h"
 
 #include "module.h"
@@ -13,12 +16,145 @@
 #include "module_loaders/dynamic_loader.h"
 #include "dynamic_library.h"
 
+#define DYNAMIC_LIBRARY_CACHE_BUCKETS 32
+
+/** @brief  A loaded library. Every module using the same library shares one of
+ *          these, so the library is opened and its API resolved only once.
+ */
 typedef struct DYNAMIC_MODULE_HANDLE_DATA_TAG
 {
     void* library;
     const MODULE_API* api;
+
+    /** @brief  Number of loads not yet unloaded */
+    size_t load_count;
+    uint32_t hash;
+    const char* path;
+    struct DYNAMIC_MODULE_HANDLE_DATA_TAG* next;
 }DYNAMIC_MODULE_HANDLE_DATA;
 
+static struct
+{
+    // Lock used to protect the cache, modules may be loaded on several threads.
+    LOCK_HANDLE lock;
+
+    // Number of DynamicLoader_Initialize calls not yet deinitialized.
+    size_t init_count;
+
+    // Loaded libraries, hashed on the path they were loaded from.
+    DYNAMIC_MODULE_HANDLE_DATA* buckets[DYNAMIC_LIBRARY_CACHE_BUCKETS];
+
+} g_library_cache = { NULL, 0, { NULL } };
+
+static uint32_t hash_library_path(const char* path)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* c = path; *c != '\0'; c++)
+    {
+        hash ^= (unsigned char)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool uses_eager_binding(const MODULE_LOADER* loader)
+{
+    return loader->configuration != NULL &&
+        ((const DYNAMIC_LOADER_CONFIGURATION*)loader->configuration)->eager_binding;
+}
+
+/*finds the library loaded from path, NULL if there is none. g_library_cache.lock must be held*/
+static DYNAMIC_MODULE_HANDLE_DATA* find_library(const char* path, uint32_t hash)
+{
+    DYNAMIC_MODULE_HANDLE_DATA* result = g_library_cache.buckets[hash % DYNAMIC_LIBRARY_CACHE_BUCKETS];
+    while (result != NULL && (result->hash != hash || strcmp(result->path, path) != 0))
+    {
+        result = result->next;
+    }
+    return result;
+}
+
+/*unloads a library that is not in the cache*/
+static void free_library(DYNAMIC_MODULE_HANDLE_DATA* library)
+{
+    DynamicLibrary_UnloadLibrary(library->library);
+    free(library);
+}
+
+static DYNAMIC_MODULE_HANDLE_DATA* load_library(const MODULE_LOADER* loader, const char* moduleLibraryFileName, uint32_t hash)
+{
+    size_t path_size = strlen(moduleLibraryFileName) + 1;
+    DYNAMIC_MODULE_HANDLE_DATA* result = (DYNAMIC_MODULE_HANDLE_DATA*)malloc(sizeof(DYNAMIC_MODULE_HANDLE_DATA) + path_size);
+    if (result == NULL)
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
+        LogError("malloc(sizeof(DYNAMIC_MODULE_HANDLE_DATA)) failed");
+    }
+    else
+    {
+        /* load the DLL */
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_004: [ DynamicModuleLoader_Load shall load the module into memory by calling DynamicLibrary_LoadLibrary. ]
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_002: [ When the loader's configuration asks for eager binding, DynamicModuleLoader_Load shall load the module by calling DynamicLibrary_LoadLibraryEager instead. ]
+        result->library = uses_eager_binding(loader) ?
+            DynamicLibrary_LoadLibraryEager(moduleLibraryFileName) :
+            DynamicLibrary_LoadLibrary(moduleLibraryFileName);
+        if (result->library == NULL)
+        {
+            //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
+            free(result);
+            result = NULL;
+            LogError("DynamicLibrary_LoadLibrary() returned NULL for module %s", moduleLibraryFileName);
+        }
+        else
+        {
+            //Codes_SRS_DYNAMIC_MODULE_LOADER_13_033: [ DynamicModuleLoader_Load shall call DynamicLibrary_FindSymbol on the module handle with the symbol name Module_GetApi to acquire the function that returns the module's API table. ]
+            pfModule_GetApi pfnGetAPI = (pfModule_GetApi)DynamicLibrary_FindSymbol(result->library, MODULE_GETAPI_NAME);
+            if (pfnGetAPI == NULL)
+            {
+                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
+                DynamicLibrary_UnloadLibrary(result->library);
+                free(result);
+                result = NULL;
+                LogError("DynamicLibrary_FindSymbol() returned NULL");
+            }
+            else
+            {
+                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_040: [ DynamicModuleLoader_Load shall call the module's Module_GetAPI callback to acquire the module API table. ]
+                result->api = pfnGetAPI(Module_ApiGatewayVersion);
+
+                /* if any of the required functions is NULL then we have a misbehaving module */
+                if (result->api == NULL ||
+                    result->api->version > Module_ApiGatewayVersion ||
+                    MODULE_CREATE(result->api) == NULL ||
+                    MODULE_DESTROY(result->api) == NULL ||
+                    MODULE_RECEIVE(result->api) == NULL)
+                {
+                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_034: [ DynamicModuleLoader_Load shall return NULL if the MODULE_API pointer returned by the module is NULL. ]
+                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_035: [ DynamicModuleLoader_Load shall return NULL if MODULE_API::version is greater than Module_ApiGatewayVersion. ]
+                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_036: [ DynamicModuleLoader_Load shall return NULL if the Module_Create function in MODULE_API is NULL. ]
+                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_037: [ DynamicModuleLoader_Load shall return NULL if the Module_Receive function in MODULE_API is NULL. ]
+                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_038: [ DynamicModuleLoader_Load shall return NULL if the Module_Destroy function in MODULE_API is NULL. ]
+                    DynamicLibrary_UnloadLibrary(result->library);
+                    free(result);
+                    result = NULL;
+                    LogError("pfnGetapi() returned NULL");
+                }
+                else
+                {
+                    char* path = (char*)(result + 1);
+                    (void)memcpy(path, moduleLibraryFileName, path_size);
+                    result->path = path;
+                    result->hash = hash;
+                    result->load_count = 1;
+                    result->next = NULL;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
 static MODULE_LIBRARY_HANDLE DynamicModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
 {
     DYNAMIC_MODULE_HANDLE_DATA* result;
@@ -53,57 +189,58 @@ static MODULE_LIBRARY_HANDLE DynamicModuleLoader_Load(const MODULE_LOADER* loade
             else
             {
                 const char * moduleLibraryFileName = STRING_c_str(dynamic_loader_entrypoint->moduleLibraryFileName);
-                result = (DYNAMIC_MODULE_HANDLE_DATA*)malloc(sizeof(DYNAMIC_MODULE_HANDLE_DATA));
-                if (result == NULL)
+                uint32_t hash = hash_library_path(moduleLibraryFileName);
+                if (g_library_cache.lock == NULL || Lock(g_library_cache.lock) != LOCK_OK)
                 {
                     //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
-                    LogError("malloc(sizeof(DYNAMIC_MODULE_HANDLE_DATA)) failed");
+                    result = NULL;
+                    LogError("unable to lock the library cache");
                 }
                 else
                 {
-                    /* load the DLL */
-                    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_004: [ DynamicModuleLoader_Load shall load the module into memory by calling DynamicLibrary_LoadLibrary. ]
-                    result->library = DynamicLibrary_LoadLibrary(moduleLibraryFileName);
-                    if (result->library == NULL)
+                    result = find_library(moduleLibraryFileName, hash);
+                    if (result != NULL)
                     {
-                        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
-                        free(result);
-                        result = NULL;
-                        LogError("DynamicLibrary_LoadLibrary() returned NULL for module %s", moduleLibraryFileName);
+                        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_001: [ If the library has already been loaded from the same path and not unloaded as many times, DynamicModuleLoader_Load shall return the same MODULE_LIBRARY_HANDLE without loading the library again. ]
+                        result->load_count++;
+                        (void)Unlock(g_library_cache.lock);
                     }
                     else
                     {
-                        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_033: [ DynamicModuleLoader_Load shall call DynamicLibrary_FindSymbol on the module handle with the symbol name Module_GetApi to acquire the function that returns the module's API table. ]
-                        pfModule_GetApi pfnGetAPI = (pfModule_GetApi)DynamicLibrary_FindSymbol(result->library, MODULE_GETAPI_NAME);
-                        if (pfnGetAPI == NULL)
+                        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_005: [ DynamicModuleLoader_Load shall not hold the library cache's lock while it loads a library. ]
+                        (void)Unlock(g_library_cache.lock);
+                        result = load_library(loader, moduleLibraryFileName, hash);
+                        if (result == NULL)
+                        {
+                            /* load_library has logged the failure */
+                        }
+                        else if (Lock(g_library_cache.lock) != LOCK_OK)
                         {
                             //Codes_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
-                            DynamicLibrary_UnloadLibrary(result->library);
-                            free(result);
+                            LogError("unable to lock the library cache");
+                            free_library(result);
                             result = NULL;
-                            LogError("DynamicLibrary_FindSymbol() returned NULL");
                         }
                         else
                         {
-                            //Codes_SRS_DYNAMIC_MODULE_LOADER_13_040: [ DynamicModuleLoader_Load shall call the module's Module_GetAPI callback to acquire the module API table. ]
-                            result->api = pfnGetAPI(Module_ApiGatewayVersion);
-
-                            /* if any of the required functions is NULL then we have a misbehaving module */
-                            if (result->api == NULL ||
-                                result->api->version > Module_ApiGatewayVersion ||
-                                MODULE_CREATE(result->api) == NULL ||
-                                MODULE_DESTROY(result->api) == NULL ||
-                                MODULE_RECEIVE(result->api) == NULL)
+                            //Codes_SRS_DYNAMIC_MODULE_LOADER_17_006: [ If the same library was loaded on another thread in the meantime, DynamicModuleLoader_Load shall unload its own copy and return the MODULE_LIBRARY_HANDLE of the other. ]
+                            DYNAMIC_MODULE_HANDLE_DATA* loaded = find_library(moduleLibraryFileName, hash);
+                            if (loaded != NULL)
                             {
-                                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_034: [ DynamicModuleLoader_Load shall return NULL if the MODULE_API pointer returned by the module is NULL. ]
-                                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_035: [ DynamicModuleLoader_Load shall return NULL if MODULE_API::version is greater than Module_ApiGatewayVersion. ]
-                                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_036: [ DynamicModuleLoader_Load shall return NULL if the Module_Create function in MODULE_API is NULL. ]
-                                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_037: [ DynamicModuleLoader_Load shall return NULL if the Module_Receive function in MODULE_API is NULL. ]
-                                //Codes_SRS_DYNAMIC_MODULE_LOADER_13_038: [ DynamicModuleLoader_Load shall return NULL if the Module_Destroy function in MODULE_API is NULL. ]
-                                DynamicLibrary_UnloadLibrary(result->library);
-                                free(result);
-                                result = NULL;
-                                LogError("pfnGetapi() returned NULL");
+                                loaded->load_count++;
+                            }
+                            else
+                            {
+                                DYNAMIC_MODULE_HANDLE_DATA** bucket = &(g_library_cache.buckets[hash % DYNAMIC_LIBRARY_CACHE_BUCKETS]);
+                                result->next = *bucket;
+                                *bucket = result;
+                            }
+                            (void)Unlock(g_library_cache.lock);
+
+                            if (loaded != NULL)
+                            {
+                                free_library(result);
+                                result = loaded;
                             }
                         }
                     }
@@ -146,11 +283,35 @@ static void DynamicModuleLoader_Unload(const MODULE_LOADER* loader, MODULE_LIBRA
     {
         DYNAMIC_MODULE_HANDLE_DATA* loader_data = moduleLibraryHandle;
 
-        /*Codes_SRS_MODULE_LOADER_17_010: [DynamicModuleLoader_Unload shall attempt to unload the library.]*/
-        DynamicLibrary_UnloadLibrary(loader_data->library);
+        if (Lock(g_library_cache.lock) != LOCK_OK)
+        {
+            LogError("unable to lock the library cache, the library stays loaded");
+        }
+        else
+        {
+            loader_data->load_count--;
+            if (loader_data->load_count == 0)
+            {
+                DYNAMIC_MODULE_HANDLE_DATA** entry = &(g_library_cache.buckets[loader_data->hash % DYNAMIC_LIBRARY_CACHE_BUCKETS]);
+                while (*entry != loader_data)
+                {
+                    entry = &((*entry)->next);
+                }
+                *entry = loader_data->next;
 
-        /*Codes_SRS_MODULE_LOADER_17_011: [DynamicModuleLoader_Unload shall deallocate memory for the structure MODULE_LIBRARY_HANDLE.]*/
-        free(loader_data);
+                /*Codes_SRS_MODULE_LOADER_17_010: [DynamicModuleLoader_Unload shall attempt to unload the library.]*/
+                DynamicLibrary_UnloadLibrary(loader_data->library);
+
+                /*Codes_SRS_MODULE_LOADER_17_011: [DynamicModuleLoader_Unload shall deallocate memory for the structure MODULE_LIBRARY_HANDLE.]*/
+                free(loader_data);
+            }
+            else
+            {
+                /*Codes_SRS_DYNAMIC_MODULE_LOADER_17_003: [ DynamicModuleLoader_Unload shall keep the library loaded until it has been unloaded as many times as it was loaded. ]*/
+            }
+
+            (void)Unlock(g_library_cache.lock);
+        }
     }
     else
     {
@@ -261,24 +422,52 @@ static void DynamicModuleLoader_FreeEntrypoint(const MODULE_LOADER* loader, void
 static MODULE_LOADER_BASE_CONFIGURATION* DynamicModuleLoader_ParseConfigurationFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
 {
     (void)loader;
-    (void)json;
+    // The input is either NULL or a JSON object that looks like this:
+    //  "configuration": {
+    //      "binding.eager": true
+    //  }
+    DYNAMIC_LOADER_CONFIGURATION* config;
+    if (json == NULL || json_value_get_type(json) != JSONObject)
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL` if `json` is not an object or if `binding.eager` is not `true`. ]
+        config = NULL;
+    }
+    else
+    {
+        JSON_Object* configuration = json_value_get_object(json);
+        if (configuration == NULL || json_object_get_boolean(configuration, "binding.eager") != 1)
+        {
+            //Codes_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL` if `json` is not an object or if `binding.eager` is not `true`. ]
+            config = NULL;
+        }
+        else
+        {
+            config = (DYNAMIC_LOADER_CONFIGURATION*)malloc(sizeof(DYNAMIC_LOADER_CONFIGURATION));
+            if (config == NULL)
+            {
+                LogError("malloc failed");
+            }
+            else
+            {
+                //Codes_SRS_DYNAMIC_MODULE_LOADER_17_004: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return a `DYNAMIC_LOADER_CONFIGURATION` with `eager_binding` set when `binding.eager` is `true`. ]
+                config->base.binding_path = NULL;
+                config->eager_binding = true;
+            }
+        }
+    }
 
-    /**
-     * The dynamic loader does not have any configuration so we always return NULL.
-     */
-    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL`. ]
-    return NULL;
+    return (MODULE_LOADER_BASE_CONFIGURATION*)config;
 }
 
 static void DynamicModuleLoader_FreeConfiguration(const MODULE_LOADER* loader, MODULE_LOADER_BASE_CONFIGURATION* configuration)
 {
     (void)loader;
-    (void)configuration;
 
-    /**
-     * Nothing to free.
-     */
-    //Codes_SRS_DYNAMIC_MODULE_LOADER_13_051: [ `DynamicModuleLoader_FreeConfiguration` shall do nothing. ]
+    if (configuration != NULL)
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_13_051: [ `DynamicModuleLoader_FreeConfiguration` shall do nothing if `configuration` is `NULL` and free it otherwise. ]
+        free(configuration);
+    }
 }
 
 static void* DynamicModuleLoader_BuildModuleConfiguration(
@@ -333,6 +522,52 @@ static MODULE_LOADER Dynamic_Module_Loader =
     &Dynamic_Module_Loader_API
 };
 
+int DynamicLoader_Initialize(void)
+{
+    int result;
+    if (g_library_cache.init_count > 0)
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_008: [ DynamicLoader_Initialize shall only count the calls after the first that succeeded, and return zero. ]
+        g_library_cache.init_count++;
+        result = 0;
+    }
+    else
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_007: [ DynamicLoader_Initialize shall create the lock of the library cache, and return a non-zero value if it cannot. ]
+        g_library_cache.lock = Lock_Init();
+        if (g_library_cache.lock == NULL)
+        {
+            LogError("Lock_Init failed, native modules cannot be loaded");
+            result = __LINE__;
+        }
+        else
+        {
+            g_library_cache.init_count = 1;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+void DynamicLoader_Deinitialize(void)
+{
+    if (g_library_cache.init_count == 0)
+    {
+        //Codes_SRS_DYNAMIC_MODULE_LOADER_17_009: [ DynamicLoader_Deinitialize shall do nothing if the loader is not initialized. ]
+        LogError("the dynamic loader is not initialized");
+    }
+    else
+    {
+        g_library_cache.init_count--;
+        if (g_library_cache.init_count == 0)
+        {
+            //Codes_SRS_DYNAMIC_MODULE_LOADER_17_010: [ DynamicLoader_Deinitialize shall free the lock of the library cache once it has been called as many times as DynamicLoader_Initialize succeeded. ]
+            Lock_Deinit(g_library_cache.lock);
+            g_library_cache.lock = NULL;
+        }
+    }
+}
+
 const MODULE_LOADER* DynamicLoader_Get(void)
 {
     //Codes_SRS_DYNAMIC_MODULE_LOADER_13_054: [DynamicModuleLoader_Get shall return a non - NULL pointer to a MODULE_LOADER struct.]
@@ -0,0 +1,279 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+#include <stdlib.h>
+#include "azure_c_shared_utility/gballoc.h"
+#include <string.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "parson.h"
+
+#include "module.h"
+#include "module_access.h"
+#include "module_loader.h"
+#include "module_loaders/static_loader.h"
+
+static struct
+{
+    // Table of the modules linked into the executable.
+    const STATIC_LOADER_MODULE* modules;
+    size_t count;
+
+} g_static_modules = { NULL, 0 };
+
+void StaticLoader_SetModules(const STATIC_LOADER_MODULE* modules, size_t count)
+{
+    if (modules == NULL && count != 0)
+    {
+        LogError("NULL table of %zu modules given", count);
+    }
+    else
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_001: [ StaticLoader_SetModules shall replace the table of modules the loader loads from. ]*/
+        g_static_modules.modules = modules;
+        g_static_modules.count = count;
+    }
+}
+
+static MODULE_LIBRARY_HANDLE StaticModuleLoader_Load(const MODULE_LOADER* loader, const void* entrypoint)
+{
+    const STATIC_LOADER_MODULE* result;
+
+    if (loader == NULL || entrypoint == NULL)
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_002: [ StaticModuleLoader_Load shall return NULL if loader or entrypoint is NULL. ]*/
+        result = NULL;
+        LogError(
+            "invalid input - loader = %p, entrypoint = %p",
+            loader, entrypoint
+        );
+    }
+    else if (loader->type != NATIVE_STATIC)
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_003: [ StaticModuleLoader_Load shall return NULL if loader->type is not NATIVE_STATIC. ]*/
+        result = NULL;
+        LogError("loader->type is not NATIVE_STATIC");
+    }
+    else if (((const STATIC_LOADER_ENTRYPOINT*)entrypoint)->moduleName == NULL)
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_004: [ StaticModuleLoader_Load shall return NULL if entrypoint->moduleName is NULL. ]*/
+        result = NULL;
+        LogError("moduleName is NULL");
+    }
+    else
+    {
+        const char* module_name = STRING_c_str(((const STATIC_LOADER_ENTRYPOINT*)entrypoint)->moduleName);
+
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_005: [ StaticModuleLoader_Load shall find the module named by entrypoint->moduleName in the table of modules. ]*/
+        result = NULL;
+        for (size_t i = 0; i < g_static_modules.count && result == NULL; i++)
+        {
+            if (strcmp(g_static_modules.modules[i].name, module_name) == 0)
+            {
+                result = &(g_static_modules.modules[i]);
+            }
+        }
+
+        if (result == NULL)
+        {
+            /*Codes_SRS_STATIC_MODULE_LOADER_17_006: [ StaticModuleLoader_Load shall return NULL if the module is not in the table. ]*/
+            LogError("module %s is not linked into this gateway", module_name);
+        }
+        else
+        {
+            /*Codes_SRS_STATIC_MODULE_LOADER_17_007: [ StaticModuleLoader_Load shall call the module's get_api function to acquire the module API table. ]*/
+            const MODULE_API* api = result->get_api(Module_ApiGatewayVersion);
+            if (api == NULL ||
+                api->version > Module_ApiGatewayVersion ||
+                MODULE_CREATE(api) == NULL ||
+                MODULE_DESTROY(api) == NULL ||
+                MODULE_RECEIVE(api) == NULL)
+            {
+                /*Codes_SRS_STATIC_MODULE_LOADER_17_008: [ StaticModuleLoader_Load shall return NULL if the MODULE_API is NULL, its version is greater than Module_ApiGatewayVersion, or its Module_Create, Module_Destroy or Module_Receive function is NULL. ]*/
+                result = NULL;
+                LogError("module %s returned an invalid API", module_name);
+            }
+        }
+    }
+
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_009: [ StaticModuleLoader_Load shall return the module's entry in the table as its MODULE_LIBRARY_HANDLE when successful. ]*/
+    return (MODULE_LIBRARY_HANDLE)result;
+}
+
+static const MODULE_API* StaticModuleLoader_GetModuleApi(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+
+    const MODULE_API* result;
+
+    if (moduleLibraryHandle == NULL)
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_010: [ StaticModuleLoader_GetModuleApi shall return NULL if moduleLibraryHandle is NULL. ]*/
+        result = NULL;
+        LogError("moduleLibraryHandle is NULL");
+    }
+    else
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_011: [ StaticModuleLoader_GetModuleApi shall return the API table of the module. ]*/
+        const STATIC_LOADER_MODULE* module = (const STATIC_LOADER_MODULE*)moduleLibraryHandle;
+        result = module->get_api(Module_ApiGatewayVersion);
+    }
+
+    return result;
+}
+
+static void StaticModuleLoader_Unload(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE moduleLibraryHandle)
+{
+    (void)loader;
+    (void)moduleLibraryHandle;
+
+    /**
+     * The module is part of the executable, there is nothing to unload.
+     */
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_012: [ StaticModuleLoader_Unload shall do nothing. ]*/
+}
+
+static void* StaticModuleLoader_ParseEntrypointFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    // The input is a JSON object that looks like this:
+    //  "entrypoint": {
+    //      "module.name": "LOGGER_MODULE"
+    //  }
+    STATIC_LOADER_ENTRYPOINT* config;
+    if (json == NULL || json_value_get_type(json) != JSONObject)
+    {
+        LogError("'json' is NULL or not an object value");
+
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_013: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if json is NULL or is not an object. ]*/
+        config = NULL;
+    }
+    else
+    {
+        JSON_Object* entrypoint = json_value_get_object(json);
+        const char* module_name = (entrypoint == NULL) ? NULL : json_object_get_string(entrypoint, "module.name");
+        if (module_name == NULL)
+        {
+            LogError("'module.name' is missing from the entrypoint");
+
+            /*Codes_SRS_STATIC_MODULE_LOADER_17_014: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if module.name does not exist. ]*/
+            config = NULL;
+        }
+        else
+        {
+            config = (STATIC_LOADER_ENTRYPOINT*)malloc(sizeof(STATIC_LOADER_ENTRYPOINT));
+            if (config == NULL)
+            {
+                /*Codes_SRS_STATIC_MODULE_LOADER_17_015: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]*/
+                LogError("malloc failed");
+            }
+            else
+            {
+                /*Codes_SRS_STATIC_MODULE_LOADER_17_016: [ StaticModuleLoader_ParseEntrypointFromJson shall return a STATIC_LOADER_ENTRYPOINT holding the value of module.name. ]*/
+                config->moduleName = STRING_construct(module_name);
+                if (config->moduleName == NULL)
+                {
+                    /*Codes_SRS_STATIC_MODULE_LOADER_17_015: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]*/
+                    LogError("STRING_construct failed");
+                    free(config);
+                    config = NULL;
+                }
+            }
+        }
+    }
+
+    return (void*)config;
+}
+
+static void StaticModuleLoader_FreeEntrypoint(const MODULE_LOADER* loader, void* entrypoint)
+{
+    (void)loader;
+
+    if (entrypoint != NULL)
+    {
+        /*Codes_SRS_STATIC_MODULE_LOADER_17_017: [ StaticModuleLoader_FreeEntrypoint shall free resources allocated during StaticModuleLoader_ParseEntrypointFromJson. ]*/
+        STATIC_LOADER_ENTRYPOINT* ep = (STATIC_LOADER_ENTRYPOINT*)entrypoint;
+        STRING_delete(ep->moduleName);
+        free(ep);
+    }
+    else
+    {
+        LogError("entrypoint is NULL");
+    }
+}
+
+static MODULE_LOADER_BASE_CONFIGURATION* StaticModuleLoader_ParseConfigurationFromJson(const MODULE_LOADER* loader, const JSON_Value* json)
+{
+    (void)loader;
+    (void)json;
+
+    /**
+     * The static loader does not have any configuration so we always return NULL.
+     */
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_018: [ StaticModuleLoader_ParseConfigurationFromJson shall return NULL. ]*/
+    return NULL;
+}
+
+static void StaticModuleLoader_FreeConfiguration(const MODULE_LOADER* loader, MODULE_LOADER_BASE_CONFIGURATION* configuration)
+{
+    (void)loader;
+    (void)configuration;
+
+    /**
+     * Nothing to free.
+     */
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_019: [ StaticModuleLoader_FreeConfiguration shall do nothing. ]*/
+}
+
+static void* StaticModuleLoader_BuildModuleConfiguration(
+    const MODULE_LOADER* loader,
+    const void* entrypoint,
+    const void* module_configuration
+)
+{
+    (void)loader;
+    (void)entrypoint;
+
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_020: [ StaticModuleLoader_BuildModuleConfiguration shall return module_configuration. ]*/
+    return (void *)module_configuration;
+}
+
+static void StaticModuleLoader_FreeModuleConfiguration(const MODULE_LOADER* loader, const void* module_configuration)
+{
+    (void)loader;
+    (void)module_configuration;
+
+    /**
+     * Nothing to free.
+     */
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_021: [ StaticModuleLoader_FreeModuleConfiguration shall do nothing. ]*/
+}
+
+static MODULE_LOADER_API Static_Module_Loader_API =
+{
+    .Load = StaticModuleLoader_Load,
+    .Unload = StaticModuleLoader_Unload,
+    .GetApi = StaticModuleLoader_GetModuleApi,
+
+    .ParseEntrypointFromJson = StaticModuleLoader_ParseEntrypointFromJson,
+    .FreeEntrypoint = StaticModuleLoader_FreeEntrypoint,
+
+    .ParseConfigurationFromJson = StaticModuleLoader_ParseConfigurationFromJson,
+    .FreeConfiguration = StaticModuleLoader_FreeConfiguration,
+
+    .BuildModuleConfiguration = StaticModuleLoader_BuildModuleConfiguration,
+    .FreeModuleConfiguration = StaticModuleLoader_FreeModuleConfiguration
+};
+
+static MODULE_LOADER Static_Module_Loader =
+{
+    NATIVE_STATIC,
+    STATIC_LOADER_NAME,
+    NULL,
+    &Static_Module_Loader_API
+};
+
+const MODULE_LOADER* StaticLoader_Get(void)
+{
+    /*Codes_SRS_STATIC_MODULE_LOADER_17_022: [ StaticLoader_Get shall return a pointer to a MODULE_LOADER of type NATIVE_STATIC named static. ]*/
+    return &Static_Module_Loader;
+}
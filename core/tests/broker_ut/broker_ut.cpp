@@ -14,6 +14,7 @@
 #include "message.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/uniqueid.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "nanomsg/nn.h"
 #include "nanomsg/pubsub.h"
@@ -49,6 +50,7 @@ namespace BASEIMPLEMENTATION
 #include "azure_c_shared_utility/lock.h"
 
 DEFINE_MICROMOCK_ENUM_TO_STRING(BROKER_RESULT, BROKER_RESULT_VALUES);
+DEFINE_MICROMOCK_ENUM_TO_STRING(BROKER_HEALTH_EVENT, BROKER_HEALTH_EVENT_VALUES);
 
 static size_t currentmalloc_call;
 static size_t whenShallmalloc_fail;
@@ -89,8 +91,27 @@ static size_t whenShallCond_Post_fail;
 static size_t currentThreadAPI_Create_call;
 static size_t whenShallThreadAPI_Create_fail;
 
+static size_t currenttickcounter_create_call;
+static size_t whenShalltickcounter_create_fail;
+
+static tickcounter_ms_t fake_current_ms;
+static tickcounter_ms_t fake_receive_duration_ms;
+
+static size_t health_callback_calls;
+static BROKER_HEALTH_EVENT health_callback_event;
+static BROKER_MODULE_HEALTH health_callback_health;
+static size_t health_callback_held_locks;
+
+static size_t tap_callback_calls;
+static BROKER_TAPPED_MESSAGE tap_callback_tapped;
+
 static size_t nn_current_msg_size;
 
+static const unsigned char* nn_recv_data;
+static size_t nn_recv_data_size;
+
+static const char* replica_key_value;
+
 typedef struct LIST_ITEM_INSTANCE_TAG
 {
     const void* item;
@@ -139,9 +160,26 @@ static void FakeModule_Receive(MODULE_HANDLE module, MESSAGE_HANDLE messageHandl
 {
     (void)messageHandle;
     call_status_for_FakeModule_Receive.was_called = true;
+    fake_current_ms += fake_receive_duration_ms;
     ASSERT_ARE_EQUAL(void_ptr, module, call_status_for_FakeModule_Receive.module);
 }
 
+static void FakeHealthCallback(void* context, BROKER_HEALTH_EVENT health_event, const BROKER_MODULE_HEALTH* health)
+{
+    (void)context;
+    health_callback_calls++;
+    health_callback_event = health_event;
+    health_callback_health = *health;
+    health_callback_held_locks = currentLock_call - currentUnlock_call;
+}
+
+static void FakeTapCallback(void* context, const BROKER_TAPPED_MESSAGE* tapped)
+{
+    (void)context;
+    tap_callback_calls++;
+    tap_callback_tapped = *tapped;
+}
+
 static MODULE_API_1 fake_module_apis =
 {
     { MODULE_API_VERSION_1 },
@@ -332,6 +370,31 @@ public:
         auto result2 = THREADAPI_OK;
     MOCK_METHOD_END(THREADAPI_RESULT, result2)
 
+    MOCK_STATIC_METHOD_0(, TICK_COUNTER_HANDLE, tickcounter_create)
+        TICK_COUNTER_HANDLE result2;
+        ++currenttickcounter_create_call;
+        if ((whenShalltickcounter_create_fail > 0) &&
+            (currenttickcounter_create_call == whenShalltickcounter_create_fail))
+        {
+            result2 = NULL;
+        }
+        else
+        {
+            result2 = (TICK_COUNTER_HANDLE)malloc(1);
+        }
+    MOCK_METHOD_END(TICK_COUNTER_HANDLE, result2)
+
+    MOCK_STATIC_METHOD_1(, void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter)
+        free(tick_counter);
+    MOCK_VOID_METHOD_END()
+
+    MOCK_STATIC_METHOD_2(, int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms)
+        *current_ms = fake_current_ms;
+    MOCK_METHOD_END(int, 0)
+
+    MOCK_STATIC_METHOD_1(, void, ThreadAPI_Sleep, unsigned int, milliseconds)
+    MOCK_VOID_METHOD_END()
+
     MOCK_STATIC_METHOD_1(, MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg)
         MESSAGE_HANDLE result2 = (MESSAGE_HANDLE)(new RefCountObject());
     MOCK_METHOD_END(MESSAGE_HANDLE, result2)
@@ -350,6 +413,17 @@ public:
     MOCK_STATIC_METHOD_3(, int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char *, buffer, int32_t, size)
     MOCK_METHOD_END(int32_t, (int32_t)1)
 
+    MOCK_STATIC_METHOD_1(, CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message)
+    MOCK_METHOD_END(CONSTMAP_HANDLE, (CONSTMAP_HANDLE)0x43)
+
+    // constmap.h
+
+    MOCK_STATIC_METHOD_2(, const char*, ConstMap_GetValue, CONSTMAP_HANDLE, handle, const char*, key)
+    MOCK_METHOD_END(const char*, replica_key_value)
+
+    MOCK_STATIC_METHOD_1(, void, ConstMap_Destroy, CONSTMAP_HANDLE, handle)
+    MOCK_VOID_METHOD_END()
+
     // list.h
 
     MOCK_STATIC_METHOD_0(, SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create)
@@ -560,7 +634,13 @@ public:
 
     MOCK_STATIC_METHOD_4(, int, nn_recv, int, s, void*, buf, size_t, len, int, flags)
         int rcv_length;
-        if (len == NN_MSG)
+        if (len == NN_MSG && nn_recv_data != NULL)
+        {
+            (*(void**)buf) = malloc(nn_recv_data_size);
+            memcpy((*(void**)buf), nn_recv_data, nn_recv_data_size);
+            rcv_length = (int)nn_recv_data_size;
+        }
+        else if (len == NN_MSG)
         {
             char * text = (char*)"nn_recv";
             (*(void**)buf) = malloc(8);
@@ -572,6 +652,9 @@ public:
             rcv_length = (int)len;
         }
     MOCK_METHOD_END(int, rcv_length)
+
+    MOCK_STATIC_METHOD_3(, int, nn_poll, struct nn_pollfd*, fds, int, nfds, int, timeout)
+    MOCK_METHOD_END(int, 0)
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void*, gballoc_malloc, size_t, size);
@@ -594,12 +677,22 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , size_t, VECTOR_size, VECTOR_HANDLE,
 
 DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, ThreadAPI_Sleep, unsigned int, milliseconds);
+
+DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , TICK_COUNTER_HANDLE, tickcounter_create);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, tickcounter_destroy, TICK_COUNTER_HANDLE, tick_counter);
+DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , int, tickcounter_get_current_ms, TICK_COUNTER_HANDLE, tick_counter, tickcounter_ms_t*, current_ms);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , MESSAGE_HANDLE, Message_Create, const MESSAGE_CONFIG*, cfg);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , MESSAGE_HANDLE, Message_CreateFromByteArray, const unsigned char*, source, int32_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , int32_t, Message_ToByteArray, MESSAGE_HANDLE, messageHandle, unsigned char *, buffer, int32_t, size);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message);
+
+// constmap.h
+DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , const char*, ConstMap_GetValue, CONSTMAP_HANDLE, handle, const char*, key);
+DECLARE_GLOBAL_MOCK_METHOD_1(CBrokerMocks, , void, ConstMap_Destroy, CONSTMAP_HANDLE, handle);
 
 // singlylinkedlist.h
 DECLARE_GLOBAL_MOCK_METHOD_0(CBrokerMocks, , SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create);
@@ -630,6 +723,7 @@ DECLARE_GLOBAL_MOCK_METHOD_5(CBrokerMocks, , int, nn_setsockopt, int, s, int, le
 DECLARE_GLOBAL_MOCK_METHOD_2(CBrokerMocks, , int, nn_connect, int, s, const char *, addr)
 DECLARE_GLOBAL_MOCK_METHOD_4(CBrokerMocks, , int, nn_send, int, s, const void*, buf, size_t, len, int, flags)
 DECLARE_GLOBAL_MOCK_METHOD_4(CBrokerMocks, , int, nn_recv, int, s, void*, buf, size_t, len, int, flags)
+DECLARE_GLOBAL_MOCK_METHOD_3(CBrokerMocks, , int, nn_poll, struct nn_pollfd*, fds, int, nfds, int, timeout)
 
 BEGIN_TEST_SUITE(broker_ut)
 
@@ -691,6 +785,20 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentThreadAPI_Create_call = 0;
     whenShallThreadAPI_Create_fail = 0;
 
+    currenttickcounter_create_call = 0;
+    whenShalltickcounter_create_fail = 0;
+
+    fake_current_ms = 0;
+    fake_receive_duration_ms = 0;
+
+    health_callback_calls = 0;
+    health_callback_event = BROKER_QUEUE_HIGH_WATERMARK;
+    memset(&health_callback_health, 0, sizeof(BROKER_MODULE_HEALTH));
+    health_callback_held_locks = 0;
+
+    tap_callback_calls = 0;
+    memset(&tap_callback_tapped, 0, sizeof(BROKER_TAPPED_MESSAGE));
+
     current_nn_socket_index = 0;
     for (int l = 0; l < 10; l++)
     {
@@ -699,6 +807,11 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 
     nn_current_msg_size = 0;
 
+    nn_recv_data = NULL;
+    nn_recv_data_size = 0;
+
+    replica_key_value = NULL;
+
     thread_func_to_call = NULL;
     thread_func_args = NULL;
 
@@ -1089,6 +1202,92 @@ TEST_FUNCTION(Broker_AddModule_fails_with_null_module_handle)
     ///cleanup
 }
 //Tests_SRS_BROKER_13_047: [This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise.]
+//Tests_SRS_BROKER_17_043: [ If replica is NULL, or its index is not less than its count, Broker_AddReplicaModule shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_AddReplicaModule_fails_with_null_replica)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    auto result = Broker_AddReplicaModule((BROKER_HANDLE)0x1, &fake_module, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_17_043: [ If replica is NULL, or its index is not less than its count, Broker_AddReplicaModule shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_AddReplicaModule_fails_with_index_out_of_range)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_REPLICA replica = { 2, 2, NULL };
+
+    ///act
+    auto result = Broker_AddReplicaModule((BROKER_HANDLE)0x1, &fake_module, &replica);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_17_044: [ Broker_AddReplicaModule shall copy the replica's key. ]
+//Tests_SRS_BROKER_17_047: [ Otherwise Broker_AddReplicaModule shall add the module as Broker_AddModule does. ]
+TEST_FUNCTION(Broker_AddReplicaModule_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_REPLICA replica = { 2, 1, "deviceId" };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module_info*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG)) /*this is for the module struct*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof("deviceId"))); /*this is for the replica key*/
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, UniqueId_Generate(IGNORED_PTR_ARG, 37))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_construct(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_socket(AF_SP, NN_SUB));
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_connect(IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_length(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, 36))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    ///act
+    auto result = Broker_AddReplicaModule(broker, &fake_module, &replica);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
 TEST_FUNCTION(Broker_AddModule_fails_when_alloc_module_info_fails)
 {
     ///arrange
@@ -1632,7 +1831,7 @@ TEST_FUNCTION(Broker_AddModule_succeeds)
 //Tests_SRS_BROKER_13_092: [ The function shall deliver the message to the module's callback function via module_info->module_apis. ]
 //Tests_SRS_BROKER_13_093: [ The function shall destroy the message that was dequeued by calling Message_Destroy. ]
 //Tests_SRS_BROKER_17_019: [ The function shall free the buffer received on the receive_socket. ]
-//Tests_SRS_BROKER_17_024: [ The function shall strip off the topic from the message. ]
+//Tests_SRS_BROKER_17_024: [ The function shall strip off the topic and the sequence number from the message. ]
 TEST_FUNCTION(module_publish_worker_calls_receive_once_then_exits_on_quit_msg)
 {
     CBrokerMocks mocks;
@@ -1809,6 +2008,168 @@ TEST_FUNCTION(module_publish_worker_exits_on_nn_recv_error)
     Broker_Destroy(broker);
 }
 
+static void set_replica_recv_data(unsigned char* data, uint32_t sequence)
+{
+    MODULE_HANDLE topic = fake_module_handle;
+    memcpy(data, &topic, sizeof(MODULE_HANDLE));
+    memcpy(data + sizeof(MODULE_HANDLE), &sequence, sizeof(uint32_t));
+    data[sizeof(MODULE_HANDLE) + sizeof(uint32_t)] = 0;
+    nn_recv_data = data;
+    nn_recv_data_size = sizeof(MODULE_HANDLE) + sizeof(uint32_t) + 1;
+}
+
+//Tests_SRS_BROKER_17_045: [ A replica without a key shall only take the messages whose sequence number, modulo the replica count, is its index. ]
+TEST_FUNCTION(module_publish_worker_replica_drops_other_replicas_turn)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_REPLICA replica = { 2, 1, NULL };
+    unsigned char data[sizeof(MODULE_HANDLE) + sizeof(uint32_t) + 1];
+
+    (void)Broker_AddReplicaModule(broker, &fake_module, &replica);
+    set_replica_recv_data(data, 4);
+
+    mocks.ResetAllCalls();
+
+    //loop 1
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(-1);
+
+    auto result = thread_func_to_call(thread_func_args);
+
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_IS_FALSE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_045: [ A replica without a key shall only take the messages whose sequence number, modulo the replica count, is its index. ]
+//Tests_SRS_BROKER_17_024: [ The function shall strip off the topic and the sequence number from the message. ]
+TEST_FUNCTION(module_publish_worker_replica_takes_its_turn)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_REPLICA replica = { 2, 1, NULL };
+    unsigned char data[sizeof(MODULE_HANDLE) + sizeof(uint32_t) + 1];
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+
+    (void)Broker_AddReplicaModule(broker, &fake_module, &replica);
+    set_replica_recv_data(data, 5);
+
+    mocks.ResetAllCalls();
+
+    //loop 1
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(-1);
+
+    auto result = thread_func_to_call(thread_func_args);
+
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_046: [ A replica with a key shall take the messages whose key property hashes to its index, and take turns on messages without the property. ]
+TEST_FUNCTION(module_publish_worker_keyed_replica_picks_message_by_key)
+{
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    /*FNV-1a of "abc" is 0x1A47E90B, odd, so the message belongs to replica 1*/
+    BROKER_REPLICA replica = { 2, 1, "deviceId" };
+    unsigned char data[sizeof(MODULE_HANDLE) + sizeof(uint32_t) + 1];
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    replica_key_value = "abc";
+
+    (void)Broker_AddReplicaModule(broker, &fake_module, &replica);
+    set_replica_recv_data(data, 4);
+
+    mocks.ResetAllCalls();
+
+    //loop 1
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_GetProperties(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ConstMap_GetValue((CONSTMAP_HANDLE)0x43, "deviceId"));
+    STRICT_EXPECTED_CALL(mocks, ConstMap_Destroy((CONSTMAP_HANDLE)0x43));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(-1);
+
+    auto result = thread_func_to_call(thread_func_args);
+
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_IS_TRUE(call_status_for_FakeModule_Receive.was_called);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
 //Tests_SRS_BROKER_13_068: [ This function shall run a loop that keeps running until module_info->quit_message_guid is sent to the thread. ]
 TEST_FUNCTION(module_publish_worker_message_size_matches_but_not_quit_for_me)
 {
@@ -2332,20 +2693,819 @@ TEST_FUNCTION(Broker_RemoveModule_succeeds_even_when_unlock_fails)
     Broker_Destroy(broker);
 }
 
-//Tests_SRS_BROKER_17_029: [ If broker, link, link->module_source_handle or link->module_sink_handle are NULL, Broker_AddLink shall return BROKER_INVALIDARG. ]
-TEST_FUNCTION(Broker_AddLink_null_broker_fails)
+//Tests_SRS_BROKER_17_050: [ If the drain timeout is not 0, Broker_RemoveModule shall let the worker thread deliver the messages queued ahead of the quit signal until they are all delivered or the drain timeout expires. ]
+//Tests_SRS_BROKER_17_052: [ If the drain timeout expires, Broker_RemoveModule shall count the messages still queued ahead of the quit signal as dropped. ]
+//Tests_SRS_BROKER_17_056: [ Broker_RemoveModule shall stop the module after releasing BROKER_HANDLE_DATA::modules_lock, so that the module can still publish while it drains. ]
+TEST_FUNCTION(Broker_RemoveModule_drops_messages_left_when_drain_times_out)
 {
     ///arrange
     CBrokerMocks mocks;
-    BROKER_HANDLE broker = NULL;
-    BROKER_LINK_DATA bld =
-    {
-        fake_module_handle,
-        fake_module_handle
-    };
-
-    ///act
-    auto result = Broker_AddLink(broker, &bld);
+    auto broker = Broker_Create();
+    (void)Broker_SetDrainTimeout(broker, 20);
+    auto result = Broker_AddModule(broker, &fake_module);
+    mocks.ResetAllCalls();
+
+    // this is for the Broker_RemoveModule call
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // the worker never reaches the quit signal, so the drain waits it out
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10));
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Sleep(10));
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is the lock protecting mq_lock*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetFailReturn(-1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // adding up the drain statistics
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_RemoveModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    BROKER_DRAIN_STATISTICS statistics;
+    ASSERT_ARE_EQUAL(BROKER_RESULT, BROKER_OK, Broker_GetDrainStatistics(broker, &statistics));
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.drained_messages);
+    ASSERT_ARE_EQUAL(size_t, 1, statistics.dropped_messages);
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_050: [ If the drain timeout is not 0, Broker_RemoveModule shall let the worker thread deliver the messages queued ahead of the quit signal until they are all delivered or the drain timeout expires. ]
+TEST_FUNCTION(Broker_RemoveModule_drain_ends_once_worker_reached_quit)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    (void)Broker_SetDrainTimeout(broker, 20);
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    // let the worker dequeue its quit signal
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+    (void)thread_func_to_call(thread_func_args);
+    mocks.ResetAllCalls();
+
+    // this is for the Broker_RemoveModule call
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &fake_module))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, 37, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)) /*this is the lock protecting mq_lock*/
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_close(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    result = Broker_RemoveModule(broker, &fake_module);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_049: [ If broker is NULL, Broker_SetDrainTimeout shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_SetDrainTimeout_fails_with_null_broker)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    ///act
+    auto result = Broker_SetDrainTimeout(NULL, 20);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+//Tests_SRS_BROKER_17_053: [ Broker_SetDrainTimeout shall store drain_timeout_ms as the drain timeout of the modules removed afterwards. ]
+TEST_FUNCTION(Broker_SetDrainTimeout_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetDrainTimeout(broker, 20);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_054: [ If broker or statistics is NULL, Broker_GetDrainStatistics shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_GetDrainStatistics_fails_with_null_args)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_DRAIN_STATISTICS statistics;
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_GetDrainStatistics(NULL, &statistics);
+    auto result2 = Broker_GetDrainStatistics(broker, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_055: [ Broker_GetDrainStatistics shall copy the counts of drained and dropped messages into statistics. ]
+TEST_FUNCTION(Broker_GetDrainStatistics_starts_at_zero)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_DRAIN_STATISTICS statistics = { 1, 1 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_GetDrainStatistics(broker, &statistics);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.drained_messages);
+    ASSERT_ARE_EQUAL(size_t, 0, statistics.dropped_messages);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_059: [ If broker is NULL, or budgets is not NULL and callback is NULL, or the recovery time exceeds the receive budget, or the low watermark is not below a non-zero high watermark, Broker_SetHealthMonitor shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_SetHealthMonitor_fails_with_invalid_args)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    BROKER_HEALTH_BUDGETS slow_recovery = { 10, 11, 0, 0 };
+    BROKER_HEALTH_BUDGETS high_low_watermark = { 0, 0, 4, 4 };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_SetHealthMonitor(NULL, &budgets, FakeHealthCallback, NULL);
+    auto result2 = Broker_SetHealthMonitor(broker, &budgets, NULL, NULL);
+    auto result3 = Broker_SetHealthMonitor(broker, &slow_recovery, FakeHealthCallback, NULL);
+    auto result4 = Broker_SetHealthMonitor(broker, &high_low_watermark, FakeHealthCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result4, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_060: [ Broker_SetHealthMonitor shall store budgets, callback and context, stop monitoring when budgets is NULL, and count the queued messages of every module from zero. ]
+TEST_FUNCTION(Broker_SetHealthMonitor_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_060: [ Broker_SetHealthMonitor shall store budgets, callback and context, stop monitoring when budgets is NULL, and count the queued messages of every module from zero. ]
+TEST_FUNCTION(Broker_SetHealthMonitor_null_budgets_stops_monitoring)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 0, 0, 1, 0 };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddLink(broker, &bld);
+    (void)Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+
+    ///act
+    auto result = Broker_SetHealthMonitor(broker, NULL, NULL, NULL);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, health_callback_calls);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_065: [ If locking modules_lock or creating the tick counter fails, Broker_SetHealthMonitor shall return BROKER_ERROR. ]
+TEST_FUNCTION(Broker_SetHealthMonitor_fails_when_tickcounter_create_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    mocks.ResetAllCalls();
+
+    whenShalltickcounter_create_fail = 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_create());
+
+    ///act
+    auto result = Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_061: [ While the broker is monitored, Broker_Publish shall count the message in the queue of every module linked to source. ]
+//Tests_SRS_BROKER_17_062: [ Broker_Publish shall call the health callback with BROKER_QUEUE_HIGH_WATERMARK when the queue of a module linked to source reaches the high watermark, unless it already did and the queue has not dropped to the low watermark since. ]
+//Tests_SRS_BROKER_17_080: [ Broker_Publish shall call the health callback after it unlocks the modules lock. ]
+TEST_FUNCTION(Broker_Publish_raises_queue_high_watermark_once)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 0, 0, 2, 1 };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddLink(broker, &bld);
+    (void)Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto calls_below_watermark = health_callback_calls;
+    auto result2 = Broker_Publish(broker, fake_module_handle, message);
+    auto result3 = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, calls_below_watermark);
+    ASSERT_ARE_EQUAL(size_t, 1, health_callback_calls);
+    ASSERT_ARE_EQUAL(BROKER_HEALTH_EVENT, BROKER_QUEUE_HIGH_WATERMARK, health_callback_event);
+    ASSERT_ARE_EQUAL(void_ptr, fake_module_handle, health_callback_health.module_handle);
+    ASSERT_ARE_EQUAL(size_t, 2, health_callback_health.queue_depth);
+    ASSERT_ARE_EQUAL(size_t, 0, health_callback_held_locks);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_061: [ While the broker is monitored, Broker_Publish shall count the message in the queue of every module linked to source. ]
+TEST_FUNCTION(Broker_Publish_does_not_count_unlinked_modules)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 0, 0, 1, 0 };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+
+    ///act
+    auto result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, health_callback_calls);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_057: [ While the broker is monitored, the function shall time the call to the module's receive function. ]
+//Tests_SRS_BROKER_17_058: [ The function shall call the health callback with BROKER_MODULE_SLOW when the module's receive function takes longer than the receive budget, unless it already did and no call has taken at most the recovery time since. ]
+//Tests_SRS_BROKER_17_078: [ While the broker is monitored, the function shall count the module's queue from zero again whenever it finds no message left on the receive_socket. ]
+//Tests_SRS_BROKER_17_079: [ The function shall call the health callback after it unlocks modules_lock. ]
+TEST_FUNCTION(module_worker_raises_module_slow)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 0, 0 };
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    fake_receive_duration_ms = 20;
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+    mocks.ResetAllCalls();
+
+    //loop 1
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_poll(IGNORED_PTR_ARG, 1, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, tickcounter_get_current_ms(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //loop 2
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+
+    ///act
+    auto result = thread_func_to_call(thread_func_args);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(size_t, 1, health_callback_calls);
+    ASSERT_ARE_EQUAL(BROKER_HEALTH_EVENT, BROKER_MODULE_SLOW, health_callback_event);
+    ASSERT_ARE_EQUAL(void_ptr, fake_module_handle, health_callback_health.module_handle);
+    ASSERT_ARE_EQUAL(int, 20, (int)health_callback_health.receive_time_ms);
+    ASSERT_ARE_EQUAL(size_t, 0, health_callback_held_locks);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_078: [ While the broker is monitored, the function shall count the module's queue from zero again whenever it finds no message left on the receive_socket. ]
+TEST_FUNCTION(module_worker_counts_the_queue_from_zero_once_it_is_empty)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_HEALTH_BUDGETS budgets = { 0, 0, 3, 0 };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    call_status_for_FakeModule_Receive.module = fake_module.module_handle;
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddLink(broker, &bld);
+    (void)Broker_SetHealthMonitor(broker, &budgets, FakeHealthCallback, NULL);
+    // the publish socket dropped all but one of the messages counted here
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(37);
+    STRICT_EXPECTED_CALL(mocks, STRING_c_str(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn("nn_recv");
+
+    ///act
+    auto result = thread_func_to_call(thread_func_args);
+    auto calls_before_refill = health_callback_calls;
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, result, 0);
+    ASSERT_ARE_EQUAL(size_t, 1, calls_before_refill);
+    ASSERT_ARE_EQUAL(size_t, 2, health_callback_calls);
+    ASSERT_ARE_EQUAL(BROKER_HEALTH_EVENT, BROKER_QUEUE_HIGH_WATERMARK, health_callback_event);
+    ASSERT_ARE_EQUAL(size_t, 3, health_callback_health.queue_depth);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_034: [ Upon an error, Broker_AddLink shall return BROKER_ADD_LINK_ERROR ]
+TEST_FUNCTION(Broker_AddLink_fails_when_remembering_source_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    auto result = Broker_AddModule(broker, &fake_module);
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+    mocks.ResetAllCalls();
+
+    whenShallVECTOR_push_back_fail = currentVECTOR_push_back_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+
+    ///act
+    result = Broker_AddLink(broker, &bld);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ADD_LINK_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_066: [ If broker is NULL, or tap is not NULL and callback is NULL or the sample interval is 0, Broker_SetMessageTap shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_SetMessageTap_fails_with_invalid_args)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 4, false };
+    BROKER_MESSAGE_TAP no_interval = { 0, false };
+    mocks.ResetAllCalls();
+
+    ///act
+    auto result1 = Broker_SetMessageTap(NULL, &tap, FakeTapCallback, NULL);
+    auto result2 = Broker_SetMessageTap(broker, &tap, NULL, NULL);
+    auto result3 = Broker_SetMessageTap(broker, &no_interval, FakeTapCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_068: [ Broker_SetMessageTap shall store tap, callback and context, remove the tap when tap is NULL, and count the published messages of every module from zero. ]
+TEST_FUNCTION(Broker_SetMessageTap_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 4, false };
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_067: [ If locking modules_lock fails, Broker_SetMessageTap shall return BROKER_ERROR. ]
+TEST_FUNCTION(Broker_SetMessageTap_fails_when_lock_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 4, false };
+    mocks.ResetAllCalls();
+
+    whenShallLock_fail = currentLock_call + 1;
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    ///act
+    auto result = Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_069: [ While the broker is tapped, Broker_Publish shall hand 1 in sample_interval of the messages each source publishes to the tap. ]
+//Tests_SRS_BROKER_17_070: [ Broker_Publish shall only hand the message itself to the tap when the tap includes the message. ]
+TEST_FUNCTION(Broker_Publish_taps_one_in_sample_interval_messages)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 2, false };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto calls_after_first = tap_callback_calls;
+    auto result2 = Broker_Publish(broker, fake_module_handle, message);
+    auto result3 = Broker_Publish(broker, fake_module_handle, message);
+    auto result4 = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result4, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, calls_after_first);
+    ASSERT_ARE_EQUAL(size_t, 2, tap_callback_calls);
+    ASSERT_ARE_EQUAL(void_ptr, fake_module_handle, tap_callback_tapped.source);
+    ASSERT_ARE_EQUAL(int, 3, (int)tap_callback_tapped.sequence);
+    ASSERT_ARE_EQUAL(size_t, 1, tap_callback_tapped.message_size);
+    ASSERT_IS_NULL(tap_callback_tapped.message);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_070: [ Broker_Publish shall only hand the message itself to the tap when the tap includes the message. ]
+TEST_FUNCTION(Broker_Publish_taps_message_when_included)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 1, true };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///act
+    auto result = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 1, tap_callback_calls);
+    ASSERT_ARE_EQUAL(void_ptr, message, tap_callback_tapped.message);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_068: [ Broker_SetMessageTap shall store tap, callback and context, remove the tap when tap is NULL, and count the published messages of every module from zero. ]
+TEST_FUNCTION(Broker_SetMessageTap_null_tap_removes_tap)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    BROKER_MESSAGE_TAP tap = { 1, false };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///act
+    auto result = Broker_SetMessageTap(broker, NULL, NULL, NULL);
+    (void)Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 0, tap_callback_calls);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_029: [ If broker, link, link->module_source_handle or link->module_sink_handle are NULL, Broker_AddLink shall return BROKER_INVALIDARG. ]
+TEST_FUNCTION(Broker_AddLink_null_broker_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    BROKER_HANDLE broker = NULL;
+    BROKER_LINK_DATA bld =
+    {
+        fake_module_handle,
+        fake_module_handle
+    };
+
+    ///act
+    auto result = Broker_AddLink(broker, &bld);
 
     ///assert
     ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_INVALIDARG);
@@ -2424,6 +3584,7 @@ TEST_FUNCTION(Broker_AddLink_null_sink_fails)
 //Tests_SRS_BROKER_17_041: [ Broker_AddLink shall find the BROKER_HANDLE_DATA::module_info for link->module_source_handle. ]
 //Tests_SRS_BROKER_17_032: [ Broker_AddLink shall subscribe module_info->receive_socket to the link->module_source_handle module handle. ]
 //Tests_SRS_BROKER_17_033: [ Broker_AddLink shall unlock the modules_lock. ]
+//Tests_SRS_BROKER_17_063: [ Broker_AddLink shall remember link->module_source_handle as a source of the sink module, so that the messages queued for the sink can be counted. ]
 TEST_FUNCTION(Broker_AddLink_succeeds)
 {
     ///arrange
@@ -2455,6 +3616,10 @@ TEST_FUNCTION(Broker_AddLink_succeeds)
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_SUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_HANDLE)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
 
     BROKER_LINK_DATA bld =
     {
@@ -2731,6 +3896,7 @@ TEST_FUNCTION(Broker_RemoveLink_null_sink_fails)
 //Tests_SRS_BROKER_17_042: [ Broker_RemoveLink shall find the module_info for link->module_source_handle. ]
 //Tests_SRS_BROKER_17_038: [ Broker_RemoveLink shall unsubscribe module_info->receive_socket from the link->module_source_handle module handle. ]
 //Tests_SRS_BROKER_17_039: [ Broker_RemoveLink shall unlock the modules_lock. ]
+//Tests_SRS_BROKER_17_064: [ Broker_RemoveLink shall forget link->module_source_handle as a source of the sink module. ]
 TEST_FUNCTION(Broker_RemoveLink_succeeds)
 {
     ///arrange
@@ -2770,6 +3936,11 @@ TEST_FUNCTION(Broker_RemoveLink_succeeds)
     STRICT_EXPECTED_CALL(mocks, nn_setsockopt(IGNORED_NUM_ARG, NN_SUB, NN_SUB_UNSUBSCRIBE, IGNORED_PTR_ARG, sizeof(MODULE_HANDLE)))
         .IgnoreArgument(1)
         .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
 
     ///act
     result = Broker_RemoveLink(broker, &bld);
@@ -3245,7 +4416,7 @@ TEST_FUNCTION(Broker_Publish_fails_when_allocmsg_fails)
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE) + sizeof(uint32_t), 0))
         .SetFailReturn(nullptr);
 
     ///act
@@ -3286,7 +4457,7 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE) + sizeof(uint32_t), 0))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, nn_freemsg(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -3313,7 +4484,7 @@ TEST_FUNCTION(Broker_Publish_fails_when_send_fails)
 //Tests_SRS_BROKER_17_022: [ Broker_Publish shall Lock the modules lock. ]
 //Tests_SRS_BROKER_17_007: [Broker_Publish shall clone the message.]
 //Tests_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ]
-//Tests_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ]
+//Tests_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE) + sizeof(uint32_t). ]
 //Tests_SRS_BROKER_17_026: [ Broker_Publish shall copy source into the beginning of the nanomsg buffer. ]
 //Tests_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ]
 //Tests_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ]
@@ -3345,7 +4516,7 @@ TEST_FUNCTION(Broker_Publish_succeeds)
     STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
     STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
-    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE), 0))
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE) + sizeof(uint32_t), 0))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(2);
@@ -3368,4 +4539,296 @@ TEST_FUNCTION(Broker_Publish_succeeds)
 }
 
 
+//Tests_SRS_BROKER_17_071: [ Broker_PublishBatch shall return BROKER_INVALIDARG if broker, source or messages is NULL, count is 0, or any of the messages is NULL. ]
+TEST_FUNCTION(Broker_PublishBatch_fails_with_invalid_args)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    MESSAGE_HANDLE messages[] = { (MESSAGE_HANDLE)0x1, (MESSAGE_HANDLE)0x2 };
+    MESSAGE_HANDLE with_null[] = { (MESSAGE_HANDLE)0x1, NULL };
+
+    ///act
+    auto r1 = Broker_PublishBatch(NULL, fake_module_handle, messages, 2);
+    auto r2 = Broker_PublishBatch((BROKER_HANDLE)0x1, NULL, messages, 2);
+    auto r3 = Broker_PublishBatch((BROKER_HANDLE)0x1, fake_module_handle, NULL, 2);
+    auto r4 = Broker_PublishBatch((BROKER_HANDLE)0x1, fake_module_handle, messages, 0);
+    auto r5 = Broker_PublishBatch((BROKER_HANDLE)0x1, fake_module_handle, with_null, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r1, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r2, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r3, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r4, BROKER_INVALIDARG);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, r5, BROKER_INVALIDARG);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+}
+
+//Tests_SRS_BROKER_17_076: [ Broker_PublishBatch shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]
+TEST_FUNCTION(Broker_PublishBatch_fails_when_Lock_fails)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[] = { message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_PublishBatch
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetFailReturn(LOCK_ERROR);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_074: [ Broker_PublishBatch shall stop at the first message it fails to publish. ]
+//Tests_SRS_BROKER_17_075: [ Broker_PublishBatch shall Unlock the modules lock. ]
+//Tests_SRS_BROKER_17_076: [ Broker_PublishBatch shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]
+TEST_FUNCTION(Broker_PublishBatch_stops_at_first_failure)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[] = { message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_PublishBatch, the second message is never published
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+    STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+    STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+    STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE) + sizeof(uint32_t), 0))
+        .SetFailReturn(nullptr);
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_ERROR);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_072: [ Broker_PublishBatch shall Lock the modules lock once for the whole batch. ]
+//Tests_SRS_BROKER_17_077: [ Broker_PublishBatch shall look source up among the broker's modules once for the whole batch. ]
+//Tests_SRS_BROKER_17_073: [ Broker_PublishBatch shall publish the messages in order, each the way Broker_Publish publishes a message. ]
+//Tests_SRS_BROKER_17_075: [ Broker_PublishBatch shall Unlock the modules lock. ]
+//Tests_SRS_BROKER_17_076: [ Broker_PublishBatch shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ]
+TEST_FUNCTION(Broker_PublishBatch_succeeds)
+{
+    ///arrange
+    CBrokerMocks mocks;
+
+    auto broker = Broker_Create();
+
+    // create a message to send
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[] = { message, message };
+
+    auto result = Broker_AddModule(broker, &fake_module);
+
+    mocks.ResetAllCalls();
+
+    // this is for Broker_PublishBatch
+    STRICT_EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    for (int i = 0; i < 2; i++)
+    {
+        STRICT_EXPECTED_CALL(mocks, Message_Clone(message));
+        STRICT_EXPECTED_CALL(mocks, Message_Destroy(message));
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, NULL, 0));
+        STRICT_EXPECTED_CALL(mocks, nn_allocmsg(1 + sizeof(MODULE_HANDLE) + sizeof(uint32_t), 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, Message_ToByteArray(message, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+    }
+
+    ///act
+    result = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result, BROKER_OK);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_048: [ Broker_Publish shall copy source's next sequence number after source, numbering the messages of each module of the broker separately and the messages of any other source together. ]
+TEST_FUNCTION(Broker_Publish_numbers_each_source_separately)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    MODULE other_module = { (const MODULE_API *)&fake_module_apis, (MODULE_HANDLE)0x43 };
+    BROKER_MESSAGE_TAP tap = { 1, false };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddModule(broker, &other_module);
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto result2 = Broker_Publish(broker, other_module.module_handle, message);
+    auto other_sequence = tap_callback_tapped.sequence;
+    auto result3 = Broker_Publish(broker, fake_module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 3, tap_callback_calls);
+    ASSERT_ARE_EQUAL(int, 0, (int)other_sequence);
+    ASSERT_ARE_EQUAL(void_ptr, fake_module_handle, tap_callback_tapped.source);
+    ASSERT_ARE_EQUAL(int, 1, (int)tap_callback_tapped.sequence);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &other_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_048: [ Broker_Publish shall copy source's next sequence number after source, numbering the messages of each module of the broker separately and the messages of any other source together. ]
+//Tests_SRS_BROKER_17_073: [ Broker_PublishBatch shall publish the messages in order, each the way Broker_Publish publishes a message. ]
+TEST_FUNCTION(Broker_PublishBatch_continues_the_sequence_of_source)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    MODULE other_module = { (const MODULE_API *)&fake_module_apis, (MODULE_HANDLE)0x43 };
+    BROKER_MESSAGE_TAP tap = { 1, false };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    MESSAGE_HANDLE messages[] = { message, message };
+    (void)Broker_AddModule(broker, &fake_module);
+    (void)Broker_AddModule(broker, &other_module);
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+
+    ///act
+    auto result1 = Broker_Publish(broker, fake_module_handle, message);
+    auto result2 = Broker_PublishBatch(broker, other_module.module_handle, messages, 2);
+    auto result3 = Broker_PublishBatch(broker, fake_module_handle, messages, 2);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(size_t, 5, tap_callback_calls);
+    ASSERT_ARE_EQUAL(void_ptr, fake_module_handle, tap_callback_tapped.source);
+    ASSERT_ARE_EQUAL(int, 2, (int)tap_callback_tapped.sequence);
+
+    ///cleanup
+    Message_Destroy(message);
+    Broker_RemoveModule(broker, &other_module);
+    Broker_RemoveModule(broker, &fake_module);
+    Broker_Destroy(broker);
+}
+
+//Tests_SRS_BROKER_17_082: [ Broker_AddModule shall add the new instance of BROKER_MODULEINFO to the source index, keyed by the module's handle. ]
+//Tests_SRS_BROKER_17_083: [ Broker_RemoveModule shall remove the module from the source index. ]
+//Tests_SRS_BROKER_17_084: [ Broker_Publish shall find source among the broker's modules in the source index. ]
+TEST_FUNCTION(Broker_Publish_finds_source_after_modules_are_added_and_removed)
+{
+    ///arrange
+    CBrokerMocks mocks;
+    auto broker = Broker_Create();
+    /* enough modules to move the source index out of the broker handle */
+    MODULE modules[8];
+    BROKER_MESSAGE_TAP tap = { 1, false };
+    unsigned char fake;
+    MESSAGE_CONFIG c = { 1, &fake, (MAP_HANDLE)&fake };
+    auto message = Message_Create(&c);
+    for (size_t i = 0; i < 8; i++)
+    {
+        modules[i].module_apis = (const MODULE_API *)&fake_module_apis;
+        modules[i].module_handle = (MODULE_HANDLE)(0x100 + i);
+        (void)Broker_AddModule(broker, &modules[i]);
+    }
+    for (size_t i = 0; i < 8; i += 2)
+    {
+        (void)Broker_RemoveModule(broker, &modules[i]);
+    }
+    (void)Broker_SetMessageTap(broker, &tap, FakeTapCallback, NULL);
+    mocks.ResetAllCalls();
+
+    EXPECTED_CALL(mocks, singlylinkedlist_find(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    ///act
+    auto result1 = Broker_Publish(broker, modules[5].module_handle, message);
+    auto result2 = Broker_Publish(broker, modules[5].module_handle, message);
+    auto kept_sequence = tap_callback_tapped.sequence;
+    auto result3 = Broker_Publish(broker, modules[6].module_handle, message);
+    auto removed_sequence = tap_callback_tapped.sequence;
+    auto result4 = Broker_Publish(broker, modules[4].module_handle, message);
+
+    ///assert
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result1, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result2, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result3, BROKER_OK);
+    ASSERT_ARE_EQUAL(BROKER_RESULT, result4, BROKER_OK);
+    ASSERT_ARE_EQUAL(int, 1, (int)kept_sequence);
+    ASSERT_ARE_EQUAL(int, 0, (int)removed_sequence);
+    /* removed modules are no longer sources of the broker, so they share its numbering */
+    ASSERT_ARE_EQUAL(int, 1, (int)tap_callback_tapped.sequence);
+    mocks.AssertActualAndExpectedCalls();
+
+    ///cleanup
+    Message_Destroy(message);
+    for (size_t i = 1; i < 8; i += 2)
+    {
+        (void)Broker_RemoveModule(broker, &modules[i]);
+    }
+    Broker_Destroy(broker);
+}
+
 END_TEST_SUITE(broker_ut)
@@ -101,6 +101,25 @@ TEST_FUNCTION(DynamicLibrary_LoadLibrary_returns_correct_value)
     ///cleanup
 }
 
+// Tests_SRS_DYNAMIC_LIBRARY_17_004: [DynamicLibrary_LoadLibraryEager shall load the named library like DynamicLibrary_LoadLibrary, resolving all of its symbols before returning.]
+TEST_FUNCTION(DynamicLibrary_LoadLibraryEager_binds_now)
+{
+    CDynamicLibraryMocks mocks;
+
+    ///arrange
+    const char* moduleFileName = LIBRARY_NAME;
+
+    STRICT_EXPECTED_CALL(mocks, gb_dlopen(moduleFileName, RTLD_NOW));
+
+    ///act
+    auto lib = DynamicLibrary_LoadLibraryEager(moduleFileName);
+
+    ///assert
+    ASSERT_ARE_EQUAL(void_ptr, lib, LOAD_LIBRARY_RETURN);
+
+    ///cleanup
+}
+
 // Tests_SRS_DYNAMIC_LIBRARY_17_002: [DynamicLibrary_UnloadLibrary shall make the OS system call to unload the library referenced by libraryHandle.]
 TEST_FUNCTION(DynamicLibrary_UnloadLibrary_Success)
 {
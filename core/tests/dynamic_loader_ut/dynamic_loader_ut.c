@@ -183,6 +183,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(JSON_Value_Type, int);
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_API_VERSION, int);
     REGISTER_GLOBAL_MOCK_RETURN(DynamicLibrary_LoadLibrary, (DYNAMIC_LIBRARY_HANDLE)0x42);
+    REGISTER_GLOBAL_MOCK_RETURN(DynamicLibrary_LoadLibraryEager, (DYNAMIC_LIBRARY_HANDLE)0x42);
     REGISTER_GLOBAL_MOCK_RETURN(DynamicLibrary_FindSymbol, (void*)0x42);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(json_value_get_object, NULL);
 
@@ -197,6 +198,8 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_GLOBAL_MOCK_HOOK(STRING_c_str, real_STRING_c_str);
     REGISTER_GLOBAL_MOCK_FAIL_RETURN(STRING_clone, NULL);
 
+    ASSERT_ARE_EQUAL(int, 0, DynamicLoader_Initialize());
+
     const MODULE_LOADER* loader = DynamicLoader_Get();
     DynamicModuleLoader_Load = loader->api->Load;
     DynamicModuleLoader_Unload = loader->api->Unload;
@@ -211,6 +214,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 
 TEST_SUITE_CLEANUP(TestClassCleanup)
 {
+    DynamicLoader_Deinitialize();
     umock_c_deinit();
 
     TEST_MUTEX_DESTROY(g_testByTest);
@@ -566,6 +570,195 @@ TEST_FUNCTION(DynamicModuleLoader_Load_succeeds)
     STRING_delete(entrypoint.moduleLibraryFileName);
 }
 
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_001: [ If the library has already been loaded from the same path and not unloaded as many times, DynamicModuleLoader_Load shall return the same MODULE_LIBRARY_HANDLE without loading the library again. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_003: [ DynamicModuleLoader_Unload shall keep the library loaded until it has been unloaded as many times as it was loaded. ]
+TEST_FUNCTION(DynamicModuleLoader_Load_reuses_loaded_library)
+{
+    // arrange
+    MODULE_LOADER loader =
+    {
+        NATIVE,
+        NULL, NULL, NULL
+    };
+    DYNAMIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("boo") };
+    MODULE_API_1 api =
+    {
+        {
+            MODULE_API_VERSION_1
+        },
+        NULL,
+        NULL,
+        (pfModule_Create)0x42,
+        (pfModule_Destroy)0x42,
+        (pfModule_Receive)0x42,
+        NULL
+    };
+    STRICT_EXPECTED_CALL(DynamicLibrary_FindSymbol(IGNORED_PTR_ARG, MODULE_GETAPI_NAME))
+        .IgnoreArgument(1)
+        .SetReturn((void*)Fake_GetAPI);
+    STRICT_EXPECTED_CALL(Fake_GetAPI((MODULE_API_VERSION)IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((MODULE_API*)&api);
+    MODULE_LIBRARY_HANDLE first = DynamicModuleLoader_Load(&loader, &entrypoint);
+    ASSERT_IS_NOT_NULL(first);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(STRING_c_str(entrypoint.moduleLibraryFileName));
+
+    // act
+    MODULE_LIBRARY_HANDLE second = DynamicModuleLoader_Load(&loader, &entrypoint);
+    DynamicModuleLoader_Unload(&loader, first);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, first, second);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(DynamicLibrary_UnloadLibrary((DYNAMIC_LIBRARY_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    DynamicModuleLoader_Unload(&loader, second);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    STRING_delete(entrypoint.moduleLibraryFileName);
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_010: [ DynamicLoader_Deinitialize shall free the lock of the library cache once it has been called as many times as DynamicLoader_Initialize succeeded. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_13_003: [ DynamicModuleLoader_Load shall return NULL if an underlying platform call fails. ]
+TEST_FUNCTION(DynamicModuleLoader_Load_returns_NULL_when_the_loader_is_not_initialized)
+{
+    // arrange
+    MODULE_LOADER loader =
+    {
+        NATIVE,
+        NULL, NULL, NULL
+    };
+    DYNAMIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("boo") };
+    DynamicLoader_Deinitialize();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(STRING_c_str(entrypoint.moduleLibraryFileName));
+
+    // act
+    MODULE_LIBRARY_HANDLE result = DynamicModuleLoader_Load(&loader, &entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    ASSERT_ARE_EQUAL(int, 0, DynamicLoader_Initialize());
+    STRING_delete(entrypoint.moduleLibraryFileName);
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_008: [ DynamicLoader_Initialize shall only count the calls after the first that succeeded, and return zero. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_010: [ DynamicLoader_Deinitialize shall free the lock of the library cache once it has been called as many times as DynamicLoader_Initialize succeeded. ]
+TEST_FUNCTION(DynamicLoader_Deinitialize_keeps_the_loader_until_every_initialize_is_undone)
+{
+    // arrange
+    MODULE_LOADER loader =
+    {
+        NATIVE,
+        NULL, NULL, NULL
+    };
+    DYNAMIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("boo") };
+    MODULE_API_1 api =
+    {
+        {
+            MODULE_API_VERSION_1
+        },
+        NULL,
+        NULL,
+        (pfModule_Create)0x42,
+        (pfModule_Destroy)0x42,
+        (pfModule_Receive)0x42,
+        NULL
+    };
+    int init_result = DynamicLoader_Initialize();
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(DynamicLibrary_FindSymbol(IGNORED_PTR_ARG, MODULE_GETAPI_NAME))
+        .IgnoreArgument(1)
+        .SetReturn((void*)Fake_GetAPI);
+    STRICT_EXPECTED_CALL(Fake_GetAPI((MODULE_API_VERSION)IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((MODULE_API*)&api);
+
+    // act
+    DynamicLoader_Deinitialize();
+    MODULE_LIBRARY_HANDLE result = DynamicModuleLoader_Load(&loader, &entrypoint);
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, init_result);
+    ASSERT_IS_NOT_NULL(result);
+
+    // cleanup
+    DynamicModuleLoader_Unload(&loader, result);
+    STRING_delete(entrypoint.moduleLibraryFileName);
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_009: [ DynamicLoader_Deinitialize shall do nothing if the loader is not initialized. ]
+TEST_FUNCTION(DynamicLoader_Deinitialize_does_nothing_when_not_initialized)
+{
+    // arrange
+    DynamicLoader_Deinitialize();
+
+    // act
+    DynamicLoader_Deinitialize();
+
+    // assert
+    ASSERT_ARE_EQUAL(int, 0, DynamicLoader_Initialize());
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_002: [ When the loader's configuration asks for eager binding, DynamicModuleLoader_Load shall load the module by calling DynamicLibrary_LoadLibraryEager instead. ]
+TEST_FUNCTION(DynamicModuleLoader_Load_binds_eagerly_when_configured)
+{
+    // arrange
+    DYNAMIC_LOADER_CONFIGURATION configuration = { { NULL }, true };
+    MODULE_LOADER loader =
+    {
+        NATIVE,
+        NULL, (MODULE_LOADER_BASE_CONFIGURATION*)&configuration, NULL
+    };
+    DYNAMIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("boo") };
+    MODULE_API_1 api =
+    {
+        {
+            MODULE_API_VERSION_1
+        },
+        NULL,
+        NULL,
+        (pfModule_Create)0x42,
+        (pfModule_Destroy)0x42,
+        (pfModule_Receive)0x42,
+        NULL
+    };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(STRING_c_str(entrypoint.moduleLibraryFileName));
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DynamicLibrary_LoadLibraryEager(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DynamicLibrary_FindSymbol(IGNORED_PTR_ARG, MODULE_GETAPI_NAME))
+        .IgnoreArgument(1)
+        .SetReturn((void*)Fake_GetAPI);
+    STRICT_EXPECTED_CALL(Fake_GetAPI((MODULE_API_VERSION)IGNORED_NUM_ARG))
+        .IgnoreArgument(1)
+        .SetReturn((MODULE_API*)&api);
+
+    // act
+    MODULE_LIBRARY_HANDLE result = DynamicModuleLoader_Load(&loader, &entrypoint);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    DynamicModuleLoader_Unload(&loader, result);
+    STRING_delete(entrypoint.moduleLibraryFileName);
+}
+
 /*Tests_SRS_MODULE_LOADER_17_007: [DynamicModuleLoader_GetModuleApi shall return NULL if the moduleLibraryHandle is NULL.]*/
 TEST_FUNCTION(DynamicModuleLoader_GetModuleApi_returns_NULL_when_moduleLibraryHandle_is_NULL)
 {
@@ -870,10 +1063,29 @@ TEST_FUNCTION(DynamicModuleLoader_FreeEntrypoint_frees_resources)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-//Tests_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL`. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL` if `json` is not an object or if `binding.eager` is not `true`. ]
 TEST_FUNCTION(DynamicModuleLoader_ParseConfigurationFromJson_returns_NULL)
 {
     // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+
+    // act
+    MODULE_LOADER_BASE_CONFIGURATION* result = DynamicModuleLoader_ParseConfigurationFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_13_050: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return `NULL` if `json` is not an object or if `binding.eager` is not `true`. ]
+TEST_FUNCTION(DynamicModuleLoader_ParseConfigurationFromJson_returns_NULL_when_binding_is_not_eager)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42))
+        .SetReturn(JSONObject);
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_boolean((const JSON_Object*)0x42, "binding.eager"))
+        .SetReturn(0);
 
     // act
     MODULE_LOADER_BASE_CONFIGURATION* result = DynamicModuleLoader_ParseConfigurationFromJson(NULL, (const JSON_Value*)0x42);
@@ -883,7 +1095,35 @@ TEST_FUNCTION(DynamicModuleLoader_ParseConfigurationFromJson_returns_NULL)
     ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 }
 
-//Tests_SRS_DYNAMIC_MODULE_LOADER_13_051: [ `DynamicModuleLoader_FreeConfiguration` shall do nothing. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_17_004: [ `DynamicModuleLoader_ParseConfigurationFromJson` shall return a `DYNAMIC_LOADER_CONFIGURATION` with `eager_binding` set when `binding.eager` is `true`. ]
+//Tests_SRS_DYNAMIC_MODULE_LOADER_13_051: [ `DynamicModuleLoader_FreeConfiguration` shall do nothing if `configuration` is `NULL` and free it otherwise. ]
+TEST_FUNCTION(DynamicModuleLoader_ParseConfigurationFromJson_returns_eager_configuration)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42))
+        .SetReturn(JSONObject);
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_boolean((const JSON_Object*)0x42, "binding.eager"))
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    MODULE_LOADER_BASE_CONFIGURATION* result = DynamicModuleLoader_ParseConfigurationFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_IS_TRUE(((DYNAMIC_LOADER_CONFIGURATION*)result)->eager_binding);
+    ASSERT_IS_NULL(result->binding_path);
+
+    // cleanup
+    DynamicModuleLoader_FreeConfiguration(NULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_DYNAMIC_MODULE_LOADER_13_051: [ `DynamicModuleLoader_FreeConfiguration` shall do nothing if `configuration` is `NULL` and free it otherwise. ]
 TEST_FUNCTION(DynamicModuleLoader_FreeConfiguration_does_nothing)
 {
     // act
@@ -5,7 +5,6 @@
 #include <cstddef>
 #include <cstdbool>
 #include <vector>
-#include <list>
 
 #include "testrunnerswitcher.h"
 #include "micromock.h"
@@ -13,10 +12,10 @@
 #include "azure_c_shared_utility/lock.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/condition.h"
-#include "azure_c_shared_utility/singlylinkedlist.h"
 #include "azure_c_shared_utility/vector.h"
 #include "azure_c_shared_utility/vector_types_internal.h"
 
+#include "message.h"
 #include "experimental/event_system.h"
 
 #define GBALLOC_H
@@ -60,11 +59,9 @@ static void* last_user_param;
 
 static VECTOR_HANDLE module_list;
 
-struct ListNode
-{
-    const void* item;
-    ListNode *next, *prev;
-};
+static GATEWAY_MODULE_HEALTH last_health;
+static GATEWAY_TAPPED_MESSAGE last_tapped;
+static int destroyed_messages;
 
 TYPED_MOCK_CLASS(CEventSystemMocks, CGlobalMock)
 {
@@ -96,52 +93,6 @@ public:
     MOCK_METHOD_END(void*, BASEIMPLEMENTATION::VECTOR_find_if(handle, pred, value));
 
 
-    MOCK_STATIC_METHOD_0(, SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create)
-    MOCK_METHOD_END(SINGLYLINKEDLIST_HANDLE, (SINGLYLINKEDLIST_HANDLE)new ListNode());
-
-    MOCK_STATIC_METHOD_1(, void, singlylinkedlist_destroy, SINGLYLINKEDLIST_HANDLE, list)
-        ListNode *current = (ListNode*)list;
-    while (current != nullptr)
-    {
-        auto tmp = current;
-        current = current->next;
-        delete tmp;
-    }
-    MOCK_VOID_METHOD_END()
-
-
-    MOCK_STATIC_METHOD_2(, LIST_ITEM_HANDLE, singlylinkedlist_add, SINGLYLINKEDLIST_HANDLE, list, const void*, item)
-        ListNode *new_item = new ListNode();
-        new_item->item = item;
-        ListNode *real_list = (ListNode*)list;
-        ListNode *ptr = real_list;
-        while (ptr->next != nullptr)
-            ptr = ptr->next;
-        ptr->next = new_item;
-        new_item->prev = ptr;
-    MOCK_METHOD_END(LIST_ITEM_HANDLE, (LIST_ITEM_HANDLE)new_item)
-
-    MOCK_STATIC_METHOD_2(, int, singlylinkedlist_remove, SINGLYLINKEDLIST_HANDLE, list, LIST_ITEM_HANDLE, item)
-        ListNode *node = (ListNode*)item;
-        node->prev->next = node->next;
-        if (node->next != nullptr)
-            node->next->prev = node->prev;
-        delete node;
-    MOCK_METHOD_END(int, 0)
-
-    MOCK_STATIC_METHOD_1(, LIST_ITEM_HANDLE, singlylinkedlist_get_head_item, SINGLYLINKEDLIST_HANDLE, list)
-        ListNode* my_result = NULL;
-        if (list != NULL)
-            my_result = ((ListNode*)list)->next;
-    MOCK_METHOD_END(LIST_ITEM_HANDLE, (LIST_ITEM_HANDLE)my_result);
-
-    MOCK_STATIC_METHOD_1(, LIST_ITEM_HANDLE, singlylinkedlist_get_next_item, LIST_ITEM_HANDLE, item_handle)
-    MOCK_METHOD_END(LIST_ITEM_HANDLE, (LIST_ITEM_HANDLE)(((ListNode*)item_handle)->next));
-
-    MOCK_STATIC_METHOD_1(, const void*, singlylinkedlist_item_get_value, LIST_ITEM_HANDLE, item_handle)
-    MOCK_METHOD_END(const void*, ((ListNode*)item_handle)->item);
-
-
     MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
     MOCK_METHOD_END(void*, BASEIMPLEMENTATION::gballoc_malloc(size));
 
@@ -173,6 +124,13 @@ public:
     MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
 
     MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+        /* the dispatcher only returns once it is stopping, so it is run when joined */
+        if (last_thread_func != NULL)
+        {
+            THREAD_START_FUNC thread_func = last_thread_func;
+            last_thread_func = NULL;
+            last_thread_result = thread_func(last_thread_arg);
+        }
         (*res) = last_thread_result;
         BASEIMPLEMENTATION::gballoc_free(threadHandle);
     MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
@@ -200,6 +158,13 @@ public:
 
     MOCK_STATIC_METHOD_1(, void, Gateway_DestroyModuleList, VECTOR_HANDLE, vec);
     MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_1(, MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
+    MOCK_METHOD_END(MESSAGE_HANDLE, message);
+
+    MOCK_STATIC_METHOD_1(, void, Message_Destroy, MESSAGE_HANDLE, message);
+        destroyed_messages++;
+    MOCK_VOID_METHOD_END();
         
 };
 
@@ -212,15 +177,6 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void*, VECTOR_front, const VEC
 DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , size_t, VECTOR_size, const VECTOR_HANDLE, handle);
 DECLARE_GLOBAL_MOCK_METHOD_3(CEventSystemMocks, , void*, VECTOR_find_if, const VECTOR_HANDLE, handle, PREDICATE_FUNCTION, pred, const void*, value);
 
-// singlylinkedlist.h
-DECLARE_GLOBAL_MOCK_METHOD_0(CEventSystemMocks, , SINGLYLINKEDLIST_HANDLE, singlylinkedlist_create);
-DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void, singlylinkedlist_destroy, SINGLYLINKEDLIST_HANDLE, list);
-DECLARE_GLOBAL_MOCK_METHOD_2(CEventSystemMocks, , LIST_ITEM_HANDLE, singlylinkedlist_add, SINGLYLINKEDLIST_HANDLE, list, const void*, item);
-DECLARE_GLOBAL_MOCK_METHOD_2(CEventSystemMocks, , int, singlylinkedlist_remove, SINGLYLINKEDLIST_HANDLE, list, LIST_ITEM_HANDLE, item_handle);
-DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , LIST_ITEM_HANDLE, singlylinkedlist_get_head_item, SINGLYLINKEDLIST_HANDLE, list);
-DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , LIST_ITEM_HANDLE, singlylinkedlist_get_next_item, LIST_ITEM_HANDLE, item_handle);
-DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , const void*, singlylinkedlist_item_get_value, LIST_ITEM_HANDLE, item_handle);
-
 DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void*, gballoc_malloc, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_2(CEventSystemMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void, gballoc_free, void*, ptr)
@@ -241,8 +197,10 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void, Condition_Deinit, COND_H
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , VECTOR_HANDLE, Gateway_GetModuleList, GATEWAY_HANDLE, gw);
 DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void, Gateway_DestroyModuleList, VECTOR_HANDLE, vec);
+DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , MESSAGE_HANDLE, Message_Clone, MESSAGE_HANDLE, message);
+DECLARE_GLOBAL_MOCK_METHOD_1(CEventSystemMocks, , void, Message_Destroy, MESSAGE_HANDLE, message);
 
-static void expectEventSystemDestroy(CEventSystemMocks &mocks, bool started_thread, int nodes_in_queue)
+static void expectEventSystemDestroy(CEventSystemMocks &mocks, bool started_thread, int callback_snapshots)
 {
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)).ExpectedAtLeastTimes(2);
     EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
@@ -254,20 +212,12 @@ static void expectEventSystemDestroy(CEventSystemMocks &mocks, bool started_thre
     EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(nodes_in_queue + 1);
-    EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(nodes_in_queue);
-    EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(nodes_in_queue);
-
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
 
     EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT + nodes_in_queue);
+        .ExpectedTimesExactly(callback_snapshots);
+    // the queue, the event system and one per callback snapshot
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(nodes_in_queue + 1);
+        .ExpectedTimesExactly(callback_snapshots + 2);
 }
 
 static void countingCallback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX ctx, void* user_param)
@@ -287,6 +237,24 @@ static void catch_context_callback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type,
     last_user_param = user_param;
 }
 
+static void catch_health_callback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX ctx, void* user_param)
+{
+    (void)gw;
+    (void)event_type;
+    (void)user_param;
+    last_context = ctx;
+    last_health = *(GATEWAY_MODULE_HEALTH*)ctx;
+}
+
+static void catch_tapped_callback(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX ctx, void* user_param)
+{
+    (void)gw;
+    (void)event_type;
+    (void)user_param;
+    last_context = ctx;
+    last_tapped = *(GATEWAY_TAPPED_MESSAGE*)ctx;
+}
+
 BEGIN_TEST_SUITE(event_system_ut)
 
 TEST_SUITE_INITIALIZE(TestClassInitialize)
@@ -323,6 +291,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     last_thread_func = NULL;
     module_list = NULL;
     last_context = NULL;
+    memset(&last_health, 0, sizeof(GATEWAY_MODULE_HEALTH));
+    memset(&last_tapped, 0, sizeof(GATEWAY_TAPPED_MESSAGE));
+    destroyed_messages = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -340,13 +311,11 @@ TEST_FUNCTION(EventSystem_Init_Basic)
     CEventSystemMocks mocks;
 
     // Expectations
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Lock_Init())
         .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Condition_Init());
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
-    EXPECTED_CALL(mocks, singlylinkedlist_create());
 
     // Act
     EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
@@ -377,7 +346,7 @@ TEST_FUNCTION(EventSystem_Init_Fail_Malloc)
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
-TEST_FUNCTION(EventSystem_Init_Fail_Vector)
+TEST_FUNCTION(EventSystem_Init_Fail_Queue)
 {
     // Arrange
     CEventSystemMocks mocks;
@@ -387,8 +356,8 @@ TEST_FUNCTION(EventSystem_Init_Fail_Vector)
     EXPECTED_CALL(mocks, Lock_Init())
         .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Condition_Init());
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .SetFailReturn((VECTOR_HANDLE)NULL);
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .SetFailReturn((void*)NULL);
     expectEventSystemDestroy(mocks, false, 0);
 
     // Act
@@ -416,13 +385,8 @@ TEST_FUNCTION(EventSystem_Init_Fail_Lock)
     EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
 
     // Act
     EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
@@ -451,39 +415,8 @@ TEST_FUNCTION(EventSystem_Init_Fail_Condition)
     EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-
-    // Act
-    EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
-
-    // Assert
-    ASSERT_IS_NULL(event_system);
-    mocks.AssertActualAndExpectedCalls();
-}
-
-/* Tests_SRS_EVENTSYSTEM_26_002: [ This function shall return NULL upon any internal error during event system creation. ] */
-TEST_FUNCTION(EventSystem_Init_Fail_List)
-{
-    // Arrange
-    CEventSystemMocks mocks;
-
-    // Expectations
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, Lock_Init())
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, Condition_Init());
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
-    EXPECTED_CALL(mocks, singlylinkedlist_create())
-        .SetFailReturn((SINGLYLINKEDLIST_HANDLE)NULL);
-
-    expectEventSystemDestroy(mocks, false, 0);
 
     // Act
     EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
@@ -542,12 +475,17 @@ TEST_FUNCTION(EventSystem_Joins_Thread)
     // Expectations
     // checks for threadapi_join
     expectEventSystemDestroy(mocks, true, 1);
+    // the joined dispatcher delivers the queued event
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(2);
 
     // Act
     EventSystem_Destroy(handle);
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 2);
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_003: [ This function shall destroy and free resources of the given event system. ] */
@@ -566,9 +504,18 @@ TEST_FUNCTION(EventSystem_Destroy_Clears_Queue)
 
     // Expectations
     expectEventSystemDestroy(mocks, true, 2);
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+        .ExpectedTimesExactly(3);
 
     // Act
     EventSystem_Destroy(handle);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 2);
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_DESTROYED], 1);
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_006: [ This function shall call all registered callbacks for the given GATEWAY_EVENT. ] */
@@ -592,8 +539,8 @@ TEST_FUNCTION(EventSystem_Report_CallAllRegistered)
     EventSystem_ReportEvent(event_system, gw, GATEWAY_STARTED);
     // check that they weren't run in this thread
     ASSERT_IS_TRUE(callback_gw_history->empty());
-    // simulate the thread running
-    last_thread_func(last_thread_arg);
+    // joins the dispatcher
+    EventSystem_Destroy(event_system);
 
     // Assert
     ASSERT_ARE_EQUAL(size_t, callback_gw_history->size(), 3);
@@ -604,10 +551,9 @@ TEST_FUNCTION(EventSystem_Report_CallAllRegistered)
 
     // Clean-up
     free(gw);
-    EventSystem_Destroy(event_system);
 }
 
-/* Tests_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created or any internall callbacks fail, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
+/* Tests_SRS_EVENTSYSTEM_26_013: [ Should the worker thread ever fail to be created, failure will be logged and no further callbacks will be called during gateway's lifecycle. ] */
 TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
 {
     // Arrange
@@ -621,12 +567,6 @@ TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
         .ExpectedTimesExactly(5);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(5);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -637,19 +577,10 @@ TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
     EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
 
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
-
     EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT + 1);
+        .ExpectedTimesExactly(1);
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+        .ExpectedTimesExactly(3);
 
     // Act
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
@@ -658,62 +589,41 @@ TEST_FUNCTION(EventSystem_Thread_Creation_Fails)
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
+    ASSERT_IS_TRUE(callback_gw_history->empty());
 }
 
-/* Checks that even if the thread quits after finishing the job, that another thread is created properly */
-TEST_FUNCTION(EventSystem_Recreates_Thread_When_Quit)
+/* Tests_SRS_EVENTSYSTEM_17_004: [ The dispatcher shall wait for further events until the event system is destroyed. ] */
+/* Tests_SRS_EVENTSYSTEM_17_005: [ This function shall create the dispatcher thread when the first event is reported. ] */
+TEST_FUNCTION(EventSystem_Keeps_Dispatcher_Between_Events)
 {
     // Arrange
     CEventSystemMocks mocks;
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
-
-    // Act
-    ASSERT_IS_NULL((void*)last_thread_func);
-    
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    
-    ASSERT_IS_NOT_NULL((void*)last_thread_func);
-    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 0);
-    last_thread_func(last_thread_arg);
-    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 2);
-    last_thread_func = NULL;
-    
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    
-    ASSERT_IS_NOT_NULL((void*)last_thread_func);
-    last_thread_func(last_thread_arg);
-    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 4);
-
     mocks.ResetAllCalls();
 
-    // All callbacks should already be consumed
-    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG)).ExpectedAtLeastTimes(2);
-    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG)).ExpectedAtLeastTimes(2);
-    EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
+    // Expect
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(6);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(6);
+    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(0);
-    EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(0);
 
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
+    // Act
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
 
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 0);
 
+    // Cleanup
     EventSystem_Destroy(handle);
-
-    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(int, callback_gw_history->size(), 4);
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_009: [ This function shall call all registered callbacks in First-In-First-Out order in terms registration. ] */
@@ -755,8 +665,6 @@ TEST_FUNCTION(EventSystem_Report_CallOrder)
 
     // Act
     EventSystem_ReportEvent(event_system, gw, GATEWAY_STARTED);
-    // simulate the thread
-    last_thread_func(last_thread_arg);
     // Cleanup to force multi-threaded callbacks to finish
     free(gw);
     EventSystem_Destroy(event_system);
@@ -768,6 +676,27 @@ TEST_FUNCTION(EventSystem_Report_CallOrder)
     mocks.ResetAllCalls();
 }
 
+/* Tests_SRS_EVENTSYSTEM_17_001: [ This function shall publish a new snapshot of the event's callbacks, so that events already reported keep calling the callbacks they were reported with. ] */
+TEST_FUNCTION(EventSystem_AddEventCallback_Does_Not_Change_Reported_Events)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+    EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
+    EventSystem_AddEventCallback(event_system, GATEWAY_STARTED, countingCallback, NULL);
+
+    // Act
+    EventSystem_ReportEvent(event_system, NULL, GATEWAY_STARTED);
+    EventSystem_AddEventCallback(event_system, GATEWAY_STARTED, countingCallback, NULL);
+    EventSystem_ReportEvent(event_system, NULL, GATEWAY_STARTED);
+    // joins the dispatcher
+    EventSystem_Destroy(event_system);
+
+    // Assert
+    // the first report only had one callback
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 3);
+}
+
 /* Tests_SRS_EVENTSYSTEM_26_014: [ This function shall do nothing when `event_system` parameter is NULL. ] */
 TEST_FUNCTION(EventSystem_Report_NULL_EventSystem)
 {
@@ -779,7 +708,7 @@ TEST_FUNCTION(EventSystem_Report_NULL_EventSystem)
     mocks.ResetAllCalls();
 
     // Expect
-    expectEventSystemDestroy(mocks, false, 0);
+    expectEventSystemDestroy(mocks, false, 1);
 
     // Act
     EventSystem_ReportEvent(NULL, gw, GATEWAY_STARTED);
@@ -803,22 +732,17 @@ TEST_FUNCTION(EventSystem_AddEventCallback_NULLs)
     mocks.ResetAllCalls();
 
     // Expect
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(4);
-    // Destroy ( + 1 lock/unlock above)
+    // Destroy ( + 2 lock/unlock above)
     EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Condition_Deinit(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Lock_Deinit(IGNORED_PTR_ARG))
         .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, singlylinkedlist_destroy(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(GATEWAY_EVENTS_COUNT);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
 
     // Act
     EventSystem_AddEventCallback(NULL, GATEWAY_STARTED, countingCallback, NULL);
@@ -834,53 +758,67 @@ TEST_FUNCTION(EventSystem_AddEventCallback_NULLs)
     ASSERT_IS_TRUE(callback_gw_history->empty());
 }
 
+/* Tests_SRS_EVENTSYSTEM_17_012: [ Should the new snapshot fail to be created, failure shall be logged and only this callback shall not be registered. ] */
 TEST_FUNCTION(EventSystem_AddEventCallback_Vector_fail)
 {
     // Arrange
     CEventSystemMocks mocks;
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
-    // This one will register but fail to be called because of failed AddEventCallback
+    // This one stays registered and is called, the failed one is not
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
     mocks.ResetAllCalls();
 
     // Expect
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(4);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(4);
+    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
         .SetFailReturn(1);
+    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     // Act
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
 
     // Assert
-    ASSERT_IS_TRUE(callback_gw_history->empty());
     mocks.AssertActualAndExpectedCalls();
 
     // Cleanup
+    // joins the dispatcher
     EventSystem_Destroy(handle);
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 1);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_Vector_Create_Fail)
+/* Tests_SRS_EVENTSYSTEM_17_002: [ This function shall take a reference to the current snapshot of the event's callbacks instead of copying them. ] */
+/* Tests_SRS_EVENTSYSTEM_17_003: [ This function shall add the event to a queue that only allocates memory when it has to grow. ] */
+TEST_FUNCTION(EventSystem_ReportEvent_Does_Not_Copy_Callbacks)
 {
     // Arrange
     CEventSystemMocks mocks;
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
+    EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
     mocks.ResetAllCalls();
 
     // Expect
+    // no VECTOR and no memory calls
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .SetFailReturn((VECTOR_HANDLE)NULL)
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     // Act
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
@@ -889,67 +827,55 @@ TEST_FUNCTION(EventSystem_ReportEvent_Vector_Create_Fail)
     EventSystem_Destroy(handle);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_Vector_Pushback_Fail)
+/* Tests_SRS_EVENTSYSTEM_17_003: [ This function shall add the event to a queue that only allocates memory when it has to grow. ] */
+TEST_FUNCTION(EventSystem_ReportEvent_Queue_Grows)
 {
     // Arrange
     CEventSystemMocks mocks;
-    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
-    EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
-    mocks.ResetAllCalls();
-
-    // Expect
-    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .SetFailReturn(1)
-        .ExpectedTimesExactly(1);
+    mocks.SetIgnoreUnexpectedCalls(true);
+    EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
+    EventSystem_AddEventCallback(event_system, GATEWAY_STARTED, countingCallback, NULL);
+    EventSystem_AddEventCallback(event_system, GATEWAY_DESTROYED, countingCallback, NULL);
 
     // Act
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
+    // more events than the queue first holds, nothing is taken until destroy
+    for (int i = 0; i < 40; i++)
+    {
+        EventSystem_ReportEvent(event_system, (GATEWAY_HANDLE)(size_t)(i + 1), (i % 2 == 0) ? GATEWAY_STARTED : GATEWAY_DESTROYED);
+    }
+    EventSystem_Destroy(event_system);
 
     // Assert
-    mocks.AssertActualAndExpectedCalls();
-
-    // Cleanup
-    EventSystem_Destroy(handle);
+    ASSERT_ARE_EQUAL(size_t, callback_gw_history->size(), 40);
+    for (int i = 0; i < 40; i++)
+        ASSERT_IS_TRUE((*callback_gw_history)[i] == (GATEWAY_HANDLE)(size_t)(i + 1));
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 20);
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_DESTROYED], 20);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_malloc_fail)
+/* Tests_SRS_EVENTSYSTEM_17_013: [ Should the context of the event fail to be created or the event fail to be queued, failure shall be logged and only this event shall be dropped. ] */
+TEST_FUNCTION(EventSystem_ReportEvent_Queue_Grow_Fail)
 {
     // Arrange
     CEventSystemMocks mocks;
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
     EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
+    // fills the queue, the dispatcher doesn't run until destroy
+    for (int i = 0; i < 16; i++)
+    {
+        EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
+    }
     mocks.ResetAllCalls();
 
     // Expect
+    // each report only drops its own event
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+        .ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(4);
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .SetFailReturn((void*)NULL)
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
 
     // Act
     EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
@@ -959,48 +885,58 @@ TEST_FUNCTION(EventSystem_ReportEvent_malloc_fail)
     mocks.AssertActualAndExpectedCalls();
 
     // Cleanup
+    // joins the dispatcher, which still delivers the queued events
     EventSystem_Destroy(handle);
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 16);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_singlylinkedlist_add_fail)
+/* Tests_SRS_EVENTSYSTEM_17_014: [ This function shall queue at most EVENT_QUEUE_MAX_CAPACITY events. ] */
+TEST_FUNCTION(EventSystem_ReportEvent_Queue_Is_Capped)
 {
     // Arrange
     CEventSystemMocks mocks;
-    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
-    EventSystem_AddEventCallback(handle, GATEWAY_STARTED, countingCallback, NULL);
+    mocks.SetIgnoreUnexpectedCalls(true);
+    EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
+    EventSystem_AddEventCallback(event_system, GATEWAY_STARTED, countingCallback, NULL);
+
+    // Act
+    // one more event than the queue holds at most, nothing is taken until destroy
+    for (int i = 0; i < 1025; i++)
+    {
+        EventSystem_ReportEvent(event_system, (GATEWAY_HANDLE)(size_t)(i + 1), GATEWAY_STARTED);
+    }
+    EventSystem_Destroy(event_system);
+
+    // Assert
+    ASSERT_ARE_EQUAL(size_t, callback_gw_history->size(), 1024);
+    ASSERT_IS_TRUE((*callback_gw_history)[1023] == (GATEWAY_HANDLE)(size_t)1024);
+}
+
+/* Tests_SRS_EVENTSYSTEM_17_015: [ The dispatcher shall shrink the queue back to its initial size once it empties it. ] */
+TEST_FUNCTION(EventSystem_Dispatcher_Shrinks_Drained_Queue)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+    EVENTSYSTEM_HANDLE event_system = EventSystem_Init();
+    EventSystem_AddEventCallback(event_system, GATEWAY_STARTED, countingCallback, NULL);
+    // grows the queue once
+    for (int i = 0; i < 17; i++)
+    {
+        EventSystem_ReportEvent(event_system, NULL, GATEWAY_STARTED);
+    }
     mocks.ResetAllCalls();
 
     // Expect
-    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
-    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .SetFailReturn((LIST_ITEM_HANDLE)NULL);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+    EXPECTED_CALL(mocks, gballoc_realloc(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     // Act
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_STARTED);
+    // joins the dispatcher, which empties the queue
+    EventSystem_Destroy(event_system);
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
-
-    // Cleanup
-    EventSystem_Destroy(handle);
+    ASSERT_ARE_EQUAL(int, callback_per_event_count[GATEWAY_STARTED], 17);
 }
 
 /* Tests_SRS_EVENTSYSTEM_26_016: [ This event shall provide `VECTOR_HANDLE` as returned from #Gateway_GetModuleList as the event context in callbacks ] */
@@ -1016,37 +952,29 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_Proper_List_Given)
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(6);
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(6);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, Gateway_GetModuleList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, singlylinkedlist_add(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    // simulated thread
-    EXPECTED_CALL(mocks, singlylinkedlist_get_head_item(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(3);
-    EXPECTED_CALL(mocks, singlylinkedlist_item_get_value(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, singlylinkedlist_remove(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .ExpectedTimesExactly(2);
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, Gateway_DestroyModuleList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Condition_Wait(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
 
     // Act
     EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
-    // simulate the thread running
-    last_thread_func(last_thread_arg);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+    mocks.ResetAllCalls();
+
+    // Expect
+    expectEventSystemDestroy(mocks, true, 1);
+    // joined dispatcher
+    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(mocks, Gateway_DestroyModuleList(IGNORED_PTR_ARG));
+
+    // Act
+    EventSystem_Destroy(handle);
 
     // Assert
     ASSERT_IS_TRUE(module_list == (VECTOR_HANDLE)last_context);
@@ -1054,9 +982,9 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_Proper_List_Given)
 
     // Cleanup
     BASEIMPLEMENTATION::VECTOR_destroy(module_list);
-    EventSystem_Destroy(handle);
 }
 
+/* Tests_SRS_EVENTSYSTEM_17_013: [ Should the context of the event fail to be created or the event fail to be queued, failure shall be logged and only this event shall be dropped. ] */
 TEST_FUNCTION(EventSystem_ReportEvent_Modules_GetModuleList_Fails)
 {
     // Arrange
@@ -1066,20 +994,18 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_GetModuleList_Fails)
     mocks.ResetAllCalls();
 
     // Expect
+    // neither event is queued, and the second one is still tried
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
+        .ExpectedTimesExactly(2);
     EXPECTED_CALL(mocks, Gateway_GetModuleList(IGNORED_PTR_ARG))
-        .SetFailReturn((VECTOR_HANDLE)NULL);
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG));
+        .SetFailReturn((VECTOR_HANDLE)NULL)
+        .ExpectedTimesExactly(2);
 
     // Act
     EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
@@ -1088,59 +1014,168 @@ TEST_FUNCTION(EventSystem_ReportEvent_Modules_GetModuleList_Fails)
     EventSystem_Destroy(handle);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_Modules_Pushback_Fails)
+TEST_FUNCTION(EventSystem_ReportEvent_user_param_is_passed)
 {
     // Arrange
-    CEventSystemMocks mocks;
+    CNiceCallComparer<CEventSystemMocks> mocks;
     module_list = BASEIMPLEMENTATION::VECTOR_create(1);
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
-    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_LIST_CHANGED, catch_context_callback, NULL);
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_LIST_CHANGED, catch_context_callback, (void*)0x42);
+    mocks.ResetAllCalls();
+
+    // Act
+    EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
+    // joins the dispatcher
+    EventSystem_Destroy(handle);
+
+    // Assert
+    ASSERT_IS_TRUE(last_user_param == (void*)0x42);
+
+    // Cleanup
+    BASEIMPLEMENTATION::VECTOR_destroy(module_list);
+}
+
+/* Tests_SRS_EVENTSYSTEM_17_007: [ This event shall provide a copy of the `GATEWAY_MODULE_HEALTH` given to #EventSystem_ReportModuleHealth as the event context in callbacks ] */
+/* Tests_SRS_EVENTSYSTEM_17_008: [ This event shall free the copy of the `GATEWAY_MODULE_HEALTH` after finishing all the callbacks ] */
+TEST_FUNCTION(EventSystem_ReportModuleHealth_Copy_Given)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    GATEWAY_MODULE_HEALTH health = { (MODULE_HANDLE)0x42, 20, 3 };
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_SLOW, catch_health_callback, NULL);
     mocks.ResetAllCalls();
 
     // Expect
     EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
+        .ExpectedTimesExactly(3);
     EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(1);
-    EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_create(IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG));
-    EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, Gateway_GetModuleList(IGNORED_PTR_ARG));
-    EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-        .SetFailReturn(1);
-    EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_MODULE_HEALTH)));
+    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     // Act
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
+    EventSystem_ReportModuleHealth(handle, NULL, GATEWAY_MODULE_SLOW, &health);
 
     // Assert
     mocks.AssertActualAndExpectedCalls();
 
     // Cleanup
+    // joins the dispatcher
     EventSystem_Destroy(handle);
+    ASSERT_IS_NOT_NULL(last_context);
+    ASSERT_IS_TRUE(last_context != (void*)&health);
+    ASSERT_IS_TRUE(last_health.module == (MODULE_HANDLE)0x42);
+    ASSERT_ARE_EQUAL(int, 20, (int)last_health.receive_time_ms);
+    ASSERT_ARE_EQUAL(size_t, 3, last_health.queue_depth);
 }
 
-TEST_FUNCTION(EventSystem_ReportEvent_user_param_is_passed)
+/* Tests_SRS_EVENTSYSTEM_17_013: [ Should the context of the event fail to be created or the event fail to be queued, failure shall be logged and only this event shall be dropped. ] */
+TEST_FUNCTION(EventSystem_ReportModuleHealth_Copy_Fails_Drops_Only_That_Event)
 {
     // Arrange
-    CNiceCallComparer<CEventSystemMocks> mocks;
-    module_list = BASEIMPLEMENTATION::VECTOR_create(1);
+    CEventSystemMocks mocks;
+    mocks.SetIgnoreUnexpectedCalls(true);
+    GATEWAY_MODULE_HEALTH health = { (MODULE_HANDLE)0x42, 20, 3 };
     EVENTSYSTEM_HANDLE handle = EventSystem_Init();
-    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_LIST_CHANGED, catch_context_callback, (void*)0x42);
+    EventSystem_AddEventCallback(handle, GATEWAY_MODULE_SLOW, countingCallback, NULL);
     mocks.ResetAllCalls();
 
+    // Expect
+    EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_MODULE_HEALTH)))
+        .SetFailReturn((void*)NULL);
+
     // Act
-    EventSystem_ReportEvent(handle, NULL, GATEWAY_MODULE_LIST_CHANGED);
-    // simulate the thread running
-    last_thread_func(last_thread_arg);
+    EventSystem_ReportModuleHealth(handle, (GATEWAY_HANDLE)0x1, GATEWAY_MODULE_SLOW, &health);
+    EventSystem_ReportModuleHealth(handle, (GATEWAY_HANDLE)0x2, GATEWAY_MODULE_SLOW, &health);
+    // joins the dispatcher
+    EventSystem_Destroy(handle);
 
     // Assert
-    ASSERT_IS_TRUE(last_user_param == (void*)0x42);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, callback_gw_history->size(), 1);
+    ASSERT_IS_TRUE((*callback_gw_history)[0] == (GATEWAY_HANDLE)0x2);
+}
+
+/* Tests_SRS_EVENTSYSTEM_17_006: [ This function shall do nothing when `health` is NULL or `event_type` is neither `GATEWAY_MODULE_SLOW` nor `GATEWAY_QUEUE_HIGH_WATERMARK`. ] */
+TEST_FUNCTION(EventSystem_ReportModuleHealth_Invalid_Args)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    GATEWAY_MODULE_HEALTH health = { (MODULE_HANDLE)0x42, 20, 3 };
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_QUEUE_HIGH_WATERMARK, catch_health_callback, NULL);
+    EventSystem_AddEventCallback(handle, GATEWAY_CREATED, catch_context_callback, NULL);
+    mocks.ResetAllCalls();
+
+    // Act
+    EventSystem_ReportModuleHealth(handle, NULL, GATEWAY_QUEUE_HIGH_WATERMARK, NULL);
+    EventSystem_ReportModuleHealth(handle, NULL, GATEWAY_CREATED, &health);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // Cleanup
+    EventSystem_Destroy(handle);
+}
+
+/* Tests_SRS_EVENTSYSTEM_17_010: [ This event shall provide a copy of the `GATEWAY_TAPPED_MESSAGE` given to #EventSystem_ReportMessageTap as the event context in callbacks, holding a clone of its message ] */
+/* Tests_SRS_EVENTSYSTEM_17_011: [ This event shall destroy the clone of the message and free the copy of the `GATEWAY_TAPPED_MESSAGE` after finishing all the callbacks ] */
+TEST_FUNCTION(EventSystem_ReportMessageTap_Clones_Message)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    GATEWAY_TAPPED_MESSAGE tapped = { (MODULE_HANDLE)0x42, 7, 16, (MESSAGE_HANDLE)0x43 };
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MESSAGE_TAPPED, catch_tapped_callback, NULL);
+    mocks.ResetAllCalls();
+
+    // Expect
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_TAPPED_MESSAGE)));
+    STRICT_EXPECTED_CALL(mocks, Message_Clone((MESSAGE_HANDLE)0x43));
+    EXPECTED_CALL(mocks, Condition_Post(IGNORED_PTR_ARG));
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+
+    // Act
+    EventSystem_ReportMessageTap(handle, NULL, &tapped);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    // Act
+    // joins the dispatcher
+    EventSystem_Destroy(handle);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 1, destroyed_messages);
+    ASSERT_IS_TRUE(last_context != (void*)&tapped);
+    ASSERT_IS_TRUE(last_tapped.source == (MODULE_HANDLE)0x42);
+    ASSERT_ARE_EQUAL(int, 7, (int)last_tapped.sequence);
+    ASSERT_ARE_EQUAL(size_t, 16, last_tapped.message_size);
+    ASSERT_IS_TRUE(last_tapped.message == (MESSAGE_HANDLE)0x43);
+}
+
+/* Tests_SRS_EVENTSYSTEM_17_009: [ This function shall do nothing when `tapped` is NULL. ] */
+TEST_FUNCTION(EventSystem_ReportMessageTap_NULL_Tapped)
+{
+    // Arrange
+    CEventSystemMocks mocks;
+    EVENTSYSTEM_HANDLE handle = EventSystem_Init();
+    EventSystem_AddEventCallback(handle, GATEWAY_MESSAGE_TAPPED, catch_tapped_callback, NULL);
+    mocks.ResetAllCalls();
+
+    // Act
+    EventSystem_ReportMessageTap(handle, NULL, NULL);
+
+    // Assert
+    mocks.AssertActualAndExpectedCalls();
 
     // Cleanup
-    BASEIMPLEMENTATION::VECTOR_destroy(module_list);
     EventSystem_Destroy(handle);
 }
 
@@ -3,15 +3,18 @@
 
 #include <cstdlib>
 #include <cstddef>
+#include <cstdio>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "module_loader.h"
 #include "experimental/event_system.h"
 
 #include "gateway.h"
+#include "file_watcher.h"
 #include "../src/gateway_internal.h"
 #include <parson.h>
 
@@ -27,6 +30,7 @@
 #define VALID_JSON_NULL_ARGS_PATH "valid_json_null.json"
 
 #define VALID_JSON_CONTENT "validJsonContent"
+#define SNAPSHOT_PATH "gateway_createfromjson_ut.snapshot"
 
 #define GBALLOC_H
 
@@ -56,10 +60,15 @@ namespace BASEIMPLEMENTATION
 };
 
 static MODULE_API_1 dummyAPIs;
+static MODULE_API_2 dummyAPIs2;
 static size_t currentBroker_ref_count;
 static MODULE_LOADER_API default_module_loader;
 static MODULE_LOADER dummyModuleLoader;
 static GATEWAY_MODULE_LOADER_INFO dummyLoaderInfo;
+static FILE_WATCHER_CALLBACK watcherCallback;
+static void* watcherContext;
+static size_t updateLockDepth;
+static size_t listChangedUnderLock;
 
 TYPED_MOCK_CLASS(CGatewayMocks, CGlobalMock)
 {
@@ -98,10 +107,26 @@ public:
         }
     MOCK_METHOD_END(JSON_Array*, arr);
 
+    MOCK_STATIC_METHOD_2(, double, json_object_dotget_number, const JSON_Object*, object, const char*, name)
+        double number = 0;
+    MOCK_METHOD_END(double, number);
+
+    MOCK_STATIC_METHOD_2(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
+        double number = 0;
+    MOCK_METHOD_END(double, number);
+
     MOCK_STATIC_METHOD_1(, size_t, json_array_get_count, const JSON_Array*, arr)
         size_t size = 0;
     MOCK_METHOD_END(size_t, size);
 
+    MOCK_STATIC_METHOD_2(, JSON_Value*, json_array_get_value, const JSON_Array*, arr, size_t, index)
+        JSON_Value* value = NULL;
+        if (arr != NULL)
+        {
+            value = (JSON_Value*)0x42;
+        }
+    MOCK_METHOD_END(JSON_Value*, value);
+
     MOCK_STATIC_METHOD_2(, JSON_Object*, json_array_get_object, const JSON_Array*, arr, size_t, index)
         JSON_Object* object = NULL;
         if (arr != NULL)
@@ -144,6 +169,9 @@ public:
         }
     MOCK_METHOD_END(char*, serialized_string);
 
+    MOCK_STATIC_METHOD_1(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value)
+    MOCK_METHOD_END(JSON_Value_Type, JSONNull);
+
     MOCK_STATIC_METHOD_1(, void, json_value_free, JSON_Value*, value)
         BASEIMPLEMENTATION::gballoc_free(value);
     MOCK_VOID_METHOD_END();
@@ -178,6 +206,15 @@ public:
     MOCK_STATIC_METHOD_1(, GATEWAY_START_RESULT, Gateway_Start, GATEWAY_HANDLE, gw)
     MOCK_METHOD_END(GATEWAY_START_RESULT, GATEWAY_START_SUCCESS);
 
+    /*File watcher Mocks*/
+    MOCK_STATIC_METHOD_3(, FILE_WATCHER_HANDLE, FileWatcher_Create, const char*, file_path, FILE_WATCHER_CALLBACK, callback, void*, context)
+        watcherCallback = callback;
+        watcherContext = context;
+    MOCK_METHOD_END(FILE_WATCHER_HANDLE, (FILE_WATCHER_HANDLE)0x42);
+
+    MOCK_STATIC_METHOD_1(, void, FileWatcher_Destroy, FILE_WATCHER_HANDLE, watcher)
+    MOCK_VOID_METHOD_END();
+
     /*Broker Mocks*/
     MOCK_STATIC_METHOD_0(, BROKER_HANDLE, Broker_Create)
         ++currentBroker_ref_count;
@@ -213,9 +250,24 @@ public:
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
 
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_AddReplicaModule, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_REPLICA*, replica)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
 
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_SetDrainTimeout, BROKER_HANDLE, handle, unsigned int, drain_timeout_ms)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_GetDrainStatistics, BROKER_HANDLE, handle, BROKER_DRAIN_STATISTICS*, statistics)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_4(, BROKER_RESULT, Broker_SetHealthMonitor, BROKER_HANDLE, handle, const BROKER_HEALTH_BUDGETS*, budgets, BROKER_HEALTH_CALLBACK, callback, void*, context)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_4(, BROKER_RESULT, Broker_SetMessageTap, BROKER_HANDLE, handle, const BROKER_MESSAGE_TAP*, tap, BROKER_TAP_CALLBACK, callback, void*, context)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
@@ -287,6 +339,17 @@ public:
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_3(, void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type)
+        // the event system calls Gateway_GetModuleList, which takes the gateway's lock
+        if (event_type == GATEWAY_MODULE_LIST_CHANGED && updateLockDepth > 0)
+        {
+            listChangedUnderLock++;
+        }
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_4(, void, EventSystem_ReportModuleHealth, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_MODULE_HEALTH*, health)
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_3(, void, EventSystem_ReportMessageTap, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, const GATEWAY_TAPPED_MESSAGE*, tapped)
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_1(, void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle)
@@ -336,6 +399,30 @@ public:
         strcpy(*destination, source);
     MOCK_METHOD_END(int, 0);
 
+    /*lock and threadapi Mocks*/
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+    MOCK_METHOD_END(LOCK_HANDLE, (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1));
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+        updateLockDepth++;
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+        updateLockDepth--;
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        *threadHandle = (THREAD_HANDLE)0x42;
+        (void)func(arg);
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
+
     /*gballoc Mocks*/
     MOCK_STATIC_METHOD_1(, void*, gballoc_malloc, size_t, size)
         void* result2 = BASEIMPLEMENTATION::gballoc_malloc(size);
@@ -351,6 +438,9 @@ public:
     MOCK_STATIC_METHOD_1(, MODULE_HANDLE, mock_Module_ParseConfigurationFromJson, const char*, configuration)
     MOCK_METHOD_END(MODULE_HANDLE, (MODULE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1));
 
+    MOCK_STATIC_METHOD_1(, void*, mock_Module_ParseConfigurationFromJsonValue, const JSON_Value*, configuration)
+    MOCK_METHOD_END(void*, BASEIMPLEMENTATION::gballoc_malloc(1));
+
     MOCK_STATIC_METHOD_1(, void, mock_Module_FreeConfiguration, void*, configuration)
         BASEIMPLEMENTATION::gballoc_free(configuration);
     MOCK_VOID_METHOD_END();
@@ -370,13 +460,17 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Value *, json_parse_string, c
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Value*, json_parse_file, const char *, filename);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Object*, json_value_get_object, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Array*, json_object_get_array, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , double, json_object_dotget_number, const JSON_Object*, object, const char*, name);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , double, json_object_get_number, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , size_t, json_array_get_count, const JSON_Array*, arr);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Value*, json_array_get_value, const JSON_Array*, arr, size_t, index);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_array_get_object, const JSON_Array*, arr, size_t, index);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Object*, json_object_get_object, const JSON_Object*, object, const char*, name);
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , JSON_Value*, json_object_get_value, const JSON_Object*, object, const char*, name);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , char*, json_serialize_to_string, const JSON_Value*, value);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , JSON_Value_Type, json_value_get_type, const JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_value_free, JSON_Value*, value);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, json_free_serialized_string, char*, string);
 
@@ -386,12 +480,20 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Gateway_Destroy, GATEWAY_HAN
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , GATEWAY_START_RESULT, Gateway_Start, GATEWAY_HANDLE, gw);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, Gateway_RemoveModuleByName, GATEWAY_HANDLE, gw, const char *, module_name);
 
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , FILE_WATCHER_HANDLE, FileWatcher_Create, const char*, file_path, FILE_WATCHER_CALLBACK, callback, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, FileWatcher_Destroy, FILE_WATCHER_HANDLE, watcher);
+
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , BROKER_HANDLE, Broker_Create);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_Destroy, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_IncRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, Broker_DecRef, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , BROKER_RESULT, Broker_AddReplicaModule, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_REPLICA*, replica);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_SetDrainTimeout, BROKER_HANDLE, handle, unsigned int, drain_timeout_ms);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_GetDrainStatistics, BROKER_HANDLE, handle, BROKER_DRAIN_STATISTICS*, statistics);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , BROKER_RESULT, Broker_SetHealthMonitor, BROKER_HANDLE, handle, const BROKER_HEALTH_BUDGETS*, budgets, BROKER_HEALTH_CALLBACK, callback, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , BROKER_RESULT, Broker_SetMessageTap, BROKER_HANDLE, handle, const BROKER_MESSAGE_TAP*, tap, BROKER_TAP_CALLBACK, callback, void*, context);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 
@@ -415,6 +517,8 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , int, OutprocessLoader_SpawnChildPr
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , EVENTSYSTEM_HANDLE, EventSystem_Init);
 DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , void, EventSystem_AddEventCallback, EVENTSYSTEM_HANDLE, event_system, GATEWAY_EVENT, event_type, GATEWAY_CALLBACK, callback, void*, user_param);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayMocks, , void, EventSystem_ReportModuleHealth, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_MODULE_HEALTH*, health);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void, EventSystem_ReportMessageTap, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, const GATEWAY_TAPPED_MESSAGE*, tapped);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
@@ -429,11 +533,19 @@ DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , void*, VECTOR_find_if, const VECTO
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void*, gballoc_malloc, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , void*, gballoc_realloc, void*, ptr, size_t, size);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, gballoc_free, void*, ptr)
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , MODULE_HANDLE, mock_Module_ParseConfigurationFromJson, const char*, configuration);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void*, mock_Module_ParseConfigurationFromJsonValue, const JSON_Value*, configuration);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, mock_Module_FreeConfiguration, void*, configuration);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayMocks, , MODULE_HANDLE, mock_Module_Create, BROKER_HANDLE, broker, const void*, configuration);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayMocks, , void, mock_Module_Destroy, MODULE_HANDLE, moduleHandle);
@@ -464,6 +576,13 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
         NULL
     };
 
+    dummyAPIs2 =
+    {
+        dummyAPIs,
+        mock_Module_ParseConfigurationFromJsonValue
+    };
+    dummyAPIs2.api_1.base.version = MODULE_API_VERSION_2;
+
     default_module_loader =
     {
         DynamicModuleLoader_Load,
@@ -503,6 +622,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     {
         ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
     }
+
+    updateLockDepth = 0;
+    listChangedUnderLock = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -631,10 +753,12 @@ static void setup_2module_gw(CGatewayMocks& mocks, char * path)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .SetReturn(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)));
 }
 
 static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const char * modulename, const char* loadername = "loader1")
@@ -658,7 +782,7 @@ static void setup_parse_modules_entry(CGatewayMocks& mocks, size_t index, const
         .SetReturn(modulename);
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "replicas"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
@@ -680,19 +804,32 @@ static void setup_links_entry(CGatewayMocks& mocks, size_t index, const char * s
         .IgnoreArgument(2);
 }
 
-static void add_a_module(CGatewayMocks& mocks, size_t index)
+static void add_a_module(CGatewayMocks& mocks, size_t index, bool parses_json_value = false)
 {
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(MODULE_DATA)));
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJson("[serialized string]"));
+    if (parses_json_value)
+    {
+        STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2)
+            .SetReturn(reinterpret_cast<const MODULE_API*>(&dummyAPIs2));
+        STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJsonValue(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+    else
+    {
+        STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+        STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJson("[serialized string]"));
+        STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
+    }
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -721,18 +858,6 @@ static void add_a_link(CGatewayMocks& mocks, size_t index)
 {
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -741,6 +866,65 @@ static void add_a_link(CGatewayMocks& mocks, size_t index)
         .IgnoreArgument(2);
 }
 
+static void hash_a_module(CGatewayMocks& mocks, size_t index)
+{
+    STRICT_EXPECTED_CALL(mocks, json_array_get_value(IGNORED_PTR_ARG, index))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_value_get_type(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+}
+
+static void stamp_module_hashes(CGatewayMocks& mocks, size_t count)
+{
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "modules"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    for (size_t index = 0; index < count; index++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
+            .IgnoreArgument(1);
+        hash_a_module(mocks, index);
+    }
+}
+
+static void hash_update_modules(CGatewayMocks& mocks, size_t count)
+{
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(count * sizeof(uint64_t)));
+    STRICT_EXPECTED_CALL(mocks, json_value_get_object(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "modules"))
+        .IgnoreArgument(1);
+    for (size_t index = 0; index < count; index++)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, index))
+            .IgnoreArgument(1);
+        hash_a_module(mocks, index);
+    }
+}
+
+/* the update plan: sizes of the running modules and links and of the entries, then one slot per entry */
+static void plan_an_update(CGatewayMocks& mocks, size_t count)
+{
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    if (count > 0)
+    {
+        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+}
+
 /*Tests_SRS_GATEWAY_JSON_14_008: [ This function shall return NULL upon any memory allocation failure. */
 TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fail)
 {
@@ -772,10 +956,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -803,7 +985,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
 /*Tests_SRS_GATEWAY_JSON_14_002: [The function shall use parson to read the file and parse the JSON string to a parson JSON_Value structure.]*/
 /*Tests_SRS_GATEWAY_JSON_17_005: [ The function shall parse the "loading args" for "module path" and fill a DYNAMIC_LOADER_CONFIG structure with the module path information. ]*/
 /*Tests_SRS_GATEWAY_JSON_14_004: [The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance.]*/
-/*Tests_SRS_GATEWAY_JSON_14_005: [The function shall set the value of const void* module_properties in the GATEWAY_PROPERTIES instance to a char* representing the serialized args value for the particular module.]*/
+/*Tests_SRS_GATEWAY_JSON_14_005: [The function shall set the module_configuration_json of each GATEWAY_JSON_MODULES_ENTRY to the parsed args value for the particular module, and leave its module_configuration NULL.]*/
 /*Tests_SRS_GATEWAY_JSON_14_007: [The function shall use the GATEWAY_PROPERTIES instance to create and return a GATEWAY_HANDLE using the lower level API.]*/
 /*Tests_SRS_GATEWAY_JSON_04_001: [The function shall create a Vector to Store all links to this gateway.] */
 /*Tests_SRS_GATEWAY_JSON_04_002: [The function shall add all modules source and sink to GATEWAY_PROPERTIES inside gateway_links.] */
@@ -814,6 +996,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Returns_NULL_on_gateway_create_internal_fai
 /*Tests_SRS_GATEWAY_JSON_17_011: [ The function shall the loader's BuildModuleConfiguration to construct module input from module's "args" and "loader.entrypoint". ]*/
 /*Tests_SRS_GATEWAY_JSON_17_013: [ The function shall parse each modules object for "loader.name" and "loader.entrypoint". ]*/
 /*Tests_SRS_GATEWAY_JSON_17_014: [ The function shall find the correct loader by "loader.name". ]*/
+/*Tests_SRS_GATEWAY_JSON_17_033: [ Otherwise the gateway shall serialize the "args" only while the module's Module_ParseConfigurationFromJson is called. ]*/
 TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 {
     //Arrange
@@ -864,6 +1047,136 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
            .IgnoreArgument(2);
        STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
+       stamp_module_hashes(mocks, 2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+           .IgnoreArgument(1);
+	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		   .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
+          .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_034: [ If a module's "replicas" number is greater than one, the function shall add that many GATEWAY_JSON_MODULES_ENTRYs named "<name>#<index>", sharing the module's loader entrypoint and args, with the replica count, index and optional "replica_key" in module_replica. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_035: [ A link whose source or sink names a replicated module shall be added once for each of the module's replicas. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_adds_module_replicas_and_their_links)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "replicas"))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "source"))
+        .IgnoreArgument(1)
+        .SetReturn("*");
+    STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "sink"))
+        .IgnoreArgument(1)
+        .SetReturn("name");
+    STRICT_EXPECTED_CALL(mocks, Broker_AddReplicaModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_AddReplicaModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 2, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    MODULE_DATA* first_replica = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0);
+    MODULE_DATA* second_replica = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 1);
+    ASSERT_ARE_EQUAL(char_ptr, "name#0", first_replica->module_name);
+    ASSERT_ARE_EQUAL(char_ptr, "name#1", second_replica->module_name);
+    ASSERT_IS_TRUE(first_replica->configuration_hash == second_replica->configuration_hash);
+    ASSERT_ARE_EQUAL(size_t, 2, BASEIMPLEMENTATION::VECTOR_size(gateway->links));
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_032: [ If the module implements Module_ParseConfigurationFromJsonValue, the gateway shall pass it the parsed "args" without serializing them. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_passes_args_value_to_v2_modules)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    setup_2module_gw(mocks, (char *)VALID_JSON_PATH);
+
+    // modules array
+    setup_parse_modules_entry(mocks, 0, "module1");
+    setup_parse_modules_entry(mocks, 1, "module2");
+
+    // links entry
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+
+    setup_links_entry(mocks, 0, "module1", "module2");
+    setup_links_entry(mocks, 1, "module2", "module1");
+
+
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(sizeof(GATEWAY_HANDLE_DATA)));
+    STRICT_EXPECTED_CALL(mocks, Broker_Create());
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(MODULE_DATA*)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(LINK_DATA)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Adding module 1 (Success)
+    add_a_module(mocks, 0, true);
+    //Adding module 2 (Success)
+    add_a_module(mocks, 1, true);
+
+    //process the links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    add_a_link(mocks, 0);
+    add_a_link(mocks, 1);
+
+
+    //Gateway start
+       STRICT_EXPECTED_CALL(mocks, EventSystem_Init());
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_CREATED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+           .IgnoreArgument(1)
+           .IgnoreArgument(2);
+       STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+           .IgnoreArgument(1);
+       stamp_module_hashes(mocks, 2);
        STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -871,13 +1184,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_Parses_Valid_JSON_Configuration_File)
 	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		   .IgnoreArgument(1)
            .IgnoreArgument(2);
-       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
        STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
            .IgnoreArgument(1);
 	   STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		   .IgnoreArgument(1)
            .IgnoreArgument(2);
-       STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
            .IgnoreArgument(1);
        STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -952,10 +1263,8 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG,0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG,1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -996,12 +1305,6 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG,IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG,IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG,IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1075,7 +1378,7 @@ TEST_FUNCTION(Gateway_Create_Start_fails_returns_null)
 
 /*Tests_SRS_GATEWAY_JSON_14_002: [The function shall use parson to read the file and parse the JSON string to a parson JSON_Value structure.]*/
 /*Tests_SRS_GATEWAY_JSON_14_004: [The function shall traverse the JSON_Value object to initialize a GATEWAY_PROPERTIES instance.]*/
-/*Tests_SRS_GATEWAY_JSON_14_005: [The function shall set the value of const void* module_properties in the GATEWAY_PROPERTIES instance to a char* representing the serialized args value for the particular module.]*/
+/*Tests_SRS_GATEWAY_JSON_14_005: [The function shall set the module_configuration_json of each GATEWAY_JSON_MODULES_ENTRY to the parsed args value for the particular module, and leave its module_configuration NULL.]*/
 /*Tests_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
 TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Push_Back_Fail)
 {
@@ -1106,23 +1409,19 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Push_Back_Fail)
         .SetReturn("Module2");
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "replicas"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetFailReturn(-1);
 
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
@@ -1144,6 +1443,28 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Push_Back_Fail)
 
 }
 
+/*Tests_SRS_GATEWAY_JSON_17_015: [ The function shall read the optional "startup.threads" number, and create the gateway with that many startup threads. ]*/
+TEST_FUNCTION(Gateway_CreateFromJson_reads_startup_threads)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1)
+        .SetReturn(4.0);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromJson(VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    ASSERT_ARE_EQUAL(int, 4, (int)((GATEWAY_HANDLE_DATA*)gateway)->startup_threads);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
 /*Tests_SRS_GATEWAY_JSON_14_006: [The function shall return NULL if the JSON_Value contains incomplete information.]*/
 TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Modules_Array)
 {
@@ -1165,6 +1486,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Modules_Array)
         .SetFailReturn((JSON_Array*)NULL);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
@@ -1204,10 +1527,12 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .SetReturn(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)));
 
     // modules array
     setup_parse_modules_entry(mocks, 0, "module1");
@@ -1251,6 +1576,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    stamp_module_hashes(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -1258,13 +1584,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_NULL_Loaders_Array_suc
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1338,7 +1662,9 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_VECTOR_Create_Fail)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)))
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)))
         .SetFailReturn((VECTOR_HANDLE)NULL);
 
     STRICT_EXPECTED_CALL(mocks, json_value_free(IGNORED_PTR_ARG))
@@ -1373,12 +1699,8 @@ TEST_FUNCTION(Gateway_CreateFromJson_Traverses_JSON_Value_VECTOR_Create_for_link
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
 
@@ -1533,6 +1855,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
         .IgnoreArgument(2);
     STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    stamp_module_hashes(mocks, 2);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -1540,13 +1863,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_uses_native_loader_when_loader_name_is_miss
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1632,7 +1953,7 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
         .SetReturn("module1");
     STRICT_EXPECTED_CALL(mocks, json_object_get_value(IGNORED_PTR_ARG, "args"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "replicas"))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
@@ -1678,13 +1999,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_fails_with_no_entry_point)
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1792,13 +2111,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_links_parsing_no_source)
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -1856,13 +2173,11 @@ TEST_FUNCTION(Gateway_CreateFromJson_Fails_links_parsing_pushback_fails)
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
 		.IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char *)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -2004,7 +2319,9 @@ static void setup_2module_update_gw(CGatewayMocks& mocks, char * json_content)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)));
 
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -2039,41 +2356,23 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_Valid_JSON_Configuration_File_Succee
     setup_links_entry(mocks, 1, "module2", "module1");
 
 
-    //Vector to track the successfull added link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    hash_update_modules(mocks, 2);
+    plan_an_update(mocks, 2);
 
-    //Adding module 1 (Success)
+    //Creating and attaching module 1 and module 2 (Success)
     add_a_module(mocks, 0);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    //Adding module 2 (Success)
     add_a_module(mocks, 1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     ////process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     add_a_link(mocks, 0);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
     add_a_link(mocks, 1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Modules
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //hashes
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -2082,13 +2381,11 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_Valid_JSON_Configuration_File_Succee
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
@@ -2139,7 +2436,9 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustModule_Configuration_Fi
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1)
         .SetFailReturn((JSON_Array *)NULL);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)));
 
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -2151,29 +2450,17 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustModule_Configuration_Fi
     setup_parse_modules_entry(mocks, 0, "module1");
     setup_parse_modules_entry(mocks, 1, "module2");
 
-    //Vector to track the successfull added link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    hash_update_modules(mocks, 2);
+    plan_an_update(mocks, 2);
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-
-    //Adding module 1 (Success)
+    //Creating and attaching module 1 and module 2 (Success)
     add_a_module(mocks, 0);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    //Adding module 2 (Success)
     add_a_module(mocks, 1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Modules
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //hashes
 
     //Destroying Module1 from Properties
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -2183,7 +2470,6 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustModule_Configuration_Fi
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
 
     //Destroying Module2 from Properties
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
@@ -2191,7 +2477,6 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustModule_Configuration_Fi
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
 
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -2240,7 +2525,9 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1)
         .SetFailReturn((JSON_Array *)NULL);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_JSON_MODULES_ENTRY)));
 
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
         .IgnoreArgument(1)
@@ -2250,29 +2537,17 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
     setup_parse_modules_entry(mocks, 0, "module1");
     setup_parse_modules_entry(mocks, 1, "module2");
 
-    //Vector to track the successfull added link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
+    hash_update_modules(mocks, 2);
+    plan_an_update(mocks, 2);
 
-    //Adding module 1 (Success)
+    //Creating and attaching module 1 and module 2 (Success)
     add_a_module(mocks, 0);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    //Adding module 2 (Success)
     add_a_module(mocks, 1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Modules
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1); //hashes
 
                             //Destroying Module1 from Properties
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -2282,7 +2557,6 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
 
     //Destroying Module2 from Properties
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
@@ -2290,7 +2564,6 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
     STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeEntrypoint(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, json_free_serialized_string((char*)"[serialized string]"));
 
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -2322,6 +2595,8 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
         .SetFailReturn((JSON_Array *)NULL);
     STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_dotget_number(IGNORED_PTR_ARG, "startup.threads"))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
 
     STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
@@ -2331,27 +2606,16 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
     setup_links_entry(mocks, 0, "module1", "module2");
     setup_links_entry(mocks, 1, "module2", "module1");
 
-    //Vector to track the successfull added link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY)));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(GATEWAY_LINK_ENTRY)));
+    plan_an_update(mocks, 0);
 
+    ////process the links
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-
     add_a_link(mocks, 0);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
     add_a_link(mocks, 1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Modules
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); //Successfull Links
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
 
     STRICT_EXPECTED_CALL(mocks, VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -2374,4 +2638,718 @@ TEST_FUNCTION(Gateway_UpdateFromJson_Parses_JSON_WithJustLinks_Configuration_Fil
 }
 
 
+/* one module named "name", no links */
+static void setup_1module_update(CNiceCallComparer<CGatewayMocks>& mocks)
+{
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
+        .IgnoreArgument(1)
+        .SetReturn((JSON_Array *)NULL);
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_016: [ The function shall hash the JSON of each module, so that a later update can tell whether the module changed. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_017: [ A module whose name and configuration match a running module shall be left running untouched. ]*/
+TEST_FUNCTION(Gateway_UpdateFromJson_same_configuration_twice_keeps_module)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    setup_1module_update(mocks);
+    int result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    MODULE_DATA* module_data = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0);
+    MODULE_HANDLE module = module_data->module;
+    mocks.ResetAllCalls();
+
+    setup_1module_update(mocks);
+
+    //Act
+    result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    ASSERT_ARE_EQUAL(void_ptr, module_data, *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0));
+    ASSERT_ARE_EQUAL(void_ptr, module, module_data->module);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_018: [ A module whose name matches a running module but whose configuration differs shall be replaced by a new instance. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_021: [ A replacement module shall be added to the broker with the links of the module it replaces before that module is removed. ]*/
+TEST_FUNCTION(Gateway_UpdateFromJson_changed_configuration_replaces_module)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    setup_1module_update(mocks);
+    int result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    MODULE_DATA* module_data = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0);
+    MODULE_HANDLE module = module_data->module;
+    module_data->configuration_hash = 1;
+    mocks.ResetAllCalls();
+
+    setup_1module_update(mocks);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(module));
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    ASSERT_ARE_EQUAL(void_ptr, module_data, *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0));
+    ASSERT_ARE_NOT_EQUAL(void_ptr, module, module_data->module);
+    ASSERT_ARE_NOT_EQUAL(int, 1, (int)module_data->configuration_hash);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_020: [ The function shall create every new and replacement module before it changes the running gateway, and shall leave the gateway unchanged if any of them fails. ]*/
+TEST_FUNCTION(Gateway_UpdateFromJson_create_fails_leaves_gateway_unchanged)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    setup_1module_update(mocks);
+    int result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    MODULE_DATA* module_data = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0);
+    MODULE_HANDLE module = module_data->module;
+    module_data->configuration_hash = 1;
+    mocks.ResetAllCalls();
+
+    setup_1module_update(mocks);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments()
+        .SetFailReturn((MODULE_HANDLE)NULL);
+
+    //Act
+    result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    ASSERT_ARE_EQUAL(void_ptr, module, module_data->module);
+    ASSERT_ARE_EQUAL(int, 1, (int)module_data->configuration_hash);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_04_004: [ If gw is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ]*/
+/*Tests_SRS_GATEWAY_JSON_04_003: [ If json_content is NULL the function shall return GATEWAY_UPDATE_FROM_JSON_ERROR. ]*/
+TEST_FUNCTION(Gateway_ReplaceFromJson_NULL_args_fail)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Act
+    GATEWAY_UPDATE_FROM_JSON_RESULT result1 = Gateway_ReplaceFromJson(NULL, VALID_JSON_CONTENT);
+    GATEWAY_UPDATE_FROM_JSON_RESULT result2 = Gateway_ReplaceFromJson(gateway, NULL);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_INVALID_ARG, result1);
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_INVALID_ARG, result2);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_024: [ Gateway_ReplaceFromJson shall return GATEWAY_UPDATE_FROM_JSON_ERROR if the document does not have both `modules` and `links`. ]*/
+TEST_FUNCTION(Gateway_ReplaceFromJson_without_links_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    setup_1module_update(mocks);
+    int result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+
+    setup_1module_update(mocks);
+
+    //Act
+    result = Gateway_ReplaceFromJson(gateway, VALID_JSON_CONTENT);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, GATEWAY_UPDATE_FROM_JSON_ERROR, result);
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_023: [ Gateway_ReplaceFromJson shall remove every link and then every module that is not in the document, after the new modules and links are in place. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_025: [ The function shall report GATEWAY_MODULE_LIST_CHANGED if any module was added, replaced or removed. ]*/
+TEST_FUNCTION(Gateway_ReplaceFromJson_removes_modules_not_in_document)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    setup_1module_update(mocks);
+    int result = Gateway_UpdateFromJson(gateway, VALID_JSON_CONTENT);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    MODULE_HANDLE module = (*(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0))->module;
+    mocks.ResetAllCalls();
+
+    // empty "modules" and "links"
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(module));
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    result = Gateway_ReplaceFromJson(gateway, VALID_JSON_CONTENT);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 0, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_026: [ If gw or file_path is NULL, Gateway_WatchJsonFile shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_NULL_args_fail)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result1 = Gateway_WatchJsonFile(NULL, VALID_JSON_PATH);
+    int result2 = Gateway_WatchJsonFile(gateway, NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_027: [ Gateway_WatchJsonFile shall stop watching any previous file and create a file watcher on file_path. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_036: [ Gateway_WatchJsonFile shall create the gateway's lock, if it has none, before it creates the file watcher, and return a non-zero value if it cannot. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_creates_watcher)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Create(VALID_JSON_PATH, IGNORED_PTR_ARG, gateway))
+        .IgnoreArgument(2);
+
+    //Act
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL(gateway->json_file_watcher);
+    ASSERT_IS_NOT_NULL(gateway->update_lock);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_027: [ Gateway_WatchJsonFile shall stop watching any previous file and create a file watcher on file_path. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_twice_destroys_previous_watcher)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    (void)Gateway_WatchJsonFile(gateway, DUMMY_JSON_PATH);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Destroy((FILE_WATCHER_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Create(VALID_JSON_PATH, IGNORED_PTR_ARG, gateway))
+        .IgnoreArgument(2);
+
+    //Act
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_030: [ Gateway_WatchJsonFile shall return a non-zero value if the file watcher cannot be created. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_watcher_create_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock_Init());
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Create(VALID_JSON_PATH, IGNORED_PTR_ARG, gateway))
+        .IgnoreArgument(2)
+        .SetFailReturn((FILE_WATCHER_HANDLE)NULL);
+
+    //Act
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(gateway->json_file_watcher);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_036: [ Gateway_WatchJsonFile shall create the gateway's lock, if it has none, before it creates the file watcher, and return a non-zero value if it cannot. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_lock_init_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Lock_Init())
+        .SetFailReturn((LOCK_HANDLE)NULL);
+
+    //Act
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(gateway->json_file_watcher);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_028: [ When the watched file changes, the gateway shall parse the file and apply it as Gateway_ReplaceFromJson does. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_037: [ The function shall hold the gateway's lock, if it has one, while it applies the configuration, and return GATEWAY_UPDATE_FROM_JSON_ERROR if it cannot take it. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_change_holds_the_gateway_lock)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(gateway->update_lock));
+    STRICT_EXPECTED_CALL(mocks, Unlock(gateway->update_lock));
+
+    //Act
+    watcherCallback(VALID_JSON_PATH, watcherContext);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_037: [ The function shall hold the gateway's lock, if it has one, while it applies the configuration, and return GATEWAY_UPDATE_FROM_JSON_ERROR if it cannot take it. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_change_lock_fails_keeps_configuration)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(gateway->update_lock))
+        .SetFailReturn(LOCK_ERROR);
+
+    //Act
+    watcherCallback(VALID_JSON_PATH, watcherContext);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 0, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_028: [ When the watched file changes, the gateway shall parse the file and apply it as Gateway_ReplaceFromJson does. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_change_applies_file)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_parse_file(VALID_JSON_PATH));
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+
+    //Act
+    watcherCallback(VALID_JSON_PATH, watcherContext);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_025: [ The function shall report GATEWAY_MODULE_LIST_CHANGED if any module was added, replaced or removed. ]*/
+/*Tests_SRS_GATEWAY_JSON_17_039: [ The function shall report GATEWAY_MODULE_LIST_CHANGED after it releases the gateway's lock. ]*/
+TEST_FUNCTION(Gateway_WatchJsonFile_change_reports_module_list_after_unlocking)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    int result = Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, Lock(gateway->update_lock));
+    STRICT_EXPECTED_CALL(mocks, Unlock(gateway->update_lock));
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, IGNORED_PTR_ARG, GATEWAY_MODULE_LIST_CHANGED))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+
+    //Act
+    watcherCallback(VALID_JSON_PATH, watcherContext);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    ASSERT_ARE_EQUAL(size_t, 0, listChangedUnderLock);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_029: [ Gateway_UnwatchJsonFile shall destroy the file watcher, if any. ]*/
+TEST_FUNCTION(Gateway_UnwatchJsonFile_destroys_watcher)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    (void)Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Destroy((FILE_WATCHER_HANDLE)0x42));
+
+    //Act
+    Gateway_UnwatchJsonFile(gateway);
+    Gateway_UnwatchJsonFile(gateway);
+    Gateway_UnwatchJsonFile(NULL);
+
+    //Assert
+    ASSERT_IS_NULL(gateway->json_file_watcher);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+}
+
+/*Tests_SRS_GATEWAY_JSON_17_031: [ Gateway_Destroy shall stop watching the JSON configuration file. ]*/
+/*Tests_SRS_GATEWAY_17_052: [ Gateway_Destroy shall wait for a change the gateway is making on another thread to finish, and then destroy the gateway's lock. ]*/
+TEST_FUNCTION(Gateway_Destroy_stops_watching_json_file)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    (void)Gateway_WatchJsonFile(gateway, VALID_JSON_PATH);
+    LOCK_HANDLE update_lock = gateway->update_lock;
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, FileWatcher_Destroy((FILE_WATCHER_HANDLE)0x42));
+    STRICT_EXPECTED_CALL(mocks, Lock(update_lock));
+    STRICT_EXPECTED_CALL(mocks, Unlock(update_lock));
+    STRICT_EXPECTED_CALL(mocks, Lock_Deinit(update_lock));
+
+    //Act
+    gateway_destroy_internal(gateway);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/* compiles one module and no links: only the modules array has a count */
+static void compile_1module_snapshot(CNiceCallComparer<CGatewayMocks>& mocks)
+{
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    int result = Gateway_CompileJsonSnapshot(VALID_JSON_PATH, SNAPSHOT_PATH);
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.ResetAllCalls();
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_001: [ If file_path or snapshot_path is NULL, Gateway_CompileJsonSnapshot shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_CompileJsonSnapshot_NULL_args_fail)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    //Act
+    int result1 = Gateway_CompileJsonSnapshot(NULL, SNAPSHOT_PATH);
+    int result2 = Gateway_CompileJsonSnapshot(VALID_JSON_PATH, NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_005: [ Gateway_CompileJsonSnapshot shall destroy the module loader list before returning. ]*/
+TEST_FUNCTION(Gateway_CompileJsonSnapshot_unreadable_file_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, json_parse_file(VALID_JSON_PATH))
+        .SetFailReturn((JSON_Value*)NULL);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    int result = Gateway_CompileJsonSnapshot(VALID_JSON_PATH, SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_002: [ Gateway_CompileJsonSnapshot shall parse and validate file_path as Gateway_CreateFromJson does, and shall return a non-zero value if it is not a complete configuration. ]*/
+TEST_FUNCTION(Gateway_CompileJsonSnapshot_without_links_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    (void)remove(SNAPSHOT_PATH);
+
+    STRICT_EXPECTED_CALL(mocks, json_object_get_array(IGNORED_PTR_ARG, "links"))
+        .IgnoreArgument(1)
+        .SetReturn((JSON_Array *)NULL);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    int result = Gateway_CompileJsonSnapshot(VALID_JSON_PATH, SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+    FILE* snapshot = fopen(SNAPSHOT_PATH, "rb");
+    ASSERT_IS_NULL(snapshot);
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_003: [ Gateway_CompileJsonSnapshot shall store, for each module, its name, its loader name, its serialized entrypoint and args, the hash of its JSON, and its replica count, index and key. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_004: [ Gateway_CompileJsonSnapshot shall write the loaders, startup threads, modules and links to snapshot_path, with a checksum over the snapshot. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_009: [ Gateway_CreateFromSnapshot shall initialize the module loaders from the snapshot's "loaders" JSON, if any. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_010: [ Gateway_CreateFromSnapshot shall find each module's loader by name and parse only the module's entrypoint JSON. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_011: [ Gateway_CreateFromSnapshot shall create the gateway from the snapshot's modules and links, and shall start it. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_012: [ Gateway_CreateFromSnapshot shall give each module the configuration hash stored in the snapshot. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_015: [ Gateway_CreateFromSnapshot shall parse each module's stored args and hand them to the module as the parsed "args" of a JSON configuration. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_creates_compiled_gateway)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    compile_1module_snapshot(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Initialize());
+    STRICT_EXPECTED_CALL(mocks, json_parse_string("[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_InitializeFromJson(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_FindByName("name"));
+    STRICT_EXPECTED_CALL(mocks, json_parse_string("[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_ParseEntrypointFromJson(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, json_parse_string("[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJson("[serialized string]"));
+    STRICT_EXPECTED_CALL(mocks, Gateway_Start(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 1, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    MODULE_DATA* module_data = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 0);
+    ASSERT_ARE_EQUAL(char_ptr, "name", module_data->module_name);
+    ASSERT_IS_TRUE(module_data->configuration_hash != 0);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+    (void)remove(SNAPSHOT_PATH);
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_015: [ Gateway_CreateFromSnapshot shall parse each module's stored args and hand them to the module as the parsed "args" of a JSON configuration. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_passes_args_value_to_v2_modules)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    compile_1module_snapshot(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(reinterpret_cast<const MODULE_API*>(&dummyAPIs2));
+    STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJsonValue(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, json_serialize_to_string(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .NeverInvoked();
+    STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJson(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .NeverInvoked();
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+    (void)remove(SNAPSHOT_PATH);
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_014: [ Gateway_CreateFromSnapshot shall give each module entry the replica count, index and key stored in the snapshot. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_keeps_module_replicas)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .SetReturn(1);
+    STRICT_EXPECTED_CALL(mocks, json_object_get_number(IGNORED_PTR_ARG, "replicas"))
+        .IgnoreArgument(1)
+        .SetReturn(2);
+    ASSERT_ARE_EQUAL(int, 0, Gateway_CompileJsonSnapshot(VALID_JSON_PATH, SNAPSHOT_PATH));
+    mocks.ResetAllCalls();
+
+    STRICT_EXPECTED_CALL(mocks, Broker_AddReplicaModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, Broker_AddReplicaModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+    ASSERT_ARE_EQUAL(size_t, 2, BASEIMPLEMENTATION::VECTOR_size(gateway->modules));
+    MODULE_DATA* module_data = *(MODULE_DATA**)BASEIMPLEMENTATION::VECTOR_element(gateway->modules, 1);
+    ASSERT_ARE_EQUAL(char_ptr, "name#1", module_data->module_name);
+
+    //Cleanup
+    gateway_destroy_internal(gateway);
+    (void)remove(SNAPSHOT_PATH);
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_006: [ If snapshot_path is NULL, Gateway_CreateFromSnapshot shall return NULL. ]*/
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_007: [ Gateway_CreateFromSnapshot shall read the snapshot in a single read, and shall return NULL if it cannot be read. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_NULL_or_missing_snapshot_fails)
+{
+    //Arrange
+    CGatewayMocks mocks;
+    (void)remove(SNAPSHOT_PATH);
+
+    //Act
+    GATEWAY_HANDLE gateway1 = Gateway_CreateFromSnapshot(NULL);
+    GATEWAY_HANDLE gateway2 = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway1);
+    ASSERT_IS_NULL(gateway2);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_008: [ Gateway_CreateFromSnapshot shall return NULL if the snapshot's magic, version, size or checksum do not match, or if any of its tables or strings is out of bounds. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_corrupt_snapshot_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    compile_1module_snapshot(mocks);
+
+    FILE* snapshot = fopen(SNAPSHOT_PATH, "r+b");
+    ASSERT_IS_NOT_NULL(snapshot);
+    ASSERT_ARE_EQUAL(int, 0, fseek(snapshot, -2, SEEK_END));
+    ASSERT_ARE_EQUAL(int, 1, (int)fwrite("?", 1, 1, snapshot));
+    fclose(snapshot);
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+
+    //Cleanup
+    (void)remove(SNAPSHOT_PATH);
+}
+
+/*Tests_SRS_GATEWAY_SNAPSHOT_17_013: [ Upon failure Gateway_CreateFromSnapshot shall destroy the module loader list and return NULL. ]*/
+TEST_FUNCTION(Gateway_CreateFromSnapshot_unknown_loader_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayMocks> mocks;
+    compile_1module_snapshot(mocks);
+
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_FindByName("name"))
+        .SetFailReturn((MODULE_LOADER*)NULL);
+    STRICT_EXPECTED_CALL(mocks, ModuleLoader_Destroy());
+
+    //Act
+    GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(SNAPSHOT_PATH);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    (void)remove(SNAPSHOT_PATH);
+}
+
 END_TEST_SUITE(gateway_createfromjson_ut)
@@ -0,0 +1,528 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool malloc_will_fail = false;
+static size_t malloc_fail_count = 0;
+static size_t malloc_count = 0;
+
+void* my_gballoc_malloc(size_t size)
+{
+    ++malloc_count;
+
+    void* result;
+    if (malloc_will_fail == true && malloc_count == malloc_fail_count)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = malloc(size);
+    }
+
+    return result;
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define ENABLE_MOCKS
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#include "azure_c_shared_utility/gballoc.h"
+
+#undef ENABLE_MOCKS
+
+#include "azure_c_shared_utility/vector.h"
+#include "experimental/event_system.h"
+#include "broker.h"
+#include "../src/gateway_internal.h"
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+#define TEST_MODULE_COUNT 20
+#define TEST_NAME_SIZE 16
+
+static GATEWAY_HANDLE_DATA test_gateway;
+static MODULE_DATA test_modules[TEST_MODULE_COUNT];
+static char test_names[TEST_MODULE_COUNT][TEST_NAME_SIZE];
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+/* the hash gateway_index.c keys module names by */
+static uint32_t test_hash_name(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; name[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t inline_home(const char* name)
+{
+    return test_hash_name(name) & (GATEWAY_INDEX_INLINE_SLOTS - 1);
+}
+
+static bool name_taken(const char* name, size_t taken)
+{
+    bool result = false;
+    for (size_t i = 0; i < taken; i++)
+    {
+        if (strcmp(test_names[i], name) == 0)
+        {
+            result = true;
+            break;
+        }
+    }
+    return result;
+}
+
+/* names test module i so that it hashes to the given inline slot */
+static MODULE_DATA* module_with_home(size_t i, size_t home)
+{
+    char name[TEST_NAME_SIZE];
+    bool found = false;
+    for (unsigned int n = 0; n < 100000 && !found; n++)
+    {
+        (void)sprintf(name, "module%u", n);
+        found = (inline_home(name) == home && !name_taken(name, i));
+    }
+    ASSERT_IS_TRUE(found);
+
+    (void)strcpy(test_names[i], name);
+    test_modules[i].module_name = test_names[i];
+    return &(test_modules[i]);
+}
+
+static MODULE_DATA* module_named(size_t i)
+{
+    (void)sprintf(test_names[i], "module%zu", i);
+    test_modules[i].module_name = test_names[i];
+    return &(test_modules[i]);
+}
+
+static const GATEWAY_INDEX_SLOT* inline_slot(size_t slot)
+{
+    return &(test_gateway.module_index.inline_slots[slot & (GATEWAY_INDEX_INLINE_SLOTS - 1)]);
+}
+
+static size_t found_position(const char* module_name)
+{
+    size_t position = GATEWAY_INDEX_NOT_FOUND;
+    (void)gateway_index_findmodule(&test_gateway, module_name, &position);
+    return position;
+}
+
+BEGIN_TEST_SUITE(gateway_index_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+
+    // malloc/free hooks
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    malloc_will_fail = false;
+    malloc_fail_count = 0;
+    malloc_count = 0;
+
+    /* the gateway zeroes its handle before it adds anything to the indexes */
+    memset(&test_gateway, 0, sizeof(test_gateway));
+    memset(test_modules, 0, sizeof(test_modules));
+    memset(test_names, 0, sizeof(test_names));
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    gateway_index_destroy(&test_gateway);
+
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+TEST_FUNCTION(gateway_index_findmodule_empty_index_returns_NULL)
+{
+    ///arrange
+    size_t position = 42;
+
+    ///act
+    MODULE_DATA* result = gateway_index_findmodule(&test_gateway, "module0", &position);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(size_t, 42, position);
+}
+
+TEST_FUNCTION(gateway_index_addmodule_finds_modules_at_their_positions)
+{
+    ///arrange
+    MODULE_DATA* first = module_named(0);
+    MODULE_DATA* second = module_named(1);
+
+    ///act
+    int result1 = gateway_index_addmodule(&test_gateway, first);
+    int result2 = gateway_index_addmodule(&test_gateway, second);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result1);
+    ASSERT_ARE_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(size_t, 2, test_gateway.module_index.count);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, "module0", NULL) == first);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, "module1", NULL) == second);
+    ASSERT_ARE_EQUAL(size_t, 0, found_position("module0"));
+    ASSERT_ARE_EQUAL(size_t, 1, found_position("module1"));
+    ASSERT_IS_NULL(gateway_index_findmodule(&test_gateway, "module2", NULL));
+}
+
+TEST_FUNCTION(gateway_index_addmodule_colliding_names_probe_to_the_next_slots)
+{
+    ///arrange
+    MODULE_DATA* modules[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        modules[i] = module_with_home(i, 5);
+    }
+
+    ///act
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, modules[i]));
+    }
+
+    ///assert
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_IS_TRUE(inline_slot(5 + i)->used);
+        ASSERT_IS_TRUE(inline_slot(5 + i)->first == modules[i]);
+        ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, modules[i]->module_name, NULL) == modules[i]);
+        ASSERT_ARE_EQUAL(size_t, i, found_position(modules[i]->module_name));
+    }
+    ASSERT_IS_FALSE(inline_slot(8)->used);
+}
+
+TEST_FUNCTION(gateway_index_addmodule_collision_chain_wraps_around_the_table)
+{
+    ///arrange
+    MODULE_DATA* modules[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        modules[i] = module_with_home(i, GATEWAY_INDEX_INLINE_SLOTS - 1);
+    }
+
+    ///act
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, modules[i]));
+    }
+
+    ///assert
+    ASSERT_IS_TRUE(inline_slot(GATEWAY_INDEX_INLINE_SLOTS - 1)->first == modules[0]);
+    ASSERT_IS_TRUE(inline_slot(0)->first == modules[1]);
+    ASSERT_IS_TRUE(inline_slot(1)->first == modules[2]);
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, modules[i]->module_name, NULL) == modules[i]);
+    }
+}
+
+TEST_FUNCTION(gateway_index_removemodule_from_middle_of_chain_shifts_the_rest_back)
+{
+    ///arrange
+    MODULE_DATA* modules[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        modules[i] = module_with_home(i, 5);
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, modules[i]));
+    }
+
+    ///act
+    gateway_index_removemodule(&test_gateway, modules[1]);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 2, test_gateway.module_index.count);
+    ASSERT_IS_TRUE(inline_slot(5)->first == modules[0]);
+    ASSERT_IS_TRUE(inline_slot(6)->used);
+    ASSERT_IS_TRUE(inline_slot(6)->first == modules[2]);
+    ASSERT_IS_FALSE(inline_slot(7)->used);
+    ASSERT_IS_NULL(gateway_index_findmodule(&test_gateway, modules[1]->module_name, NULL));
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, modules[0]->module_name, NULL) == modules[0]);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, modules[2]->module_name, NULL) == modules[2]);
+}
+
+TEST_FUNCTION(gateway_index_removemodule_shifts_only_entries_that_probed_past_the_hole)
+{
+    ///arrange
+    /* two modules share the last slot, the third's home is the slot the
+     * second wrapped into, and the fourth sits in its own home after them */
+    size_t last = GATEWAY_INDEX_INLINE_SLOTS - 1;
+    MODULE_DATA* first = module_with_home(0, last);
+    MODULE_DATA* second = module_with_home(1, last);
+    MODULE_DATA* third = module_with_home(2, 0);
+    MODULE_DATA* fourth = module_with_home(3, 2);
+    ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, first));
+    ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, second));
+    ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, third));
+    ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, fourth));
+    ASSERT_IS_TRUE(inline_slot(1)->first == third);
+    ASSERT_IS_TRUE(inline_slot(2)->first == fourth);
+
+    ///act
+    gateway_index_removemodule(&test_gateway, first);
+
+    ///assert
+    ASSERT_IS_TRUE(inline_slot(last)->first == second);
+    ASSERT_IS_TRUE(inline_slot(0)->first == third);
+    ASSERT_IS_FALSE(inline_slot(1)->used);
+    ASSERT_IS_TRUE(inline_slot(2)->first == fourth);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, second->module_name, NULL) == second);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, third->module_name, NULL) == third);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, fourth->module_name, NULL) == fourth);
+}
+
+TEST_FUNCTION(gateway_index_removemodule_moves_down_the_positions_after_it)
+{
+    ///arrange
+    for (size_t i = 0; i < 4; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+
+    ///act
+    gateway_index_removemodule(&test_gateway, &(test_modules[1]));
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 0, found_position("module0"));
+    ASSERT_ARE_EQUAL(size_t, GATEWAY_INDEX_NOT_FOUND, found_position("module1"));
+    ASSERT_ARE_EQUAL(size_t, 1, found_position("module2"));
+    ASSERT_ARE_EQUAL(size_t, 2, found_position("module3"));
+}
+
+TEST_FUNCTION(gateway_index_addmodule_after_remove_takes_the_last_position)
+{
+    ///arrange
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+    gateway_index_removemodule(&test_gateway, &(test_modules[0]));
+
+    ///act
+    int result = gateway_index_addmodule(&test_gateway, module_named(3));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 0, found_position("module1"));
+    ASSERT_ARE_EQUAL(size_t, 1, found_position("module2"));
+    ASSERT_ARE_EQUAL(size_t, 2, found_position("module3"));
+}
+
+TEST_FUNCTION(gateway_index_removemodule_other_module_with_same_name_does_nothing)
+{
+    ///arrange
+    MODULE_DATA other;
+    ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(0)));
+    other.module_name = test_names[0];
+
+    ///act
+    gateway_index_removemodule(&test_gateway, &other);
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 1, test_gateway.module_index.count);
+    ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, "module0", NULL) == &(test_modules[0]));
+}
+
+TEST_FUNCTION(gateway_index_addmodule_moves_to_the_heap_once_half_full)
+{
+    ///arrange
+    for (size_t i = 0; i < GATEWAY_INDEX_INLINE_SLOTS / 2; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+    ASSERT_IS_NULL(test_gateway.module_index.slots);
+
+    ///act
+    int result = gateway_index_addmodule(&test_gateway, module_named(GATEWAY_INDEX_INLINE_SLOTS / 2));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL(test_gateway.module_index.slots);
+    ASSERT_ARE_EQUAL(size_t, 2 * GATEWAY_INDEX_INLINE_SLOTS, test_gateway.module_index.capacity);
+    for (size_t i = 0; i <= GATEWAY_INDEX_INLINE_SLOTS / 2; i++)
+    {
+        ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, test_names[i], NULL) == &(test_modules[i]));
+        ASSERT_ARE_EQUAL(size_t, i, found_position(test_names[i]));
+    }
+}
+
+TEST_FUNCTION(gateway_index_addmodule_keeps_growing_and_finds_every_module)
+{
+    ///arrange
+
+    ///act
+    for (size_t i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, 4 * GATEWAY_INDEX_INLINE_SLOTS, test_gateway.module_index.capacity);
+    ASSERT_ARE_EQUAL(size_t, TEST_MODULE_COUNT, test_gateway.module_index.count);
+    for (size_t i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, test_names[i], NULL) == &(test_modules[i]));
+        ASSERT_ARE_EQUAL(size_t, i, found_position(test_names[i]));
+    }
+}
+
+TEST_FUNCTION(gateway_index_removemodule_after_resize_shifts_positions)
+{
+    ///arrange
+    for (size_t i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+
+    ///act
+    gateway_index_removemodule(&test_gateway, &(test_modules[5]));
+
+    ///assert
+    ASSERT_ARE_EQUAL(size_t, TEST_MODULE_COUNT - 1, test_gateway.module_index.count);
+    for (size_t i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        size_t expected = (i < 5) ? i : (i == 5) ? GATEWAY_INDEX_NOT_FOUND : i - 1;
+        ASSERT_ARE_EQUAL(size_t, expected, found_position(test_names[i]));
+    }
+}
+
+TEST_FUNCTION(gateway_index_addmodule_grow_fails_keeps_the_inline_slots)
+{
+    ///arrange
+    for (size_t i = 0; i < GATEWAY_INDEX_INLINE_SLOTS / 2; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+    malloc_will_fail = true;
+    malloc_fail_count = 1;
+
+    ///act
+    int result = gateway_index_addmodule(&test_gateway, module_named(GATEWAY_INDEX_INLINE_SLOTS / 2));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NULL(test_gateway.module_index.slots);
+    for (size_t i = 0; i <= GATEWAY_INDEX_INLINE_SLOTS / 2; i++)
+    {
+        ASSERT_IS_TRUE(gateway_index_findmodule(&test_gateway, test_names[i], NULL) == &(test_modules[i]));
+    }
+}
+
+TEST_FUNCTION(gateway_index_addmodule_fails_when_full_and_unable_to_grow)
+{
+    ///arrange
+    malloc_will_fail = true;
+    for (size_t i = 0; i < GATEWAY_INDEX_INLINE_SLOTS - 1; i++)
+    {
+        /* fail every attempt to grow */
+        malloc_fail_count = malloc_count + 1;
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+    malloc_fail_count = malloc_count + 1;
+
+    ///act
+    int result = gateway_index_addmodule(&test_gateway, module_named(GATEWAY_INDEX_INLINE_SLOTS - 1));
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, GATEWAY_INDEX_INLINE_SLOTS - 1, test_gateway.module_index.count);
+    ASSERT_IS_NULL(gateway_index_findmodule(&test_gateway, test_names[GATEWAY_INDEX_INLINE_SLOTS - 1], NULL));
+}
+
+TEST_FUNCTION(gateway_index_removelink_moves_the_last_link_into_its_place)
+{
+    ///arrange
+    LINK_DATA links[3];
+    GATEWAY_LINK_ENTRY first_entry = { "module0", "module1" };
+    GATEWAY_LINK_ENTRY last_entry = { "*", "module2" };
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addmodule(&test_gateway, module_named(i)));
+    }
+    links[0].from_any_source = false;
+    links[0].module_source = &(test_modules[0]);
+    links[0].module_sink = &(test_modules[1]);
+    links[1].from_any_source = false;
+    links[1].module_source = &(test_modules[1]);
+    links[1].module_sink = &(test_modules[2]);
+    links[2].from_any_source = true;
+    links[2].module_source = NULL;
+    links[2].module_sink = &(test_modules[2]);
+    for (size_t i = 0; i < 3; i++)
+    {
+        ASSERT_ARE_EQUAL(int, 0, gateway_index_addlink(&test_gateway, &(links[i])));
+    }
+    ASSERT_ARE_EQUAL(size_t, 2, gateway_index_findlink(&test_gateway, &last_entry));
+
+    ///act
+    LINK_DATA* result = gateway_index_removelink(&test_gateway, &(links[0]));
+
+    ///assert
+    ASSERT_IS_TRUE(result == &(links[2]));
+    ASSERT_IS_TRUE(links[0].from_any_source);
+    ASSERT_ARE_EQUAL(size_t, GATEWAY_INDEX_NOT_FOUND, gateway_index_findlink(&test_gateway, &first_entry));
+    ASSERT_ARE_EQUAL(size_t, 0, gateway_index_findlink(&test_gateway, &last_entry));
+    ASSERT_ARE_EQUAL(size_t, GATEWAY_INDEX_NOT_FOUND, gateway_index_findlinkof(&test_gateway, &(test_modules[0])));
+    ASSERT_ARE_EQUAL(size_t, 1, gateway_index_findlinkof(&test_gateway, &(test_modules[1])));
+}
+
+END_TEST_SUITE(gateway_index_ut)
@@ -0,0 +1,299 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#include "testrunnerswitcher.h"
+#include "micromock.h"
+#include "micromockcharstararenullterminatedstrings.h"
+
+#include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/agenttime.h"
+#include "module.h"
+#include "gateway.h"
+#include "experimental/event_system.h"
+#include "module_loaders/static_loader.h"
+
+static MICROMOCK_MUTEX_HANDLE g_testByTest;
+static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
+
+/* how long an update may take before the test calls it a deadlock */
+#define UPDATE_TIMEOUT_SECS 10
+
+static LOCK_HANDLE g_state_lock;
+static bool g_update_done;
+static GATEWAY_UPDATE_FROM_JSON_RESULT g_update_result;
+static size_t g_list_changed_count;
+
+static void* UpdateIntModule_ParseConfigurationFromJson(const char* configuration)
+{
+    (void)configuration;
+    return NULL;
+}
+
+static void UpdateIntModule_FreeConfiguration(void* configuration)
+{
+    (void)configuration;
+}
+
+static MODULE_HANDLE UpdateIntModule_Create(BROKER_HANDLE broker, const void* configuration)
+{
+    (void)broker;
+    (void)configuration;
+    return (MODULE_HANDLE)malloc(1);
+}
+
+static void UpdateIntModule_Destroy(MODULE_HANDLE module)
+{
+    free(module);
+}
+
+static void UpdateIntModule_Receive(MODULE_HANDLE module, MESSAGE_HANDLE message)
+{
+    (void)module;
+    (void)message;
+}
+
+static const MODULE_API_1 UpdateIntModule_Apis =
+{
+    { MODULE_API_VERSION_1 },
+    UpdateIntModule_ParseConfigurationFromJson,
+    UpdateIntModule_FreeConfiguration,
+    UpdateIntModule_Create,
+    UpdateIntModule_Destroy,
+    UpdateIntModule_Receive,
+    NULL
+};
+
+extern "C" const MODULE_API* MODULE_STATIC_GETAPI(UPDATE_INT_MODULE)(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return reinterpret_cast<const MODULE_API*>(&UpdateIntModule_Apis);
+}
+
+static const STATIC_LOADER_MODULE g_linked_modules[] =
+{
+    STATIC_LOADER_MODULE_ENTRY(UPDATE_INT_MODULE)
+};
+
+static const char* ONE_MODULE_JSON =
+    "{"
+    "  \"modules\": ["
+    "    {"
+    "      \"name\": \"update_int\","
+    "      \"loader\": {"
+    "        \"name\": \"static\","
+    "        \"entrypoint\": { \"module.name\": \"UPDATE_INT_MODULE\" }"
+    "      },"
+    "      \"args\": null"
+    "    }"
+    "  ],"
+    "  \"links\": []"
+    "}";
+
+static const char* NO_MODULES_JSON = "{ \"modules\": [], \"links\": [] }";
+
+class TempFile
+{
+public:
+    std::string file_path;
+
+    enum
+    {
+        COULD_NOT_CREATE_FILE
+    };
+
+public:
+    TempFile()
+    {
+        // See nodejs_int for why 'tmpnam' is acceptable here.
+        auto temp_path = std::tmpnam(nullptr);
+        if (temp_path == nullptr)
+        {
+            throw COULD_NOT_CREATE_FILE;
+        }
+
+        file_path = temp_path;
+    }
+
+    void Write(std::string contents)
+    {
+        std::ofstream stream(file_path);
+        stream << contents;
+    }
+
+    ~TempFile()
+    {
+        std::remove(file_path.c_str());
+    }
+};
+
+template <typename TCallback>
+void wait_for_predicate(uint32_t timeout_in_secs, TCallback pred)
+{
+    time_t start_time = get_time(nullptr);
+    while(
+            pred() == false
+            &&
+            (get_time(nullptr) - start_time) < timeout_in_secs
+         )
+    {
+        ThreadAPI_Sleep(100);
+    }
+}
+
+static bool is_update_done()
+{
+    bool result;
+    (void)Lock(g_state_lock);
+    result = g_update_done;
+    (void)Unlock(g_state_lock);
+    return result;
+}
+
+static size_t get_list_changed_count()
+{
+    size_t result;
+    (void)Lock(g_state_lock);
+    result = g_list_changed_count;
+    (void)Unlock(g_state_lock);
+    return result;
+}
+
+static void on_module_list_changed(GATEWAY_HANDLE gw, GATEWAY_EVENT event_type, GATEWAY_EVENT_CTX context, void* user_param)
+{
+    (void)gw;
+    (void)event_type;
+    (void)context;
+    (void)user_param;
+    (void)Lock(g_state_lock);
+    g_list_changed_count++;
+    (void)Unlock(g_state_lock);
+}
+
+typedef struct UPDATE_ARGS_TAG
+{
+    GATEWAY_HANDLE gateway;
+    const char* json_content;
+} UPDATE_ARGS;
+
+/* outlives an update that never finishes */
+static UPDATE_ARGS g_update_args;
+
+static int apply_update(void* param)
+{
+    UPDATE_ARGS* args = (UPDATE_ARGS*)param;
+    GATEWAY_UPDATE_FROM_JSON_RESULT result = Gateway_ReplaceFromJson(args->gateway, args->json_content);
+    (void)Lock(g_state_lock);
+    g_update_result = result;
+    g_update_done = true;
+    (void)Unlock(g_state_lock);
+    return 0;
+}
+
+/* applies json_content on another thread, and reports whether it finished in time */
+static bool apply_update_in_time(GATEWAY_HANDLE gateway, const char* json_content)
+{
+    THREAD_HANDLE thread;
+    bool result;
+
+    g_update_args.gateway = gateway;
+    g_update_args.json_content = json_content;
+    (void)Lock(g_state_lock);
+    g_update_done = false;
+    (void)Unlock(g_state_lock);
+
+    ASSERT_ARE_EQUAL(int, (int)THREADAPI_OK, (int)ThreadAPI_Create(&thread, apply_update, &g_update_args));
+    wait_for_predicate(UPDATE_TIMEOUT_SECS, []() {
+        return is_update_done();
+    });
+
+    result = is_update_done();
+    if (result)
+    {
+        int thread_result;
+        (void)ThreadAPI_Join(thread, &thread_result);
+    }
+    return result;
+}
+
+BEGIN_TEST_SUITE(gateway_update_int)
+
+    TEST_SUITE_INITIALIZE(TestClassInitialize)
+    {
+        TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+        g_testByTest = MicroMockCreateMutex();
+        ASSERT_IS_NOT_NULL(g_testByTest);
+
+        g_state_lock = Lock_Init();
+        ASSERT_IS_NOT_NULL(g_state_lock);
+
+        StaticLoader_SetModules(g_linked_modules, sizeof(g_linked_modules) / sizeof(g_linked_modules[0]));
+    }
+
+    TEST_SUITE_CLEANUP(TestClassCleanup)
+    {
+        Lock_Deinit(g_state_lock);
+
+        MicroMockDestroyMutex(g_testByTest);
+        TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    }
+
+    TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+    {
+        if (!MicroMockAcquireMutex(g_testByTest))
+        {
+            ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+        }
+
+        g_update_done = false;
+        g_list_changed_count = 0;
+    }
+
+    TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+    {
+        if (!MicroMockReleaseMutex(g_testByTest))
+        {
+            ASSERT_FAIL("failure in test framework at ReleaseMutex");
+        }
+    }
+
+    /* the watched file gives the gateway its lock, and the event system takes it again to build the module list */
+    TEST_FUNCTION(Gateway_ReplaceFromJson_with_watched_file_and_list_callback_does_not_deadlock)
+    {
+        ///arrange
+        TempFile json_file;
+        json_file.Write(NO_MODULES_JSON);
+
+        GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+        ASSERT_IS_NOT_NULL(gateway);
+        ASSERT_ARE_EQUAL(int, 0, Gateway_WatchJsonFile(gateway, json_file.file_path.c_str()));
+        Gateway_AddEventCallback(gateway, GATEWAY_MODULE_LIST_CHANGED, on_module_list_changed, NULL);
+
+        ///act
+        bool added_in_time = apply_update_in_time(gateway, ONE_MODULE_JSON);
+        GATEWAY_UPDATE_FROM_JSON_RESULT added_result = g_update_result;
+        bool removed_in_time = added_in_time && apply_update_in_time(gateway, NO_MODULES_JSON);
+        GATEWAY_UPDATE_FROM_JSON_RESULT removed_result = g_update_result;
+
+        ///assert
+        ASSERT_IS_TRUE(added_in_time);
+        ASSERT_ARE_EQUAL(int, (int)GATEWAY_UPDATE_FROM_JSON_SUCCESS, (int)added_result);
+        ASSERT_IS_TRUE(removed_in_time);
+        ASSERT_ARE_EQUAL(int, (int)GATEWAY_UPDATE_FROM_JSON_SUCCESS, (int)removed_result);
+
+        // the callbacks run on the event system's dispatcher
+        wait_for_predicate(UPDATE_TIMEOUT_SECS, []() {
+            return get_list_changed_count() >= 2;
+        });
+        ASSERT_IS_TRUE(get_list_changed_count() >= 2);
+
+        ///cleanup
+        Gateway_Destroy(gateway);
+    }
+
+END_TEST_SUITE(gateway_update_int)
@@ -4,15 +4,19 @@
 #include <cstdlib>
 #include <cstddef>
 #include <cstdbool>
+#include <cstdio>
 #include "testrunnerswitcher.h"
 #include "micromock.h"
 #include "micromockcharstararenullterminatedstrings.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/threadapi.h"
 
 #include "gateway.h"
 #include "broker.h"
 #include "experimental/event_system.h"
 #include "module_loader.h"
+#include "file_watcher.h"
+#include "../src/gateway_internal.h"
 
 #include "azure_c_shared_utility/vector_types_internal.h"
 #ifdef OUTPROCESS_ENABLED
@@ -63,8 +67,21 @@ static size_t whenShallBroker_Create_fail;
 static size_t currentBroker_module_count;
 static size_t currentBroker_ref_count;
 
+/* messages queued in the broker for one sink, which nanomsg discards when the sink unsubscribes */
+static MODULE_HANDLE queuedBroker_sink;
+static size_t queuedBroker_messages;
+static size_t drainedBroker_messages;
+static size_t discardedBroker_messages;
+
+static BROKER_HEALTH_CALLBACK currentBroker_health_callback;
+static void* currentBroker_health_context;
+static BROKER_TAP_CALLBACK currentBroker_tap_callback;
+static void* currentBroker_tap_context;
+
 static size_t currentModuleLoader_Load_call;
 static size_t whenShallModuleLoader_Load_fail;
+static size_t currentModule_Create_call;
+static size_t whenShallModule_Create_fail;
 
 
 static size_t currentVECTOR_create_call;
@@ -74,6 +91,13 @@ static size_t whenShallVECTOR_push_back_fail;
 static size_t currentVECTOR_find_if_call;
 static size_t whenShallVECTOR_find_if_fail;
 
+static size_t currentThreadAPI_Create_call;
+static size_t whenShallThreadAPI_Create_fail;
+
+#define MAX_STARTED_MODULES 8
+static MODULE_HANDLE startedModules[MAX_STARTED_MODULES];
+static size_t startedModuleCount;
+
 static MODULE_API_1 dummyAPIs;
 
 TYPED_MOCK_CLASS(CGatewayLLMocks, CGlobalMock)
@@ -89,8 +113,12 @@ public:
 	MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_2(, MODULE_HANDLE, mock_Module_Create, BROKER_HANDLE, broker, const void*, configuration)
-        MODULE_HANDLE result1;
-        result1 = (MODULE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        MODULE_HANDLE result1 = NULL;
+        currentModule_Create_call++;
+        if (whenShallModule_Create_fail != currentModule_Create_call)
+        {
+            result1 = (MODULE_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+        }
     MOCK_METHOD_END(MODULE_HANDLE, result1);
 
     MOCK_STATIC_METHOD_1(, void, mock_Module_Destroy, MODULE_HANDLE, moduleHandle)
@@ -101,6 +129,10 @@ public:
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_1(, void, mock_Module_Start, MODULE_HANDLE, moduleHandle)
+        if (startedModuleCount < MAX_STARTED_MODULES)
+        {
+            startedModules[startedModuleCount++] = moduleHandle;
+        }
     MOCK_VOID_METHOD_END();
 
     MOCK_STATIC_METHOD_1(, void, Broker_DecRef, BROKER_HANDLE, broker)
@@ -156,6 +188,10 @@ public:
         }
     MOCK_METHOD_END(BROKER_RESULT, result1);
 
+    MOCK_STATIC_METHOD_3(, BROKER_RESULT, Broker_AddReplicaModule, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_REPLICA*, replica)
+        ++currentBroker_module_count;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK);
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module)
         currentBroker_RemoveModule_call++;
         BROKER_RESULT result1 = BROKER_ERROR;
@@ -163,13 +199,40 @@ public:
         {
             --currentBroker_module_count;
             result1 = BROKER_OK;
+            if (module->module_handle == queuedBroker_sink)
+            {
+                drainedBroker_messages += queuedBroker_messages;
+                queuedBroker_messages = 0;
+                queuedBroker_sink = NULL;
+            }
         }
     MOCK_METHOD_END(BROKER_RESULT, result1);
 
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_SetDrainTimeout, BROKER_HANDLE, handle, unsigned int, drain_timeout_ms)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_GetDrainStatistics, BROKER_HANDLE, handle, BROKER_DRAIN_STATISTICS*, statistics)
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_4(, BROKER_RESULT, Broker_SetHealthMonitor, BROKER_HANDLE, handle, const BROKER_HEALTH_BUDGETS*, budgets, BROKER_HEALTH_CALLBACK, callback, void*, context)
+        currentBroker_health_callback = callback;
+        currentBroker_health_context = context;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
+    MOCK_STATIC_METHOD_4(, BROKER_RESULT, Broker_SetMessageTap, BROKER_HANDLE, handle, const BROKER_MESSAGE_TAP*, tap, BROKER_TAP_CALLBACK, callback, void*, context)
+        currentBroker_tap_callback = callback;
+        currentBroker_tap_context = context;
+    MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
+
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
     MOCK_STATIC_METHOD_2(, BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link)
+        if (link != NULL && link->module_sink_handle == queuedBroker_sink)
+        {
+            discardedBroker_messages += queuedBroker_messages;
+            queuedBroker_messages = 0;
+        }
     MOCK_METHOD_END(BROKER_RESULT, BROKER_OK)
 
     MOCK_STATIC_METHOD_2(, MODULE_LIBRARY_HANDLE, DynamicModuleLoader_Load, const struct MODULE_LOADER_TAG*, loader, const void*, entrypoint)
@@ -225,6 +288,9 @@ public:
     MOCK_STATIC_METHOD_0(, int, OutprocessLoader_SpawnChildProcesses);
     MOCK_METHOD_END(int, 0);
 
+    MOCK_STATIC_METHOD_1(, void, FileWatcher_Destroy, FILE_WATCHER_HANDLE, watcher)
+    MOCK_VOID_METHOD_END();
+
 
     MOCK_STATIC_METHOD_0(, EVENTSYSTEM_HANDLE, EventSystem_Init)
     MOCK_METHOD_END(EVENTSYSTEM_HANDLE, (EVENTSYSTEM_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1));
@@ -241,6 +307,14 @@ public:
         // no-op
     MOCK_VOID_METHOD_END();
 
+    MOCK_STATIC_METHOD_4(, void, EventSystem_ReportModuleHealth, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_MODULE_HEALTH*, health)
+        // no-op
+    MOCK_VOID_METHOD_END();
+
+    MOCK_STATIC_METHOD_3(, void, EventSystem_ReportMessageTap, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, const GATEWAY_TAPPED_MESSAGE*, tapped)
+        // no-op
+    MOCK_VOID_METHOD_END();
+
     MOCK_STATIC_METHOD_1(, void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle)
         BASEIMPLEMENTATION::gballoc_free(handle);
     MOCK_VOID_METHOD_END();
@@ -330,6 +404,40 @@ public:
         (*destination) = (char*)malloc(strlen(source) + 1);
         strcpy(*destination, source);
     MOCK_METHOD_END(int, 0);
+
+    MOCK_STATIC_METHOD_0(, LOCK_HANDLE, Lock_Init)
+        LOCK_HANDLE result2 = (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+    MOCK_METHOD_END(LOCK_HANDLE, result2);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Unlock, LOCK_HANDLE, lock)
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    MOCK_STATIC_METHOD_1(, LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock)
+        BASEIMPLEMENTATION::gballoc_free(lock);
+    MOCK_METHOD_END(LOCK_RESULT, LOCK_OK);
+
+    /*the thread runs to completion before ThreadAPI_Create returns*/
+    MOCK_STATIC_METHOD_3(, THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg)
+        THREADAPI_RESULT result2;
+        ++currentThreadAPI_Create_call;
+        if ((whenShallThreadAPI_Create_fail > 0) &&
+            (currentThreadAPI_Create_call == whenShallThreadAPI_Create_fail))
+        {
+            result2 = THREADAPI_ERROR;
+        }
+        else
+        {
+            *threadHandle = (THREAD_HANDLE)0x42;
+            (void)func(arg);
+            result2 = THREADAPI_OK;
+        }
+    MOCK_METHOD_END(THREADAPI_RESULT, result2);
+
+    MOCK_STATIC_METHOD_2(, THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res)
+    MOCK_METHOD_END(THREADAPI_RESULT, THREADAPI_OK);
 };
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void*, mock_Module_ParseConfigurationFromJson, const char*, configuration);
@@ -342,7 +450,12 @@ DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, mock_Module_Start, MODULE_
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , BROKER_HANDLE, Broker_Create);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_Destroy, BROKER_HANDLE, broker);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , BROKER_RESULT, Broker_AddReplicaModule, BROKER_HANDLE, handle, const MODULE*, module, const BROKER_REPLICA*, replica);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveModule, BROKER_HANDLE, handle, const MODULE*, module);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_SetDrainTimeout, BROKER_HANDLE, handle, unsigned int, drain_timeout_ms);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_GetDrainStatistics, BROKER_HANDLE, handle, BROKER_DRAIN_STATISTICS*, statistics);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , BROKER_RESULT, Broker_SetHealthMonitor, BROKER_HANDLE, handle, const BROKER_HEALTH_BUDGETS*, budgets, BROKER_HEALTH_CALLBACK, callback, void*, context);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , BROKER_RESULT, Broker_SetMessageTap, BROKER_HANDLE, handle, const BROKER_MESSAGE_TAP*, tap, BROKER_TAP_CALLBACK, callback, void*, context);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_AddLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , BROKER_RESULT, Broker_RemoveLink, BROKER_HANDLE, handle, const BROKER_LINK_DATA*, link);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, Broker_IncRef, BROKER_HANDLE, broker);
@@ -361,10 +474,13 @@ DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , MODULE_LOADER_RESULT, ModuleLoad
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , void, ModuleLoader_Destroy);
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , void, OutprocessLoader_JoinChildProcesses);
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , int, OutprocessLoader_SpawnChildProcesses);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, FileWatcher_Destroy, FILE_WATCHER_HANDLE, watcher);
 
 DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , EVENTSYSTEM_HANDLE, EventSystem_Init);
 DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , void, EventSystem_AddEventCallback, EVENTSYSTEM_HANDLE, event_system, GATEWAY_EVENT, event_type, GATEWAY_CALLBACK, callback, void*, user_param);
 DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , void, EventSystem_ReportEvent, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type);
+DECLARE_GLOBAL_MOCK_METHOD_4(CGatewayLLMocks, , void, EventSystem_ReportModuleHealth, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, GATEWAY_EVENT, event_type, const GATEWAY_MODULE_HEALTH*, health);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , void, EventSystem_ReportMessageTap, EVENTSYSTEM_HANDLE, event_system, GATEWAY_HANDLE, gw, const GATEWAY_TAPPED_MESSAGE*, tapped);
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , void, EventSystem_Destroy, EVENTSYSTEM_HANDLE, handle);
 
 DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , VECTOR_HANDLE, VECTOR_create, size_t, elementSize);
@@ -384,6 +500,13 @@ DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , void*, gballoc_calloc, size_t, n
 
 DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , int, mallocAndStrcpy_s, char**, destination, const char*, source);
 
+DECLARE_GLOBAL_MOCK_METHOD_0(CGatewayLLMocks, , LOCK_HANDLE, Lock_Init);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Lock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Unlock, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_1(CGatewayLLMocks, , LOCK_RESULT, Lock_Deinit, LOCK_HANDLE, lock);
+DECLARE_GLOBAL_MOCK_METHOD_3(CGatewayLLMocks, , THREADAPI_RESULT, ThreadAPI_Create, THREAD_HANDLE*, threadHandle, THREAD_START_FUNC, func, void*, arg);
+DECLARE_GLOBAL_MOCK_METHOD_2(CGatewayLLMocks, , THREADAPI_RESULT, ThreadAPI_Join, THREAD_HANDLE, threadHandle, int*, res);
+
 static MICROMOCK_GLOBAL_SEMAPHORE_HANDLE g_dllByDll;
 static MICROMOCK_MUTEX_HANDLE g_testByTest;
 
@@ -479,8 +602,20 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentBroker_module_count = 0;
     currentBroker_ref_count = 0;
 
+    queuedBroker_sink = NULL;
+    queuedBroker_messages = 0;
+    drainedBroker_messages = 0;
+    discardedBroker_messages = 0;
+
+    currentBroker_health_callback = NULL;
+    currentBroker_health_context = NULL;
+    currentBroker_tap_callback = NULL;
+    currentBroker_tap_context = NULL;
+
     currentModuleLoader_Load_call = 0;
     whenShallModuleLoader_Load_fail = 0;
+    currentModule_Create_call = 0;
+    whenShallModule_Create_fail = 0;
 
 
     currentVECTOR_create_call = 0;
@@ -490,6 +625,10 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     currentVECTOR_find_if_call = 0;
     whenShallVECTOR_find_if_fail = 0;
 
+    currentThreadAPI_Create_call = 0;
+    whenShallThreadAPI_Create_fail = 0;
+    startedModuleCount = 0;
+
     dummyAPIs =
     {
         {MODULE_API_VERSION_1},
@@ -826,8 +965,6 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -859,8 +996,6 @@ TEST_FUNCTION(Gateway_Create_VECTOR_push_back_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
@@ -980,8 +1115,6 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
@@ -1013,8 +1146,6 @@ TEST_FUNCTION(Gateway_Create_Broker_AddModule_Fails_To_Add_All_Modules_In_Props)
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -1124,8 +1255,6 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -1159,8 +1288,6 @@ TEST_FUNCTION(Gateway_Create_AddModule_WithDuplicatedModuleName_Fails)
 
     //Adding module 2 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
 
     //Removing previous module
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
@@ -1245,8 +1372,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -1278,8 +1403,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_In_Props_Success)
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -1376,8 +1499,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -1410,8 +1531,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     //Adding module 2 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 1));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
@@ -1447,14 +1566,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_All_Links_In_Props_Success)
 
     //Adding link1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_links, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments(); //Check if Link exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments(); //Check if Source Module exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments(); //Check if Sink Module exists.
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1499,8 +1610,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
 
     //Adding module 1 (Success)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_modules, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
@@ -1536,15 +1645,6 @@ TEST_FUNCTION(Gateway_Create_Adds_All_Modules_And_Links_fromNonExistingModule_Fa
 
     //Adding link1 (Failure)
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(dummyProps->gateway_links, 0));
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments(); //Check if Link exists.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments(); //Check if Source Module exists.
-
-
-    //Removing previous module
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
@@ -1703,6 +1803,7 @@ TEST_FUNCTION(Gateway_Destroy_Continues_Unloading_If_Broker_RemoveModule_Fails)
 /*Tests_SRS_GATEWAY_14_028: [ The function shall remove each module in GATEWAY_HANDLE_DATA's modules vector and destroy GATEWAY_HANDLE_DATA's modules. ]*/
 /*Tests_SRS_GATEWAY_14_006: [ The function shall destroy the GATEWAY_HANDLE_DATA's broker BROKER_HANDLE. ]*/
 /*Tests_SRS_GATEWAY_04_014: [ The function shall remove each link in GATEWAY_HANDLE_DATA's links vector and destroy GATEWAY_HANDLE_DATA's link. ]*/
+/*Tests_SRS_GATEWAY_17_054: [ The function shall leave the links in the broker, which drops them along with their sinks, so that each module still drains the messages queued for it when it is detached. ]*/
 /*Tests_SRS_GATEWAY_17_019: [ The function shall destroy the module loader list. ]*/
 /*Tests_SRS_GATEWAY_27_040: [ Launch - `Gateway_Destroy` shall join any spawned threads. ]*/
 TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
@@ -1788,8 +1889,6 @@ TEST_FUNCTION(Gateway_Destroy_Removes_All_Modules_And_Destroys_Vector_Success)
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_front(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -1920,8 +2019,6 @@ TEST_FUNCTION(Gateway_AddModule_Loads_Module_From_Library_Path)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -1975,8 +2072,6 @@ TEST_FUNCTION(Gateway_AddModule_Malloc_data_Fails)
 
     //Expectations
     whenShallModuleLoader_Load_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1)
         .SetFailReturn(nullptr);
@@ -2002,8 +2097,6 @@ TEST_FUNCTION(Gateway_AddModule_Fails)
 
     //Expectations
     whenShallModuleLoader_Load_fail = 1;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -2039,8 +2132,6 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
     };
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -2084,6 +2175,64 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_Using_Module_Properties)
     free(properties);
 }
 
+/*Tests_SRS_GATEWAY_17_036: [ If the entry was read from JSON or a snapshot and is one of a group of replicas, the function shall attach the module using Broker_AddReplicaModule instead. ]*/
+TEST_FUNCTION(gateway_addmodule_internal_Attaches_JSON_Replica_Using_Broker_AddReplicaModule)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+    GATEWAY_JSON_MODULES_ENTRY entry = {
+        { "Test module#1", dummyLoaderInfo, NULL },
+        NULL,
+        { 2, 1, NULL }
+    };
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
+        .IgnoreArgument(1);
+    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_ParseConfigurationFromJson(NULL));
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, mock_Module_FreeConfiguration(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_AddReplicaModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &entry.module_replica))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    MODULE_HANDLE handle = gateway_addmodule_internal(gw, &entry.entry, true);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
 /*Tests_SRS_GATEWAY_14_011: [ If gw, entry, or GATEWAY_MODULES_ENTRY's specified loader or entrypoint is NULL the function shall return NULL. ]*/
 TEST_FUNCTION(Gateway_AddModule_fails_on_null_loader_api)
 {
@@ -2131,8 +2280,6 @@ TEST_FUNCTION(Gateway_AddModule_Module_Create_Fails)
     };
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -2176,8 +2323,6 @@ TEST_FUNCTION(Gateway_AddModule_Broker_AddModule_Fails)
     mocks.ResetAllCalls();
     
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
@@ -2227,8 +2372,6 @@ TEST_FUNCTION(Gateway_AddModule_Internal_API_Fail_Rollback_Module)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -2341,8 +2484,6 @@ TEST_FUNCTION(Gateway_RemoveModule_Finds_Module_Data_Success)
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -2414,8 +2555,6 @@ TEST_FUNCTION(Gateway_RemoveModule_Broker_RemoveModule_Failure)
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     whenShallBroker_RemoveModule_fail = 1;
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -2536,8 +2675,6 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSourceModule_Find_Link_Data_Failure)
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, gw))
-        .IgnoreAllArguments();
 
     //Act
     Gateway_RemoveLink(gw, &dummyLink2);
@@ -2581,8 +2718,6 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_Link_Data_Failure)
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
 
     //Act
     Gateway_RemoveLink(gw, &dummyLink2);
@@ -2595,7 +2730,7 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_Link_Data_Failure)
 }
 
 /*Codes_SRS_GATEWAY_04_006: [ The function shall locate the LINK_DATA object in GATEWAY_HANDLE_DATA's links containing link and return if it cannot be found. ]*/
-TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_star_Link_Data_Failure)
+TEST_FUNCTION(Gateway_RemoveLink_Finds_star_Link_Data_Success)
 {
     //Arrange
     CGatewayLLMocks mocks;
@@ -2622,14 +2757,16 @@ TEST_FUNCTION(Gateway_RemoveLink_NonExistingSinkModule_Find_star_Link_Data_Failu
 
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    whenShallVECTOR_find_if_fail = currentVECTOR_find_if_call + 2;
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -2679,9 +2816,8 @@ TEST_FUNCTION(Gateway_RemoveLink_Finds_Link_Data_Success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
@@ -3076,9 +3212,6 @@ TEST_FUNCTION(Gateway_AddLink_DuplicatedLink_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &duplicatedLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &duplicatedLink);
 
@@ -3122,12 +3255,6 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSourceModule_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
 
@@ -3172,17 +3299,6 @@ TEST_FUNCTION(Gateway_AddLink_NonExistingSinkModule_Fail)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &nonExistingModuleLink))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, nem))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);//Check Sink Module.
-
-    GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &nonExistingModuleLink);
 
     //Assert
     ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
@@ -3218,14 +3334,6 @@ TEST_FUNCTION(Gateway_AddLink_Succeeds)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Sink Module.
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3267,14 +3375,6 @@ TEST_FUNCTION(Gateway_AddLink_pushback_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Sink Module.
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -3315,15 +3415,6 @@ TEST_FUNCTION(Gateway_AddLink_broker_add_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Source Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Sink Module.
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
      GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink);
 
@@ -3372,17 +3463,6 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Sink Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2); // Add link to links vector
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1); // for each module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
@@ -3392,8 +3472,6 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_addbroker_fails)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -3459,16 +3537,6 @@ TEST_FUNCTION(Gateway_AddLink_star_2nd_add_push_fails)
     mocks.ResetAllCalls();
 
     //Act
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();//Check Sink Module.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .SetFailReturn(1); // Add link to links vector
-
-    result = Gateway_AddLink(gateway, &dummyLink2);
 
     //Assert
     ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, result);
@@ -3516,8 +3584,6 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -3549,15 +3615,11 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_with_star_links)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, EventSystem_ReportEvent(IGNORED_PTR_ARG, gateway, GATEWAY_MODULE_LIST_CHANGED))
@@ -3610,8 +3672,6 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
         .IgnoreArgument(1);
     EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -3645,15 +3705,11 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
@@ -3663,14 +3719,10 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and remove the rest.
@@ -3704,11 +3756,11 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_addLink_fails)
 }
 
 //Tests_SRS_GATEWAY_17_003: [ The gateway shall treat a source of "*" as link to the sink module from every other module in gateway. ]
-//Tests_SRS_GATEWAY_17_005: [ For this link, the sink shall receive all messages publish by other modules. ]
-TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
+//Tests_SRS_GATEWAY_17_034: [ The gateway shall index each module by name, so that finding a module by name does not scan gw->modules. ]
+TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_links_without_searching_modules)
 {
     //Arrange
-    CGatewayLLMocks mocks;
+    CNiceCallComparer<CGatewayLLMocks> mocks;
 
     GATEWAY_MODULES_ENTRY dummyEntry2 = {
         "dummy module 2",
@@ -3738,92 +3790,320 @@ TEST_FUNCTION(Gateway_AddModule_Creates_Module_star_2nd_find_fails)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG))
-        .IgnoreArgument(1);
-    EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_BuildModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_FreeModuleConfiguration(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_IncRef(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    // 1st broadcast link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    // 2nd broadcast link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
+    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+    EXPECTED_CALL(mocks, Broker_AddLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
 
+    //Act
+    MODULE_HANDLE handle = Gateway_AddModule(gateway, &dummyEntry3);
 
-    // tear down broadcast link.
-    STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
-    // and remove the rest.
-    STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_back(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_erase(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
-    STRICT_EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
-        .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
+    //Assert
+    ASSERT_IS_NOT_NULL(handle);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+//Tests_SRS_GATEWAY_17_034: [ The gateway shall index each module by name, so that finding a module by name does not scan gw->modules. ]
+//Tests_SRS_GATEWAY_17_035: [ The gateway shall index each link by its source and sink modules, so that finding a link does not scan gw->links. ]
+TEST_FUNCTION(Gateway_AddLink_indexes_more_links_than_inline_slots)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    char names[40][16];
+    for (int i = 0; i < 40; i++)
+    {
+        sprintf(names[i], "module %d", i);
+        GATEWAY_MODULES_ENTRY entry = {
+            names[i],
+            dummyLoaderInfo,
+            NULL
+        };
+        ASSERT_IS_NOT_NULL(Gateway_AddModule(gateway, &entry));
+    }
+    for (int i = 1; i < 40; i++)
+    {
+        GATEWAY_LINK_ENTRY link = {
+            names[i - 1],
+            names[i]
+        };
+        ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, Gateway_AddLink(gateway, &link));
+    }
+    mocks.ResetAllCalls();
+
+    GATEWAY_LINK_ENTRY firstLink = {
+        names[0],
+        names[1]
+    };
+    GATEWAY_LINK_ENTRY lastLink = {
+        names[38],
+        names[39]
+    };
+
+    //Expectations
+    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
 
     //Act
-    MODULE_HANDLE handle = Gateway_AddModule(gateway, &dummyEntry3);
+    GATEWAY_ADD_LINK_RESULT duplicate = Gateway_AddLink(gateway, &firstLink);
+    int removed = Gateway_RemoveModuleByName(gateway, names[20]);
+    int removedAgain = Gateway_RemoveModuleByName(gateway, names[20]);
+    Gateway_RemoveLink(gateway, &lastLink);
+    GATEWAY_ADD_LINK_RESULT readded = Gateway_AddLink(gateway, &lastLink);
 
     //Assert
-    ASSERT_IS_NULL(handle);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, duplicate);
+    ASSERT_ARE_EQUAL(int, 0, removed);
+    ASSERT_ARE_NOT_EQUAL(int, 0, removedAgain);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, readded);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+//Tests_SRS_GATEWAY_26_018: [ This function shall remove any links that contain the removed module either as a source or sink. ]
+//Tests_SRS_GATEWAY_17_049: [ The function shall move the last link of gw->links into the place of the removed link, so that no other link changes position. ]
+//Tests_SRS_GATEWAY_17_050: [ The gateway shall index each link by the modules at its ends, so that finding the links of a module does not scan the link index. ]
+TEST_FUNCTION(Gateway_RemoveModule_removes_only_its_links_and_keeps_the_others_indexed)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    char names[21][16];
+    for (int i = 0; i < 21; i++)
+    {
+        sprintf(names[i], "module %d", i);
+        GATEWAY_MODULES_ENTRY entry = {
+            names[i],
+            dummyLoaderInfo,
+            NULL
+        };
+        ASSERT_IS_NOT_NULL(Gateway_AddModule(gateway, &entry));
+    }
+    /* module 0 links both ways with every other module, interleaved with a chain between the others */
+    for (int i = 1; i < 21; i++)
+    {
+        GATEWAY_LINK_ENTRY toHub = {
+            names[i],
+            names[0]
+        };
+        GATEWAY_LINK_ENTRY fromHub = {
+            names[0],
+            names[i]
+        };
+        ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, Gateway_AddLink(gateway, &toHub));
+        if (i > 1)
+        {
+            GATEWAY_LINK_ENTRY chain = {
+                names[i - 1],
+                names[i]
+            };
+            ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, Gateway_AddLink(gateway, &chain));
+        }
+        ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, Gateway_AddLink(gateway, &fromHub));
+    }
+    mocks.ResetAllCalls();
+
+    //Expectations
+    /* the 20 links from module 0, whose sinks are still attached, then each chain link is removed twice */
+    EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(20 + 2 * 19);
+
+    //Act
+    int removed = Gateway_RemoveModuleByName(gateway, names[0]);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, removed);
+    for (int i = 2; i < 21; i++)
+    {
+        GATEWAY_LINK_ENTRY chain = {
+            names[i - 1],
+            names[i]
+        };
+        ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, Gateway_AddLink(gateway, &chain));
+        Gateway_RemoveLink(gateway, &chain);
+        ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, Gateway_AddLink(gateway, &chain));
+        Gateway_RemoveLink(gateway, &chain);
+    }
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_17_053: [ The function shall detach the module from the broker before removing its links, so that the module drains the messages queued for it while it is still subscribed to their sources. ]*/
+/*Tests_SRS_GATEWAY_17_054: [ The function shall leave the links in the broker, which drops them along with their sinks, so that each module still drains the messages queued for it when it is detached. ]*/
+TEST_FUNCTION(Gateway_RemoveModule_drains_the_messages_queued_over_its_links)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY sourceEntry = {
+        "source",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY sinkEntry = {
+        "sink",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY toSink = {
+        "source",
+        "sink"
+    };
+    GATEWAY_LINK_ENTRY fromSink = {
+        "sink",
+        "source"
+    };
+    MODULE_HANDLE source = Gateway_AddModule(gateway, &sourceEntry);
+    MODULE_HANDLE sink = Gateway_AddModule(gateway, &sinkEntry);
+    GATEWAY_ADD_LINK_RESULT added1 = Gateway_AddLink(gateway, &toSink);
+    GATEWAY_ADD_LINK_RESULT added2 = Gateway_AddLink(gateway, &fromSink);
+    int drain_set = Gateway_SetDrainTimeout(gateway, 100);
+    /* source published three messages the sink has not received yet */
+    queuedBroker_sink = sink;
+    queuedBroker_messages = 3;
+    mocks.ResetAllCalls();
+
+    //Expectations
+    EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+    /* only the link into source, which stays attached */
+    EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+
+    //Act
+    Gateway_RemoveModule(gateway, sink);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(source);
+    ASSERT_IS_NOT_NULL(sink);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, added1);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, added2);
+    ASSERT_ARE_EQUAL(int, 0, drain_set);
+    ASSERT_ARE_EQUAL(size_t, 3, drainedBroker_messages);
+    ASSERT_ARE_EQUAL(size_t, 0, discardedBroker_messages);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_ERROR, Gateway_AddLink(gateway, &toSink));
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+}
+
+/*Tests_SRS_GATEWAY_17_054: [ The function shall leave the links in the broker, which drops them along with their sinks, so that each module still drains the messages queued for it when it is detached. ]*/
+TEST_FUNCTION(Gateway_Destroy_drains_the_messages_queued_over_the_links)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY sourceEntry = {
+        "source",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_MODULES_ENTRY sinkEntry = {
+        "sink",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY toSink = {
+        "source",
+        "sink"
+    };
+    MODULE_HANDLE source = Gateway_AddModule(gateway, &sourceEntry);
+    MODULE_HANDLE sink = Gateway_AddModule(gateway, &sinkEntry);
+    GATEWAY_ADD_LINK_RESULT added = Gateway_AddLink(gateway, &toSink);
+    int drain_set = Gateway_SetDrainTimeout(gateway, 100);
+    /* source published three messages the sink has not received yet */
+    queuedBroker_sink = sink;
+    queuedBroker_messages = 3;
+    mocks.ResetAllCalls();
+
+    //Act
+    Gateway_Destroy(gateway);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(source);
+    ASSERT_IS_NOT_NULL(sink);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, added);
+    ASSERT_ARE_EQUAL(int, 0, drain_set);
+    ASSERT_ARE_EQUAL(size_t, 3, drainedBroker_messages);
+    ASSERT_ARE_EQUAL(size_t, 0, discardedBroker_messages);
+}
+
+//Tests_SRS_GATEWAY_17_051: [ Once the gateway has a lock, Gateway_Start, Gateway_StartModule, Gateway_AddModule, Gateway_RemoveModule, Gateway_RemoveModuleByName, Gateway_AddLink, Gateway_RemoveLink, Gateway_GetModuleList and the JSON updates shall hold it while they use the gateway's modules and links. ]
+TEST_FUNCTION(Gateway_changes_hold_the_gateway_lock)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    GATEWAY_MODULES_ENTRY dummyEntry2 = {
+        "dummy module2",
+        dummyLoaderInfo,
+        NULL
+    };
+    GATEWAY_LINK_ENTRY dummyLink = {
+        "dummy module",
+        "dummy module2"
+    };
+    /* Gateway_WatchJsonFile creates the lock */
+    gateway->update_lock = (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+    mocks.ResetAllCalls();
+
+    //Expectations
+    EXPECTED_CALL(mocks, Lock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(8);
+    EXPECTED_CALL(mocks, Unlock(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(8);
+
+    //Act
+    MODULE_HANDLE module = Gateway_AddModule(gateway, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+    (void)Gateway_AddModule(gateway, &dummyEntry2);
+    GATEWAY_ADD_LINK_RESULT added = Gateway_AddLink(gateway, &dummyLink);
+    GATEWAY_START_RESULT started = Gateway_Start(gateway);
+    VECTOR_HANDLE modules = Gateway_GetModuleList(gateway);
+    Gateway_RemoveLink(gateway, &dummyLink);
+    Gateway_RemoveModule(gateway, module);
+    int removed = Gateway_RemoveModuleByName(gateway, "dummy module2");
+
+    //Assert
+    ASSERT_IS_NOT_NULL(module);
+    ASSERT_ARE_EQUAL(GATEWAY_ADD_LINK_RESULT, GATEWAY_ADD_LINK_SUCCESS, added);
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, GATEWAY_START_SUCCESS, started);
+    ASSERT_IS_NOT_NULL(modules);
+    ASSERT_ARE_EQUAL(int, 0, removed);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_DestroyModuleList(modules);
+    Gateway_Destroy(gateway);
+}
+
+//Tests_SRS_GATEWAY_17_051: [ Once the gateway has a lock, Gateway_Start, Gateway_StartModule, Gateway_AddModule, Gateway_RemoveModule, Gateway_RemoveModuleByName, Gateway_AddLink, Gateway_RemoveLink, Gateway_GetModuleList and the JSON updates shall hold it while they use the gateway's modules and links. ]
+TEST_FUNCTION(Gateway_AddModule_fails_when_the_gateway_lock_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gateway = Gateway_Create(NULL);
+    gateway->update_lock = (LOCK_HANDLE)BASEIMPLEMENTATION::gballoc_malloc(1);
+    mocks.ResetAllCalls();
+
+    //Expectations
+    STRICT_EXPECTED_CALL(mocks, Lock(gateway->update_lock))
+        .SetFailReturn(LOCK_ERROR);
+    EXPECTED_CALL(mocks, Broker_AddModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    MODULE_HANDLE module = Gateway_AddModule(gateway, (GATEWAY_MODULES_ENTRY*)BASEIMPLEMENTATION::VECTOR_front(dummyProps->gateway_modules));
+
+    //Assert
+    ASSERT_IS_NULL(module);
     mocks.AssertActualAndExpectedCalls();
 
     //Cleanup
@@ -3866,13 +4146,6 @@ TEST_FUNCTION(Gateway_AddLink_star_success)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, "dummy module"))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -3940,12 +4213,6 @@ TEST_FUNCTION(Gateway_AddLink_star_no_sink)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, dm4))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
 
     ///Act
     GATEWAY_ADD_LINK_RESULT result = Gateway_AddLink(gateway, &dummyLink2);
@@ -3992,13 +4259,6 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
     GATEWAY_HANDLE gateway = Gateway_Create(dummyProps);
     mocks.ResetAllCalls();
 
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreArgument(1)
-        .IgnoreArgument(2)
-        .IgnoreArgument(3);
     STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2);
@@ -4013,8 +4273,6 @@ TEST_FUNCTION(Gateway_AddLink_star_failure_to_add)
         .SetFailReturn(BROKER_ADD_LINK_ERROR);
 
     //Remove link
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1); // for each module.
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
@@ -4090,20 +4348,14 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     // and the rest of the remove...
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
@@ -4179,21 +4431,16 @@ TEST_FUNCTION(Gateway_RemoveModule_with_star_links_has_errors)
     // 1st broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 0))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments()
-        .SetFailReturn(nullptr);
+    STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreAllArguments();
     // 2nd broadcast link
     STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1);
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     EXPECTED_CALL(mocks, gballoc_free(IGNORED_PTR_ARG));
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
     // and the rest of the remove...
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments();
     STRICT_EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG))
@@ -4264,10 +4511,8 @@ TEST_FUNCTION(Gateway_RemoveLink_star_link_success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink2))
-        .IgnoreAllArguments();
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, "dummy module"))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 1))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     // 1st broadcast link
@@ -4339,8 +4584,8 @@ TEST_FUNCTION(Gateway_RemoveLink_nostar_link_success)
     mocks.ResetAllCalls();
 
     //Expectations
-    STRICT_EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, &dummyLink3))
-        .IgnoreAllArguments();
+    STRICT_EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, 2))
+        .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(mocks, Broker_RemoveLink(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
         .IgnoreAllArguments()
         .SetFailReturn(BROKER_REMOVE_LINK_ERROR);
@@ -4979,7 +5224,6 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_no_modules)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     //Act
     int result = Gateway_RemoveModuleByName(gw, "foo");
@@ -5001,7 +5245,6 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_not_existing)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
 
     //Act
     int result = Gateway_RemoveModuleByName(gw, "foo");
@@ -5023,8 +5266,7 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_success)
     mocks.ResetAllCalls();
 
     //Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, VECTOR_element(IGNORED_PTR_ARG, IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, VECTOR_size(IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_RemoveModule(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, Broker_DecRef(IGNORED_PTR_ARG));
@@ -5047,11 +5289,324 @@ TEST_FUNCTION(Gateway_RemoveModuleByName_success)
     Gateway_Destroy(gw);
 }
 
-/* Tests_SRS_GATEWAY_26_018: [ This function shall remove any links that contain the removed module either as a source or sink. ] */
-TEST_FUNCTION(Gateway_RemoveModule_removes_links)
+/*Tests_SRS_GATEWAY_17_037: [ If gw is NULL, Gateway_SetDrainTimeout shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_SetDrainTimeout_Null_gw)
 {
-    // Arrange
-    CNiceCallComparer<CGatewayLLMocks> mocks;
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Expect
+    //Nothing!
+
+    //Act
+    int result = Gateway_SetDrainTimeout(NULL, 100);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_17_038: [ Gateway_SetDrainTimeout shall set the drain timeout of the gateway's broker by calling Broker_SetDrainTimeout, and return a non-zero value if it fails. ]*/
+TEST_FUNCTION(Gateway_SetDrainTimeout_sets_broker_drain_timeout)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetDrainTimeout(IGNORED_PTR_ARG, 100))
+        .IgnoreArgument(1);
+
+    //Act
+    int result = Gateway_SetDrainTimeout(gw, 100);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_038: [ Gateway_SetDrainTimeout shall set the drain timeout of the gateway's broker by calling Broker_SetDrainTimeout, and return a non-zero value if it fails. ]*/
+TEST_FUNCTION(Gateway_SetDrainTimeout_fails_when_broker_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetDrainTimeout(IGNORED_PTR_ARG, 100))
+        .IgnoreArgument(1)
+        .SetFailReturn(BROKER_ERROR);
+
+    //Act
+    int result = Gateway_SetDrainTimeout(gw, 100);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_039: [ If gw or statistics is NULL, Gateway_GetDrainStatistics shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_GetDrainStatistics_Null_args)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    auto gw = Gateway_Create(NULL);
+    BROKER_DRAIN_STATISTICS statistics;
+    mocks.ResetAllCalls();
+
+    //Expect
+    //Nothing!
+
+    //Act
+    int result1 = Gateway_GetDrainStatistics(NULL, &statistics);
+    int result2 = Gateway_GetDrainStatistics(gw, NULL);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_040: [ Gateway_GetDrainStatistics shall get the counts from the gateway's broker by calling Broker_GetDrainStatistics, and return a non-zero value if it fails. ]*/
+TEST_FUNCTION(Gateway_GetDrainStatistics_gets_broker_statistics)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    auto gw = Gateway_Create(NULL);
+    BROKER_DRAIN_STATISTICS statistics;
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_GetDrainStatistics(IGNORED_PTR_ARG, &statistics))
+        .IgnoreArgument(1);
+
+    //Act
+    int result = Gateway_GetDrainStatistics(gw, &statistics);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_041: [ If gw is NULL, Gateway_SetHealthBudgets shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_SetHealthBudgets_Null_gw)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+
+    //Expect
+    //Nothing!
+
+    //Act
+    int result = Gateway_SetHealthBudgets(NULL, &budgets);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_17_042: [ Gateway_SetHealthBudgets shall start or, when budgets is NULL, stop monitoring the gateway's broker by calling Broker_SetHealthMonitor, and return a non-zero value if it fails. ]*/
+/*Tests_SRS_GATEWAY_17_044: [ Gateway_Destroy shall stop monitoring the modules' health before destroying the event system. ]*/
+TEST_FUNCTION(Gateway_SetHealthBudgets_sets_broker_health_monitor)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetHealthMonitor(IGNORED_PTR_ARG, &budgets, IGNORED_PTR_ARG, gw))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+
+    //Act
+    int result = Gateway_SetHealthBudgets(gw, &budgets);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL((void*)currentBroker_health_callback);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+    ASSERT_IS_NULL((void*)currentBroker_health_callback);
+}
+
+/*Tests_SRS_GATEWAY_17_042: [ Gateway_SetHealthBudgets shall start or, when budgets is NULL, stop monitoring the gateway's broker by calling Broker_SetHealthMonitor, and return a non-zero value if it fails. ]*/
+TEST_FUNCTION(Gateway_SetHealthBudgets_fails_when_broker_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetHealthMonitor(IGNORED_PTR_ARG, &budgets, IGNORED_PTR_ARG, gw))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3)
+        .SetFailReturn(BROKER_ERROR);
+
+    //Act
+    int result = Gateway_SetHealthBudgets(gw, &budgets);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_043: [ When the broker reports BROKER_MODULE_SLOW or BROKER_QUEUE_HIGH_WATERMARK, the gateway shall report GATEWAY_MODULE_SLOW or GATEWAY_QUEUE_HIGH_WATERMARK with the module's health. ]*/
+TEST_FUNCTION(Gateway_SetHealthBudgets_reports_module_health_events)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_HEALTH_BUDGETS budgets = { 10, 5, 4, 2 };
+    BROKER_MODULE_HEALTH health = { (MODULE_HANDLE)0x42, 20, 4 };
+    auto gw = Gateway_Create(NULL);
+    (void)Gateway_SetHealthBudgets(gw, &budgets);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportModuleHealth(IGNORED_PTR_ARG, gw, GATEWAY_MODULE_SLOW, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportModuleHealth(IGNORED_PTR_ARG, gw, GATEWAY_QUEUE_HIGH_WATERMARK, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(4);
+
+    //Act
+    currentBroker_health_callback(currentBroker_health_context, BROKER_MODULE_SLOW, &health);
+    currentBroker_health_callback(currentBroker_health_context, BROKER_QUEUE_HIGH_WATERMARK, &health);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_045: [ If gw is NULL, Gateway_SetMessageTap shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_SetMessageTap_Null_gw)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_MESSAGE_TAP tap = { 10, false };
+
+    //Expect
+    //Nothing!
+
+    //Act
+    int result = Gateway_SetMessageTap(NULL, &tap);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+}
+
+/*Tests_SRS_GATEWAY_17_046: [ Gateway_SetMessageTap shall set or, when tap is NULL, remove the tap of the gateway's broker by calling Broker_SetMessageTap, and return a non-zero value if it fails. ]*/
+/*Tests_SRS_GATEWAY_17_048: [ Gateway_Destroy shall remove the message tap before destroying the event system. ]*/
+TEST_FUNCTION(Gateway_SetMessageTap_sets_broker_tap)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_MESSAGE_TAP tap = { 10, false };
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetMessageTap(IGNORED_PTR_ARG, &tap, IGNORED_PTR_ARG, gw))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+
+    //Act
+    int result = Gateway_SetMessageTap(gw, &tap);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_NOT_NULL((void*)currentBroker_tap_callback);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+    ASSERT_IS_NULL((void*)currentBroker_tap_callback);
+}
+
+/*Tests_SRS_GATEWAY_17_046: [ Gateway_SetMessageTap shall set or, when tap is NULL, remove the tap of the gateway's broker by calling Broker_SetMessageTap, and return a non-zero value if it fails. ]*/
+TEST_FUNCTION(Gateway_SetMessageTap_fails_when_broker_fails)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_MESSAGE_TAP tap = { 10, false };
+    auto gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, Broker_SetMessageTap(IGNORED_PTR_ARG, &tap, IGNORED_PTR_ARG, gw))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3)
+        .SetFailReturn(BROKER_ERROR);
+
+    //Act
+    int result = Gateway_SetMessageTap(gw, &tap);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/*Tests_SRS_GATEWAY_17_047: [ When the broker taps a message, the gateway shall report GATEWAY_MESSAGE_TAPPED with the tapped message. ]*/
+TEST_FUNCTION(Gateway_SetMessageTap_reports_message_tapped_events)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+    BROKER_MESSAGE_TAP tap = { 10, false };
+    BROKER_TAPPED_MESSAGE tapped = { (MODULE_HANDLE)0x42, 7, 100, NULL };
+    auto gw = Gateway_Create(NULL);
+    (void)Gateway_SetMessageTap(gw, &tap);
+    mocks.ResetAllCalls();
+
+    //Expect
+    STRICT_EXPECTED_CALL(mocks, EventSystem_ReportMessageTap(IGNORED_PTR_ARG, gw, IGNORED_PTR_ARG))
+        .IgnoreArgument(1)
+        .IgnoreArgument(3);
+
+    //Act
+    currentBroker_tap_callback(currentBroker_tap_context, &tapped);
+
+    //Assert
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
+/* Tests_SRS_GATEWAY_26_018: [ This function shall remove any links that contain the removed module either as a source or sink. ] */
+TEST_FUNCTION(Gateway_RemoveModule_removes_links)
+{
+    // Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
 
     GATEWAY_MODULES_ENTRY modules[] = {
         {
@@ -5247,7 +5802,6 @@ TEST_FUNCTION(Gateway_AddModule_malloc_name_fail)
     };
 
     // Expect
-    EXPECTED_CALL(mocks, VECTOR_find_if(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG));
     EXPECTED_CALL(mocks, gballoc_malloc(IGNORED_NUM_ARG));
     EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, dummyLoaderInfo.entrypoint));
     EXPECTED_CALL(mocks, DynamicModuleLoader_GetModuleApi(IGNORED_PTR_ARG, IGNORED_PTR_ARG));
@@ -5345,6 +5899,347 @@ TEST_FUNCTION(Gateway_Start_starts_stuff)
     free(properties);
 }
 
+static void fillParallelProps(GATEWAY_PROPERTIES* props, GATEWAY_MODULES_ENTRY* entries, size_t count)
+{
+    props->gateway_modules = VECTOR_create(sizeof(GATEWAY_MODULES_ENTRY));
+    props->gateway_links = NULL;
+    if (count > 0)
+    {
+        VECTOR_push_back(props->gateway_modules, entries, count);
+    }
+}
+
+/*Tests_SRS_GATEWAY_17_023: [ If the gateway's startup_threads is greater than one, the function shall create the modules concurrently on up to startup_threads threads. ]*/
+/*Tests_SRS_GATEWAY_17_024: [ Modules shall be handed to the threads in lanes: native modules share a lane when they are loaded from the same library, every module of any other loader shares the lane of its loader. ]*/
+/*Tests_SRS_GATEWAY_17_026: [ The calling thread shall take part in the work and join every thread it started before returning. ]*/
+/*Tests_SRS_GATEWAY_17_029: [ Created modules shall be attached to the broker one at a time, in configuration order. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_creates_every_module)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", dummyLoaderInfo, NULL },
+        { "module_2", dummyLoaderInfo, NULL },
+        { "module_3", dummyLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 3);
+
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+    EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 2);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+    VECTOR_HANDLE module_list = Gateway_GetModuleList(gateway);
+    ASSERT_ARE_EQUAL(size_t, 3, VECTOR_size(module_list));
+    ASSERT_ARE_EQUAL(int, 0, strcmp("module_1", ((GATEWAY_MODULE_INFO*)VECTOR_element(module_list, 0))->module_name));
+    ASSERT_ARE_EQUAL(int, 0, strcmp("module_2", ((GATEWAY_MODULE_INFO*)VECTOR_element(module_list, 1))->module_name));
+    ASSERT_ARE_EQUAL(int, 0, strcmp("module_3", ((GATEWAY_MODULE_INFO*)VECTOR_element(module_list, 2))->module_name));
+
+    //Cleanup
+    Gateway_DestroyModuleList(module_list);
+    Gateway_Destroy(gateway);
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_024: [ Modules shall be handed to the threads in lanes: native modules share a lane when they are loaded from the same library, every module of any other loader shares the lane of its loader. ]*/
+/*Tests_SRS_GATEWAY_17_025: [ The modules of a lane shall be handled one after another, in configuration order. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_keeps_one_lane_per_language_loader)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    MODULE_LOADER javaLoader =
+    {
+        JAVA,
+        "dummy java loader",
+        NULL,
+        &module_loader_api
+    };
+    GATEWAY_MODULE_LOADER_INFO javaLoaderInfo =
+    {
+        &javaLoader,
+        (void*)0x42
+    };
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", javaLoaderInfo, NULL },
+        { "module_2", javaLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 2);
+
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 4);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_028: [ If the threads cannot be set up, the modules shall be brought up one at a time on the calling thread. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_continues_when_thread_create_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", dummyLoaderInfo, NULL },
+        { "module_2", dummyLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 2);
+    whenShallThreadAPI_Create_fail = 1;
+
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 2);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_027: [ Every entry shall be checked, its MODULE_DATA allocated and its library loaded, one at a time, before any module is created. ]*/
+/*Tests_SRS_GATEWAY_04_004: [ If a module with the same module_name already exists, this function shall fail and the GATEWAY_HANDLE will be destroyed. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_fails_on_duplicate_name_before_creating)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", dummyLoaderInfo, NULL },
+        { "module_2", dummyLoaderInfo, NULL },
+        { "module_1", dummyLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 3);
+
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 2);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_030: [ If any module cannot be created or attached, every module created but not yet attached shall be destroyed and its library unloaded. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_destroys_created_modules_on_failure)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", dummyLoaderInfo, NULL },
+        { "module_2", dummyLoaderInfo, NULL },
+        { "module_3", dummyLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 3);
+    whenShallModule_Create_fail = 2;
+
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+    EXPECTED_CALL(mocks, mock_Module_Destroy(IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(3);
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 3);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_027: [ Every entry shall be checked, its MODULE_DATA allocated and its library loaded, one at a time, before any module is created. ]*/
+/*Tests_SRS_GATEWAY_14_031: [If unsuccessful, the function shall return NULL.]*/
+TEST_FUNCTION(Gateway_Create_parallel_unloads_loaded_libraries_when_load_fails)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", dummyLoaderInfo, NULL },
+        { "module_2", dummyLoaderInfo, NULL },
+        { "module_3", dummyLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 3);
+    whenShallModuleLoader_Load_fail = 2;
+
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Load(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, DynamicModuleLoader_Unload(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(1);
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 3);
+
+    //Assert
+    ASSERT_IS_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    VECTOR_destroy(props.gateway_modules);
+}
+
+static MODULE_LIBRARY_HANDLE sharedLibrary_Load(const MODULE_LOADER* loader, const void* entrypoint)
+{
+    (void)loader;
+    (void)entrypoint;
+    return (MODULE_LIBRARY_HANDLE)0x4242;
+}
+
+static void sharedLibrary_Unload(const MODULE_LOADER* loader, MODULE_LIBRARY_HANDLE handle)
+{
+    (void)loader;
+    (void)handle;
+}
+
+/*Tests_SRS_GATEWAY_17_024: [ Modules shall be handed to the threads in lanes: native modules share a lane when they are loaded from the same library, every module of any other loader shares the lane of its loader. ]*/
+TEST_FUNCTION(Gateway_Create_parallel_keeps_one_lane_per_native_library)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    MODULE_LOADER_API sharedLibraryApi = module_loader_api;
+    sharedLibraryApi.Load = sharedLibrary_Load;
+    sharedLibraryApi.Unload = sharedLibrary_Unload;
+    MODULE_LOADER sharedLibraryLoader =
+    {
+        NATIVE,
+        "dummy shared library loader",
+        NULL,
+        &sharedLibraryApi
+    };
+    GATEWAY_MODULE_LOADER_INFO sharedLibraryLoaderInfo =
+    {
+        &sharedLibraryLoader,
+        (void*)0x42
+    };
+    GATEWAY_MODULES_ENTRY entries[] = {
+        { "module_1", sharedLibraryLoaderInfo, NULL },
+        { "module_2", sharedLibraryLoaderInfo, NULL }
+    };
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, entries, 2);
+
+    EXPECTED_CALL(mocks, mock_Module_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .ExpectedTimesExactly(2);
+    EXPECTED_CALL(mocks, ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .NeverInvoked();
+
+    //Act
+    auto gateway = gateway_create_internal(&props, false, 4);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(gateway);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gateway);
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_031: [ A module shall be started only after every module it has a link to, so that no module receives messages before it is started. ]*/
+/*Tests_SRS_GATEWAY_17_033: [ The modules of one step shall be started concurrently on up to startup_threads threads. ]*/
+TEST_FUNCTION(Gateway_Start_parallel_starts_sinks_before_sources)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, NULL, 0);
+    GATEWAY_HANDLE gw = Gateway_Create(&props);
+    (void)Gateway_SetStartupThreads(gw, 2);
+    GATEWAY_MODULES_ENTRY source = { "source", dummyLoaderInfo, NULL };
+    GATEWAY_MODULES_ENTRY middle = { "middle", dummyLoaderInfo, NULL };
+    GATEWAY_MODULES_ENTRY sink = { "sink", dummyLoaderInfo, NULL };
+    MODULE_HANDLE source_handle = Gateway_AddModule(gw, &source);
+    MODULE_HANDLE middle_handle = Gateway_AddModule(gw, &middle);
+    MODULE_HANDLE sink_handle = Gateway_AddModule(gw, &sink);
+    GATEWAY_LINK_ENTRY link_1 = { "source", "middle" };
+    GATEWAY_LINK_ENTRY link_2 = { "middle", "sink" };
+    (void)Gateway_AddLink(gw, &link_1);
+    (void)Gateway_AddLink(gw, &link_2);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, GATEWAY_START_SUCCESS, result);
+    ASSERT_ARE_EQUAL(size_t, 3, startedModuleCount);
+    ASSERT_IS_TRUE(sink_handle == startedModules[0]);
+    ASSERT_IS_TRUE(middle_handle == startedModules[1]);
+    ASSERT_IS_TRUE(source_handle == startedModules[2]);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+    VECTOR_destroy(props.gateway_modules);
+}
+
+/*Tests_SRS_GATEWAY_17_032: [ If every module left has a link to another module left, the links form a cycle and the modules left shall be started together. ]*/
+TEST_FUNCTION(Gateway_Start_parallel_starts_linked_cycle)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_PROPERTIES props;
+    fillParallelProps(&props, NULL, 0);
+    GATEWAY_HANDLE gw = Gateway_Create(&props);
+    (void)Gateway_SetStartupThreads(gw, 2);
+    GATEWAY_MODULES_ENTRY module_1 = { "module_1", dummyLoaderInfo, NULL };
+    GATEWAY_MODULES_ENTRY module_2 = { "module_2", dummyLoaderInfo, NULL };
+    (void)Gateway_AddModule(gw, &module_1);
+    (void)Gateway_AddModule(gw, &module_2);
+    GATEWAY_LINK_ENTRY link_1 = { "module_1", "module_2" };
+    GATEWAY_LINK_ENTRY link_2 = { "module_2", "module_1" };
+    (void)Gateway_AddLink(gw, &link_1);
+    (void)Gateway_AddLink(gw, &link_2);
+
+    //Act
+    auto result = Gateway_Start(gw);
+
+    //Assert
+    ASSERT_ARE_EQUAL(GATEWAY_START_RESULT, GATEWAY_START_SUCCESS, result);
+    ASSERT_ARE_EQUAL(size_t, 2, startedModuleCount);
+
+    //Cleanup
+    Gateway_Destroy(gw);
+    VECTOR_destroy(props.gateway_modules);
+}
+
 //Tests_SRS_GATEWAY_17_009: [ This function shall return GATEWAY_START_INVALID_ARGS if a NULL gateway is received. ]
 TEST_FUNCTION(Gateway_Start_null_gw_returns_error)
 {
@@ -5361,6 +6256,42 @@ TEST_FUNCTION(Gateway_Start_null_gw_returns_error)
     //Cleanup
 }
 
+/*Tests_SRS_GATEWAY_17_055: [ If gw is NULL, Gateway_SetStartupThreads shall return a non-zero value. ]*/
+TEST_FUNCTION(Gateway_SetStartupThreads_returns_non_zero_for_NULL_gateway)
+{
+    //Arrange
+    CGatewayLLMocks mocks;
+
+    //Act
+    int result = Gateway_SetStartupThreads(NULL, 2);
+
+    //Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+}
+
+/*Tests_SRS_GATEWAY_17_056: [ Gateway_SetStartupThreads shall set the number of threads Gateway_Start uses while holding the gateway's lock, and return a non-zero value if it cannot take the lock. ]*/
+TEST_FUNCTION(Gateway_SetStartupThreads_sets_startup_threads)
+{
+    //Arrange
+    CNiceCallComparer<CGatewayLLMocks> mocks;
+    GATEWAY_HANDLE gw = Gateway_Create(NULL);
+    mocks.ResetAllCalls();
+
+    //Act
+    int result = Gateway_SetStartupThreads(gw, 3);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 3, (int)((GATEWAY_HANDLE_DATA*)gw)->startup_threads);
+    mocks.AssertActualAndExpectedCalls();
+
+    //Cleanup
+    Gateway_Destroy(gw);
+}
+
 //Tests_SRS_GATEWAY_17_008: [ When module is found, if the Module_Start function is defined for this module, the Module_Start function shall be called. ]
 TEST_FUNCTION(Gateway_StartModule_starts_module)
 {
@@ -71,6 +71,7 @@ MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value*, val
 static const size_t g_enabled_loaders[] =
 {
     1       // native loader
+    , 1     // static loader
 #ifdef NODE_BINDING_ENABLED
     , 1
 #endif
@@ -208,6 +209,28 @@ extern "C"
 #endif
 MOCK_FUNCTION_WITH_CODE(, const MODULE_LOADER*, DynamicLoader_Get)
 MOCK_FUNCTION_END(&Dynamic_Module_Loader)
+MOCK_FUNCTION_WITH_CODE(, int, DynamicLoader_Initialize)
+MOCK_FUNCTION_END(0)
+MOCK_FUNCTION_WITH_CODE(, void, DynamicLoader_Deinitialize)
+MOCK_FUNCTION_END()
+#ifdef __cplusplus
+}
+#endif
+
+static MODULE_LOADER Static_Module_Loader =
+{
+    NATIVE_STATIC,
+    "static",
+    NULL,
+    &Fake_Module_Loader_API
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+MOCK_FUNCTION_WITH_CODE(, const MODULE_LOADER*, StaticLoader_Get)
+MOCK_FUNCTION_END(&Static_Module_Loader)
 #ifdef __cplusplus
 }
 #endif
@@ -488,6 +511,8 @@ TEST_FUNCTION(ModuleLoader_Initialize_returns_MODULE_LOADER_ERROR_when_things_fa
         .SetFailReturn(LOCK_ERROR);
     STRICT_EXPECTED_CALL(VECTOR_create(sizeof(MODULE_LOADER*)))
         .SetFailReturn(NULL);
+    STRICT_EXPECTED_CALL(DynamicLoader_Initialize())
+        .SetFailReturn(1);
     STRICT_EXPECTED_CALL(VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
         .IgnoreArgument(1)
         .IgnoreArgument(2)
@@ -514,6 +539,7 @@ TEST_FUNCTION(ModuleLoader_Initialize_returns_MODULE_LOADER_ERROR_when_things_fa
 // Tests_SRS_MODULE_LOADER_13_001: [ ModuleLoader_Initialize shall initialize g_module_loaders.lock. ]
 // Tests_SRS_MODULE_LOADER_13_003: [ ModuleLoader_Initialize shall acquire the lock on g_module_loaders.lock. ]
 // Tests_SRS_MODULE_LOADER_13_004: [ ModuleLoader_Initialize shall initialize g_module.module_loaders by calling VECTOR_create. ]
+// Tests_SRS_MODULE_LOADER_17_012: [ ModuleLoader_Initialize shall initialize the dynamic loader by calling DynamicLoader_Initialize. ]
 // Tests_SRS_MODULE_LOADER_13_005: [ ModuleLoader_Initialize shall add the default support module loaders to g_module.module_loaders. ]
 // Tests_SRS_MODULE_LOADER_13_007: [ ModuleLoader_Initialize shall unlock g_module.lock. ]
 // Tests_SRS_MODULE_LOADER_13_006: [ ModuleLoader_Initialize shall return MODULE_LOADER_SUCCESS once all the default loaders have been added successfully. ]
@@ -524,7 +550,9 @@ TEST_FUNCTION(ModuleLoader_Initialize_succeeds)
     STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(VECTOR_create(sizeof(MODULE_LOADER*)));
+    STRICT_EXPECTED_CALL(DynamicLoader_Initialize());
 	STRICT_EXPECTED_CALL(DynamicLoader_Get());
+    STRICT_EXPECTED_CALL(StaticLoader_Get());
 #ifdef NODE_BINDING_ENABLED
     STRICT_EXPECTED_CALL(NodeLoader_Get());
 #endif
@@ -1075,6 +1103,7 @@ TEST_FUNCTION(ModuleLoader_Destroy_does_nothing_when_not_initialized)
 
 // Tests_SRS_MODULE_LOADER_13_046: [ ModuleLoader_Destroy shall invoke FreeConfiguration on every module loader's configuration field. ]
 // Tests_SRS_MODULE_LOADER_13_048: [ ModuleLoader_Destroy shall destroy the loaders vector. ]
+// Tests_SRS_MODULE_LOADER_17_013: [ ModuleLoader_Destroy shall deinitialize the dynamic loader by calling DynamicLoader_Deinitialize. ]
 TEST_FUNCTION(ModuleLoader_Destroy_frees_resources)
 {
     // arrange
@@ -1094,6 +1123,7 @@ TEST_FUNCTION(ModuleLoader_Destroy_frees_resources)
     }
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DynamicLoader_Deinitialize());
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG))
@@ -1109,6 +1139,7 @@ TEST_FUNCTION(ModuleLoader_Destroy_frees_resources)
 // Tests_SRS_MODULE_LOADER_13_046: [ ModuleLoader_Destroy shall invoke FreeConfiguration on every module loader's configuration field. ]
 // Tests_SRS_MODULE_LOADER_13_047: [ ModuleLoader_Destroy shall free the loader's name and the loader itself if it is not a default loader. ]
 // Tests_SRS_MODULE_LOADER_13_048: [ ModuleLoader_Destroy shall destroy the loaders vector. ]
+// Tests_SRS_MODULE_LOADER_17_013: [ ModuleLoader_Destroy shall deinitialize the dynamic loader by calling DynamicLoader_Deinitialize. ]
 TEST_FUNCTION(ModuleLoader_Destroy_frees_resources_with_non_default_loaders)
 {
     // arrange
@@ -1152,6 +1183,7 @@ TEST_FUNCTION(ModuleLoader_Destroy_frees_resources_with_non_default_loaders)
     }
     STRICT_EXPECTED_CALL(VECTOR_destroy(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(DynamicLoader_Deinitialize());
     STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG))
         .IgnoreArgument(1);
     STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG))
@@ -1301,6 +1333,7 @@ TEST_FUNCTION(ModuleLoader_GetDefaultLoaderForType_succeeds)
     MODULE_LOADER_TYPE inputs[] =
     {
         NATIVE
+        , NATIVE_STATIC
 #ifdef JAVA_BINDING_ENABLED
         , JAVA
 #endif
@@ -1358,8 +1391,8 @@ TEST_FUNCTION(ModuleLoader_ParseType_returns_UNKNOWN_for_unknown_loader_type)
 TEST_FUNCTION(ModuleLoader_ParseType_succeeds)
 {
     // arrange
-    char* inputs[] = { "native", "node", "java", "dotnet", "dotnetcore", "outprocess" };
-    MODULE_LOADER_TYPE expected[] = { NATIVE, NODEJS, JAVA, DOTNET, DOTNETCORE, OUTPROCESS };
+    char* inputs[] = { "native", "static", "node", "java", "dotnet", "dotnetcore", "outprocess" };
+    MODULE_LOADER_TYPE expected[] = { NATIVE, NATIVE_STATIC, NODEJS, JAVA, DOTNET, DOTNETCORE, OUTPROCESS };
 
     for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
     {
@@ -1371,12 +1404,12 @@ TEST_FUNCTION(ModuleLoader_ParseType_succeeds)
     }
 }
 
-// Tests_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]
+// Tests_SRS_MODULE_LOADER_13_061: [ ModuleLoader_IsDefaultLoader shall return true if name is the name of a default module loader and false otherwise. The default module loader names are 'native', 'static', 'node', 'java' , 'dotnet' and 'dotnetcore'. ]
 TEST_FUNCTION(ModuleLoader_IsDefaultLoader_succeeds)
 {
     // arrange
-    char* inputs[] = { "native", "node", "java", "dotnet", "dotnetcore", "outprocess", "boo" };
-    bool expected[] = { true, true, true, true, true, true, false };
+    char* inputs[] = { "native", "static", "node", "java", "dotnet", "dotnetcore", "outprocess", "boo" };
+    bool expected[] = { true, true, true, true, true, true, true, false };
 
     for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
     {
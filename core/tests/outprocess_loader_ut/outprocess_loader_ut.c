@@ -99,6 +99,7 @@ static const THREAD_HANDLE MOCK_THREAD_HANDLE = (THREAD_HANDLE *)0x19791709;
 #endif
 
 int launch_child_process_from_entrypoint(OUTPROCESS_LOADER_ENTRYPOINT * outprocess_entry);
+int launch_child_process_instances(OUTPROCESS_LOADER_ENTRYPOINT * outprocess_entry);
 int spawn_child_processes(void * context);
 int update_entrypoint_with_launch_object(OUTPROCESS_LOADER_ENTRYPOINT * outprocess_entry, const JSON_Object * launch_object);
 int validate_launch_arguments(const JSON_Object * launch_object);
@@ -127,6 +128,7 @@ MOCKABLE_FUNCTION(, JSON_Object*, json_object_get_object, const JSON_Object*, ob
 MOCKABLE_FUNCTION(, JSON_Value*, json_object_get_value, const JSON_Object*, object, const char*, name);
 MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
 MOCKABLE_FUNCTION(, double, json_object_get_number, const JSON_Object*, object, const char*, name);
+MOCKABLE_FUNCTION(, int, json_object_get_boolean, const JSON_Object*, object, const char*, name);
 MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value *, value);
 MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value);
 
@@ -162,6 +164,20 @@ const MODULE_API_1 Outprocess_Module_API_all =
 	NULL,
 	NULL
 };
+const MODULE_API_1 Outprocess_Pool_API_all =
+{
+	{ MODULE_API_VERSION_1 },
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+void Outprocess_InitializeSharedConnections(void)
+{
+}
 
 void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
 {
@@ -206,6 +222,9 @@ MOCK_FUNCTION_END(str)
 MOCK_FUNCTION_WITH_CODE(, double, json_object_get_number, const JSON_Object*, object, const char*, name)
 MOCK_FUNCTION_END(0);
 
+MOCK_FUNCTION_WITH_CODE(, int, json_object_get_boolean, const JSON_Object*, object, const char*, name)
+MOCK_FUNCTION_END(-1);
+
 MOCK_FUNCTION_WITH_CODE(, JSON_Value*, json_object_get_value, const JSON_Object*, object, const char*, name)
     JSON_Value* value = NULL;
     if (object != NULL && name != NULL)
@@ -763,6 +782,34 @@ TEST_FUNCTION(OutprocessModuleLoader_GetModuleApi_succeeds)
     OutprocessModuleLoader_Unload(&loader, module);
 }
 
+/*Tests_SRS_OUTPROCESS_LOADER_17_051: [ If the entrypoint has more than one instance, the loader shall store the Outprocess_Pool_API_all in the loader handle instead. ] */
+TEST_FUNCTION(OutprocessModuleLoader_GetModuleApi_returns_pool_api_for_instances)
+{
+    // arrange
+	OUTPROCESS_LOADER_ENTRYPOINT entrypoint = { OUTPROCESS_LOADER_ACTIVATION_NONE, (STRING_HANDLE)0x42, (STRING_HANDLE)0x42, 0, NULL, 0};
+	entrypoint.instances = 2;
+	MODULE_LOADER loader =
+	{
+		OUTPROCESS,
+		NULL, NULL, NULL
+	};
+
+    MODULE_LIBRARY_HANDLE module = OutprocessModuleLoader_Load(&loader, &entrypoint);
+    ASSERT_IS_NOT_NULL(module);
+
+    umock_c_reset_all_calls();
+
+    // act
+    const MODULE_API* result = OutprocessModuleLoader_GetModuleApi(&loader, module);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, (const MODULE_API*)&Outprocess_Pool_API_all, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    OutprocessModuleLoader_Unload(&loader, module);
+}
+
 /*Tests_SRS_OUTPROCESS_LOADER_17_010: [ This function shall do nothing if moduleLibraryHandle is NULL. ]*/
 TEST_FUNCTION(OutprocessModuleLoader_Unload_does_nothing_when_moduleLibraryHandle_is_NULL)
 {
@@ -998,6 +1045,10 @@ TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_returns_NULL_when_u
 /*Tests_SRS_OUTPROCESS_LOADER_27_020: [ Launch - `OutprocessModuleLoader_ParseEntrypointFromJson` shall update the entry point with the parsed launch parameters. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_043: [ This function shall read the "timeout" value. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_044: [ If "timeout" is set, the remote_message_wait shall be set to this value, else it will be set to a default of 1000 ms. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_045: [ This function shall read the "message.batch.size" value, and set message_batch_size to it, or 0 (no batching) if not present. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_046: [ This function shall read the "message.batch.delay.ms" value, and set message_batch_delay_ms to it, or 0 if not present. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_047: [ This function shall read the "outgoing.queue.limit" value, and set outgoing_queue_limit to it, or 0 (unbounded) if not present. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_048: [ This function shall read the "outgoing.queue.overflow" value, and set outgoing_queue_overflow to OUTPROCESS_QUEUE_DROP_OLDEST if it is "drop-oldest", or OUTPROCESS_QUEUE_DROP_NEWEST otherwise. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_022: [ This function shall return a valid pointer to an OUTPROCESS_LOADER_ENTRYPOINT on success. ]*/
 TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_succeeds)
 {
@@ -1024,6 +1075,140 @@ TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_succeeds)
     expected_calls_update_entrypoint_with_launch_object();
 	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"))
 		.SetReturn(2000);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.size"))
+		.SetReturn(4096);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.delay.ms"))
+		.SetReturn(5);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "outgoing.queue.limit"))
+		.SetReturn(1000);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "outgoing.queue.overflow"))
+		.SetReturn("drop-oldest");
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "instances"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "startup"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "startup.timeout.ms"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "message.trace"))
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "multiplex"))
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(STRING_construct(NULL));
+
+	// act
+	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(int, 1000, (int)((OUTPROCESS_LOADER_ENTRYPOINT*)result)->outgoing_queue_limit);
+	ASSERT_ARE_EQUAL(int, (int)OUTPROCESS_QUEUE_DROP_OLDEST, (int)((OUTPROCESS_LOADER_ENTRYPOINT*)result)->outgoing_queue_overflow);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_17_049: [ This function shall read the "instances" value, and set instances to it, or 0 (a single instance) if not present. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_050: [ If there is more than one instance, this function shall read the "instances.dispatch" value: "least-loaded" sets dispatch_policy to OUTPROCESS_DISPATCH_LEAST_LOADED, "key-hash" to OUTPROCESS_DISPATCH_KEY_HASH with dispatch_key set to the "instances.dispatch.key" value, and anything else to OUTPROCESS_DISPATCH_ROUND_ROBIN. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_parses_instances)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "a url";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.size"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.delay.ms"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "outgoing.queue.limit"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "outgoing.queue.overflow"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "instances"))
+		.SetReturn(4);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "instances.dispatch"))
+		.SetReturn("key-hash");
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "instances.dispatch.key"))
+		.SetReturn("deviceId");
+	STRICT_EXPECTED_CALL(STRING_construct("deviceId"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "startup"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "startup.timeout.ms"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "message.trace"))
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "multiplex"))
+		.SetReturn(-1);
+	STRICT_EXPECTED_CALL(STRING_construct(NULL));
+
+	// act
+	void* result = OutprocessModuleLoader_ParseEntrypointFromJson(NULL, (JSON_Value*)0x42);
+
+	// assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	ASSERT_ARE_EQUAL(int, 4, (int)((OUTPROCESS_LOADER_ENTRYPOINT*)result)->instances);
+	ASSERT_ARE_EQUAL(int, (int)OUTPROCESS_DISPATCH_KEY_HASH, (int)((OUTPROCESS_LOADER_ENTRYPOINT*)result)->dispatch_policy);
+	ASSERT_ARE_EQUAL(char_ptr, "deviceId", STRING_c_str(((OUTPROCESS_LOADER_ENTRYPOINT*)result)->dispatch_key));
+	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
+}
+
+/*Tests_SRS_OUTPROCESS_LOADER_17_059: [ This function shall read the "startup" value, and set parallel_startup to true if it is "parallel", or false otherwise. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_060: [ This function shall read the "startup.timeout.ms" value, and set startup_timeout_ms to it, or 0 (no deadline) if not present. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_062: [ This function shall set message_trace to true if the "message.trace" value is true, or false otherwise. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_064: [ This function shall set multiplex to true if the "multiplex" value is true, or false otherwise. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_parses_parallel_startup)
+{
+	// arrange
+	char * activation_type = "none";
+	char * control_id = "a url";
+
+	STRICT_EXPECTED_CALL(json_value_get_type((JSON_Value*)0x42))
+		.SetReturn(JSONObject);
+	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x42))
+		.SetReturn((JSON_Object*)0x43);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "activation.type"))
+		.SetReturn(activation_type);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "control.id"))
+		.SetReturn(control_id);
+	STRICT_EXPECTED_CALL(json_object_get_object((JSON_Object*)0x43, "launch"));
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "message.id"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(OUTPROCESS_LOADER_ENTRYPOINT)));
+	STRICT_EXPECTED_CALL(STRING_construct(control_id));
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "timeout"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.size"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "message.batch.delay.ms"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "outgoing.queue.limit"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "outgoing.queue.overflow"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "instances"))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(json_object_get_string((JSON_Object*)0x43, "startup"))
+		.SetReturn("parallel");
+	STRICT_EXPECTED_CALL(json_object_get_number((JSON_Object*)0x43, "startup.timeout.ms"))
+		.SetReturn(30000);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "message.trace"))
+		.SetReturn(1);
+	STRICT_EXPECTED_CALL(json_object_get_boolean((JSON_Object*)0x43, "multiplex"))
+		.SetReturn(1);
 	STRICT_EXPECTED_CALL(STRING_construct(NULL));
 
 	// act
@@ -1032,6 +1217,10 @@ TEST_FUNCTION(OutprocessModuleLoader_ParseEntrypointFromJson_succeeds)
 	// assert
 	ASSERT_IS_NOT_NULL(result);
 	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	ASSERT_IS_TRUE(((OUTPROCESS_LOADER_ENTRYPOINT*)result)->parallel_startup);
+	ASSERT_ARE_EQUAL(int, 30000, (int)((OUTPROCESS_LOADER_ENTRYPOINT*)result)->startup_timeout_ms);
+	ASSERT_IS_TRUE(((OUTPROCESS_LOADER_ENTRYPOINT*)result)->message_trace);
+	ASSERT_IS_TRUE(((OUTPROCESS_LOADER_ENTRYPOINT*)result)->multiplex);
 	OutprocessModuleLoader_FreeEntrypoint(NULL, result);
 }
 
@@ -1174,6 +1363,47 @@ TEST_FUNCTION(OutprocessModuleLoader_BuildModuleConfiguration_success_with_msg_u
 	STRING_delete(mc);
 }
 
+/*Tests_SRS_OUTPROCESS_LOADER_17_061: [ This function shall set lifecycle_model to OUTPROCESS_LIFECYCLE_ASYNC if the entrypoint's parallel_startup is true, or OUTPROCESS_LIFECYCLE_SYNC otherwise, and copy the entrypoint's startup_timeout_ms. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_063: [ This function shall copy the entrypoint's message_trace to the OUTPROCESS_MODULE_CONFIG. ]*/
+/*Tests_SRS_OUTPROCESS_LOADER_17_065: [ This function shall copy the entrypoint's multiplex to the OUTPROCESS_MODULE_CONFIG. ]*/
+TEST_FUNCTION(OutprocessModuleLoader_BuildModuleConfiguration_copies_startup_settings)
+{
+	//arrange
+	OUTPROCESS_LOADER_ENTRYPOINT ep =
+	{
+		OUTPROCESS_LOADER_ACTIVATION_NONE,
+		STRING_construct("control_id"),
+		STRING_construct("message_id"),
+		0,
+		NULL,
+		0
+	};
+	ep.parallel_startup = true;
+	ep.startup_timeout_ms = 30000;
+	ep.message_trace = true;
+	ep.multiplex = true;
+	STRING_HANDLE mc = STRING_construct("message config");
+
+	umock_c_reset_all_calls();
+
+	//act
+	void * result = OutprocessModuleLoader_BuildModuleConfiguration(NULL, &ep, mc);
+	OUTPROCESS_MODULE_CONFIG *omc = (OUTPROCESS_MODULE_CONFIG*)result;
+
+	//assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(int, (int)OUTPROCESS_LIFECYCLE_ASYNC, (int)omc->lifecycle_model);
+	ASSERT_ARE_EQUAL(int, 30000, (int)omc->startup_timeout_ms);
+	ASSERT_IS_TRUE(omc->message_trace);
+	ASSERT_IS_TRUE(omc->multiplex);
+
+	//cleanup
+	OutprocessModuleLoader_FreeModuleConfiguration(NULL, result);
+	STRING_delete(ep.control_id);
+	STRING_delete(ep.message_id);
+	STRING_delete(mc);
+}
+
 /*Tests_SRS_OUTPROCESS_LOADER_17_029: [ If the entrypoint's message_id is NULL, then the loader shall construct an IPC url. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_030: [ The loader shall create a unique id, if needed for URL constrution. ]*/
 /*Tests_SRS_OUTPROCESS_LOADER_17_032: [ The message url shall be composed of "ipc://" + unique id. ]*/
@@ -2210,6 +2440,63 @@ TEST_FUNCTION(launch_child_process_from_entrypoint_SCENARIO_negative_tests)
     umock_c_negative_tests_deinit();
 }
 
+/* Tests_SRS_OUTPROCESS_LOADER_17_054: [ `launch_child_process_instances` shall allocate an argument array for the instances, by calling `void * malloc(size_t _Size)`. ] */
+/* Tests_SRS_OUTPROCESS_LOADER_17_055: [ The control id of each instance shall be the entrypoint's control id, followed by "." and the instance index. ] */
+/* Tests_SRS_OUTPROCESS_LOADER_17_056: [ `launch_child_process_instances` shall launch a child process per instance, replacing every argument equal to the entrypoint's control id with the control id of the instance. ] */
+TEST_FUNCTION(launch_child_process_instances_SCENARIO_success)
+{
+    // Arrange
+    global_memory = true;
+    static const unsigned int INSTANCES = 2;
+
+    int result;
+    char * process_argv[] = {
+        "program.exe",
+        "control.id",
+        NULL
+    };
+    STRING_HANDLE control_id = real_STRING_construct("control.id");
+    OUTPROCESS_LOADER_ENTRYPOINT entrypoint = {
+        OUTPROCESS_LOADER_ACTIVATION_LAUNCH,
+        control_id,
+        NULL,
+        2,
+        process_argv,
+        0
+    };
+    entrypoint.instances = INSTANCES;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(char *) * 3));
+    STRICT_EXPECTED_CALL(STRING_c_str(control_id));
+    for (unsigned int i = 0; i < INSTANCES; ++i) {
+        STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+        expected_calls_launch_child_process_from_entrypoint(0 == i);
+        STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+            .IgnoreArgument(1);
+    }
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // Act
+    result = launch_child_process_instances(&entrypoint);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    OutprocessLoader_JoinChildProcesses();
+    for (unsigned int i = 0; i < INSTANCES; ++i) {
+        my_gballoc_free(NULL);
+    }
+    global_memory = false;
+    ASSERT_ARE_EQUAL(int, 0, global_malloc_count);
+    real_STRING_delete(control_id);
+}
+
 /* Tests_SRS_OUTPROCESS_LOADER_27_080: [ `spawn_child_processes` shall start the child process management thread, by calling `int uv_run(uv_loop_t * loop, uv_run_mode mode)` passing the result of `uv_default_loop()` for `loop` and `UV_RUN_DEFAULT` for `mode`. ] */
 /* Tests_SRS_OUTPROCESS_LOADER_27_081: [ If no errors are encountered, then `spawn_child_processes` shall return zero. ] */
 TEST_FUNCTION(spawn_child_processes_SCENARIO_success)
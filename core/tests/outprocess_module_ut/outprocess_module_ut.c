@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 #define GATEWAY_EXPORT_H
 #define GATEWAY_EXPORT
@@ -56,12 +58,16 @@ void my_gballoc_free(void* ptr)
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "broker.h"
 #include "module_loader.h"
 #include "message_queue.h"
+#include "message_batch.h"
+#include "message_trace.h"
 
 #undef ENABLE_MOCKS
 #include "control_message.h"
+#include "message_mux.h"
 
 #include "module_loaders/outprocess_module.h"
 
@@ -163,6 +169,9 @@ MOCK_FUNCTION_END(send_length)
 static bool should_nn_recv_fail = false;
 static int current_nn_recv_index;
 static int when_shall_nn_recv_fail;
+/* when set, nn_recv receives this frame instead of "nn_recv" */
+static const unsigned char * nn_recv_frame;
+static size_t nn_recv_frame_size;
 MOCK_FUNCTION_WITH_CODE(, int, nn_recv, int, s, void *, buf, size_t, len, int, flags)
 	int rcv_length;
 	current_nn_recv_index++;
@@ -174,12 +183,13 @@ MOCK_FUNCTION_WITH_CODE(, int, nn_recv, int, s, void *, buf, size_t, len, int, f
 	{
 		if (len == NN_MSG)
 		{
-			char * text = (char*)"nn_recv";
-			(*(void**)buf) = my_gballoc_malloc(8);
+			const unsigned char * frame = (nn_recv_frame != NULL) ? nn_recv_frame : (const unsigned char*)"nn_recv";
+			size_t frame_size = (nn_recv_frame != NULL) ? nn_recv_frame_size : 8;
+			(*(void**)buf) = my_gballoc_malloc(frame_size);
 			if ((*(void**)buf) != NULL)
 			{
-				memcpy((*(void**)buf), text, 8);
-				rcv_length = 8;
+				memcpy((*(void**)buf), frame, frame_size);
+				rcv_length = (int)frame_size;
 			}
 			else
 			{
@@ -203,6 +213,9 @@ MOCK_FUNCTION_WITH_CODE(, int, nn_freemsg, void *, msg)
 my_gballoc_free(msg);
 MOCK_FUNCTION_END(free_result)
 
+// the messaging thread of a pool instance is only created by Start
+extern int outprocessIncomingMessageThread(void *param);
+
 //Thread API mocks
 #define NUMMOCKTHREADS 6
 static THREAD_START_FUNC thread_func_to_call[NUMMOCKTHREADS];
@@ -256,6 +269,19 @@ THREADAPI_RESULT myThreadAPI_Join( THREAD_HANDLE threadHandle, int* res)
 	return thread_join_result[currentThreadAPI_join_call];
 }
 
+/* tickcounter mocks */
+#define FAKE_TICKCOUNTER ((TICK_COUNTER_HANDLE)0x60)
+static tickcounter_ms_t current_ms;
+static tickcounter_ms_t ms_per_sample;
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* ms)
+{
+	(void)tick_counter;
+	*ms = current_ms;
+	current_ms += ms_per_sample;
+	return 0;
+}
+
 /* Lock mocks
  */
 LOCK_HANDLE my_Lock_Init(void)
@@ -344,6 +370,16 @@ if (*counter == 0)
 MOCK_FUNCTION_END()
 
 
+MOCK_FUNCTION_WITH_CODE(, CONSTMAP_HANDLE, Message_GetProperties, MESSAGE_HANDLE, message)
+MOCK_FUNCTION_END((CONSTMAP_HANDLE)0x50)
+
+static const char * dispatch_key_value;
+MOCK_FUNCTION_WITH_CODE(, const char*, ConstMap_GetValue, CONSTMAP_HANDLE, handle, const char*, key)
+MOCK_FUNCTION_END(dispatch_key_value)
+
+MOCK_FUNCTION_WITH_CODE(, void, ConstMap_Destroy, CONSTMAP_HANDLE, handle)
+MOCK_FUNCTION_END()
+
 MOCK_FUNCTION_WITH_CODE(, BROKER_RESULT, Broker_Publish, BROKER_HANDLE, broker, MODULE_HANDLE, source, MESSAGE_HANDLE, message)
 MOCK_FUNCTION_END(BROKER_OK)
 
@@ -365,6 +401,11 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	REGISTER_UMOCK_ALIAS_TYPE(BROKER_HANDLE, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_QUEUE_HANDLE, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_BATCH_HANDLE, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_BATCH_CALLBACK, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_TRACE_HISTOGRAM_HANDLE, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(const MESSAGE_TRACE*, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_TRACE_HOP, int);
 	REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void*);
 	REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
 	REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void*);
@@ -372,6 +413,8 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	REGISTER_UMOCK_ALIAS_TYPE(MODULE_API_VERSION, int);
 	REGISTER_UMOCK_ALIAS_TYPE(BROKER_RESULT, int);
 	REGISTER_UMOCK_ALIAS_TYPE(THREADAPI_RESULT, int);
+	REGISTER_UMOCK_ALIAS_TYPE(CONSTMAP_HANDLE, void*);
+	REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
 
 	// STRING
 	REGISTER_GLOBAL_MOCK_HOOK(STRING_construct, real_STRING_construct);
@@ -379,6 +422,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	REGISTER_GLOBAL_MOCK_HOOK(STRING_c_str, real_STRING_c_str);
 	REGISTER_GLOBAL_MOCK_HOOK(STRING_clone, real_STRING_clone);
 	REGISTER_GLOBAL_MOCK_HOOK(STRING_length, real_STRING_length);
+	REGISTER_GLOBAL_MOCK_HOOK(STRING_concat, real_STRING_concat);
 	
 	// malloc/free hooks
 	REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
@@ -397,6 +441,10 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	// message queue
 	REGISTER_GLOBAL_MOCK_RETURNS(MESSAGE_QUEUE_create, (MESSAGE_QUEUE_HANDLE)0x40, NULL);
 
+	// tickcounter
+	REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, FAKE_TICKCOUNTER);
+	REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+
 
 	Module_ParseConfigurationFromJson = Outprocess_Module_API_all.Module_ParseConfigurationFromJson;
 	Module_FreeConfiguration = Outprocess_Module_API_all.Module_FreeConfiguration;
@@ -404,6 +452,9 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
 	Module_Destroy = Outprocess_Module_API_all.Module_Destroy;
 	Module_Receive = Outprocess_Module_API_all.Module_Receive;
 	Module_Start = Outprocess_Module_API_all.Module_Start;
+
+	// the outprocess loader does this before any module is created
+	Outprocess_InitializeSharedConnections();
 }
 
 TEST_SUITE_CLEANUP(TestClassCleanup)
@@ -431,6 +482,8 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	when_shall_nn_send_fail = 0;
 	current_nn_recv_index = 0;
 	when_shall_nn_recv_fail = 0;
+	nn_recv_frame = NULL;
+	nn_recv_frame_size = 0;
 
 	current_nn_socket_index = 0;
 	current_nn_bind_index = 0;
@@ -460,6 +513,9 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
 	}
 
 	memset(&global_control_msg, 0, sizeof(CONTROL_MESSAGE_MODULE_CREATE));
+	dispatch_key_value = NULL;
+	current_ms = 0;
+	ms_per_sample = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -676,6 +732,76 @@ TEST_FUNCTION(Outprocess_Create_success)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_092: [ If message_trace is true, this function shall create the latency histograms for traced messages. ]*/
+TEST_FUNCTION(Outprocess_Create_success_with_message_trace)
+{
+	// arrange
+	global_control_msg.base.type = CONTROL_MESSAGE_TYPE_MODULE_REPLY;
+	global_control_msg.base.version = CONTROL_MESSAGE_VERSION_CURRENT;
+	((CONTROL_MESSAGE_MODULE_REPLY*)&global_control_msg)->status = 0;
+
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.message_trace = true;
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Init());
+
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_create())
+		.SetReturn((MESSAGE_QUEUE_HANDLE)0x40);
+
+	setup_create_connections(&config);
+
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+
+	STRICT_EXPECTED_CALL(STRING_clone(config.control_uri));
+	STRICT_EXPECTED_CALL(STRING_clone(config.message_uri));
+	STRICT_EXPECTED_CALL(STRING_clone(config.outprocess_module_args));
+	STRICT_EXPECTED_CALL(MessageTrace_CreateHistogram())
+		.SetReturn((MESSAGE_TRACE_HISTOGRAM_HANDLE)0x44);
+
+	//create thread
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	call_thread_function_on_join[1] = 1;
+	STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	//join on the create thread.
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	setup_create_create_message(&config);
+
+	STRICT_EXPECTED_CALL(nn_setsockopt(2, NN_SOL_SOCKET, NN_RCVTIMEO, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(4).IgnoreArgument(5);
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, 0))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray(IGNORED_PTR_ARG, 8))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	// act
+	MODULE_HANDLE result = Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	Module_Destroy(result);
+	cleanup_create_config(&config);
+}
+
 TEST_FUNCTION(Outprocess_Create_success_on_2nd_recv)
 {
 	// arrange
@@ -752,6 +878,80 @@ TEST_FUNCTION(Outprocess_Create_success_on_2nd_recv)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_086: [ If startup_timeout_ms is not zero, this thread shall mark the time the Create handshake began. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_087: [ If no Create Response has been received once startup_timeout_ms has elapsed, this thread shall stop waiting and report a failure. ]*/
+TEST_FUNCTION(Outprocess_Create_returns_null_after_startup_timeout)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.startup_timeout_ms = 1000;
+	ms_per_sample = 1500;
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_create())
+		.SetReturn((MESSAGE_QUEUE_HANDLE)0x40);
+	setup_create_connections(&config);
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(STRING_clone(config.control_uri));
+	STRICT_EXPECTED_CALL(STRING_clone(config.message_uri));
+	STRICT_EXPECTED_CALL(STRING_clone(config.outprocess_module_args));
+	//create thread
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	call_thread_function_on_join[1] = 1;
+	STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	//join on the create thread.
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(tickcounter_create());
+	STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICKCOUNTER, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	setup_create_create_message(&config);
+	STRICT_EXPECTED_CALL(nn_setsockopt(2, NN_SOL_SOCKET, NN_RCVTIMEO, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(4).IgnoreArgument(5);
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+		.IgnoreArgument(2);
+	when_shall_nn_recv_fail = 1;
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, 0))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno()).SetReturn(ETIMEDOUT);
+	STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICKCOUNTER, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(tickcounter_destroy(FAKE_TICKCOUNTER));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_close(1));
+	STRICT_EXPECTED_CALL(nn_close(2));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_destroy((MESSAGE_QUEUE_HANDLE)0x40));
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	MODULE_HANDLE result = Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+	ASSERT_IS_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_013: [ This function shall send the Create Message on the control channel. ]*/
 TEST_FUNCTION(Outprocess_Create_success_async)
 {
@@ -2476,6 +2676,84 @@ TEST_FUNCTION(Outprocess_Start_success)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_088: [ If the module was created with OUTPROCESS_LIFECYCLE_ASYNC, this function shall wait for the Create handshake to complete. ]*/
+TEST_FUNCTION(Outprocess_Start_async_waits_for_create_handshake)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	global_control_msg.base.type = CONTROL_MESSAGE_TYPE_MODULE_REPLY;
+	global_control_msg.base.version = CONTROL_MESSAGE_VERSION_CURRENT;
+	((CONTROL_MESSAGE_MODULE_REPLY*)&global_control_msg)->status = 0;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	umock_c_reset_all_calls();
+
+	call_thread_function_on_join[1] = 1;
+	STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	setup_create_create_message(&config);
+	STRICT_EXPECTED_CALL(nn_setsockopt(2, NN_SOL_SOCKET, NN_RCVTIMEO, IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreArgument(4).IgnoreArgument(5);
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, 0))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray(IGNORED_PTR_ARG, 8))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	setup_start_or_destroy_message();
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+
+	///act
+	Module_Start(module);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_089: [ If the Create handshake failed, this function shall not start the module. ]*/
+TEST_FUNCTION(Outprocess_Start_async_does_not_start_when_create_handshake_fails)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	umock_c_reset_all_calls();
+
+	thread_join_result[1] = THREADAPI_ERROR;
+	STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	///act
+	Module_Start(module);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_021: [ This function shall free any resources created. ]*/
 TEST_FUNCTION(Outprocess_Start_nn_send_fail)
 {
@@ -2647,6 +2925,7 @@ static void teardown_a_thread(bool needs_join, bool lock_fail)
 /*Tests_SRS_OUTPROCESS_MODULE_17_050: [ This function shall signal the control thread to close. ]*/
 /*Tests_SRS_OUTPROCESS_MODULE_17_051: [ This function shall wait for the outgoing gateway message thread to complete. ]*/
 /*Tests_SRS_OUTPROCESS_MODULE_17_052: [ This function shall wait for the control thread to complete. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_112: [ This function shall stop the outgoing gateway message thread before sending the Destroy Message, so that its pending batch is sent while the message channel is open. ]*/
 TEST_FUNCTION(Outprocess_Destroy_success)
 {
 	OUTPROCESS_MODULE_CONFIG config;
@@ -2662,16 +2941,10 @@ TEST_FUNCTION(Outprocess_Destroy_success)
 	umock_c_reset_all_calls();
 
 	// arrange
-	setup_start_or_destroy_message();
-	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, 1)).IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(nn_close(1));
-	STRICT_EXPECTED_CALL(nn_close(2));
-	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	//thread_create order: async, msg_rec, msg_send, control
-	//thread join order: async, msg_rec, msg_send, control, async
-	call_thread_function_on_join[2] = 2;
-	call_thread_function_on_join[3] = 3;
+	//thread join order: async, msg_send, msg_rec, control, async
+	call_thread_function_on_join[2] = 3;
+	call_thread_function_on_join[3] = 2;
 	call_thread_function_on_join[4] = 4;
 	//teardown_a_thread(true, false);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2681,9 +2954,13 @@ TEST_FUNCTION(Outprocess_Destroy_success)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	setup_start_or_destroy_message();
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, 1)).IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_close(1));
+	STRICT_EXPECTED_CALL(nn_close(2));
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	//teardown_a_thread(true, false);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2692,6 +2969,8 @@ TEST_FUNCTION(Outprocess_Destroy_success)
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Lock_Deinit(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	//teardown_a_thread(true, false);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2738,6 +3017,10 @@ TEST_FUNCTION(Outprocess_Destroy_send_lock_join_fails)
 	umock_c_reset_all_calls();
 
 	// arrange
+	thread_join_result[1] = THREADAPI_ERROR;
+	thread_join_result[2] = THREADAPI_ERROR;
+	thread_join_result[3] = THREADAPI_ERROR;
+	teardown_a_thread(true, true);
 	setup_start_or_destroy_message();
 
 	should_nn_send_fail = true;
@@ -2757,10 +3040,6 @@ TEST_FUNCTION(Outprocess_Destroy_send_lock_join_fails)
 	STRICT_EXPECTED_CALL(nn_close(1));
 	STRICT_EXPECTED_CALL(nn_close(2));
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	thread_join_result[1] = THREADAPI_ERROR;
-	thread_join_result[2] = THREADAPI_ERROR;
-	thread_join_result[3] = THREADAPI_ERROR;
-	teardown_a_thread(true, true);
 	teardown_a_thread(true, true);
 	teardown_a_thread(true, true);
 	teardown_a_thread(true, true); //async won't be closed.
@@ -2795,6 +3074,7 @@ TEST_FUNCTION(Outprocess_Destroy_destroy_message_alloc_fails)
 	umock_c_reset_all_calls();
 
 	// arrange
+	teardown_a_thread(true, false);
 	STRICT_EXPECTED_CALL(ControlMessage_ToByteArray(IGNORED_PTR_ARG, NULL, 0))
 		.IgnoreArgument(1);
 	malloc_will_fail = true;
@@ -2807,7 +3087,6 @@ TEST_FUNCTION(Outprocess_Destroy_destroy_message_alloc_fails)
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	teardown_a_thread(true, false);
 	teardown_a_thread(true, false);
-	teardown_a_thread(true, false);
 	teardown_a_thread(false, false);
 	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2840,6 +3119,7 @@ TEST_FUNCTION(Outprocess_Destroy_destroy_message_to_array_fails)
 	umock_c_reset_all_calls();
 
 	// arrange
+	teardown_a_thread(true, false);
 	STRICT_EXPECTED_CALL(ControlMessage_ToByteArray(IGNORED_PTR_ARG, NULL, 0))
 		.IgnoreArgument(1)
 		.SetReturn(-1);
@@ -2849,7 +3129,6 @@ TEST_FUNCTION(Outprocess_Destroy_destroy_message_to_array_fails)
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	teardown_a_thread(true, false);
 	teardown_a_thread(true, false);
-	teardown_a_thread(true, false);
 	teardown_a_thread(false, false);
 	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
@@ -2910,13 +3189,16 @@ TEST_FUNCTION(Outprocess_Receive_success)
 	cleanup_create_config(&config);
 }
 
-/*Tests_SRS_OUTPROCESS_MODULE_17_047: [ This function shall push the message onto the end of the outgoing gateway message queue. ]*/
-TEST_FUNCTION(Outprocess_Receive_push_queue_fails)
+/*Tests_SRS_OUTPROCESS_MODULE_17_090: [ If message tracing is enabled and no queued message is traced, this function shall trace the queued message and stamp its enqueue hop. ]*/
+TEST_FUNCTION(Outprocess_Receive_traces_first_queued_message)
 {
 	// arrange
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
+	config.message_trace = true;
 
+	STRICT_EXPECTED_CALL(MessageTrace_CreateHistogram())
+		.SetReturn((MESSAGE_TRACE_HISTOGRAM_HANDLE)0x44);
 	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
 	Module_Start(module);
 	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
@@ -2924,24 +3206,31 @@ TEST_FUNCTION(Outprocess_Receive_push_queue_fails)
 
 	STRICT_EXPECTED_CALL(Message_Clone(msg));
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push(IGNORED_PTR_ARG, msg)).IgnoreArgument(1).SetReturn(2620);
-	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push(IGNORED_PTR_ARG, msg)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageTrace_Now());
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push(IGNORED_PTR_ARG, msg)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 
 	// act
 	Module_Receive(module, msg);
+	Module_Receive(module, msg);
 
 	// assert 
 	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
 
 	//ablution
 	Message_Destroy(msg);
+	Message_Destroy(msg);
+	Message_Destroy(msg);
 	Module_Destroy(module);
 	cleanup_create_config(&config);
 }
 
 /*Tests_SRS_OUTPROCESS_MODULE_17_047: [ This function shall push the message onto the end of the outgoing gateway message queue. ]*/
-TEST_FUNCTION(Outprocess_Receive_Lock_fails)
+TEST_FUNCTION(Outprocess_Receive_push_queue_fails)
 {
 	// arrange
 	OUTPROCESS_MODULE_CONFIG config;
@@ -2953,7 +3242,37 @@ TEST_FUNCTION(Outprocess_Receive_Lock_fails)
 	umock_c_reset_all_calls();
 
 	STRICT_EXPECTED_CALL(Message_Clone(msg));
-	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push(IGNORED_PTR_ARG, msg)).IgnoreArgument(1).SetReturn(2620);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	Module_Receive(module, msg);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Message_Destroy(msg);
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_047: [ This function shall push the message onto the end of the outgoing gateway message queue. ]*/
+TEST_FUNCTION(Outprocess_Receive_Lock_fails)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
 	STRICT_EXPECTED_CALL(Message_Destroy(msg));
 
 	// act
@@ -2995,6 +3314,396 @@ TEST_FUNCTION(Outprocess_Receive_Message_Clone_fails)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_070: [ If the outgoing queue is full and the overflow policy is OUTPROCESS_QUEUE_DROP_NEWEST, this function shall destroy the message instead of queuing it. ]*/
+TEST_FUNCTION(Outprocess_Receive_full_queue_drops_newest)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.outgoing_queue_limit = 1;
+	config.outgoing_queue_overflow = OUTPROCESS_QUEUE_DROP_NEWEST;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	Module_Receive(module, msg);
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	Module_Receive(module, msg);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Message_Destroy(msg);
+	Message_Destroy(msg);
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_071: [ If the outgoing queue is full and the overflow policy is OUTPROCESS_QUEUE_DROP_OLDEST, this function shall remove and destroy the oldest message in the queue before pushing the new one. ]*/
+TEST_FUNCTION(Outprocess_Receive_full_queue_drops_oldest)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.outgoing_queue_limit = 1;
+	config.outgoing_queue_overflow = OUTPROCESS_QUEUE_DROP_OLDEST;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	Module_Receive(module, msg);
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_pop(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push(IGNORED_PTR_ARG, msg)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	Module_Receive(module, msg);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Message_Destroy(msg);
+	Message_Destroy(msg);
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+static void setup_pool_config(OUTPROCESS_MODULE_CONFIG* config, unsigned int instances, OUTPROCESS_DISPATCH_POLICY dispatch_policy)
+{
+	setup_create_config(config);
+	config->lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config->instances = instances;
+	config->dispatch_policy = dispatch_policy;
+}
+
+static void setup_pool_instance_create(size_t instance)
+{
+	char control_uri[32];
+	char message_uri[32];
+	(void)sprintf(control_uri, "control_uri.%u", (unsigned int)instance);
+	(void)sprintf(message_uri, "message_uri.%u", (unsigned int)instance);
+
+	STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_concat(IGNORED_PTR_ARG, IGNORED_PTR_ARG)).IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_create())
+		.SetReturn((MESSAGE_QUEUE_HANDLE)(0x40 + instance));
+	STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(nn_connect((int)(2 * instance + 1), message_uri));
+	STRICT_EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(nn_connect((int)(2 * instance + 2), control_uri));
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(Lock_Init());
+	STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG)).IgnoreArgument(1);
+}
+
+static void setup_pool_create(unsigned int instances, bool with_dispatch_key)
+{
+	STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(MODULE_HANDLE) * instances));
+	if (with_dispatch_key)
+	{
+		STRICT_EXPECTED_CALL(STRING_clone(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	}
+	for (unsigned int i = 0; i < instances; i++)
+	{
+		setup_pool_instance_create(i);
+	}
+}
+
+static void setup_pool_receive(MESSAGE_HANDLE msg, size_t instance)
+{
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push((MESSAGE_QUEUE_HANDLE)(0x40 + instance), msg));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_072: [ If broker or configuration are NULL, Outprocess_Pool_Create shall return NULL. ]*/
+TEST_FUNCTION(Outprocess_Pool_Create_returns_null_with_null_arguments)
+{
+	///arrange
+	///act
+	MODULE_HANDLE m1 = Outprocess_Pool_API_all.Module_Create(NULL, (const void*)0x42);
+	MODULE_HANDLE m2 = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, NULL);
+
+	///asssert
+	ASSERT_IS_NULL(m1);
+	ASSERT_IS_NULL(m2);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	//ablution
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_073: [ Outprocess_Pool_Create shall allocate memory for the pool and for a handle per instance. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_074: [ Each instance shall connect to the control_uri and the message_uri of the pool, suffixed with "." and the instance index. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_075: [ Outprocess_Pool_Create shall create each instance as an outprocess module. ]*/
+TEST_FUNCTION(Outprocess_Pool_Create_success)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 2, OUTPROCESS_DISPATCH_ROUND_ROBIN);
+	setup_pool_create(2, false);
+
+	// act
+	MODULE_HANDLE result = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+	ASSERT_IS_NOT_NULL(result);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	Outprocess_Pool_API_all.Module_Destroy(result);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_076: [ If any step fails, Outprocess_Pool_Create shall destroy the instances created so far, deallocate all resources and return NULL. ]*/
+TEST_FUNCTION(Outprocess_Pool_Create_returns_null_when_an_instance_fails)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 2, OUTPROCESS_DISPATCH_ROUND_ROBIN);
+	// the second instance is unable to open its message socket
+	when_shall_nn_socket_fail = 3;
+
+	// act
+	MODULE_HANDLE result = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+	ASSERT_IS_NULL(result);
+
+	// ablution
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_080: [ If module or message_handle is NULL, Outprocess_Pool_Receive shall do nothing. ]*/
+TEST_FUNCTION(Outprocess_Pool_Receive_does_nothing_with_nothing)
+{
+	///act
+	Outprocess_Pool_API_all.Module_Receive(NULL, (MESSAGE_HANDLE)0x42);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_083: [ OUTPROCESS_DISPATCH_ROUND_ROBIN shall pick each instance in turn. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_084: [ Outprocess_Pool_Receive shall pass the message to the picked instance. ]*/
+TEST_FUNCTION(Outprocess_Pool_Receive_round_robin)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 2, OUTPROCESS_DISPATCH_ROUND_ROBIN);
+	setup_pool_create(2, false);
+	MODULE_HANDLE module = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	umock_c_reset_all_calls();
+
+	setup_pool_receive(msg, 0);
+	setup_pool_receive(msg, 1);
+	setup_pool_receive(msg, 0);
+
+	// act
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	for (int i = 0; i < 4; i++)
+	{
+		Message_Destroy(msg);
+	}
+	Outprocess_Pool_API_all.Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_104: [ An instance of a pool shall publish its messages as the pool. ]*/
+TEST_FUNCTION(Outprocess_Pool_instance_publishes_as_the_pool)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 2, OUTPROCESS_DISPATCH_ROUND_ROBIN);
+	setup_pool_create(2, false);
+	MODULE_HANDLE pool = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(pool);
+	umock_c_reset_all_calls();
+
+	// the second instance receives a message from its module host; the
+	// broker routes it to the sinks linked to the pool only if the pool
+	// is its source
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(3, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(MessageBatch_IsBatch(IGNORED_PTR_ARG, 8)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(Broker_Publish((BROKER_HANDLE)0x42, pool, IGNORED_PTR_ARG))
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+
+	// act
+	int function_result = outprocessIncomingMessageThread(thread_func_args[2]);
+
+	// assert
+	ASSERT_ARE_EQUAL(int, function_result, 0);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	Outprocess_Pool_API_all.Module_Destroy(pool);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_081: [ OUTPROCESS_DISPATCH_LEAST_LOADED shall pick the instance with the fewest messages in its outgoing queue, the lowest index on ties. ]*/
+TEST_FUNCTION(Outprocess_Pool_Receive_least_loaded)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 2, OUTPROCESS_DISPATCH_LEAST_LOADED);
+	setup_pool_create(2, false);
+	MODULE_HANDLE module = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	umock_c_reset_all_calls();
+
+	// both queues are empty, the first instance wins the tie
+	for (int i = 0; i < 2; i++)
+	{
+		STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	}
+	setup_pool_receive(msg, 0);
+	// the first instance now has a message queued
+	for (int i = 0; i < 2; i++)
+	{
+		STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	}
+	STRICT_EXPECTED_CALL(Message_Clone(msg));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_push((MESSAGE_QUEUE_HANDLE)0x41, msg))
+		.SetReturn(1);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	// the second instance failed to queue, so it is still the least loaded
+	for (int i = 0; i < 2; i++)
+	{
+		STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+		STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	}
+	setup_pool_receive(msg, 1);
+
+	// act
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	for (int i = 0; i < 3; i++)
+	{
+		Message_Destroy(msg);
+	}
+	Outprocess_Pool_API_all.Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_082: [ OUTPROCESS_DISPATCH_KEY_HASH shall pick the instance by the 32 bit FNV-1a hash of the dispatch key property of the message, modulo the number of instances. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_085: [ If the message does not carry the dispatch key property, the message shall be dispatched round-robin. ]*/
+TEST_FUNCTION(Outprocess_Pool_Receive_key_hash)
+{
+	// arrange
+	// FNV-1a("g") is 0xe20c2606, which lands on instance 0 of 3
+	// FNV-1a("c") is 0xe60c2c52, which lands on instance 2 of 3
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_pool_config(&config, 3, OUTPROCESS_DISPATCH_KEY_HASH);
+	config.dispatch_key = STRING_construct("deviceId");
+	setup_pool_create(3, true);
+	MODULE_HANDLE module = Outprocess_Pool_API_all.Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Message_GetProperties(msg));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ConstMap_GetValue((CONSTMAP_HANDLE)0x50, "deviceId"))
+		.SetReturn("c");
+	STRICT_EXPECTED_CALL(ConstMap_Destroy((CONSTMAP_HANDLE)0x50));
+	setup_pool_receive(msg, 2);
+	STRICT_EXPECTED_CALL(Message_GetProperties(msg));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ConstMap_GetValue((CONSTMAP_HANDLE)0x50, "deviceId"))
+		.SetReturn("g");
+	STRICT_EXPECTED_CALL(ConstMap_Destroy((CONSTMAP_HANDLE)0x50));
+	setup_pool_receive(msg, 0);
+	STRICT_EXPECTED_CALL(Message_GetProperties(msg));
+	STRICT_EXPECTED_CALL(STRING_c_str(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ConstMap_GetValue((CONSTMAP_HANDLE)0x50, "deviceId"))
+		.SetReturn(NULL);
+	STRICT_EXPECTED_CALL(ConstMap_Destroy((CONSTMAP_HANDLE)0x50));
+	setup_pool_receive(msg, 0);
+
+	// act
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+	Outprocess_Pool_API_all.Module_Receive(module, msg);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	for (int i = 0; i < 4; i++)
+	{
+		Message_Destroy(msg);
+	}
+	Outprocess_Pool_API_all.Module_Destroy(module);
+	STRING_delete(config.dispatch_key);
+	cleanup_create_config(&config);
+}
+
 TEST_FUNCTION(Outprocess_outgoing_thread_does_nothing_with_nothing)
 {
 	OUTPROCESS_MODULE_CONFIG config;
@@ -3063,6 +3772,197 @@ TEST_FUNCTION(Outprocess_outgoing_thread_success)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_068: [ If the module host has granted credits, this function shall leave messages in the queue until enough message and byte credits are available, and consume those credits when a message is removed. ]*/
+TEST_FUNCTION(Outprocess_outgoing_thread_waits_for_credit)
+{
+	// arrange
+	CONTROL_MESSAGE_MODULE_CREDIT one_message =
+	{
+		{ CONTROL_MESSAGE_VERSION_CURRENT,  CONTROL_MESSAGE_TYPE_MODULE_CREDIT },
+		1,
+		0
+	};
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	umock_c_reset_all_calls();
+	STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.SetReturn((CONTROL_MESSAGE*)&one_message);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+	thread_func_to_call[4](thread_func_args[4]);
+	umock_c_reset_all_calls();
+
+	// 1st pass: one credit, the message is sent
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_is_empty(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_front(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_pop(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Message_ToByteArray(msg, NULL, 0));
+	STRICT_EXPECTED_CALL(nn_allocmsg(default_serialized_size, 0));
+	STRICT_EXPECTED_CALL(Message_ToByteArray(msg, IGNORED_PTR_ARG, default_serialized_size))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_send(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+	// 2nd pass: out of credits, the message stays queued
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_is_empty(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_front(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+
+	// act
+	//third thread created is outgoing message thread
+	thread_func_to_call[3](thread_func_args[3]);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_062: [ If message_batch_size is not zero, this thread shall create a message batch of that size. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_063: [ When batching, this function shall append the message to the batch instead of sending it. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_064: [ Once a flush is due, this function shall send the batch as a single frame on the message channel and empty the batch. ]*/
+TEST_FUNCTION(Outprocess_outgoing_thread_batch_success)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.message_batch_size = 4096;
+	config.message_batch_delay_ms = 5;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	MESSAGE_BATCH_HANDLE batch = (MESSAGE_BATCH_HANDLE)0x50;
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(MessageBatch_Create(4096, 5))
+		.SetReturn(batch);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_is_empty(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_pop(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageBatch_AddMessage(batch, msg))
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(MessageBatch_IsFlushDue(batch))
+		.SetReturn(true);
+	STRICT_EXPECTED_CALL(MessageBatch_ToByteArray(batch, NULL, 0))
+		.SetReturn(default_serialized_size);
+	STRICT_EXPECTED_CALL(nn_allocmsg(default_serialized_size, 0));
+	STRICT_EXPECTED_CALL(MessageBatch_ToByteArray(batch, IGNORED_PTR_ARG, default_serialized_size))
+		.IgnoreArgument(2)
+		.SetReturn(default_serialized_size);
+	STRICT_EXPECTED_CALL(nn_send(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(MessageBatch_Clear(batch));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+	STRICT_EXPECTED_CALL(MessageBatch_Destroy(batch));
+
+	// act
+	thread_func_to_call[3](thread_func_args[3]);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_110: [ When batching a traced message, this function shall stamp its send hop and append its trace trailer to the batch entry. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_111: [ When asked to stop, this thread shall send any pending batch on the message channel, without waiting for the remote, before exiting. ]*/
+TEST_FUNCTION(Outprocess_outgoing_thread_batches_traced_message_and_flushes_on_stop)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.message_batch_size = 4096;
+	config.message_batch_delay_ms = 5;
+	config.message_trace = true;
+
+	STRICT_EXPECTED_CALL(MessageTrace_CreateHistogram())
+		.SetReturn((MESSAGE_TRACE_HISTOGRAM_HANDLE)0x44);
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	MESSAGE_HANDLE msg = Message_Create((const MESSAGE_CONFIG*)(0x42));
+	Module_Receive(module, msg);
+	MESSAGE_BATCH_HANDLE batch = (MESSAGE_BATCH_HANDLE)0x50;
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(MessageBatch_Create(4096, 5))
+		.SetReturn(batch);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_is_empty(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(MESSAGE_QUEUE_pop(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(msg);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageTrace_Now());
+	STRICT_EXPECTED_CALL(MessageBatch_AddTracedMessage(batch, msg, IGNORED_PTR_ARG))
+		.IgnoreArgument(3)
+		.SetReturn(0);
+	STRICT_EXPECTED_CALL(Message_Destroy(msg));
+	STRICT_EXPECTED_CALL(MessageBatch_IsFlushDue(batch))
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+	// the batch still holds the message when the thread stops
+	STRICT_EXPECTED_CALL(MessageBatch_ToByteArray(batch, NULL, 0))
+		.SetReturn(default_serialized_size);
+	STRICT_EXPECTED_CALL(nn_allocmsg(default_serialized_size, 0));
+	STRICT_EXPECTED_CALL(MessageBatch_ToByteArray(batch, IGNORED_PTR_ARG, default_serialized_size))
+		.IgnoreArgument(2)
+		.SetReturn(default_serialized_size);
+	STRICT_EXPECTED_CALL(nn_send(1, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(MessageBatch_Clear(batch));
+	STRICT_EXPECTED_CALL(MessageBatch_Destroy(batch));
+
+	// act
+	thread_func_to_call[3](thread_func_args[3]);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Message_Destroy(msg);
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_053: [ This thread shall ensure thread safety on the module data. ]*/
 TEST_FUNCTION(Outprocess_outgoing_thread_nn_send_1st_unlock_fails)
 {
@@ -3277,7 +4177,58 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_lock_fails)
 }
 
 /*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
-TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock_fails)
+TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock_fails)
+{
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+
+	int function_result = (*thread_func_to_call[2])(thread_func_args[2]);
+
+	// assert
+	ASSERT_ARE_EQUAL(int, function_result, 0);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
+TEST_FUNCTION(Outprocess_incoming_thread_ends_lock2_fails)
+{
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+
+	int function_result = (*thread_func_to_call[2])(thread_func_args[2]);
+
+	// assert
+	ASSERT_ARE_EQUAL(int, function_result, 0);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	// ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
+TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock2_fails)
 {
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
@@ -3287,6 +4238,8 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock_fails)
 
 	umock_c_reset_all_calls();
 
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
 
@@ -3301,8 +4254,8 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock_fails)
 	cleanup_create_config(&config);
 }
 
-/*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
-TEST_FUNCTION(Outprocess_incoming_thread_ends_lock2_fails)
+/*Tests_SRS_OUTPROCESS_MODULE_17_038: [ This function shall read from the message channel for gateway messages from the module host. ]*/
+TEST_FUNCTION(Outprocess_incoming_thread_ends_nn_recv_fails)
 {
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
@@ -3314,7 +4267,12 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_lock2_fails)
 
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	should_nn_recv_fail = true;
+	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno()).SetReturn(37);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
 
 	int function_result = (*thread_func_to_call[2])(thread_func_args[2]);
 
@@ -3328,7 +4286,11 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_lock2_fails)
 }
 
 /*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
-TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock2_fails)
+/*Tests_SRS_OUTPROCESS_MODULE_17_037: [ This function shall receive the module handle data as the thread parameter. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_038: [ This function shall read from the message channel for gateway messages from the module host. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_039: [ Upon successful receiving a gateway message, this function shall deserialize the message. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_040: [This function shall publish any successfully created gateway message to the broker.]*/
+TEST_FUNCTION(Outprocess_messaging_thread_ends_one_loop_then_fails)
 {
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
@@ -3341,7 +4303,18 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock2_fails)
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(MessageBatch_IsBatch(IGNORED_PTR_ARG, 8)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(Broker_Publish(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
 
 	int function_result = (*thread_func_to_call[2])(thread_func_args[2]);
 
@@ -3354,8 +4327,8 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_unlock2_fails)
 	cleanup_create_config(&config);
 }
 
-/*Tests_SRS_OUTPROCESS_MODULE_17_038: [ This function shall read from the message channel for gateway messages from the module host. ]*/
-TEST_FUNCTION(Outprocess_incoming_thread_ends_nn_recv_fails)
+/*Tests_SRS_OUTPROCESS_MODULE_17_065: [ If the received frame is a message batch, this function shall deserialize and publish every message in the batch, in order. ]*/
+TEST_FUNCTION(Outprocess_messaging_thread_unpacks_batch)
 {
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
@@ -3369,10 +4342,14 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_nn_recv_fails)
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
-	should_nn_recv_fail = true;
 	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(nn_errno()).SetReturn(37);
+	STRICT_EXPECTED_CALL(MessageBatch_IsBatch(IGNORED_PTR_ARG, 8)).IgnoreArgument(1)
+		.SetReturn(true);
+	STRICT_EXPECTED_CALL(MessageBatch_ForEach(IGNORED_PTR_ARG, 8, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreArgument(1).IgnoreArgument(3).IgnoreArgument(4);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
 
 	int function_result = (*thread_func_to_call[2])(thread_func_args[2]);
 
@@ -3385,16 +4362,15 @@ TEST_FUNCTION(Outprocess_incoming_thread_ends_nn_recv_fails)
 	cleanup_create_config(&config);
 }
 
-/*Tests_SRS_OUTPROCESS_MODULE_17_036: [ This function shall ensure thread safety on execution. ]*/
-/*Tests_SRS_OUTPROCESS_MODULE_17_037: [ This function shall receive the module handle data as the thread parameter. ]*/
-/*Tests_SRS_OUTPROCESS_MODULE_17_038: [ This function shall read from the message channel for gateway messages from the module host. ]*/
-/*Tests_SRS_OUTPROCESS_MODULE_17_039: [ Upon successful receiving a gateway message, this function shall deserialize the message. ]*/
-/*Tests_SRS_OUTPROCESS_MODULE_17_040: [This function shall publish any successfully created gateway message to the broker.]*/
-TEST_FUNCTION(Outprocess_messaging_thread_ends_one_loop_then_fails)
+/*Tests_SRS_OUTPROCESS_MODULE_17_093: [ If message tracing is enabled and the received frame is a trace report, this function shall stamp the report hop and record the trace in the latency histograms. ]*/
+TEST_FUNCTION(Outprocess_messaging_thread_records_trace_report)
 {
 	OUTPROCESS_MODULE_CONFIG config;
 	setup_create_config(&config);
+	config.message_trace = true;
 
+	STRICT_EXPECTED_CALL(MessageTrace_CreateHistogram())
+		.SetReturn((MESSAGE_TRACE_HISTOGRAM_HANDLE)0x44);
 	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
 	Module_Start(module);
 
@@ -3405,11 +4381,13 @@ TEST_FUNCTION(Outprocess_messaging_thread_ends_one_loop_then_fails)
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
-	STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
-		.IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(Broker_Publish(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
-		.IgnoreAllArguments();
-	STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageTrace_IsReport(IGNORED_PTR_ARG, 8)).IgnoreArgument(1)
+		.SetReturn(true);
+	STRICT_EXPECTED_CALL(MessageTrace_FromReport(IGNORED_PTR_ARG, 8, IGNORED_PTR_ARG))
+		.IgnoreArgument(1).IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageTrace_Record((MESSAGE_TRACE_HISTOGRAM_HANDLE)0x44, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
 	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1));
 	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1).SetReturn(LOCK_ERROR);
@@ -3488,6 +4466,52 @@ TEST_FUNCTION(Outprocess_control_thread_success)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_066: [ If a Module Credit message has been received, this thread shall add its message and byte credits to the credits available for sending gateway messages. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_067: [ A window shall be enforced from the first Module Credit message that grants a non-zero value for it. ]*/
+TEST_FUNCTION(Outprocess_control_thread_grants_credit)
+{
+	// arrange
+	CONTROL_MESSAGE_MODULE_CREDIT credit =
+	{
+		{ CONTROL_MESSAGE_VERSION_CURRENT,  CONTROL_MESSAGE_TYPE_MODULE_CREDIT },
+		16,
+		4096
+	};
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	Module_Start(module);
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray(IGNORED_PTR_ARG, IGNORED_NUM_ARG))
+		.IgnoreAllArguments()
+		.SetReturn((CONTROL_MESSAGE*)&credit);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ThreadAPI_Sleep(250));
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1)
+		.SetReturn(LOCK_ERROR);
+
+	// act
+	//fourth thread created is control message thread
+	thread_func_to_call[4](thread_func_args[4]);
+
+	// assert 
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
 /*Tests_SRS_OUTPROCESS_MODULE_17_058 : [If a message has been received, it shall look for a Module Reply message.]*/
 /*Tests_SRS_OUTPROCESS_MODULE_17_059 : [If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process.]*/
 /*Tests_SRS_OUTPROCESS_MODULE_17_060 : [Once the control channel has been restarted, it shall follow the same process in Outprocess_Create to send a Create Message to the module host.]*/
@@ -3787,4 +4811,236 @@ TEST_FUNCTION(OutProcess_async_thread_1st_lock_fails)
 	cleanup_create_config(&config);
 }
 
+/*Tests_SRS_OUTPROCESS_MODULE_17_095: [ If multiplex is true, this function shall share one control and one message channel with every other multiplexed module connecting to the same control_uri, creating them on first use. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_096: [ This function shall give a multiplexed module an id unique on its shared connection. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_103: [ If the module is multiplexed, this function shall leave the shared connection, and close it once no module uses it. ]*/
+TEST_FUNCTION(Outprocess_Create_multiplexed_modules_share_connection)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	// act
+	MODULE_HANDLE module1 = Module_Create((BROKER_HANDLE)0x42, &config);
+	MODULE_HANDLE module2 = Module_Create((BROKER_HANDLE)0x42, &config);
+	umock_c_reset_all_calls();
+	Module_Destroy(module1);
+
+	// assert
+	ASSERT_IS_NOT_NULL(module1);
+	ASSERT_IS_NOT_NULL(module2);
+	// one message socket and one control socket for both modules
+	ASSERT_ARE_EQUAL(int, 2, current_nn_socket_index);
+	ASSERT_IS_NULL(strstr(umock_c_get_actual_calls(), "nn_close"));
+
+	umock_c_reset_all_calls();
+	Module_Destroy(module2);
+	ASSERT_IS_NOT_NULL(strstr(umock_c_get_actual_calls(), "nn_close"));
+
+	//ablution
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_108: [ The lock guarding the shared connections shall be freed when the last shared connection is released. ]*/
+TEST_FUNCTION(Outprocess_Destroy_last_multiplexed_module_frees_shared_connections_lock)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module);
+	Module_Destroy(module);
+	umock_c_reset_all_calls();
+
+	// the lock is only created again if it has been freed
+	STRICT_EXPECTED_CALL(Lock_Init());
+
+	// act
+	Outprocess_InitializeSharedConnections();
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_109: [ If the lock guarding the shared connections has been freed, this function shall create it again. ]*/
+TEST_FUNCTION(Outprocess_Create_multiplexed_after_last_connection_released_succeeds)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	MODULE_HANDLE module1 = Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module1);
+	Module_Destroy(module1);
+
+	// act
+	MODULE_HANDLE module2 = Module_Create((BROKER_HANDLE)0x42, &config);
+
+	// assert
+	ASSERT_IS_NOT_NULL(module2);
+
+	//ablution
+	Module_Destroy(module2);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_105: [ Outprocess_InitializeSharedConnections shall create the lock guarding the shared connections, unless it exists. ]*/
+TEST_FUNCTION(Outprocess_InitializeSharedConnections_keeps_existing_lock)
+{
+	// arrange
+	Outprocess_InitializeSharedConnections();
+	umock_c_reset_all_calls();
+
+	// act
+	Outprocess_InitializeSharedConnections();
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_098: [ A shared connection shall run a single thread receiving from both channels and routing each frame to the module named by its mux header. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_099: [ A failed Module Reply without a mux header shall be routed to every module on the shared connection. ]*/
+TEST_FUNCTION(Outprocess_multiplexed_connection_routes_failed_reply_to_every_module)
+{
+	// arrange
+	global_control_msg.base.type = CONTROL_MESSAGE_TYPE_MODULE_REPLY;
+	global_control_msg.base.version = CONTROL_MESSAGE_VERSION_CURRENT;
+	((CONTROL_MESSAGE_MODULE_REPLY*)&global_control_msg)->status = 1;
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	MODULE_HANDLE module1 = Module_Create((BROKER_HANDLE)0x42, &config);
+	MODULE_HANDLE module2 = Module_Create((BROKER_HANDLE)0x42, &config);
+	umock_c_reset_all_calls();
+	when_shall_nn_recv_fail = current_nn_recv_index + 2;
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray(IGNORED_PTR_ARG, 8))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ControlMessage_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno());
+
+	// act
+	//first thread created is the shared connection thread
+	thread_func_to_call[1](thread_func_args[1]);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Module_Destroy(module1);
+	Module_Destroy(module2);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_098: [ A shared connection shall run a single thread receiving from both channels and routing each frame to the module named by its mux header. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_107: [ A shared connection shall publish the messages it receives after releasing the connection lock. ]*/
+TEST_FUNCTION(Outprocess_multiplexed_connection_publishes_after_unlocking)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	ASSERT_IS_NOT_NULL(module);
+
+	// a message for the first module on the connection
+	unsigned char frame[MESSAGE_MUX_HEADER_SIZE + 8];
+	ASSERT_ARE_EQUAL(int, MESSAGE_MUX_HEADER_SIZE, (int)MessageMux_WriteHeader(1, frame, (int32_t)sizeof(frame)));
+	memcpy(frame + MESSAGE_MUX_HEADER_SIZE, "nn_recv", 8);
+	nn_recv_frame = frame;
+	nn_recv_frame_size = sizeof(frame);
+	umock_c_reset_all_calls();
+	when_shall_nn_recv_fail = current_nn_recv_index + 1;
+
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_recv(2, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_errno());
+	STRICT_EXPECTED_CALL(nn_recv(1, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT)).IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(Lock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Unlock(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(MessageBatch_IsBatch(IGNORED_PTR_ARG, 8)).IgnoreArgument(1)
+		.SetReturn(false);
+	STRICT_EXPECTED_CALL(Message_CreateFromByteArray(IGNORED_PTR_ARG, 8))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(Broker_Publish((BROKER_HANDLE)0x42, module, IGNORED_PTR_ARG))
+		.IgnoreArgument(3);
+	STRICT_EXPECTED_CALL(Message_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+	// act
+	//first thread created is the shared connection thread
+	thread_func_to_call[1](thread_func_args[1]);
+
+	// assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	//ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
+/*Tests_SRS_OUTPROCESS_MODULE_17_097: [ If the module is multiplexed, every frame it sends shall start with a mux header carrying its module id. ]*/
+/*Tests_SRS_OUTPROCESS_MODULE_17_100: [ If the module is multiplexed, this function shall not create a thread to receive messages, the shared connection receives them. ]*/
+TEST_FUNCTION(Outprocess_Start_multiplexed_tags_start_message)
+{
+	// arrange
+	OUTPROCESS_MODULE_CONFIG config;
+	setup_create_config(&config);
+	config.lifecycle_model = OUTPROCESS_LIFECYCLE_ASYNC;
+	config.multiplex = true;
+
+	MODULE_HANDLE module = Module_Create((BROKER_HANDLE)0x42, &config);
+	umock_c_reset_all_calls();
+
+	STRICT_EXPECTED_CALL(ThreadAPI_Join(IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+		.IgnoreAllArguments();
+	STRICT_EXPECTED_CALL(ControlMessage_ToByteArray(IGNORED_PTR_ARG, NULL, 0))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(nn_allocmsg(default_serialized_size + MESSAGE_MUX_HEADER_SIZE, 0));
+	STRICT_EXPECTED_CALL(ControlMessage_ToByteArray(IGNORED_PTR_ARG, IGNORED_PTR_ARG, default_serialized_size))
+		.IgnoreArgument(1)
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(nn_send(2, IGNORED_PTR_ARG, NN_MSG, 0)).IgnoreArgument(2);
+
+	///act
+	Module_Start(module);
+
+	///assert
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///ablution
+	Module_Destroy(module);
+	cleanup_create_config(&config);
+}
+
 END_TEST_SUITE(OutprocessModule_UnitTests);
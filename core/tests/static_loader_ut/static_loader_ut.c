@@ -0,0 +1,438 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+void* my_gballoc_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#include "real_strings.h"
+
+#define ENABLE_MOCKS
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/gballoc.h"
+
+#include "parson.h"
+#include "module_loader.h"
+
+#undef ENABLE_MOCKS
+
+#include "module_loaders/static_loader.h"
+
+static pfModuleLoader_Load StaticModuleLoader_Load = NULL;
+static pfModuleLoader_Unload StaticModuleLoader_Unload = NULL;
+static pfModuleLoader_GetApi StaticModuleLoader_GetModuleApi = NULL;
+static pfModuleLoader_ParseEntrypointFromJson StaticModuleLoader_ParseEntrypointFromJson = NULL;
+static pfModuleLoader_FreeEntrypoint StaticModuleLoader_FreeEntrypoint = NULL;
+static pfModuleLoader_ParseConfigurationFromJson StaticModuleLoader_ParseConfigurationFromJson = NULL;
+static pfModuleLoader_FreeConfiguration StaticModuleLoader_FreeConfiguration = NULL;
+static pfModuleLoader_BuildModuleConfiguration StaticModuleLoader_BuildModuleConfiguration = NULL;
+static pfModuleLoader_FreeModuleConfiguration StaticModuleLoader_FreeModuleConfiguration = NULL;
+
+MOCKABLE_FUNCTION(, JSON_Object*, json_value_get_object, const JSON_Value*, value);
+MOCKABLE_FUNCTION(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name);
+MOCKABLE_FUNCTION(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value);
+
+//=============================================================================
+//Globals
+//=============================================================================
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+static MODULE_API_1 g_valid_api =
+{
+    {
+        MODULE_API_VERSION_1
+    },
+    NULL,
+    NULL,
+    (pfModule_Create)0x42,
+    (pfModule_Destroy)0x42,
+    (pfModule_Receive)0x42,
+    NULL
+};
+
+static MODULE_API_1 g_invalid_api =
+{
+    {
+        MODULE_API_VERSION_1
+    },
+    NULL,
+    NULL,
+    (pfModule_Create)0x42,
+    (pfModule_Destroy)0x42,
+    NULL,
+    NULL
+};
+
+static const MODULE_API* Module_GetApi_FAKE_MODULE(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&g_valid_api;
+}
+
+static const MODULE_API* Module_GetApi_BROKEN_MODULE(MODULE_API_VERSION gateway_api_version)
+{
+    (void)gateway_api_version;
+    return (const MODULE_API*)&g_invalid_api;
+}
+
+static const STATIC_LOADER_MODULE g_linked_modules[] =
+{
+    STATIC_LOADER_MODULE_ENTRY(FAKE_MODULE),
+    STATIC_LOADER_MODULE_ENTRY(BROKEN_MODULE)
+};
+
+//parson mocks
+MOCK_FUNCTION_WITH_CODE(, JSON_Object*, json_value_get_object, const JSON_Value*, value)
+    JSON_Object* obj = NULL;
+    if (value != NULL)
+    {
+        obj = (JSON_Object*)0x42;
+    }
+MOCK_FUNCTION_END(obj)
+
+MOCK_FUNCTION_WITH_CODE(, const char*, json_object_get_string, const JSON_Object*, object, const char*, name)
+    const char* str = NULL;
+    if (object != NULL && name != NULL)
+    {
+        str = "FAKE_MODULE";
+    }
+MOCK_FUNCTION_END(str)
+
+MOCK_FUNCTION_WITH_CODE(, JSON_Value_Type, json_value_get_type, const JSON_Value*, value)
+    JSON_Value_Type val = JSONError;
+    if (value != NULL)
+    {
+        val = JSONObject;
+    }
+MOCK_FUNCTION_END(val)
+
+#undef ENABLE_MOCKS
+
+TEST_DEFINE_ENUM_TYPE(MODULE_LOADER_TYPE, MODULE_LOADER_TYPE_VALUES);
+
+BEGIN_TEST_SUITE(StaticLoader_UnitTests)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+
+    REGISTER_UMOCK_ALIAS_TYPE(MODULE_LOADER_TYPE, int);
+    REGISTER_UMOCK_ALIAS_TYPE(STRING_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(JSON_Value_Type, int);
+
+    // malloc/free hooks
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+
+    // Strings hooks
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_construct, real_STRING_construct);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_delete, real_STRING_delete);
+    REGISTER_GLOBAL_MOCK_HOOK(STRING_c_str, real_STRING_c_str);
+
+    const MODULE_LOADER* loader = StaticLoader_Get();
+    StaticModuleLoader_Load = loader->api->Load;
+    StaticModuleLoader_Unload = loader->api->Unload;
+    StaticModuleLoader_GetModuleApi = loader->api->GetApi;
+    StaticModuleLoader_ParseEntrypointFromJson = loader->api->ParseEntrypointFromJson;
+    StaticModuleLoader_FreeEntrypoint = loader->api->FreeEntrypoint;
+    StaticModuleLoader_ParseConfigurationFromJson = loader->api->ParseConfigurationFromJson;
+    StaticModuleLoader_FreeConfiguration = loader->api->FreeConfiguration;
+    StaticModuleLoader_BuildModuleConfiguration = loader->api->BuildModuleConfiguration;
+    StaticModuleLoader_FreeModuleConfiguration = loader->api->FreeModuleConfiguration;
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    StaticLoader_SetModules(g_linked_modules, sizeof(g_linked_modules) / sizeof(g_linked_modules[0]));
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_002: [ StaticModuleLoader_Load shall return NULL if loader or entrypoint is NULL. ]
+TEST_FUNCTION(StaticModuleLoader_Load_returns_NULL_when_loader_or_entrypoint_is_NULL)
+{
+    // act
+    MODULE_LIBRARY_HANDLE no_loader = StaticModuleLoader_Load(NULL, (void*)0x42);
+    MODULE_LIBRARY_HANDLE no_entrypoint = StaticModuleLoader_Load(StaticLoader_Get(), NULL);
+
+    // assert
+    ASSERT_IS_NULL(no_loader);
+    ASSERT_IS_NULL(no_entrypoint);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_003: [ StaticModuleLoader_Load shall return NULL if loader->type is not NATIVE_STATIC. ]
+TEST_FUNCTION(StaticModuleLoader_Load_returns_NULL_when_loader_type_is_not_NATIVE_STATIC)
+{
+    // arrange
+    MODULE_LOADER loader =
+    {
+        NATIVE,
+        NULL, NULL, NULL
+    };
+
+    // act
+    MODULE_LIBRARY_HANDLE result = StaticModuleLoader_Load(&loader, (void*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_004: [ StaticModuleLoader_Load shall return NULL if entrypoint->moduleName is NULL. ]
+TEST_FUNCTION(StaticModuleLoader_Load_returns_NULL_when_moduleName_is_NULL)
+{
+    // arrange
+    STATIC_LOADER_ENTRYPOINT entrypoint = { NULL };
+
+    // act
+    MODULE_LIBRARY_HANDLE result = StaticModuleLoader_Load(StaticLoader_Get(), &entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_005: [ StaticModuleLoader_Load shall find the module named by entrypoint->moduleName in the table of modules. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_007: [ StaticModuleLoader_Load shall call the module's get_api function to acquire the module API table. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_009: [ StaticModuleLoader_Load shall return the module's entry in the table as its MODULE_LIBRARY_HANDLE when successful. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_011: [ StaticModuleLoader_GetModuleApi shall return the API table of the module. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_012: [ StaticModuleLoader_Unload shall do nothing. ]
+TEST_FUNCTION(StaticModuleLoader_Load_succeeds)
+{
+    // arrange
+    STATIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("FAKE_MODULE") };
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(STRING_c_str(entrypoint.moduleName));
+
+    // act
+    MODULE_LIBRARY_HANDLE result = StaticModuleLoader_Load(StaticLoader_Get(), &entrypoint);
+    const MODULE_API* api = StaticModuleLoader_GetModuleApi(StaticLoader_Get(), result);
+    StaticModuleLoader_Unload(StaticLoader_Get(), result);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, (void*)&(g_linked_modules[0]), result);
+    ASSERT_ARE_EQUAL(void_ptr, (void*)&g_valid_api, (void*)api);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // cleanup
+    STRING_delete(entrypoint.moduleName);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_006: [ StaticModuleLoader_Load shall return NULL if the module is not in the table. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_001: [ StaticLoader_SetModules shall replace the table of modules the loader loads from. ]
+TEST_FUNCTION(StaticModuleLoader_Load_returns_NULL_when_module_is_not_linked)
+{
+    // arrange
+    STATIC_LOADER_ENTRYPOINT missing = { STRING_construct("MISSING_MODULE") };
+    STATIC_LOADER_ENTRYPOINT fake = { STRING_construct("FAKE_MODULE") };
+
+    // act
+    MODULE_LIBRARY_HANDLE missing_result = StaticModuleLoader_Load(StaticLoader_Get(), &missing);
+    StaticLoader_SetModules(NULL, 0);
+    MODULE_LIBRARY_HANDLE fake_result = StaticModuleLoader_Load(StaticLoader_Get(), &fake);
+
+    // assert
+    ASSERT_IS_NULL(missing_result);
+    ASSERT_IS_NULL(fake_result);
+
+    // cleanup
+    STRING_delete(missing.moduleName);
+    STRING_delete(fake.moduleName);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_008: [ StaticModuleLoader_Load shall return NULL if the MODULE_API is NULL, its version is greater than Module_ApiGatewayVersion, or its Module_Create, Module_Destroy or Module_Receive function is NULL. ]
+TEST_FUNCTION(StaticModuleLoader_Load_returns_NULL_when_API_is_invalid)
+{
+    // arrange
+    STATIC_LOADER_ENTRYPOINT entrypoint = { STRING_construct("BROKEN_MODULE") };
+
+    // act
+    MODULE_LIBRARY_HANDLE result = StaticModuleLoader_Load(StaticLoader_Get(), &entrypoint);
+
+    // assert
+    ASSERT_IS_NULL(result);
+
+    // cleanup
+    STRING_delete(entrypoint.moduleName);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_010: [ StaticModuleLoader_GetModuleApi shall return NULL if moduleLibraryHandle is NULL. ]
+TEST_FUNCTION(StaticModuleLoader_GetModuleApi_returns_NULL_when_moduleLibraryHandle_is_NULL)
+{
+    // act
+    const MODULE_API* result = StaticModuleLoader_GetModuleApi(NULL, NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_013: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if json is NULL or is not an object. ]
+TEST_FUNCTION(StaticModuleLoader_ParseEntrypointFromJson_returns_NULL_when_json_is_not_an_object)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42))
+        .SetReturn(JSONArray);
+
+    // act
+    void* no_json = StaticModuleLoader_ParseEntrypointFromJson(NULL, NULL);
+    void* result = StaticModuleLoader_ParseEntrypointFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(no_json);
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_014: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if module.name does not exist. ]
+TEST_FUNCTION(StaticModuleLoader_ParseEntrypointFromJson_returns_NULL_when_module_name_is_missing)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"))
+        .SetReturn(NULL);
+
+    // act
+    void* result = StaticModuleLoader_ParseEntrypointFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_015: [ StaticModuleLoader_ParseEntrypointFromJson shall return NULL if an underlying platform call fails. ]
+TEST_FUNCTION(StaticModuleLoader_ParseEntrypointFromJson_returns_NULL_when_malloc_fails)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(STATIC_LOADER_ENTRYPOINT)))
+        .SetReturn(NULL);
+
+    // act
+    void* result = StaticModuleLoader_ParseEntrypointFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_016: [ StaticModuleLoader_ParseEntrypointFromJson shall return a STATIC_LOADER_ENTRYPOINT holding the value of module.name. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_017: [ StaticModuleLoader_FreeEntrypoint shall free resources allocated during StaticModuleLoader_ParseEntrypointFromJson. ]
+TEST_FUNCTION(StaticModuleLoader_ParseEntrypointFromJson_succeeds)
+{
+    // arrange
+    STRICT_EXPECTED_CALL(json_value_get_type((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_value_get_object((const JSON_Value*)0x42));
+    STRICT_EXPECTED_CALL(json_object_get_string((const JSON_Object*)0x42, "module.name"));
+    STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(STATIC_LOADER_ENTRYPOINT)));
+    STRICT_EXPECTED_CALL(STRING_construct("FAKE_MODULE"));
+    STRICT_EXPECTED_CALL(STRING_delete(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    // act
+    STATIC_LOADER_ENTRYPOINT* result = (STATIC_LOADER_ENTRYPOINT*)StaticModuleLoader_ParseEntrypointFromJson(NULL, (const JSON_Value*)0x42);
+
+    // assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, "FAKE_MODULE", real_STRING_c_str(result->moduleName));
+
+    // cleanup
+    StaticModuleLoader_FreeEntrypoint(NULL, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_018: [ StaticModuleLoader_ParseConfigurationFromJson shall return NULL. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_019: [ StaticModuleLoader_FreeConfiguration shall do nothing. ]
+TEST_FUNCTION(StaticModuleLoader_has_no_configuration)
+{
+    // act
+    MODULE_LOADER_BASE_CONFIGURATION* result = StaticModuleLoader_ParseConfigurationFromJson(NULL, (const JSON_Value*)0x42);
+    StaticModuleLoader_FreeConfiguration(NULL, NULL);
+
+    // assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_020: [ StaticModuleLoader_BuildModuleConfiguration shall return module_configuration. ]
+//Tests_SRS_STATIC_MODULE_LOADER_17_021: [ StaticModuleLoader_FreeModuleConfiguration shall do nothing. ]
+TEST_FUNCTION(StaticModuleLoader_BuildModuleConfiguration_returns_module_configuration)
+{
+    // act
+    void* result = StaticModuleLoader_BuildModuleConfiguration(NULL, NULL, (void*)0x42);
+    StaticModuleLoader_FreeModuleConfiguration(NULL, result);
+
+    // assert
+    ASSERT_ARE_EQUAL(void_ptr, result, (void*)0x42);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+//Tests_SRS_STATIC_MODULE_LOADER_17_022: [ StaticLoader_Get shall return a pointer to a MODULE_LOADER of type NATIVE_STATIC named static. ]
+TEST_FUNCTION(StaticLoader_Get_succeeds)
+{
+    // act
+    const MODULE_LOADER* loader = StaticLoader_Get();
+
+    // assert
+    ASSERT_IS_NOT_NULL(loader);
+    ASSERT_ARE_EQUAL(MODULE_LOADER_TYPE, loader->type, NATIVE_STATIC);
+    ASSERT_IS_TRUE(strcmp(loader->name, "static") == 0);
+}
+
+END_TEST_SUITE(StaticLoader_UnitTests);
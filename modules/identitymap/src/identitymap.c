@@ -408,6 +408,68 @@ static MODULE_HANDLE IdentityMap_Create(BROKER_HANDLE broker, const void* config
     return result;
 }
 
+/*
+* @brief    Build the configuration vector from the parsed JSON array.
+*/
+static VECTOR_HANDLE IdentityMap_ParseConfigurationFromValue(const JSON_Value* json)
+{
+    VECTOR_HANDLE result;
+    /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
+    JSON_Array *jsonArray = json_value_get_array(json);
+    if (jsonArray == NULL)
+    {
+        /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+        LogError("Expected a JSON Array in configuration");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration vector. ]*/
+        /*Codes_SRS_IDMAP_05_007: [ IdentityMap_ParseConfigurationFromJson shall call VECTOR_create to make the identity map module input vector. ]*/
+        result = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
+        if (result == NULL)
+        {
+            //Codes_SRS_IDMAP_17_061: [ If allocation fails, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
+            /*Codes_SRS_IDMAP_05_019: [ If creating the vector fails, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+            LogError("Failed to create the input vector");
+            result = NULL;
+        }
+        else
+        {
+            size_t numberOfRecords = json_array_get_count(jsonArray);
+            size_t record;
+            bool arrayParsed = true;
+            /*Codes_SRS_IDMAP_05_008: [ IdentityMap_ParseConfigurationFromJson shall walk through each object of the array. ]*/
+            for (record = 0; record < numberOfRecords; record++)
+            {
+                /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
+                if (addOneRecord(result, json_array_get_object(jsonArray, record)) != true)
+                {
+                    arrayParsed = false;
+                    break;
+                }
+            }
+            if (arrayParsed != true)
+            {
+                numberOfRecords = VECTOR_size(result);
+                for (record = 0; record < numberOfRecords; record++)
+                {
+                    IDENTITY_MAP_CONFIG *element = (IDENTITY_MAP_CONFIG *)VECTOR_element(result, record);
+                    IdentityMapConfig_Free(element);
+                }
+                VECTOR_destroy(result);
+                /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
+                result = NULL;
+            }
+            else
+            {
+                /*Codes_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration vector on success. ]*/
+            }
+        }
+    }
+    return result;
+}
+
 /*
 * @brief    Parse configuration for identity map module.
 */
@@ -432,61 +494,29 @@ static void * IdentityMap_ParseConfigurationFromJson(const char* configuration)
         }
         else
         {
-            /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
-            JSON_Array *jsonArray = json_value_get_array(json);
-            if (jsonArray == NULL)
-            {
-                /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                LogError("Expected a JSON Array in configuration");
-                result = NULL;
-            }
-            else
-            {
-				/*Codes_SRS_IDMAP_17_060: [ IdentityMap_ParseConfigurationFromJson shall allocate memory for the configuration vector. ]*/
-				/*Codes_SRS_IDMAP_05_007: [ IdentityMap_ParseConfigurationFromJson shall call VECTOR_create to make the identity map module input vector. ]*/
-                result = VECTOR_create(sizeof(IDENTITY_MAP_CONFIG));
-                if (result == NULL)
-                {
-                    //Codes_SRS_IDMAP_17_061: [ If allocation fails, IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
-                    /*Codes_SRS_IDMAP_05_019: [ If creating the vector fails, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                    LogError("Failed to create the input vector");
-                    result = NULL;
-                }
-                else
-                {
-                    size_t numberOfRecords = json_array_get_count(jsonArray);
-                    size_t record;
-                    bool arrayParsed = true;
-                    /*Codes_SRS_IDMAP_05_008: [ IdentityMap_ParseConfigurationFromJson shall walk through each object of the array. ]*/
-                    for (record = 0; record < numberOfRecords; record++)
-                    {
-                        /*Codes_SRS_IDMAP_05_006: [ IdentityMap_ParseConfigurationFromJson shall parse the configuration as a JSON array of objects. ]*/
-                        if (addOneRecord(result, json_array_get_object(jsonArray, record)) != true)
-                        {
-                            arrayParsed = false;
-                            break;
-                        }
-                    }
-                    if (arrayParsed != true)
-                    {
-                        numberOfRecords = VECTOR_size(result);
-                        for (record = 0; record < numberOfRecords; record++)
-                        {
-                            IDENTITY_MAP_CONFIG *element = (IDENTITY_MAP_CONFIG *)VECTOR_element(result, record);
-                            IdentityMapConfig_Free(element);
-                        }
-                        VECTOR_destroy(result);
-                        /*Codes_SRS_IDMAP_05_005: [ If configuration is not a JSON array of JSON objects, then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]*/
-                        result = NULL;
-                    }
-                    else
-                    {
-                        /*Codes_SRS_IDMAP_17_062: [ IdentityMap_ParseConfigurationFromJson shall return the pointer to the configuration vector on success. ]*/
-                    }
-                }
-            }
-			json_value_free(json);
-		}
+            result = IdentityMap_ParseConfigurationFromValue(json);
+            json_value_free(json);
+        }
+    }
+    return result;
+}
+
+/*
+* @brief    Parse configuration for identity map module from the JSON value the gateway parsed.
+*/
+static void * IdentityMap_ParseConfigurationFromJsonValue(const JSON_Value* configuration)
+{
+    VECTOR_HANDLE result;
+    if (configuration == NULL)
+    {
+        /*Codes_SRS_IDMAP_17_063: [ If configuration is NULL then IdentityMap_ParseConfigurationFromJsonValue shall fail and return NULL. ]*/
+        LogError("Invalid NULL configuration parameter");
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_IDMAP_17_064: [ IdentityMap_ParseConfigurationFromJsonValue shall build the configuration vector as IdentityMap_ParseConfigurationFromJson does, without parsing or freeing configuration. ]*/
+        result = IdentityMap_ParseConfigurationFromValue(configuration);
     }
     return result;
 }
@@ -825,6 +855,21 @@ static const MODULE_API_1 IdentityMap_APIS_all =
     NULL
 };
 
+static const MODULE_API_2 IdentityMap_APIS_2 =
+{
+    {
+        {MODULE_API_VERSION_2},
+
+        IdentityMap_ParseConfigurationFromJson,
+        IdentityMap_FreeConfiguration,
+        IdentityMap_Create,
+        IdentityMap_Destroy,
+        IdentityMap_Receive,
+        NULL
+    },
+    IdentityMap_ParseConfigurationFromJsonValue
+};
+
 /*Codes_SRS_IDMAP_26_001: [ `Module_GetApi` shall return a pointer to `MODULE_API` structure. ]*/
 #ifdef BUILD_MODULE_TYPE_STATIC
 MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(IDENTITYMAP_MODULE)(MODULE_API_VERSION gateway_api_version)
@@ -832,6 +877,15 @@ MODULE_EXPORT const MODULE_API* MODULE_STATIC_GETAPI(IDENTITYMAP_MODULE)(MODULE_
 MODULE_EXPORT const MODULE_API* Module_GetApi(MODULE_API_VERSION gateway_api_version)
 #endif
 {
-    (void)gateway_api_version;
-    return (const MODULE_API *)&IdentityMap_APIS_all;
+    const MODULE_API* result;
+    if (gateway_api_version >= MODULE_API_VERSION_2)
+    {
+        /*Codes_SRS_IDMAP_17_065: [ Module_GetApi shall return a MODULE_API_2 structure when gateway_api_version is MODULE_API_VERSION_2 or greater. ]*/
+        result = (const MODULE_API *)&IdentityMap_APIS_2;
+    }
+    else
+    {
+        result = (const MODULE_API *)&IdentityMap_APIS_all;
+    }
+    return result;
 }
@@ -651,6 +651,82 @@ BEGIN_TEST_SUITE(idmap_ut)
         ///Ablution
     }
 
+    /*Tests_SRS_IDMAP_17_065: [ Module_GetApi shall return a MODULE_API_2 structure when gateway_api_version is MODULE_API_VERSION_2 or greater. ]*/
+    TEST_FUNCTION(IdentityMap_Module_GetApi_v2_returns_json_value_parser)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+
+        ///Act
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_2);
+
+        ///Assert
+        ASSERT_IS_NOT_NULL(theAPIS);
+        ASSERT_ARE_EQUAL(int, (int)MODULE_API_VERSION_2, (int)theAPIS->version);
+        ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON(theAPIS) != NULL);
+        ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(theAPIS) != NULL);
+        ASSERT_IS_TRUE(MODULE_CREATE(theAPIS) != NULL);
+        ASSERT_IS_TRUE(MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(Module_GetApi(MODULE_API_VERSION_1)) == NULL);
+
+        ///Ablution
+    }
+
+    /*Tests_SRS_IDMAP_17_063: [ If configuration is NULL then IdentityMap_ParseConfigurationFromJsonValue shall fail and return NULL. ]*/
+    TEST_FUNCTION(IdentityMap_ParseConfigurationFromJsonValue_Config_Null)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_2);
+
+        ///Act
+        auto n = MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(theAPIS)(NULL);
+
+        ///Assert
+        ASSERT_IS_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+    }
+
+    /*Tests_SRS_IDMAP_17_064: [ IdentityMap_ParseConfigurationFromJsonValue shall build the configuration vector as IdentityMap_ParseConfigurationFromJson does, without parsing or freeing configuration. ]*/
+    TEST_FUNCTION(IdentityMap_ParseConfigurationFromJsonValue_Success)
+    {
+        ///Arrange
+        CIdentitymapMocks mocks;
+        const MODULE_API* theAPIS = Module_GetApi(MODULE_API_VERSION_2);
+
+        STRICT_EXPECTED_CALL(mocks, json_value_get_array((const JSON_Value*)0x42));
+        STRICT_EXPECTED_CALL(mocks, VECTOR_create(sizeof(IDENTITY_MAP_CONFIG)));
+        STRICT_EXPECTED_CALL(mocks, json_array_get_count(IGNORED_PTR_ARG))
+            .IgnoreArgument(1)
+            .SetReturn(1UL);
+        STRICT_EXPECTED_CALL(mocks, json_array_get_object(IGNORED_PTR_ARG, 0))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "macAddress"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceId"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, json_object_get_string(IGNORED_PTR_ARG, "deviceKey"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "00:00:00:00:00:00"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "id"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, mallocAndStrcpy_s(IGNORED_PTR_ARG, "key"))
+            .IgnoreArgument(1);
+        STRICT_EXPECTED_CALL(mocks, VECTOR_push_back(IGNORED_PTR_ARG, IGNORED_PTR_ARG, 1))
+            .IgnoreArgument(1)
+            .IgnoreArgument(2);
+
+        //Act
+        auto n = MODULE_PARSE_CONFIGURATION_FROM_JSON_VALUE(theAPIS)((const JSON_Value*)0x42);
+
+        ///Assert
+        ASSERT_IS_NOT_NULL(n);
+        mocks.AssertActualAndExpectedCalls();
+
+        ///Cleanup
+        MODULE_FREE_CONFIGURATION(theAPIS)(n);
+    }
+
     //Tests_SRS_IDMAP_05_004: [ If configuration is NULL then IdentityMap_ParseConfigurationFromJson shall fail and return NULL. ]
     TEST_FUNCTION(IdentityMap_ParseConfigurationFromJson_Config_Null)
     {
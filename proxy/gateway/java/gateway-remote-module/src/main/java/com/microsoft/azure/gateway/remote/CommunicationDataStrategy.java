@@ -32,7 +32,13 @@ class CommunicationDataStrategy implements CommunicationStrategy {
 	 */
 	@Override
     public RemoteMessage deserializeMessage(ByteBuffer messageBuffer, byte version) throws MessageDeserializationException {
-		return new DataMessage(messageBuffer.array());
+		if (messageBuffer.hasArray()) {
+			return new DataMessage(messageBuffer.array());
+		}
+		// a direct buffer is only valid until released, keep a copy of the content
+		byte[] content = new byte[messageBuffer.remaining()];
+		messageBuffer.get(content);
+		return new DataMessage(content);
 	}
 
 	/**
@@ -15,6 +15,14 @@ interface CommunicationEndpoint {
      */
     void setVersion(byte version);
 
+    /**
+     * Exchange messages through buffers owned by the transport instead of
+     * Java byte arrays, which saves a copy of every message.
+     *
+     * @param directBuffers
+     */
+    void setDirectBuffers(boolean directBuffers);
+
     /**
      * Creates a socket and connects to it.
      * 
@@ -35,12 +35,15 @@ public class ModuleConfiguration {
     private final String identifier;
     private final Class<? extends IGatewayModule> moduleClass;
     private final byte version;
+    private final boolean directBuffers;
 
     // Codes_SRS_MODULE_CONFIGURATION_24_001: [ ModuleConfiguration shall not have a private constructor . ]
-    private ModuleConfiguration(String identifier, Class<? extends IGatewayModule> moduleClass, byte version) {
+    private ModuleConfiguration(String identifier, Class<? extends IGatewayModule> moduleClass, byte version,
+            boolean directBuffers) {
         this.identifier = identifier;
         this.moduleClass = moduleClass;
         this.version = version;
+        this.directBuffers = directBuffers;
     }
 
     // Codes_SRS_MODULE_CONFIGURATION_24_003: [ It shall return the control channel identification. ]
@@ -58,6 +61,11 @@ public class ModuleConfiguration {
         return version;
     }
 
+    // Codes_SRS_MODULE_CONFIGURATION_24_014: [ It shall return whether messages are exchanged through direct buffers. ]
+    public boolean isDirectBuffers() {
+        return directBuffers;
+    }
+
     /**
      * A builder for {@code ModuleConfiguration}.
      *
@@ -69,6 +77,7 @@ public class ModuleConfiguration {
         private String identifier;
         private Class<? extends IGatewayModule> moduleClass;
         private byte version;
+        private boolean directBuffers;
 
         public Builder() {
         }
@@ -91,6 +100,17 @@ public class ModuleConfiguration {
             return this;
         }
 
+        /**
+         * Exchange messages with the Gateway through direct buffers allocated
+         * by nanomsg instead of Java byte arrays, which saves a copy of every
+         * message sent and of every control message received.
+         */
+        // Codes_SRS_MODULE_CONFIGURATION_BUILDER_24_015: [ It shall save `directBuffers` into member field.  ]
+        public Builder setDirectBuffers(boolean directBuffers) {
+            this.directBuffers = directBuffers;
+            return this;
+        }
+
         /**
          * Creates an {@code ModuleConfiguration} instance.
          *
@@ -113,7 +133,7 @@ public class ModuleConfiguration {
                 this.version = DEFAULT_VERSION;
 
             // Codes_SRS_MODULE_CONFIGURATION_BUILDER_24_009: [ It shall create a new ModuleConfiguration instance. ]
-            return new ModuleConfiguration(this.identifier, this.moduleClass, this.version);
+            return new ModuleConfiguration(this.identifier, this.moduleClass, this.version, this.directBuffers);
         }
     }
 }
\ No newline at end of file
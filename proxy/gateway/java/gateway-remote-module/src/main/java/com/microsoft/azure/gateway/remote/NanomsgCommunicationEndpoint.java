@@ -17,6 +17,7 @@ class NanomsgCommunicationEndpoint implements CommunicationEndpoint {
     private final NanomsgLibrary nano;
     private final CommunicationStrategy communicationStrategy;
     private byte version;
+    private boolean directBuffers;
     private int socket;
     private int endpointId;
 
@@ -47,6 +48,14 @@ class NanomsgCommunicationEndpoint implements CommunicationEndpoint {
         this.version = version;
     }
 
+    /* (non-Javadoc)
+     * @see com.microsoft.azure.gateway.remote.CommunicationEndpoint#setDirectBuffers(boolean)
+     */
+    @Override
+    public void setDirectBuffers(boolean directBuffers) {
+        this.directBuffers = directBuffers;
+    }
+
     /* (non-Javadoc)
      * @see com.microsoft.azure.gateway.remote.CommunicationEndpoint#connect()
      */
@@ -61,6 +70,9 @@ class NanomsgCommunicationEndpoint implements CommunicationEndpoint {
      */
     @Override
     public RemoteMessage receiveMessage() throws ConnectionException, MessageDeserializationException {
+        if (this.directBuffers) {
+            return this.receiveDirectMessage();
+        }
 
         byte[] messageBuffer = this.nano.receiveMessageNoWait(this.socket);
         if (messageBuffer == null) {
@@ -83,7 +95,11 @@ class NanomsgCommunicationEndpoint implements CommunicationEndpoint {
      */
     @Override
     public void sendMessage(byte[] message) throws ConnectionException {
-        this.nano.sendMessage(socket, message);
+        if (this.directBuffers) {
+            this.sendDirectMessage(message);
+        } else {
+            this.nano.sendMessage(socket, message);
+        }
     }
 
     /* (non-Javadoc)
@@ -94,6 +110,29 @@ class NanomsgCommunicationEndpoint implements CommunicationEndpoint {
         return this.nano.sendMessageAsync(this.socket, message);
     }
 
+    private RemoteMessage receiveDirectMessage() throws ConnectionException, MessageDeserializationException {
+        ByteBuffer messageBuffer = this.nano.receiveDirectMessageNoWait(this.socket);
+        if (messageBuffer == null) {
+            return null;
+        }
+        try {
+            return this.communicationStrategy.deserializeMessage(messageBuffer, version);
+        } finally {
+            this.nano.releaseMessage(messageBuffer);
+        }
+    }
+
+    private void sendDirectMessage(byte[] message) throws ConnectionException {
+        ByteBuffer messageBuffer = this.nano.allocateMessage(message.length);
+        messageBuffer.put(message);
+        try {
+            this.nano.sendDirectMessage(this.socket, messageBuffer);
+        } catch (ConnectionException e) {
+            this.nano.releaseMessage(messageBuffer);
+            throw e;
+        }
+    }
+
     private void createSocket() throws ConnectionException {
         this.socket = this.nano.createSocket(this.communicationStrategy.getEndpointType());
     }
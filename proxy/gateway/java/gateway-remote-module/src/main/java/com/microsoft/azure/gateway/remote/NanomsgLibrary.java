@@ -4,6 +4,7 @@
  */
 package com.microsoft.azure.gateway.remote;
 
+import java.nio.ByteBuffer;
 import java.util.Map;
 
 class NanomsgLibrary {
@@ -46,6 +47,14 @@ class NanomsgLibrary {
 
     private native byte[] nn_recv(int socket, int flags);
 
+    private native ByteBuffer nn_allocmsg_direct(int size);
+
+    private native int nn_freemsg_direct(ByteBuffer buffer);
+
+    private native int nn_send_direct(int socket, ByteBuffer buffer, int flags);
+
+    private native ByteBuffer nn_recv_direct(int socket, int flags);
+
     private static native Map<String, Integer> getSymbols();
 
     public int createSocket(int protocol) throws ConnectionException {
@@ -103,6 +112,66 @@ class NanomsgLibrary {
         return messageBuffer;
     }
 
+    /**
+     * Allocates a message in memory owned by nanomsg. The message belongs to
+     * the caller until it is sent with {@code sendDirectMessage} or released
+     * with {@code releaseMessage}.
+     *
+     * @return A direct buffer of exactly {@code size} bytes
+     */
+    public ByteBuffer allocateMessage(int size) throws ConnectionException {
+        ByteBuffer message = this.nn_allocmsg_direct(size);
+        if (message == null) {
+            int errn = this.nn_errno();
+            throw new ConnectionException(String.format("Error: %d - %s\n", errn, this.nn_strerror(errn)));
+        }
+        return message;
+    }
+
+    /**
+     * Sends a message allocated by {@code allocateMessage} without copying it.
+     * The whole buffer is sent. Once sent, the message belongs to nanomsg and
+     * the buffer must not be used anymore; if it could not be sent, it still
+     * belongs to the caller.
+     */
+    public void sendDirectMessage(int socket, ByteBuffer message) throws ConnectionException {
+        int result = this.nn_send_direct(socket, message, 0);
+        if (result < 0) {
+            int errn = this.nn_errno();
+            throw new ConnectionException(String.format("Error: %d - %s\n", errn, this.nn_strerror(errn)));
+        }
+    }
+
+    /**
+     * Receives a message without copying it out of nanomsg memory. The
+     * returned buffer must be released with {@code releaseMessage} once read.
+     *
+     * @return A direct buffer holding the message, or null if no message is
+     *         available
+     */
+    public ByteBuffer receiveDirectMessageNoWait(int socket) throws ConnectionException {
+        ByteBuffer messageBuffer = this.nn_recv_direct(socket, NN_DONTWAIT);
+
+        if (messageBuffer == null) {
+            int errn = this.nn_errno();
+            if (errn == EAGAIN) {
+                return null;
+            } else {
+                throw new ConnectionException(String.format("Error: %d - %s\n", errn, this.nn_strerror(errn)));
+            }
+        }
+        return messageBuffer;
+    }
+
+    /**
+     * Gives a message received or allocated by this library back to nanomsg.
+     */
+    public void releaseMessage(ByteBuffer message) {
+        if (message != null) {
+            this.nn_freemsg_direct(message);
+        }
+    }
+
     public void shutdown(int socket, int endpointId) {
         this.nn_shutdown(socket, endpointId);
     }
@@ -159,6 +159,8 @@ public class ProxyGateway {
             this.controlEndpoint = new NanomsgCommunicationEndpoint(this.config.getIdentifier(),
                     new CommunicationControlStrategy());
             this.controlEndpoint.setVersion(this.config.getVersion());
+            // Codes_SRS_JAVA_PROXY_GATEWAY_24_035: [ *Message Listener task* - Every channel shall use direct buffers if the configuration asks for them. ]
+            this.controlEndpoint.setDirectBuffers(this.config.isDirectBuffers());
             // Codes_SRS_JAVA_PROXY_GATEWAY_24_008: [ *Message Listener task* - It shall connect to the control channel. ]
             // Codes_SRS_JAVA_PROXY_GATEWAY_24_009: [ *Message Listener task* - If the connection with the control channel fails, it shall throw ConnectionException. ]
             this.controlEndpoint.connect();
@@ -368,6 +370,8 @@ public class ProxyGateway {
                 throws ConnectionException {
             CommunicationEndpoint endpoint = new NanomsgCommunicationEndpoint(endpointConfig.getId(),
                     new CommunicationDataStrategy(endpointConfig.getType()));
+            // Codes_SRS_JAVA_PROXY_GATEWAY_24_035: [ *Message Listener task* - Every channel shall use direct buffers if the configuration asks for them. ]
+            endpoint.setDirectBuffers(this.config.isDirectBuffers());
             endpoint.connect();
             return endpoint;
         }
@@ -26,6 +26,7 @@ public class CommunicationEndpointTest {
     private static byte[] messageBuffer = new byte[] {};
     private static int endpointId = 1;
     private static int socket = 0;
+    private static int releasedMessages = 0;
     private final String identifier = "test";
 
     @Mocked
@@ -89,6 +90,27 @@ public class CommunicationEndpointTest {
             public int nn_send(int socket, byte[] str, int flags) {
                 return sentBytes;
             }
+
+            @Mock
+            public ByteBuffer nn_recv_direct(int socket, int flags) {
+                return messageBuffer == null ? null : ByteBuffer.allocateDirect(messageBuffer.length);
+            }
+
+            @Mock
+            public ByteBuffer nn_allocmsg_direct(int size) {
+                return ByteBuffer.allocateDirect(size);
+            }
+
+            @Mock
+            public int nn_send_direct(int socket, ByteBuffer buffer, int flags) {
+                return sentBytes;
+            }
+
+            @Mock
+            public int nn_freemsg_direct(ByteBuffer buffer) {
+                releasedMessages++;
+                return 0;
+            }
         };
     }
 
@@ -174,6 +196,73 @@ public class CommunicationEndpointTest {
         endpoint.receiveMessage();
     }
 
+    @Test
+    public void receiveMessageWithDirectBuffersReleasesMessage()
+            throws ConnectionException, MessageDeserializationException {
+        messageBuffer = new byte[4];
+        releasedMessages = 0;
+        CommunicationEndpoint endpoint = new NanomsgCommunicationEndpoint(identifier, strategy);
+        endpoint.setDirectBuffers(true);
+        endpoint.receiveMessage();
+
+        new Verifications() {
+            {
+                strategy.deserializeMessage((ByteBuffer) any, anyByte);
+                times = 1;
+            }
+        };
+        assertTrue(releasedMessages == 1);
+    }
+
+    @Test
+    public void receiveMessageWithDirectBuffersNoMessage()
+            throws ConnectionException, MessageDeserializationException {
+        messageBuffer = null;
+        errorNo = 11;
+        releasedMessages = 0;
+        CommunicationEndpoint endpoint = new NanomsgCommunicationEndpoint(identifier, strategy);
+        endpoint.setDirectBuffers(true);
+        endpoint.receiveMessage();
+
+        new Verifications() {
+            {
+                strategy.deserializeMessage((ByteBuffer) any, anyByte);
+                times = 0;
+            }
+        };
+        assertTrue(releasedMessages == 0);
+    }
+
+    @Test
+    public void sendMessageWithDirectBuffersSuccess() throws ConnectionException {
+        messageBuffer = new byte[4];
+        sentBytes = 4;
+        releasedMessages = 0;
+
+        CommunicationEndpoint endpoint = new NanomsgCommunicationEndpoint(identifier, strategy);
+        endpoint.setDirectBuffers(true);
+        endpoint.sendMessage(messageBuffer);
+
+        assertTrue(releasedMessages == 0);
+    }
+
+    @Test
+    public void sendMessageWithDirectBuffersReleasesMessageIfNotSent() throws ConnectionException {
+        messageBuffer = new byte[4];
+        sentBytes = -1;
+        releasedMessages = 0;
+
+        CommunicationEndpoint endpoint = new NanomsgCommunicationEndpoint(identifier, strategy);
+        endpoint.setDirectBuffers(true);
+        try {
+            endpoint.sendMessage(messageBuffer);
+        } catch (ConnectionException e) {
+            assertTrue(releasedMessages == 1);
+            return;
+        }
+        assertFalse(true);
+    }
+
     @Test
     public void disconnectMessageSuccess() throws ConnectionException, MessageDeserializationException {
         final String identifier = "test";
@@ -5,6 +5,8 @@
 package com.microsoft.azure.gateway.remote;
 
 import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+import static org.junit.Assert.assertTrue;
 
 import org.junit.Test;
 
@@ -55,6 +57,17 @@ public class ModuleConfigurationTest {
         assertEquals(config.getModuleClass(), MODULE_CLASS);
         assertEquals(config.getVersion(), VERSION);
     }
+
+    // Tests_SRS_MODULE_CONFIGURATION_BUILDER_24_015: [ It shall save `directBuffers` into member field.  ]
+    // Tests_SRS_MODULE_CONFIGURATION_24_014: [ It shall return whether messages are exchanged through direct buffers. ]
+    @Test
+    public void buildSetsDirectBuffers() {
+        ModuleConfiguration.Builder builder = new ModuleConfiguration.Builder();
+        builder.setIdentifier(IDENTIFIER).setModuleClass(MODULE_CLASS);
+
+        assertFalse(builder.build().isDirectBuffers());
+        assertTrue(builder.setDirectBuffers(true).build().isDirectBuffers());
+    }
     
     // Tests_SRS_MODULE_CONFIGURATION_24_001: [ ModuleConfiguration shall not have a private constructor . ]
     // Tests_SRS_MODULE_CONFIGURATION_24_002: [ ModuleConfiguration shall have a Builder that creates new instances of ModuleConfiguration . ]
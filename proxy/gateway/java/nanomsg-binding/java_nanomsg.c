@@ -117,6 +117,93 @@ JNIEXPORT jbyteArray JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibr
     return result;
 }
 
+/*
+ * The direct variants hand nanomsg owned memory to Java as a direct ByteBuffer,
+ * so a frame is neither copied into nor out of a Java byte array. A buffer that
+ * was received or allocated belongs to the caller until it is sent, which gives
+ * it back to nanomsg, or released with nn_freemsg_direct.
+ */
+static jobject new_direct_message(JNIEnv *env, void *buf, int nbytes)
+{
+    jobject result = (*env)->NewDirectByteBuffer(env, buf, nbytes);
+    jthrowable exception = (*env)->ExceptionOccurred(env);
+    if (result == NULL || exception)
+    {
+        result = NULL;
+        (*env)->ExceptionDescribe(env);
+        (*env)->ExceptionClear(env);
+        nn_freemsg(buf);
+    }
+
+    return result;
+}
+
+JNIEXPORT jobject JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct
+(JNIEnv *env, jobject obj, jint size) {
+    (void)obj;
+
+    jobject result = NULL;
+    if (size > 0) {
+        void *buf = nn_allocmsg(size, 0);
+        if (buf != NULL) {
+            result = new_direct_message(env, buf, size);
+        }
+    }
+
+    return result;
+}
+
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1freemsg_1direct
+(JNIEnv *env, jobject obj, jobject buffer) {
+    (void)obj;
+
+    jint result = -1;
+    if (buffer != NULL) {
+        void *buf = (*env)->GetDirectBufferAddress(env, buffer);
+        if (buf != NULL) {
+            result = nn_freemsg(buf);
+        }
+    }
+
+    return result;
+}
+
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct
+(JNIEnv *env, jobject obj, jint socket, jobject buffer, jint flags) {
+    (void)obj;
+
+    jint result = -1;
+    if (buffer != NULL) {
+        void *buf = (*env)->GetDirectBufferAddress(env, buffer);
+        if (buf != NULL) {
+            /* nanomsg takes the message over once sent, and sends all of it */
+            result = nn_send(socket, &buf, NN_MSG, flags);
+        }
+    }
+
+    return result;
+}
+
+JNIEXPORT jobject JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct
+(JNIEnv *env, jobject obj, jint socket, jint flags)
+{
+    (void)obj;
+    void *buf = NULL;
+    int nbytes = nn_recv(socket, &buf, NN_MSG, flags);
+    jobject result = NULL;
+    if (nbytes <= 0) {
+        result = NULL;
+        if (nbytes == 0) {
+            nn_freemsg(buf);
+        }
+    }
+    else {
+        result = new_direct_message(env, buf, nbytes);
+    }
+
+    return result;
+}
+
 JNIEXPORT jobject JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_getSymbols
 (JNIEnv *env, jclass clazz) {
     (void)clazz;
@@ -71,6 +71,38 @@ JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn
 JNIEXPORT jbyteArray JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv
   (JNIEnv *, jobject, jint, jint);
 
+/*
+ * Class:     com_microsoft_azure_gateway_remote_NanomsgLibrary
+ * Method:    nn_allocmsg_direct
+ * Signature: (I)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     com_microsoft_azure_gateway_remote_NanomsgLibrary
+ * Method:    nn_freemsg_direct
+ * Signature: (Ljava/nio/ByteBuffer;)I
+ */
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1freemsg_1direct
+  (JNIEnv *, jobject, jobject);
+
+/*
+ * Class:     com_microsoft_azure_gateway_remote_NanomsgLibrary
+ * Method:    nn_send_direct
+ * Signature: (ILjava/nio/ByteBuffer;I)I
+ */
+JNIEXPORT jint JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct
+  (JNIEnv *, jobject, jint, jobject, jint);
+
+/*
+ * Class:     com_microsoft_azure_gateway_remote_NanomsgLibrary
+ * Method:    nn_recv_direct
+ * Signature: (II)Ljava/nio/ByteBuffer;
+ */
+JNIEXPORT jobject JNICALL Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct
+  (JNIEnv *, jobject, jint, jint);
+
 /*
  * Class:     com_microsoft_azure_gateway_remote_NanomsgLibrary
  * Method:    getSymbols
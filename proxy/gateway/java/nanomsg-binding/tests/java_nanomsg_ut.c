@@ -106,6 +106,14 @@ MOCK_FUNCTION_END()
 MOCK_FUNCTION_WITH_CODE(JNICALL, void, SetByteArrayRegion, JNIEnv*, env, jbyteArray, arr, jsize, start, jsize, len, const jbyte*, buf);
 MOCK_FUNCTION_END()
 
+MOCK_FUNCTION_WITH_CODE(JNICALL, jobject, NewDirectByteBuffer, JNIEnv*, env, void*, address, jlong, capacity);
+    jobject buffer = (jobject)0x42;
+MOCK_FUNCTION_END(buffer)
+
+MOCK_FUNCTION_WITH_CODE(JNICALL, void*, GetDirectBufferAddress, JNIEnv*, env, jobject, buf);
+    void* address = (void*)0x43;
+MOCK_FUNCTION_END(address)
+
 MOCKABLE_FUNCTION(JNICALL, void, DeleteLocalRef, JNIEnv*, env, jobject, obj);
 void my_DeleteLocalRef(JNIEnv* env, jobject obj)
 {
@@ -148,7 +156,7 @@ struct JNINativeInterface_ env = {
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
     NULL, NULL, NULL, NULL, SetByteArrayRegion, NULL, NULL, NULL, NULL, NULL,
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+    NULL, NULL, NULL, NULL, NULL, NewDirectByteBuffer, GetDirectBufferAddress, NULL, NULL
 };
 
 #undef ENABLE_MOCKS
@@ -157,6 +165,9 @@ struct JNINativeInterface_ env = {
 MOCK_FUNCTION_WITH_CODE(, int, nn_bind, int, s, const char *, addr)
 MOCK_FUNCTION_END(0)
 
+MOCK_FUNCTION_WITH_CODE(, void *, nn_allocmsg, size_t, size, int, type)
+MOCK_FUNCTION_END((void *)0x43)
+
 MOCK_FUNCTION_WITH_CODE(, int, nn_close, int, s)
 MOCK_FUNCTION_END(0)
 
@@ -221,6 +232,7 @@ TEST_SUITE_INITIALIZE(TestClassInitialize)
     REGISTER_UMOCK_ALIAS_TYPE(const jbyte*, void*);
     REGISTER_UMOCK_ALIAS_TYPE(jarray, void*);
     REGISTER_UMOCK_ALIAS_TYPE(JNIEnv*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(jlong, int64_t);
 
     REGISTER_UMOCK_ALIAS_TYPE(const char*, char*);
 
@@ -595,6 +607,196 @@ TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_re
     ASSERT_IS_NULL(result);
 }
 
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct_success)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint socket = (jint)1;
+    jint flags = (jint)1;
+    int expectedResult = 4;
+
+    STRICT_EXPECTED_CALL(nn_recv(socket, IGNORED_PTR_ARG, NN_MSG, flags))
+        .IgnoreArgument(2)
+        .SetReturn(expectedResult);
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(IGNORED_PTR_ARG, IGNORED_PTR_ARG, expectedResult))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jobject result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct(global_env, jObject, socket, flags);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct_return_null_if_no_message)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint socket = (jint)1;
+    jint flags = (jint)1;
+
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreAllArguments()
+        .SetReturn(-1);
+
+    //Act
+    jobject result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct(global_env, jObject, socket, flags);
+
+    //Assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct_frees_message_if_buffer_fails)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint socket = (jint)1;
+    jint flags = (jint)1;
+    int expectedResult = 4;
+
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreAllArguments()
+        .SetReturn(expectedResult);
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(IGNORED_PTR_ARG, IGNORED_PTR_ARG, expectedResult))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(ExceptionDescribe(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(ExceptionClear(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(nn_freemsg(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jobject result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1recv_1direct(global_env, jObject, socket, flags);
+
+    //Assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct_success)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint size = (jint)16;
+
+    STRICT_EXPECTED_CALL(nn_allocmsg(size, 0));
+    STRICT_EXPECTED_CALL(NewDirectByteBuffer(IGNORED_PTR_ARG, (void*)0x43, size))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(ExceptionOccurred(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+
+    //Act
+    jobject result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct(global_env, jObject, size);
+
+    //Assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct_return_null_if_alloc_fails)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint size = (jint)16;
+
+    STRICT_EXPECTED_CALL(nn_allocmsg(size, 0))
+        .SetReturn(NULL);
+
+    //Act
+    jobject result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1allocmsg_1direct(global_env, jObject, size);
+
+    //Assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct_success)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint socket = (jint)1;
+    jobject buffer = (jobject)0x42;
+    jint flags = (jint)1;
+    jint expectedResult = (jint)16;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(IGNORED_PTR_ARG, buffer))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(nn_send(socket, IGNORED_PTR_ARG, NN_MSG, flags))
+        .IgnoreArgument(2)
+        .SetReturn(expectedResult);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct(global_env, jObject, socket, buffer, flags);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int32_t, expectedResult, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct_not_sent_if_not_direct)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jint socket = (jint)1;
+    jobject buffer = (jobject)0x42;
+    jint flags = (jint)1;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(IGNORED_PTR_ARG, buffer))
+        .IgnoreArgument(1)
+        .SetReturn(NULL);
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1send_1direct(global_env, jObject, socket, buffer, flags);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int32_t, -1, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1freemsg_1direct_success)
+{
+    //Arrange
+    umock_c_reset_all_calls();
+
+    jobject jObject = (jobject)0x42;
+    jobject buffer = (jobject)0x42;
+
+    STRICT_EXPECTED_CALL(GetDirectBufferAddress(IGNORED_PTR_ARG, buffer))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(nn_freemsg((void*)0x43));
+
+    //Act
+    jint result = Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_nn_1freemsg_1direct(global_env, jObject, buffer);
+
+    //Assert
+    ASSERT_ARE_EQUAL(int32_t, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 TEST_FUNCTION(Java_com_microsoft_azure_gateway_remote_NanomsgLibrary_getSymbols_success)
 {
     //Arrange
@@ -15,6 +15,15 @@
 
 typedef struct REMOTE_MODULE_TAG * REMOTE_MODULE_HANDLE;
 
+#define PROXY_GATEWAY_CHANNEL_VALUES \
+    PROXY_GATEWAY_CONTROL_CHANNEL, \
+    PROXY_GATEWAY_MESSAGE_CHANNEL
+
+/*!
+ * \brief The channels connecting a remote module to the Azure IoT Gateway
+ */
+DEFINE_ENUM(PROXY_GATEWAY_CHANNEL, PROXY_GATEWAY_CHANNEL_VALUES);
+
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 /*!
@@ -59,7 +68,9 @@ MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, ProxyGateway_Detach, REMOTE_MODULE_HAND
  * words, if multiple messages are queued on a single channel, only the first message of
  * each channel will be serviced. If the message is intended for the remote module (as
  * opposed to the ProxyGateway library itself), the ProxyGateway library will pass it along
- * by calling `Module_Receive` on the remote module.
+ * by calling `Module_Receive` on the remote module. If the gateway traced the message,
+ * its latency trace is stripped before delivery, stamped around `Module_Receive` and
+ * returned to the gateway.
  *
  * \param remote_module [in] The handle of the remote module you wish to detach from
  *                           the Azure IoT Gateway.
@@ -100,6 +111,90 @@ MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_HaltWorkerThread, REMOTE_MO
  */
 MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_StartWorkerThread, REMOTE_MODULE_HANDLE, remote_module);
 
+/*!
+ * \brief Start a worker thread that sleeps until the gateway sends something
+ *
+ * `ProxyGateway_StartBlockingWorkerThread` is an alternative to `ProxyGateway_StartWorkerThread`.
+ * Instead of calling `ProxyGateway_DoWork` in a loop, the worker thread blocks until a message
+ * arrives on the control or the message channel, so an idle remote module uses no CPU and a
+ * message is serviced as soon as it arrives. The worker thread is halted by
+ * `ProxyGateway_HaltWorkerThread`, which may take up to a tenth of a second to be noticed.
+ *
+ * \param remote_module [in] The handle of the remote module you wish to detach from
+ *                           the Azure IoT Gateway.
+ *
+ * \return A result value. 0 indicating success or failure otherwise
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_StartBlockingWorkerThread, REMOTE_MODULE_HANDLE, remote_module);
+
+/*!
+ * \brief Get a descriptor that signals when a channel has a message
+ *
+ * `ProxyGateway_GetFd` lets a remote module service the Azure IoT Gateway from its own event
+ * loop (`epoll`, `select`, libuv, etc.) instead of a worker thread. The descriptor becomes
+ * readable while a message is waiting on `channel`; call `ProxyGateway_DoWork` when it does.
+ * The descriptor must not be read from or written to.
+ *
+ * \param remote_module [in] The handle of the remote module.
+ * \param channel [in] The channel to watch.
+ *
+ * \return The descriptor, or -1 if it cannot be obtained
+ *
+ * \note `ProxyGateway_DoWork` services one message per channel, so watch the descriptors
+ *       level-triggered. The message channel is only connected once the gateway has sent
+ *       the create message, and is replaced whenever the gateway recreates the module;
+ *       query its descriptor again after each call to `ProxyGateway_DoWork`. If message
+ *       batching is enabled, also call `ProxyGateway_DoWork` at least every `max_delay_ms`.
+ *       On Windows the descriptor is a `SOCKET`.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_GetFd, REMOTE_MODULE_HANDLE, remote_module, PROXY_GATEWAY_CHANNEL, channel);
+
+/*!
+ * \brief Batch the messages a remote module publishes to the gateway
+ *
+ * `ProxyGateway_SetMessageBatching` makes the ProxyGateway library pack the messages
+ * published by the remote module into batch frames, instead of sending one frame per
+ * message. A batch is sent once it reaches `max_batch_size` bytes, or from
+ * `ProxyGateway_DoWork` once its oldest message has waited `max_delay_ms`.
+ * Batched frames received from the gateway are always unpacked, whether or not
+ * batching is enabled here.
+ *
+ * \param remote_module [in] The handle of the remote module to configure.
+ * \param max_batch_size [in] The size, in bytes, at which a batch is sent. Zero leaves
+ *                            batching disabled.
+ * \param max_delay_ms [in] The longest time, in milliseconds, a published message may
+ *                          wait in a partially filled batch.
+ *
+ * \return A result value. 0 indicating success or failure otherwise
+ *
+ * \note Batching can only be enabled once, and should be enabled after `ProxyGateway_Attach`
+ *       and before the remote module starts publishing messages.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_SetMessageBatching, REMOTE_MODULE_HANDLE, remote_module, uint32_t, max_batch_size, uint32_t, max_delay_ms);
+
+/*!
+ * \brief Grant the gateway credits to send messages to a remote module
+ *
+ * `ProxyGateway_GrantCredits` lets a remote module apply backpressure to the gateway.
+ * Once a remote module has granted credits, the gateway only sends it messages while
+ * credits remain, and holds the rest in its outgoing queue. Each message sent consumes
+ * one message credit and as many byte credits as its serialized size. Credits add up
+ * across calls.
+ *
+ * \param remote_module [in] The handle of the remote module granting credits.
+ * \param message_credits [in] The number of additional messages the gateway may send.
+ *                             Zero leaves the message window unchanged.
+ * \param byte_credits [in] The number of additional serialized bytes the gateway may send.
+ *                          Zero leaves the byte window unchanged.
+ *
+ * \return A result value. 0 indicating success or failure otherwise
+ *
+ * \note A window is only enforced once credits have been granted for it. A remote module
+ *       that never calls `ProxyGateway_GrantCredits` is never throttled. The gateway
+ *       reads credits periodically, so grant more before the current window runs out.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, ProxyGateway_GrantCredits, REMOTE_MODULE_HANDLE, remote_module, uint32_t, message_credits, uint32_t, byte_credits);
+
 #ifdef __cplusplus
   }
 #endif
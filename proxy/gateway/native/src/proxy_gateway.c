@@ -4,6 +4,7 @@
 #include "proxy_gateway.h"
 #include "broker.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +20,9 @@
 #include "control_message.h"
 #include "gateway.h"
 #include "message.h"
+#include "message_batch.h"
+#include "message_mux.h"
+#include "message_trace.h"
 
 typedef enum REMOTE_MODULE_RESULT_TAG {
     REMOTE_MODULE_DETACH = -1,
@@ -58,11 +62,58 @@ send_control_reply (
     uint8_t response
 );
 
+int
+send_control_message (
+    REMOTE_MODULE_HANDLE remote_module,
+    CONTROL_MESSAGE * message
+);
+
 int
 worker_thread(
     void * thread_arg
 );
 
+int
+blocking_worker_thread (
+    void * thread_arg
+);
+
+int
+start_worker_thread (
+    REMOTE_MODULE_HANDLE remote_module,
+    THREAD_START_FUNC thread_func
+);
+
+int
+send_message_batch (
+    REMOTE_MODULE_HANDLE remote_module
+);
+
+void
+deliver_message_frame (
+    void * context,
+    const unsigned char * frame,
+    size_t frame_size
+);
+
+int
+send_trace_report (
+    REMOTE_MODULE_HANDLE remote_module,
+    const MESSAGE_TRACE * trace
+);
+
+REMOTE_MODULE_HANDLE
+find_hosted_module (
+    REMOTE_MODULE_HANDLE remote_module,
+    uint32_t module_id,
+    bool create
+);
+
+void
+release_hosted_module (
+    REMOTE_MODULE_HANDLE hosted_module
+);
+
 typedef struct MESSAGE_THREAD_TAG {
     bool halt;
     LOCK_HANDLE mutex;
@@ -76,6 +127,13 @@ typedef struct REMOTE_MODULE_TAG {
     int message_socket;
     MESSAGE_THREAD_HANDLE message_thread;
     MODULE module;
+    LOCK_HANDLE batch_lock;
+    MESSAGE_BATCH_HANDLE message_batch;
+    uint32_t batch_delay_ms;
+    REMOTE_MODULE_HANDLE host;
+    uint32_t module_id;
+    REMOTE_MODULE_HANDLE hosted_modules;
+    REMOTE_MODULE_HANDLE next_hosted_module;
 } REMOTE_MODULE;
 
 static size_t strnlen_(const char* s, size_t max)
@@ -198,6 +256,25 @@ ProxyGateway_Detach (
             }
         }
 
+        if (NULL != remote_module->message_batch) {
+            /* Codes_SRS_PROXY_GATEWAY_027_075: [If message batching is enabled, `ProxyGateway_Detach` shall attempt to send any pending batched messages, then free the batch and its mutex] */
+            (void)send_message_batch(remote_module);
+            MessageBatch_Destroy(remote_module->message_batch);
+            remote_module->message_batch = NULL;
+            (void)Lock_Deinit(remote_module->batch_lock);
+            remote_module->batch_lock = NULL;
+        }
+
+        while (NULL != remote_module->hosted_modules) {
+            REMOTE_MODULE_HANDLE hosted_module = remote_module->hosted_modules;
+            remote_module->hosted_modules = hosted_module->next_hosted_module;
+            /* Codes_SRS_PROXY_GATEWAY_027_108: [`ProxyGateway_Detach` shall destroy every hosted module by calling `void Module_Destroy(MODULE_HANDLE moduleHandle)`, and free the memory dedicated to it] */
+            if (NULL != hosted_module->module.module_handle) {
+                ((MODULE_API_1 *)hosted_module->module.module_apis)->Module_Destroy(hosted_module->module.module_handle);
+            }
+            free(hosted_module);
+        }
+
         /* Codes_SRS_PROXY_GATEWAY_027_061: [`ProxyGateway_Detach` shall attempt to notify the Azure IoT Gateway of the detachment] */
         (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_DETACH);
 		ThreadAPI_Sleep(1000);
@@ -228,6 +305,8 @@ ProxyGateway_DoWork (
         LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
     } else {
         int32_t bytes_received;
+        int32_t mux_header_size;
+        uint32_t module_id = 0;
         void * control_message = NULL;
 
         /* Codes_SRS_PROXY_GATEWAY_027_027: [Control Channel - `ProxyGateway_DoWork` shall poll the gateway control channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with the control socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
@@ -241,35 +320,62 @@ ProxyGateway_DoWork (
             }
         } else {
             CONTROL_MESSAGE * structured_control_message;
+            REMOTE_MODULE_HANDLE target_module = NULL;
 
+            /* Codes_SRS_PROXY_GATEWAY_027_099: [Control Channel - `ProxyGateway_DoWork` shall read the module id of the control message by calling `int32_t MessageMux_ReadHeader(const unsigned char * source, size_t size, uint32_t * module_id)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+            if (0 > (mux_header_size = MessageMux_ReadHeader((const unsigned char *)control_message, (size_t)bytes_received, &module_id))) {
+                /* Codes_SRS_PROXY_GATEWAY_027_100: [Control Channel - If the module id header is malformed, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the control channel request] */
+                LogError("%s: Unable to read the module id of a control message!", __FUNCTION__);
             /* Codes_SRS_PROXY_GATEWAY_027_029: [Control Channel - If a control message was received, then `ProxyGateway_DoWork` will parse that message by calling `CONTROL_MESSAGE * ControlMessage_CreateFromByteArray(const unsigned char * source, size_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
-            if (NULL == (structured_control_message = ControlMessage_CreateFromByteArray((const unsigned char *)control_message, bytes_received))) {
+            } else if (NULL == (structured_control_message = ControlMessage_CreateFromByteArray((const unsigned char *)control_message + mux_header_size, bytes_received - mux_header_size))) {
                 /* Codes_SRS_PROXY_GATEWAY_027_030: [Control Channel - If unable to parse the control message, then `ProxyGateway_DoWork` shall signal the gateway, free any previously allocated memory and abandon the control channel request] */
                 LogError("%s: Unable to parse control message!", __FUNCTION__);
-                (void)send_control_reply(remote_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
+                if (NULL != (target_module = ((0 == mux_header_size) ? remote_module : find_hosted_module(remote_module, module_id, false)))) {
+                    (void)send_control_reply(target_module, (uint8_t)REMOTE_MODULE_GATEWAY_CONNECTION_ERROR);
+                }
             } else {
+                /* Codes_SRS_PROXY_GATEWAY_027_101: [Control Channel - If the control message carries a module id, then `ProxyGateway_DoWork` shall process it on behalf of the hosted module with that id, hosting a new module if the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE and no hosted module has that id] */
+                if (0 == mux_header_size) {
+                    target_module = remote_module;
+                } else if (NULL == (target_module = find_hosted_module(remote_module, module_id, (CONTROL_MESSAGE_TYPE_MODULE_CREATE == structured_control_message->type)))) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_102: [Control Channel - If no module can be hosted for the module id, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the control channel request] */
+                    LogError("%s: No module hosted for module id <%u>!", __FUNCTION__, module_id);
+                }
+
                 // Route control channel messages to appropriate functions
-                switch (structured_control_message->type) {
-                  case CONTROL_MESSAGE_TYPE_MODULE_CREATE:
-                    /* Codes_SRS_PROXY_GATEWAY_027_031: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE, then `ProxyGateway_DoWork` shall process the create message] */
-                    if (0 != process_module_create_message(remote_module, (const CONTROL_MESSAGE_MODULE_CREATE *)structured_control_message)) {
-                        LogError("%s: Unable to process create message!", __FUNCTION__);
-                    }
-                    break;
-                  case CONTROL_MESSAGE_TYPE_MODULE_START:
-                    /* Codes_SRS_PROXY_GATEWAY_027_032: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_START and `Module_Start` was provided, then `ProxyGateway_DoWork` shall call `void Module_Start(MODULE_HANDLE moduleHandle)`] */
-                    if (((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start) {
-                        ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Start(remote_module->module.module_handle);
+                if (NULL == target_module) {
+                    // no module to route to
+                } else {
+                    switch (structured_control_message->type) {
+                      case CONTROL_MESSAGE_TYPE_MODULE_CREATE:
+                        /* Codes_SRS_PROXY_GATEWAY_027_031: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE, then `ProxyGateway_DoWork` shall process the create message] */
+                        if (0 != process_module_create_message(target_module, (const CONTROL_MESSAGE_MODULE_CREATE *)structured_control_message)) {
+                            LogError("%s: Unable to process create message!", __FUNCTION__);
+                            if (NULL != target_module->host) {
+                                /* Codes_SRS_PROXY_GATEWAY_027_103: [Control Channel - If a hosted module cannot be created or has been destroyed, then `ProxyGateway_DoWork` shall release the hosted module] */
+                                release_hosted_module(target_module);
+                            }
+                        }
+                        break;
+                      case CONTROL_MESSAGE_TYPE_MODULE_START:
+                        /* Codes_SRS_PROXY_GATEWAY_027_032: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_START and `Module_Start` was provided, then `ProxyGateway_DoWork` shall call `void Module_Start(MODULE_HANDLE moduleHandle)`] */
+                        if (((MODULE_API_1 *)target_module->module.module_apis)->Module_Start) {
+                            ((MODULE_API_1 *)target_module->module.module_apis)->Module_Start(target_module->module.module_handle);
+                        }
+                        break;
+                      case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
+                        /* Codes_SRS_PROXY_GATEWAY_027_033: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall call `void Module_Destroy(MODULE_HANDLE moduleHandle)`] */
+                        ((MODULE_API_1 *)target_module->module.module_apis)->Module_Destroy(target_module->module.module_handle);
+                        target_module->module.module_handle = NULL;
+                        /* Codes_SRS_PROXY_GATEWAY_027_034: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall disconnect from the message channel] */
+                        disconnect_from_message_channel(target_module);
+                        if (NULL != target_module->host) {
+                            /* Codes_SRS_PROXY_GATEWAY_027_103: [Control Channel - If a hosted module cannot be created or has been destroyed, then `ProxyGateway_DoWork` shall release the hosted module] */
+                            release_hosted_module(target_module);
+                        }
+                        break;
+                      default: LogError("ERROR: REMOTE_MODULE - Received unsupported message type! [%d]\n", structured_control_message->type); break;
                     }
-                    break;
-                  case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
-                    /* Codes_SRS_PROXY_GATEWAY_027_033: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall call `void Module_Destroy(MODULE_HANDLE moduleHandle)`] */
-                    ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Destroy(remote_module->module.module_handle);
-                    remote_module->module.module_handle = NULL;
-                    /* Codes_SRS_PROXY_GATEWAY_027_034: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_DESTROY, then `ProxyGateway_DoWork` shall disconnect from the message channel] */
-                    disconnect_from_message_channel(remote_module);
-                    break;
-                  default: LogError("ERROR: REMOTE_MODULE - Received unsupported message type! [%d]\n", structured_control_message->type); break;
                 }
                 /* Codes_SRS_PROXY_GATEWAY_027_035: [Control Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed control message by calling `void ControlMessage_Destroy(CONTROL_MESSAGE * message)` using the parsed control message as `message`] */
                 ControlMessage_Destroy(structured_control_message);
@@ -283,6 +389,7 @@ ProxyGateway_DoWork (
             // not connected to message channel
         } else {
             void * module_message = NULL;
+            REMOTE_MODULE_HANDLE target_module = NULL;
 
             /* Codes_SRS_PROXY_GATEWAY_027_038: [Message Channel - `ProxyGateway_DoWork` shall poll the gateway message channel by calling `int nn_recv(int s, void * buf, size_t len, int flags)` with each message socket for `s`, `NULL` for `buf`, `NN_MSG` for `len` and NN_DONTWAIT for `flags`] */
             if (0 > (bytes_received = nn_recv(remote_module->message_socket, &module_message, NN_MSG, NN_DONTWAIT))) {
@@ -293,22 +400,47 @@ ProxyGateway_DoWork (
                     LogError("%s: Unexpected error received from the message channel!", __FUNCTION__);
                 }
             } else {
-                MESSAGE_HANDLE structured_module_message;
+                const unsigned char * frame;
+                size_t frame_size;
+
+                /* Codes_SRS_PROXY_GATEWAY_027_104: [Message Channel - `ProxyGateway_DoWork` shall read the module id of the frame by calling `int32_t MessageMux_ReadHeader(const unsigned char * source, size_t size, uint32_t * module_id)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+                if (0 > (mux_header_size = MessageMux_ReadHeader((const unsigned char *)module_message, (size_t)bytes_received, &module_id))) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_105: [Message Channel - If the module id header is malformed, or no module is hosted for the module id, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
+                    LogError("%s: Unable to read the module id of a gateway message!", __FUNCTION__);
+                } else if (NULL == (target_module = ((0 == mux_header_size) ? remote_module : find_hosted_module(remote_module, module_id, false)))) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_105: [Message Channel - If the module id header is malformed, or no module is hosted for the module id, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
+                    LogError("%s: No module hosted for module id <%u>!", __FUNCTION__, module_id);
+                }
 
-                /* Codes_SRS_PROXY_GATEWAY_027_040: [Message Channel - If a module message was received, then `ProxyGateway_DoWork` will parse that message by calling `MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char * source, int32_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
-                if (NULL == (structured_module_message = Message_CreateFromByteArray((const unsigned char *)module_message, bytes_received))) {
-                    /* Codes_SRS_PROXY_GATEWAY_027_041: [Message Channel - If unable to parse the module message, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
-                    LogError("%s: Unable to parse control message!", __FUNCTION__);
+                frame = (const unsigned char *)module_message + ((NULL == target_module) ? 0 : mux_header_size);
+                frame_size = (size_t)bytes_received - ((NULL == target_module) ? 0 : (size_t)mux_header_size);
+                if (NULL == target_module) {
+                    // nowhere to deliver the frame
+                } else if (MessageBatch_IsBatch(frame, frame_size)) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_073: [Message Channel - If the received frame is a message batch, then `ProxyGateway_DoWork` shall pass each message in the batch to the module, in order, by calling `int MessageBatch_ForEachFrame(const unsigned char * source, size_t size, MESSAGE_BATCH_FRAME_CALLBACK callback, void * context)`] */
+                    /* Codes_SRS_PROXY_GATEWAY_027_110: [Message Channel - `ProxyGateway_DoWork` shall deliver each message in a batch as it delivers a single gateway message frame, so that traced messages in a batch are stamped and reported] */
+                    if (0 != MessageBatch_ForEachFrame(frame, frame_size, deliver_message_frame, target_module)) {
+                        LogError("%s: Unable to deliver every message in a batch!", __FUNCTION__);
+                    }
                 } else {
-                    /* Codes_SRS_PROXY_GATEWAY_027_042: [Message Channel - `ProxyGateway_DoWork` shall pass the structured message to the module by calling `void Module_Receive(MODULE_HANDLE moduleHandle)` using the parsed message as `moduleHandle`] */
-                    ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Receive(remote_module->module.module_handle, structured_module_message);
-                    /* Codes_SRS_PROXY_GATEWAY_027_043: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed module message by calling `void Message_Destroy(MESSAGE_HANDLE * message)` using the parsed module message as `message`] */
-                    Message_Destroy(structured_module_message);
+                    deliver_message_frame(target_module, frame, frame_size);
                 }
                 /* Codes_SRS_PROXY_GATEWAY_027_044: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the gateway message by calling `int nn_freemsg(void * msg)` with the resulting buffer from the previous call to `nn_recv`] */
                 (void)nn_freemsg(module_message);
             }
         }
+
+        if (NULL == remote_module->message_batch) {
+            // message batching is disabled
+        /* Codes_SRS_PROXY_GATEWAY_027_074: [Message Channel - If message batching is enabled and a flush is due, then `ProxyGateway_DoWork` shall send the pending batch to the gateway] */
+        } else if (LOCK_OK != Lock(remote_module->batch_lock)) {
+            LogError("%s: Unable to acquire batch mutex!", __FUNCTION__);
+        } else {
+            if (MessageBatch_IsFlushDue(remote_module->message_batch)) {
+                (void)send_message_batch(remote_module);
+            }
+            (void)Unlock(remote_module->batch_lock);
+        }
     }
 
     return;
@@ -375,43 +507,129 @@ ProxyGateway_HaltWorkerThread (
 int
 ProxyGateway_StartWorkerThread (
 	REMOTE_MODULE_HANDLE remote_module
+) {
+	return start_worker_thread(remote_module, worker_thread);
+}
+
+
+int
+ProxyGateway_StartBlockingWorkerThread (
+    REMOTE_MODULE_HANDLE remote_module
+) {
+    /* Codes_SRS_PROXY_GATEWAY_027_094: [`ProxyGateway_StartBlockingWorkerThread` shall start the worker thread in the same manner as `ProxyGateway_StartWorkerThread`, using a function that blocks until a channel has a message for `func`] */
+    return start_worker_thread(remote_module, blocking_worker_thread);
+}
+
+
+int
+ProxyGateway_GetFd (
+    REMOTE_MODULE_HANDLE remote_module,
+    PROXY_GATEWAY_CHANNEL channel
 ) {
     int result;
+    int channel_socket;
+    size_t fd_size = sizeof(result);
 
     if (NULL == remote_module) {
-        /* Codes_SRS_PROXY_GATEWAY_027_017: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_StartWorkerThread` shall do nothing and return a non-zero value] */
+        /* Codes_SRS_PROXY_GATEWAY_027_089: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_GetFd` shall return -1] */
+        LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
+        result = -1;
+    } else if (PROXY_GATEWAY_CONTROL_CHANNEL != channel && PROXY_GATEWAY_MESSAGE_CHANNEL != channel) {
+        /* Codes_SRS_PROXY_GATEWAY_027_090: [Prerequisite Check - If `channel` is neither `PROXY_GATEWAY_CONTROL_CHANNEL` nor `PROXY_GATEWAY_MESSAGE_CHANNEL`, then `ProxyGateway_GetFd` shall return -1] */
+        LogError("%s: Unknown channel <%d>!", __FUNCTION__, (int)channel);
+        result = -1;
+    } else if (0 > (channel_socket = ((PROXY_GATEWAY_CONTROL_CHANNEL == channel) ? remote_module->control_socket : remote_module->message_socket))) {
+        /* Codes_SRS_PROXY_GATEWAY_027_091: [If the message channel is requested before the gateway has connected it, then `ProxyGateway_GetFd` shall return -1] */
+        LogInfo("%s: Message channel is not connected.", __FUNCTION__);
+        result = -1;
+    /* Codes_SRS_PROXY_GATEWAY_027_092: [`ProxyGateway_GetFd` shall obtain the descriptor by calling `int nn_getsockopt(int s, int level, int option, void * optval, size_t * optvallen)` with the socket of `channel` for `s`, `NN_SOL_SOCKET` for `level` and `NN_RCVFD` for `option`] */
+    } else if (0 != nn_getsockopt(channel_socket, NN_SOL_SOCKET, NN_RCVFD, &result, &fd_size)) {
+        /* Codes_SRS_PROXY_GATEWAY_027_093: [If unable to obtain the descriptor, then `ProxyGateway_GetFd` shall return -1] */
+        LogError("%s: Unable to obtain the receive descriptor!", __FUNCTION__);
+        result = -1;
+    }
+
+    return result;
+}
+
+
+int
+ProxyGateway_SetMessageBatching (
+    REMOTE_MODULE_HANDLE remote_module,
+    uint32_t max_batch_size,
+    uint32_t max_delay_ms
+) {
+    int result;
+
+    if (NULL == remote_module) {
+        /* Codes_SRS_PROXY_GATEWAY_027_067: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_SetMessageBatching` shall do nothing and return a non-zero value] */
         LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
         result = __LINE__;
-    } else if (NULL != remote_module->message_thread) {
-        /* Codes_SRS_PROXY_GATEWAY_027_018: [Prerequisite Check - If a work thread already exist for the given handle, then `ProxyGateway_StartWorkerThread` shall do nothing and return zero] */
-        LogInfo("%s: Worker thread has already been initialized.", __FUNCTION__);
-        result = 0;
-    /* Codes_SRS_PROXY_GATEWAY_027_019: [`ProxyGateway_StartWorkerThread` shall allocate the memory required to support the worker thread] */
-    } else if (NULL == (remote_module->message_thread = (MESSAGE_THREAD_HANDLE)calloc(1, sizeof(MESSAGE_THREAD)))) {
-        /* Codes_SRS_PROXY_GATEWAY_027_020: [If memory allocation fails for the worker thread data, then `ProxyGateway_StartWorkerThread` shall return a non-zero value] */
-        LogError("%s: Unable to allocate memory!", __FUNCTION__);
+    } else if (NULL != remote_module->message_batch) {
+        /* Codes_SRS_PROXY_GATEWAY_027_068: [Prerequisite Check - If message batching has already been enabled, then `ProxyGateway_SetMessageBatching` shall do nothing and return a non-zero value] */
+        LogError("%s: Message batching has already been configured!", __FUNCTION__);
         result = __LINE__;
-    /* Codes_SRS_PROXY_GATEWAY_027_021: [`ProxyGateway_StartWorkerThread` shall create a mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
-    } else if (NULL == (remote_module->message_thread->mutex = Lock_Init())) {
-        /* Codes_SRS_PROXY_GATEWAY_027_022: [If a mutex is unable to be created, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
+    } else if (0 == max_batch_size) {
+        /* Codes_SRS_PROXY_GATEWAY_027_069: [If `max_batch_size` is zero, then `ProxyGateway_SetMessageBatching` shall leave batching disabled and return zero] */
+        result = 0;
+    /* Codes_SRS_PROXY_GATEWAY_027_070: [`ProxyGateway_SetMessageBatching` shall create a mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
+    } else if (NULL == (remote_module->batch_lock = Lock_Init())) {
+        /* Codes_SRS_PROXY_GATEWAY_027_071: [If any step fails, then `ProxyGateway_SetMessageBatching` shall free any previously allocated resources and return a non-zero value] */
         LogError("%s: Unable to create mutex!", __FUNCTION__);
         result = __LINE__;
-        free(remote_module->message_thread);
-        remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
-    /* Codes_SRS_PROXY_GATEWAY_027_023: [`ProxyGateway_StartWorkerThread` shall start a worker thread by calling `THREADAPI_RESULT ThreadAPI_Create(&THREAD_HANDLE threadHandle, THREAD_START_FUNC func, void * arg)` with an empty thread handle for `threadHandle`, a function that loops polling the messages for `func`, and `remote_module` for `arg`] */
-    } else if (THREADAPI_OK != ThreadAPI_Create(&remote_module->message_thread->thread, worker_thread, remote_module)) {
-        /* Codes_SRS_PROXY_GATEWAY_027_024: [If the worker thread failed to start, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
-        LogError("%s: Unable to create worker thread!", __FUNCTION__);
+    /* Codes_SRS_PROXY_GATEWAY_027_072: [`ProxyGateway_SetMessageBatching` shall create a message batch by calling `MESSAGE_BATCH_HANDLE MessageBatch_Create(uint32_t max_size, uint32_t max_delay_ms)` using `max_batch_size` and `max_delay_ms`] */
+    } else if (NULL == (remote_module->message_batch = MessageBatch_Create(max_batch_size, max_delay_ms))) {
+        /* Codes_SRS_PROXY_GATEWAY_027_071: [If any step fails, then `ProxyGateway_SetMessageBatching` shall free any previously allocated resources and return a non-zero value] */
+        LogError("%s: Unable to create message batch!", __FUNCTION__);
         result = __LINE__;
-        (void)Lock_Deinit(remote_module->message_thread->mutex);
-        free(remote_module->message_thread);
-        remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
+        (void)Lock_Deinit(remote_module->batch_lock);
+        remote_module->batch_lock = NULL;
     } else {
-        /* Codes_SRS_PROXY_GATEWAY_027_025: [If no errors are encountered, then `ProxyGateway_StartWorkerThread` shall return zero] */
+        remote_module->batch_delay_ms = max_delay_ms;
         result = 0;
     }
 
-	return result;
+    return result;
+}
+
+
+int
+ProxyGateway_GrantCredits (
+    REMOTE_MODULE_HANDLE remote_module,
+    uint32_t message_credits,
+    uint32_t byte_credits
+) {
+    int result;
+
+    if (NULL == remote_module) {
+        /* Codes_SRS_PROXY_GATEWAY_027_076: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_GrantCredits` shall do nothing and return a non-zero value] */
+        LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
+        result = __LINE__;
+    } else if (0 == message_credits && 0 == byte_credits) {
+        /* Codes_SRS_PROXY_GATEWAY_027_077: [If both `message_credits` and `byte_credits` are zero, then `ProxyGateway_GrantCredits` shall do nothing and return zero] */
+        result = 0;
+    } else {
+        CONTROL_MESSAGE_MODULE_CREDIT credit = {
+            .base = {
+                .type = CONTROL_MESSAGE_TYPE_MODULE_CREDIT,
+                .version = CONTROL_MESSAGE_VERSION_1,
+            },
+            .message_credits = message_credits,
+            .byte_credits = byte_credits,
+        };
+
+        /* Codes_SRS_PROXY_GATEWAY_027_078: [`ProxyGateway_GrantCredits` shall send a module credit message carrying `message_credits` and `byte_credits` on the control channel] */
+        if (0 != send_control_message(remote_module, (CONTROL_MESSAGE *)&credit)) {
+            /* Codes_SRS_PROXY_GATEWAY_027_079: [If unable to send the module credit message, then `ProxyGateway_GrantCredits` shall return a non-zero value] */
+            LogError("%s: Unable to send credits to the gateway!", __FUNCTION__);
+            result = __LINE__;
+        } else {
+            /* Codes_SRS_PROXY_GATEWAY_027_080: [If no errors are encountered, then `ProxyGateway_GrantCredits` shall return zero] */
+            result = 0;
+        }
+    }
+
+    return result;
 }
 
 
@@ -434,6 +652,32 @@ Broker_Publish (
         result = BROKER_INVALIDARG;
         LogError("Broker handle and/or message handle is NULL");
     }
+    else if (NULL != remote_module->message_batch)
+    {
+        /* SRS_PROXY_GATEWAY_027_0xx: [If message batching is enabled, `Broker_Publish` shall append the message to the batch and send the batch once it is full] */
+        if (LOCK_OK != Lock(remote_module->batch_lock))
+        {
+            LogError("unable to acquire batch mutex");
+            result = BROKER_ERROR;
+        }
+        else
+        {
+            if (0 != MessageBatch_AddMessage(remote_module->message_batch, message))
+            {
+                LogError("unable to add message [%p] to batch", message);
+                result = BROKER_ERROR;
+            }
+            else if (MessageBatch_IsFull(remote_module->message_batch) && 0 != send_message_batch(remote_module))
+            {
+                result = BROKER_ERROR;
+            }
+            else
+            {
+                result = BROKER_OK;
+            }
+            (void)Unlock(remote_module->batch_lock);
+        }
+    }
     else
     {
         // Send message_ to nanomsg
@@ -453,7 +697,8 @@ Broker_Publish (
         else
         {
             /* Codes_SRS_BROKER_17_025: [ Broker_Publish shall allocate a nanomsg buffer the size of the serialized message + sizeof(MODULE_HANDLE). ] */
-            buf_size = msg_size;
+            const int32_t header_size = ((NULL == remote_module->host) ? 0 : MESSAGE_MUX_HEADER_SIZE);
+            buf_size = header_size + msg_size;
             void* nn_msg = nn_allocmsg(buf_size, 0);
             if (nn_msg == NULL)
             {
@@ -461,14 +706,22 @@ Broker_Publish (
                 LogError("unable to serialize a message [%p]", msg);
                 result = BROKER_ERROR;
             }
+            /* Codes_SRS_PROXY_GATEWAY_027_107: [Every frame sent on behalf of a hosted module shall start with its module id, written by calling `int32_t MessageMux_WriteHeader(uint32_t module_id, unsigned char * buf, int32_t size)`, and be sent on the channels of its proxy gateway] */
+            else if (0 != header_size && 0 > MessageMux_WriteHeader(remote_module->module_id, (unsigned char *)nn_msg, header_size))
+            {
+                LogError("unable to write the module id of a message [%p]", msg);
+                nn_freemsg(nn_msg);
+                result = BROKER_ERROR;
+            }
             else
             {
-                unsigned char *nn_msg_bytes = (unsigned char *)nn_msg;
+                unsigned char *nn_msg_bytes = (unsigned char *)nn_msg + header_size;
+                int message_socket = (NULL == remote_module->host) ? remote_module->message_socket : remote_module->host->message_socket;
                 /* Codes_SRS_BROKER_17_027: [ Broker_Publish shall serialize the message into the remainder of the nanomsg buffer. ] */
                 Message_ToByteArray(message, nn_msg_bytes, msg_size);
 
                 /* Codes_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ] */
-                int nbytes = nn_send(remote_module->message_socket, &nn_msg, NN_MSG, 0);
+                int nbytes = nn_send(message_socket, &nn_msg, NN_MSG, 0);
                 if (nbytes != buf_size)
                 {
                     /* Codes_SRS_BROKER_13_037: [ This function shall return BROKER_ERROR if an underlying API call to the platform causes an error or BROKER_OK otherwise. ] */
@@ -501,8 +754,11 @@ connect_to_message_channel (
 ) {
     int result;
 
+    if (NULL != remote_module->host) {
+        /* Codes_SRS_PROXY_GATEWAY_027_106: [Hosted modules shall share the message channel of their proxy gateway, which `connect_to_message_channel` shall connect for the first hosted module only] */
+        result = (0 > remote_module->host->message_socket) ? connect_to_message_channel(remote_module->host, channel_uri) : 0;
     /* SRS_PROXY_GATEWAY_027_0xx: [`connect_to_message_channel` shall create a socket for the Azure IoT Gateway message channel by calling `int nn_socket(int domain, int protocol)` with `AF_SP` as `domain` and `MESSAGE_URI::uri_type` as `protocol`] */
-    if (-1 == (remote_module->message_socket = nn_socket(AF_SP, channel_uri->uri_type))) {
+    } else if (-1 == (remote_module->message_socket = nn_socket(AF_SP, channel_uri->uri_type))) {
         /* SRS_PROXY_GATEWAY_027_0xx: [If a call to `nn_socket` returns -1, then `connect_to_message_channel` shall free any previously allocated memory, abandon the control message and prepare for the next create message] */
         LogError("%s: Unable to create the gateway socket!", __FUNCTION__);
         result = __LINE__;
@@ -526,12 +782,17 @@ void
 disconnect_from_message_channel (
     REMOTE_MODULE_HANDLE remote_module
 ) {
-    /* SRS_PROXY_GATEWAY_027_0xx: [`disconnect_from_message_channel` shall shutdown the Azure IoT Gateway message channel by calling `int nn_shutdown(int s, int how)`] */
-    (void)nn_shutdown(remote_module->message_socket, remote_module->message_endpoint);
-    remote_module->message_endpoint = -1;
-    /* SRS_PROXY_GATEWAY_027_0xx: [`disconnect_from_message_channel` shall close the Azure IoT Gateway message socket by calling `int nn_close(int s)`] */
-    (void)nn_close(remote_module->message_socket);
-    remote_module->message_socket = -1;
+    if (NULL != remote_module->host) {
+        /* Codes_SRS_PROXY_GATEWAY_027_106: [Hosted modules shall share the message channel of their proxy gateway, which `connect_to_message_channel` shall connect for the first hosted module only] */
+        // the shared channel is closed once its last hosted module is released
+    } else {
+        /* SRS_PROXY_GATEWAY_027_0xx: [`disconnect_from_message_channel` shall shutdown the Azure IoT Gateway message channel by calling `int nn_shutdown(int s, int how)`] */
+        (void)nn_shutdown(remote_module->message_socket, remote_module->message_endpoint);
+        remote_module->message_endpoint = -1;
+        /* SRS_PROXY_GATEWAY_027_0xx: [`disconnect_from_message_channel` shall close the Azure IoT Gateway message socket by calling `int nn_close(int s)`] */
+        (void)nn_close(remote_module->message_socket);
+        remote_module->message_socket = -1;
+    }
 
     return;
 }
@@ -626,7 +887,6 @@ send_control_reply (
     REMOTE_MODULE_HANDLE remote_module,
     uint8_t response
 ) {
-    int result;
     CONTROL_MESSAGE_MODULE_REPLY reply = {
         .base = {
             .type = CONTROL_MESSAGE_TYPE_MODULE_REPLY,
@@ -634,41 +894,276 @@ send_control_reply (
         },
         .status = response,
     };
+
+    return send_control_message(remote_module, (CONTROL_MESSAGE *)&reply);
+}
+
+
+int
+send_control_message (
+    REMOTE_MODULE_HANDLE remote_module,
+    CONTROL_MESSAGE * message
+) {
+    int result;
     unsigned char * message_buffer = NULL;
     int32_t message_size;
+    const int32_t header_size = ((NULL == remote_module->host) ? 0 : MESSAGE_MUX_HEADER_SIZE);
+    const int control_socket = ((NULL == remote_module->host) ? remote_module->control_socket : remote_module->host->control_socket);
 
-    /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` shall calculate the serialized message size by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
-    if (0 > (message_size = ControlMessage_ToByteArray((CONTROL_MESSAGE *)&reply, message_buffer, 0))) {
-        /* SRS_PROXY_GATEWAY_027_0xx: [If unable to calculate the serialized message size, `send_control_reply` shall return a non-zero value] */
+    /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_message` shall calculate the serialized message size by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
+    if (0 > (message_size = ControlMessage_ToByteArray(message, message_buffer, 0))) {
+        /* SRS_PROXY_GATEWAY_027_0xx: [If unable to calculate the serialized message size, `send_control_message` shall return a non-zero value] */
         LogError("%s: Unable to calculate serialized message size!", __FUNCTION__);
         result = __LINE__;
     } else {
-        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` allocate the necessary space for the nano message, by calling `void * nn_allocmsg(size_t size, int type)` using the previously acquired message size for `size` and `0` for `type`] */
-        if (NULL == (message_buffer = nn_allocmsg(message_size, 0))) {
-            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to allocate memory, `send_control_reply` shall return a non-zero value] */
+        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_message` allocate the necessary space for the nano message, by calling `void * nn_allocmsg(size_t size, int type)` using the previously acquired message size for `size` and `0` for `type`] */
+        if (NULL == (message_buffer = nn_allocmsg(header_size + message_size, 0))) {
+            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to allocate memory, `send_control_message` shall return a non-zero value] */
             LogError("%s: Unable to allocate message!", __FUNCTION__);
             result = __LINE__;
-        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` shall serialize a creation reply indicating the creation status by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
-        } else if (0 > ControlMessage_ToByteArray((CONTROL_MESSAGE *)&reply, message_buffer, message_size)) {
-            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to serialize the creation message reply, `send_control_reply` shall return a non-zero value] */
+        /* Codes_SRS_PROXY_GATEWAY_027_107: [Every frame sent on behalf of a hosted module shall start with its module id, written by calling `int32_t MessageMux_WriteHeader(uint32_t module_id, unsigned char * buf, int32_t size)`, and be sent on the channels of its proxy gateway] */
+        } else if (0 != header_size && 0 > MessageMux_WriteHeader(remote_module->module_id, message_buffer, header_size)) {
+            LogError("%s: Unable to write the module id!", __FUNCTION__);
+            result = __LINE__;
+            nn_freemsg(message_buffer);
+        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_message` shall serialize the control message by calling `size_t ControlMessage_ToByteArray(CONTROL MESSAGE * message, unsigned char * buf, size_t size)`] */
+        } else if (0 > ControlMessage_ToByteArray(message, message_buffer + header_size, message_size)) {
+            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to serialize the control message, `send_control_message` shall return a non-zero value] */
             LogError("%s: Unable to serialize message!", __FUNCTION__);
             result = __LINE__;
-        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_reply` shall send the serialized message by calling `int nn_send(int s, const void * buf, size_t len, int flags)` using the serialized message as the `buf` parameter and the value returned from `ControlMessage_ToByteArray` as `len`] */
-        } else if (0 > (message_size = nn_send(remote_module->control_socket, &message_buffer, NN_MSG, NN_DONTWAIT))) {
-            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to send the serialized message, `send_control_reply` shall release the nano message by calling `int nn_freemsg(void * msg)` using the previously acquired nano message pointer as `msg` and return a non-zero value] */
+        /* SRS_PROXY_GATEWAY_027_0xx: [`send_control_message` shall send the serialized message by calling `int nn_send(int s, const void * buf, size_t len, int flags)` using the serialized message as the `buf` parameter and the value returned from `ControlMessage_ToByteArray` as `len`] */
+        } else if (0 > (message_size = nn_send(control_socket, &message_buffer, NN_MSG, NN_DONTWAIT))) {
+            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to send the serialized message, `send_control_message` shall release the nano message by calling `int nn_freemsg(void * msg)` using the previously acquired nano message pointer as `msg` and return a non-zero value] */
             LogError("%s: Unable to send message to gateway process!", __FUNCTION__);
             result = __LINE__;
             nn_freemsg(message_buffer);
         } else {
-            /* SRS_PROXY_GATEWAY_027_0xx: [If no errors are encountered, `send_control_reply` shall return zero] */
+            /* SRS_PROXY_GATEWAY_027_0xx: [If no errors are encountered, `send_control_message` shall return zero] */
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+
+/* SRS_PROXY_GATEWAY_027_0xx: [`send_message_batch` shall be called with the batch mutex held] */
+int
+send_message_batch (
+    REMOTE_MODULE_HANDLE remote_module
+) {
+    int result;
+    int32_t batch_size;
+    void * nn_msg;
+
+    /* SRS_PROXY_GATEWAY_027_0xx: [`send_message_batch` shall calculate the serialized batch size by calling `int32_t MessageBatch_ToByteArray(MESSAGE_BATCH_HANDLE batch, unsigned char * buf, int32_t size)` with `NULL` for `buf`] */
+    if (0 > (batch_size = MessageBatch_ToByteArray(remote_module->message_batch, NULL, 0))) {
+        LogError("%s: Unable to calculate serialized batch size!", __FUNCTION__);
+        result = __LINE__;
+    /* SRS_PROXY_GATEWAY_027_0xx: [`send_message_batch` shall allocate the nano message by calling `void * nn_allocmsg(size_t size, int type)`] */
+    } else if (NULL == (nn_msg = nn_allocmsg(batch_size, 0))) {
+        LogError("%s: Unable to allocate message!", __FUNCTION__);
+        result = __LINE__;
+    } else {
+        (void)MessageBatch_ToByteArray(remote_module->message_batch, (unsigned char *)nn_msg, batch_size);
+        /* SRS_PROXY_GATEWAY_027_0xx: [`send_message_batch` shall send the batch on the message channel by calling `int nn_send(int s, const void * buf, size_t len, int flags)`] */
+        if (batch_size != nn_send(remote_module->message_socket, &nn_msg, NN_MSG, 0)) {
+            /* SRS_PROXY_GATEWAY_027_0xx: [If unable to send the batch, `send_message_batch` shall release the nano message and return a non-zero value] */
+            LogError("%s: Unable to send message batch to gateway process!", __FUNCTION__);
+            result = __LINE__;
+            nn_freemsg(nn_msg);
+        } else {
             result = 0;
         }
     }
+    /* SRS_PROXY_GATEWAY_027_0xx: [`send_message_batch` shall empty the batch, whether or not it was sent] */
+    MessageBatch_Clear(remote_module->message_batch);
 
     return result;
 }
 
 
+int
+send_trace_report (
+    REMOTE_MODULE_HANDLE remote_module,
+    const MESSAGE_TRACE * trace
+) {
+    int result;
+    int32_t report_size;
+    void * nn_msg;
+    const int32_t header_size = ((NULL == remote_module->host) ? 0 : MESSAGE_MUX_HEADER_SIZE);
+    const int message_socket = ((NULL == remote_module->host) ? remote_module->message_socket : remote_module->host->message_socket);
+
+    /* Codes_SRS_PROXY_GATEWAY_027_086: [`send_trace_report` shall calculate the trace report size by calling `int32_t MessageTrace_ToReport(const MESSAGE_TRACE * trace, unsigned char * buf, int32_t size)` with `NULL` for `buf`] */
+    if (0 > (report_size = MessageTrace_ToReport(trace, NULL, 0))) {
+        LogError("%s: Unable to calculate trace report size!", __FUNCTION__);
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_027_087: [`send_trace_report` shall allocate the nano message by calling `void * nn_allocmsg(size_t size, int type)`] */
+    } else if (NULL == (nn_msg = nn_allocmsg(header_size + report_size, 0))) {
+        LogError("%s: Unable to allocate message!", __FUNCTION__);
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_027_107: [Every frame sent on behalf of a hosted module shall start with its module id, written by calling `int32_t MessageMux_WriteHeader(uint32_t module_id, unsigned char * buf, int32_t size)`, and be sent on the channels of its proxy gateway] */
+    } else if (0 != header_size && 0 > MessageMux_WriteHeader(remote_module->module_id, (unsigned char *)nn_msg, header_size)) {
+        LogError("%s: Unable to write the module id!", __FUNCTION__);
+        result = __LINE__;
+        nn_freemsg(nn_msg);
+    } else {
+        (void)MessageTrace_ToReport(trace, (unsigned char *)nn_msg + header_size, report_size);
+        report_size += header_size;
+        /* Codes_SRS_PROXY_GATEWAY_027_088: [`send_trace_report` shall send the trace report on the message channel by calling `int nn_send(int s, const void * buf, size_t len, int flags)`, and release the nano message if it cannot be sent] */
+        if (report_size != nn_send(message_socket, &nn_msg, NN_MSG, 0)) {
+            LogError("%s: Unable to send trace report to gateway process!", __FUNCTION__);
+            result = __LINE__;
+            nn_freemsg(nn_msg);
+        } else {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+
+void
+deliver_message_frame (
+    void * context,
+    const unsigned char * frame,
+    size_t frame_size
+) {
+    REMOTE_MODULE_HANDLE remote_module = (REMOTE_MODULE_HANDLE)context;
+    MESSAGE_HANDLE structured_module_message;
+    MESSAGE_TRACE trace = { 0 };
+    int32_t message_size;
+
+    /* Codes_SRS_PROXY_GATEWAY_027_081: [Message Channel - `ProxyGateway_DoWork` shall separate the gateway message from any trace trailer by calling `int32_t MessageTrace_SplitFrame(const unsigned char * source, size_t size, MESSAGE_TRACE * trace)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+    if (0 > (message_size = MessageTrace_SplitFrame(frame, frame_size, &trace))) {
+        /* Codes_SRS_PROXY_GATEWAY_027_082: [Message Channel - If the trace trailer is malformed, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
+        LogError("%s: Unable to read message trace!", __FUNCTION__);
+    } else {
+        if (0 != trace.count) {
+            /* Codes_SRS_PROXY_GATEWAY_027_083: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall stamp the receive hop by calling `int MessageTrace_Stamp(MESSAGE_TRACE * trace)`] */
+            (void)MessageTrace_Stamp(&trace);
+        }
+        /* Codes_SRS_PROXY_GATEWAY_027_040: [Message Channel - If a module message was received, then `ProxyGateway_DoWork` will parse that message by calling `MESSAGE_HANDLE Message_CreateFromByteArray(const unsigned char * source, int32_t size)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+        if (NULL == (structured_module_message = Message_CreateFromByteArray(frame, message_size))) {
+            /* Codes_SRS_PROXY_GATEWAY_027_041: [Message Channel - If unable to parse the module message, then `ProxyGateway_DoWork` shall free any previously allocated memory and abandon the message channel request] */
+            LogError("%s: Unable to parse control message!", __FUNCTION__);
+        } else {
+            if (0 != trace.count) {
+                /* Codes_SRS_PROXY_GATEWAY_027_084: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall stamp the module receive entry and exit hops around the call to `Module_Receive`] */
+                (void)MessageTrace_Stamp(&trace);
+            }
+            /* Codes_SRS_PROXY_GATEWAY_027_042: [Message Channel - `ProxyGateway_DoWork` shall pass the structured message to the module by calling `void Module_Receive(MODULE_HANDLE moduleHandle)` using the parsed message as `moduleHandle`] */
+            ((MODULE_API_1 *)remote_module->module.module_apis)->Module_Receive(remote_module->module.module_handle, structured_module_message);
+            if (0 != trace.count) {
+                (void)MessageTrace_Stamp(&trace);
+                /* Codes_SRS_PROXY_GATEWAY_027_085: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall return the trace to the gateway in a trace report] */
+                (void)send_trace_report(remote_module, &trace);
+            }
+            /* Codes_SRS_PROXY_GATEWAY_027_043: [Message Channel - `ProxyGateway_DoWork` shall free the resources held by the parsed module message by calling `void Message_Destroy(MESSAGE_HANDLE * message)` using the parsed module message as `message`] */
+            Message_Destroy(structured_module_message);
+        }
+    }
+}
+
+
+REMOTE_MODULE_HANDLE
+find_hosted_module (
+    REMOTE_MODULE_HANDLE remote_module,
+    uint32_t module_id,
+    bool create
+) {
+    REMOTE_MODULE_HANDLE hosted_module;
+
+    for (hosted_module = remote_module->hosted_modules; NULL != hosted_module && module_id != hosted_module->module_id; hosted_module = hosted_module->next_hosted_module) {}
+
+    if (NULL != hosted_module || !create) {
+        // found, or only looking
+    /* Codes_SRS_PROXY_GATEWAY_027_101: [Control Channel - If the control message carries a module id, then `ProxyGateway_DoWork` shall process it on behalf of the hosted module with that id, hosting a new module if the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE and no hosted module has that id] */
+    } else if (NULL == (hosted_module = (REMOTE_MODULE_HANDLE)calloc(1, sizeof(REMOTE_MODULE)))) {
+        LogError("%s: Unable to allocate memory!", __FUNCTION__);
+    } else {
+        hosted_module->module.module_apis = remote_module->module.module_apis;
+        hosted_module->control_socket = -1;
+        hosted_module->control_endpoint = -1;
+        hosted_module->message_socket = -1;
+        hosted_module->message_endpoint = -1;
+        hosted_module->host = remote_module;
+        hosted_module->module_id = module_id;
+        hosted_module->next_hosted_module = remote_module->hosted_modules;
+        remote_module->hosted_modules = hosted_module;
+    }
+
+    return hosted_module;
+}
+
+
+void
+release_hosted_module (
+    REMOTE_MODULE_HANDLE hosted_module
+) {
+    REMOTE_MODULE_HANDLE host = hosted_module->host;
+    REMOTE_MODULE_HANDLE * link;
+
+    for (link = &host->hosted_modules; NULL != *link && hosted_module != *link; link = &(*link)->next_hosted_module) {}
+    if (NULL != *link) {
+        *link = hosted_module->next_hosted_module;
+    }
+    free(hosted_module);
+
+    if (NULL == host->hosted_modules && NULL == host->module.module_handle && 0 <= host->message_socket) {
+        /* Codes_SRS_PROXY_GATEWAY_027_109: [Once its last hosted module is released, and it has no module of its own, the proxy gateway shall disconnect from the shared message channel] */
+        disconnect_from_message_channel(host);
+    }
+
+    return;
+}
+
+
+int
+start_worker_thread (
+    REMOTE_MODULE_HANDLE remote_module,
+    THREAD_START_FUNC thread_func
+) {
+    int result;
+
+    if (NULL == remote_module) {
+        /* Codes_SRS_PROXY_GATEWAY_027_017: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_StartWorkerThread` shall do nothing and return a non-zero value] */
+        LogError("%s: NULL parameter - remote_module!", __FUNCTION__);
+        result = __LINE__;
+    } else if (NULL != remote_module->message_thread) {
+        /* Codes_SRS_PROXY_GATEWAY_027_018: [Prerequisite Check - If a work thread already exist for the given handle, then `ProxyGateway_StartWorkerThread` shall do nothing and return zero] */
+        LogInfo("%s: Worker thread has already been initialized.", __FUNCTION__);
+        result = 0;
+    /* Codes_SRS_PROXY_GATEWAY_027_019: [`ProxyGateway_StartWorkerThread` shall allocate the memory required to support the worker thread] */
+    } else if (NULL == (remote_module->message_thread = (MESSAGE_THREAD_HANDLE)calloc(1, sizeof(MESSAGE_THREAD)))) {
+        /* Codes_SRS_PROXY_GATEWAY_027_020: [If memory allocation fails for the worker thread data, then `ProxyGateway_StartWorkerThread` shall return a non-zero value] */
+        LogError("%s: Unable to allocate memory!", __FUNCTION__);
+        result = __LINE__;
+    /* Codes_SRS_PROXY_GATEWAY_027_021: [`ProxyGateway_StartWorkerThread` shall create a mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
+    } else if (NULL == (remote_module->message_thread->mutex = Lock_Init())) {
+        /* Codes_SRS_PROXY_GATEWAY_027_022: [If a mutex is unable to be created, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
+        LogError("%s: Unable to create mutex!", __FUNCTION__);
+        result = __LINE__;
+        free(remote_module->message_thread);
+        remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
+    /* Codes_SRS_PROXY_GATEWAY_027_023: [`ProxyGateway_StartWorkerThread` shall start a worker thread by calling `THREADAPI_RESULT ThreadAPI_Create(&THREAD_HANDLE threadHandle, THREAD_START_FUNC func, void * arg)` with an empty thread handle for `threadHandle`, a function that loops polling the messages for `func`, and `remote_module` for `arg`] */
+    } else if (THREADAPI_OK != ThreadAPI_Create(&remote_module->message_thread->thread, thread_func, remote_module)) {
+        /* Codes_SRS_PROXY_GATEWAY_027_024: [If the worker thread failed to start, then `ProxyGateway_StartWorkerThread` shall free any previously allocated memory and return a non-zero value] */
+        LogError("%s: Unable to create worker thread!", __FUNCTION__);
+        result = __LINE__;
+        (void)Lock_Deinit(remote_module->message_thread->mutex);
+        free(remote_module->message_thread);
+        remote_module->message_thread = (MESSAGE_THREAD_HANDLE)NULL;
+    } else {
+        /* Codes_SRS_PROXY_GATEWAY_027_025: [If no errors are encountered, then `ProxyGateway_StartWorkerThread` shall return zero] */
+        result = 0;
+    }
+
+	return result;
+}
+
+
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall obtain the thread mutex in order to initialize the thread by calling `LOCK_RESULT Lock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall return a non-zero value] */
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall release the thread mutex upon entering the loop by calling `LOCK_RESULT Unlock(LOCK_HANDLE handle)`] */
@@ -725,3 +1220,71 @@ worker_thread (
     return result;
 }
 
+
+int
+blocking_worker_thread (
+    void * thread_arg
+) {
+    static const int HALT_CHECK_INTERVAL_MS = 100;
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = (REMOTE_MODULE_HANDLE)thread_arg;
+
+    if (LOCK_ERROR == Lock(remote_module->message_thread->mutex)) {
+        LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+        result = __LINE__;
+    }
+    else {
+        result = 0;
+        remote_module->message_thread->halt = false;
+        for (; !remote_module->message_thread->halt;) {
+            if (LOCK_ERROR == Unlock(remote_module->message_thread->mutex)) {
+                LogError("%s: Failed to release mutex!", __FUNCTION__);
+                result = __LINE__;
+                break;
+            }
+            else {
+                struct nn_pollfd channels[2];
+                int channel_count = 0;
+                int timeout_ms = HALT_CHECK_INTERVAL_MS;
+
+                channels[channel_count].fd = remote_module->control_socket;
+                channels[channel_count].events = NN_POLLIN;
+                channels[channel_count].revents = 0;
+                ++channel_count;
+                if (0 <= remote_module->message_socket) {
+                    channels[channel_count].fd = remote_module->message_socket;
+                    channels[channel_count].events = NN_POLLIN;
+                    channels[channel_count].revents = 0;
+                    ++channel_count;
+                }
+                if (NULL != remote_module->message_batch && (uint32_t)timeout_ms > remote_module->batch_delay_ms) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_096: [If message batching is enabled, then `blocking_worker_thread` shall not wait longer than the batch delay, and no less than one millisecond] */
+                    timeout_ms = (0 == remote_module->batch_delay_ms) ? 1 : (int)remote_module->batch_delay_ms;
+                }
+
+                /* Codes_SRS_PROXY_GATEWAY_027_095: [`blocking_worker_thread` shall wait for a message on the control channel and, once connected, the message channel by calling `int nn_poll(struct nn_pollfd * fds, int nfds, int timeout)`, waking periodically to check for a halt signal] */
+                if (0 > nn_poll(channels, channel_count, timeout_ms) && EINTR != nn_errno()) {
+                    /* Codes_SRS_PROXY_GATEWAY_027_098: [If `nn_poll` fails for any reason other than an interruption, then `blocking_worker_thread` shall exit the thread and return a non-zero value] */
+                    LogError("%s: Unable to poll the gateway channels!", __FUNCTION__);
+                    result = __LINE__;
+                    break;
+                }
+                /* Codes_SRS_PROXY_GATEWAY_027_097: [Once `nn_poll` returns, `blocking_worker_thread` shall invoke processing by calling `void ProxyGateway_DoWork(REMOTE_MODULE_HANDLE remote_module)`] */
+                ProxyGateway_DoWork(remote_module);
+                if (LOCK_ERROR == Lock(remote_module->message_thread->mutex)) {
+                    LogError("%s: Failed to obtain mutex!", __FUNCTION__);
+                    result = __LINE__;
+                    break;
+                }
+            }
+        }
+        if (0 == result && LOCK_ERROR == Unlock(remote_module->message_thread->mutex)) {
+            LogError("%s: Failed to release mutex!", __FUNCTION__);
+            result = __LINE__;
+        }
+    }
+    ThreadAPI_Exit(result);
+
+    return result;
+}
+
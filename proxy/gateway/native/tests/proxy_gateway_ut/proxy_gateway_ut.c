@@ -74,6 +74,9 @@ non_mocked_free(
   #include "azure_c_shared_utility/threadapi.h"
   #include "control_message.h"
   #include "message.h"
+  #include "message_batch.h"
+  #include "message_mux.h"
+  #include "message_trace.h"
   #include "module.h"
 #undef ENABLE_MOCKS
 
@@ -132,6 +135,20 @@ worker_thread (
     void * thread_arg
 );
 
+extern
+REMOTE_MODULE_HANDLE
+find_hosted_module (
+    REMOTE_MODULE_HANDLE remote_module,
+    uint32_t module_id,
+    bool create
+);
+
+extern
+void
+release_hosted_module (
+    REMOTE_MODULE_HANDLE hosted_module
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -186,6 +203,22 @@ umockvalue_stringify_CONTROL_MESSAGE (
             strcpy(result, buffer);
             break;
           }
+          case CONTROL_MESSAGE_TYPE_MODULE_CREDIT:
+          {
+            const CONTROL_MESSAGE_MODULE_CREDIT * value = (CONTROL_MESSAGE_MODULE_CREDIT *)*value_;
+            len = sprintf(
+                buffer,
+                "CONTROL_MESSAGE_MODULE_CREDIT {\n\t.base {\n\t\t.type: %u\n\t\t.version: %u\n\t}\n\t.message_credits: %u\n\t.byte_credits: %u\n}\n",
+                (uint8_t)value->base.type,
+                (uint8_t)value->base.version,
+                value->message_credits,
+                value->byte_credits
+            );
+
+            result = (char *)non_mocked_malloc(len + 1);
+            strcpy(result, buffer);
+            break;
+          }
           case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
             len = sprintf(
                 buffer,
@@ -262,6 +295,18 @@ umockvalue_are_equal_CONTROL_MESSAGE (
             match = (match && (left->status == right->status));
             break;
           }
+          case CONTROL_MESSAGE_TYPE_MODULE_CREDIT:
+          {
+            const CONTROL_MESSAGE_MODULE_CREDIT * left = (CONTROL_MESSAGE_MODULE_CREDIT *)*left_;
+            const CONTROL_MESSAGE_MODULE_CREDIT * right = (CONTROL_MESSAGE_MODULE_CREDIT *)*right_;
+            match = true;
+
+            match = (match && (left->base.type == right->base.type));
+            match = (match && (left->base.version == right->base.version));
+            match = (match && (left->message_credits == right->message_credits));
+            match = (match && (left->byte_credits == right->byte_credits));
+            break;
+          }
           case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
           case CONTROL_MESSAGE_TYPE_MODULE_START:
           default:
@@ -338,6 +383,20 @@ umockvalue_copy_CONTROL_MESSAGE (
                 }
             }
             break;
+          case CONTROL_MESSAGE_TYPE_MODULE_CREDIT:
+            if (NULL == (*destination_ = (CONTROL_MESSAGE *)non_mocked_malloc(sizeof(CONTROL_MESSAGE_MODULE_CREDIT)))) {
+                result = __LINE__;
+            } else {
+                CONTROL_MESSAGE_MODULE_CREDIT * destination = (CONTROL_MESSAGE_MODULE_CREDIT *)*destination_;
+                const CONTROL_MESSAGE_MODULE_CREDIT * source = (const CONTROL_MESSAGE_MODULE_CREDIT *)*source_;
+
+                destination->base.type = source->base.type;
+                destination->base.version = source->base.version;
+                destination->message_credits = source->message_credits;
+                destination->byte_credits = source->byte_credits;
+                result = 0;
+            }
+            break;
           case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
           case CONTROL_MESSAGE_TYPE_MODULE_START:
           default:
@@ -379,6 +438,7 @@ umockvalue_free_CONTROL_MESSAGE (
           case CONTROL_MESSAGE_TYPE_MODULE_DESTROY:
           case CONTROL_MESSAGE_TYPE_MODULE_REPLY:
           case CONTROL_MESSAGE_TYPE_MODULE_START:
+          case CONTROL_MESSAGE_TYPE_MODULE_CREDIT:
           default:
             non_mocked_free(*value_);
             break;
@@ -403,6 +463,12 @@ MOCK_FUNCTION_END(0)
 MOCK_FUNCTION_WITH_CODE(, int, nn_freemsg, void *, msg)
 MOCK_FUNCTION_END(0)
 
+MOCK_FUNCTION_WITH_CODE(, int, nn_getsockopt, int, s, int, level, int, option, void *, optval, size_t *, optvallen)
+MOCK_FUNCTION_END(0)
+
+MOCK_FUNCTION_WITH_CODE(, int, nn_poll, struct nn_pollfd *, fds, int, nfds, int, timeout)
+MOCK_FUNCTION_END(0)
+
 MOCK_FUNCTION_WITH_CODE(, int, nn_recv, int, s, void *, buf, size_t, len, int, flags)
 MOCK_FUNCTION_END(0)
 
@@ -496,14 +562,14 @@ expected_calls_invoke_add_module_procedure (
 
 static
 void
-expected_calls_send_control_reply (
-    const CONTROL_MESSAGE_MODULE_REPLY * reply
+expected_calls_send_control_message (
+    const CONTROL_MESSAGE * message
 ) {
     static void * ALLOCATED_MEMORY_PTR = (void *)0xEBADF00D;
     static const int32_t MESSAGE_SIZE = 1979;
 
     enableNegativeTest(negative_test_index++);
-    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)reply, NULL, 0))
+    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)message, NULL, 0))
         .SetFailReturn(-1)
         .SetReturn(MESSAGE_SIZE);
     enableNegativeTest(negative_test_index++);
@@ -511,7 +577,7 @@ expected_calls_send_control_reply (
         .SetFailReturn(NULL)
         .SetReturn(ALLOCATED_MEMORY_PTR);
     enableNegativeTest(negative_test_index++);
-    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)reply, (unsigned char *)ALLOCATED_MEMORY_PTR, MESSAGE_SIZE))
+    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)message, (unsigned char *)ALLOCATED_MEMORY_PTR, MESSAGE_SIZE))
         .SetFailReturn(-1)
         .SetReturn(MESSAGE_SIZE);
     enableNegativeTest(negative_test_index++);
@@ -522,6 +588,14 @@ expected_calls_send_control_reply (
         .SetReturn(MESSAGE_SIZE);
 }
 
+static
+void
+expected_calls_send_control_reply (
+    const CONTROL_MESSAGE_MODULE_REPLY * reply
+) {
+    expected_calls_send_control_message((const CONTROL_MESSAGE *)reply);
+}
+
 static
 void
 expected_calls_process_module_create_message (
@@ -534,6 +608,24 @@ expected_calls_process_module_create_message (
     expected_calls_send_control_reply(reply);
 }
 
+/* hands the whole frame to the callback, as if it were every entry of the batch */
+static size_t batch_frames_to_deliver;
+
+static
+int
+mock_MessageBatch_ForEachFrame (
+    const unsigned char * source,
+    size_t size,
+    MESSAGE_BATCH_FRAME_CALLBACK callback,
+    void * context
+) {
+    size_t i;
+    for (i = 0; i < batch_frames_to_deliver; ++i) {
+        callback(context, source, size);
+    }
+    return 0;
+}
+
 static
 void
 on_umock_c_error (
@@ -568,6 +660,11 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(LOCK_RESULT, int);
     REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_BATCH_HANDLE, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_BATCH_CALLBACK, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_BATCH_FRAME_CALLBACK, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_TRACE_HISTOGRAM_HANDLE, void *);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_TRACE_HOP, int);
     REGISTER_UMOCK_ALIAS_TYPE(MODULE_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(REMOTE_MODULE_HANDLE, void *);
     REGISTER_UMOCK_ALIAS_TYPE(THREAD_HANDLE, void *);
@@ -584,6 +681,7 @@ TEST_SUITE_INITIALIZE(suite_init)
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_calloc, non_mocked_calloc);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, non_mocked_free);
     REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, non_mocked_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(MessageBatch_ForEachFrame, mock_MessageBatch_ForEachFrame);
 }
 
 TEST_SUITE_CLEANUP(suite_cleanup)
@@ -602,6 +700,7 @@ TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
     }
     negative_test_index = 0;
     negative_tests_to_skip = 0;
+    batch_frames_to_deliver = 0;
 }
 
 TEST_FUNCTION_CLEANUP(TestMethodCleanup)
@@ -1090,6 +1189,10 @@ TEST_FUNCTION(doWork_SCENARIO_create_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
@@ -1101,6 +1204,15 @@ TEST_FUNCTION(doWork_SCENARIO_create_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(false);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(NN_MESSAGE_SIZE);
     STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((MESSAGE_HANDLE)&CREATE_MESSAGE);
@@ -1118,6 +1230,237 @@ TEST_FUNCTION(doWork_SCENARIO_create_message_success)
     ProxyGateway_Detach(remote_module);
 }
 
+/* Tests_SRS_PROXY_GATEWAY_027_081: [Message Channel - `ProxyGateway_DoWork` shall separate the gateway message from any trace trailer by calling `int32_t MessageTrace_SplitFrame(const unsigned char * source, size_t size, MESSAGE_TRACE * trace)` with the buffer received from `nn_recv` as `source` and return value from `nn_recv` as `size`] */
+/* Tests_SRS_PROXY_GATEWAY_027_083: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall stamp the receive hop by calling `int MessageTrace_Stamp(MESSAGE_TRACE * trace)`] */
+/* Tests_SRS_PROXY_GATEWAY_027_084: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall stamp the module receive entry and exit hops around the call to `Module_Receive`] */
+/* Tests_SRS_PROXY_GATEWAY_027_085: [Message Channel - If the message is traced, then `ProxyGateway_DoWork` shall return the trace to the gateway in a trace report] */
+/* Tests_SRS_PROXY_GATEWAY_027_086: [`send_trace_report` shall calculate the trace report size by calling `int32_t MessageTrace_ToReport(const MESSAGE_TRACE * trace, unsigned char * buf, int32_t size)` with `NULL` for `buf`] */
+/* Tests_SRS_PROXY_GATEWAY_027_087: [`send_trace_report` shall allocate the nano message by calling `void * nn_allocmsg(size_t size, int type)`] */
+/* Tests_SRS_PROXY_GATEWAY_027_088: [`send_trace_report` shall send the trace report on the message channel by calling `int nn_send(int s, const void * buf, size_t len, int flags)`, and release the nano message if it cannot be sent] */
+TEST_FUNCTION(doWork_SCENARIO_traced_message_success)
+{
+    // Arrange
+	static const int COMMAND_SOCKET = 1979;
+
+    CONTROL_MESSAGE_MODULE_CREATE CREATE_MESSAGE = {
+        {
+            CONTROL_MESSAGE_VERSION_CURRENT,
+            CONTROL_MESSAGE_TYPE_MODULE_CREATE
+        },
+        GATEWAY_MESSAGE_VERSION_CURRENT,
+        {
+            sizeof("ipc://message_channel"),
+            NN_PAIR,
+            "ipc://message_channel"
+        },
+        sizeof("json_encoded_remote_module_parameters"),
+        "json_encoded_remote_module_parameters"
+    };
+    static const void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    static const int32_t GATEWAY_MESSAGE_SIZE = 1960;
+    static void * REPORT_BUFFER = (void *)0xDEADBEEF;
+    static const int32_t REPORT_SIZE = 52;
+    static const CONTROL_MESSAGE_MODULE_REPLY REPLY = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_REPLY
+        },
+        0
+    };
+    MESSAGE_TRACE trace = { 0 };
+    trace.count = 2;
+    trace.stamps[MESSAGE_TRACE_HOP_ENQUEUE] = 100;
+    trace.stamps[MESSAGE_TRACE_HOP_SEND] = 150;
+
+	EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+	EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR)).SetReturn(COMMAND_SOCKET);
+	EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG)).SetReturn(1);
+	EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
+    expected_calls_process_module_create_message(remote_module, &CREATE_MESSAGE, &REPLY);
+    STRICT_EXPECTED_CALL(ControlMessage_Destroy((CONTROL_MESSAGE *)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(false);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(3, &trace, sizeof(MESSAGE_TRACE))
+        .IgnoreArgument(3)
+        .SetReturn(GATEWAY_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, GATEWAY_MESSAGE_SIZE))
+        .SetReturn((MESSAGE_HANDLE)&CREATE_MESSAGE);
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mock_receive(MOCK_MODULE, (MESSAGE_HANDLE)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(MessageTrace_ToReport(IGNORED_PTR_ARG, NULL, 0))
+        .IgnoreArgument(1)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(REPORT_SIZE, 0))
+        .SetReturn(REPORT_BUFFER);
+    STRICT_EXPECTED_CALL(MessageTrace_ToReport(IGNORED_PTR_ARG, (unsigned char *)REPORT_BUFFER, REPORT_SIZE))
+        .IgnoreArgument(1)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(Message_Destroy((MESSAGE_HANDLE)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+
+    // Act
+    ProxyGateway_DoWork(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_110: [Message Channel - `ProxyGateway_DoWork` shall deliver each message in a batch as it delivers a single gateway message frame, so that traced messages in a batch are stamped and reported] */
+TEST_FUNCTION(doWork_SCENARIO_traced_message_in_batch_success)
+{
+    // Arrange
+	static const int COMMAND_SOCKET = 1979;
+
+    CONTROL_MESSAGE_MODULE_CREATE CREATE_MESSAGE = {
+        {
+            CONTROL_MESSAGE_VERSION_CURRENT,
+            CONTROL_MESSAGE_TYPE_MODULE_CREATE
+        },
+        GATEWAY_MESSAGE_VERSION_CURRENT,
+        {
+            sizeof("ipc://message_channel"),
+            NN_PAIR,
+            "ipc://message_channel"
+        },
+        sizeof("json_encoded_remote_module_parameters"),
+        "json_encoded_remote_module_parameters"
+    };
+    static const void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    static const int32_t GATEWAY_MESSAGE_SIZE = 1960;
+    static void * REPORT_BUFFER = (void *)0xDEADBEEF;
+    static const int32_t REPORT_SIZE = 52;
+    static const CONTROL_MESSAGE_MODULE_REPLY REPLY = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_REPLY
+        },
+        0
+    };
+    MESSAGE_TRACE trace = { 0 };
+    trace.count = 2;
+    trace.stamps[MESSAGE_TRACE_HOP_ENQUEUE] = 100;
+    trace.stamps[MESSAGE_TRACE_HOP_SEND] = 150;
+
+	EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+	EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+	EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR)).SetReturn(COMMAND_SOCKET);
+	EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG)).SetReturn(1);
+	EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    batch_frames_to_deliver = 1;
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
+    expected_calls_process_module_create_message(remote_module, &CREATE_MESSAGE, &REPLY);
+    STRICT_EXPECTED_CALL(ControlMessage_Destroy((CONTROL_MESSAGE *)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(true);
+    STRICT_EXPECTED_CALL(MessageBatch_ForEachFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG, remote_module))
+        .IgnoreArgument(3);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(3, &trace, sizeof(MESSAGE_TRACE))
+        .IgnoreArgument(3)
+        .SetReturn(GATEWAY_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, GATEWAY_MESSAGE_SIZE))
+        .SetReturn((MESSAGE_HANDLE)&CREATE_MESSAGE);
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(mock_receive(MOCK_MODULE, (MESSAGE_HANDLE)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(MessageTrace_Stamp(IGNORED_PTR_ARG))
+        .IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(MessageTrace_ToReport(IGNORED_PTR_ARG, NULL, 0))
+        .IgnoreArgument(1)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(REPORT_SIZE, 0))
+        .SetReturn(REPORT_BUFFER);
+    STRICT_EXPECTED_CALL(MessageTrace_ToReport(IGNORED_PTR_ARG, (unsigned char *)REPORT_BUFFER, REPORT_SIZE))
+        .IgnoreArgument(1)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, 0))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(REPORT_SIZE);
+    STRICT_EXPECTED_CALL(Message_Destroy((MESSAGE_HANDLE)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+
+    // Act
+    ProxyGateway_DoWork(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
 /* Tests_SRS_PROXY_GATEWAY_027_032: [Control Channel - If the message type is CONTROL_MESSAGE_TYPE_MODULE_START and `Module_Start` was provided, then `ProxyGateway_DoWork` shall call `void Module_Start(MODULE_HANDLE moduleHandle)`] */
 TEST_FUNCTION(doWork_SCENARIO_start_message_success)
 {
@@ -1160,6 +1503,10 @@ TEST_FUNCTION(doWork_SCENARIO_start_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
@@ -1179,6 +1526,10 @@ TEST_FUNCTION(doWork_SCENARIO_start_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&START_MESSAGE);
@@ -1190,6 +1541,15 @@ TEST_FUNCTION(doWork_SCENARIO_start_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(false);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(NN_MESSAGE_SIZE);
     STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((MESSAGE_HANDLE)&START_MESSAGE);
@@ -1232,6 +1592,10 @@ TEST_FUNCTION(doWork_SCENARIO_destroy_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&DESTROY_MESSAGE);
@@ -1340,6 +1704,10 @@ TEST_FUNCTION(doWork_SCENARIO_control_message_bad_parse)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn(NULL);
@@ -1394,6 +1762,10 @@ TEST_FUNCTION(doWork_SCENARIO_gateway_message_not_available)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
@@ -1456,6 +1828,10 @@ TEST_FUNCTION(doWork_SCENARIO_gateway_message_bad_parse)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
@@ -1467,6 +1843,15 @@ TEST_FUNCTION(doWork_SCENARIO_gateway_message_bad_parse)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(false);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(NN_MESSAGE_SIZE);
     STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn(NULL);
@@ -1482,22 +1867,195 @@ TEST_FUNCTION(doWork_SCENARIO_gateway_message_bad_parse)
     ProxyGateway_Detach(remote_module);
 }
 
-/* Tests_SRS_PROXY_GATEWAY_027_045: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_HaltWorkerThread` shall return a non-zero value] */
-TEST_FUNCTION(haltWorkerThread_SCENARIO_NULL_handle)
+/* Tests_SRS_PROXY_GATEWAY_027_073: [Message Channel - If the received frame is a message batch, then `ProxyGateway_DoWork` shall pass each message in the batch to the module, in order, by calling `int MessageBatch_ForEachFrame(const unsigned char * source, size_t size, MESSAGE_BATCH_FRAME_CALLBACK callback, void * context)`] */
+TEST_FUNCTION(doWork_SCENARIO_gateway_message_batch)
 {
     // Arrange
-    int result;
+    CONTROL_MESSAGE_MODULE_CREATE CREATE_MESSAGE = {
+        {
+            CONTROL_MESSAGE_VERSION_CURRENT,
+            CONTROL_MESSAGE_TYPE_MODULE_CREATE
+        },
+        GATEWAY_MESSAGE_VERSION_CURRENT,
+        {
+            sizeof("ipc://message_channel"),
+            NN_PAIR,
+            "ipc://message_channel"
+        },
+        sizeof("json_encoded_remote_module_parameters"),
+        "json_encoded_remote_module_parameters"
+    };
+    static const void * NN_MESSAGE_BUFFER = (void *)0xEBADF00D;
+    static const int32_t NN_MESSAGE_SIZE = 1979;
+    static const CONTROL_MESSAGE_MODULE_REPLY REPLY = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_REPLY
+        },
+        0
+    };
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
 
     // Expected call listing
     umock_c_reset_all_calls();
-
-    // Act
-    result = ProxyGateway_HaltWorkerThread(NULL);
-
-    // Assert
-    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
-    ASSERT_ARE_NOT_EQUAL(int, 0, result);
-
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
+        .IgnoreArgument(2)
+        .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
+    expected_calls_process_module_create_message(remote_module, &CREATE_MESSAGE, &REPLY);
+    STRICT_EXPECTED_CALL(ControlMessage_Destroy((CONTROL_MESSAGE *)&CREATE_MESSAGE));
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+    STRICT_EXPECTED_CALL(nn_recv(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .CopyOutArgumentBuffer(2, &NN_MESSAGE_BUFFER, sizeof(void *))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(true);
+    STRICT_EXPECTED_CALL(MessageBatch_ForEachFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG, remote_module))
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(nn_freemsg((void *)NN_MESSAGE_BUFFER));
+
+    // Act
+    ProxyGateway_DoWork(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_067: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_SetMessageBatching` shall do nothing and return a non-zero value] */
+TEST_FUNCTION(setMessageBatching_SCENARIO_NULL_handle)
+{
+    // Arrange
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_SetMessageBatching(NULL, 4096, 5);
+
+    // Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_069: [If `max_batch_size` is zero, then `ProxyGateway_SetMessageBatching` shall leave batching disabled and return zero] */
+TEST_FUNCTION(setMessageBatching_SCENARIO_zero_size_disables)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_SetMessageBatching(remote_module, 0, 5);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_068: [Prerequisite Check - If message batching has already been enabled, then `ProxyGateway_SetMessageBatching` shall do nothing and return a non-zero value] */
+/* Tests_SRS_PROXY_GATEWAY_027_070: [`ProxyGateway_SetMessageBatching` shall create a mutex by calling `LOCK_HANDLE Lock_Init(void)`] */
+/* Tests_SRS_PROXY_GATEWAY_027_072: [`ProxyGateway_SetMessageBatching` shall create a message batch by calling `MESSAGE_BATCH_HANDLE MessageBatch_Create(uint32_t max_size, uint32_t max_delay_ms)` using `max_batch_size` and `max_delay_ms`] */
+TEST_FUNCTION(setMessageBatching_SCENARIO_success)
+{
+    // Arrange
+    int result;
+    int second_result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn((LOCK_HANDLE)0x09171979);
+    STRICT_EXPECTED_CALL(MessageBatch_Create(4096, 5))
+        .SetReturn((MESSAGE_BATCH_HANDLE)0x19790917);
+
+    // Act
+    result = ProxyGateway_SetMessageBatching(remote_module, 4096, 5);
+    second_result = ProxyGateway_SetMessageBatching(remote_module, 4096, 5);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_NOT_EQUAL(int, 0, second_result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_071: [If any step fails, then `ProxyGateway_SetMessageBatching` shall free any previously allocated resources and return a non-zero value] */
+TEST_FUNCTION(setMessageBatching_SCENARIO_batch_create_fails)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(Lock_Init())
+        .SetReturn((LOCK_HANDLE)0x09171979);
+    STRICT_EXPECTED_CALL(MessageBatch_Create(4096, 5))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Lock_Deinit((LOCK_HANDLE)0x09171979));
+
+    // Act
+    result = ProxyGateway_SetMessageBatching(remote_module, 4096, 5);
+
+    // Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_045: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_HaltWorkerThread` shall return a non-zero value] */
+TEST_FUNCTION(haltWorkerThread_SCENARIO_NULL_handle)
+{
+    // Arrange
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_HaltWorkerThread(NULL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+
     // Cleanup
 }
 
@@ -1898,6 +2456,151 @@ TEST_FUNCTION(detach_SCENARIO_success)
     // Cleanup
 }
 
+/* Tests_SRS_PROXY_GATEWAY_027_101: [Control Channel - If the control message carries a module id, then `ProxyGateway_DoWork` shall process it on behalf of the hosted module with that id, hosting a new module if the message type is CONTROL_MESSAGE_TYPE_MODULE_CREATE and no hosted module has that id] */
+TEST_FUNCTION(find_hosted_module_SCENARIO_success)
+{
+    // Arrange
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG))
+        .IgnoreArgument(2);
+
+    // Act
+    REMOTE_MODULE_HANDLE hosted_module = find_hosted_module(remote_module, 7, true);
+    REMOTE_MODULE_HANDLE found_module = find_hosted_module(remote_module, 7, false);
+    REMOTE_MODULE_HANDLE unknown_module = find_hosted_module(remote_module, 8, false);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_IS_NOT_NULL(hosted_module);
+    ASSERT_ARE_EQUAL(void_ptr, hosted_module, found_module);
+    ASSERT_IS_NULL(unknown_module);
+
+    // Cleanup
+    release_hosted_module(hosted_module);
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_106: [Hosted modules shall share the message channel of their proxy gateway, which `connect_to_message_channel` shall connect for the first hosted module only] */
+/* Tests_SRS_PROXY_GATEWAY_027_107: [Every frame sent on behalf of a hosted module shall start with its module id, written by calling `int32_t MessageMux_WriteHeader(uint32_t module_id, unsigned char * buf, int32_t size)`, and be sent on the channels of its proxy gateway] */
+TEST_FUNCTION(process_module_create_message_SCENARIO_hosted_module_success)
+{
+    // Arrange
+    static const CONTROL_MESSAGE_MODULE_CREATE CREATE_MESSAGE = {
+        {
+            CONTROL_MESSAGE_VERSION_CURRENT,
+            CONTROL_MESSAGE_TYPE_MODULE_CREATE
+        },
+        GATEWAY_MESSAGE_VERSION_CURRENT,
+        {
+            sizeof("ipc://message_channel"),
+            NN_PAIR,
+            "ipc://message_channel"
+        },
+        sizeof("json_encoded_remote_module_parameters"),
+        "json_encoded_remote_module_parameters"
+    };
+    static const CONTROL_MESSAGE_MODULE_REPLY REPLY = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_REPLY
+        },
+        0
+    };
+    static void * ALLOCATED_MEMORY_PTR = (void *)0xEBADF00D;
+    static const int32_t MESSAGE_SIZE = 1979;
+
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    REMOTE_MODULE_HANDLE hosted_module = find_hosted_module(remote_module, 7, true);
+    ASSERT_IS_NOT_NULL(hosted_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    expected_calls_connect_to_message_channel((const MESSAGE_URI *)&CREATE_MESSAGE.uri);
+    expected_calls_invoke_add_module_procedure(hosted_module, &CREATE_MESSAGE);
+    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)&REPLY, NULL, 0))
+        .SetReturn(MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(nn_allocmsg(MESSAGE_MUX_HEADER_SIZE + MESSAGE_SIZE, 0))
+        .SetReturn(ALLOCATED_MEMORY_PTR);
+    STRICT_EXPECTED_CALL(MessageMux_WriteHeader(7, (unsigned char *)ALLOCATED_MEMORY_PTR, MESSAGE_MUX_HEADER_SIZE))
+        .SetReturn(MESSAGE_MUX_HEADER_SIZE);
+    STRICT_EXPECTED_CALL(ControlMessage_ToByteArray((CONTROL_MESSAGE *)&REPLY, (unsigned char *)ALLOCATED_MEMORY_PTR + MESSAGE_MUX_HEADER_SIZE, MESSAGE_SIZE))
+        .SetReturn(MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(nn_send(IGNORED_NUM_ARG, IGNORED_PTR_ARG, NN_MSG, NN_DONTWAIT))
+        .IgnoreArgument(1)
+        .IgnoreArgument(2)
+        .SetReturn(MESSAGE_MUX_HEADER_SIZE + MESSAGE_SIZE);
+
+    // Act
+    result = process_module_create_message(hosted_module, &CREATE_MESSAGE);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_108: [`ProxyGateway_Detach` shall destroy every hosted module by calling `void Module_Destroy(MODULE_HANDLE moduleHandle)`, and free the memory dedicated to it] */
+TEST_FUNCTION(detach_SCENARIO_destroys_hosted_modules)
+{
+    // Arrange
+    static const CONTROL_MESSAGE_MODULE_CREATE CREATE_MESSAGE = {
+        {
+            CONTROL_MESSAGE_VERSION_CURRENT,
+            CONTROL_MESSAGE_TYPE_MODULE_CREATE
+        },
+        GATEWAY_MESSAGE_VERSION_CURRENT,
+        {
+            sizeof("ipc://message_channel"),
+            NN_PAIR,
+            "ipc://message_channel"
+        },
+        sizeof("json_encoded_remote_module_parameters"),
+        "json_encoded_remote_module_parameters"
+    };
+    static const CONTROL_MESSAGE_MODULE_REPLY REPLY = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_REPLY
+        },
+        (uint8_t)-1,
+    };
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+    REMOTE_MODULE_HANDLE hosted_module = find_hosted_module(remote_module, 7, true);
+    ASSERT_IS_NOT_NULL(hosted_module);
+    expected_calls_process_module_create_message(hosted_module, &CREATE_MESSAGE, &REPLY);
+    (void)process_module_create_message(hosted_module, &CREATE_MESSAGE);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(mock_destroy(MOCK_MODULE));
+    STRICT_EXPECTED_CALL(free(hosted_module));
+    expected_calls_send_control_reply((CONTROL_MESSAGE_MODULE_REPLY *)&REPLY);
+    STRICT_EXPECTED_CALL(ThreadAPI_Sleep(1000));
+    expected_calls_disconnect_from_message_channel();
+    EXPECTED_CALL(nn_shutdown(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_close(IGNORED_NUM_ARG));
+    STRICT_EXPECTED_CALL(free(remote_module));
+
+    // Act
+    ProxyGateway_Detach(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+}
+
 /* Tests_SRS_PROXY_GATEWAY_027_060: [If unable to halt the worker thread, `ProxyGateway_Detach` shall forcibly free the memory allocated to the worker thread] */
 TEST_FUNCTION(detach_SCENARIO_unable_to_halt_thread)
 {
@@ -2493,6 +3196,130 @@ TEST_FUNCTION(send_control_reply_SCENARIO_negative_tests)
     umock_c_negative_tests_deinit();
 }
 
+/* Tests_SRS_PROXY_GATEWAY_027_076: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_GrantCredits` shall do nothing and return a non-zero value] */
+TEST_FUNCTION(grantCredits_SCENARIO_NULL_handle)
+{
+    // Arrange
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_GrantCredits(NULL, 16, 4096);
+
+    // Assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_077: [If both `message_credits` and `byte_credits` are zero, then `ProxyGateway_GrantCredits` shall do nothing and return zero] */
+TEST_FUNCTION(grantCredits_SCENARIO_nothing_granted)
+{
+    // Arrange
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_GrantCredits(remote_module, 0, 0);
+
+    // Assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_078: [`ProxyGateway_GrantCredits` shall send a module credit message carrying `message_credits` and `byte_credits` on the control channel] */
+/* Tests_SRS_PROXY_GATEWAY_027_080: [If no errors are encountered, then `ProxyGateway_GrantCredits` shall return zero] */
+TEST_FUNCTION(grantCredits_SCENARIO_success)
+{
+    // Arrange
+    static const CONTROL_MESSAGE_MODULE_CREDIT CREDIT = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_CREDIT
+        },
+        16,
+        4096
+    };
+
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    expected_calls_send_control_message((const CONTROL_MESSAGE *)&CREDIT);
+
+    // Act
+    result = ProxyGateway_GrantCredits(remote_module, CREDIT.message_credits, CREDIT.byte_credits);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_079: [If unable to send the module credit message, then `ProxyGateway_GrantCredits` shall return a non-zero value] */
+TEST_FUNCTION(grantCredits_SCENARIO_negative_tests)
+{
+    // Arrange
+    int negativeTestsInitResult = umock_c_negative_tests_init();
+    ASSERT_ARE_EQUAL(int, 0, negativeTestsInitResult);
+
+    static const CONTROL_MESSAGE_MODULE_CREDIT CREDIT = {
+        {
+            CONTROL_MESSAGE_VERSION_1,
+            CONTROL_MESSAGE_TYPE_MODULE_CREDIT
+        },
+        16,
+        4096
+    };
+
+    int result;
+
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    expected_calls_send_control_message((const CONTROL_MESSAGE *)&CREDIT);
+    umock_c_negative_tests_snapshot();
+
+    ASSERT_ARE_EQUAL(int, negative_test_index, umock_c_negative_tests_call_count());
+    for (size_t i = 0; i < umock_c_negative_tests_call_count(); ++i) {
+        if (skipNegativeTest(i)) {
+            printf("%s: Skipping negative tests: %zx\n", __FUNCTION__, i);
+            continue;
+        }
+        printf("%s: Running negative tests: %zx\n", __FUNCTION__, i);
+        umock_c_negative_tests_reset();
+        umock_c_negative_tests_fail_call(i);
+
+        // Act
+        result = ProxyGateway_GrantCredits(remote_module, CREDIT.message_credits, CREDIT.byte_credits);
+
+        // Assert
+        ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    }
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+    umock_c_negative_tests_deinit();
+}
+
 /* Tests_SRS_BROKER_17_007: [ Broker_Publish shall clone the message. ] */
 /* Tests_SRS_BROKER_17_008: [ Broker_Publish shall serialize the message. ] */
 /* Tests_SRS_BROKER_17_010: [ Broker_Publish shall send a message on the publish_socket. ] */
@@ -2542,6 +3369,10 @@ TEST_FUNCTION(publish_SCENARIO_create_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
     STRICT_EXPECTED_CALL(ControlMessage_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((CONTROL_MESSAGE *)&CREATE_MESSAGE);
@@ -2553,6 +3384,15 @@ TEST_FUNCTION(publish_SCENARIO_create_message_success)
         .IgnoreArgument(1)
         .IgnoreArgument(2)
         .SetReturn(NN_MESSAGE_SIZE);
+    STRICT_EXPECTED_CALL(MessageMux_ReadHeader((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .IgnoreArgument(3)
+        .SetReturn(0);
+    STRICT_EXPECTED_CALL(MessageBatch_IsBatch((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE))
+        .SetReturn(false);
+    STRICT_EXPECTED_CALL(MessageTrace_SplitFrame((const unsigned char *)NN_MESSAGE_BUFFER, NN_MESSAGE_SIZE, IGNORED_PTR_ARG))
+        .IgnoreArgument(3)
+        .SetReturn(NN_MESSAGE_SIZE);
     STRICT_EXPECTED_CALL(Message_CreateFromByteArray((const unsigned char *)NN_MESSAGE_BUFFER, IGNORED_NUM_ARG))
         .IgnoreArgument(2)
         .SetReturn((MESSAGE_HANDLE)&CREATE_MESSAGE);
@@ -2571,6 +3411,143 @@ TEST_FUNCTION(publish_SCENARIO_create_message_success)
 }
 
 
+/* Tests_SRS_PROXY_GATEWAY_027_094: [`ProxyGateway_StartBlockingWorkerThread` shall start the worker thread in the same manner as `ProxyGateway_StartWorkerThread`, using a function that blocks until a channel has a message for `func`] */
+TEST_FUNCTION(startBlockingWorkerThread_SCENARIO_success)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    EXPECTED_CALL(gballoc_calloc(IGNORED_NUM_ARG, IGNORED_NUM_ARG));
+    EXPECTED_CALL(Lock_Init())
+        .SetReturn(MOCK_LOCK);
+    EXPECTED_CALL(ThreadAPI_Create(IGNORED_PTR_ARG, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .SetReturn(THREADAPI_OK);
+
+    // Act
+    result = ProxyGateway_StartBlockingWorkerThread(remote_module);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, 0, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_089: [Prerequisite Check - If the `remote_module` parameter is `NULL`, then `ProxyGateway_GetFd` shall return -1] */
+TEST_FUNCTION(getFd_SCENARIO_NULL_handle)
+{
+    // Arrange
+    int result;
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_GetFd(NULL, PROXY_GATEWAY_CONTROL_CHANNEL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, -1, result);
+
+    // Cleanup
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_091: [If the message channel is requested before the gateway has connected it, then `ProxyGateway_GetFd` shall return -1] */
+TEST_FUNCTION(getFd_SCENARIO_message_channel_not_connected)
+{
+    // Arrange
+    int result;
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+
+    // Act
+    result = ProxyGateway_GetFd(remote_module, PROXY_GATEWAY_MESSAGE_CHANNEL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, -1, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_092: [`ProxyGateway_GetFd` shall obtain the descriptor by calling `int nn_getsockopt(int s, int level, int option, void * optval, size_t * optvallen)` with the socket of `channel` for `s`, `NN_SOL_SOCKET` for `level` and `NN_RCVFD` for `option`] */
+TEST_FUNCTION(getFd_SCENARIO_success)
+{
+    // Arrange
+    static const int COMMAND_SOCKET = 1979;
+    static const int RECEIVE_FD = 17;
+    int result;
+
+    EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR)).SetReturn(COMMAND_SOCKET);
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_getsockopt(COMMAND_SOCKET, NN_SOL_SOCKET, NN_RCVFD, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .CopyOutArgumentBuffer(4, &RECEIVE_FD, sizeof(int))
+        .IgnoreArgument(4)
+        .IgnoreArgument(5)
+        .SetReturn(0);
+
+    // Act
+    result = ProxyGateway_GetFd(remote_module, PROXY_GATEWAY_CONTROL_CHANNEL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, RECEIVE_FD, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+/* Tests_SRS_PROXY_GATEWAY_027_093: [If unable to obtain the descriptor, then `ProxyGateway_GetFd` shall return -1] */
+TEST_FUNCTION(getFd_SCENARIO_getsockopt_fails)
+{
+    // Arrange
+    static const int COMMAND_SOCKET = 1979;
+    int result;
+
+    EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG));
+    EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG));
+    EXPECTED_CALL(nn_socket(AF_SP, NN_PAIR)).SetReturn(COMMAND_SOCKET);
+    EXPECTED_CALL(nn_bind(IGNORED_NUM_ARG, IGNORED_PTR_ARG)).SetReturn(1);
+    EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG));
+    REMOTE_MODULE_HANDLE remote_module = ProxyGateway_Attach((MODULE_API *)&MOCK_MODULE_APIS, "proxy_gateway_ut");
+    ASSERT_IS_NOT_NULL(remote_module);
+
+    // Expected call listing
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(nn_getsockopt(COMMAND_SOCKET, NN_SOL_SOCKET, NN_RCVFD, IGNORED_PTR_ARG, IGNORED_PTR_ARG))
+        .IgnoreArgument(4)
+        .IgnoreArgument(5)
+        .SetReturn(-1);
+
+    // Act
+    result = ProxyGateway_GetFd(remote_module, PROXY_GATEWAY_CONTROL_CHANNEL);
+
+    // Assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int, -1, result);
+
+    // Cleanup
+    ProxyGateway_Detach(remote_module);
+}
+
+
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall obtain the thread mutex in order to initialize the thread by calling `LOCK_RESULT Lock(LOCK_HANDLE handle)`] */
 /* SRS_PROXY_GATEWAY_027_0xx: [If unable to obtain the mutex, then `worker_thread` shall return a non-zero value] */
 /* SRS_PROXY_GATEWAY_027_0xx: [`worker_thread` shall release the thread mutex upon entering the loop by calling `LOCK_RESULT Unlock(LOCK_HANDLE handle)`] */
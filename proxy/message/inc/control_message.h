@@ -30,7 +30,8 @@ extern "C"
     CONTROL_MESSAGE_TYPE_MODULE_CREATE,  \
     CONTROL_MESSAGE_TYPE_MODULE_REPLY, \
     CONTROL_MESSAGE_TYPE_MODULE_START,   \
-    CONTROL_MESSAGE_TYPE_MODULE_DESTROY
+    CONTROL_MESSAGE_TYPE_MODULE_DESTROY, \
+    CONTROL_MESSAGE_TYPE_MODULE_CREDIT
 
 /** @brief    Enumeration specifying the various types of control messages that
  *            can be sent from a gateway process to a module host process.
@@ -114,6 +115,28 @@ typedef struct CONTROL_MESSAGE_MODULE_REPLY_TAG
     uint8_t status;
 }CONTROL_MESSAGE_MODULE_REPLY;
 
+/** @brief    Defines the structure of the message that is sent by the module
+ *            host to grant the gateway credits for sending gateway messages.
+ *
+ *  @details  Credits are added to the windows already granted. A window is
+ *            only enforced once a credit message carrying a non-zero value
+ *            for it has been received.
+ */
+typedef struct CONTROL_MESSAGE_MODULE_CREDIT_TAG
+{
+    /** @brief  The "base" message information.
+     */
+    CONTROL_MESSAGE base;
+
+    /** @brief  The number of gateway messages the gateway may send.
+     */
+    uint32_t message_credits;
+
+    /** @brief  The number of serialized bytes the gateway may send.
+     */
+    uint32_t byte_credits;
+}CONTROL_MESSAGE_MODULE_CREDIT;
+
 
 /** @brief      Creates a new control message from a byte array
  *              containing the serialized form.
@@ -0,0 +1,183 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       message_batch.h
+ *  @brief      Packs several serialized gateway messages into a single frame.
+ *
+ *  @details    A message batch is an envelope that carries many serialized
+ *              gateway messages in one nanomsg frame, so that a burst of small
+ *              messages crossing a process boundary costs a single
+ *              allocation and a single send. A batch is flushed by its owner
+ *              once it reaches a size threshold, or once the oldest message
+ *              in it has waited for the configured maximum delay.
+ */
+
+#ifndef MESSAGE_BATCH_H
+#define MESSAGE_BATCH_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "message.h"
+#include "message_trace.h"
+#include "gateway_export.h"
+
+#define MESSAGE_BATCH_VERSION_1           0x01
+#define MESSAGE_BATCH_VERSION_CURRENT     MESSAGE_BATCH_VERSION_1
+
+/** @brief  Struct representing a batch of serialized messages waiting to be
+ *          sent.
+ */
+typedef struct MESSAGE_BATCH_TAG* MESSAGE_BATCH_HANDLE;
+
+/** @brief  Function called by ::MessageBatch_ForEach for every message found
+ *          in a batch frame. The message is destroyed once the callback
+ *          returns; the callback shall clone it if it needs to keep it.
+ */
+typedef void(*MESSAGE_BATCH_CALLBACK)(void* context, MESSAGE_HANDLE message);
+
+/** @brief  Function called by ::MessageBatch_ForEachFrame for every entry
+ *          found in a batch frame. @c frame holds the serialized message,
+ *          followed by its trace trailer if it was added with
+ *          ::MessageBatch_AddTracedMessage, and is only valid until the
+ *          callback returns.
+ */
+typedef void(*MESSAGE_BATCH_FRAME_CALLBACK)(void* context, const unsigned char* frame, size_t size);
+
+/** @brief      Creates an empty message batch.
+ *
+ *  @param      max_size        Size, in bytes, of the frame at which the
+ *                              batch is considered full.
+ *  @param      max_delay_ms    The longest time, in milliseconds, the oldest
+ *                              message may wait in the batch before a flush is
+ *                              due. Zero means a flush is due as soon as the
+ *                              batch holds a message.
+ *
+ *  @return     A non-NULL #MESSAGE_BATCH_HANDLE, or NULL upon failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT MESSAGE_BATCH_HANDLE, MessageBatch_Create, uint32_t, max_size, uint32_t, max_delay_ms);
+
+/** @brief      Destroys a message batch, discarding any message not yet
+ *              serialized into a frame.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to destroy.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessageBatch_Destroy, MESSAGE_BATCH_HANDLE, batch);
+
+/** @brief      Serializes a message and appends it to the batch.
+ *
+ *  @details    The message is not retained; the caller still owns it.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to append to.
+ *  @param      message The #MESSAGE_HANDLE to serialize.
+ *
+ *  @return     0 on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageBatch_AddMessage, MESSAGE_BATCH_HANDLE, batch, MESSAGE_HANDLE, message);
+
+/** @brief      Serializes a message, followed by its trace trailer, and
+ *              appends both to the batch.
+ *
+ *  @details    The receiver shall read such entries with
+ *              ::MessageBatch_ForEachFrame and separate the trailer with
+ *              ::MessageTrace_SplitFrame. The message is not retained; the
+ *              caller still owns it.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to append to.
+ *  @param      message The #MESSAGE_HANDLE to serialize.
+ *  @param      trace   The hops stamped so far.
+ *
+ *  @return     0 on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageBatch_AddTracedMessage, MESSAGE_BATCH_HANDLE, batch, MESSAGE_HANDLE, message, const MESSAGE_TRACE*, trace);
+
+/** @brief      Tells whether the batch has reached its size threshold.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to test.
+ *
+ *  @return     true if the serialized batch is at least @c max_size bytes.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT bool, MessageBatch_IsFull, MESSAGE_BATCH_HANDLE, batch);
+
+/** @brief      Tells whether the batch should be sent now.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to test.
+ *
+ *  @return     true if the batch holds at least one message and is either
+ *              full or its oldest message has waited @c max_delay_ms.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT bool, MessageBatch_IsFlushDue, MESSAGE_BATCH_HANDLE, batch);
+
+/** @brief      Writes the batch frame into a byte array.
+ *
+ *  @details    If @c buf is NULL, this function returns the size required for
+ *              the frame. The batch is left untouched; call
+ *              ::MessageBatch_Clear once the frame has been sent.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to serialize.
+ *  @param      buf     A byte array pointer in memory, or NULL.
+ *  @param      size    The size of @c buf.
+ *
+ *  @return     The size of the frame, or a negative value on error.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageBatch_ToByteArray, MESSAGE_BATCH_HANDLE, batch, unsigned char*, buf, int32_t, size);
+
+/** @brief      Empties the batch so that it can be filled again.
+ *
+ *  @param      batch   The #MESSAGE_BATCH_HANDLE to empty.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessageBatch_Clear, MESSAGE_BATCH_HANDLE, batch);
+
+/** @brief      Tells whether a received frame is a batch frame, as opposed to
+ *              a single serialized message.
+ *
+ *  @param      source  Pointer to the received frame.
+ *  @param      size    Size of the received frame.
+ *
+ *  @return     true if @c source starts with a batch header.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT bool, MessageBatch_IsBatch, const unsigned char*, source, size_t, size);
+
+/** @brief      Unpacks a batch frame, calling @c callback for every message.
+ *
+ *  @param      source      Pointer to the received frame.
+ *  @param      size        Size of the received frame.
+ *  @param      callback    Function called with each deserialized message.
+ *  @param      context     Passed unchanged to @c callback.
+ *
+ *  @return     0 if every message in the frame was delivered, a non-zero
+ *              value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageBatch_ForEach, const unsigned char*, source, size_t, size, MESSAGE_BATCH_CALLBACK, callback, void*, context);
+
+/** @brief      Walks a batch frame, calling @c callback with the raw bytes of
+ *              every entry.
+ *
+ *  @details    Unlike ::MessageBatch_ForEach, entries are not deserialized,
+ *              so any trace trailer is left for the callback to read.
+ *
+ *  @param      source      Pointer to the received frame.
+ *  @param      size        Size of the received frame.
+ *  @param      callback    Function called with each entry.
+ *  @param      context     Passed unchanged to @c callback.
+ *
+ *  @return     0 if every entry in the frame was delivered, a non-zero value
+ *              otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageBatch_ForEachFrame, const unsigned char*, source, size_t, size, MESSAGE_BATCH_FRAME_CALLBACK, callback, void*, context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MESSAGE_BATCH_H*/
@@ -0,0 +1,70 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       message_mux.h
+ *  @brief      Tags frames with the module they belong to, so that many
+ *              modules hosted by one process can share a single pair of
+ *              control and message channels.
+ *
+ *  @details    A multiplexed frame is any frame already exchanged between the
+ *              gateway and a module host (control message, gateway message,
+ *              message batch or trace report) preceded by a short header that
+ *              carries a module id. The id is chosen by the gateway when it
+ *              creates the module and is echoed by the module host on every
+ *              frame it sends back for that module.
+ */
+
+#ifndef MESSAGE_MUX_H
+#define MESSAGE_MUX_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stdint.h>
+#include <stddef.h>
+#endif
+
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "gateway_export.h"
+
+#define MESSAGE_MUX_VERSION_1           0x01
+#define MESSAGE_MUX_VERSION_CURRENT     MESSAGE_MUX_VERSION_1
+
+/** @brief  Size, in bytes, of the header preceding a multiplexed frame. */
+#define MESSAGE_MUX_HEADER_SIZE         7
+
+/** @brief      Writes the header tagging a frame with a module id.
+ *
+ *  @details    The frame itself is written by its own serializer, starting
+ *              @c MESSAGE_MUX_HEADER_SIZE bytes into the buffer, so that a
+ *              multiplexed frame still costs a single allocation.
+ *
+ *  @param      module_id   The module the frame belongs to.
+ *  @param      buf         A byte array pointer in memory.
+ *  @param      size        The size of @c buf.
+ *
+ *  @return     The size of the header, or a negative value on error.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageMux_WriteHeader, uint32_t, module_id, unsigned char*, buf, int32_t, size);
+
+/** @brief      Reads the module id of a received frame.
+ *
+ *  @param      source      Pointer to the received frame.
+ *  @param      size        Size of the received frame.
+ *  @param      module_id   Receives the module id of a multiplexed frame.
+ *
+ *  @return     The size of the header preceding the frame, zero if the frame
+ *              is not multiplexed, or a negative value if the header is
+ *              malformed.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageMux_ReadHeader, const unsigned char*, source, size_t, size, uint32_t*, module_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MESSAGE_MUX_H*/
@@ -0,0 +1,191 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/** @file       message_trace.h
+ *  @brief      Per-hop latency tracing of gateway messages crossing a process
+ *              boundary.
+ *
+ *  @details    A traced message carries monotonic timestamps, one per hop, in
+ *              a trailer appended after the serialized gateway message. The
+ *              module host adds its own timestamps and returns them to the
+ *              gateway in a trace report frame, where they are aggregated
+ *              into latency histograms. Timestamps are taken from the system
+ *              wide monotonic clock, so both processes must run on the same
+ *              machine for the intervals between them to be meaningful.
+ */
+
+#ifndef MESSAGE_TRACE_H
+#define MESSAGE_TRACE_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <cstddef>
+extern "C"
+{
+#else
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+#include "azure_c_shared_utility/macro_utils.h"
+#include "azure_c_shared_utility/umock_c_prod.h"
+
+#include "gateway_export.h"
+
+#define MESSAGE_TRACE_VERSION_1           0x01
+#define MESSAGE_TRACE_VERSION_CURRENT     MESSAGE_TRACE_VERSION_1
+
+#define MESSAGE_TRACE_HOP_VALUES \
+    MESSAGE_TRACE_HOP_ENQUEUE, \
+    MESSAGE_TRACE_HOP_SEND, \
+    MESSAGE_TRACE_HOP_RECEIVE, \
+    MESSAGE_TRACE_HOP_MODULE_ENTER, \
+    MESSAGE_TRACE_HOP_MODULE_EXIT, \
+    MESSAGE_TRACE_HOP_REPORT
+
+/** @brief  The points at which a traced message is stamped, in the order it
+ *          reaches them.
+ */
+DEFINE_ENUM(MESSAGE_TRACE_HOP, MESSAGE_TRACE_HOP_VALUES);
+
+#define MESSAGE_TRACE_HOP_COUNT       6
+#define MESSAGE_TRACE_BUCKET_COUNT    32
+
+/** @brief  The timestamps, in microseconds, collected for one message. Only
+ *          the first @c count hops are stamped.
+ */
+typedef struct MESSAGE_TRACE_TAG
+{
+    uint8_t count;
+    uint64_t stamps[MESSAGE_TRACE_HOP_COUNT];
+} MESSAGE_TRACE;
+
+/** @brief  Struct representing the latency histograms of traced messages. */
+typedef struct MESSAGE_TRACE_HISTOGRAM_TAG* MESSAGE_TRACE_HISTOGRAM_HANDLE;
+
+/** @brief      Reads the monotonic clock used to stamp hops.
+ *
+ *  @return     The current time in microseconds, from an arbitrary origin
+ *              shared by every process on the machine.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT uint64_t, MessageTrace_Now);
+
+/** @brief      Stamps the next hop of a trace with the current time.
+ *
+ *  @param      trace   The trace to stamp.
+ *
+ *  @return     0 on success, a non-zero value if every hop is already stamped.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageTrace_Stamp, MESSAGE_TRACE*, trace);
+
+/** @brief      Writes the trace as a trailer, to be appended after a
+ *              serialized gateway message.
+ *
+ *  @details    If @c buf is NULL, this function returns the size required for
+ *              the trailer.
+ *
+ *  @param      trace   The trace to serialize.
+ *  @param      buf     A byte array pointer in memory, or NULL.
+ *  @param      size    The size of @c buf.
+ *
+ *  @return     The size of the trailer, or a negative value on error.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageTrace_ToTrailer, const MESSAGE_TRACE*, trace, unsigned char*, buf, int32_t, size);
+
+/** @brief      Separates a received gateway message from its trace trailer.
+ *
+ *  @details    A frame without a trailer is a plain gateway message; @c trace
+ *              is then left with no hop stamped.
+ *
+ *  @param      source  Pointer to the received frame.
+ *  @param      size    Size of the received frame.
+ *  @param      trace   Receives the trace found in the trailer.
+ *
+ *  @return     The size of the gateway message at the start of the frame, or
+ *              a negative value if the trailer is malformed.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageTrace_SplitFrame, const unsigned char*, source, size_t, size, MESSAGE_TRACE*, trace);
+
+/** @brief      Writes the trace as a trace report frame.
+ *
+ *  @details    If @c buf is NULL, this function returns the size required for
+ *              the frame.
+ *
+ *  @param      trace   The trace to serialize.
+ *  @param      buf     A byte array pointer in memory, or NULL.
+ *  @param      size    The size of @c buf.
+ *
+ *  @return     The size of the frame, or a negative value on error.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int32_t, MessageTrace_ToReport, const MESSAGE_TRACE*, trace, unsigned char*, buf, int32_t, size);
+
+/** @brief      Tells whether a received frame is a trace report.
+ *
+ *  @param      source  Pointer to the received frame.
+ *  @param      size    Size of the received frame.
+ *
+ *  @return     true if @c source starts with a trace report header.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT bool, MessageTrace_IsReport, const unsigned char*, source, size_t, size);
+
+/** @brief      Reads the trace carried by a trace report frame.
+ *
+ *  @param      source  Pointer to the received frame.
+ *  @param      size    Size of the received frame.
+ *  @param      trace   Receives the trace.
+ *
+ *  @return     0 on success, a non-zero value if the frame is malformed.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageTrace_FromReport, const unsigned char*, source, size_t, size, MESSAGE_TRACE*, trace);
+
+/** @brief      Creates empty latency histograms, one for the interval ending
+ *              at each hop after the first.
+ *
+ *  @return     A non-NULL #MESSAGE_TRACE_HISTOGRAM_HANDLE, or NULL upon
+ *              failure.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT MESSAGE_TRACE_HISTOGRAM_HANDLE, MessageTrace_CreateHistogram);
+
+/** @brief      Destroys the histograms.
+ *
+ *  @param      histogram   The #MESSAGE_TRACE_HISTOGRAM_HANDLE to destroy.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessageTrace_DestroyHistogram, MESSAGE_TRACE_HISTOGRAM_HANDLE, histogram);
+
+/** @brief      Adds the intervals between consecutive hops of a trace to the
+ *              histograms.
+ *
+ *  @param      histogram   The #MESSAGE_TRACE_HISTOGRAM_HANDLE to update.
+ *  @param      trace       The trace to record.
+ *
+ *  @return     0 on success, a non-zero value otherwise.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT int, MessageTrace_Record, MESSAGE_TRACE_HISTOGRAM_HANDLE, histogram, const MESSAGE_TRACE*, trace);
+
+/** @brief      Reads one bucket of a histogram.
+ *
+ *  @details    Bucket 0 counts intervals under 1 microsecond; bucket @c n
+ *              counts intervals from 2^(n-1) up to 2^n microseconds. The last
+ *              bucket also counts every longer interval.
+ *
+ *  @param      histogram   The #MESSAGE_TRACE_HISTOGRAM_HANDLE to read.
+ *  @param      hop         The hop ending the interval.
+ *  @param      bucket      The bucket to read.
+ *
+ *  @return     The number of intervals counted in the bucket.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT uint64_t, MessageTrace_GetBucket, MESSAGE_TRACE_HISTOGRAM_HANDLE, histogram, MESSAGE_TRACE_HOP, hop, size_t, bucket);
+
+/** @brief      Logs a summary of every histogram.
+ *
+ *  @param      histogram   The #MESSAGE_TRACE_HISTOGRAM_HANDLE to log.
+ *  @param      name        Identifies the traced channel in the log.
+ */
+MOCKABLE_FUNCTION(, GATEWAY_EXPORT void, MessageTrace_LogHistogram, MESSAGE_TRACE_HISTOGRAM_HANDLE, histogram, const char*, name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*MESSAGE_TRACE_H*/
@@ -18,6 +18,7 @@ DEFINE_ENUM_STRINGS(CONTROL_MESSAGE_TYPE, CONTROL_MESSAGE_TYPE_VALUES);
 #define BASE_MESSAGE_SIZE 8
 #define BASE_CREATE_SIZE (BASE_MESSAGE_SIZE+10)
 #define BASE_CREATE_REPLY_SIZE (BASE_MESSAGE_SIZE+1)
+#define BASE_CREDIT_SIZE (BASE_MESSAGE_SIZE+8)
 
 static int parse_uint32_t(const unsigned char* source, size_t sourceSize, size_t position, int32_t *parsed, uint32_t* value)
 {
@@ -279,6 +280,30 @@ CONTROL_MESSAGE * ControlMessage_CreateFromByteArray(const unsigned char* source
                         }
                     }
                 }
+                else if (messageType == CONTROL_MESSAGE_TYPE_MODULE_CREDIT)
+                {
+					/*Codes_SRS_CONTROL_MESSAGE_17_039: [ If the total message size is not at least 16 bytes, then this function shall fail and return NULL. ]*/
+                    if (size < BASE_CREDIT_SIZE)
+                    {
+                        result = NULL;
+                    }
+                    else
+                    {
+						/*Codes_SRS_CONTROL_MESSAGE_17_038: [ This function shall allocate a CONTROL_MESSAGE_MODULE_CREDIT structure. ]*/
+                        result = (CONTROL_MESSAGE *)malloc(sizeof(CONTROL_MESSAGE_MODULE_CREDIT));
+                        if (result != NULL)
+                        {
+                            CONTROL_MESSAGE_MODULE_CREDIT * credit_msg = (CONTROL_MESSAGE_MODULE_CREDIT*)result;
+							/*Codes_SRS_CONTROL_MESSAGE_17_024: [ Upon valid reading of the byte stream, this function shall assign the message version and type into the CONTROL_MESSAGE base structure. ]*/
+                            result->version = messageVersion;
+                            result->type = messageType;
+							/*Codes_SRS_CONTROL_MESSAGE_17_040: [ This function shall read the message_credits and byte_credits from the byte stream. ]*/
+                            (void)parse_uint32_t(source, size, currentPosition, &parsed, &(credit_msg->message_credits));
+                            currentPosition += parsed;
+                            (void)parse_uint32_t(source, size, currentPosition, &parsed, &(credit_msg->byte_credits));
+                        }
+                    }
+                }
                 else if (
                         (messageType == CONTROL_MESSAGE_TYPE_MODULE_START) || 
                         (messageType == CONTROL_MESSAGE_TYPE_MODULE_DESTROY)
@@ -413,6 +438,11 @@ int32_t ControlMessage_ToByteArray(CONTROL_MESSAGE * message, unsigned char* buf
             result = 0;
             byteArraySize += 1; /* status */
         }
+        else if (message->type == CONTROL_MESSAGE_TYPE_MODULE_CREDIT)
+        {
+            result = 0;
+            byteArraySize += 8; /* message_credits, byte_credits */
+        }
         else if (
                  (message->type == CONTROL_MESSAGE_TYPE_MODULE_START) || 
                  (message->type == CONTROL_MESSAGE_TYPE_MODULE_DESTROY)
@@ -467,6 +497,19 @@ int32_t ControlMessage_ToByteArray(CONTROL_MESSAGE * message, unsigned char* buf
                     CONTROL_MESSAGE_MODULE_REPLY * reply_msg = 
                             (CONTROL_MESSAGE_MODULE_REPLY*)message;
                     buf[currentPosition++] = (reply_msg->status);
+                }
+                else if (message->type == CONTROL_MESSAGE_TYPE_MODULE_CREDIT)
+                {
+                    CONTROL_MESSAGE_MODULE_CREDIT * credit_msg =
+                            (CONTROL_MESSAGE_MODULE_CREDIT*)message;
+                    buf[currentPosition++] = (credit_msg->message_credits) >> 24;
+                    buf[currentPosition++] = ((credit_msg->message_credits) >> 16) & 0xFF;
+                    buf[currentPosition++] = ((credit_msg->message_credits) >> 8) & 0xFF;
+                    buf[currentPosition++] = (credit_msg->message_credits) & 0xFF;
+                    buf[currentPosition++] = (credit_msg->byte_credits) >> 24;
+                    buf[currentPosition++] = ((credit_msg->byte_credits) >> 16) & 0xFF;
+                    buf[currentPosition++] = ((credit_msg->byte_credits) >> 8) & 0xFF;
+                    buf[currentPosition++] = (credit_msg->byte_credits) & 0xFF;
                 }
 				/*Codes_SRS_CONTROL_MESSAGE_17_035: [ Upon success this function shall return the byte array size.*/
                 result = byteArraySize;
@@ -0,0 +1,473 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+#include "azure_c_shared_utility/tickcounter.h"
+
+#include "message_batch.h"
+#include "message_trace.h"
+
+#define FIRST_MESSAGE_BYTE 0xA1  /*0xA1 comes from (A)zure (I)oT*/
+#define SECOND_MESSAGE_BYTE 0x62 /*0x62 comes from (G)ateway (B)atch */
+#define BASE_BATCH_SIZE 11       /*header (2), version (1), total size (4), message count (4)*/
+#define ENTRY_HEADER_SIZE 4      /*size of one serialized message*/
+
+typedef struct MESSAGE_BATCH_TAG
+{
+    uint32_t max_size;
+    uint32_t max_delay_ms;
+    TICK_COUNTER_HANDLE ticks;
+    tickcounter_ms_t first_added;
+    uint32_t count;
+    unsigned char* entries;
+    size_t entries_size;
+    size_t entries_capacity;
+} MESSAGE_BATCH;
+
+static void write_uint32_t(unsigned char* destination, uint32_t value)
+{
+    destination[0] = (unsigned char)((value >> 24) & 0xFF);
+    destination[1] = (unsigned char)((value >> 16) & 0xFF);
+    destination[2] = (unsigned char)((value >> 8) & 0xFF);
+    destination[3] = (unsigned char)(value & 0xFF);
+}
+
+static uint32_t read_uint32_t(const unsigned char* source)
+{
+    return
+        ((uint32_t)source[0] << 24) |
+        ((uint32_t)source[1] << 16) |
+        ((uint32_t)source[2] << 8) |
+        ((uint32_t)source[3]);
+}
+
+static int reserve_entries(MESSAGE_BATCH* batch, size_t needed)
+{
+    int result;
+    if (batch->entries_size + needed <= batch->entries_capacity)
+    {
+        result = 0;
+    }
+    else
+    {
+        size_t new_capacity = (batch->entries_capacity == 0) ? batch->max_size : batch->entries_capacity;
+        while (new_capacity < batch->entries_size + needed)
+        {
+            new_capacity *= 2;
+        }
+        unsigned char* new_entries = (unsigned char*)realloc(batch->entries, new_capacity);
+        if (new_entries == NULL)
+        {
+            LogError("unable to grow message batch to %zu bytes", new_capacity);
+            result = __LINE__;
+        }
+        else
+        {
+            batch->entries = new_entries;
+            batch->entries_capacity = new_capacity;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+MESSAGE_BATCH_HANDLE MessageBatch_Create(uint32_t max_size, uint32_t max_delay_ms)
+{
+    MESSAGE_BATCH* result;
+    if (max_size <= BASE_BATCH_SIZE)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_001: [ If max_size is not larger than the batch header, this function shall fail and return NULL. ]*/
+        LogError("batch size %u is too small", max_size);
+        result = NULL;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_002: [ This function shall allocate memory for the batch. ]*/
+        result = (MESSAGE_BATCH*)malloc(sizeof(MESSAGE_BATCH));
+        if (result == NULL)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+            LogError("unable to allocate message batch");
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_003: [ This function shall create a tick counter to track the age of the oldest message in the batch. ]*/
+            result->ticks = tickcounter_create();
+            if (result->ticks == NULL)
+            {
+                /*Codes_SRS_MESSAGE_BATCH_17_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+                LogError("unable to create message batch tick counter");
+                free(result);
+                result = NULL;
+            }
+            else
+            {
+                result->max_size = max_size;
+                result->max_delay_ms = max_delay_ms;
+                result->first_added = 0;
+                result->count = 0;
+                result->entries = NULL;
+                result->entries_size = 0;
+                result->entries_capacity = 0;
+            }
+        }
+    }
+    return result;
+}
+
+void MessageBatch_Destroy(MESSAGE_BATCH_HANDLE batch)
+{
+    /*Codes_SRS_MESSAGE_BATCH_17_005: [ If batch is NULL, this function shall do nothing. ]*/
+    if (batch != NULL)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_006: [ This function shall release all resources held by the batch, discarding any pending message. ]*/
+        tickcounter_destroy(batch->ticks);
+        free(batch->entries);
+        free(batch);
+    }
+}
+
+static int add_entry(MESSAGE_BATCH* batch, MESSAGE_HANDLE message, const MESSAGE_TRACE* trace)
+{
+    int result;
+    int32_t message_size = Message_ToByteArray(message, NULL, 0);
+    int32_t trailer_size = (trace == NULL) ? 0 : MessageTrace_ToTrailer(trace, NULL, 0);
+    if (message_size < 0 || trailer_size < 0)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_009: [ If the message cannot be serialized, this function shall leave the batch unchanged and return a non-zero value. ]*/
+        LogError("unable to get serialized size of message [%p]", message);
+        result = __LINE__;
+    }
+    else if (BASE_BATCH_SIZE + batch->entries_size + ENTRY_HEADER_SIZE + (size_t)message_size + (size_t)trailer_size > INT32_MAX)
+    {
+        LogError("message [%p] does not fit in a batch frame", message);
+        result = __LINE__;
+    }
+    else if (reserve_entries(batch, ENTRY_HEADER_SIZE + (size_t)message_size + (size_t)trailer_size) != 0)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_009: [ If the message cannot be serialized, this function shall leave the batch unchanged and return a non-zero value. ]*/
+        result = __LINE__;
+    }
+    else
+    {
+        unsigned char* entry = batch->entries + batch->entries_size;
+        if (Message_ToByteArray(message, entry + ENTRY_HEADER_SIZE, message_size) != message_size)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_009: [ If the message cannot be serialized, this function shall leave the batch unchanged and return a non-zero value. ]*/
+            LogError("unable to serialize message [%p]", message);
+            result = __LINE__;
+        }
+        else if (trace != NULL && MessageTrace_ToTrailer(trace, entry + ENTRY_HEADER_SIZE + message_size, trailer_size) != trailer_size)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_031: [ If the trace trailer cannot be written, this function shall leave the batch unchanged and return a non-zero value. ]*/
+            LogError("unable to write trace trailer of message [%p]", message);
+            result = __LINE__;
+        }
+        else if (batch->count == 0 && tickcounter_get_current_ms(batch->ticks, &batch->first_added) != 0)
+        {
+            LogError("unable to sample tick counter");
+            result = __LINE__;
+        }
+        else
+        {
+            write_uint32_t(entry, (uint32_t)(message_size + trailer_size));
+            batch->entries_size += ENTRY_HEADER_SIZE + (size_t)message_size + (size_t)trailer_size;
+            batch->count++;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int MessageBatch_AddMessage(MESSAGE_BATCH_HANDLE batch, MESSAGE_HANDLE message)
+{
+    int result;
+    if (batch == NULL || message == NULL)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_007: [ If batch or message is NULL, this function shall fail and return a non-zero value. ]*/
+        LogError("invalid arguments batch=%p, message=%p", batch, message);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_008: [ This function shall serialize the message at the end of the batch, preceded by its serialized size. ]*/
+        result = add_entry(batch, message, NULL);
+        /*Codes_SRS_MESSAGE_BATCH_17_010: [ This function shall return zero upon success. ]*/
+    }
+    return result;
+}
+
+int MessageBatch_AddTracedMessage(MESSAGE_BATCH_HANDLE batch, MESSAGE_HANDLE message, const MESSAGE_TRACE* trace)
+{
+    int result;
+    if (batch == NULL || message == NULL || trace == NULL)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_029: [ If batch, message or trace is NULL, this function shall fail and return a non-zero value. ]*/
+        LogError("invalid arguments batch=%p, message=%p, trace=%p", batch, message, trace);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_030: [ This function shall serialize the message at the end of the batch followed by the trace trailer, both preceded by their combined size. ]*/
+        result = add_entry(batch, message, trace);
+        /*Codes_SRS_MESSAGE_BATCH_17_032: [ This function shall return zero upon success. ]*/
+    }
+    return result;
+}
+
+bool MessageBatch_IsFull(MESSAGE_BATCH_HANDLE batch)
+{
+    bool result;
+    if (batch == NULL)
+    {
+        LogError("batch is NULL");
+        result = false;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_011: [ This function shall return true when the size of the batch frame is at least max_size. ]*/
+        result = (BASE_BATCH_SIZE + batch->entries_size >= batch->max_size);
+    }
+    return result;
+}
+
+bool MessageBatch_IsFlushDue(MESSAGE_BATCH_HANDLE batch)
+{
+    bool result;
+    if (batch == NULL)
+    {
+        LogError("batch is NULL");
+        result = false;
+    }
+    else if (batch->count == 0)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_012: [ This function shall return false if the batch is empty. ]*/
+        result = false;
+    }
+    else if (MessageBatch_IsFull(batch) || batch->max_delay_ms == 0)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_013: [ This function shall return true if the batch is full. ]*/
+        result = true;
+    }
+    else
+    {
+        tickcounter_ms_t now;
+        if (tickcounter_get_current_ms(batch->ticks, &now) != 0)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_015: [ If the current time cannot be read, this function shall return true. ]*/
+            LogError("unable to sample tick counter, flushing batch");
+            result = true;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_014: [ This function shall return true if the oldest message in the batch has waited at least max_delay_ms. ]*/
+            result = (now - batch->first_added >= batch->max_delay_ms);
+        }
+    }
+    return result;
+}
+
+int32_t MessageBatch_ToByteArray(MESSAGE_BATCH_HANDLE batch, unsigned char* buf, int32_t size)
+{
+    int32_t result;
+    if (batch == NULL)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_016: [ If batch is NULL, this function shall return a negative value. ]*/
+        LogError("batch is NULL");
+        result = -1;
+    }
+    else
+    {
+        int32_t frame_size = (int32_t)(BASE_BATCH_SIZE + batch->entries_size);
+        if (buf == NULL)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_017: [ If buf is NULL, this function shall return the size of the batch frame. ]*/
+            result = frame_size;
+        }
+        else if (size < frame_size)
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_018: [ If size is smaller than the batch frame, this function shall return a negative value. ]*/
+            LogError("buffer of %d bytes cannot hold a batch frame of %d bytes", size, frame_size);
+            result = -1;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_BATCH_17_019: [ This function shall write the batch header 0xA1 0x62, the batch version, the frame size and the message count, followed by every serialized message. ]*/
+            buf[0] = FIRST_MESSAGE_BYTE;
+            buf[1] = SECOND_MESSAGE_BYTE;
+            buf[2] = MESSAGE_BATCH_VERSION_CURRENT;
+            write_uint32_t(buf + 3, (uint32_t)frame_size);
+            write_uint32_t(buf + 7, batch->count);
+            if (batch->entries_size > 0)
+            {
+                memcpy(buf + BASE_BATCH_SIZE, batch->entries, batch->entries_size);
+            }
+            result = frame_size;
+        }
+    }
+    return result;
+}
+
+void MessageBatch_Clear(MESSAGE_BATCH_HANDLE batch)
+{
+    if (batch != NULL)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_020: [ This function shall empty the batch and keep its buffer for reuse. ]*/
+        batch->count = 0;
+        batch->entries_size = 0;
+    }
+}
+
+bool MessageBatch_IsBatch(const unsigned char* source, size_t size)
+{
+    /*Codes_SRS_MESSAGE_BATCH_17_021: [ This function shall return true if source holds at least a batch header starting with 0xA1 0x62, false otherwise. ]*/
+    return
+        source != NULL &&
+        size >= BASE_BATCH_SIZE &&
+        source[0] == FIRST_MESSAGE_BYTE &&
+        source[1] == SECOND_MESSAGE_BYTE;
+}
+
+static int read_batch_header(const unsigned char* source, size_t size, uint32_t* count)
+{
+    int result;
+    if (source[2] != MESSAGE_BATCH_VERSION_1)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_023: [ If the batch version is not supported, this function shall return a non-zero value. ]*/
+        LogError("unsupported batch version %u", (unsigned int)source[2]);
+        result = __LINE__;
+    }
+    else if (read_uint32_t(source + 3) != size)
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_024: [ If the frame size in the header does not match size, this function shall return a non-zero value. ]*/
+        LogError("batch frame size mismatch");
+        result = __LINE__;
+    }
+    else
+    {
+        *count = read_uint32_t(source + 7);
+        result = 0;
+    }
+    return result;
+}
+
+/* moves position past the next entry of the frame, reporting where its bytes are */
+static int read_next_entry(const unsigned char* source, size_t size, size_t* position, const unsigned char** entry, uint32_t* entry_size)
+{
+    int result;
+    if (*position + ENTRY_HEADER_SIZE > size)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        *entry_size = read_uint32_t(source + *position);
+        *position += ENTRY_HEADER_SIZE;
+        if (*entry_size > size - *position || *entry_size > INT32_MAX)
+        {
+            result = __LINE__;
+        }
+        else
+        {
+            *entry = source + *position;
+            *position += *entry_size;
+            result = 0;
+        }
+    }
+    return result;
+}
+
+int MessageBatch_ForEach(const unsigned char* source, size_t size, MESSAGE_BATCH_CALLBACK callback, void* context)
+{
+    int result;
+    uint32_t count;
+    if (callback == NULL || !MessageBatch_IsBatch(source, size))
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_022: [ If callback is NULL or source is not a batch frame, this function shall return a non-zero value. ]*/
+        LogError("invalid arguments source=%p, size=%zu, callback=%p", source, size, callback);
+        result = __LINE__;
+    }
+    else if (read_batch_header(source, size, &count) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t position = BASE_BATCH_SIZE;
+        uint32_t i;
+        result = 0;
+        for (i = 0; i < count; i++)
+        {
+            const unsigned char* entry;
+            uint32_t message_size;
+            if (read_next_entry(source, size, &position, &entry, &message_size) != 0)
+            {
+                /*Codes_SRS_MESSAGE_BATCH_17_025: [ Reading past the end of the frame shall stop the iteration and return a non-zero value. ]*/
+                LogError("batch frame truncated at message %u of %u", i, count);
+                result = __LINE__;
+                break;
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGE_BATCH_17_026: [ This function shall deserialize each message in the frame, in order, and pass it to callback. ]*/
+                MESSAGE_HANDLE message = Message_CreateFromByteArray(entry, (int32_t)message_size);
+                if (message == NULL)
+                {
+                    /*Codes_SRS_MESSAGE_BATCH_17_027: [ A message that cannot be deserialized shall be skipped, and this function shall return a non-zero value. ]*/
+                    LogError("unable to deserialize message %u of %u in batch", i, count);
+                    result = __LINE__;
+                }
+                else
+                {
+                    callback(context, message);
+                    /*Codes_SRS_MESSAGE_BATCH_17_028: [ This function shall destroy each message once callback returns. ]*/
+                    Message_Destroy(message);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int MessageBatch_ForEachFrame(const unsigned char* source, size_t size, MESSAGE_BATCH_FRAME_CALLBACK callback, void* context)
+{
+    int result;
+    uint32_t count;
+    if (callback == NULL || !MessageBatch_IsBatch(source, size))
+    {
+        /*Codes_SRS_MESSAGE_BATCH_17_033: [ If callback is NULL or source is not a batch frame, this function shall return a non-zero value. ]*/
+        LogError("invalid arguments source=%p, size=%zu, callback=%p", source, size, callback);
+        result = __LINE__;
+    }
+    /*Codes_SRS_MESSAGE_BATCH_17_034: [ If the batch version is not supported, or the frame size in the header does not match size, this function shall return a non-zero value. ]*/
+    else if (read_batch_header(source, size, &count) != 0)
+    {
+        result = __LINE__;
+    }
+    else
+    {
+        size_t position = BASE_BATCH_SIZE;
+        uint32_t i;
+        result = 0;
+        for (i = 0; i < count; i++)
+        {
+            const unsigned char* entry;
+            uint32_t entry_size;
+            if (read_next_entry(source, size, &position, &entry, &entry_size) != 0)
+            {
+                /*Codes_SRS_MESSAGE_BATCH_17_035: [ Reading past the end of the frame shall stop the iteration and return a non-zero value. ]*/
+                LogError("batch frame truncated at frame %u of %u", i, count);
+                result = __LINE__;
+                break;
+            }
+            /*Codes_SRS_MESSAGE_BATCH_17_036: [ This function shall pass the bytes of each entry in the frame, in order, to callback without deserializing them. ]*/
+            callback(context, entry, entry_size);
+        }
+    }
+    return result;
+}
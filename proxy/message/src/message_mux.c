@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "message_mux.h"
+
+#define FIRST_MESSAGE_BYTE 0xA1  /*0xA1 comes from (A)zure (I)oT*/
+#define SECOND_MESSAGE_BYTE 0x6D /*0x6D comes from (M)ultiplexed */
+
+static void write_uint32_t(unsigned char* destination, uint32_t value)
+{
+    destination[0] = (unsigned char)((value >> 24) & 0xFF);
+    destination[1] = (unsigned char)((value >> 16) & 0xFF);
+    destination[2] = (unsigned char)((value >> 8) & 0xFF);
+    destination[3] = (unsigned char)(value & 0xFF);
+}
+
+static uint32_t read_uint32_t(const unsigned char* source)
+{
+    return
+        ((uint32_t)source[0] << 24) |
+        ((uint32_t)source[1] << 16) |
+        ((uint32_t)source[2] << 8) |
+        ((uint32_t)source[3]);
+}
+
+int32_t MessageMux_WriteHeader(uint32_t module_id, unsigned char* buf, int32_t size)
+{
+    int32_t result;
+    if (buf == NULL || size < MESSAGE_MUX_HEADER_SIZE)
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_001: [ If buf is NULL or size is smaller than the header, this function shall return a negative value. ]*/
+        LogError("invalid arguments buf=%p, size=%d", buf, (int)size);
+        result = -1;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_002: [ This function shall write the header 0xA1 0x6D, the mux version and the module id in big endian, and return the size of the header. ]*/
+        buf[0] = FIRST_MESSAGE_BYTE;
+        buf[1] = SECOND_MESSAGE_BYTE;
+        buf[2] = MESSAGE_MUX_VERSION_CURRENT;
+        write_uint32_t(buf + 3, module_id);
+        result = MESSAGE_MUX_HEADER_SIZE;
+    }
+    return result;
+}
+
+int32_t MessageMux_ReadHeader(const unsigned char* source, size_t size, uint32_t* module_id)
+{
+    int32_t result;
+    if (source == NULL || module_id == NULL)
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_003: [ If source or module_id is NULL, this function shall return a negative value. ]*/
+        LogError("invalid arguments source=%p, module_id=%p", source, module_id);
+        result = -1;
+    }
+    else if (size < 2 || source[0] != FIRST_MESSAGE_BYTE || source[1] != SECOND_MESSAGE_BYTE)
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_004: [ If source does not start with 0xA1 0x6D, this function shall leave module_id unchanged and return zero. ]*/
+        result = 0;
+    }
+    else if (size <= MESSAGE_MUX_HEADER_SIZE)
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_005: [ If source holds no frame after the header, this function shall return a negative value. ]*/
+        LogError("multiplexed frame is too short");
+        result = -1;
+    }
+    else if (source[2] != MESSAGE_MUX_VERSION_1)
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_006: [ If the mux version is not supported, this function shall return a negative value. ]*/
+        LogError("unsupported mux version %u", (unsigned int)source[2]);
+        result = -1;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_MUX_17_007: [ This function shall read the module id into module_id and return the size of the header. ]*/
+        *module_id = read_uint32_t(source + 3);
+        result = MESSAGE_MUX_HEADER_SIZE;
+    }
+    return result;
+}
@@ -0,0 +1,420 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef _WIN32
+/* clock_gettime is hidden by --std=c99 */
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "message_trace.h"
+
+DEFINE_ENUM_STRINGS(MESSAGE_TRACE_HOP, MESSAGE_TRACE_HOP_VALUES);
+
+#define FIRST_MESSAGE_BYTE 0xA1  /*0xA1 comes from (A)zure (I)oT*/
+#define SECOND_MESSAGE_BYTE 0x74 /*0x74 comes from (T)race */
+#define GATEWAY_MESSAGE_BYTE 0x60 /*second byte of a serialized gateway message*/
+#define GATEWAY_MESSAGE_HEADER_SIZE 6 /*header (2), total size (4)*/
+#define TRAILER_FOOTER_SIZE 4     /*count (1), version (1), trailer marker (2)*/
+#define REPORT_HEADER_SIZE 4      /*header (2), version (1), count (1)*/
+#define STAMP_SIZE 8
+
+typedef struct MESSAGE_TRACE_HISTOGRAM_TAG
+{
+    uint64_t buckets[MESSAGE_TRACE_HOP_COUNT][MESSAGE_TRACE_BUCKET_COUNT];
+} MESSAGE_TRACE_HISTOGRAM;
+
+static void write_uint64_t(unsigned char* destination, uint64_t value)
+{
+    int i;
+    for (i = 0; i < STAMP_SIZE; i++)
+    {
+        destination[i] = (unsigned char)((value >> (8 * (STAMP_SIZE - 1 - i))) & 0xFF);
+    }
+}
+
+static uint64_t read_uint64_t(const unsigned char* source)
+{
+    uint64_t value = 0;
+    int i;
+    for (i = 0; i < STAMP_SIZE; i++)
+    {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+static uint32_t read_uint32_t(const unsigned char* source)
+{
+    return
+        ((uint32_t)source[0] << 24) |
+        ((uint32_t)source[1] << 16) |
+        ((uint32_t)source[2] << 8) |
+        ((uint32_t)source[3]);
+}
+
+static size_t bucket_of(uint64_t interval)
+{
+    size_t bucket = 0;
+    while (interval > 0 && bucket < MESSAGE_TRACE_BUCKET_COUNT - 1)
+    {
+        interval >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+uint64_t MessageTrace_Now(void)
+{
+    uint64_t result;
+#ifdef _WIN32
+    /*Codes_SRS_MESSAGE_TRACE_17_001: [ This function shall return the system wide monotonic clock in microseconds. ]*/
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&counter))
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_002: [ If the clock cannot be read, this function shall return 0. ]*/
+        LogError("unable to read the performance counter");
+        result = 0;
+    }
+    else
+    {
+        result = (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+            (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / (uint64_t)frequency.QuadPart;
+    }
+#else
+    /*Codes_SRS_MESSAGE_TRACE_17_001: [ This function shall return the system wide monotonic clock in microseconds. ]*/
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_002: [ If the clock cannot be read, this function shall return 0. ]*/
+        LogError("unable to read the monotonic clock");
+        result = 0;
+    }
+    else
+    {
+        result = (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+    }
+#endif
+    return result;
+}
+
+int MessageTrace_Stamp(MESSAGE_TRACE* trace)
+{
+    int result;
+    if (trace == NULL || trace->count >= MESSAGE_TRACE_HOP_COUNT)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_003: [ If trace is NULL or every hop is already stamped, this function shall return a non-zero value. ]*/
+        LogError("unable to stamp trace [%p]", trace);
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_004: [ This function shall stamp the next hop of trace with the current time and return zero. ]*/
+        trace->stamps[trace->count] = MessageTrace_Now();
+        trace->count++;
+        result = 0;
+    }
+    return result;
+}
+
+int32_t MessageTrace_ToTrailer(const MESSAGE_TRACE* trace, unsigned char* buf, int32_t size)
+{
+    int32_t result;
+    if (trace == NULL || trace->count > MESSAGE_TRACE_HOP_COUNT)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_005: [ If trace is NULL or holds more stamps than there are hops, this function shall return a negative value. ]*/
+        LogError("invalid trace [%p]", trace);
+        result = -1;
+    }
+    else
+    {
+        int32_t trailer_size = (int32_t)(trace->count * STAMP_SIZE + TRAILER_FOOTER_SIZE);
+        if (buf == NULL)
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_006: [ If buf is NULL, this function shall return the size of the trailer. ]*/
+            result = trailer_size;
+        }
+        else if (size < trailer_size)
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_007: [ If size is smaller than the trailer, this function shall return a negative value. ]*/
+            LogError("buffer of %d bytes cannot hold a trace trailer of %d bytes", size, trailer_size);
+            result = -1;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_008: [ This function shall write every stamp, then the stamp count, the trace version and the marker 0xA1 0x74. ]*/
+            uint8_t i;
+            for (i = 0; i < trace->count; i++)
+            {
+                write_uint64_t(buf + i * STAMP_SIZE, trace->stamps[i]);
+            }
+            buf[trailer_size - 4] = trace->count;
+            buf[trailer_size - 3] = MESSAGE_TRACE_VERSION_CURRENT;
+            buf[trailer_size - 2] = FIRST_MESSAGE_BYTE;
+            buf[trailer_size - 1] = SECOND_MESSAGE_BYTE;
+            result = trailer_size;
+        }
+    }
+    return result;
+}
+
+int32_t MessageTrace_SplitFrame(const unsigned char* source, size_t size, MESSAGE_TRACE* trace)
+{
+    int32_t result;
+    if (source == NULL || trace == NULL)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_009: [ If source or trace is NULL, this function shall return a negative value. ]*/
+        LogError("invalid arguments source=%p, trace=%p", source, trace);
+        result = -1;
+    }
+    else
+    {
+        trace->count = 0;
+        if (
+            size < GATEWAY_MESSAGE_HEADER_SIZE ||
+            source[0] != FIRST_MESSAGE_BYTE ||
+            source[1] != GATEWAY_MESSAGE_BYTE ||
+            read_uint32_t(source + 2) >= size
+            )
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_010: [ If source is not a gateway message followed by more bytes than its serialized size, this function shall leave trace without stamps and return size. ]*/
+            result = (int32_t)size;
+        }
+        else
+        {
+            size_t message_size = read_uint32_t(source + 2);
+            size_t trailer_size = size - message_size;
+            const unsigned char* footer = source + size - TRAILER_FOOTER_SIZE;
+            if (
+                trailer_size < TRAILER_FOOTER_SIZE ||
+                footer[2] != FIRST_MESSAGE_BYTE ||
+                footer[3] != SECOND_MESSAGE_BYTE ||
+                footer[1] != MESSAGE_TRACE_VERSION_1 ||
+                footer[0] > MESSAGE_TRACE_HOP_COUNT ||
+                trailer_size != (size_t)footer[0] * STAMP_SIZE + TRAILER_FOOTER_SIZE
+                )
+            {
+                /*Codes_SRS_MESSAGE_TRACE_17_011: [ If the bytes following the gateway message are not a supported trace trailer, this function shall return a negative value. ]*/
+                LogError("malformed trace trailer");
+                result = -1;
+            }
+            else
+            {
+                /*Codes_SRS_MESSAGE_TRACE_17_012: [ This function shall read the stamps of the trailer into trace and return the size of the gateway message. ]*/
+                uint8_t i;
+                trace->count = footer[0];
+                for (i = 0; i < trace->count; i++)
+                {
+                    trace->stamps[i] = read_uint64_t(source + message_size + i * STAMP_SIZE);
+                }
+                result = (int32_t)message_size;
+            }
+        }
+    }
+    return result;
+}
+
+int32_t MessageTrace_ToReport(const MESSAGE_TRACE* trace, unsigned char* buf, int32_t size)
+{
+    int32_t result;
+    if (trace == NULL || trace->count > MESSAGE_TRACE_HOP_COUNT)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_013: [ If trace is NULL or holds more stamps than there are hops, this function shall return a negative value. ]*/
+        LogError("invalid trace [%p]", trace);
+        result = -1;
+    }
+    else
+    {
+        int32_t frame_size = (int32_t)(REPORT_HEADER_SIZE + trace->count * STAMP_SIZE);
+        if (buf == NULL)
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_014: [ If buf is NULL, this function shall return the size of the trace report frame. ]*/
+            result = frame_size;
+        }
+        else if (size < frame_size)
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_015: [ If size is smaller than the frame, this function shall return a negative value. ]*/
+            LogError("buffer of %d bytes cannot hold a trace report of %d bytes", size, frame_size);
+            result = -1;
+        }
+        else
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_016: [ This function shall write the header 0xA1 0x74, the trace version and the stamp count, followed by every stamp. ]*/
+            uint8_t i;
+            buf[0] = FIRST_MESSAGE_BYTE;
+            buf[1] = SECOND_MESSAGE_BYTE;
+            buf[2] = MESSAGE_TRACE_VERSION_CURRENT;
+            buf[3] = trace->count;
+            for (i = 0; i < trace->count; i++)
+            {
+                write_uint64_t(buf + REPORT_HEADER_SIZE + i * STAMP_SIZE, trace->stamps[i]);
+            }
+            result = frame_size;
+        }
+    }
+    return result;
+}
+
+bool MessageTrace_IsReport(const unsigned char* source, size_t size)
+{
+    /*Codes_SRS_MESSAGE_TRACE_17_017: [ This function shall return true if source holds at least a trace report header starting with 0xA1 0x74, false otherwise. ]*/
+    return
+        source != NULL &&
+        size >= REPORT_HEADER_SIZE &&
+        source[0] == FIRST_MESSAGE_BYTE &&
+        source[1] == SECOND_MESSAGE_BYTE;
+}
+
+int MessageTrace_FromReport(const unsigned char* source, size_t size, MESSAGE_TRACE* trace)
+{
+    int result;
+    if (trace == NULL || !MessageTrace_IsReport(source, size))
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_018: [ If trace is NULL or source is not a trace report, this function shall return a non-zero value. ]*/
+        LogError("invalid arguments source=%p, size=%zu, trace=%p", source, size, trace);
+        result = __LINE__;
+    }
+    else if (source[2] != MESSAGE_TRACE_VERSION_1)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_019: [ If the trace version is not supported, this function shall return a non-zero value. ]*/
+        LogError("unsupported trace version %u", (unsigned int)source[2]);
+        result = __LINE__;
+    }
+    else if (source[3] > MESSAGE_TRACE_HOP_COUNT || size != REPORT_HEADER_SIZE + (size_t)source[3] * STAMP_SIZE)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_020: [ If the frame does not hold exactly the stamps it counts, this function shall return a non-zero value. ]*/
+        LogError("trace report size mismatch");
+        result = __LINE__;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_021: [ This function shall read every stamp of the report into trace and return zero. ]*/
+        uint8_t i;
+        trace->count = source[3];
+        for (i = 0; i < trace->count; i++)
+        {
+            trace->stamps[i] = read_uint64_t(source + REPORT_HEADER_SIZE + i * STAMP_SIZE);
+        }
+        result = 0;
+    }
+    return result;
+}
+
+MESSAGE_TRACE_HISTOGRAM_HANDLE MessageTrace_CreateHistogram(void)
+{
+    /*Codes_SRS_MESSAGE_TRACE_17_022: [ This function shall allocate zeroed histograms, or return NULL upon failure. ]*/
+    MESSAGE_TRACE_HISTOGRAM* result = (MESSAGE_TRACE_HISTOGRAM*)calloc(1, sizeof(MESSAGE_TRACE_HISTOGRAM));
+    if (result == NULL)
+    {
+        LogError("unable to allocate trace histogram");
+    }
+    return result;
+}
+
+void MessageTrace_DestroyHistogram(MESSAGE_TRACE_HISTOGRAM_HANDLE histogram)
+{
+    /*Codes_SRS_MESSAGE_TRACE_17_023: [ If histogram is NULL, this function shall do nothing. ]*/
+    if (histogram != NULL)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_024: [ This function shall release the histograms. ]*/
+        free(histogram);
+    }
+}
+
+int MessageTrace_Record(MESSAGE_TRACE_HISTOGRAM_HANDLE histogram, const MESSAGE_TRACE* trace)
+{
+    int result;
+    if (histogram == NULL || trace == NULL || trace->count > MESSAGE_TRACE_HOP_COUNT)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_025: [ If histogram or trace is NULL, or trace holds more stamps than there are hops, this function shall return a non-zero value. ]*/
+        LogError("invalid arguments histogram=%p, trace=%p", histogram, trace);
+        result = __LINE__;
+    }
+    else
+    {
+        uint8_t hop;
+        for (hop = 1; hop < trace->count; hop++)
+        {
+            /*Codes_SRS_MESSAGE_TRACE_17_026: [ This function shall count the interval between each stamped hop and the one before it in the histogram of the later hop. ]*/
+            /*Codes_SRS_MESSAGE_TRACE_17_027: [ An interval during which the clock went backwards shall be counted as zero. ]*/
+            uint64_t interval = (trace->stamps[hop] > trace->stamps[hop - 1]) ?
+                trace->stamps[hop] - trace->stamps[hop - 1] :
+                0;
+            histogram->buckets[hop][bucket_of(interval)]++;
+        }
+        result = 0;
+    }
+    return result;
+}
+
+uint64_t MessageTrace_GetBucket(MESSAGE_TRACE_HISTOGRAM_HANDLE histogram, MESSAGE_TRACE_HOP hop, size_t bucket)
+{
+    uint64_t result;
+    if (histogram == NULL || (size_t)hop >= MESSAGE_TRACE_HOP_COUNT || bucket >= MESSAGE_TRACE_BUCKET_COUNT)
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_028: [ If histogram is NULL, or hop or bucket is out of range, this function shall return 0. ]*/
+        result = 0;
+    }
+    else
+    {
+        /*Codes_SRS_MESSAGE_TRACE_17_029: [ This function shall return the number of intervals ending at hop counted in bucket. ]*/
+        result = histogram->buckets[hop][bucket];
+    }
+    return result;
+}
+
+static uint64_t percentile_bound(const uint64_t* buckets, uint64_t samples, uint64_t percentile)
+{
+    uint64_t threshold = (samples * percentile + 99) / 100;
+    uint64_t seen = 0;
+    size_t bucket;
+    for (bucket = 0; bucket < MESSAGE_TRACE_BUCKET_COUNT - 1; bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen >= threshold)
+        {
+            break;
+        }
+    }
+    return (uint64_t)1 << bucket;
+}
+
+void MessageTrace_LogHistogram(MESSAGE_TRACE_HISTOGRAM_HANDLE histogram, const char* name)
+{
+    if (histogram != NULL)
+    {
+        size_t hop;
+        for (hop = 1; hop < MESSAGE_TRACE_HOP_COUNT; hop++)
+        {
+            uint64_t samples = 0;
+            size_t bucket;
+            for (bucket = 0; bucket < MESSAGE_TRACE_BUCKET_COUNT; bucket++)
+            {
+                samples += histogram->buckets[hop][bucket];
+            }
+            /*Codes_SRS_MESSAGE_TRACE_17_030: [ This function shall log, for each hop with samples, the number of samples and the bucket bounds holding the median and the 99th percentile. ]*/
+            if (samples > 0)
+            {
+                LogInfo("%s: %s %llu samples, p50 < %llu us, p99 < %llu us",
+                    (name == NULL) ? "" : name,
+                    ENUM_TO_STRING(MESSAGE_TRACE_HOP, (MESSAGE_TRACE_HOP)hop),
+                    (unsigned long long)samples,
+                    (unsigned long long)percentile_bound(histogram->buckets[hop], samples, 50),
+                    (unsigned long long)percentile_bound(histogram->buckets[hop], samples, 99));
+            }
+        }
+    }
+}
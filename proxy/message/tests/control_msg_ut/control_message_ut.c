@@ -100,6 +100,14 @@ static const unsigned char notFail____minimalMessageDestroy[] =
 	0x00, 0x00, 0x00, 8,    /*size of this array*/
 };
 
+static const unsigned char notFail____minimalMessageCredit[] =
+{
+	0xA1, 0x6C, 0x01, 5,    /*header, version, type */
+	0x00, 0x00, 0x00, 16,   /*size of this array*/
+	0x00, 0x00, 0x01, 0x00, /*message credits*/
+	0x00, 0x01, 0x00, 0x02  /*byte credits*/
+};
+
 static const unsigned char notFail__1url_0args[] =
 {
 	0xA1, 0x6C, 0x01, 1,    /*header, version, type */
@@ -587,6 +595,67 @@ TEST_FUNCTION(ControlMessage_CreateFromByteArray_bad_msg_type_fails)
 	///cleanup
 }
 
+/*Tests_SRS_CONTROL_MESSAGE_17_038: [ This function shall allocate a CONTROL_MESSAGE_MODULE_CREDIT structure. ]*/
+/*Tests_SRS_CONTROL_MESSAGE_17_040: [ This function shall read the message_credits and byte_credits from the byte stream. ]*/
+TEST_FUNCTION(ControlMessage_CreateFromByteArray_credit_success)
+{
+	///arrange
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(CONTROL_MESSAGE_MODULE_CREDIT)));
+
+	///act
+	CONTROL_MESSAGE * r1 = ControlMessage_CreateFromByteArray(notFail____minimalMessageCredit, sizeof(notFail____minimalMessageCredit));
+	CONTROL_MESSAGE_MODULE_CREDIT * rcc = (CONTROL_MESSAGE_MODULE_CREDIT*)r1;
+
+	///assert
+	ASSERT_IS_NOT_NULL(r1);
+	ASSERT_ARE_EQUAL(CONTROL_MESSAGE_TYPE, r1->type, CONTROL_MESSAGE_TYPE_MODULE_CREDIT);
+	ASSERT_ARE_EQUAL(uint8_t, r1->version, 0x01);
+	ASSERT_ARE_EQUAL(int32_t, (int32_t)rcc->message_credits, 256);
+	ASSERT_ARE_EQUAL(int32_t, (int32_t)rcc->byte_credits, 65538);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///cleanup
+	ControlMessage_Destroy(r1);
+}
+
+/*Tests_SRS_CONTROL_MESSAGE_17_039: [ If the total message size is not at least 16 bytes, then this function shall fail and return NULL. ]*/
+TEST_FUNCTION(ControlMessage_CreateFromByteArray_credit_struct_size_too_small)
+{
+	///arrange
+	static const unsigned char fail____shortMessageCredit[] =
+	{
+		0xA1, 0x6C, 0x01, 5,    /*header, version, type */
+		0x00, 0x00, 0x00, 12,   /*size of this array*/
+		0x00, 0x00, 0x01, 0x00  /*message credits*/
+	};
+
+	///act
+	CONTROL_MESSAGE * r1 = ControlMessage_CreateFromByteArray(fail____shortMessageCredit, sizeof(fail____shortMessageCredit));
+
+	///assert
+	ASSERT_IS_NULL(r1);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///cleanup
+}
+
+/*Tests_SRS_CONTROL_MESSAGE_17_036: [ This function shall return NULL upon failure. ]*/
+TEST_FUNCTION(ControlMessage_CreateFromByteArray_credit_struct_malloc_fail)
+{
+	///arrange
+	whenShallmalloc_fail = 1;
+	STRICT_EXPECTED_CALL(gballoc_malloc(sizeof(CONTROL_MESSAGE_MODULE_CREDIT)));
+
+	///act
+	CONTROL_MESSAGE * r1 = ControlMessage_CreateFromByteArray(notFail____minimalMessageCredit, sizeof(notFail____minimalMessageCredit));
+
+	///assert
+	ASSERT_IS_NULL(r1);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///cleanup
+}
+
 /*Tests_SRS_CONTROL_MESSAGE_17_026: [ If message is NULL this function shall do nothing. ]*/
 TEST_FUNCTION(ControlMessage_Destroy_does_nothing_with_nothing)
 {
@@ -765,4 +834,31 @@ TEST_FUNCTION(ControlMessage_ToByteArray_create_reply_correct)
 	///cleanup
 }
 
+/*Tests_SRS_CONTROL_MESSAGE_17_033: [ This function shall populate the memory with values as indicated in control messages in out process modules. ]*/
+TEST_FUNCTION(ControlMessage_ToByteArray_credit_roundtrip)
+{
+	///arrange
+	CONTROL_MESSAGE_MODULE_CREDIT m1 =
+	{
+		{
+			0x01,
+			CONTROL_MESSAGE_TYPE_MODULE_CREDIT
+		},
+		256,
+		65538
+	};
+	unsigned char buf[16];
+
+	///act
+	int32_t c0 = ControlMessage_ToByteArray((CONTROL_MESSAGE*)&m1, NULL, 0);
+	int32_t c1 = ControlMessage_ToByteArray((CONTROL_MESSAGE*)&m1, buf, 16);
+
+	///assert
+	ASSERT_ARE_EQUAL(int32_t, c0, 16);
+	ASSERT_ARE_EQUAL(int32_t, c1, 16);
+	ASSERT_ARE_EQUAL(int, 0, memcmp(buf, notFail____minimalMessageCredit, sizeof(notFail____minimalMessageCredit)));
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+	///cleanup
+}
+
 END_TEST_SUITE(control_message_ut)
@@ -0,0 +1,712 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+static size_t currentmalloc_call;
+static size_t whenShallmalloc_fail;
+
+static void* my_gballoc_malloc(size_t size)
+{
+    void* result;
+    currentmalloc_call++;
+    if (whenShallmalloc_fail > 0 && currentmalloc_call == whenShallmalloc_fail)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = malloc(size);
+    }
+    return result;
+}
+
+static void* my_gballoc_realloc(void* ptr, size_t size)
+{
+    void* result;
+    currentmalloc_call++;
+    if (whenShallmalloc_fail > 0 && currentmalloc_call == whenShallmalloc_fail)
+    {
+        result = NULL;
+    }
+    else
+    {
+        result = realloc(ptr, size);
+    }
+    return result;
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "message.h"
+#include "message_trace.h"
+#undef ENABLE_MOCKS
+
+#include "message_batch.h"
+
+#define FAKE_TICKCOUNTER ((TICK_COUNTER_HANDLE)0x42)
+#define FAKE_MESSAGE_1 ((MESSAGE_HANDLE)0x1001)
+#define FAKE_MESSAGE_2 ((MESSAGE_HANDLE)0x1002)
+#define SERIALIZED_SIZE 5
+#define BATCH_HEADER_SIZE 11
+#define TRAILER_SIZE 12
+
+static tickcounter_ms_t current_ms;
+
+static int my_tickcounter_get_current_ms(TICK_COUNTER_HANDLE tick_counter, tickcounter_ms_t* ms)
+{
+    (void)tick_counter;
+    *ms = current_ms;
+    return 0;
+}
+
+static int32_t my_Message_ToByteArray(MESSAGE_HANDLE messageHandle, unsigned char* buf, int32_t size)
+{
+    int32_t result;
+    if (buf == NULL)
+    {
+        result = SERIALIZED_SIZE;
+    }
+    else
+    {
+        /* tag the serialized bytes with the handle so that the order can be checked */
+        memset(buf, (int)((uintptr_t)messageHandle & 0xFF), size);
+        result = size;
+    }
+    return result;
+}
+
+static int32_t my_MessageTrace_ToTrailer(const MESSAGE_TRACE* trace, unsigned char* buf, int32_t size)
+{
+    (void)trace;
+    if (buf != NULL)
+    {
+        memset(buf, 0xEE, size);
+    }
+    return TRAILER_SIZE;
+}
+
+static MESSAGE_HANDLE delivered[4];
+static size_t delivered_count;
+
+static MESSAGE_HANDLE my_Message_CreateFromByteArray(const unsigned char* source, int32_t size)
+{
+    (void)size;
+    return (MESSAGE_HANDLE)(uintptr_t)(0x1000 + source[0]);
+}
+
+static void test_callback(void* context, MESSAGE_HANDLE message)
+{
+    (void)context;
+    if (delivered_count < sizeof(delivered) / sizeof(delivered[0]))
+    {
+        delivered[delivered_count] = message;
+    }
+    delivered_count++;
+}
+
+static const unsigned char* delivered_frames[4];
+static size_t delivered_sizes[4];
+static size_t delivered_frames_count;
+
+static void test_frame_callback(void* context, const unsigned char* frame, size_t size)
+{
+    (void)context;
+    if (delivered_frames_count < sizeof(delivered_frames) / sizeof(delivered_frames[0]))
+    {
+        delivered_frames[delivered_frames_count] = frame;
+        delivered_sizes[delivered_frames_count] = size;
+    }
+    delivered_frames_count++;
+}
+
+static const unsigned char twoMessageBatch[] =
+{
+    0xA1, 0x62, 0x01,           /*header, version*/
+    0x00, 0x00, 0x00, 29,       /*size of this array*/
+    0x00, 0x00, 0x00, 2,        /*message count*/
+    0x00, 0x00, 0x00, 5, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x00, 0x00, 0x00, 5, 0x02, 0x02, 0x02, 0x02, 0x02
+};
+
+static const unsigned char truncatedBatch[] =
+{
+    0xA1, 0x62, 0x01,           /*header, version*/
+    0x00, 0x00, 0x00, 20,       /*size of this array*/
+    0x00, 0x00, 0x00, 2,        /*message count*/
+    0x00, 0x00, 0x00, 5, 0x01, 0x01, 0x01, 0x01, 0x01
+};
+
+static const unsigned char notABatch[] =
+{
+    0xA1, 0x60, 0x01,           /*a gateway message header*/
+    0x00, 0x00, 0x00, 11,
+    0x00, 0x00, 0x00, 0
+};
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+BEGIN_TEST_SUITE(message_batch_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+    umocktypes_bool_register_types();
+
+    REGISTER_UMOCK_ALIAS_TYPE(TICK_COUNTER_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(MESSAGE_HANDLE, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const unsigned char*, void*);
+    REGISTER_UMOCK_ALIAS_TYPE(const MESSAGE_TRACE*, void*);
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_malloc, my_gballoc_malloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_realloc, my_gballoc_realloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+    REGISTER_GLOBAL_MOCK_RETURN(tickcounter_create, FAKE_TICKCOUNTER);
+    REGISTER_GLOBAL_MOCK_HOOK(tickcounter_get_current_ms, my_tickcounter_get_current_ms);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_ToByteArray, my_Message_ToByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(Message_CreateFromByteArray, my_Message_CreateFromByteArray);
+    REGISTER_GLOBAL_MOCK_HOOK(MessageTrace_ToTrailer, my_MessageTrace_ToTrailer);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+    currentmalloc_call = 0;
+    whenShallmalloc_fail = 0;
+    current_ms = 1000;
+    delivered_count = 0;
+    memset(delivered, 0, sizeof(delivered));
+    delivered_frames_count = 0;
+    memset(delivered_frames, 0, sizeof(delivered_frames));
+    memset(delivered_sizes, 0, sizeof(delivered_sizes));
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_001: [ If max_size is not larger than the batch header, this function shall fail and return NULL. ]*/
+TEST_FUNCTION(MessageBatch_Create_with_small_size_fails)
+{
+    ///act
+    MESSAGE_BATCH_HANDLE result = MessageBatch_Create(BATCH_HEADER_SIZE, 0);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_002: [ This function shall allocate memory for the batch. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_003: [ This function shall create a tick counter to track the age of the oldest message in the batch. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_006: [ This function shall release all resources held by the batch, discarding any pending message. ]*/
+TEST_FUNCTION(MessageBatch_Create_success)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_create());
+
+    ///act
+    MESSAGE_BATCH_HANDLE result = MessageBatch_Create(64, 5);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(result);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_004: [ If any step fails, this function shall release all resources and return NULL. ]*/
+TEST_FUNCTION(MessageBatch_Create_tickcounter_fails)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_malloc(IGNORED_NUM_ARG)).IgnoreArgument(1);
+    STRICT_EXPECTED_CALL(tickcounter_create()).SetReturn(NULL);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+    ///act
+    MESSAGE_BATCH_HANDLE result = MessageBatch_Create(64, 5);
+
+    ///assert
+    ASSERT_IS_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_005: [ If batch is NULL, this function shall do nothing. ]*/
+TEST_FUNCTION(MessageBatch_Destroy_does_nothing_with_null)
+{
+    ///act
+    MessageBatch_Destroy(NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_007: [ If batch or message is NULL, this function shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_AddMessage_with_null_fails)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result1 = MessageBatch_AddMessage(NULL, FAKE_MESSAGE_1);
+    int result2 = MessageBatch_AddMessage(batch, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_008: [ This function shall serialize the message at the end of the batch, preceded by its serialized size. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_010: [ This function shall return zero upon success. ]*/
+TEST_FUNCTION(MessageBatch_AddMessage_success)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 64));
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, IGNORED_PTR_ARG, SERIALIZED_SIZE))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    ///act
+    int result = MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int32_t, BATCH_HEADER_SIZE + 4 + SERIALIZED_SIZE, MessageBatch_ToByteArray(batch, NULL, 0));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_009: [ If the message cannot be serialized, this function shall leave the batch unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_AddMessage_serialize_fails)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, NULL, 0)).SetReturn(-1);
+
+    ///act
+    int result = MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int32_t, BATCH_HEADER_SIZE, MessageBatch_ToByteArray(batch, NULL, 0));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_009: [ If the message cannot be serialized, this function shall leave the batch unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_AddMessage_realloc_fails)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+    whenShallmalloc_fail = currentmalloc_call + 1;
+
+    ///act
+    int result = MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int32_t, BATCH_HEADER_SIZE, MessageBatch_ToByteArray(batch, NULL, 0));
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_029: [ If batch, message or trace is NULL, this function shall fail and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_AddTracedMessage_with_null_fails)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 2, { 1, 2 } };
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    ///act
+    int result1 = MessageBatch_AddTracedMessage(NULL, FAKE_MESSAGE_1, &trace);
+    int result2 = MessageBatch_AddTracedMessage(batch, NULL, &trace);
+    int result3 = MessageBatch_AddTracedMessage(batch, FAKE_MESSAGE_1, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_030: [ This function shall serialize the message at the end of the batch followed by the trace trailer, both preceded by their combined size. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_032: [ This function shall return zero upon success. ]*/
+TEST_FUNCTION(MessageBatch_AddTracedMessage_success)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 2, { 1, 2 } };
+    unsigned char frame[BATCH_HEADER_SIZE + 4 + SERIALIZED_SIZE + TRAILER_SIZE];
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, NULL, 0));
+    STRICT_EXPECTED_CALL(MessageTrace_ToTrailer(&trace, NULL, 0));
+    STRICT_EXPECTED_CALL(gballoc_realloc(NULL, 64));
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, IGNORED_PTR_ARG, SERIALIZED_SIZE))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(MessageTrace_ToTrailer(&trace, IGNORED_PTR_ARG, TRAILER_SIZE))
+        .IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2);
+
+    ///act
+    int result = MessageBatch_AddTracedMessage(batch, FAKE_MESSAGE_1, &trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)sizeof(frame), MessageBatch_ToByteArray(batch, frame, sizeof(frame)));
+    ASSERT_ARE_EQUAL(int, SERIALIZED_SIZE + TRAILER_SIZE, (int)frame[BATCH_HEADER_SIZE + 3]);
+    ASSERT_ARE_EQUAL(int, 0x01, (int)frame[BATCH_HEADER_SIZE + 4]);
+    ASSERT_ARE_EQUAL(int, 0xEE, (int)frame[BATCH_HEADER_SIZE + 4 + SERIALIZED_SIZE]);
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_031: [ If the trace trailer cannot be written, this function shall leave the batch unchanged and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_AddTracedMessage_trailer_fails)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 2, { 1, 2 } };
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(64, 5);
+    umock_c_reset_all_calls();
+
+    STRICT_EXPECTED_CALL(Message_ToByteArray(FAKE_MESSAGE_1, NULL, 0));
+    STRICT_EXPECTED_CALL(MessageTrace_ToTrailer(&trace, NULL, 0))
+        .SetReturn(-1);
+
+    ///act
+    int result = MessageBatch_AddTracedMessage(batch, FAKE_MESSAGE_1, &trace);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int32_t, BATCH_HEADER_SIZE, MessageBatch_ToByteArray(batch, NULL, 0));
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_011: [ This function shall return true when the size of the batch frame is at least max_size. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_013: [ This function shall return true if the batch is full. ]*/
+TEST_FUNCTION(MessageBatch_IsFull_after_size_threshold)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(BATCH_HEADER_SIZE + 2 * (4 + SERIALIZED_SIZE), 1000);
+
+    ///act
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+    bool full1 = MessageBatch_IsFull(batch);
+    bool due1 = MessageBatch_IsFlushDue(batch);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_2);
+    bool full2 = MessageBatch_IsFull(batch);
+    bool due2 = MessageBatch_IsFlushDue(batch);
+
+    ///assert
+    ASSERT_IS_FALSE(full1);
+    ASSERT_IS_FALSE(due1);
+    ASSERT_IS_TRUE(full2);
+    ASSERT_IS_TRUE(due2);
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_012: [ This function shall return false if the batch is empty. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_014: [ This function shall return true if the oldest message in the batch has waited at least max_delay_ms. ]*/
+TEST_FUNCTION(MessageBatch_IsFlushDue_after_max_delay)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(1024, 10);
+
+    ///act
+    bool due_empty = MessageBatch_IsFlushDue(batch);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+    current_ms += 9;
+    bool due_early = MessageBatch_IsFlushDue(batch);
+    current_ms += 1;
+    bool due_late = MessageBatch_IsFlushDue(batch);
+
+    ///assert
+    ASSERT_IS_FALSE(due_empty);
+    ASSERT_IS_FALSE(due_early);
+    ASSERT_IS_TRUE(due_late);
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_015: [ If the current time cannot be read, this function shall return true. ]*/
+TEST_FUNCTION(MessageBatch_IsFlushDue_tickcounter_fails)
+{
+    ///arrange
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(1024, 10);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+    umock_c_reset_all_calls();
+    STRICT_EXPECTED_CALL(tickcounter_get_current_ms(FAKE_TICKCOUNTER, IGNORED_PTR_ARG))
+        .IgnoreArgument(2)
+        .SetReturn(__LINE__);
+
+    ///act
+    bool due = MessageBatch_IsFlushDue(batch);
+
+    ///assert
+    ASSERT_IS_TRUE(due);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_016: [ If batch is NULL, this function shall return a negative value. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_018: [ If size is smaller than the batch frame, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageBatch_ToByteArray_fails)
+{
+    ///arrange
+    unsigned char buffer[BATCH_HEADER_SIZE];
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(1024, 10);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+
+    ///act
+    int32_t result1 = MessageBatch_ToByteArray(NULL, buffer, sizeof(buffer));
+    int32_t result2 = MessageBatch_ToByteArray(batch, buffer, sizeof(buffer));
+
+    ///assert
+    ASSERT_IS_TRUE(result1 < 0);
+    ASSERT_IS_TRUE(result2 < 0);
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_017: [ If buf is NULL, this function shall return the size of the batch frame. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_019: [ This function shall write the batch header 0xA1 0x62, the batch version, the frame size and the message count, followed by every serialized message. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_020: [ This function shall empty the batch and keep its buffer for reuse. ]*/
+TEST_FUNCTION(MessageBatch_ToByteArray_success)
+{
+    ///arrange
+    unsigned char buffer[sizeof(twoMessageBatch)];
+    MESSAGE_BATCH_HANDLE batch = MessageBatch_Create(1024, 10);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_1);
+    (void)MessageBatch_AddMessage(batch, FAKE_MESSAGE_2);
+
+    ///act
+    int32_t size = MessageBatch_ToByteArray(batch, NULL, 0);
+    int32_t result = MessageBatch_ToByteArray(batch, buffer, size);
+    MessageBatch_Clear(batch);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, sizeof(twoMessageBatch), size);
+    ASSERT_ARE_EQUAL(int32_t, size, result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buffer, twoMessageBatch, sizeof(twoMessageBatch)));
+    ASSERT_ARE_EQUAL(int32_t, BATCH_HEADER_SIZE, MessageBatch_ToByteArray(batch, NULL, 0));
+    ASSERT_IS_FALSE(MessageBatch_IsFlushDue(batch));
+
+    ///cleanup
+    MessageBatch_Destroy(batch);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_021: [ This function shall return true if source holds at least a batch header starting with 0xA1 0x62, false otherwise. ]*/
+TEST_FUNCTION(MessageBatch_IsBatch_checks_header)
+{
+    ///act
+    bool result1 = MessageBatch_IsBatch(twoMessageBatch, sizeof(twoMessageBatch));
+    bool result2 = MessageBatch_IsBatch(notABatch, sizeof(notABatch));
+    bool result3 = MessageBatch_IsBatch(twoMessageBatch, BATCH_HEADER_SIZE - 1);
+    bool result4 = MessageBatch_IsBatch(NULL, 0);
+
+    ///assert
+    ASSERT_IS_TRUE(result1);
+    ASSERT_IS_FALSE(result2);
+    ASSERT_IS_FALSE(result3);
+    ASSERT_IS_FALSE(result4);
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_022: [ If callback is NULL or source is not a batch frame, this function shall return a non-zero value. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_024: [ If the frame size in the header does not match size, this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_ForEach_bad_arguments_fail)
+{
+    ///act
+    int result1 = MessageBatch_ForEach(twoMessageBatch, sizeof(twoMessageBatch), NULL, NULL);
+    int result2 = MessageBatch_ForEach(notABatch, sizeof(notABatch), test_callback, NULL);
+    int result3 = MessageBatch_ForEach(twoMessageBatch, sizeof(twoMessageBatch) - 1, test_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_EQUAL(size_t, 0, delivered_count);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_026: [ This function shall deserialize each message in the frame, in order, and pass it to callback. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_028: [ This function shall destroy each message once callback returns. ]*/
+TEST_FUNCTION(MessageBatch_ForEach_success)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(twoMessageBatch + 15, SERIALIZED_SIZE));
+    STRICT_EXPECTED_CALL(Message_Destroy(FAKE_MESSAGE_1));
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(twoMessageBatch + 24, SERIALIZED_SIZE));
+    STRICT_EXPECTED_CALL(Message_Destroy(FAKE_MESSAGE_2));
+
+    ///act
+    int result = MessageBatch_ForEach(twoMessageBatch, sizeof(twoMessageBatch), test_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, delivered_count);
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_MESSAGE_1, delivered[0]);
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_MESSAGE_2, delivered[1]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_025: [ Reading past the end of the frame shall stop the iteration and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_ForEach_truncated_frame_delivers_complete_messages)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(truncatedBatch + 15, SERIALIZED_SIZE));
+    STRICT_EXPECTED_CALL(Message_Destroy(FAKE_MESSAGE_1));
+
+    ///act
+    int result = MessageBatch_ForEach(truncatedBatch, sizeof(truncatedBatch), test_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, delivered_count);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_027: [ A message that cannot be deserialized shall be skipped, and this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_ForEach_skips_bad_message)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(twoMessageBatch + 15, SERIALIZED_SIZE))
+        .SetReturn(NULL);
+    STRICT_EXPECTED_CALL(Message_CreateFromByteArray(twoMessageBatch + 24, SERIALIZED_SIZE));
+    STRICT_EXPECTED_CALL(Message_Destroy(FAKE_MESSAGE_2));
+
+    ///act
+    int result = MessageBatch_ForEach(twoMessageBatch, sizeof(twoMessageBatch), test_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, delivered_count);
+    ASSERT_ARE_EQUAL(void_ptr, FAKE_MESSAGE_2, delivered[0]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_033: [ If callback is NULL or source is not a batch frame, this function shall return a non-zero value. ]*/
+/*Tests_SRS_MESSAGE_BATCH_17_034: [ If the batch version is not supported, or the frame size in the header does not match size, this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_ForEachFrame_bad_arguments_fail)
+{
+    ///act
+    int result1 = MessageBatch_ForEachFrame(twoMessageBatch, sizeof(twoMessageBatch), NULL, NULL);
+    int result2 = MessageBatch_ForEachFrame(notABatch, sizeof(notABatch), test_frame_callback, NULL);
+    int result3 = MessageBatch_ForEachFrame(twoMessageBatch, sizeof(twoMessageBatch) - 1, test_frame_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result1);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result2);
+    ASSERT_ARE_NOT_EQUAL(int, 0, result3);
+    ASSERT_ARE_EQUAL(size_t, 0, delivered_frames_count);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_036: [ This function shall pass the bytes of each entry in the frame, in order, to callback without deserializing them. ]*/
+TEST_FUNCTION(MessageBatch_ForEachFrame_success)
+{
+    ///act
+    int result = MessageBatch_ForEachFrame(twoMessageBatch, sizeof(twoMessageBatch), test_frame_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 2, delivered_frames_count);
+    ASSERT_ARE_EQUAL(void_ptr, twoMessageBatch + 15, delivered_frames[0]);
+    ASSERT_ARE_EQUAL(size_t, SERIALIZED_SIZE, delivered_sizes[0]);
+    ASSERT_ARE_EQUAL(void_ptr, twoMessageBatch + 24, delivered_frames[1]);
+    ASSERT_ARE_EQUAL(size_t, SERIALIZED_SIZE, delivered_sizes[1]);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_BATCH_17_035: [ Reading past the end of the frame shall stop the iteration and return a non-zero value. ]*/
+TEST_FUNCTION(MessageBatch_ForEachFrame_truncated_frame_delivers_complete_entries)
+{
+    ///act
+    int result = MessageBatch_ForEachFrame(truncatedBatch, sizeof(truncatedBatch), test_frame_callback, NULL);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(size_t, 1, delivered_frames_count);
+    ASSERT_ARE_EQUAL(void_ptr, truncatedBatch + 15, delivered_frames[0]);
+}
+
+END_TEST_SUITE(message_batch_ut)
@@ -0,0 +1,185 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+#include "message_mux.h"
+
+/*a control message (module start) for module 0x01020304*/
+static const unsigned char muxedFrame[] =
+{
+    0xA1, 0x6D, 0x01,           /*mux header, version*/
+    0x01, 0x02, 0x03, 0x04,     /*module id*/
+    0xA1, 0x6C, 0x01, 0x03,     /*control message header, version, type*/
+    0x00, 0x00, 0x00, 0x08      /*size of the control message*/
+};
+
+static const unsigned char plainFrame[] =
+{
+    0xA1, 0x6C, 0x01, 0x03,
+    0x00, 0x00, 0x00, 0x08
+};
+
+static const unsigned char badVersion[] =
+{
+    0xA1, 0x6D, 0x02,
+    0x01, 0x02, 0x03, 0x04,
+    0xA1, 0x6C, 0x01, 0x03,
+    0x00, 0x00, 0x00, 0x08
+};
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+BEGIN_TEST_SUITE(message_mux_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_002: [ This function shall write the header 0xA1 0x6D, the mux version and the module id in big endian, and return the size of the header. ]*/
+TEST_FUNCTION(MessageMux_WriteHeader_writes_header)
+{
+    ///arrange
+    unsigned char buf[MESSAGE_MUX_HEADER_SIZE];
+
+    ///act
+    int32_t result = MessageMux_WriteHeader(0x01020304, buf, sizeof(buf));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, MESSAGE_MUX_HEADER_SIZE, result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buf, muxedFrame, sizeof(buf)));
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_001: [ If buf is NULL or size is smaller than the header, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageMux_WriteHeader_fails_with_small_buffer)
+{
+    ///arrange
+    unsigned char buf[MESSAGE_MUX_HEADER_SIZE];
+
+    ///act
+    int32_t result = MessageMux_WriteHeader(1, buf, MESSAGE_MUX_HEADER_SIZE - 1);
+    int32_t null_result = MessageMux_WriteHeader(1, NULL, MESSAGE_MUX_HEADER_SIZE);
+
+    ///assert
+    ASSERT_IS_TRUE(result < 0);
+    ASSERT_IS_TRUE(null_result < 0);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_007: [ This function shall read the module id into module_id and return the size of the header. ]*/
+TEST_FUNCTION(MessageMux_ReadHeader_reads_module_id)
+{
+    ///arrange
+    uint32_t module_id = 0;
+
+    ///act
+    int32_t result = MessageMux_ReadHeader(muxedFrame, sizeof(muxedFrame), &module_id);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, MESSAGE_MUX_HEADER_SIZE, result);
+    ASSERT_ARE_EQUAL(uint32_t, 0x01020304, module_id);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_004: [ If source does not start with 0xA1 0x6D, this function shall leave module_id unchanged and return zero. ]*/
+TEST_FUNCTION(MessageMux_ReadHeader_plain_frame_returns_zero)
+{
+    ///arrange
+    uint32_t module_id = 42;
+
+    ///act
+    int32_t result = MessageMux_ReadHeader(plainFrame, sizeof(plainFrame), &module_id);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 0, result);
+    ASSERT_ARE_EQUAL(uint32_t, 42, module_id);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_005: [ If source holds no frame after the header, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageMux_ReadHeader_header_only_fails)
+{
+    ///arrange
+    uint32_t module_id = 0;
+
+    ///act
+    int32_t result = MessageMux_ReadHeader(muxedFrame, MESSAGE_MUX_HEADER_SIZE, &module_id);
+
+    ///assert
+    ASSERT_IS_TRUE(result < 0);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_006: [ If the mux version is not supported, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageMux_ReadHeader_bad_version_fails)
+{
+    ///arrange
+    uint32_t module_id = 0;
+
+    ///act
+    int32_t result = MessageMux_ReadHeader(badVersion, sizeof(badVersion), &module_id);
+
+    ///assert
+    ASSERT_IS_TRUE(result < 0);
+}
+
+/*Tests_SRS_MESSAGE_MUX_17_003: [ If source or module_id is NULL, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageMux_ReadHeader_with_null_fails)
+{
+    ///arrange
+    uint32_t module_id = 0;
+
+    ///act
+    int32_t null_source = MessageMux_ReadHeader(NULL, sizeof(muxedFrame), &module_id);
+    int32_t null_id = MessageMux_ReadHeader(muxedFrame, sizeof(muxedFrame), NULL);
+
+    ///assert
+    ASSERT_IS_TRUE(null_source < 0);
+    ASSERT_IS_TRUE(null_id < 0);
+}
+
+END_TEST_SUITE(message_mux_ut)
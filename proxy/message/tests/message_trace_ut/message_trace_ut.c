@@ -0,0 +1,341 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "testrunnerswitcher.h"
+#include "umock_c.h"
+#include "umocktypes_charptr.h"
+#include "umocktypes_stdint.h"
+#include "umocktypes_bool.h"
+
+#define GATEWAY_EXPORT_H
+#define GATEWAY_EXPORT
+
+#ifdef WIN32
+static TEST_MUTEX_HANDLE g_dllByDll;
+#endif
+static TEST_MUTEX_HANDLE g_testByTest;
+
+static void* my_gballoc_calloc(size_t nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+static void my_gballoc_free(void* ptr)
+{
+    free(ptr);
+}
+
+#define ENABLE_MOCKS
+#include "azure_c_shared_utility/gballoc.h"
+#undef ENABLE_MOCKS
+
+#include "message_trace.h"
+
+/*a 10 byte gateway message followed by a trailer with 2 stamps*/
+static const unsigned char tracedMessage[] =
+{
+    0xA1, 0x60,                 /*gateway message header*/
+    0x00, 0x00, 0x00, 10,       /*size of the gateway message*/
+    0x00, 0x00, 0x00, 0,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,  /*first stamp*/
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x40,  /*second stamp*/
+    2, 0x01, 0xA1, 0x74         /*stamp count, version, trailer marker*/
+};
+
+static const unsigned char plainMessage[] =
+{
+    0xA1, 0x60,
+    0x00, 0x00, 0x00, 10,
+    0x00, 0x00, 0x00, 0
+};
+
+static const unsigned char badTrailer[] =
+{
+    0xA1, 0x60,
+    0x00, 0x00, 0x00, 10,
+    0x00, 0x00, 0x00, 0,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+    2, 0x01, 0xA1, 0x74         /*counts one more stamp than it holds*/
+};
+
+static const unsigned char traceReport[] =
+{
+    0xA1, 0x74, 0x01, 3,        /*header, version, stamp count*/
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30
+};
+
+static void on_umock_c_error(UMOCK_C_ERROR_CODE error_code)
+{
+    (void)error_code;
+    ASSERT_FAIL("umock_c reported error");
+}
+
+BEGIN_TEST_SUITE(message_trace_ut)
+
+TEST_SUITE_INITIALIZE(TestClassInitialize)
+{
+    TEST_INITIALIZE_MEMORY_DEBUG(g_dllByDll);
+    g_testByTest = TEST_MUTEX_CREATE();
+    ASSERT_IS_NOT_NULL(g_testByTest);
+
+    umock_c_init(on_umock_c_error);
+    umocktypes_charptr_register_types();
+    umocktypes_stdint_register_types();
+    umocktypes_bool_register_types();
+
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_calloc, my_gballoc_calloc);
+    REGISTER_GLOBAL_MOCK_HOOK(gballoc_free, my_gballoc_free);
+}
+
+TEST_SUITE_CLEANUP(TestClassCleanup)
+{
+    umock_c_deinit();
+    TEST_MUTEX_DESTROY(g_testByTest);
+    TEST_DEINITIALIZE_MEMORY_DEBUG(g_dllByDll);
+}
+
+TEST_FUNCTION_INITIALIZE(TestMethodInitialize)
+{
+    if (TEST_MUTEX_ACQUIRE(g_testByTest) != 0)
+    {
+        ASSERT_FAIL("our mutex is ABANDONED. Failure in test framework");
+    }
+
+    umock_c_reset_all_calls();
+}
+
+TEST_FUNCTION_CLEANUP(TestMethodCleanup)
+{
+    TEST_MUTEX_RELEASE(g_testByTest);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_001: [ This function shall return the system wide monotonic clock in microseconds. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_004: [ This function shall stamp the next hop of trace with the current time and return zero. ]*/
+TEST_FUNCTION(MessageTrace_Stamp_stamps_next_hop)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int first = MessageTrace_Stamp(&trace);
+    int second = MessageTrace_Stamp(&trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, first);
+    ASSERT_ARE_EQUAL(int, 0, second);
+    ASSERT_ARE_EQUAL(int, 2, (int)trace.count);
+    ASSERT_IS_TRUE(trace.stamps[1] >= trace.stamps[0]);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_003: [ If trace is NULL or every hop is already stamped, this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageTrace_Stamp_fails_when_every_hop_is_stamped)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+    trace.count = MESSAGE_TRACE_HOP_COUNT;
+
+    ///act
+    int result = MessageTrace_Stamp(&trace);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, MESSAGE_TRACE_HOP_COUNT, (int)trace.count);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_006: [ If buf is NULL, this function shall return the size of the trailer. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_008: [ This function shall write every stamp, then the stamp count, the trace version and the marker 0xA1 0x74. ]*/
+TEST_FUNCTION(MessageTrace_ToTrailer_writes_trailer)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+    unsigned char buf[20];
+    trace.count = 2;
+    trace.stamps[0] = 0x100;
+    trace.stamps[1] = 0x140;
+
+    ///act
+    int32_t size = MessageTrace_ToTrailer(&trace, NULL, 0);
+    int32_t result = MessageTrace_ToTrailer(&trace, buf, sizeof(buf));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 20, size);
+    ASSERT_ARE_EQUAL(int32_t, 20, result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buf, tracedMessage + sizeof(plainMessage), sizeof(buf)));
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_007: [ If size is smaller than the trailer, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageTrace_ToTrailer_fails_with_small_buffer)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+    unsigned char buf[20];
+    trace.count = 2;
+
+    ///act
+    int32_t result = MessageTrace_ToTrailer(&trace, buf, 19);
+
+    ///assert
+    ASSERT_IS_TRUE(result < 0);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_012: [ This function shall read the stamps of the trailer into trace and return the size of the gateway message. ]*/
+TEST_FUNCTION(MessageTrace_SplitFrame_reads_trailer)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int32_t result = MessageTrace_SplitFrame(tracedMessage, sizeof(tracedMessage), &trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, 10, result);
+    ASSERT_ARE_EQUAL(int, 2, (int)trace.count);
+    ASSERT_IS_TRUE(trace.stamps[0] == 0x100);
+    ASSERT_IS_TRUE(trace.stamps[1] == 0x140);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_010: [ If source is not a gateway message followed by more bytes than its serialized size, this function shall leave trace without stamps and return size. ]*/
+TEST_FUNCTION(MessageTrace_SplitFrame_without_trailer_returns_size)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+    trace.count = 3;
+
+    ///act
+    int32_t result = MessageTrace_SplitFrame(plainMessage, sizeof(plainMessage), &trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)sizeof(plainMessage), result);
+    ASSERT_ARE_EQUAL(int, 0, (int)trace.count);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_011: [ If the bytes following the gateway message are not a supported trace trailer, this function shall return a negative value. ]*/
+TEST_FUNCTION(MessageTrace_SplitFrame_with_bad_trailer_fails)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int32_t result = MessageTrace_SplitFrame(badTrailer, sizeof(badTrailer), &trace);
+
+    ///assert
+    ASSERT_IS_TRUE(result < 0);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_014: [ If buf is NULL, this function shall return the size of the trace report frame. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_016: [ This function shall write the header 0xA1 0x74, the trace version and the stamp count, followed by every stamp. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_017: [ This function shall return true if source holds at least a trace report header starting with 0xA1 0x74, false otherwise. ]*/
+TEST_FUNCTION(MessageTrace_ToReport_writes_report)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+    unsigned char buf[sizeof(traceReport)];
+    trace.count = 3;
+    trace.stamps[0] = 0x10;
+    trace.stamps[1] = 0x20;
+    trace.stamps[2] = 0x30;
+
+    ///act
+    int32_t size = MessageTrace_ToReport(&trace, NULL, 0);
+    int32_t result = MessageTrace_ToReport(&trace, buf, sizeof(buf));
+
+    ///assert
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)sizeof(traceReport), size);
+    ASSERT_ARE_EQUAL(int32_t, (int32_t)sizeof(traceReport), result);
+    ASSERT_ARE_EQUAL(int, 0, memcmp(buf, traceReport, sizeof(traceReport)));
+    ASSERT_IS_TRUE(MessageTrace_IsReport(buf, sizeof(buf)));
+    ASSERT_IS_FALSE(MessageTrace_IsReport(plainMessage, sizeof(plainMessage)));
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_021: [ This function shall read every stamp of the report into trace and return zero. ]*/
+TEST_FUNCTION(MessageTrace_FromReport_reads_report)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int result = MessageTrace_FromReport(traceReport, sizeof(traceReport), &trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_ARE_EQUAL(int, 3, (int)trace.count);
+    ASSERT_IS_TRUE(trace.stamps[2] == 0x30);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_020: [ If the frame does not hold exactly the stamps it counts, this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageTrace_FromReport_with_truncated_report_fails)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int result = MessageTrace_FromReport(traceReport, sizeof(traceReport) - 1, &trace);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_022: [ This function shall allocate zeroed histograms, or return NULL upon failure. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_024: [ This function shall release the histograms. ]*/
+TEST_FUNCTION(MessageTrace_CreateHistogram_success)
+{
+    ///arrange
+    STRICT_EXPECTED_CALL(gballoc_calloc(1, IGNORED_NUM_ARG)).IgnoreArgument(2);
+    STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG)).IgnoreArgument(1);
+
+    ///act
+    MESSAGE_TRACE_HISTOGRAM_HANDLE result = MessageTrace_CreateHistogram();
+    MessageTrace_DestroyHistogram(result);
+
+    ///assert
+    ASSERT_IS_NOT_NULL(result);
+    ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_026: [ This function shall count the interval between each stamped hop and the one before it in the histogram of the later hop. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_027: [ An interval during which the clock went backwards shall be counted as zero. ]*/
+/*Tests_SRS_MESSAGE_TRACE_17_029: [ This function shall return the number of intervals ending at hop counted in bucket. ]*/
+TEST_FUNCTION(MessageTrace_Record_counts_intervals)
+{
+    ///arrange
+    MESSAGE_TRACE_HISTOGRAM_HANDLE histogram = MessageTrace_CreateHistogram();
+    MESSAGE_TRACE trace = { 0 };
+    trace.count = 3;
+    trace.stamps[0] = 1000;
+    trace.stamps[1] = 1005;     /*5us, in [4, 8)*/
+    trace.stamps[2] = 1000;     /*clock went backwards*/
+
+    ///act
+    int result = MessageTrace_Record(histogram, &trace);
+
+    ///assert
+    ASSERT_ARE_EQUAL(int, 0, result);
+    ASSERT_IS_TRUE(MessageTrace_GetBucket(histogram, MESSAGE_TRACE_HOP_SEND, 3) == 1);
+    ASSERT_IS_TRUE(MessageTrace_GetBucket(histogram, MESSAGE_TRACE_HOP_RECEIVE, 0) == 1);
+    ASSERT_IS_TRUE(MessageTrace_GetBucket(histogram, MESSAGE_TRACE_HOP_MODULE_ENTER, 0) == 0);
+    ASSERT_IS_TRUE(MessageTrace_GetBucket(histogram, MESSAGE_TRACE_HOP_ENQUEUE, 0) == 0);
+
+    ///cleanup
+    MessageTrace_DestroyHistogram(histogram);
+}
+
+/*Tests_SRS_MESSAGE_TRACE_17_025: [ If histogram or trace is NULL, or trace holds more stamps than there are hops, this function shall return a non-zero value. ]*/
+TEST_FUNCTION(MessageTrace_Record_with_null_fails)
+{
+    ///arrange
+    MESSAGE_TRACE trace = { 0 };
+
+    ///act
+    int result = MessageTrace_Record(NULL, &trace);
+
+    ///assert
+    ASSERT_ARE_NOT_EQUAL(int, 0, result);
+}
+
+END_TEST_SUITE(message_trace_ut)
@@ -30,6 +30,9 @@ typedef struct MODULE_HOST_TAG
     BROKER_HANDLE module_host_broker;
 } MODULE_HOST;
 
+/*number of modules currently hosted, sharing the module loader*/
+static size_t module_host_count = 0;
+
 static void* NativeModuleHost_ParseConfigurationFromJson(const char* configuration)
 {
     char* config_str;
@@ -195,7 +198,8 @@ static MODULE_HANDLE NativeModuleHost_Create(BROKER_HANDLE broker, const void* c
     else
     {
         /*Codes_SRS_NATIVEMODULEHOST_17_010: [ NativeModuleHost_Create shall intialize the Module_Loader. ]*/
-        if (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS)
+        /*Codes_SRS_NATIVEMODULEHOST_17_036: [ NativeModuleHost_Create shall not initialize the Module_Loader again while another module is hosted. ]*/
+        if ((module_host_count == 0) && (ModuleLoader_Initialize() != MODULE_LOADER_SUCCESS))
         {
             /*Codes_SRS_NATIVEMODULEHOST_17_026: [ If any step above fails, then NativeModuleHost_Create shall free all resources allocated and return NULL. ]*/
             LogError("ModuleLoader_Initialize failed");
@@ -280,7 +284,14 @@ static MODULE_HANDLE NativeModuleHost_Create(BROKER_HANDLE broker, const void* c
             {
                 // failed to create a module, give up entirely.
                 /*Codes_SRS_NATIVEMODULEHOST_17_026: [ If any step above fails, then NativeModuleHost_Create shall free all resources allocated and return NULL. ]*/
-                ModuleLoader_Destroy();
+                if (module_host_count == 0)
+                {
+                    ModuleLoader_Destroy();
+                }
+            }
+            else
+            {
+                module_host_count++;
             }
         }
     }
@@ -316,10 +327,18 @@ static void NativeModuleHost_Destroy(MODULE_HANDLE moduleHandle)
             module_host->module_library_handle = NULL;
             module_host->module_host_broker = NULL;
             free(module_host);
+            if (module_host_count > 0)
+            {
+                module_host_count--;
+            }
         }
     }
     /*Codes_SRS_NATIVEMODULEHOST_17_027: [ NativeModuleHost_Destroy shall always destroy the module loader. ]*/
-    ModuleLoader_Destroy();
+    /*Codes_SRS_NATIVEMODULEHOST_17_037: [ NativeModuleHost_Destroy shall not destroy the Module_Loader while another module is hosted. ]*/
+    if (module_host_count == 0)
+    {
+        ModuleLoader_Destroy();
+    }
 }
 
 static void NativeModuleHost_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
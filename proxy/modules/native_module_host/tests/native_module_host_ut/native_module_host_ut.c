@@ -1052,11 +1052,12 @@ TEST_FUNCTION(NativeModuleHost_Destroy_destroys_loader_with_nothing)
 	///ablution
 }
 
-static MODULE_HANDLE create_a_module(const MODULE_API* apis)
+static void expected_calls_create_a_module(BROKER_HANDLE b, char * config, bool first_module)
 {
-	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
-	char * config = "Assume this is a valid config";
-	STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
+	if (first_module)
+	{
+		STRICT_EXPECTED_CALL(ModuleLoader_Initialize());
+	}
 	STRICT_EXPECTED_CALL(json_parse_string(config))
 		.SetReturn((JSON_Value*)0x43);
 	STRICT_EXPECTED_CALL(json_value_get_object((JSON_Value*)0x43))
@@ -1100,6 +1101,13 @@ static MODULE_HANDLE create_a_module(const MODULE_API* apis)
 	STRICT_EXPECTED_CALL(mock_ModuleLoader_FreeEntrypoint(&dummyModuleLoader, IGNORED_PTR_ARG))
 		.IgnoreArgument(2);
 	STRICT_EXPECTED_CALL(json_value_free((JSON_Value*)0x43));
+}
+
+static MODULE_HANDLE create_a_module(const MODULE_API* apis)
+{
+	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
+	char * config = "Assume this is a valid config";
+	expected_calls_create_a_module(b, config, true);
 
 	///act
 	MODULE_HANDLE m = MODULE_CREATE(apis)(b, config);
@@ -1133,6 +1141,47 @@ TEST_FUNCTION(NativeModuleHost_Destroy_success)
 	///ablution
 }
 
+/*Tests_SRS_NATIVEMODULEHOST_17_036: [ NativeModuleHost_Create shall not initialize the Module_Loader again while another module is hosted. ]*/
+/*Tests_SRS_NATIVEMODULEHOST_17_037: [ NativeModuleHost_Destroy shall not destroy the Module_Loader while another module is hosted. ]*/
+TEST_FUNCTION(NativeModuleHost_hosts_many_modules_with_one_loader)
+{
+	///arrange
+	const MODULE_API* apis = Module_GetApi(MODULE_API_VERSION_1);
+	BROKER_HANDLE b = (BROKER_HANDLE)0x42;
+	char * config = "Assume this is a valid config";
+	MODULE_HANDLE m1 = create_a_module(apis);
+
+	expected_calls_create_a_module(b, config, false);
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_GetApi(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2).SetReturn((const MODULE_API*)&dummyAPIs);
+	STRICT_EXPECTED_CALL(mock_Module_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_Unload(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+
+	///act
+	MODULE_HANDLE m2 = MODULE_CREATE(apis)(b, config);
+	MODULE_DESTROY(apis)(m1);
+
+	///assert
+	ASSERT_IS_NOT_NULL(m2);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+
+	///ablution
+	umock_c_reset_all_calls();
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_GetApi(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2).SetReturn((const MODULE_API*)&dummyAPIs);
+	STRICT_EXPECTED_CALL(mock_Module_Destroy(IGNORED_PTR_ARG)).IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(mock_ModuleLoader_Unload(&dummyModuleLoader, IGNORED_PTR_ARG))
+		.IgnoreArgument(2);
+	STRICT_EXPECTED_CALL(gballoc_free(IGNORED_PTR_ARG))
+		.IgnoreArgument(1);
+	STRICT_EXPECTED_CALL(ModuleLoader_Destroy());
+	MODULE_DESTROY(apis)(m2);
+	ASSERT_ARE_EQUAL(char_ptr, umock_c_get_expected_calls(), umock_c_get_actual_calls());
+}
+
 /*Tests_SRS_NATIVEMODULEHOST_17_029: [ NativeModuleHost_Receive shall do nothing if moduleHandle is NULL. ]*/
 TEST_FUNCTION(NativeModuleHost_Receive_does_nothing_with_nothing)
 {
@@ -11,11 +11,14 @@
 #ifndef OUTPROCESS_LOADER_H
 #define OUTPROCESS_LOADER_H
 
+#include <stdbool.h>
+
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/umock_c_prod.h"
 
 #include "module.h"
 #include "module_loader.h"
+#include "module_loaders/outprocess_module.h"
 #include "gateway_export.h"
 
 #ifdef __cplusplus
@@ -53,6 +56,28 @@ typedef struct OUTPROCESS_LOADER_ENTRYPOINT_TAG
     char ** process_argv;
     /** @brief controls timeout for ipc retries. */
 	unsigned int remote_message_wait;
+    /** @brief frame size at which batched messages are sent, 0 to disable batching. */
+    unsigned int message_batch_size;
+    /** @brief longest time a message waits in a partial batch. */
+    unsigned int message_batch_delay_ms;
+    /** @brief largest number of messages queued for the module host, 0 for no limit. */
+    unsigned int outgoing_queue_limit;
+    /** @brief which message to drop when the outgoing queue is full. */
+    OUTPROCESS_QUEUE_OVERFLOW_POLICY outgoing_queue_overflow;
+    /** @brief number of module host instances behind the module, 0 or 1 for a single one. */
+    unsigned int instances;
+    /** @brief how messages are spread across the instances. */
+    OUTPROCESS_DISPATCH_POLICY dispatch_policy;
+    /** @brief the message property hashed by the key hash dispatch policy. */
+    STRING_HANDLE dispatch_key;
+    /** @brief when true, the create handshake runs while the next modules are created. */
+    bool parallel_startup;
+    /** @brief longest wait for the module host to reply to the create message, 0 for no limit. */
+    unsigned int startup_timeout_ms;
+    /** @brief when true, one queued message at a time carries per-hop timestamps to the module host. */
+    bool message_trace;
+    /** @brief when true, the module shares one control and one message channel with every other multiplexed module on the same control id. */
+    bool multiplex;
 } OUTPROCESS_LOADER_ENTRYPOINT;
 
 /** @brief      The API for the out of process proxy module loader. */
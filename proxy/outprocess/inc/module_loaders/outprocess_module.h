@@ -9,6 +9,8 @@
 #ifndef OUTPROCESS_MODULE_H
 #define OUTPROCESS_MODULE_H
 
+#include <stdbool.h>
+
 #include "module.h"
 #include "azure_c_shared_utility/macro_utils.h"
 
@@ -23,6 +25,21 @@ extern "C"
 
 DEFINE_ENUM(OUTPROCESS_MODULE_LIFECYCLE, OUTPROCESS_MODULE_LIFECYCLE_VALUES);
 
+#define OUTPROCESS_QUEUE_OVERFLOW_POLICY_VALUES \
+	OUTPROCESS_QUEUE_DROP_NEWEST, \
+	OUTPROCESS_QUEUE_DROP_OLDEST
+
+/** @brief What to do with a message received while the outgoing queue is full */
+DEFINE_ENUM(OUTPROCESS_QUEUE_OVERFLOW_POLICY, OUTPROCESS_QUEUE_OVERFLOW_POLICY_VALUES);
+
+#define OUTPROCESS_DISPATCH_POLICY_VALUES \
+	OUTPROCESS_DISPATCH_ROUND_ROBIN, \
+	OUTPROCESS_DISPATCH_LEAST_LOADED, \
+	OUTPROCESS_DISPATCH_KEY_HASH
+
+/** @brief How a pool of module host instances shares the incoming messages */
+DEFINE_ENUM(OUTPROCESS_DISPATCH_POLICY, OUTPROCESS_DISPATCH_POLICY_VALUES);
+
 /** @brief Structure to configure an out of process proxy module */
 typedef struct OUTPROCESS_MODULE_CONFIG_DATA
 {
@@ -35,11 +52,48 @@ typedef struct OUTPROCESS_MODULE_CONFIG_DATA
     STRING_HANDLE outprocess_module_args;
 	/** @brief controls timeout for ipc retries. */
 	unsigned int remote_message_wait;
+	/** @brief Size, in bytes, of the frame at which outgoing messages are
+	 *         flushed to the remote module. Zero sends one message per frame. */
+	unsigned int message_batch_size;
+	/** @brief Longest time, in milliseconds, a message waits in a partially
+	 *         filled batch before it is sent. */
+	unsigned int message_batch_delay_ms;
+	/** @brief Largest number of messages waiting to be sent to the remote
+	 *         module. Zero leaves the outgoing queue unbounded. */
+	unsigned int outgoing_queue_limit;
+	/** @brief Which message is dropped when the outgoing queue is full. */
+	OUTPROCESS_QUEUE_OVERFLOW_POLICY outgoing_queue_overflow;
+	/** @brief Number of module host instances behind this module. Zero or
+	 *         one connects to a single module host. */
+	unsigned int instances;
+	/** @brief How messages are spread across the instances. */
+	OUTPROCESS_DISPATCH_POLICY dispatch_policy;
+	/** @brief The message property hashed by OUTPROCESS_DISPATCH_KEY_HASH. */
+	STRING_HANDLE dispatch_key;
+	/** @brief Longest time, in milliseconds, to wait for the module host to
+	 *         reply to the create message. Zero waits until it replies. */
+	unsigned int startup_timeout_ms;
+	/** @brief Traces the latency of messages sent to the module host. Only
+	 *         module hosts that understand trace trailers may be traced. */
+	bool message_trace;
+	/** @brief Shares one control and one message channel with every other
+	 *         multiplexed module connecting to the same control_uri. The
+	 *         module host must be able to host many modules. */
+	bool multiplex;
 } OUTPROCESS_MODULE_CONFIG;
 
 /** @brief the API fr this module */
 extern const MODULE_API_1 Outprocess_Module_API_all;
 
+/** @brief the API for a pool of module host instances behind one module */
+extern const MODULE_API_1 Outprocess_Pool_API_all;
+
+/** @brief Creates the lock guarding the connections shared by multiplexed
+ *         modules. The outprocess loader calls it before any module is
+ *         created; further calls do nothing. The lock is freed with the
+ *         last shared connection. */
+void Outprocess_InitializeSharedConnections(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,7 @@
 
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <uv.h>
 
 #include "azure_c_shared_utility/gballoc.h"
@@ -100,6 +101,71 @@ int launch_child_process_from_entrypoint (OUTPROCESS_LOADER_ENTRYPOINT * outproc
     return result;
 }
 
+int launch_child_process_instances (OUTPROCESS_LOADER_ENTRYPOINT * outprocess_entry)
+{
+    int result;
+    char ** instance_argv;
+
+    if (outprocess_entry->instances <= 1)
+    {
+        /* Codes_SRS_OUTPROCESS_LOADER_17_053: [ If the entrypoint has at most one instance, `launch_child_process_instances` shall launch a single child process with the entrypoint's arguments. ] */
+        result = launch_child_process_from_entrypoint(outprocess_entry);
+    }
+    /* Codes_SRS_OUTPROCESS_LOADER_17_054: [ `launch_child_process_instances` shall allocate an argument array for the instances, by calling `void * malloc(size_t _Size)`. ] */
+    else if (NULL == (instance_argv = (char **)malloc(sizeof(char *) * (outprocess_entry->process_argc + 1))))
+    {
+        /* Codes_SRS_OUTPROCESS_LOADER_17_057: [ If any step fails, `launch_child_process_instances` shall stop launching instances and return a non-zero value. ] */
+        LogError("Unable to allocate instance argument array.");
+        result = __LINE__;
+    }
+    else
+    {
+        const char * control_id = STRING_c_str(outprocess_entry->control_id);
+
+        result = 0;
+        for (unsigned int i = 0; i < outprocess_entry->instances; ++i)
+        {
+            /* Codes_SRS_OUTPROCESS_LOADER_17_055: [ The control id of each instance shall be the entrypoint's control id, followed by "." and the instance index. ] */
+            STRING_HANDLE instance_id = STRING_construct_sprintf("%s.%u", control_id, i);
+            if (NULL == instance_id)
+            {
+                /* Codes_SRS_OUTPROCESS_LOADER_17_057: [ If any step fails, `launch_child_process_instances` shall stop launching instances and return a non-zero value. ] */
+                LogError("Unable to construct the control id of instance %u.", i);
+                result = __LINE__;
+                break;
+            }
+            else
+            {
+                OUTPROCESS_LOADER_ENTRYPOINT instance_entry = *outprocess_entry;
+
+                /* Codes_SRS_OUTPROCESS_LOADER_17_056: [ `launch_child_process_instances` shall launch a child process per instance, replacing every argument equal to the entrypoint's control id with the control id of the instance. ] */
+                for (size_t j = 0; j <= outprocess_entry->process_argc; ++j)
+                {
+                    char * arg = outprocess_entry->process_argv[j];
+                    instance_argv[j] = ((0 < j) && (NULL != arg) && (0 == strcmp(arg, control_id))) ? (char *)STRING_c_str(instance_id) : arg;
+                }
+                instance_entry.process_argv = instance_argv;
+
+                if (launch_child_process_from_entrypoint(&instance_entry))
+                {
+                    /* Codes_SRS_OUTPROCESS_LOADER_17_057: [ If any step fails, `launch_child_process_instances` shall stop launching instances and return a non-zero value. ] */
+                    LogError("Unable to launch instance %u.", i);
+                    result = __LINE__;
+                }
+                STRING_delete(instance_id);
+            }
+
+            if (0 != result)
+            {
+                break;
+            }
+        }
+        free(instance_argv);
+    }
+
+    return result;
+}
+
 int spawn_child_processes (void * context)
 {
     (void)context;
@@ -376,7 +442,8 @@ static MODULE_LIBRARY_HANDLE OutprocessModuleLoader_Load(const MODULE_LOADER* lo
         LogError("Invalid arguments activation type");
     }
     /*Codes_SRS_OUTPROCESS_LOADER_27_005: [ Launch - `OutprocessModuleLoader_Load` shall launch the child process identified by the entrypoint. ]*/
-    else if ((OUTPROCESS_LOADER_ACTIVATION_LAUNCH == outprocess_entry->activation_type) && launch_child_process_from_entrypoint(outprocess_entry))
+    /*Codes_SRS_OUTPROCESS_LOADER_17_052: [ Launch - `OutprocessModuleLoader_Load` shall launch a child process per instance of the entrypoint. ]*/
+    else if ((OUTPROCESS_LOADER_ACTIVATION_LAUNCH == outprocess_entry->activation_type) && launch_child_process_instances(outprocess_entry))
     {
         /*Codes_SRS_OUTPROCESS_LOADER_17_008: [ If any call in this function fails, this function shall return NULL. ] */
         result = NULL;
@@ -411,7 +478,10 @@ static MODULE_LIBRARY_HANDLE OutprocessModuleLoader_Load(const MODULE_LOADER* lo
     {
         /*Codes_SRS_OUTPROCESS_LOADER_17_006: [ The loader shall store the Outprocess_Module_API_all in the loader handle. ] */
         /*Codes_SRS_OUTPROCESS_LOADER_17_007: [ Upon success, this function shall return a valid pointer to the loader handle. ] */
-        result->api = (const MODULE_API*)&Outprocess_Module_API_all;
+        /*Codes_SRS_OUTPROCESS_LOADER_17_051: [ If the entrypoint has more than one instance, the loader shall store the Outprocess_Pool_API_all in the loader handle instead. ] */
+        result->api = (outprocess_entry->instances > 1) ?
+            (const MODULE_API*)&Outprocess_Pool_API_all :
+            (const MODULE_API*)&Outprocess_Module_API_all;
     }
 
     return result;
@@ -566,6 +636,87 @@ static void* OutprocessModuleLoader_ParseEntrypointFromJson(const struct MODULE_
                     config->remote_message_wait = (unsigned int)timeout;
                 }
 
+                /*Codes_SRS_OUTPROCESS_LOADER_17_045: [ This function shall read the "message.batch.size" value, and set message_batch_size to it, or 0 (no batching) if not present. ]*/
+                config->message_batch_size = (unsigned int)json_object_get_number(entrypoint, "message.batch.size");
+                /*Codes_SRS_OUTPROCESS_LOADER_17_046: [ This function shall read the "message.batch.delay.ms" value, and set message_batch_delay_ms to it, or 0 if not present. ]*/
+                config->message_batch_delay_ms = (unsigned int)json_object_get_number(entrypoint, "message.batch.delay.ms");
+
+                /*Codes_SRS_OUTPROCESS_LOADER_17_047: [ This function shall read the "outgoing.queue.limit" value, and set outgoing_queue_limit to it, or 0 (unbounded) if not present. ]*/
+                config->outgoing_queue_limit = (unsigned int)json_object_get_number(entrypoint, "outgoing.queue.limit");
+                /*Codes_SRS_OUTPROCESS_LOADER_17_048: [ This function shall read the "outgoing.queue.overflow" value, and set outgoing_queue_overflow to OUTPROCESS_QUEUE_DROP_OLDEST if it is "drop-oldest", or OUTPROCESS_QUEUE_DROP_NEWEST otherwise. ]*/
+                const char * overflowPolicy = json_object_get_string(entrypoint, "outgoing.queue.overflow");
+                if ((overflowPolicy != NULL) && (strcmp(overflowPolicy, "drop-oldest") == 0))
+                {
+                    config->outgoing_queue_overflow = OUTPROCESS_QUEUE_DROP_OLDEST;
+                }
+                else
+                {
+                    if ((overflowPolicy != NULL) && (strcmp(overflowPolicy, "drop-newest") != 0))
+                    {
+                        LogError("unknown outgoing queue overflow policy \"%s\", dropping newest messages", overflowPolicy);
+                    }
+                    config->outgoing_queue_overflow = OUTPROCESS_QUEUE_DROP_NEWEST;
+                }
+
+                /*Codes_SRS_OUTPROCESS_LOADER_17_049: [ This function shall read the "instances" value, and set instances to it, or 0 (a single instance) if not present. ]*/
+                config->instances = (unsigned int)json_object_get_number(entrypoint, "instances");
+                config->dispatch_policy = OUTPROCESS_DISPATCH_ROUND_ROBIN;
+                config->dispatch_key = NULL;
+                if (config->instances > 1)
+                {
+                    /*Codes_SRS_OUTPROCESS_LOADER_17_050: [ If there is more than one instance, this function shall read the "instances.dispatch" value: "least-loaded" sets dispatch_policy to OUTPROCESS_DISPATCH_LEAST_LOADED, "key-hash" to OUTPROCESS_DISPATCH_KEY_HASH with dispatch_key set to the "instances.dispatch.key" value, and anything else to OUTPROCESS_DISPATCH_ROUND_ROBIN. ]*/
+                    const char * dispatchPolicy = json_object_get_string(entrypoint, "instances.dispatch");
+                    if (dispatchPolicy == NULL || strcmp(dispatchPolicy, "round-robin") == 0)
+                    {
+                        config->dispatch_policy = OUTPROCESS_DISPATCH_ROUND_ROBIN;
+                    }
+                    else if (strcmp(dispatchPolicy, "least-loaded") == 0)
+                    {
+                        config->dispatch_policy = OUTPROCESS_DISPATCH_LEAST_LOADED;
+                    }
+                    else if (strcmp(dispatchPolicy, "key-hash") == 0)
+                    {
+                        const char * dispatchKey = json_object_get_string(entrypoint, "instances.dispatch.key");
+                        if (dispatchKey == NULL)
+                        {
+                            LogError("key-hash dispatch needs an \"instances.dispatch.key\", dispatching round-robin");
+                        }
+                        else if (NULL == (config->dispatch_key = STRING_construct(dispatchKey)))
+                        {
+                            LogError("unable to copy the dispatch key, dispatching round-robin");
+                        }
+                        else
+                        {
+                            config->dispatch_policy = OUTPROCESS_DISPATCH_KEY_HASH;
+                        }
+                    }
+                    else
+                    {
+                        LogError("unknown dispatch policy \"%s\", dispatching round-robin", dispatchPolicy);
+                    }
+                }
+
+                /*Codes_SRS_OUTPROCESS_LOADER_17_059: [ This function shall read the "startup" value, and set parallel_startup to true if it is "parallel", or false otherwise. ]*/
+                const char * startup = json_object_get_string(entrypoint, "startup");
+                if ((startup != NULL) && (strcmp(startup, "parallel") == 0))
+                {
+                    config->parallel_startup = true;
+                }
+                else
+                {
+                    if ((startup != NULL) && (strcmp(startup, "sequential") != 0))
+                    {
+                        LogError("unknown startup mode \"%s\", starting sequentially", startup);
+                    }
+                    config->parallel_startup = false;
+                }
+                /*Codes_SRS_OUTPROCESS_LOADER_17_060: [ This function shall read the "startup.timeout.ms" value, and set startup_timeout_ms to it, or 0 (no deadline) if not present. ]*/
+                config->startup_timeout_ms = (unsigned int)json_object_get_number(entrypoint, "startup.timeout.ms");
+                /*Codes_SRS_OUTPROCESS_LOADER_17_062: [ This function shall set message_trace to true if the "message.trace" value is true, or false otherwise. ]*/
+                config->message_trace = (json_object_get_boolean(entrypoint, "message.trace") == 1);
+                /*Codes_SRS_OUTPROCESS_LOADER_17_064: [ This function shall set multiplex to true if the "multiplex" value is true, or false otherwise. ]*/
+                config->multiplex = (json_object_get_boolean(entrypoint, "multiplex") == 1);
+
                 /*Codes_SRS_OUTPROCESS_LOADER_17_017: [ This function shall assign the entrypoint activation_type to the decoded value. ] */
                 config->activation_type = activationType;
 
@@ -591,6 +742,8 @@ static void OutprocessModuleLoader_FreeEntrypoint(const struct MODULE_LOADER_TAG
         if (ep->message_id != NULL)
             STRING_delete(ep->message_id); 
         STRING_delete(ep->control_id);
+        if (ep->dispatch_key != NULL)
+            STRING_delete(ep->dispatch_key);
         if (ep->process_argv) {
             for (size_t i = 0; i < ep->process_argc; ++i) {
                 free(ep->process_argv[i]);
@@ -699,11 +852,38 @@ static void* OutprocessModuleLoader_BuildModuleConfiguration(
             free(fullModuleConfiguration);
             fullModuleConfiguration = NULL;
         }
+        /*Codes_SRS_OUTPROCESS_LOADER_17_058: [ This function shall copy the entrypoint's instances, dispatch_policy and dispatch_key to the OUTPROCESS_MODULE_CONFIG. ]*/
+        else if ((ep->dispatch_key != NULL) && (NULL == (fullModuleConfiguration->dispatch_key = STRING_clone(ep->dispatch_key))))
+        {
+            /*Codes_SRS_OUTPROCESS_LOADER_17_036: [ If any call fails, this function shall return NULL. ]*/
+            LogError("unable to allocate a dispatch key string");
+            STRING_delete(fullModuleConfiguration->message_uri);
+            STRING_delete(fullModuleConfiguration->control_uri);
+            STRING_delete(fullModuleConfiguration->outprocess_module_args);
+            free(fullModuleConfiguration);
+            fullModuleConfiguration = NULL;
+        }
         else
         {
             /*Codes_SRS_OUTPROCESS_LOADER_17_035: [ Upon success, this function shall return a valid pointer to an OUTPROCESS_MODULE_CONFIG structure. ]*/
+            if (ep->dispatch_key == NULL)
+            {
+                fullModuleConfiguration->dispatch_key = NULL;
+            }
+            fullModuleConfiguration->instances = ep->instances;
+            fullModuleConfiguration->dispatch_policy = ep->dispatch_policy;
             fullModuleConfiguration->remote_message_wait = ep->remote_message_wait;
-            fullModuleConfiguration->lifecycle_model = OUTPROCESS_LIFECYCLE_SYNC;
+            fullModuleConfiguration->message_batch_size = ep->message_batch_size;
+            fullModuleConfiguration->message_batch_delay_ms = ep->message_batch_delay_ms;
+            fullModuleConfiguration->outgoing_queue_limit = ep->outgoing_queue_limit;
+            fullModuleConfiguration->outgoing_queue_overflow = ep->outgoing_queue_overflow;
+            /*Codes_SRS_OUTPROCESS_LOADER_17_061: [ This function shall set lifecycle_model to OUTPROCESS_LIFECYCLE_ASYNC if the entrypoint's parallel_startup is true, or OUTPROCESS_LIFECYCLE_SYNC otherwise, and copy the entrypoint's startup_timeout_ms. ]*/
+            fullModuleConfiguration->lifecycle_model = ep->parallel_startup ? OUTPROCESS_LIFECYCLE_ASYNC : OUTPROCESS_LIFECYCLE_SYNC;
+            fullModuleConfiguration->startup_timeout_ms = ep->startup_timeout_ms;
+            /*Codes_SRS_OUTPROCESS_LOADER_17_063: [ This function shall copy the entrypoint's message_trace to the OUTPROCESS_MODULE_CONFIG. ]*/
+            fullModuleConfiguration->message_trace = ep->message_trace;
+            /*Codes_SRS_OUTPROCESS_LOADER_17_065: [ This function shall copy the entrypoint's multiplex to the OUTPROCESS_MODULE_CONFIG. ]*/
+            fullModuleConfiguration->multiplex = ep->multiplex;
         }
     }
 
@@ -720,6 +900,8 @@ static void OutprocessModuleLoader_FreeModuleConfiguration(const struct MODULE_L
         STRING_delete(config->control_uri);
         STRING_delete(config->message_uri);
         STRING_delete(config->outprocess_module_args);
+        if (config->dispatch_key != NULL)
+            STRING_delete(config->dispatch_key);
         free(config);
     }
 }
@@ -753,6 +935,12 @@ static MODULE_LOADER OutProcess_Module_Loader =
 
 const MODULE_LOADER* OutprocessLoader_Get(void)
 {
+    /**
+     * The loader is always retrieved here before any module is created,
+     * which is where the lock of the shared connections gets created.
+     */
+    Outprocess_InitializeSharedConnections();
+
     /*Codes_SRS_OUTPROCESS_LOADER_17_038: [ OutprocessModuleLoader_Get shall return a non-NULL pointer to a MODULE_LOADER struct. ]*/
     return &OutProcess_Module_Loader;
 }
@@ -2,6 +2,9 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <errno.h>
 #include <nanomsg/nn.h>
 #include <nanomsg/pair.h>
@@ -11,12 +14,17 @@
 #include "message.h"
 #include "message_queue.h"
 #include "control_message.h"
+#include "message_batch.h"
+#include "message_trace.h"
+#include "message_mux.h"
 #include "module_loaders/outprocess_module.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/threadapi.h"
 #include "azure_c_shared_utility/lock.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/constmap.h"
 
 typedef struct THREAD_CONTROL_TAG
 {
@@ -27,6 +35,30 @@ typedef struct THREAD_CONTROL_TAG
 
 #define THREAD_FLAG_STOP 1
 
+typedef struct SEND_CREDIT_TAG
+{
+	bool message_window_enforced;
+	uint32_t messages;
+	bool byte_window_enforced;
+	uint32_t bytes;
+} SEND_CREDIT;
+
+/* The control and message channels shared by every multiplexed module
+ * connecting to the same module host. */
+typedef struct OUTPROCESS_CONNECTION_TAG
+{
+	STRING_HANDLE control_uri;
+	STRING_HANDLE message_uri;
+	int control_socket;
+	int message_socket;
+	size_t ref_count;
+	uint32_t next_module_id;
+	LOCK_HANDLE lock;
+	struct OUTPROCESS_HANDLE_DATA_TAG * modules;
+	THREAD_CONTROL receive_thread;
+	struct OUTPROCESS_CONNECTION_TAG * next;
+} OUTPROCESS_CONNECTION;
+
 typedef struct OUTPROCESS_HANDLE_DATA_TAG
 {
 	LOCK_HANDLE handle_lock;
@@ -38,7 +70,24 @@ typedef struct OUTPROCESS_HANDLE_DATA_TAG
 	STRING_HANDLE module_args;
 	OUTPROCESS_MODULE_LIFECYCLE lifecyle_model;
 	BROKER_HANDLE broker;
+	MODULE_HANDLE publisher;
 	unsigned int remote_message_wait;
+	unsigned int startup_timeout_ms;
+	unsigned int message_batch_size;
+	unsigned int message_batch_delay_ms;
+	unsigned int outgoing_queue_limit;
+	OUTPROCESS_QUEUE_OVERFLOW_POLICY outgoing_queue_overflow;
+	size_t outgoing_count;
+	SEND_CREDIT send_credit;
+	MESSAGE_TRACE_HISTOGRAM_HANDLE trace_histogram;
+	MESSAGE_HANDLE traced_message;
+	uint64_t traced_enqueued;
+	bool multiplexed;
+	OUTPROCESS_CONNECTION * connection;
+	uint32_t module_id;
+	bool reply_received;
+	uint8_t reply_status;
+	struct OUTPROCESS_HANDLE_DATA_TAG * next_connected_module;
 
 	THREAD_CONTROL message_receive_thread;
 	THREAD_CONTROL message_send_thread;
@@ -46,10 +95,101 @@ typedef struct OUTPROCESS_HANDLE_DATA_TAG
 	THREAD_CONTROL control_thread;
 } OUTPROCESS_HANDLE_DATA;
 
+typedef struct OUTPROCESS_POOL_HANDLE_DATA_TAG
+{
+	MODULE_HANDLE * instances;
+	size_t instance_count;
+	OUTPROCESS_DISPATCH_POLICY dispatch_policy;
+	STRING_HANDLE dispatch_key;
+	size_t next_instance;
+} OUTPROCESS_POOL_HANDLE_DATA;
+
+#define INSTANCE_SUFFIX_SIZE 12
+
+/* Modules may be created and destroyed from several threads at once (the
+ * gateway's caller and its configuration file watcher), so the list of
+ * shared connections and their reference counts are guarded by a lock. */
+static OUTPROCESS_CONNECTION * shared_connections = NULL;
+static LOCK_HANDLE shared_connections_lock = NULL;
+
 // forward definitions
 static void* construct_create_message(OUTPROCESS_HANDLE_DATA* handleData, int32_t * creationMessageSize);
 static void send_start_message(OUTPROCESS_HANDLE_DATA* handleData);
+static void shutdown_a_thread(THREAD_CONTROL * theThreadControl);
+
+/* where the messages received for a module are published, copied out of
+ * the module so they can be published without holding its locks */
+typedef struct FRAME_PUBLISHER_TAG
+{
+	BROKER_HANDLE broker;
+	MODULE_HANDLE publisher;
+} FRAME_PUBLISHER;
+
+static void publish_batched_message(void * context, MESSAGE_HANDLE message)
+{
+	FRAME_PUBLISHER * frame_publisher = (FRAME_PUBLISHER*)context;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_040: [ This function shall publish any successfully created gateway message to the broker. ]*/
+	/*Codes_SRS_OUTPROCESS_MODULE_17_104: [ An instance of a pool shall publish its messages as the pool. ]*/
+	Broker_Publish(frame_publisher->broker, frame_publisher->publisher, message);
+}
+
+static void record_trace_report(OUTPROCESS_HANDLE_DATA * handleData, const unsigned char * source, size_t size)
+{
+	MESSAGE_TRACE trace;
+	if (MessageTrace_FromReport(source, size, &trace) != 0)
+	{
+		LogError("unable to read trace report from module host");
+	}
+	else if (MessageTrace_Stamp(&trace) != 0 || MessageTrace_Record(handleData->trace_histogram, &trace) != 0)
+	{
+		LogError("unable to record trace report from module host");
+	}
+}
+
+static void publish_message_frame(FRAME_PUBLISHER * frame_publisher, const unsigned char * buf_bytes, size_t nbytes)
+{
+	if (MessageBatch_IsBatch(buf_bytes, nbytes))
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_065: [ If the received frame is a message batch, this function shall deserialize and publish every message in the batch, in order. ]*/
+		if (MessageBatch_ForEach(buf_bytes, nbytes, publish_batched_message, frame_publisher) != 0)
+		{
+			LogError("unable to deliver every message in a batch from module host");
+		}
+	}
+	else
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_039: [ Upon successful receiving a gateway message, this function shall deserialize the message. ]*/
+		MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, (int32_t)nbytes);
+		if (msg != NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_040: [ This function shall publish any successfully created gateway message to the broker. ]*/
+			/*Codes_SRS_OUTPROCESS_MODULE_17_104: [ An instance of a pool shall publish its messages as the pool. ]*/
+			Broker_Publish(frame_publisher->broker, frame_publisher->publisher, msg);
+			Message_Destroy(msg);
+		}
+	}
+}
 
+/* returns true if the frame is a trace report, which has been recorded */
+static bool receive_trace_report(OUTPROCESS_HANDLE_DATA * handleData, const unsigned char * buf_bytes, size_t nbytes)
+{
+	bool result = (handleData->trace_histogram != NULL && MessageTrace_IsReport(buf_bytes, nbytes));
+	if (result)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_093: [ If message tracing is enabled and the received frame is a trace report, this function shall stamp the report hop and record the trace in the latency histograms. ]*/
+		record_trace_report(handleData, buf_bytes, nbytes);
+	}
+	return result;
+}
+
+static void receive_message_frame(OUTPROCESS_HANDLE_DATA * handleData, const unsigned char * buf_bytes, size_t nbytes)
+{
+	if (!receive_trace_report(handleData, buf_bytes, nbytes))
+	{
+		FRAME_PUBLISHER frame_publisher = { handleData->broker, handleData->publisher };
+		publish_message_frame(&frame_publisher, buf_bytes, nbytes);
+	}
+}
 
 int outprocessIncomingMessageThread(void *param)
 {
@@ -111,15 +251,7 @@ int outprocessIncomingMessageThread(void *param)
 			}
 			else
 			{
-				/*Codes_SRS_OUTPROCESS_MODULE_17_039: [ Upon successful receiving a gateway message, this function shall deserialize the message. ]*/
-				const unsigned char*buf_bytes = (const unsigned char*)buf;
-				MESSAGE_HANDLE msg = Message_CreateFromByteArray(buf_bytes, nbytes);
-				if (msg != NULL)
-				{
-					/*Codes_SRS_OUTPROCESS_MODULE_17_040: [ This function shall publish any successfully created gateway message to the broker. ]*/
-					Broker_Publish(handleData->broker, (MODULE_HANDLE)handleData, msg);
-					Message_Destroy(msg);
-				}
+				receive_message_frame(handleData, (const unsigned char*)buf, (size_t)nbytes);
 				nn_freemsg(buf);
 			}
 			ThreadAPI_Sleep(1);
@@ -128,6 +260,120 @@ int outprocessIncomingMessageThread(void *param)
 	return 0;
 }
 
+static int32_t frame_header_size(OUTPROCESS_HANDLE_DATA * handleData)
+{
+	return handleData->multiplexed ? MESSAGE_MUX_HEADER_SIZE : 0;
+}
+
+static void write_frame_header(OUTPROCESS_HANDLE_DATA * handleData, unsigned char * buf)
+{
+	if (handleData->multiplexed)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_097: [ If the module is multiplexed, every frame it sends shall start with a mux header carrying its module id. ]*/
+		(void)MessageMux_WriteHeader(handleData->module_id, buf, MESSAGE_MUX_HEADER_SIZE);
+	}
+}
+
+static void send_message_batch(OUTPROCESS_HANDLE_DATA * handleData, MESSAGE_BATCH_HANDLE batch, int flags)
+{
+	int32_t header_size = frame_header_size(handleData);
+	int32_t batch_size = MessageBatch_ToByteArray(batch, NULL, 0);
+	if (batch_size < 0)
+	{
+		LogError("unable to serialize outgoing message batch");
+	}
+	else
+	{
+		void* result = nn_allocmsg(header_size + batch_size, 0);
+		if (result == NULL)
+		{
+			LogError("unable to allocate buffer for outgoing message batch");
+		}
+		else
+		{
+			write_frame_header(handleData, (unsigned char *)result);
+			(void)MessageBatch_ToByteArray(batch, (unsigned char *)result + header_size, batch_size);
+			/*Codes_SRS_OUTPROCESS_MODULE_17_064: [ Once a flush is due, this function shall send the batch as a single frame on the message channel and empty the batch. ]*/
+			int nbytes = nn_send(handleData->message_socket, &result, NN_MSG, flags);
+			if (nbytes != header_size + batch_size)
+			{
+				LogError("unable to send message batch to remote");
+				/*Codes_SRS_OUTPROCESS_MODULE_17_025: [ This function shall free any resources created. ]*/
+				nn_freemsg(result);
+			}
+		}
+	}
+	MessageBatch_Clear(batch);
+}
+
+/* must be called with the handle lock held */
+static bool take_send_credit(OUTPROCESS_HANDLE_DATA * handleData, MESSAGE_HANDLE messageHandle)
+{
+	bool result;
+	SEND_CREDIT * credit = &(handleData->send_credit);
+	if (credit->message_window_enforced && credit->messages == 0)
+	{
+		result = false;
+	}
+	else if (credit->byte_window_enforced)
+	{
+		int32_t msg_size = Message_ToByteArray(messageHandle, NULL, 0);
+		if (msg_size < 0)
+		{
+			/* the send path reports messages that cannot be serialized */
+			result = true;
+		}
+		else if ((uint32_t)msg_size > credit->bytes)
+		{
+			result = false;
+		}
+		else
+		{
+			credit->bytes -= (uint32_t)msg_size;
+			result = true;
+		}
+	}
+	else
+	{
+		result = true;
+	}
+	if (result && credit->message_window_enforced)
+	{
+		credit->messages--;
+	}
+	return result;
+}
+
+static uint32_t add_credit(uint32_t available, uint32_t granted)
+{
+	return (available > UINT32_MAX - granted) ? UINT32_MAX : available + granted;
+}
+
+static void grant_send_credit(OUTPROCESS_HANDLE_DATA * handleData, CONTROL_MESSAGE_MODULE_CREDIT * credit_msg)
+{
+	if (Lock(handleData->handle_lock) != LOCK_OK)
+	{
+		LogError("unable to Lock handle data, credits dropped");
+	}
+	else
+	{
+		SEND_CREDIT * credit = &(handleData->send_credit);
+		/*Codes_SRS_OUTPROCESS_MODULE_17_067: [ A window shall be enforced from the first Module Credit message that grants a non-zero value for it. ]*/
+		if (credit_msg->message_credits != 0)
+		{
+			credit->message_window_enforced = true;
+		}
+		if (credit_msg->byte_credits != 0)
+		{
+			credit->byte_window_enforced = true;
+		}
+		/*Codes_SRS_OUTPROCESS_MODULE_17_066: [ If a Module Credit message has been received, this thread shall add its message and byte credits to the credits available for sending gateway messages. ]*/
+		credit->messages = add_credit(credit->messages, credit_msg->message_credits);
+		credit->bytes = add_credit(credit->bytes, credit_msg->byte_credits);
+		(void)Unlock(handleData->handle_lock);
+	}
+}
+
 static int outprocessOutgoingMessagesThread(void * param)
 {
 	OUTPROCESS_HANDLE_DATA * handleData = (OUTPROCESS_HANDLE_DATA*)param;
@@ -138,6 +384,17 @@ static int outprocessOutgoingMessagesThread(void * param)
 	else
 	{
 		int should_continue = 1;
+		MESSAGE_BATCH_HANDLE batch = NULL;
+		size_t batched_count = 0;
+		if (handleData->message_batch_size > 0)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_062: [ If message_batch_size is not zero, this thread shall create a message batch of that size. ]*/
+			batch = MessageBatch_Create(handleData->message_batch_size, handleData->message_batch_delay_ms);
+			if (batch == NULL)
+			{
+				LogError("unable to create message batch, sending one message per frame");
+			}
+		}
 
 		while (should_continue)
 		{
@@ -160,6 +417,8 @@ static int outprocessOutgoingMessagesThread(void * param)
 				break;
 			}
 			MESSAGE_HANDLE messageHandle;
+			MESSAGE_TRACE trace;
+			trace.count = 0;
 			/*Codes_SRS_OUTPROCESS_MODULE_17_053: [ This thread shall ensure thread safety on the module data. ]*/
 			if (Lock(handleData->handle_lock) != LOCK_OK)
 			{
@@ -172,6 +431,14 @@ static int outprocessOutgoingMessagesThread(void * param)
 			{
 				messageHandle = NULL;
 			}
+			else if (
+				(handleData->send_credit.message_window_enforced || handleData->send_credit.byte_window_enforced) &&
+				!take_send_credit(handleData, MESSAGE_QUEUE_front(handleData->outgoing_messages))
+				)
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_068: [ If the module host has granted credits, this function shall leave messages in the queue until enough message and byte credits are available, and consume those credits when a message is removed. ]*/
+				messageHandle = NULL;
+			}
 			else
 			{
 				/*Codes_SRS_OUTPROCESS_MODULE_17_054: [ This function shall remove the oldest message from the outgoing gateway message queue. ]*/
@@ -183,6 +450,13 @@ static int outprocessOutgoingMessagesThread(void * param)
 					should_continue = 0;
 					break;
 				}
+				handleData->outgoing_count--;
+				if (messageHandle == handleData->traced_message)
+				{
+					trace.stamps[MESSAGE_TRACE_HOP_ENQUEUE] = handleData->traced_enqueued;
+					trace.count = MESSAGE_TRACE_HOP_ENQUEUE + 1;
+					handleData->traced_message = NULL;
+				}
 			}
 			if (Unlock(handleData->handle_lock) != LOCK_OK)
 			{
@@ -191,28 +465,68 @@ static int outprocessOutgoingMessagesThread(void * param)
 			}
 
 			/* forward message to remote */
-			if (messageHandle != NULL)
+			if (messageHandle != NULL && batch != NULL)
+			{
+				int add_result;
+				if (trace.count > 0)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_17_110: [ When batching a traced message, this function shall stamp its send hop and append its trace trailer to the batch entry. ]*/
+					trace.stamps[MESSAGE_TRACE_HOP_SEND] = MessageTrace_Now();
+					trace.count = MESSAGE_TRACE_HOP_SEND + 1;
+					add_result = MessageBatch_AddTracedMessage(batch, messageHandle, &trace);
+				}
+				else
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_17_063: [ When batching, this function shall append the message to the batch instead of sending it. ]*/
+					add_result = MessageBatch_AddMessage(batch, messageHandle);
+				}
+				if (add_result != 0)
+				{
+					LogError("unable to add outgoing message [%p] to batch", messageHandle);
+				}
+				else
+				{
+					batched_count++;
+				}
+				Message_Destroy(messageHandle);
+			}
+			else if (messageHandle != NULL)
 			{
 				/*Codes_SRS_OUTPROCESS_MODULE_17_023: [ This function shall serialize the message for transmission on the message channel. ]*/
+				int32_t header_size = frame_header_size(handleData);
 				int32_t msg_size = Message_ToByteArray(messageHandle, NULL, 0);
-				if (msg_size < 0)
+				int32_t trailer_size = 0;
+				if (trace.count > 0)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_17_091: [ If the message is traced, this function shall append a trace trailer holding the enqueue and send hops after the serialized message. ]*/
+					trace.count = MESSAGE_TRACE_HOP_SEND + 1;
+					trailer_size = MessageTrace_ToTrailer(&trace, NULL, 0);
+				}
+				if (msg_size < 0 || trailer_size < 0)
 				{
 					LogError("unable to serialize outgoing message [%p]", messageHandle);
 				}
 				else
 				{
-					void* result = nn_allocmsg(msg_size, 0);
+					void* result = nn_allocmsg(header_size + msg_size + trailer_size, 0);
 					if (result == NULL)
 					{
 						LogError("unable to allocate buffer for outgoing message [%p]", messageHandle);
 					}
 					else
 					{
-						unsigned char *nn_msg_bytes = (unsigned char *)result;
+						write_frame_header(handleData, (unsigned char *)result);
+						unsigned char *nn_msg_bytes = (unsigned char *)result + header_size;
 						Message_ToByteArray(messageHandle, nn_msg_bytes, msg_size);
+						if (trailer_size > 0)
+						{
+							/* the send hop is stamped as late as possible */
+							trace.stamps[MESSAGE_TRACE_HOP_SEND] = MessageTrace_Now();
+							(void)MessageTrace_ToTrailer(&trace, nn_msg_bytes + msg_size, trailer_size);
+						}
 						/*Codes_SRS_OUTPROCESS_MODULE_17_024: [ This function shall send the message on the message channel. ]*/
 						int nbytes = nn_send(handleData->message_socket, &result, NN_MSG, 0);
-						if (nbytes != msg_size)
+						if (nbytes != header_size + msg_size + trailer_size)
 						{
 							LogError("unable to send buffer to remote for message [%p]", messageHandle);
 							/*Codes_SRS_OUTPROCESS_MODULE_17_025: [ This function shall free any resources created. ]*/
@@ -224,12 +538,77 @@ static int outprocessOutgoingMessagesThread(void * param)
 				/*Codes_SRS_OUTPROCESS_MODULE_17_055: [ This function shall Destroy the message once successfully transmitted. ]*/
 				Message_Destroy(messageHandle);
 			}
-			ThreadAPI_Sleep(1);
+			if (batch != NULL && MessageBatch_IsFlushDue(batch))
+			{
+				send_message_batch(handleData, batch, 0);
+				batched_count = 0;
+			}
+			/* when batching, keep draining the queue while it has messages */
+			if (batch == NULL || messageHandle == NULL)
+			{
+				ThreadAPI_Sleep(1);
+			}
+		}
+		if (batch != NULL)
+		{
+			if (batched_count > 0)
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_111: [ When asked to stop, this thread shall send any pending batch on the message channel, without waiting for the remote, before exiting. ]*/
+				send_message_batch(handleData, batch, NN_DONTWAIT);
+			}
+			MessageBatch_Destroy(batch);
 		}
 	}
 	return 0;
 }
 
+static void set_module_reply(OUTPROCESS_HANDLE_DATA * handleData, uint8_t status)
+{
+	if (Lock(handleData->handle_lock) != LOCK_OK)
+	{
+		LogError("unable to Lock handle data, module reply dropped");
+	}
+	else
+	{
+		handleData->reply_received = true;
+		handleData->reply_status = status;
+		(void)Unlock(handleData->handle_lock);
+	}
+}
+
+static bool take_module_reply(OUTPROCESS_HANDLE_DATA * handleData, uint8_t * status)
+{
+	bool result = false;
+	if (Lock(handleData->handle_lock) != LOCK_OK)
+	{
+		LogError("unable to Lock handle data");
+	}
+	else
+	{
+		if (handleData->reply_received)
+		{
+			*status = handleData->reply_status;
+			handleData->reply_received = false;
+			result = true;
+		}
+		(void)Unlock(handleData->handle_lock);
+	}
+	return result;
+}
+
+static bool wait_for_module_reply(OUTPROCESS_HANDLE_DATA * handleData, unsigned int wait_ms, uint8_t * status)
+{
+	bool result = take_module_reply(handleData, status);
+	unsigned int waited_ms = 0;
+	while (!result && waited_ms < wait_ms)
+	{
+		ThreadAPI_Sleep(1);
+		waited_ms++;
+		result = take_module_reply(handleData, status);
+	}
+	return result;
+}
+
 static int outprocessCreate(void *param)
 {
 	int thread_return;
@@ -251,9 +630,34 @@ static int outprocessCreate(void *param)
 		{
 			int control_fd = handleData->control_socket;
 			int remote_message_wait = (int)handleData->remote_message_wait;
+			unsigned int startup_timeout_ms = handleData->startup_timeout_ms;
+			/*Codes_SRS_OUTPROCESS_MODULE_17_069: [ A newly created module host starts without any credit windows enforced. ]*/
+			handleData->send_credit.message_window_enforced = false;
+			handleData->send_credit.messages = 0;
+			handleData->send_credit.byte_window_enforced = false;
+			handleData->send_credit.bytes = 0;
+			handleData->reply_received = false;
 			(void)Unlock(handleData->handle_lock);
 			int should_continue = 1;
 
+			TICK_COUNTER_HANDLE startup_ticks = NULL;
+			tickcounter_ms_t startup_began = 0;
+			if (startup_timeout_ms != 0)
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_086: [ If startup_timeout_ms is not zero, this thread shall mark the time the Create handshake began. ]*/
+				startup_ticks = tickcounter_create();
+				if (startup_ticks == NULL)
+				{
+					LogError("unable to create a tick counter, the create handshake will not time out");
+				}
+				else if (tickcounter_get_current_ms(startup_ticks, &startup_began) != 0)
+				{
+					LogError("unable to read the tick counter, the create handshake will not time out");
+					tickcounter_destroy(startup_ticks);
+					startup_ticks = NULL;
+				}
+			}
+
 			do {
 				int32_t creationMessageSize = 0;
 
@@ -295,6 +699,17 @@ static int outprocessCreate(void *param)
 								ThreadAPI_Sleep((unsigned int)remote_message_wait);
 							}
 						}
+						else if (handleData->multiplexed)
+						{
+							uint8_t status;
+							/*Codes_SRS_OUTPROCESS_MODULE_17_101: [ If the module is multiplexed, this function shall wait for the Module Reply routed to it by the shared connection instead of receiving on the control channel. ]*/
+							if (wait_for_module_reply(handleData, (unsigned int)remote_message_wait, &status))
+							{
+								should_continue = 0;
+								/*Codes_SRS_OUTPROCESS_MODULE_17_015: [ This function shall expect a successful result from the Create Response to consider the module creation a success. ]*/
+								thread_return = (status == 0) ? 1 : -1;
+							}
+						}
 						else
 						{
 							unsigned char *buf = NULL;
@@ -345,7 +760,26 @@ static int outprocessCreate(void *param)
 						}
 					} 
 				}
+				if (should_continue == 1 && startup_ticks != NULL)
+				{
+					tickcounter_ms_t now;
+					if (
+						(tickcounter_get_current_ms(startup_ticks, &now) != 0) ||
+						((now - startup_began) >= startup_timeout_ms)
+						)
+					{
+						/*Codes_SRS_OUTPROCESS_MODULE_17_087: [ If no Create Response has been received once startup_timeout_ms has elapsed, this thread shall stop waiting and report a failure. ]*/
+						LogError("module host did not reply to the create message within %u ms", startup_timeout_ms);
+						should_continue = 0;
+						thread_return = -1;
+					}
+				}
 			} while (should_continue == 1);
+
+			if (startup_ticks != NULL)
+			{
+				tickcounter_destroy(startup_ticks);
+			}
 		}
 	}
 	return thread_return;
@@ -402,63 +836,467 @@ int outprocessControlThread(void *param)
 				}
 			}
 
-			/*Codes_SRS_OUTPROCESS_MODULE_17_056: [ This thread shall ensure thread safety on the module data. ]*/
-			if (Lock(handleData->handle_lock) != LOCK_OK)
+			if (handleData->multiplexed)
 			{
-				LogError("unable to Lock handle data");
+				uint8_t status;
+				/*Codes_SRS_OUTPROCESS_MODULE_17_102: [ If the module is multiplexed, this thread shall look for a Module Reply routed to it by the shared connection instead of receiving from the control channel. ]*/
+				if (take_module_reply(handleData, &status) && status != 0)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_17_059: [ If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process. ]*/
+					needs_to_attach = 1;
+				}
+			}
+			else
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_056: [ This thread shall ensure thread safety on the module data. ]*/
+				if (Lock(handleData->handle_lock) != LOCK_OK)
+				{
+					LogError("unable to Lock handle data");
+					should_continue = 0;
+					break;
+				}
+				int nn_fd = handleData->control_socket;
+				if (Unlock(handleData->handle_lock) != LOCK_OK)
+				{
+					should_continue = 0;
+					break;
+				}
+
+				int nbytes;
+				unsigned char *buf = NULL;
+				errno = 0;
+				/*Codes_SRS_OUTPROCESS_MODULE_17_057: [ This thread shall periodically attempt to receive a meesage from the module host process. ]*/
+				nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, NN_DONTWAIT);
+				if (nbytes < 0)
+				{
+					int receive_error = nn_errno();
+					if (receive_error != EAGAIN)
+						should_continue = 0;
+				}
+				else
+				{
+					CONTROL_MESSAGE * msg = ControlMessage_CreateFromByteArray((const unsigned char*)buf, nbytes);
+					nn_freemsg(buf);
+					if (msg != NULL)
+					{
+						/*Codes_SRS_OUTPROCESS_MODULE_17_058: [ If a message has been received, it shall look for a Module Reply message. ]*/
+						if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_REPLY)
+						{
+							CONTROL_MESSAGE_MODULE_REPLY * resp_msg = (CONTROL_MESSAGE_MODULE_REPLY*)msg;
+							if (resp_msg->status != 0)
+							{
+								/*Codes_SRS_OUTPROCESS_MODULE_17_059: [ If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process. ]*/
+								needs_to_attach = 1;
+							}
+						}
+						else if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_CREDIT)
+						{
+							/*Codes_SRS_OUTPROCESS_MODULE_17_066: [ If a Module Credit message has been received, this thread shall add its message and byte credits to the credits available for sending gateway messages. ]*/
+							grant_send_credit(handleData, (CONTROL_MESSAGE_MODULE_CREDIT*)msg);
+						}
+						ControlMessage_Destroy(msg);
+					}
+				}
+			}
+			ThreadAPI_Sleep(250);
+		}
+	}
+	return 0;
+}
+
+/* Connection related functions
+*/
+
+/* must be called with the connection lock held */
+static OUTPROCESS_HANDLE_DATA * find_connected_module(OUTPROCESS_CONNECTION * connection, uint32_t module_id)
+{
+	OUTPROCESS_HANDLE_DATA * result = connection->modules;
+	while (result != NULL && result->module_id != module_id)
+	{
+		result = result->next_connected_module;
+	}
+	return result;
+}
+
+/* must be called with the connection lock held */
+static void dispatch_control_frame(OUTPROCESS_CONNECTION * connection, OUTPROCESS_HANDLE_DATA * handleData, const unsigned char * frame, size_t size)
+{
+	CONTROL_MESSAGE * msg = ControlMessage_CreateFromByteArray(frame, size);
+	if (msg == NULL)
+	{
+		LogError("unable to read control message from module host");
+	}
+	else
+	{
+		if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_REPLY)
+		{
+			uint8_t status = ((CONTROL_MESSAGE_MODULE_REPLY*)msg)->status;
+			if (handleData != NULL)
+			{
+				set_module_reply(handleData, status);
+			}
+			else if (status != 0)
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_099: [ A failed Module Reply without a mux header shall be routed to every module on the shared connection. ]*/
+				OUTPROCESS_HANDLE_DATA * module = connection->modules;
+				while (module != NULL)
+				{
+					set_module_reply(module, status);
+					module = module->next_connected_module;
+				}
+			}
+		}
+		else if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_CREDIT && handleData != NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_066: [ If a Module Credit message has been received, this thread shall add its message and byte credits to the credits available for sending gateway messages. ]*/
+			grant_send_credit(handleData, (CONTROL_MESSAGE_MODULE_CREDIT*)msg);
+		}
+		ControlMessage_Destroy(msg);
+	}
+}
+
+/* returns 1 if a frame was received, 0 if none was waiting */
+static int receive_connection_frame(OUTPROCESS_CONNECTION * connection, int nn_fd, bool is_control)
+{
+	int result;
+	unsigned char *buf = NULL;
+	int nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, NN_DONTWAIT);
+	if (nbytes < 0)
+	{
+		int receive_error = nn_errno();
+		result = (receive_error == EAGAIN || receive_error == ETIMEDOUT) ? 0 : -1;
+	}
+	else
+	{
+		FRAME_PUBLISHER frame_publisher = { NULL, NULL };
+		uint32_t module_id = 0;
+		int32_t header_size = MessageMux_ReadHeader(buf, (size_t)nbytes, &module_id);
+		if (header_size < 0)
+		{
+			LogError("dropped a malformed frame from module host");
+		}
+		else if (Lock(connection->lock) != LOCK_OK)
+		{
+			LogError("unable to Lock shared connection, frame dropped");
+		}
+		else
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_098: [ A shared connection shall run a single thread receiving from both channels and routing each frame to the module named by its mux header. ]*/
+			OUTPROCESS_HANDLE_DATA * handleData = (header_size == 0) ? NULL : find_connected_module(connection, module_id);
+			if (is_control)
+			{
+				dispatch_control_frame(connection, handleData, buf + header_size, (size_t)(nbytes - header_size));
+			}
+			else if (handleData == NULL)
+			{
+				LogError("dropped a message frame for unknown module %u", (unsigned int)module_id);
+			}
+			else if (!receive_trace_report(handleData, buf + header_size, (size_t)(nbytes - header_size)))
+			{
+				frame_publisher.broker = handleData->broker;
+				frame_publisher.publisher = handleData->publisher;
+			}
+			(void)Unlock(connection->lock);
+		}
+
+		if (frame_publisher.broker != NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_107: [ A shared connection shall publish the messages it receives after releasing the connection lock. ]*/
+			publish_message_frame(&frame_publisher, buf + header_size, (size_t)(nbytes - header_size));
+		}
+		nn_freemsg(buf);
+		result = 1;
+	}
+	return result;
+}
+
+static int outprocessConnectionThread(void *param)
+{
+	OUTPROCESS_CONNECTION * connection = (OUTPROCESS_CONNECTION*)param;
+	if (connection == NULL)
+	{
+		LogError("outprocess connection thread: parameter is NULL");
+	}
+	else
+	{
+		int should_continue = 1;
+
+		while (should_continue)
+		{
+			if (Lock(connection->receive_thread.thread_lock) != LOCK_OK)
+			{
+				LogError("unable to Lock");
 				should_continue = 0;
 				break;
 			}
-			int nn_fd = handleData->control_socket;
-			if (Unlock(handleData->handle_lock) != LOCK_OK)
+			if (connection->receive_thread.thread_flag == THREAD_FLAG_STOP)
+			{
+				should_continue = 0;
+				(void)Unlock(connection->receive_thread.thread_lock);
+				break;
+			}
+			if (Unlock(connection->receive_thread.thread_lock) != LOCK_OK)
 			{
 				should_continue = 0;
 				break;
 			}
 
-			int nbytes;
-			unsigned char *buf = NULL;
-			errno = 0;
-			/*Codes_SRS_OUTPROCESS_MODULE_17_057: [ This thread shall periodically attempt to receive a meesage from the module host process. ]*/
-			nbytes = nn_recv(nn_fd, (void *)&buf, NN_MSG, NN_DONTWAIT);
-			if (nbytes < 0)
+			int control_result = receive_connection_frame(connection, connection->control_socket, true);
+			int message_result = receive_connection_frame(connection, connection->message_socket, false);
+			if (control_result < 0 || message_result < 0)
+			{
+				should_continue = 0;
+			}
+			else if (control_result == 0 && message_result == 0)
+			{
+				ThreadAPI_Sleep(1);
+			}
+		}
+	}
+	return 0;
+}
+
+static void destroy_shared_connection(OUTPROCESS_CONNECTION * connection)
+{
+	if (connection->receive_thread.thread_lock != NULL)
+	{
+		shutdown_a_thread(&(connection->receive_thread));
+	}
+	if (connection->message_socket >= 0)
+		(void)nn_close(connection->message_socket);
+	if (connection->control_socket >= 0)
+		(void)nn_close(connection->control_socket);
+	if (connection->lock != NULL)
+		(void)Lock_Deinit(connection->lock);
+	STRING_delete(connection->control_uri);
+	STRING_delete(connection->message_uri);
+	free(connection);
+}
+
+static OUTPROCESS_CONNECTION * create_shared_connection(OUTPROCESS_MODULE_CONFIG * config)
+{
+	OUTPROCESS_CONNECTION * result = (OUTPROCESS_CONNECTION*)malloc(sizeof(OUTPROCESS_CONNECTION));
+	if (result == NULL)
+	{
+		LogError("allocation for shared connection failed.");
+	}
+	else
+	{
+		THREAD_CONTROL default_thread =
+		{
+			NULL,
+			NULL,
+			0
+		};
+		result->control_socket = -1;
+		result->message_socket = -1;
+		result->ref_count = 0;
+		result->next_module_id = 1;
+		result->modules = NULL;
+		result->next = NULL;
+		result->receive_thread = default_thread;
+		result->control_uri = STRING_clone(config->control_uri);
+		result->message_uri = STRING_clone(config->message_uri);
+		result->lock = Lock_Init();
+		result->receive_thread.thread_lock = Lock_Init();
+		if (
+			(result->control_uri == NULL) ||
+			(result->message_uri == NULL) ||
+			(result->lock == NULL) ||
+			(result->receive_thread.thread_lock == NULL)
+			)
+		{
+			LogError("unable to initialize shared connection");
+			destroy_shared_connection(result);
+			result = NULL;
+		}
+		else if (
+			((result->message_socket = nn_socket(AF_SP, NN_PAIR)) < 0) ||
+			(nn_connect(result->message_socket, STRING_c_str(result->message_uri)) < 0) ||
+			((result->control_socket = nn_socket(AF_SP, NN_PAIR)) < 0) ||
+			(nn_connect(result->control_socket, STRING_c_str(result->control_uri)) < 0)
+			)
+		{
+			LogError("shared connection failed to connect, errno = %d", nn_errno());
+			destroy_shared_connection(result);
+			result = NULL;
+		}
+		else if (ThreadAPI_Create(&(result->receive_thread.thread_handle), outprocessConnectionThread, result) != THREADAPI_OK)
+		{
+			LogError("failed to spawn shared connection thread");
+			result->receive_thread.thread_handle = NULL;
+			destroy_shared_connection(result);
+			result = NULL;
+		}
+	}
+	return result;
+}
+
+void Outprocess_InitializeSharedConnections(void)
+{
+	if (shared_connections_lock == NULL)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_105: [ Outprocess_InitializeSharedConnections shall create the lock guarding the shared connections, unless it exists. ]*/
+		shared_connections_lock = Lock_Init();
+		if (shared_connections_lock == NULL)
+		{
+			LogError("Lock_Init failed, multiplexed modules cannot be created");
+		}
+	}
+}
+
+static void release_shared_connection(OUTPROCESS_CONNECTION * connection)
+{
+	bool last_reference;
+	bool last_connection = false;
+	LOCK_HANDLE lock = shared_connections_lock;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_106: [ The list of shared connections and their reference counts shall only be changed under the shared connections lock. ]*/
+	if (Lock(lock) != LOCK_OK)
+	{
+		LogError("unable to Lock shared connections - shared connection is kept");
+		last_reference = false;
+	}
+	else
+	{
+		connection->ref_count--;
+		last_reference = (connection->ref_count == 0);
+		if (last_reference)
+		{
+			OUTPROCESS_CONNECTION ** link = &shared_connections;
+			while (*link != NULL && *link != connection)
+			{
+				link = &((*link)->next);
+			}
+			if (*link != NULL)
+			{
+				*link = connection->next;
+			}
+			last_connection = (shared_connections == NULL);
+			if (last_connection)
 			{
-				int receive_error = nn_errno();
-				if (receive_error != EAGAIN)
-					should_continue = 0;
+				shared_connections_lock = NULL;
 			}
-			else
+		}
+		(void)Unlock(lock);
+	}
+
+	if (last_connection)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_108: [ The lock guarding the shared connections shall be freed when the last shared connection is released. ]*/
+		Lock_Deinit(lock);
+	}
+
+	// nobody can find the connection anymore, its thread is joined
+	// outside of the lock
+	if (last_reference)
+	{
+		destroy_shared_connection(connection);
+	}
+}
+
+static OUTPROCESS_CONNECTION * acquire_shared_connection(OUTPROCESS_MODULE_CONFIG * config)
+{
+	OUTPROCESS_CONNECTION * connection;
+	if (shared_connections_lock == NULL)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_109: [ If the lock guarding the shared connections has been freed, this function shall create it again. ]*/
+		Outprocess_InitializeSharedConnections();
+	}
+
+	/*Codes_SRS_OUTPROCESS_MODULE_17_106: [ The list of shared connections and their reference counts shall only be changed under the shared connections lock. ]*/
+	if (shared_connections_lock == NULL || Lock(shared_connections_lock) != LOCK_OK)
+	{
+		LogError("unable to Lock shared connections");
+		connection = NULL;
+	}
+	else
+	{
+		connection = shared_connections;
+		while (connection != NULL && strcmp(STRING_c_str(connection->control_uri), STRING_c_str(config->control_uri)) != 0)
+		{
+			connection = connection->next;
+		}
+		if (connection == NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_095: [ If multiplex is true, this function shall share one control and one message channel with every other multiplexed module connecting to the same control_uri, creating them on first use. ]*/
+			connection = create_shared_connection(config);
+			if (connection != NULL)
 			{
-				CONTROL_MESSAGE * msg = ControlMessage_CreateFromByteArray((const unsigned char*)buf, nbytes);
-				nn_freemsg(buf);
-				if (msg != NULL)
-				{
-					/*Codes_SRS_OUTPROCESS_MODULE_17_058: [ If a message has been received, it shall look for a Module Reply message. ]*/
-					if (msg->type == CONTROL_MESSAGE_TYPE_MODULE_REPLY)
-					{
-						CONTROL_MESSAGE_MODULE_REPLY * resp_msg = (CONTROL_MESSAGE_MODULE_REPLY*)msg;
-						if (resp_msg->status != 0)
-						{
-							/*Codes_SRS_OUTPROCESS_MODULE_17_059: [ If a Module Reply message has been received, and the status indicates the module has failed or has been terminated, this thread shall attempt to restart communications with module host process. ]*/
-							needs_to_attach = 1;
-						}
-					}
-					ControlMessage_Destroy(msg);
-				}
+				connection->next = shared_connections;
+				shared_connections = connection;
 			}
-			ThreadAPI_Sleep(250);
 		}
+		if (connection != NULL)
+		{
+			connection->ref_count++;
+		}
+		(void)Unlock(shared_connections_lock);
 	}
-	return 0;
+	return connection;
 }
 
-/* Connection related functions
-*/
+static int connect_shared_connection(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODULE_CONFIG * config)
+{
+	int result;
+	OUTPROCESS_CONNECTION * connection = acquire_shared_connection(config);
+	if (connection == NULL)
+	{
+		result = -1;
+	}
+	else
+	{
+		if (Lock(connection->lock) != LOCK_OK)
+		{
+			LogError("unable to Lock shared connection");
+			release_shared_connection(connection);
+			result = -1;
+		}
+		else
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_096: [ This function shall give a multiplexed module an id unique on its shared connection. ]*/
+			handleData->module_id = connection->next_module_id++;
+			handleData->next_connected_module = connection->modules;
+			connection->modules = handleData;
+			(void)Unlock(connection->lock);
+			handleData->connection = connection;
+			handleData->multiplexed = true;
+			handleData->message_socket = connection->message_socket;
+			handleData->control_socket = connection->control_socket;
+			result = 0;
+		}
+	}
+	return result;
+}
 
-static int connection_setup(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODULE_CONFIG * config)
+static void disconnect_shared_connection(OUTPROCESS_HANDLE_DATA* handleData)
+{
+	OUTPROCESS_CONNECTION * connection = handleData->connection;
+	int locked = (Lock(connection->lock) == LOCK_OK);
+	if (!locked)
+	{
+		LogError("could not lock shared connection - removing module anyway");
+	}
+	OUTPROCESS_HANDLE_DATA ** link = &(connection->modules);
+	while (*link != NULL && *link != handleData)
+	{
+		link = &((*link)->next_connected_module);
+	}
+	if (*link != NULL)
+	{
+		*link = handleData->next_connected_module;
+	}
+	if (locked)
+	{
+		(void)Unlock(connection->lock);
+	}
+	handleData->connection = NULL;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_103: [ If the module is multiplexed, this function shall leave the shared connection, and close it once no module uses it. ]*/
+	release_shared_connection(connection);
+}
+
+static int connect_module_channels(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODULE_CONFIG * config)
 {
 	int result;
-	handleData->control_socket = -1;
 	/*
 	* Start with messaging socket.
 	*/
@@ -509,17 +1347,47 @@ static int connection_setup(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODUL
 	return result;
 }
 
+static int connection_setup(OUTPROCESS_HANDLE_DATA* handleData, OUTPROCESS_MODULE_CONFIG * config)
+{
+	int result;
+	handleData->control_socket = -1;
+	handleData->multiplexed = false;
+	handleData->connection = NULL;
+	handleData->module_id = 0;
+	handleData->reply_received = false;
+	handleData->reply_status = 0;
+	handleData->next_connected_module = NULL;
+	if (config->multiplex)
+	{
+		handleData->message_socket = -1;
+		result = connect_shared_connection(handleData, config);
+	}
+	else
+	{
+		result = connect_module_channels(handleData, config);
+	}
+	return result;
+}
+
 static void connection_teardown(OUTPROCESS_HANDLE_DATA* handleData)
 {
-	if (Lock(handleData->handle_lock) != LOCK_OK)
+	if (handleData->connection != NULL)
+	{
+		/* the shared sockets are closed with the connection */
+		disconnect_shared_connection(handleData);
+	}
+	else
 	{
-		LogError("could not lock handle data - attempting to destroy module anyway");
+		if (Lock(handleData->handle_lock) != LOCK_OK)
+		{
+			LogError("could not lock handle data - attempting to destroy module anyway");
+		}
+		if (handleData->message_socket >= 0)
+			(void)nn_close(handleData->message_socket);
+		if (handleData->control_socket >= 0)
+			(void)nn_close(handleData->control_socket);
+		(void)Unlock(handleData->handle_lock);
 	}
-	if (handleData->message_socket >= 0)
-		(void)nn_close(handleData->message_socket);
-	if (handleData->control_socket >= 0)
-		(void)nn_close(handleData->control_socket);
-	(void)Unlock(handleData->handle_lock);
 }
 
 
@@ -528,10 +1396,11 @@ static void connection_teardown(OUTPROCESS_HANDLE_DATA* handleData)
 
 /* Control message functions */
 
-static void* serialize_control_message(CONTROL_MESSAGE * msg, int32_t * theMessageSize)
+static void* serialize_control_message(OUTPROCESS_HANDLE_DATA* handleData, CONTROL_MESSAGE * msg, int32_t * theMessageSize)
 {
 	void * result;
 
+	int32_t header_size = frame_header_size(handleData);
 	int32_t msg_size = ControlMessage_ToByteArray(msg, NULL, 0);
 	if (msg_size < 0)
 	{
@@ -540,16 +1409,17 @@ static void* serialize_control_message(CONTROL_MESSAGE * msg, int32_t * theMessa
 	}
 	else
 	{
-		result = nn_allocmsg(msg_size, 0);
+		result = nn_allocmsg(header_size + msg_size, 0);
 		if (result == NULL)
 		{
 			LogError("unable to allocate a control message");
 		}
 		else
 		{
-			unsigned char *nn_msg_bytes = (unsigned char *)result;
+			write_frame_header(handleData, (unsigned char *)result);
+			unsigned char *nn_msg_bytes = (unsigned char *)result + header_size;
 			ControlMessage_ToByteArray(msg, nn_msg_bytes, msg_size);
-			*theMessageSize = msg_size;
+			*theMessageSize = header_size + msg_size;
 		}
 	}
 	return result;
@@ -586,7 +1456,7 @@ static void* construct_create_message(OUTPROCESS_HANDLE_DATA* handleData, int32_
 			args_length + 1,	/*args_size;(+1 for null)*/
 			args_string			/*args;*/
 		};
-		result = serialize_control_message((CONTROL_MESSAGE *)&create_msg, creationMessageSize);
+		result = serialize_control_message(handleData, (CONTROL_MESSAGE *)&create_msg, creationMessageSize);
 	}
 	return result;
 }
@@ -594,28 +1464,26 @@ static void* construct_create_message(OUTPROCESS_HANDLE_DATA* handleData, int32_
 static void* construct_start_message(OUTPROCESS_HANDLE_DATA* handleData, int32_t * startMessageSize)
 {
 	void * result;
-	(void)handleData;
 
 	CONTROL_MESSAGE start_msg =
 	{
 		CONTROL_MESSAGE_VERSION_CURRENT,	/*version*/
 		CONTROL_MESSAGE_TYPE_MODULE_START	/*type*/
 	};
-	result = serialize_control_message(&start_msg, startMessageSize);
+	result = serialize_control_message(handleData, &start_msg, startMessageSize);
 	return result;
 }
 
 static void * construct_destroy_message(OUTPROCESS_HANDLE_DATA* handleData, int32_t * destroyMessageSize)
 {
 	void * result;
-	(void)handleData;
 
 	CONTROL_MESSAGE destroy_msg =
 	{
 		CONTROL_MESSAGE_VERSION_CURRENT,	/*version*/
 		CONTROL_MESSAGE_TYPE_MODULE_DESTROY	/*type*/
 	};
-	result = serialize_control_message(&destroy_msg, destroyMessageSize);
+	result = serialize_control_message(handleData, &destroy_msg, destroyMessageSize);
 	return result;
 }
 
@@ -664,7 +1532,8 @@ static int save_strings(OUTPROCESS_HANDLE_DATA * handleData, OUTPROCESS_MODULE_C
 	}
 	else
 	{
-		handleData->message_uri = STRING_clone(config->message_uri);
+		/* multiplexed modules announce the message channel of their shared connection */
+		handleData->message_uri = STRING_clone((handleData->connection != NULL) ? handleData->connection->message_uri : config->message_uri);
 		if (handleData->message_uri == NULL)
 		{
 			STRING_delete(handleData->control_uri);
@@ -695,7 +1564,18 @@ static void delete_strings(OUTPROCESS_HANDLE_DATA * handleData)
 	STRING_delete(handleData->module_args);
 }
 
-static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configuration)
+static void destroy_trace_histogram(OUTPROCESS_HANDLE_DATA * handleData)
+{
+	if (handleData->trace_histogram != NULL)
+	{
+		MessageTrace_DestroyHistogram(handleData->trace_histogram);
+		handleData->trace_histogram = NULL;
+	}
+}
+
+/* publisher is the module the broker knows, which is the pool for an
+ * instance of a pool and the module itself otherwise. */
+static MODULE_HANDLE create_module(BROKER_HANDLE broker, const void* configuration, MODULE_HANDLE publisher)
 {
 	OUTPROCESS_HANDLE_DATA * module;
 	if (
@@ -760,7 +1640,21 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 							0
 						};
 						module->broker = broker;
+						module->publisher = (publisher == NULL) ? (MODULE_HANDLE)module : publisher;
 						module->remote_message_wait = config->remote_message_wait;
+						module->startup_timeout_ms = config->startup_timeout_ms;
+						module->message_batch_size = config->message_batch_size;
+						module->message_batch_delay_ms = config->message_batch_delay_ms;
+						module->outgoing_queue_limit = config->outgoing_queue_limit;
+						module->outgoing_queue_overflow = config->outgoing_queue_overflow;
+						module->outgoing_count = 0;
+						module->send_credit.message_window_enforced = false;
+						module->send_credit.messages = 0;
+						module->send_credit.byte_window_enforced = false;
+						module->send_credit.bytes = 0;
+						module->trace_histogram = NULL;
+						module->traced_message = NULL;
+						module->traced_enqueued = 0;
 						module->message_receive_thread = default_thread;
 						module->message_send_thread = default_thread;
 						module->control_thread = default_thread;
@@ -818,6 +1712,22 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 							free(module);
 							module = NULL;
 						}
+						/*Codes_SRS_OUTPROCESS_MODULE_17_092: [ If message_trace is true, this function shall create the latency histograms for traced messages. ]*/
+						else if (config->message_trace && (module->trace_histogram = MessageTrace_CreateHistogram()) == NULL)
+						{
+							/*Codes_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
+							LogError("unable to create trace histogram");
+							connection_teardown(module);
+							delete_strings(module);
+							MESSAGE_QUEUE_destroy(module->outgoing_messages);
+							Lock_Deinit(module->async_create_thread.thread_lock);
+							Lock_Deinit(module->control_thread.thread_lock);
+							Lock_Deinit(module->message_receive_thread.thread_lock);
+							Lock_Deinit(module->message_send_thread.thread_lock);
+							Lock_Deinit(module->handle_lock);
+							free(module);
+							module = NULL;
+						}
 						else
 						{
 							/*Codes_SRS_OUTPROCESS_MODULE_17_014: [ This function shall wait for a Create Response on the control channel. ]*/
@@ -829,6 +1739,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 								module->async_create_thread.thread_handle = NULL;
 								connection_teardown(module);
 								delete_strings(module);
+								destroy_trace_histogram(module);
 								MESSAGE_QUEUE_destroy(module->outgoing_messages);
 								Lock_Deinit(module->async_create_thread.thread_lock);
 								Lock_Deinit(module->control_thread.thread_lock);
@@ -865,6 +1776,7 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 									/*Codes_SRS_OUTPROCESS_MODULE_17_016: [ If any step in the creation fails, this function shall deallocate all resources and return NULL. ]*/
 									connection_teardown(module);
 									delete_strings(module);
+									destroy_trace_histogram(module);
 									MESSAGE_QUEUE_destroy(module->outgoing_messages);
 									Lock_Deinit(module->async_create_thread.thread_lock);
 									Lock_Deinit(module->control_thread.thread_lock);
@@ -884,6 +1796,11 @@ static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configu
 	return module;
 }
 
+static MODULE_HANDLE Outprocess_Create(BROKER_HANDLE broker, const void* configuration)
+{
+	return create_module(broker, configuration, NULL);
+}
+
 static void shutdown_a_thread(THREAD_CONTROL * theThreadControl)
 {
 	int notUsed;
@@ -926,6 +1843,10 @@ static void Outprocess_Destroy(MODULE_HANDLE moduleHandle)
 	/*Codes_SRS_OUTPROCESS_MODULE_17_026: [ If module is NULL, this function shall do nothing. ]*/
 	if (handleData != NULL)
 	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_049: [ This function shall signal the outgoing gateway message thread to close. ]*/
+		/*Codes_SRS_OUTPROCESS_MODULE_17_112: [ This function shall stop the outgoing gateway message thread before sending the Destroy Message, so that its pending batch is sent while the message channel is open. ]*/
+		shutdown_a_thread(&(handleData->message_send_thread));
+
 		/*tell remote module to stop*/
 		int32_t messageSize = 0;
 		/*Codes_SRS_OUTPROCESS_MODULE_17_028: [ This function shall construct a Destroy Message. ]*/
@@ -968,12 +1889,17 @@ static void Outprocess_Destroy(MODULE_HANDLE moduleHandle)
 
 		/*Codes_SRS_OUTPROCESS_MODULE_17_032: [ This function shall signal the messaging thread to close. ]*/
 		shutdown_a_thread(&(handleData->message_receive_thread));
-		/*Codes_SRS_OUTPROCESS_MODULE_17_049: [ This function shall signal the outgoing gateway message thread to close. ]*/
-		shutdown_a_thread(&(handleData->message_send_thread));
 		/*Codes_SRS_OUTPROCESS_MODULE_17_050: [ This function shall signal the control thread to close. ]*/
 		shutdown_a_thread(&(handleData->control_thread));
 		shutdown_a_thread(&(handleData->async_create_thread));
 
+		if (handleData->trace_histogram != NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_094: [ If message tracing is enabled, this function shall log the latency histograms before releasing them. ]*/
+			MessageTrace_LogHistogram(handleData->trace_histogram, STRING_c_str(handleData->message_uri));
+			destroy_trace_histogram(handleData);
+		}
+
 		/* Free remaining resources */
 		/*Codes_SRS_OUTPROCESS_MODULE_17_034: [ This function shall release all resources created by this module. ]*/
 		delete_strings(handleData);
@@ -1004,11 +1930,52 @@ static void Outprocess_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messag
 			}
 			else
 			{
-				/*Codes_SRS_OUTPROCESS_MODULE_17_047: [ This function shall push the message onto the end of the outgoing gateway message queue. ]*/
-				if (MESSAGE_QUEUE_push(handleData->outgoing_messages, queued_message) != 0)
+				if (
+					(handleData->outgoing_queue_limit != 0) &&
+					(handleData->outgoing_count >= handleData->outgoing_queue_limit)
+					)
+				{
+					if (handleData->outgoing_queue_overflow == OUTPROCESS_QUEUE_DROP_OLDEST)
+					{
+						/*Codes_SRS_OUTPROCESS_MODULE_17_071: [ If the outgoing queue is full and the overflow policy is OUTPROCESS_QUEUE_DROP_OLDEST, this function shall remove and destroy the oldest message in the queue before pushing the new one. ]*/
+						MESSAGE_HANDLE oldest_message = MESSAGE_QUEUE_pop(handleData->outgoing_messages);
+						if (oldest_message == handleData->traced_message)
+						{
+							handleData->traced_message = NULL;
+						}
+						if (oldest_message != NULL)
+						{
+							Message_Destroy(oldest_message);
+						}
+						handleData->outgoing_count--;
+						LogError("outgoing queue is full, dropped the oldest message");
+					}
+					else
+					{
+						/*Codes_SRS_OUTPROCESS_MODULE_17_070: [ If the outgoing queue is full and the overflow policy is OUTPROCESS_QUEUE_DROP_NEWEST, this function shall destroy the message instead of queuing it. ]*/
+						LogError("outgoing queue is full, dropped the newest message");
+						Message_Destroy(queued_message);
+						queued_message = NULL;
+					}
+				}
+				if (queued_message != NULL)
 				{
-					LogError("unable to queue the message");
-					Message_Destroy(queued_message);
+					/*Codes_SRS_OUTPROCESS_MODULE_17_047: [ This function shall push the message onto the end of the outgoing gateway message queue. ]*/
+					if (MESSAGE_QUEUE_push(handleData->outgoing_messages, queued_message) != 0)
+					{
+						LogError("unable to queue the message");
+						Message_Destroy(queued_message);
+					}
+					else
+					{
+						handleData->outgoing_count++;
+						if (handleData->trace_histogram != NULL && handleData->traced_message == NULL)
+						{
+							/*Codes_SRS_OUTPROCESS_MODULE_17_090: [ If message tracing is enabled and no queued message is traced, this function shall trace the queued message and stamp its enqueue hop. ]*/
+							handleData->traced_message = queued_message;
+							handleData->traced_enqueued = MessageTrace_Now();
+						}
+					}
 				}
 				(void)Unlock(handleData->handle_lock);
 			}
@@ -1016,15 +1983,37 @@ static void Outprocess_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messag
 	}
 }
 
+static int wait_for_create_handshake(OUTPROCESS_HANDLE_DATA* handleData)
+{
+	int result = 1;
+	if (handleData->lifecyle_model == OUTPROCESS_LIFECYCLE_ASYNC && handleData->async_create_thread.thread_handle != NULL)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_088: [ If the module was created with OUTPROCESS_LIFECYCLE_ASYNC, this function shall wait for the Create handshake to complete. ]*/
+		if (ThreadAPI_Join(handleData->async_create_thread.thread_handle, &result) != THREADAPI_OK)
+		{
+			LogError("unable to join the async create thread");
+			result = -1;
+		}
+		handleData->async_create_thread.thread_handle = NULL;
+	}
+	return result;
+}
+
 static void Outprocess_Start(MODULE_HANDLE moduleHandle)
 {
 	OUTPROCESS_HANDLE_DATA* handleData = moduleHandle;
 	/*Codes_SRS_OUTPROCESS_MODULE_17_020: [ This function shall do nothing if module is NULL. ]*/
 	if (handleData != NULL)
 	{
+		if (wait_for_create_handshake(handleData) < 0)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_089: [ If the Create handshake failed, this function shall not start the module. ]*/
+			LogError("module host did not complete the create handshake, module not started");
+		}
 		/*Codes_SRS_OUTPROCESS_MODULE_17_017: [ This function shall ensure thread safety on execution. ]*/
 		/*Codes_SRS_OUTPROCESS_MODULE_17_018: [ This function shall create a thread to handle receiving messages from module host. ]*/
-		if (ThreadAPI_Create(&(handleData->message_receive_thread.thread_handle), outprocessIncomingMessageThread, handleData) != THREADAPI_OK)
+		/*Codes_SRS_OUTPROCESS_MODULE_17_100: [ If the module is multiplexed, this function shall not create a thread to receive messages, the shared connection receives them. ]*/
+		else if (!handleData->multiplexed && ThreadAPI_Create(&(handleData->message_receive_thread.thread_handle), outprocessIncomingMessageThread, handleData) != THREADAPI_OK)
 		{
 			LogError("failed to spawn message handling thread");
 			handleData->message_receive_thread.thread_handle = NULL;
@@ -1060,3 +2049,247 @@ const MODULE_API_1 Outprocess_Module_API_all =
 	Outprocess_Start
 };
  
+
+static STRING_HANDLE construct_instance_uri(STRING_HANDLE uri, size_t instance)
+{
+	char suffix[INSTANCE_SUFFIX_SIZE];
+	STRING_HANDLE result = STRING_clone(uri);
+	if (result == NULL)
+	{
+		LogError("unable to copy uri");
+	}
+	else
+	{
+		(void)snprintf(suffix, sizeof(suffix), ".%u", (unsigned int)instance);
+		if (STRING_concat(result, suffix) != 0)
+		{
+			LogError("unable to append instance to uri");
+			STRING_delete(result);
+			result = NULL;
+		}
+	}
+	return result;
+}
+
+static MODULE_HANDLE create_pool_instance(BROKER_HANDLE broker, const OUTPROCESS_MODULE_CONFIG * config, size_t instance, MODULE_HANDLE pool)
+{
+	MODULE_HANDLE result;
+	OUTPROCESS_MODULE_CONFIG instance_config = *config;
+	instance_config.instances = 1;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_074: [ Each instance shall connect to the control_uri and the message_uri of the pool, suffixed with "." and the instance index. ]*/
+	instance_config.control_uri = construct_instance_uri(config->control_uri, instance);
+	instance_config.message_uri = construct_instance_uri(config->message_uri, instance);
+	if (instance_config.control_uri == NULL || instance_config.message_uri == NULL)
+	{
+		LogError("unable to construct uris for instance %u", (unsigned int)instance);
+		result = NULL;
+	}
+	else
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_104: [ An instance of a pool shall publish its messages as the pool. ]*/
+		result = create_module(broker, &instance_config, pool);
+	}
+	STRING_delete(instance_config.control_uri);
+	STRING_delete(instance_config.message_uri);
+	return result;
+}
+
+static void Outprocess_Pool_Destroy(MODULE_HANDLE moduleHandle)
+{
+	OUTPROCESS_POOL_HANDLE_DATA * pool = (OUTPROCESS_POOL_HANDLE_DATA*)moduleHandle;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_078: [ If module is NULL, Outprocess_Pool_Destroy shall do nothing. ]*/
+	if (pool != NULL)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_079: [ Outprocess_Pool_Destroy shall destroy every instance, then release all resources created by the pool. ]*/
+		for (size_t i = 0; i < pool->instance_count; i++)
+		{
+			Outprocess_Destroy(pool->instances[i]);
+		}
+		if (pool->dispatch_key != NULL)
+		{
+			STRING_delete(pool->dispatch_key);
+		}
+		free(pool->instances);
+		free(pool);
+	}
+}
+
+static MODULE_HANDLE Outprocess_Pool_Create(BROKER_HANDLE broker, const void* configuration)
+{
+	OUTPROCESS_POOL_HANDLE_DATA * pool;
+	if (
+		(broker == NULL) ||
+		(configuration == NULL)
+		)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_072: [ If broker or configuration are NULL, Outprocess_Pool_Create shall return NULL. ]*/
+		LogError("invalid arguments for outprocess pool. broker=[%p], configuration = [%p]", broker, configuration);
+		pool = NULL;
+	}
+	else
+	{
+		const OUTPROCESS_MODULE_CONFIG * config = (const OUTPROCESS_MODULE_CONFIG*)configuration;
+		size_t instance_count = (config->instances == 0) ? 1 : config->instances;
+		/*Codes_SRS_OUTPROCESS_MODULE_17_073: [ Outprocess_Pool_Create shall allocate memory for the pool and for a handle per instance. ]*/
+		pool = (OUTPROCESS_POOL_HANDLE_DATA*)malloc(sizeof(OUTPROCESS_POOL_HANDLE_DATA));
+		if (pool == NULL)
+		{
+			/*Codes_SRS_OUTPROCESS_MODULE_17_076: [ If any step fails, Outprocess_Pool_Create shall destroy the instances created so far, deallocate all resources and return NULL. ]*/
+			LogError("allocation for pool failed.");
+		}
+		else if ((pool->instances = (MODULE_HANDLE*)malloc(sizeof(MODULE_HANDLE) * instance_count)) == NULL)
+		{
+			LogError("allocation for pool instances failed.");
+			free(pool);
+			pool = NULL;
+		}
+		else
+		{
+			pool->instance_count = 0;
+			pool->dispatch_policy = config->dispatch_policy;
+			pool->dispatch_key = NULL;
+			pool->next_instance = 0;
+
+			if ((config->dispatch_key != NULL) && ((pool->dispatch_key = STRING_clone(config->dispatch_key)) == NULL))
+			{
+				LogError("unable to copy the dispatch key");
+				Outprocess_Pool_Destroy(pool);
+				pool = NULL;
+			}
+			else
+			{
+				/*Codes_SRS_OUTPROCESS_MODULE_17_075: [ Outprocess_Pool_Create shall create each instance as an outprocess module. ]*/
+				while (pool->instance_count < instance_count)
+				{
+					MODULE_HANDLE instance = create_pool_instance(broker, config, pool->instance_count, (MODULE_HANDLE)pool);
+					if (instance == NULL)
+					{
+						break;
+					}
+					pool->instances[pool->instance_count++] = instance;
+				}
+
+				if (pool->instance_count < instance_count)
+				{
+					/*Codes_SRS_OUTPROCESS_MODULE_17_076: [ If any step fails, Outprocess_Pool_Create shall destroy the instances created so far, deallocate all resources and return NULL. ]*/
+					LogError("unable to create instance %u of the pool", (unsigned int)pool->instance_count);
+					Outprocess_Pool_Destroy(pool);
+					pool = NULL;
+				}
+			}
+		}
+	}
+	return pool;
+}
+
+static size_t round_robin_instance(OUTPROCESS_POOL_HANDLE_DATA * pool)
+{
+	size_t result = pool->next_instance;
+	pool->next_instance = (pool->next_instance + 1) % pool->instance_count;
+	return result;
+}
+
+static size_t least_loaded_instance(OUTPROCESS_POOL_HANDLE_DATA * pool)
+{
+	size_t result = 0;
+	size_t least_pending = SIZE_MAX;
+	for (size_t i = 0; i < pool->instance_count; i++)
+	{
+		OUTPROCESS_HANDLE_DATA * instance = (OUTPROCESS_HANDLE_DATA*)pool->instances[i];
+		if (Lock(instance->handle_lock) != LOCK_OK)
+		{
+			LogError("unable to Lock instance %u, skipping it", (unsigned int)i);
+		}
+		else
+		{
+			size_t pending = instance->outgoing_count;
+			(void)Unlock(instance->handle_lock);
+			if (pending < least_pending)
+			{
+				least_pending = pending;
+				result = i;
+			}
+		}
+	}
+	return result;
+}
+
+static size_t key_hash_instance(OUTPROCESS_POOL_HANDLE_DATA * pool, MESSAGE_HANDLE messageHandle)
+{
+	size_t result;
+	CONSTMAP_HANDLE properties = (pool->dispatch_key == NULL) ? NULL : Message_GetProperties(messageHandle);
+	const char * key = (properties == NULL) ? NULL : ConstMap_GetValue(properties, STRING_c_str(pool->dispatch_key));
+	if (key == NULL)
+	{
+		/*Codes_SRS_OUTPROCESS_MODULE_17_085: [ If the message does not carry the dispatch key property, the message shall be dispatched round-robin. ]*/
+		result = round_robin_instance(pool);
+	}
+	else
+	{
+		/* 32 bit FNV-1a */
+		uint32_t hash = 2166136261u;
+		for (; *key != '\0'; key++)
+		{
+			hash ^= (uint8_t)*key;
+			hash *= 16777619u;
+		}
+		result = hash % pool->instance_count;
+	}
+	if (properties != NULL)
+	{
+		ConstMap_Destroy(properties);
+	}
+	return result;
+}
+
+static void Outprocess_Pool_Receive(MODULE_HANDLE moduleHandle, MESSAGE_HANDLE messageHandle)
+{
+	OUTPROCESS_POOL_HANDLE_DATA * pool = (OUTPROCESS_POOL_HANDLE_DATA*)moduleHandle;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_080: [ If module or message_handle is NULL, Outprocess_Pool_Receive shall do nothing. ]*/
+	if (pool != NULL && messageHandle != NULL)
+	{
+		size_t instance;
+		switch (pool->dispatch_policy)
+		{
+		case OUTPROCESS_DISPATCH_LEAST_LOADED:
+			/*Codes_SRS_OUTPROCESS_MODULE_17_081: [ OUTPROCESS_DISPATCH_LEAST_LOADED shall pick the instance with the fewest messages in its outgoing queue, the lowest index on ties. ]*/
+			instance = least_loaded_instance(pool);
+			break;
+		case OUTPROCESS_DISPATCH_KEY_HASH:
+			/*Codes_SRS_OUTPROCESS_MODULE_17_082: [ OUTPROCESS_DISPATCH_KEY_HASH shall pick the instance by the 32 bit FNV-1a hash of the dispatch key property of the message, modulo the number of instances. ]*/
+			instance = key_hash_instance(pool, messageHandle);
+			break;
+		case OUTPROCESS_DISPATCH_ROUND_ROBIN:
+		default:
+			/*Codes_SRS_OUTPROCESS_MODULE_17_083: [ OUTPROCESS_DISPATCH_ROUND_ROBIN shall pick each instance in turn. ]*/
+			instance = round_robin_instance(pool);
+			break;
+		}
+		/*Codes_SRS_OUTPROCESS_MODULE_17_084: [ Outprocess_Pool_Receive shall pass the message to the picked instance. ]*/
+		Outprocess_Receive(pool->instances[instance], messageHandle);
+	}
+}
+
+static void Outprocess_Pool_Start(MODULE_HANDLE moduleHandle)
+{
+	OUTPROCESS_POOL_HANDLE_DATA * pool = (OUTPROCESS_POOL_HANDLE_DATA*)moduleHandle;
+	/*Codes_SRS_OUTPROCESS_MODULE_17_077: [ Outprocess_Pool_Start shall start every instance, and do nothing if module is NULL. ]*/
+	if (pool != NULL)
+	{
+		for (size_t i = 0; i < pool->instance_count; i++)
+		{
+			Outprocess_Start(pool->instances[i]);
+		}
+	}
+}
+
+const MODULE_API_1 Outprocess_Pool_API_all =
+{
+	{MODULE_API_VERSION_1},
+	Outprocess_ParseConfigurationFromJson,
+	Outprocess_FreeConfiguration,
+	Outprocess_Pool_Create,
+	Outprocess_Pool_Destroy,
+	Outprocess_Pool_Receive,
+	Outprocess_Pool_Start
+};
@@ -0,0 +1,86 @@
+package com.microsoft.azure.gateway.sample;
+/*
+ * Copyright (c) Microsoft. All rights reserved.
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+
+import java.io.IOException;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ScheduledExecutorService;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicLong;
+
+import com.microsoft.azure.gateway.core.Broker;
+import com.microsoft.azure.gateway.core.GatewayModule;
+import com.microsoft.azure.gateway.messaging.Message;
+import com.microsoft.azure.gateway.remote.ConnectionException;
+import com.microsoft.azure.gateway.remote.ModuleConfiguration;
+import com.microsoft.azure.gateway.remote.ProxyGateway;
+
+/**
+ * Counts the messages received from the Gateway and prints how many arrive
+ * every second. Run it once with "copy" and once with "direct" to compare
+ * the throughput of byte arrays and direct buffers.
+ */
+public class RemoteThroughputSample {
+    private static final AtomicLong received = new AtomicLong();
+
+    public static class Counter extends GatewayModule {
+        public Counter(long address, Broker broker, String configuration) {
+            super(address, broker, configuration);
+        }
+
+        @Override
+        public void receive(Message message) {
+            received.incrementAndGet();
+        }
+
+        @Override
+        public void destroy() {
+            //No cleanup necessary
+        }
+    }
+
+    public static void main(String[] args) {
+        if (args.length < 1)
+            throw new IllegalArgumentException("Please provide the control message identifier");
+
+        final boolean directBuffers = args.length > 1 && "direct".equals(args[1]);
+
+        byte version = 1;
+        ModuleConfiguration.Builder configBuilder = new ModuleConfiguration.Builder();
+        configBuilder.setIdentifier(args[0]);
+        configBuilder.setModuleClass(Counter.class);
+        configBuilder.setModuleVersion(version);
+        configBuilder.setDirectBuffers(directBuffers);
+
+        ProxyGateway moduleProxy = new ProxyGateway(configBuilder.build());
+        try {
+            moduleProxy.attach();
+        } catch (ConnectionException e) {
+            e.printStackTrace();
+        }
+
+        ScheduledExecutorService reporter = Executors.newSingleThreadScheduledExecutor();
+        reporter.scheduleAtFixedRate(new Runnable() {
+            private long last = 0;
+
+            @Override
+            public void run() {
+                long total = received.get();
+                System.out.println((directBuffers ? "direct" : "copy") + ": " + (total - last) + " messages/s");
+                last = total;
+            }
+        }, 1, 1, TimeUnit.SECONDS);
+
+        try {
+            System.out.println("Press ENTER to stop");
+            System.in.read();
+        } catch (IOException e) {
+            e.printStackTrace();
+        }
+
+        reporter.shutdownNow();
+        moduleProxy.detach();
+    }
+}
@@ -77,7 +77,7 @@ int main(int argc, char** argv)
         {
             printf("failed to attach remote module from JSON\n");
         }
-        else if (0 != ProxyGateway_StartWorkerThread(remote_module))
+        else if (0 != ProxyGateway_StartBlockingWorkerThread(remote_module))
         {
             printf("failed to start the worker thread\n");
         }
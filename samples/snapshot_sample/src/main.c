@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gateway.h"
+
+static void print_usage(void)
+{
+    printf("usage: snapshot_sample compile configFile snapshotFile\n");
+    printf("       snapshot_sample run snapshotFile\n");
+    printf("where configFile is the name of the file that contains the Gateway configuration\n");
+    printf("and snapshotFile is the name of the compiled snapshot\n");
+}
+
+int main(int argc, char** argv)
+{
+    int result;
+    if (argc == 4 && strcmp(argv[1], "compile") == 0)
+    {
+        if (Gateway_CompileJsonSnapshot(argv[2], argv[3]) != 0)
+        {
+            printf("failed to compile %s\n", argv[2]);
+            result = 1;
+        }
+        else
+        {
+            printf("%s compiled to %s\n", argv[2], argv[3]);
+            result = 0;
+        }
+    }
+    else if (argc == 3 && strcmp(argv[1], "run") == 0)
+    {
+        GATEWAY_HANDLE gateway = Gateway_CreateFromSnapshot(argv[2]);
+        if (gateway == NULL)
+        {
+            printf("failed to create the gateway from the snapshot\n");
+            result = 1;
+        }
+        else
+        {
+            printf("gateway successfully created from the snapshot\n");
+            printf("gateway shall run until ENTER is pressed\n");
+            (void)getchar();
+            Gateway_Destroy(gateway);
+            result = 0;
+        }
+    }
+    else
+    {
+        print_usage();
+        result = 1;
+    }
+    return result;
+}